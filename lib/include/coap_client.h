@@ -45,11 +45,115 @@
 
 #define COAP_CLIENT_HOST_BUF_LEN  128                                           /**< Buffer length for host addresses */
 #define COAP_CLIENT_PORT_BUF_LEN  8                                             /**< Buffer length for port numbers */
+#define COAP_CLIENT_ASYNC_NUM     256                                           /**< Default maximum number of outstanding asynchronous requests */
+
+#define coap_client_async_get_fd(client)   ((client)->async_fd)                 /**< Get the file descriptor that becomes readable when asynchronous requests need processing */
+#define coap_client_async_get_num(client)  ((client)->async_pending)            /**< Get the number of outstanding asynchronous requests */
+#define coap_client_get_block_window(client)       ((client)->block_window)           /**< Get the number of block2 requests kept in flight by blockwise GET transfers */
+#define coap_client_set_block_window(client, num)  ((client)->block_window = (num))  /**< Set the number of block2 requests kept in flight by blockwise GET transfers, 0 or 1 for stop-and-wait */
+
+struct coap_client;
+
+/**
+ *  @brief Asynchronous request completion call-back function
+ *
+ *  Called exactly once for each asynchronous request, and
+ *  again for each notification of an observation. If
+ *  status is 0 then resp contains the response, otherwise
+ *  resp is NULL. The response may refer to a buffer in the
+ *  client structure and is only valid for the duration of
+ *  the call. The call-back function may send new requests
+ *  but must not destroy the client structure.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in] req Pointer to the request message
+ *  @param[in] resp Pointer to the response message or NULL
+ *  @param[in] status 0 on success, -ETIMEDOUT, -ECONNRESET, -EBADMSG or -ECANCELED otherwise
+ *  @param[in] data Pointer supplied when the request was sent
+ */
+typedef void (* coap_client_handler_t)(struct coap_client *client, coap_msg_t *req, coap_msg_t *resp, int status, void *data);
+
+/**
+ *  @brief Blockwise transfer source call-back function
+ *
+ *  Called to copy part of the request body into a buffer.
+ *  The body is read at increasing offsets but a range may
+ *  be requested more than once.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in] offset Byte offset into the body
+ *  @param[out] buf Buffer to hold the data
+ *  @param[in] len Length of the buffer
+ *  @param[in] data Pointer supplied by the application
+ *
+ *  @returns Number of bytes copied or error code
+ *  @retval >=0 Number of bytes copied, less than len at the end of the body
+ *  @retval <0 Error
+ */
+typedef ssize_t (* coap_client_block_read_t)(struct coap_client *client, size_t offset, char *buf, size_t len, void *data);
+
+/**
+ *  @brief Blockwise transfer sink call-back function
+ *
+ *  Called with each block of the response body as it
+ *  arrives. Blocks are delivered in order unless a block
+ *  window has been set with coap_client_set_block_window.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in] offset Byte offset of the block in the body
+ *  @param[in] buf Buffer containing the block
+ *  @param[in] len Length of the block
+ *  @param[in] more Flag to indicate that the block is not the last one in the body
+ *  @param[in] data Pointer supplied by the application
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+typedef int (* coap_client_block_write_t)(struct coap_client *client, size_t offset, const char *buf, size_t len, int more, void *data);
+
+/**
+ *  @brief Outstanding asynchronous request structure
+ */
+typedef struct coap_client_req
+{
+    int active;                                                                 /**< Flag to indicate if this structure contains an outstanding request */
+    int acked;                                                                  /**< Flag to indicate that an empty acknowledgement has been received */
+    coap_msg_t req;                                                             /**< Request message */
+    struct timespec timeout;                                                    /**< Acknowledgement timeout value */
+    struct timespec expiry;                                                     /**< Absolute time at which the current timeout expires */
+    unsigned num_retrans;                                                       /**< Current number of retransmissions */
+    coap_client_handler_t handle;                                               /**< Completion call-back function */
+    void *data;                                                                 /**< Pointer passed to the completion call-back function */
+    int observe;                                                                /**< Flag to indicate that the request registers an observation */
+    int registered;                                                             /**< Flag to indicate that the server has accepted the observation */
+    int in_handle;                                                              /**< Flag set while the call-back function is called for a notification */
+    int cancelled;                                                              /**< Flag to indicate that the observation was cancelled by the call-back function */
+    unsigned obs_seq;                                                           /**< Observe option value of the freshest notification */
+    struct timespec obs_time;                                                   /**< Time at which the freshest notification was received */
+    struct coap_client_req *hash_next;                                          /**< Pointer to the next structure in the message ID hash chain or the free list */
+    struct coap_client_req *prev;                                               /**< Pointer to the previous structure in the list of outstanding requests */
+    struct coap_client_req *next;                                               /**< Pointer to the next structure in the list of outstanding requests */
+}
+coap_client_req_t;
 
 /**
  *  @brief Client structure
+ *
+ *  Asynchronous requests are kept in a table that is
+ *  allocated by coap_client_async_create. Acknowledgements
+ *  and resets are matched to requests by message ID using
+ *  a hash table and responses are matched by token, which
+ *  encodes the index of the request in the table.
+ *
+ *  An observation is an asynchronous request that stays in
+ *  the table after its response, which matches notifications
+ *  by token until the observation ends.
+ *
+ *  If block_window is greater than one then blockwise GET
+ *  transfers keep that many block2 requests in flight.
  */
-typedef struct
+typedef struct coap_client
 {
     int sd;                                                                     /**< Socket descriptor */
     int timer_fd;                                                               /**< Timer file descriptor */
@@ -59,6 +163,19 @@ typedef struct
     socklen_t server_sin_len;                                                   /**< Socket structure length */
     char server_host[COAP_CLIENT_HOST_BUF_LEN];                                 /**< String to hold the server host address */
     char server_port[COAP_CLIENT_PORT_BUF_LEN];                                 /**< String to hold the server port number */
+    char recv_buf[COAP_MSG_MAX_BUF_LEN];                                        /**< Buffer for received messages */
+    coap_client_req_t *async_req;                                               /**< Array of asynchronous request structures */
+    unsigned async_num;                                                         /**< Number of asynchronous request structures */
+    unsigned async_pending;                                                     /**< Number of outstanding asynchronous requests */
+    coap_client_req_t **async_hash;                                             /**< Hash table of outstanding asynchronous requests indexed by message ID */
+    unsigned async_hash_mask;                                                   /**< Number of hash table buckets minus one */
+    coap_client_req_t *async_first;                                             /**< List of outstanding asynchronous requests */
+    coap_client_req_t *async_free;                                              /**< List of free asynchronous request structures */
+    unsigned async_msg_id;                                                      /**< Last message ID value used in an asynchronous request */
+    int async_timer_fd;                                                         /**< Timer file descriptor for asynchronous requests */
+    struct timespec async_expiry;                                               /**< Absolute time at which the asynchronous timer expires or zero if it is not running */
+    int async_fd;                                                               /**< Epoll file descriptor for the socket and the asynchronous timer */
+    unsigned block_window;                                                      /**< Number of block2 requests kept in flight by blockwise GET transfers */
 #ifdef COAP_DTLS_EN
     gnutls_session_t session;                                                   /**< DTLS session */
     gnutls_certificate_credentials_t cred;                                      /**< DTLS credentials */
@@ -147,6 +264,16 @@ int coap_client_exchange(coap_client_t *client, coap_msg_t *req, coap_msg_t *res
  *  the request message overriding any values set by the
  *  calling function.
  *
+ *  If a block window greater than one has been set with
+ *  coap_client_set_block_window then a GET transfer keeps
+ *  that many block2 requests in flight after the first
+ *  block has been received, stores each block in the body
+ *  by block number and retransmits only the requests that
+ *  are not answered. A windowed transfer uses the
+ *  asynchronous request table internally and fails with
+ *  -EBUSY if coap_client_async_create has been called.
+ *  Block1 transfers are always stop-and-wait.
+ *
  *  @param[in,out] client Pointer to a client structure
  *  @param[in] req Pointer to the request message
  *  @param[out] resp Pointer to the response message
@@ -165,4 +292,152 @@ ssize_t coap_client_exchange_blockwise(coap_client_t *client,
                                        unsigned block1_size, unsigned block2_size,
                                        char *body, size_t body_len, int have_resp);
 
+/**
+ *  @brief Exchange with the server using streaming blockwise transfers
+ *
+ *  This function behaves like coap_client_exchange_blockwise
+ *  except that the request body is pulled from block_read
+ *  one block at a time and the response body is pushed to
+ *  block_write as each block arrives, so the size of the
+ *  body is not limited by a buffer. The error returned by
+ *  a call-back function is returned by this function.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in] req Pointer to the request message
+ *  @param[out] resp Pointer to the response message
+ *  @param[in] block1_size Block1 size
+ *  @param[in] block2_size Block2 size
+ *  @param[in] block_read Call-back function to produce the request body for PUT and POST requests
+ *  @param[in] block_write Call-back function to consume the response body
+ *  @param[in] data Pointer to pass to the call-back functions
+ *  @param[in] have_resp Flag to indicate that the first response has already been received
+ *
+ *  @returns Operation status
+ *  @retval >=0 Length of the data received
+ *  @retval <0 Error
+ **/
+ssize_t coap_client_exchange_blockwise_stream(coap_client_t *client,
+                                              coap_msg_t *req, coap_msg_t *resp,
+                                              unsigned block1_size, unsigned block2_size,
+                                              coap_client_block_read_t block_read,
+                                              coap_client_block_write_t block_write,
+                                              void *data, int have_resp);
+
+/**
+ *  @brief Prepare a client structure for asynchronous requests
+ *
+ *  Allocate the table of outstanding requests and create
+ *  the file descriptor returned by coap_client_async_get_fd.
+ *  Asynchronous requests and calls to coap_client_exchange
+ *  must not be mixed while requests are outstanding.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in] num Maximum number of outstanding requests, 0 to use COAP_CLIENT_ASYNC_NUM
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+int coap_client_async_create(coap_client_t *client, unsigned num);
+
+/**
+ *  @brief Release the asynchronous request resources in a client structure
+ *
+ *  The completion call-back function of each outstanding
+ *  request and observation is called with status -ECANCELED.
+ *  This function is called by coap_client_destroy.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ */
+void coap_client_async_destroy(coap_client_t *client);
+
+/**
+ *  @brief Send a request to the server without waiting for the response
+ *
+ *  This function sets the message ID and token fields of
+ *  the request message overriding any values set by the
+ *  calling function. The request is copied into the client
+ *  structure so the caller keeps ownership of req.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in,out] req Pointer to the request message
+ *  @param[in] handle Completion call-back function
+ *  @param[in] data Pointer to pass to the completion call-back function
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval -ENOSPC Too many outstanding requests
+ *  @retval <0 Error
+ */
+int coap_client_async_send(coap_client_t *client, coap_msg_t *req, coap_client_handler_t handle, void *data);
+
+/**
+ *  @brief Observe a resource on the server
+ *
+ *  Send a GET request with an Observe option value of 0 to
+ *  register interest in the resource. The call-back function
+ *  is called with the response and then with each notification
+ *  that is fresher than the last one received, all using the
+ *  token of the request. Notifications arriving out of order
+ *  are discarded. The observation ends, and the call-back
+ *  function is not called again, after it is called with a
+ *  non-zero status or a response without an Observe option,
+ *  e.g. an error response or a server that does not support
+ *  observation. While the observation lasts it occupies one
+ *  of the asynchronous request structures but is not counted
+ *  by coap_client_async_get_num.
+ *
+ *  This function sets the message ID and token fields of
+ *  the request message and adds the Observe option, which
+ *  must not already be present.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in,out] req Pointer to the GET request message
+ *  @param[in] handle Call-back function for the response and the notifications
+ *  @param[in] data Pointer to pass to the call-back function
+ *
+ *  @returns Observation identifier or error code
+ *  @retval >=0 Observation identifier
+ *  @retval -ENOSPC Too many outstanding requests
+ *  @retval <0 Error
+ */
+int coap_client_async_observe(coap_client_t *client, coap_msg_t *req, coap_client_handler_t handle, void *data);
+
+/**
+ *  @brief Cancel an observation
+ *
+ *  Forget the observation and send a non-confirmable GET
+ *  request with an Observe option value of 1 so the server
+ *  stops sending notifications. Any notification received
+ *  afterwards is rejected with a reset message. The call-back
+ *  function is not called, and this function may be called
+ *  from within it.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in] id Observation identifier returned by coap_client_async_observe
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+int coap_client_async_cancel_observe(coap_client_t *client, int id);
+
+/**
+ *  @brief Process received messages and expired timers
+ *
+ *  Receive all messages waiting on the socket, match them
+ *  to outstanding requests, retransmit confirmable requests
+ *  and call completion call-back functions. This function
+ *  does not block and should be called whenever the file
+ *  descriptor returned by coap_client_async_get_fd becomes
+ *  readable.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+int coap_client_async_process(coap_client_t *client);
+
 #endif
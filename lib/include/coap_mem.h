@@ -29,6 +29,15 @@
  *  @file coap_mem.h
  *
  *  @brief Include file for the FreeCoAP memory allocator
+ *
+ *  A memory allocator structure must only be used by one thread
+ *  at a time. If COAP_MEM_THREAD_EN is defined then the small,
+ *  medium and large memory allocators can be used by several
+ *  threads at once. Each thread then takes buffers from and
+ *  returns buffers to these memory allocators in batches
+ *  through a small per-thread cache. An allocation only fails
+ *  when no buffer is free in the memory allocator or in the
+ *  cache of any thread.
  */
 
 #ifndef COAP_MEM_H
@@ -41,9 +50,16 @@
 #define coap_mem_get_len(mem)         ((mem)->len)                              /**< Get the length of each buffer in a memory allocator */
 #define coap_mem_get_active(mem)      ((mem)->active)                           /**< Get the active bitset from a memory allocator */
 #define coap_mem_get_active_len(mem)  ((mem)->num >> 3)                         /**< Get the length of the active bitset from a memory allocator */
+#define coap_mem_get_free_num(mem)    ((mem)->free_num)                         /**< Get the number of free buffers in a memory allocator */
 
 /**
  *  @brief Memory allocator structure
+ *
+ *  The free list is a stack containing the indices of the
+ *  buffers that are not in use. Buffers are allocated from
+ *  and returned to the top of the stack so that allocation
+ *  and deallocation take constant time. The active bitset
+ *  is kept in step with the free list.
  */
 typedef struct
 {
@@ -51,6 +67,8 @@ typedef struct
     size_t num;                                                                 /**< Number of buffers */
     size_t len;                                                                 /**< Length of each buffer */
     char *active;                                                               /**< Bitset marking active buffers */
+    size_t *free_list;                                                          /**< Stack of indices of free buffers */
+    size_t free_num;                                                            /**< Number of indices in the free list */
 }
 coap_mem_t;
 
@@ -87,6 +105,9 @@ void *coap_mem_alloc(coap_mem_t *mem, size_t len);
 /**
  *  @brief Return a buffer back to a memory allocator
  *
+ *  Pointers that do not refer to an active
+ *  buffer in the memory allocator are ignored.
+ *
  *  @param[in,out] mem Pointer to a memory allocator
  *  @param[in] buf Pointer to a buffer
  */
@@ -48,6 +48,9 @@
 #define COAP_MSG_OP_MAX_BLOCK_SIZE                  (1 << 10)                   /**< Maximum block size for a Block1 or Block2 option */
 #define COAP_MSG_MAX_BUF_LEN                        1152                        /**< Maximum buffer length for header and payload */
 #define COAP_MSG_MAX_PAYLOAD_LEN                    1024                        /**< Maximum buffer length for payload */
+#define COAP_MSG_OP_INLINE_NUM                      8                           /**< Number of option structures stored inline in a message structure */
+#define COAP_MSG_OP_INLINE_MAX_LEN                  64                          /**< Maximum length of an option value stored inline in a message structure */
+#define COAP_MSG_OP_INLINE_BUF_LEN                  256                         /**< Buffer length for option values stored inline in a message structure */
 
 #define coap_msg_block_szx_to_size(szx)             (1 << ((szx) + 4)))         /**< Convert a block size exponent value to a size value */
 #define coap_msg_block_start_to_num(start, szx)     ((start) >> ((szx) + 4))    /**< Convert a start byte value to a block num value */
@@ -75,6 +78,7 @@
 #define coap_msg_get_first_op(msg)                  ((msg)->op_list.first)      /**< Get the first option from a message */
 #define coap_msg_get_payload(msg)                   ((msg)->payload)            /**< Get the payload from a message */
 #define coap_msg_get_payload_len(msg)               ((msg)->payload_len)        /**< Get the payload length from a message */
+#define coap_msg_is_view(msg)                       ((msg)->view)               /**< Indicate if a message is a read-only view into a receive buffer */
 #define coap_msg_is_empty(msg)                      (((msg)->code_class == 0) && ((msg)->code_detail == 0))
                                                                                 /**< Indicate if a message is empty */
 
@@ -170,6 +174,7 @@ typedef enum
     COAP_MSG_URI_HOST = 3,                                                      /**< URI-Host option number */
     COAP_MSG_ETAG = 4,                                                          /**< Entity-Tag option number */
     COAP_MSG_IF_NONE_MATCH = 5,                                                 /**< If-None-Match option number */
+    COAP_MSG_OBSERVE = 6,                                                       /**< Observe option number */
     COAP_MSG_URI_PORT = 7,                                                      /**< URI-Port option number */
     COAP_MSG_LOCATION_PATH = 8,                                                 /**< Location-Path option number */
     COAP_MSG_URI_PATH = 11,                                                     /**< URI-Path option number */
@@ -211,6 +216,13 @@ coap_msg_op_list_t;
 
 /**
  *  @brief Message structure
+ *
+ *  The first COAP_MSG_OP_INLINE_NUM option structures and option
+ *  values of up to COAP_MSG_OP_INLINE_MAX_LEN bytes are stored in
+ *  the message structure itself. Further options are allocated
+ *  from the small and medium memory allocators. As the option list
+ *  can point into the message structure, a message structure must
+ *  not be copied by assignment. Use coap_msg_copy instead.
  */
 typedef struct
 {
@@ -222,8 +234,13 @@ typedef struct
     unsigned msg_id;                                                            /**< Message ID */
     char token[COAP_MSG_MAX_TOKEN_LEN];                                         /**< Token value */
     coap_msg_op_list_t op_list;                                                 /**< Option list */
+    coap_msg_op_t op_inline[COAP_MSG_OP_INLINE_NUM];                            /**< Option structures stored inline */
+    unsigned op_inline_num;                                                     /**< Number of inline option structures in use */
+    char op_buf[COAP_MSG_OP_INLINE_BUF_LEN];                                    /**< Buffer for option values stored inline */
+    size_t op_buf_end;                                                          /**< Amount of the inline option value buffer in use */
     char *payload;                                                              /**< Pointer to a buffer containing the payload */
     size_t payload_len;                                                         /**< Length of the payload */
+    int view;                                                                   /**< Option values and payload point into a buffer owned by the caller */
 }
 coap_msg_t;
 
@@ -279,6 +296,36 @@ int coap_msg_op_parse_block_val(unsigned *num, unsigned *more, unsigned *size, c
  */
 int coap_msg_op_format_block_val(char *val, unsigned len, unsigned num, unsigned more, unsigned size);
 
+/**
+ *  @brief Parse an unsigned integer option value
+ *
+ *  Unsigned integer option values, e.g. Observe,
+ *  Max-Age and Size1, are big-endian and carry no
+ *  leading zero bytes.
+ *
+ *  @param[out] num Pointer to the integer value
+ *  @param[in] val Pointer to the option value
+ *  @param[in] len Option length
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+int coap_msg_op_parse_uint_val(unsigned *num, const char *val, unsigned len);
+
+/**
+ *  @brief Format an unsigned integer option value
+ *
+ *  @param[out] val Pointer to a buffer to store the option value
+ *  @param[in] len Length of the buffer
+ *  @param[in] num Integer value
+ *
+ *  @returns Length of the formatted option value or error code
+ *  @retval >=0 Length of the formatted option value
+ *  @retval <0 Error
+ */
+int coap_msg_op_format_uint_val(char *val, unsigned len, unsigned num);
+
 /**
  *  @brief Generate a random string of bytes
  *
@@ -377,6 +424,41 @@ int coap_msg_parse_block_op(unsigned *num, unsigned *more, unsigned *size, coap_
  */
 ssize_t coap_msg_parse(coap_msg_t *msg, char *buf, size_t len);
 
+/**
+ *  @brief Parse a message without copying the option values or payload
+ *
+ *  The option values and payload in the resulting message
+ *  point into the buffer containing the message so the
+ *  buffer must not be modified or freed while the message
+ *  is in use. The payload is not null-terminated. Options
+ *  and payload cannot be added to or set in the message
+ *  until it is detached from the buffer by coap_msg_detach.
+ *
+ *  @param[in,out] msg Pointer to a message structure
+ *  @param[in] buf Pointer to a buffer containing the message
+ *  @param[in] len Length of the buffer
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+ssize_t coap_msg_parse_view(coap_msg_t *msg, char *buf, size_t len);
+
+/**
+ *  @brief Copy the option values and payload of a message view into the message
+ *
+ *  After this call the message no longer refers to the
+ *  buffer it was parsed from. Has no effect on a message
+ *  that is not a view.
+ *
+ *  @param[in,out] msg Pointer to a message structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+int coap_msg_detach(coap_msg_t *msg);
+
 /**
  *  @brief Set the type in a message
  *
@@ -34,6 +34,7 @@
 #ifndef COAP_SERVER_H
 #define COAP_SERVER_H
 
+#include <stdint.h>
 #include <time.h>
 #include <netinet/in.h>
 #ifdef COAP_DTLS_EN
@@ -43,9 +44,24 @@
 #include "coap_msg.h"
 #include "coap_ipv.h"
 
-#define COAP_SERVER_NUM_TRANS                       8                           /**< Maximum number of active transactions per server */
+#define COAP_SERVER_NUM_TRANS                       8                           /**< Default maximum number of active transactions per server */
+#define COAP_SERVER_TIMER_WHEEL_SIZE                256                         /**< Number of slots in the timer wheel (must be a power of 2) */
+#define COAP_SERVER_BATCH_SIZE                      16                          /**< Maximum number of datagrams received or sent with each system call */
 #define COAP_SERVER_ADDR_BUF_LEN                    128                         /**< Buffer length for host addresses */
 #define COAP_SERVER_DIAG_PAYLOAD_LEN                128                         /**< Buffer length for diagnostic payloads */
+#define COAP_SERVER_RES_NUM_METHODS                 (COAP_MSG_DELETE + 1)       /**< Number of request methods indexed in a resource structure */
+#define COAP_SERVER_RES_HASH_SIZE                   16                          /**< Initial number of buckets in the resource hash table (must be a power of 2) */
+#define COAP_SERVER_OBS_HASH_SIZE                   64                          /**< Number of buckets in the observer hash table (must be a power of 2) */
+#define COAP_SERVER_TRANS_MAX_OBS                   8                           /**< Maximum number of resources observed by each client endpoint */
+#define COAP_SERVER_CACHE_NUM                       64                          /**< Default number of entries in the response cache */
+#define COAP_SERVER_CACHE_KEY_LEN                   256                         /**< Maximum length of a response cache key */
+#define COAP_SERVER_CACHE_ETAG_LEN                  8                           /**< Maximum length of an ETag option value */
+#define COAP_SERVER_CACHE_GEN_NUM                   64                          /**< Number of response cache generation counters shared by the workers of a server, must be a power of 2 */
+#define COAP_SERVER_DEDUP_PER_TRANS                 16                          /**< Number of entries in the message ID deduplication table for each transaction structure */
+#define COAP_SERVER_STATS_URI_PATH                  "/.well-known/stats"        /**< URI path of the statistics resource */
+#define COAP_SERVER_HIST_SUB_BITS                   3                           /**< Number of bits of each value kept by a latency histogram */
+#define COAP_SERVER_HIST_MAX_BITS                   36                          /**< Number of bits in the largest value counted by a latency histogram */
+#define COAP_SERVER_HIST_NUM_BUCKETS                ((COAP_SERVER_HIST_MAX_BITS - COAP_SERVER_HIST_SUB_BITS + 1) << COAP_SERVER_HIST_SUB_BITS)  /**< Number of buckets in a latency histogram */
 
 #define coap_server_trans_get_type(trans)           ((trans)->type)             /**< Get the type of transaction */
 #define coap_server_trans_get_req(trans)            (&(trans)->req)             /**< Get the last request message received for this transaction */
@@ -54,6 +70,7 @@
 #define coap_server_trans_get_body_len(trans)       ((trans)->body_len)         /**< Get the length of the body of a blockwise transfer */
 #define coap_server_trans_get_body_end(trans)       ((trans)->body_end)         /**< Get the amount of relevant data in body of a blockwise transfer */
 #define coap_server_trans_set_body_end(trans, i)    ((trans)->body_end = (i))   /**< Get the amount of relevant data in body of a blockwise transfer */
+#define coap_server_trans_get_block_data(trans)     ((trans)->block_data)       /**< Get the application data of a streaming blockwise transfer */
 
 /**
  *  @brief Transaction type enumeration
@@ -98,36 +115,230 @@ struct coap_server_trans;
 typedef int (* coap_server_trans_handler_t)(struct coap_server_trans *trans, coap_msg_t *req, coap_msg_t *resp);
 
 /**
- *  @brief URI path structure
+ *  @brief Blockwise transfer producer callback function
+ *
+ *  Called to copy part of the body of a streaming blockwise
+ *  transfer into a buffer. The body is read at random offsets
+ *  so the same range may be requested more than once.
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in] offset Byte offset into the body
+ *  @param[out] buf Buffer to hold the data
+ *  @param[in] len Length of the buffer
+ *  @param[in] data Pointer to application data
+ *
+ *  @returns Number of bytes copied or error code
+ *  @retval >=0 Number of bytes copied, less than len at the end of the body
+ *  @retval <0 Error
+ */
+typedef ssize_t (* coap_server_trans_block_read_t)(struct coap_server_trans *trans, size_t offset, char *buf, size_t len, void *data);
+
+/**
+ *  @brief Blockwise transfer consumer callback function
+ *
+ *  Called with each block of the body of a streaming blockwise
+ *  transfer as it arrives. Blocks are delivered in order.
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in] offset Byte offset of the block in the body
+ *  @param[in] buf Buffer containing the block
+ *  @param[in] len Length of the block
+ *  @param[in] more Flag to indicate that more blocks follow
+ *  @param[in] data Pointer to application data
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval -ENOSPC The body is too large
+ *  @retval <0 Error
+ */
+typedef int (* coap_server_trans_block_write_t)(struct coap_server_trans *trans, size_t offset, const char *buf, size_t len, int more, void *data);
+
+/**
+ *  @brief Resource structure
+ *
+ *  Resources form a trie over the URI-Path option segments
+ *  of a request. Each resource other than the root is stored
+ *  in a hash table keyed by its parent and its segment so the
+ *  child for the next segment is found in constant time.
  */
-typedef struct coap_server_path
+typedef struct coap_server_res
 {
-    char *str;                                                                  /**< String containing a path */
-    struct coap_server_path *next;                                              /**< Pointer to the next URI path structure in the list */
+    struct coap_server_res *parent;                                             /**< Pointer to the parent resource structure or NULL for the root */
+    char *seg;                                                                  /**< URI path segment */
+    size_t seg_len;                                                             /**< Length of the URI path segment */
+    unsigned hash;                                                              /**< Hash value of the parent and the URI path segment */
+    int sep;                                                                    /**< Flag to indicate that requests for this resource require separate responses */
+    coap_server_trans_handler_t handle[COAP_SERVER_RES_NUM_METHODS];            /**< Call-back functions to handle requests indexed by request method */
+    unsigned obs_seq;                                                           /**< Number of changes to the resource signalled by coap_server_notify */
+    struct coap_server_res *hash_next;                                          /**< Pointer to the next resource structure in the hash chain */
 }
-coap_server_path_t;
+coap_server_res_t;
 
 /**
- *  @brief URI path list structure
+ *  @brief Observer structure
+ *
+ *  An observer is a client endpoint that has registered
+ *  interest in a resource with a GET request containing
+ *  an Observe option. Observers are stored in a hash
+ *  table keyed by resource so all of the observers of
+ *  a resource share a hash chain, and are also linked
+ *  to the transaction structure of the client endpoint.
+ */
+typedef struct coap_server_obs
+{
+    coap_server_res_t *res;                                                     /**< Pointer to the observed resource structure */
+    struct coap_server_trans *trans;                                            /**< Pointer to the transaction structure of the client endpoint */
+    char token[COAP_MSG_MAX_TOKEN_LEN];                                         /**< Token of the registration request */
+    unsigned token_len;                                                         /**< Length of the token */
+    unsigned seq;                                                               /**< Value of the change count of the resource when the client was last notified */
+    unsigned msg_id;                                                            /**< Message ID of the last notification */
+    int notified;                                                               /**< Flag to indicate that a notification has been sent */
+    struct coap_server_obs *hash_next;                                          /**< Pointer to the next observer structure in the hash chain */
+    struct coap_server_obs *trans_next;                                         /**< Pointer to the next observer structure of the same transaction */
+}
+coap_server_obs_t;
+
+/**
+ *  @brief Response cache entry structure
+ *
+ *  A response cache entry holds a response formatted
+ *  without a token so that it can be sent to any client
+ *  that makes the same request by patching in the type,
+ *  message ID and token of the client, and the remaining
+ *  lifetime of the entry as the Max-Age option.
+ */
+typedef struct coap_server_cache_entry
+{
+    char key[COAP_SERVER_CACHE_KEY_LEN];                                        /**< Method and URI-Path, URI-Query and Accept options of the request */
+    size_t key_len;                                                             /**< Length of the key */
+    size_t path_len;                                                            /**< Length of the part of the key that contains the method and URI-Path options */
+    unsigned hash;                                                              /**< Hash value of the key */
+    char *resp;                                                                 /**< Buffer containing the formatted response */
+    size_t resp_len;                                                            /**< Length of the formatted response */
+    size_t resp_max_age_off;                                                    /**< Offset of the Max-Age option in the formatted response */
+    char *valid;                                                                /**< Buffer containing a formatted 2.03 (Valid) response or NULL if the response has no ETag */
+    size_t valid_len;                                                           /**< Length of the formatted 2.03 (Valid) response */
+    size_t valid_max_age_off;                                                   /**< Offset of the Max-Age option in the formatted 2.03 (Valid) response */
+    char etag[COAP_SERVER_CACHE_ETAG_LEN];                                      /**< ETag option value of the response */
+    unsigned etag_len;                                                          /**< Length of the ETag option value */
+    struct timespec expiry;                                                     /**< Time at which the response stops being fresh */
+    unsigned gen;                                                               /**< Generation counter value of the URI path when the response was generated, always 0 if COAP_SERVER_THREAD_EN is not defined */
+    struct coap_server_cache_entry *hash_next;                                  /**< Pointer to the next entry in the hash chain or the free list */
+    struct coap_server_cache_entry *lru_prev;                                   /**< Pointer to the next more recently used entry */
+    struct coap_server_cache_entry *lru_next;                                   /**< Pointer to the next less recently used entry */
+}
+coap_server_cache_entry_t;
+
+/**
+ *  @brief Message ID deduplication entry structure
+ *
+ *  A deduplication entry records a request from a client
+ *  endpoint whose transaction structure has been reused,
+ *  with the formatted piggy-backed response if there was
+ *  one, so that a duplicate of the request received within
+ *  EXCHANGE_LIFETIME is not passed to the handler again.
+ */
+typedef struct coap_server_dedup
+{
+    coap_ipv_sockaddr_in_t sin;                                                 /**< Socket structure of the client endpoint */
+    socklen_t sin_len;                                                          /**< Socket structure length */
+    unsigned msg_id;                                                            /**< Message ID of the request */
+    unsigned type;                                                              /**< Type of the request */
+    char *resp;                                                                 /**< Buffer containing the formatted piggy-backed response or NULL */
+    size_t resp_len;                                                            /**< Length of the formatted piggy-backed response */
+    time_t expiry;                                                              /**< Time at which the message ID may be reused */
+    struct coap_server_dedup *hash_next;                                        /**< Pointer to the next entry in the hash chain */
+}
+coap_server_dedup_t;
+
+/**
+ *  @brief Server processing stage enumeration
+ */
+typedef enum
+{
+    COAP_SERVER_STAGE_RECV = 0,                                                 /**< From the start of an exchange until the request is read */
+    COAP_SERVER_STAGE_PARSE,                                                    /**< Parsing the request */
+    COAP_SERVER_STAGE_HANDLER,                                                  /**< Checking the options and calling the handler */
+    COAP_SERVER_STAGE_FORMAT,                                                   /**< Completing and formatting the response */
+    COAP_SERVER_STAGE_SEND,                                                     /**< Sending, or queueing, the response */
+    COAP_SERVER_STAGE_FLUSH,                                                    /**< Sending a batch of queued datagrams */
+    COAP_SERVER_NUM_STAGES                                                      /**< Number of stages */
+}
+coap_server_stage_t;
+
+/**
+ *  @brief Latency histogram structure
+ *
+ *  Values are durations in nanoseconds. Values below
+ *  2^COAP_SERVER_HIST_SUB_BITS have a bucket each and larger
+ *  values are counted in buckets whose width is proportional
+ *  to the value so that the relative error is bounded by
+ *  2^-COAP_SERVER_HIST_SUB_BITS. Values of
+ *  2^COAP_SERVER_HIST_MAX_BITS or more are counted in the
+ *  last bucket.
  */
 typedef struct
 {
-    coap_server_path_t *first;                                                  /**< Pointer to the first URI path structure in the list */
-    coap_server_path_t *last;                                                   /**< Pointer to the last URI path structure in the list */
+    uint64_t count;                                                             /**< Number of values */
+    uint64_t sum;                                                               /**< Sum of the values */
+    uint64_t max;                                                               /**< Largest value */
+    uint64_t bucket[COAP_SERVER_HIST_NUM_BUCKETS];                              /**< Number of values in each bucket */
 }
-coap_server_path_list_t;
+coap_server_hist_t;
+
+/**
+ *  @brief Server statistics structure
+ */
+typedef struct
+{
+    coap_server_hist_t stage[COAP_SERVER_NUM_STAGES];                           /**< Latency histogram of each processing stage */
+    uint64_t num_req;                                                           /**< Number of requests received, excluding duplicates */
+    uint64_t num_dup;                                                           /**< Number of duplicate requests received */
+    uint64_t num_retrans;                                                       /**< Number of confirmable responses retransmitted */
+    uint64_t num_timeout;                                                       /**< Number of confirmable responses never acknowledged */
+    uint64_t num_evict;                                                         /**< Number of active transaction structures reused for another client endpoint */
+    uint64_t trans_active;                                                      /**< Number of active transaction structures */
+    uint64_t trans_max;                                                         /**< Number of transaction structures */
+}
+coap_server_stats_t;
 
 struct coap_server;
 
+#ifndef COAP_DTLS_EN
+
+/**
+ *  @brief Datagram structure
+ */
+typedef struct
+{
+    char buf[COAP_MSG_MAX_BUF_LEN];                                             /**< Buffer containing the datagram */
+    const char *data;                                                           /**< Pointer to the datagram to be sent, either buf or the formatted response of a transaction structure */
+    size_t len;                                                                 /**< Length of the datagram */
+    coap_ipv_sockaddr_in_t sin;                                                 /**< Socket structure of the remote endpoint */
+    socklen_t sin_len;                                                          /**< Socket structure length */
+    struct coap_server_trans *trans;                                            /**< Pointer to the transaction structure whose formatted response is to be sent, or NULL */
+}
+coap_server_dgram_t;
+
+#endif
+
 /**
  *  @brief Transaction structure
+ *
+ *  The last response is kept both as a message structure
+ *  and formatted so that retransmissions and replies to
+ *  duplicate requests are sent without formatting it again.
  */
 typedef struct coap_server_trans
 {
     int active;                                                                 /**< Flag to indicate if this transaction structure contains valid data */
     coap_server_trans_type_t type;                                              /**< Transaction type */
     time_t last_use;                                                            /**< The time that this transaction structure was last used */
-    int timer_fd;                                                               /**< Timer file descriptor */
+    int timer_running;                                                          /**< Flag to indicate if the acknowledgement timer is in the timer wheel */
+    unsigned timer_slot;                                                        /**< Timer wheel slot holding the acknowledgement timer */
+    unsigned timer_rounds;                                                      /**< Number of timer wheel revolutions left before the acknowledgement timer expires */
+    struct coap_server_trans *timer_prev;                                       /**< Pointer to the previous transaction structure in the timer wheel slot */
+    struct coap_server_trans *timer_next;                                       /**< Pointer to the next transaction structure in the timer wheel slot */
     struct timespec timeout;                                                    /**< Timeout value */
     unsigned num_retrans;                                                       /**< Current number of retransmissions */
     coap_ipv_sockaddr_in_t client_sin;                                          /**< Socket structure */
@@ -135,6 +346,11 @@ typedef struct coap_server_trans
     char client_addr[COAP_SERVER_ADDR_BUF_LEN];                                 /**< String to hold the client address */
     coap_msg_t req;                                                             /**< Last request message received for this transaction */
     coap_msg_t resp;                                                            /**< Last response message sent for this transaction */
+    char resp_buf[COAP_MSG_MAX_BUF_LEN];                                        /**< Last response message sent for this transaction, formatted */
+    size_t resp_len;                                                            /**< Length of the formatted response message or 0 if there is none */
+#ifndef COAP_DTLS_EN
+    int resp_queued;                                                            /**< Flag to indicate that the send batch refers to the formatted response message */
+#endif
     char *body;                                                                 /**< Pointer to a buffer for blockwise transfers */
     size_t body_len;                                                            /**< Length of the buffer for blockwise transfers */
     size_t body_end;                                                            /**< Amount of relevant data in the buffer for blockwise transfers */
@@ -145,7 +361,15 @@ typedef struct coap_server_trans
     char block_uri[COAP_MSG_OP_URI_PATH_MAX_LEN + 1];                           /**< The URI for the current blockwise transfer */
     coap_msg_success_t block_detail;                                            /**< Code detail for a PUT or POST blockwise operation */
     coap_server_trans_handler_t block_rx;                                       /**< User-supplied callback function to be called when the body of a blockwise transfer has been fully received */
+    coap_server_trans_block_read_t block_read;                                  /**< User-supplied callback function to produce the body of a streaming blockwise transfer */
+    coap_server_trans_block_write_t block_write;                                /**< User-supplied callback function to consume the body of a streaming blockwise transfer */
+    void *block_data;                                                           /**< Application data passed to the streaming blockwise callback functions */
+    coap_server_obs_t *obs;                                                     /**< List of observer structures registered by the client endpoint */
+    unsigned num_obs;                                                           /**< Number of observer structures registered by the client endpoint */
     struct coap_server *server;                                                 /**< Pointer to the containing server structure */
+    struct coap_server_trans *hash_next;                                        /**< Pointer to the next transaction structure in the hash chain or the free list */
+    struct coap_server_trans *lru_prev;                                         /**< Pointer to the next more recently used transaction structure */
+    struct coap_server_trans *lru_next;                                         /**< Pointer to the next less recently used transaction structure */
 #ifdef COAP_DTLS_EN
     gnutls_session_t session;                                                   /**< DTLS session */
 #endif
@@ -154,14 +378,107 @@ coap_server_trans_t;
 
 /**
  *  @brief Server structure
+ *
+ *  Active transaction structures are indexed by client
+ *  endpoint in a hash table and kept in a list ordered
+ *  by last use so that the least recently used transaction
+ *  can be evicted when all of them are in use.
+ *
+ *  Acknowledgement timers for all transactions are kept in
+ *  a hashed timer wheel that is advanced by a single timer
+ *  file descriptor ticking while any timer is running.
+ *
+ *  If COAP_EPOLL_EN is defined the server waits for events
+ *  on the socket and the timer with edge-triggered epoll,
+ *  otherwise it uses select. The epoll members are present
+ *  either way so that the layout of the structure does not
+ *  depend on how the library was built.
+ *
+ *  If COAP_DTLS_EN is not defined datagrams are received
+ *  in batches with recvmmsg and responses are queued and
+ *  sent in batches with sendmmsg.
+ *
+ *  If COAP_SERVER_THREAD_EN is defined the server can be
+ *  run on several worker threads, each with its own server
+ *  structure and socket. If COAP_SERVER_STATS_EN is defined
+ *  each server structure keeps latency histograms and
+ *  counters. As with the epoll members, the statistics and
+ *  worker members are present either way so that the layout
+ *  of the structure does not depend on how the library was
+ *  built.
+ *
+ *  Observers are kept per server structure as each client
+ *  endpoint is served by one worker. An event file
+ *  descriptor wakes the server when coap_server_notify
+ *  signals a change to an observed resource.
+ *
+ *  The optional response cache is indexed by request in a
+ *  hash table and kept in a list ordered by last use so
+ *  that the least recently used entry can be evicted.
+ *
+ *  When a transaction structure is reused its last request
+ *  is moved to a message ID deduplication table sized at
+ *  COAP_SERVER_DEDUP_PER_TRANS entries per transaction
+ *  structure. All entries live for the same time so the
+ *  table is a ring ordered by expiry time, indexed by client
+ *  endpoint and message ID in a hash table. Expired entries
+ *  are removed from the front of the ring. An entry is never
+ *  removed before it expires, so while the ring is full a
+ *  request from a new client endpoint that would need an
+ *  active transaction structure to be reused is ignored and
+ *  left for the client to retransmit.
  */
 typedef struct coap_server
 {
     int sd;                                                                     /**< Socket descriptor */
     unsigned msg_id;                                                            /**< Last message ID value used in a response message */
-    coap_server_path_list_t sep_list;                                           /**< List of URI paths that require separate responses */
-    coap_server_trans_t trans[COAP_SERVER_NUM_TRANS];                           /**< Array of transaction structures */
-    coap_server_trans_handler_t handle;                                         /**< Call-back function to handle requests and generate responses */
+    coap_server_res_t *res_root;                                                /**< Pointer to the root of the resource trie */
+    coap_server_res_t **res_hash;                                               /**< Hash table of resource structures other than the root */
+    unsigned res_hash_mask;                                                     /**< Number of resource hash table buckets minus one */
+    unsigned res_num;                                                           /**< Number of resource structures in the hash table */
+    coap_server_trans_t *trans;                                                 /**< Array of transaction structures */
+    unsigned num_trans;                                                         /**< Number of transaction structures */
+    coap_server_trans_t **trans_hash;                                           /**< Hash table of active transaction structures */
+    unsigned trans_hash_mask;                                                   /**< Number of hash table buckets minus one */
+    coap_server_trans_t *trans_lru_first;                                       /**< Pointer to the most recently used active transaction structure */
+    coap_server_trans_t *trans_lru_last;                                        /**< Pointer to the least recently used active transaction structure */
+    coap_server_trans_t *trans_free;                                            /**< List of inactive transaction structures */
+    int timer_fd;                                                               /**< Timer file descriptor that drives the timer wheel */
+    coap_server_trans_t *timer_wheel[COAP_SERVER_TIMER_WHEEL_SIZE];             /**< Timer wheel of transaction structures with running acknowledgement timers */
+    unsigned timer_pos;                                                         /**< Current timer wheel slot */
+    unsigned timer_num;                                                         /**< Number of running timers in the timer wheel */
+    coap_server_obs_t **obs_hash;                                               /**< Hash table of observer structures indexed by resource */
+    int notify_fd;                                                              /**< Event file descriptor signalled by coap_server_notify */
+    coap_server_cache_entry_t *cache;                                           /**< Array of response cache entries or NULL if the cache is disabled */
+    unsigned cache_num;                                                         /**< Number of response cache entries */
+    coap_server_cache_entry_t **cache_hash;                                     /**< Hash table of response cache entries in use */
+    unsigned cache_hash_mask;                                                   /**< Number of response cache hash table buckets minus one */
+    coap_server_cache_entry_t *cache_lru_first;                                 /**< Pointer to the most recently used response cache entry */
+    coap_server_cache_entry_t *cache_lru_last;                                  /**< Pointer to the least recently used response cache entry */
+    coap_server_cache_entry_t *cache_free;                                      /**< List of unused response cache entries */
+    coap_server_dedup_t *dedup;                                                 /**< Ring of message ID deduplication entries ordered by expiry time */
+    coap_server_dedup_t **dedup_hash;                                           /**< Hash table of message ID deduplication entries in use */
+    unsigned dedup_mask;                                                        /**< Number of message ID deduplication entries minus one, also used to select hash table buckets */
+    unsigned dedup_first;                                                       /**< Index of the oldest message ID deduplication entry in the ring */
+    unsigned dedup_num;                                                         /**< Number of message ID deduplication entries in use */
+    coap_server_stats_t stats;                                                  /**< Statistics updated by the thread running this server structure, unused if COAP_SERVER_STATS_EN is not defined */
+    struct timespec stats_stage_start;                                          /**< Start time of the current processing stage */
+    int epoll_fd;                                                               /**< Epoll file descriptor, -1 if COAP_EPOLL_EN is not defined */
+    int sd_ready;                                                               /**< Flag to indicate that the socket may have data waiting to be read */
+#ifndef COAP_DTLS_EN
+    coap_server_dgram_t recv_batch[COAP_SERVER_BATCH_SIZE];                     /**< Batch of received datagrams */
+    unsigned recv_num;                                                          /**< Number of datagrams in the receive batch */
+    unsigned recv_next;                                                         /**< Index of the next datagram to be processed in the receive batch */
+    coap_server_dgram_t *recv_cur;                                              /**< Pointer to the datagram currently being processed */
+    coap_server_dgram_t send_batch[COAP_SERVER_BATCH_SIZE];                     /**< Batch of datagrams waiting to be sent */
+    unsigned send_num;                                                          /**< Number of datagrams in the send batch */
+#endif
+    int stop;                                                                   /**< Flag set by another thread to make the server stop running, unused if COAP_SERVER_THREAD_EN is not defined */
+    struct coap_server *workers;                                                /**< Array of worker server structures run by coap_server_run_workers */
+    unsigned num_workers;                                                       /**< Number of running worker server structures */
+    struct coap_server *master;                                                 /**< Pointer to the server structure that created this worker, or NULL */
+    unsigned cache_gen[COAP_SERVER_CACHE_GEN_NUM];                              /**< Response cache generation counters indexed by URI path hash and shared by the workers */
+    coap_server_trans_handler_t handle;                                         /**< Call-back function to handle requests that do not match a registered resource */
 #ifdef COAP_DTLS_EN
     gnutls_certificate_credentials_t cred;                                      /**< DTLS credentials */
     gnutls_priority_t priority;                                                 /**< DTLS priorities */
@@ -199,15 +516,55 @@ int coap_server_trans_handle_blockwise(coap_server_trans_t *trans,
                                        size_t body_len,
                                        coap_server_trans_handler_t block_rx);
 
+/**
+ *  @brief Handle a streaming library-level blockwise transfer
+ *
+ *  Configure the transaction structure to do a library-level
+ *  blockwise transfer without buffering the body. For a GET
+ *  request, or for the response phase of a PUT or POST
+ *  request when block_read is not NULL, each Block2 payload is
+ *  pulled from block_read as it is requested. For a PUT or
+ *  POST request each Block1 payload is pushed to block_write
+ *  as it arrives and block_rx is called after the last one
+ *  to generate the response. The memory used by the transfer
+ *  is bounded by the block size rather than the body length.
+ *  This function should be called by the application from
+ *  the handle callback function.
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in] req Pointer to the request message
+ *  @param[out] resp Pointer to the response message
+ *  @param[in] block1_size Preferred block1 size
+ *  @param[in] block2_size Preferred block2 size
+ *  @param[in] block_read Callback function to produce the response body or NULL
+ *  @param[in] block_write Callback function to consume the request body or NULL
+ *  @param[in] block_rx Callback function to be called when the body of a blockwise transfer has been fully received
+ *  @param[in] data Pointer to application data passed to block_read and block_write
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+int coap_server_trans_handle_blockwise_stream(coap_server_trans_t *trans,
+                                              coap_msg_t *req,
+                                              coap_msg_t *resp,
+                                              unsigned block1_size,
+                                              unsigned block2_size,
+                                              coap_server_trans_block_read_t block_read,
+                                              coap_server_trans_block_write_t block_write,
+                                              coap_server_trans_handler_t block_rx,
+                                              void *data);
+
 #ifdef COAP_DTLS_EN
 
 /**
  *  @brief Initialise a server structure
  *
  *  @param[out] server Pointer to a server structure
- *  @param[in] handle Call-back function to handle client requests
+ *  @param[in] handle Call-back function to handle client requests that do not match a registered resource or NULL
  *  @param[in] host String containing the host address of the server
  *  @param[in] port String containing the port number of the server
+ *  @param[in] num_trans Maximum number of active transactions or 0 for COAP_SERVER_NUM_TRANS
  *  @param[in] key_file_name String containing the DTLS key file name
  *  @param[in] cert_file_name String containing the DTLS certificate file name
  *  @param[in] trust_file_name String containing the DTLS trust file name
@@ -221,6 +578,7 @@ int coap_server_create(coap_server_t *server,
                        coap_server_trans_handler_t handle,
                        const char *host,
                        const char *port,
+                       unsigned num_trans,
                        const char *key_file_name,
                        const char *cert_file_name,
                        const char *trust_file_name,
@@ -232,9 +590,10 @@ int coap_server_create(coap_server_t *server,
  *  @brief Initialise a server structure
  *
  *  @param[out] server Pointer to a server structure
- *  @param[in] handle Call-back function to handle client requests
+ *  @param[in] handle Call-back function to handle client requests that do not match a registered resource or NULL
  *  @param[in] host String containing the host address of the server
  *  @param[in] port String containing the port number of the server
+ *  @param[in] num_trans Maximum number of active transactions or 0 for COAP_SERVER_NUM_TRANS
  *
  *  @returns Operation status
  *  @retval 0 Success
@@ -243,7 +602,8 @@ int coap_server_create(coap_server_t *server,
 int coap_server_create(coap_server_t *server,
                        coap_server_trans_handler_t handle,
                        const char *host,
-                       const char *port);
+                       const char *port,
+                       unsigned num_trans);
 
 #endif  /* COAP_DTLS_EN */
 
@@ -263,6 +623,33 @@ void coap_server_destroy(coap_server_t *server);
  */
 unsigned coap_server_get_next_msg_id(coap_server_t *server);
 
+/**
+ *  @brief Register a handler for a resource
+ *
+ *  Requests are matched against registered resources by
+ *  walking the URI-Path options of the request through the
+ *  resource trie, so the cost of a lookup depends on the
+ *  number of path segments and not on the number of
+ *  resources. A request for a registered resource and method
+ *  is passed to the handler registered here. Any other
+ *  request is passed to the handle call-back function given
+ *  to coap_server_create or, if that is NULL, answered with
+ *  4.05 (Method Not Allowed) when the resource exists and
+ *  4.04 (Not Found) when it does not.
+ *
+ *  Resources must be registered before the server is run.
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in] str String representation of a URI path, e.g. "/client/id"
+ *  @param[in] method Request method
+ *  @param[in] handle Call-back function to handle requests for the resource
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+int coap_server_add_resource(coap_server_t *server, const char *str, coap_msg_method_t method, coap_server_trans_handler_t handle);
+
 /**
  *  @brief Register a URI path that requires a separate response
  *
@@ -275,6 +662,115 @@ unsigned coap_server_get_next_msg_id(coap_server_t *server);
  */ 
 int coap_server_add_sep_resp_uri_path(coap_server_t *server, const char *str);
 
+/**
+ *  @brief Enable the response cache
+ *
+ *  The cache stores formatted 2.05 (Content) responses to
+ *  GET requests whose only options are URI-Path, URI-Query,
+ *  Accept and ETag, keyed by the method and the URI-Path,
+ *  URI-Query and Accept options. Only responses that carry
+ *  an explicit, non-zero Max-Age option are stored, so a
+ *  handle call-back function opts a resource in by adding
+ *  the option. A matching request received while the
+ *  response is fresh is answered from the receive path
+ *  without calling the handle call-back function or
+ *  formatting a message. If the request contains an ETag
+ *  option that matches the ETag option of the stored
+ *  response then a 2.03 (Valid) response is sent instead.
+ *  Either response is sent with its Max-Age option set to
+ *  the number of seconds for which the stored response
+ *  remains fresh, so that downstream caches do not extend
+ *  its lifetime. A PUT, POST or DELETE request for the
+ *  same URI path, including each block of a blockwise
+ *  transfer, removes the stored responses for it.
+ *
+ *  Observation requests, requests for resources that
+ *  require separate responses and blockwise transfers
+ *  bypass the cache.
+ *
+ *  If the server is run on worker threads each worker has
+ *  its own cache. A PUT, POST or DELETE request handled by
+ *  one worker also increments a generation counter that is
+ *  shared by the workers and selected by a hash of the URI
+ *  path, and responses stored under an earlier value of the
+ *  counter are discarded by every worker.
+ *
+ *  This function must be called before the server is run.
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in] num Number of cache entries or 0 for COAP_SERVER_CACHE_NUM
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+int coap_server_cache_create(coap_server_t *server, unsigned num);
+
+/**
+ *  @brief Notify the observers of a resource that it has changed
+ *
+ *  A client observes a resource by sending a GET request
+ *  with an Observe option value of 0. If the GET handler
+ *  for the resource returns a 2.xx response that fits in a
+ *  single message then the client is registered as an
+ *  observer and the Observe option is added to the response.
+ *  A GET request with an Observe option value of 1 removes
+ *  the registration, as does a reset message sent in reply
+ *  to a notification or the transaction structure of the
+ *  client endpoint being reused.
+ *
+ *  This function only records the change and wakes the
+ *  server, and any workers, so it may be called from any
+ *  thread, including from a handle call-back function. The
+ *  server then calls the GET handler for the resource once
+ *  to generate the current representation, formats it once
+ *  and sends it as a non-confirmable notification to every
+ *  observer, changing only the message ID and token. Changes
+ *  signalled before the notifications are sent are combined.
+ *  A notification that is not a 2.xx response ends all of
+ *  the observations of the resource.
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in] str String representation of the URI path of a registered resource
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval -ENOENT The resource has not been registered
+ *  @retval <0 Error
+ */
+int coap_server_notify(coap_server_t *server, const char *str);
+
+#ifdef COAP_SERVER_STATS_EN
+
+/**
+ *  @brief Get the statistics of a server
+ *
+ *  The statistics of the server structure and of its
+ *  running workers are added together. Each worker updates
+ *  its own statistics without locking so the result is
+ *  not an atomic snapshot. This function may be called
+ *  from any thread, including from a handle call-back
+ *  function. The statistics are also served as text by
+ *  the resource at COAP_SERVER_STATS_URI_PATH which is
+ *  registered by coap_server_create.
+ *
+ *  @param[in] server Pointer to a server structure
+ *  @param[out] stats Pointer to a statistics structure
+ */
+void coap_server_get_stats(coap_server_t *server, coap_server_stats_t *stats);
+
+/**
+ *  @brief Get a percentile of the values in a latency histogram
+ *
+ *  @param[in] hist Pointer to a latency histogram structure
+ *  @param[in] pct Percentile from 0 to 100
+ *
+ *  @returns Largest value equivalent to the percentile, or 0 if the histogram is empty
+ */
+uint64_t coap_server_hist_get_percentile(const coap_server_hist_t *hist, unsigned pct);
+
+#endif
+
 /**
  *  @brief Run the server
  *
@@ -290,4 +786,38 @@ int coap_server_add_sep_resp_uri_path(coap_server_t *server, const char *str);
  */
 int coap_server_run(coap_server_t *server);
 
+#ifdef COAP_SERVER_THREAD_EN
+
+/**
+ *  @brief Run the server on multiple worker threads
+ *
+ *  The calling thread runs the server structure as the
+ *  first worker. Every other worker opens its own socket
+ *  bound to the same address and port with SO_REUSEPORT
+ *  and has its own transaction table, timers and message
+ *  ID counter. The kernel hashes the client address and
+ *  port to select a socket so each client stays with one
+ *  worker. All workers call the same handle call-back
+ *  functions, which must therefore be thread-safe.
+ *
+ *  Resources and separate response URI paths must be
+ *  registered before calling this function. They are shared
+ *  by all workers. Each worker keeps the observers of the
+ *  clients it serves and coap_server_notify, called with the
+ *  server structure, wakes every worker. The library must be built with
+ *  COAP_MEM_THREAD_EN and, as each thread keeps a cache of
+ *  free buffers, the memory allocators should be sized in
+ *  proportion to the number of workers.
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in] num_workers Number of worker threads, 0 to use one per online processor
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+int coap_server_run_workers(coap_server_t *server, unsigned num_workers);
+
+#endif
+
 #endif
@@ -43,6 +43,7 @@
 #include <sys/timerfd.h>
 #include <sys/select.h>
 #include <sys/types.h>
+#include <sys/epoll.h>
 #ifdef COAP_DTLS_EN
 #include <gnutls/x509.h>
 #endif
@@ -53,6 +54,9 @@
 #define COAP_CLIENT_ACK_TIMEOUT_SEC             2                               /**< Minimum delay to wait before retransmitting a confirmable message */
 #define COAP_CLIENT_MAX_RETRANSMIT              4                               /**< Maximum number of times a confirmable message can be retransmitted */
 #define COAP_CLIENT_RESP_TIMEOUT_SEC            30                              /**< Maximum amount of time to wait for a response */
+#define COAP_CLIENT_OBS_MAX_SEQ                 0xffffff                        /**< Mask to wrap Observe option values to 24 bits */
+#define COAP_CLIENT_OBS_SEQ_HALF                (1 << 23)                       /**< Half of the range of Observe option values */
+#define COAP_CLIENT_OBS_FRESH_SEC               128                             /**< Time after which a notification is fresh regardless of its Observe option value */
 
 #ifdef COAP_DTLS_EN
 
@@ -652,6 +656,7 @@ int coap_client_create(coap_client_t *client,
 
 void coap_client_destroy(coap_client_t *client)
 {
+    coap_client_async_destroy(client);
 #ifdef COAP_DTLS_EN
     coap_client_dtls_destroy(client);
 #endif
@@ -890,6 +895,10 @@ static void coap_client_handle_format_error(coap_client_t *client, char *buf, si
 /**
  *  @brief Receive a message from the server
  *
+ *  The message is parsed as a view into the receive
+ *  buffer in the client structure which is overwritten
+ *  by the next call to this function.
+ *
  *  @param[in,out] client Pointer to a client structure
  *  @param[in] msg Pointer to a message structure
  *
@@ -905,11 +914,11 @@ static ssize_t coap_client_recv(coap_client_t *client, coap_msg_t *msg)
 #endif
     ssize_t num = 0;
     ssize_t ret = 0;
-    char buf[COAP_MSG_MAX_BUF_LEN] = {0};
+    char *buf = client->recv_buf;
 
 #ifdef COAP_DTLS_EN
     errno = 0;
-    num = gnutls_record_recv(client->session, buf, sizeof(buf));
+    num = gnutls_record_recv(client->session, buf, sizeof(client->recv_buf));
     if (errno != 0)
     {
         return -errno;
@@ -938,13 +947,13 @@ static ssize_t coap_client_recv(coap_client_t *client, coap_msg_t *msg)
         return -1;
     }
 #else
-    num = recv(client->sd, buf, sizeof(buf), 0);
+    num = recv(client->sd, buf, sizeof(client->recv_buf), 0);
     if (num < 0)
     {
         return -errno;
     }
 #endif
-    ret = coap_msg_parse(msg, buf, num);
+    ret = coap_msg_parse_view(msg, buf, num);
     if (ret < 0)
     {
         if (ret == -EBADMSG)
@@ -1619,13 +1628,87 @@ int coap_client_exchange(coap_client_t *client, coap_msg_t *req, coap_msg_t *res
 
     if (coap_msg_get_type(req) == COAP_MSG_CON)
     {
-        return coap_client_exchange_con(client, req, resp);
+        ret = coap_client_exchange_con(client, req, resp);
     }
     else if (coap_msg_get_type(req) == COAP_MSG_NON)
     {
-        return coap_client_exchange_non(client, req, resp);
+        ret = coap_client_exchange_non(client, req, resp);
     }
-    return -EINVAL;
+    else
+    {
+        return -EINVAL;
+    }
+    /* the response must not refer to the receive buffer once returned */
+    num = coap_msg_detach(resp);
+    if ((ret == 0) && (num < 0))
+    {
+        return num;
+    }
+    return ret;
+}
+
+/**
+ *  @brief Body buffer structure
+ */
+typedef struct
+{
+    char *body;                                                                 /**< Pointer to a buffer to hold the body */
+    size_t body_len;                                                            /**< Length of the buffer to hold the body */
+}
+coap_client_body_t;
+
+/**
+ *  @brief Copy part of a body buffer for a blockwise transfer
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in] offset Byte offset into the body
+ *  @param[out] buf Buffer to hold the data
+ *  @param[in] len Length of the buffer
+ *  @param[in] data Pointer to a body buffer structure
+ *
+ *  @returns Number of bytes copied
+ */
+static ssize_t coap_client_body_read(coap_client_t *client, size_t offset, char *buf, size_t len, void *data)
+{
+    coap_client_body_t *body = (coap_client_body_t *)data;
+
+    if (offset >= body->body_len)
+    {
+        return 0;
+    }
+    if (offset + len > body->body_len)
+    {
+        len = body->body_len - offset;
+    }
+    memcpy(buf, body->body + offset, len);
+    return len;
+}
+
+/**
+ *  @brief Store a block of a blockwise transfer in a body buffer
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in] offset Byte offset of the block in the body
+ *  @param[in] buf Buffer containing the block
+ *  @param[in] len Length of the block
+ *  @param[in] more Flag to indicate that the block is not the last one in the body
+ *  @param[in] data Pointer to a body buffer structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval -ENOSPC The body buffer is too small
+ */
+static int coap_client_body_write(coap_client_t *client, size_t offset, const char *buf, size_t len, int more, void *data)
+{
+    coap_client_body_t *body = (coap_client_body_t *)data;
+
+    /* check for potential buffer overrun */
+    if (offset + len > body->body_len)
+    {
+        return -ENOSPC;
+    }
+    memcpy(body->body + offset, buf, len);
+    return 0;
 }
 
 /**
@@ -1642,8 +1725,8 @@ int coap_client_exchange(coap_client_t *client, coap_msg_t *req, coap_msg_t *res
  *  @param[out] resp Pointer to the response message
  *  @param[in] block1_size Block1 size
  *  @param[in] block2_size Block2 size
- *  @param[in] body Pointer to a buffer to hold the body
- *  @param[in] body_len Length of the buffer to hold the body
+ *  @param[in] block_read Call-back function to produce the body
+ *  @param[in] data Pointer to pass to the call-back function
  *
  *  @returns Operation status
  *  @retval >=0 Length of the data sent
@@ -1652,22 +1735,26 @@ int coap_client_exchange(coap_client_t *client, coap_msg_t *req, coap_msg_t *res
 static ssize_t coap_client_exchange_blockwise1(coap_client_t *client,
                                                coap_msg_t *req, coap_msg_t *resp,
                                                unsigned block1_size, unsigned block2_size,
-                                               char *body, size_t body_len)
+                                               coap_client_block_read_t block_read,
+                                               void *data)
 {
     coap_msg_t msg = {0};
     unsigned tmp_block_size = 0;
     unsigned payload_len = 0;
     unsigned block1_more = 0;
+    unsigned block1_last = 0;
     unsigned block1_num = 0;
     unsigned block1_len = 0;
     unsigned block2_len = 0;
     size_t block1_start = 0;
+    ssize_t num = 0;
     char block_val[COAP_MSG_OP_MAX_BLOCK_VAL_LEN] = {0};
+    char block_buf[COAP_MSG_OP_MAX_BLOCK_SIZE + 1] = {0};
     int block1_szx = -1;
     int ret = 0;
 
     /* use a block1 option to describe the size of the blocks in the request */
-    if ((block1_size == 0) || (block2_size == 0))
+    if ((block1_size == 0) || (block2_size == 0) || (block_read == NULL))
     {
         return -EINVAL;
     }
@@ -1692,13 +1779,21 @@ static ssize_t coap_client_exchange_blockwise1(coap_client_t *client,
         {
             return ret;
         }
-        block1_more = 1;
-        payload_len = block1_size;
-        if (block1_start + block1_size >= body_len)
+        /* ask for one byte more than a block to find out if another block follows */
+        num = (*block_read)(client, block1_start, block_buf, block1_size + 1, data);
+        if (num < 0)
+        {
+            coap_msg_destroy(&msg);
+            return num;
+        }
+        block1_more = 0;
+        payload_len = num;
+        if (payload_len > block1_size)
         {
-            block1_more = 0;
-            payload_len = body_len - block1_start;
+            block1_more = 1;
+            payload_len = block1_size;
         }
+        block1_last = !block1_more;
         block1_num = coap_msg_block_start_to_num(block1_start, block1_szx);
         /* format the block1 option */
         ret = coap_msg_op_format_block_val(block_val, sizeof(block_val), block1_num, block1_more, block1_size);
@@ -1734,7 +1829,7 @@ static ssize_t coap_client_exchange_blockwise1(coap_client_t *client,
             }
         }
         /* add the payload */
-        ret = coap_msg_set_payload(&msg, body + block1_start, payload_len);
+        ret = coap_msg_set_payload(&msg, block_buf, payload_len);
         if (ret < 0)
         {
             coap_msg_destroy(&msg);
@@ -1788,7 +1883,7 @@ static ssize_t coap_client_exchange_blockwise1(coap_client_t *client,
         /* advance to the next block */
         block1_start += payload_len;
         /* check for completion */
-        if (block1_start >= body_len)
+        if (block1_last)
         {
             coap_msg_destroy(&msg);
             return block1_start;  /* success */
@@ -1805,8 +1900,8 @@ static ssize_t coap_client_exchange_blockwise1(coap_client_t *client,
  *  @param[in] req Pointer to the request message
  *  @param[out] resp Pointer to the response message
  *  @param[in] block2_size Block2 size
- *  @param[in] body Pointer to a buffer to hold the body
- *  @param[in] body_len Length of the buffer to hold the body
+ *  @param[in] block_write Call-back function to consume the body
+ *  @param[in] data Pointer to pass to the call-back function
  *  @param[in] have_resp Flag to indicate that the first response has already been received
  *
  *  @returns Operation status
@@ -1816,8 +1911,8 @@ static ssize_t coap_client_exchange_blockwise1(coap_client_t *client,
 static ssize_t coap_client_exchange_blockwise2(coap_client_t *client,
                                                coap_msg_t *req, coap_msg_t *resp,
                                                unsigned block2_size,
-                                               char *body, size_t body_len,
-                                               int have_resp)
+                                               coap_client_block_write_t block_write,
+                                               void *data, int have_resp)
 {
     coap_msg_t msg = {0};
     unsigned tmp_block_size = 0;
@@ -1831,7 +1926,7 @@ static ssize_t coap_client_exchange_blockwise2(coap_client_t *client,
     int ret = 0;
 
     /* use a block2 option to control the size of the blocks in the response */
-    if (block2_size == 0)
+    if ((block2_size == 0) || (block_write == NULL))
     {
         return -EINVAL;
     }
@@ -1940,14 +2035,13 @@ static ssize_t coap_client_exchange_blockwise2(coap_client_t *client,
             coap_msg_destroy(&msg);
             return -EBADMSG;
         }
-        /* check for potential buffer overrun */
-        if (block2_start + payload_len > body_len)
+        /* pass the payload data from the response to the application */
+        ret = (*block_write)(client, block2_start, coap_msg_get_payload(resp), payload_len, block2_more, data);
+        if (ret < 0)
         {
             coap_msg_destroy(&msg);
-            return -ENOSPC;
+            return ret;
         }
-        /* copy the payload data from the response */
-        memcpy(body + block2_start, coap_msg_get_payload(resp), payload_len);
         /* advance to the next block */
         block2_start += payload_len;
         /* check for completion */
@@ -1963,17 +2057,342 @@ static ssize_t coap_client_exchange_blockwise2(coap_client_t *client,
     return 0;
 }
 
-ssize_t coap_client_exchange_blockwise(coap_client_t *client,
-                                       coap_msg_t *req, coap_msg_t *resp,
-                                       unsigned block1_size, unsigned block2_size,
-                                       char *body, size_t body_len, int have_resp)
+/**
+ *  @brief Windowed blockwise transfer structure
+ */
+typedef struct
+{
+    coap_client_block_write_t block_write;                                      /**< Call-back function to consume the body */
+    void *data;                                                                 /**< Pointer to pass to the call-back function */
+    size_t body_end;                                                            /**< Length of the body once the last block has been received */
+    unsigned block2_size;                                                       /**< Block2 size */
+    unsigned num_pending;                                                       /**< Number of block2 requests in flight */
+    unsigned num_recv;                                                          /**< Number of blocks received */
+    unsigned last_num;                                                          /**< Number of the last block */
+    int last_known;                                                             /**< Flag to indicate that the last block has been received */
+    unsigned err_num;                                                           /**< Lowest block number with an error response */
+    int err_known;                                                              /**< Flag to indicate that an error response has been received */
+    int status;                                                                 /**< First error status of a block2 request */
+    coap_msg_t *resp;                                                           /**< Pointer to the message to hold the response for the last block */
+    coap_msg_t err_resp;                                                        /**< Error response for the block numbered err_num */
+}
+coap_client_window_t;
+
+/**
+ *  @brief Handle the response to a block2 request in a windowed blockwise transfer
+ *
+ *  The payload is passed to the application with the offset
+ *  given by the block number. The block size chosen by the server
+ *  in the response to the first block is used for the rest
+ *  of the transfer.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in] req Pointer to the request message
+ *  @param[in] resp Pointer to the response message or NULL
+ *  @param[in] status Completion status
+ *  @param[in,out] data Pointer to a windowed blockwise transfer structure
+ */
+static void coap_client_window_handle(coap_client_t *client, coap_msg_t *req, coap_msg_t *resp, int status, void *data)
+{
+    coap_client_window_t *window = (coap_client_window_t *)data;
+    unsigned payload_len = 0;
+    unsigned block2_size = 0;
+    unsigned block2_more = 0;
+    unsigned block2_num = 0;
+    unsigned req_num = 0;
+    size_t block2_start = 0;
+    int ret = 0;
+
+    window->num_pending--;
+    if (status < 0)
+    {
+        if (window->status == 0)
+        {
+            window->status = status;
+        }
+        return;
+    }
+    /* the first request may not include a block2 option */
+    ret = coap_msg_parse_block_op(&req_num, &block2_more, &block2_size, req, COAP_MSG_BLOCK2);
+    if (ret < 0)
+    {
+        window->status = -EBADMSG;
+        return;
+    }
+    if ((coap_msg_get_code_class(resp) != COAP_MSG_SUCCESS)
+     || ((coap_msg_get_code_detail(resp) != COAP_MSG_CONTINUE)
+      && (coap_msg_get_code_detail(resp) != COAP_MSG_CONTENT)))
+    {
+        /* keep the error response for the lowest block number
+         * as it will be ignored if it is beyond the last block
+         */
+        if ((!window->err_known) || (req_num < window->err_num))
+        {
+            coap_msg_reset(&window->err_resp);
+            ret = coap_msg_copy(&window->err_resp, resp);
+            if (ret < 0)
+            {
+                window->status = ret;
+                return;
+            }
+            window->err_num = req_num;
+            window->err_known = 1;
+        }
+        return;
+    }
+    /* inspect the block2 option in the response */
+    ret = coap_msg_parse_block_op(&block2_num, &block2_more, &block2_size, resp, COAP_MSG_BLOCK2);
+    if ((ret != 0) || (block2_num != req_num))
+    {
+        window->status = -EBADMSG;
+        return;
+    }
+    if (window->num_recv == 0)
+    {
+        /* allow the server to resize the blocks */
+        if (block2_size < window->block2_size)
+        {
+            window->block2_size = block2_size;
+        }
+    }
+    if (block2_size != window->block2_size)
+    {
+        window->status = -EBADMSG;
+        return;
+    }
+    /* check that the payload in the response has the correct size */
+    payload_len = coap_msg_get_payload_len(resp);
+    if ((payload_len > block2_size)
+     || ((block2_more) && (payload_len != block2_size)))
+    {
+        window->status = -EBADMSG;
+        return;
+    }
+    /* pass the payload data from the response to the application */
+    block2_start = (size_t)block2_num * block2_size;
+    ret = (*window->block_write)(client, block2_start, coap_msg_get_payload(resp), payload_len, block2_more, window->data);
+    if (ret < 0)
+    {
+        window->status = ret;
+        return;
+    }
+    window->num_recv++;
+    if (!block2_more)
+    {
+        window->last_num = block2_num;
+        window->last_known = 1;
+        window->body_end = block2_start + payload_len;
+        if (resp != window->resp)
+        {
+            coap_msg_reset(window->resp);
+            ret = coap_msg_copy(window->resp, resp);
+            if (ret < 0)
+            {
+                window->status = ret;
+            }
+        }
+    }
+}
+
+/**
+ *  @brief Send a block2 request in a windowed blockwise transfer
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in] req Pointer to the request message
+ *  @param[in,out] window Pointer to a windowed blockwise transfer structure
+ *  @param[in] block2_num Block number
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_client_window_send(coap_client_t *client, coap_msg_t *req, coap_client_window_t *window, unsigned block2_num)
+{
+    coap_msg_t msg = {0};
+    unsigned block2_len = 0;
+    char block_val[COAP_MSG_OP_MAX_BLOCK_VAL_LEN] = {0};
+    int ret = 0;
+
+    coap_log_debug("Requesting block number: %u for windowed GET library-level blockwise transfer", block2_num);
+    /* copy the request message so we can add a block2 option */
+    coap_msg_create(&msg);
+    ret = coap_msg_copy(&msg, req);
+    if (ret < 0)
+    {
+        coap_msg_destroy(&msg);
+        return ret;
+    }
+    ret = coap_msg_op_format_block_val(block_val, sizeof(block_val), block2_num, 0, window->block2_size);
+    if (ret < 0)
+    {
+        coap_msg_destroy(&msg);
+        return ret;
+    }
+    block2_len = ret;
+    ret = coap_msg_add_op(&msg, COAP_MSG_BLOCK2, block2_len, block_val);
+    if (ret < 0)
+    {
+        coap_msg_destroy(&msg);
+        return ret;
+    }
+    ret = coap_client_async_send(client, &msg, coap_client_window_handle, window);
+    if (ret == 0)
+    {
+        window->num_pending++;
+    }
+    coap_msg_destroy(&msg);
+    return ret;
+}
+
+/**
+ *  @brief Exchange a response with the server using windowed blockwise transfers
+ *
+ *  The first block is requested on its own so that the
+ *  server can choose the block size. After that up to
+ *  client->block_window block2 requests are kept in flight
+ *  using the asynchronous request table. Each request is
+ *  retransmitted independently so only blocks that are
+ *  lost are requested again.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in] req Pointer to the request message
+ *  @param[out] resp Pointer to the response message
+ *  @param[in] block2_size Block2 size
+ *  @param[in] block_write Call-back function to consume the body
+ *  @param[in] data Pointer to pass to the call-back function
+ *  @param[in] have_resp Flag to indicate that the first response has already been received
+ *
+ *  @returns Operation status
+ *  @retval >=0 Length of the data received
+ *  @retval <0 Error
+ **/
+static ssize_t coap_client_exchange_blockwise2_window(coap_client_t *client,
+                                                      coap_msg_t *req, coap_msg_t *resp,
+                                                      unsigned block2_size,
+                                                      coap_client_block_write_t block_write,
+                                                      void *data, int have_resp)
+{
+    coap_client_window_t window = {0};
+    struct epoll_event ev = {0};
+    unsigned next_num = 0;
+    ssize_t num = 0;
+    int ret = 0;
+
+    if ((block2_size == 0) || (block_write == NULL))
+    {
+        return -EINVAL;
+    }
+    ret = coap_msg_op_calc_block_szx(block2_size);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    if (client->async_req != NULL)
+    {
+        return -EBUSY;
+    }
+    window.block_write = block_write;
+    window.data = data;
+    window.block2_size = block2_size;
+    window.resp = resp;
+    coap_msg_create(&window.err_resp);
+    if (have_resp)
+    {
+        window.num_pending++;
+        coap_client_window_handle(client, req, resp, 0, &window);
+        next_num = 1;
+    }
+    ret = coap_client_async_create(client, client->block_window);
+    if (ret < 0)
+    {
+        coap_msg_destroy(&window.err_resp);
+        return ret;
+    }
+    while (1)
+    {
+        /* keep the window full until the last block is received
+         * but only request the first block on its own
+         */
+        while ((window.status == 0)
+            && (!window.err_known)
+            && (!window.last_known)
+            && (window.num_pending < client->block_window)
+            && ((next_num == 0) || (window.num_recv > 0)))
+        {
+            ret = coap_client_window_send(client, req, &window, next_num);
+            if (ret < 0)
+            {
+                window.status = ret;
+                break;
+            }
+            next_num++;
+        }
+        if ((window.num_pending == 0) || (window.status < 0))
+        {
+            break;
+        }
+        ret = epoll_wait(coap_client_async_get_fd(client), &ev, 1, -1);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            window.status = -errno;
+            break;
+        }
+        ret = coap_client_async_process(client);
+        if (ret < 0)
+        {
+            window.status = ret;
+            break;
+        }
+    }
+    /* cancel any requests still in flight */
+    num = window.status;
+    coap_client_async_destroy(client);
+    if (num < 0)
+    {
+        coap_msg_destroy(&window.err_resp);
+        return num;
+    }
+    if ((window.err_known)
+     && ((!window.last_known) || (window.err_num <= window.last_num)))
+    {
+        /* return the error response to the caller */
+        coap_msg_reset(resp);
+        ret = coap_msg_copy(resp, &window.err_resp);
+        coap_msg_destroy(&window.err_resp);
+        return ret;
+    }
+    coap_msg_destroy(&window.err_resp);
+    if ((!window.last_known) || (window.num_recv != window.last_num + 1))
+    {
+        return -EBADMSG;
+    }
+    return window.body_end;
+}
+
+ssize_t coap_client_exchange_blockwise_stream(coap_client_t *client,
+                                              coap_msg_t *req, coap_msg_t *resp,
+                                              unsigned block1_size, unsigned block2_size,
+                                              coap_client_block_read_t block_read,
+                                              coap_client_block_write_t block_write,
+                                              void *data, int have_resp)
 {
     ssize_t num = 0;
 
     if (coap_msg_get_code_detail(req) == COAP_MSG_GET)
     {
         coap_log_info("Starting new GET library-level blockwise transfer");
-        num = coap_client_exchange_blockwise2(client, req, resp, block2_size, body, body_len, have_resp);
+        if (client->block_window > 1)
+        {
+            num = coap_client_exchange_blockwise2_window(client, req, resp, block2_size, block_write, data, have_resp);
+        }
+        else
+        {
+            num = coap_client_exchange_blockwise2(client, req, resp, block2_size, block_write, data, have_resp);
+        }
         if (num <= 0)
         {
             return num;
@@ -1984,7 +2403,7 @@ ssize_t coap_client_exchange_blockwise(coap_client_t *client,
     else if (coap_msg_get_code_detail(req) == COAP_MSG_PUT)
     {
         coap_log_info("Starting new PUT library-level blockwise transfer");
-        num = coap_client_exchange_blockwise1(client, req, resp, block1_size, block2_size, body, body_len);
+        num = coap_client_exchange_blockwise1(client, req, resp, block1_size, block2_size, block_read, data);
         if (num <= 0)
         {
             return num;
@@ -1994,7 +2413,7 @@ ssize_t coap_client_exchange_blockwise(coap_client_t *client,
             coap_log_info("Completed PUT library-level blockwise transfer");
             return 0;
         }
-        num = coap_client_exchange_blockwise2(client, req, resp, block2_size, body, body_len, 1);
+        num = coap_client_exchange_blockwise2(client, req, resp, block2_size, block_write, data, 1);
         if (num <= 0)
         {
             return num;
@@ -2005,7 +2424,7 @@ ssize_t coap_client_exchange_blockwise(coap_client_t *client,
     else if (coap_msg_get_code_detail(req) == COAP_MSG_POST)
     {
         coap_log_info("Starting new POST library-level blockwise transfer");
-        num = coap_client_exchange_blockwise1(client, req, resp, block1_size, block2_size, body, body_len);
+        num = coap_client_exchange_blockwise1(client, req, resp, block1_size, block2_size, block_read, data);
         if (num <= 0)
         {
             return num;
@@ -2015,7 +2434,7 @@ ssize_t coap_client_exchange_blockwise(coap_client_t *client,
             coap_log_info("Completed POST library-level blockwise transfer");
             return 0;
         }
-        num = coap_client_exchange_blockwise2(client, req, resp, block2_size, body, body_len, 1);
+        num = coap_client_exchange_blockwise2(client, req, resp, block2_size, block_write, data, 1);
         if (num <= 0)
         {
             return num;
@@ -2026,3 +2445,1001 @@ ssize_t coap_client_exchange_blockwise(coap_client_t *client,
     coap_log_warn("Request method unsupported in blockwise transfer");
     return -EINVAL;
 }
+
+ssize_t coap_client_exchange_blockwise(coap_client_t *client,
+                                       coap_msg_t *req, coap_msg_t *resp,
+                                       unsigned block1_size, unsigned block2_size,
+                                       char *body, size_t body_len, int have_resp)
+{
+    coap_client_body_t buf = {0};
+
+    buf.body = body;
+    buf.body_len = body_len;
+    return coap_client_exchange_blockwise_stream(client, req, resp,
+                                                 block1_size, block2_size,
+                                                 coap_client_body_read,
+                                                 coap_client_body_write,
+                                                 &buf, have_resp);
+}
+
+/****************************************************************************************************
+ *                                        coap_client_async                                         *
+ ****************************************************************************************************/
+
+/**
+ *  @brief Compare two absolute times
+ *
+ *  @param[in] a Pointer to the first time
+ *  @param[in] b Pointer to the second time
+ *
+ *  @returns Comparison value
+ *  @retval <0 a is earlier than b
+ *  @retval 0 a is equal to b
+ *  @retval >0 a is later than b
+ */
+static int coap_client_time_cmp(const struct timespec *a, const struct timespec *b)
+{
+    if (a->tv_sec != b->tv_sec)
+    {
+        return (a->tv_sec < b->tv_sec) ? -1 : 1;
+    }
+    if (a->tv_nsec != b->tv_nsec)
+    {
+        return (a->tv_nsec < b->tv_nsec) ? -1 : 1;
+    }
+    return 0;
+}
+
+/**
+ *  @brief Arm the asynchronous timer in a client structure
+ *
+ *  The timer is set to expire at the earliest expiry
+ *  time of all outstanding requests or stopped if there
+ *  are no outstanding requests.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_client_async_set_timer(coap_client_t *client)
+{
+    struct itimerspec its = {{0}};
+    coap_client_req_t *req = NULL;
+    int ret = 0;
+
+    memset(&client->async_expiry, 0, sizeof(client->async_expiry));
+    for (req = client->async_first; req != NULL; req = req->next)
+    {
+        if (((client->async_expiry.tv_sec == 0) && (client->async_expiry.tv_nsec == 0))
+         || (coap_client_time_cmp(&req->expiry, &client->async_expiry) < 0))
+        {
+            client->async_expiry = req->expiry;
+        }
+    }
+    its.it_value = client->async_expiry;
+    ret = timerfd_settime(client->async_timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+    if (ret < 0)
+    {
+        return -errno;
+    }
+    return 0;
+}
+
+/**
+ *  @brief Start the timer for an asynchronous request
+ *
+ *  Set the expiry time of the request to the current
+ *  time plus the timeout value and bring the asynchronous
+ *  timer forward if necessary.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in,out] req Pointer to an asynchronous request structure
+ *  @param[in] timeout Pointer to the timeout value
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_client_async_start_timer(coap_client_t *client, coap_client_req_t *req, const struct timespec *timeout)
+{
+    struct itimerspec its = {{0}};
+    int ret = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &req->expiry);
+    req->expiry.tv_sec += timeout->tv_sec;
+    req->expiry.tv_nsec += timeout->tv_nsec;
+    if (req->expiry.tv_nsec >= 1000000000)
+    {
+        req->expiry.tv_sec++;
+        req->expiry.tv_nsec -= 1000000000;
+    }
+    if (((client->async_expiry.tv_sec == 0) && (client->async_expiry.tv_nsec == 0))
+     || (coap_client_time_cmp(&req->expiry, &client->async_expiry) < 0))
+    {
+        client->async_expiry = req->expiry;
+        its.it_value = client->async_expiry;
+        ret = timerfd_settime(client->async_timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+        if (ret < 0)
+        {
+            return -errno;
+        }
+    }
+    return 0;
+}
+
+/**
+ *  @brief Start the acknowledgement timer for an asynchronous request
+ *
+ *  The timeout is initialised to a random duration between
+ *  ACK_TIMEOUT and (ACK_TIMEOUT * ACK_RANDOM_FACTOR).
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in,out] req Pointer to an asynchronous request structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_client_async_start_ack_timer(coap_client_t *client, coap_client_req_t *req)
+{
+    if (!rand_init)
+    {
+        srand(time(NULL));
+        rand_init = 1;
+    }
+    req->num_retrans = 0;
+    req->timeout.tv_sec = COAP_CLIENT_ACK_TIMEOUT_SEC;
+    req->timeout.tv_nsec = (rand() % 1000) * 1000000;
+    return coap_client_async_start_timer(client, req, &req->timeout);
+}
+
+/**
+ *  @brief Start the response timer for an asynchronous request
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in,out] req Pointer to an asynchronous request structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_client_async_start_resp_timer(coap_client_t *client, coap_client_req_t *req)
+{
+    struct timespec timeout = {0};
+
+    timeout.tv_sec = COAP_CLIENT_RESP_TIMEOUT_SEC;
+    return coap_client_async_start_timer(client, req, &timeout);
+}
+
+/**
+ *  @brief Add an asynchronous request to the message ID hash table and the list of outstanding requests
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in,out] req Pointer to an asynchronous request structure
+ */
+static void coap_client_async_link(coap_client_t *client, coap_client_req_t *req)
+{
+    unsigned bucket = coap_msg_get_msg_id(&req->req) & client->async_hash_mask;
+
+    req->hash_next = client->async_hash[bucket];
+    client->async_hash[bucket] = req;
+    req->prev = NULL;
+    req->next = client->async_first;
+    if (client->async_first != NULL)
+    {
+        client->async_first->prev = req;
+    }
+    client->async_first = req;
+    client->async_pending++;
+}
+
+/**
+ *  @brief Remove an asynchronous request from the message ID hash table and the list of outstanding requests
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in,out] req Pointer to an asynchronous request structure
+ */
+static void coap_client_async_unlink(coap_client_t *client, coap_client_req_t *req)
+{
+    coap_client_req_t **link = NULL;
+    unsigned bucket = coap_msg_get_msg_id(&req->req) & client->async_hash_mask;
+
+    link = &client->async_hash[bucket];
+    while (*link != NULL)
+    {
+        if (*link == req)
+        {
+            *link = req->hash_next;
+            break;
+        }
+        link = &(*link)->hash_next;
+    }
+    if (req->prev != NULL)
+        req->prev->next = req->next;
+    else
+        client->async_first = req->next;
+    if (req->next != NULL)
+        req->next->prev = req->prev;
+    req->hash_next = NULL;
+    req->prev = NULL;
+    req->next = NULL;
+    client->async_pending--;
+}
+
+/**
+ *  @brief Return an asynchronous request structure to the free list
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in,out] req Pointer to an asynchronous request structure
+ */
+static void coap_client_async_release(coap_client_t *client, coap_client_req_t *req)
+{
+    coap_msg_destroy(&req->req);
+    memset(req, 0, sizeof(coap_client_req_t));
+    req->hash_next = client->async_free;
+    client->async_free = req;
+}
+
+/**
+ *  @brief Complete an asynchronous request
+ *
+ *  Call the completion call-back function and return
+ *  the request structure to the free list.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in,out] req Pointer to an asynchronous request structure
+ *  @param[in] resp Pointer to the response message or NULL
+ *  @param[in] status Completion status
+ */
+static void coap_client_async_complete(coap_client_t *client, coap_client_req_t *req, coap_msg_t *resp, int status)
+{
+    coap_client_async_unlink(client, req);
+    req->handle(client, &req->req, resp, status, req->data);
+    coap_client_async_release(client, req);
+}
+
+/**
+ *  @brief Get the Observe option value from a message
+ *
+ *  @param[in] msg Pointer to a message structure
+ *  @param[out] seq Pointer to the Observe option value
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval -ENOENT The message has no valid Observe option
+ */
+static int coap_client_obs_get_seq(coap_msg_t *msg, unsigned *seq)
+{
+    coap_msg_op_t *op = NULL;
+
+    for (op = coap_msg_get_first_op(msg); op != NULL; op = coap_msg_op_get_next(op))
+    {
+        if (coap_msg_op_get_num(op) == COAP_MSG_OBSERVE)
+        {
+            if (coap_msg_op_parse_uint_val(seq, coap_msg_op_get_val(op), coap_msg_op_get_len(op)) < 0)
+            {
+                return -ENOENT;
+            }
+            *seq &= COAP_CLIENT_OBS_MAX_SEQ;
+            return 0;
+        }
+    }
+    return -ENOENT;
+}
+
+/**
+ *  @brief Check if a notification is fresher than the last one received for an observation
+ *
+ *  Observe option values are compared as 24-bit serial
+ *  numbers, unless so much time has passed that the
+ *  values may have wrapped around.
+ *
+ *  @param[in] req Pointer to an asynchronous request structure
+ *  @param[in] seq Observe option value of the notification
+ *  @param[in] now Pointer to the time the notification was received
+ *
+ *  @returns Comparison value
+ *  @retval 0 The notification is stale
+ *  @retval 1 The notification is fresh
+ */
+static int coap_client_obs_is_fresh(coap_client_req_t *req, unsigned seq, const struct timespec *now)
+{
+    unsigned v1 = req->obs_seq;
+    unsigned v2 = seq;
+
+    return ((v1 < v2) && (v2 - v1 < COAP_CLIENT_OBS_SEQ_HALF))
+        || ((v1 > v2) && (v1 - v2 > COAP_CLIENT_OBS_SEQ_HALF))
+        || (now->tv_sec > req->obs_time.tv_sec + COAP_CLIENT_OBS_FRESH_SEC);
+}
+
+/**
+ *  @brief Pass a response or a notification to the call-back function of an observation
+ *
+ *  The request structure is released afterwards if the
+ *  observation has ended or was cancelled by the call-back
+ *  function.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in,out] req Pointer to an asynchronous request structure
+ *  @param[in] resp Pointer to the response message
+ *  @param[in] end Flag to indicate that the observation has ended
+ */
+static void coap_client_obs_notify(coap_client_t *client, coap_client_req_t *req, coap_msg_t *resp, int end)
+{
+    req->in_handle = 1;
+    req->handle(client, &req->req, resp, 0, req->data);
+    req->in_handle = 0;
+    if ((end) || (req->cancelled))
+    {
+        coap_client_async_release(client, req);
+    }
+}
+
+/**
+ *  @brief Handle the response to an asynchronous request
+ *
+ *  A successful response with an Observe option to an
+ *  observation request registers the observation, which
+ *  is kept to receive notifications. Any other response
+ *  completes the request.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in,out] req Pointer to an asynchronous request structure
+ *  @param[in] resp Pointer to the response message or NULL
+ *  @param[in] status Completion status
+ */
+static void coap_client_async_respond(coap_client_t *client, coap_client_req_t *req, coap_msg_t *resp, int status)
+{
+    unsigned seq = 0;
+
+    if ((status == 0)
+     && (req->observe)
+     && (coap_msg_get_code_class(resp) == COAP_MSG_SUCCESS)
+     && (coap_client_obs_get_seq(resp, &seq) == 0))
+    {
+        coap_log_info("Registered observation with host %s and port %s", client->server_host, client->server_port);
+        coap_client_async_unlink(client, req);
+        req->registered = 1;
+        req->obs_seq = seq;
+        clock_gettime(CLOCK_MONOTONIC, &req->obs_time);
+        coap_client_obs_notify(client, req, resp, 0);
+        return;
+    }
+    coap_client_async_complete(client, req, resp, status);
+}
+
+/**
+ *  @brief Handle a notification for an observation
+ *
+ *  Acknowledge the notification if necessary and pass it
+ *  to the call-back function if it is fresh. A notification
+ *  without an Observe option ends the observation.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in,out] req Pointer to an asynchronous request structure
+ *  @param[in] msg Pointer to the notification message
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_client_obs_handle_msg(coap_client_t *client, coap_client_req_t *req, coap_msg_t *msg)
+{
+    struct timespec now = {0};
+    unsigned seq = 0;
+    int ret = 0;
+
+    ret = coap_client_handle_sep_response(client, msg);
+    if (ret < 0)
+    {
+        /* a reset has already been sent if necessary */
+        return 0;
+    }
+    if ((coap_msg_get_code_class(msg) != COAP_MSG_SUCCESS)
+     || (coap_client_obs_get_seq(msg, &seq) < 0))
+    {
+        coap_log_info("Observation ended by host %s and port %s", client->server_host, client->server_port);
+        coap_client_obs_notify(client, req, msg, 1);
+        return 0;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (!coap_client_obs_is_fresh(req, seq, &now))
+    {
+        coap_log_info("Received stale notification from host %s and port %s", client->server_host, client->server_port);
+        return 0;
+    }
+    coap_log_info("Received notification from host %s and port %s", client->server_host, client->server_port);
+    req->obs_seq = seq;
+    req->obs_time = now;
+    coap_client_obs_notify(client, req, msg, 0);
+    return 0;
+}
+
+/**
+ *  @brief Search for an outstanding asynchronous request by message ID
+ *
+ *  @param[in] client Pointer to a client structure
+ *  @param[in] msg_id Message ID
+ *
+ *  @returns Pointer to an asynchronous request structure or NULL
+ */
+static coap_client_req_t *coap_client_async_find_msg_id(coap_client_t *client, unsigned msg_id)
+{
+    coap_client_req_t *req = client->async_hash[msg_id & client->async_hash_mask];
+
+    while (req != NULL)
+    {
+        if (coap_msg_get_msg_id(&req->req) == msg_id)
+        {
+            return req;
+        }
+        req = req->hash_next;
+    }
+    return NULL;
+}
+
+/**
+ *  @brief Search for an outstanding asynchronous request by token
+ *
+ *  The first two bytes of the token hold the index of
+ *  the request structure.
+ *
+ *  @param[in] client Pointer to a client structure
+ *  @param[in] msg Pointer to a message structure
+ *
+ *  @returns Pointer to an asynchronous request structure or NULL
+ */
+static coap_client_req_t *coap_client_async_find_token(coap_client_t *client, coap_msg_t *msg)
+{
+    coap_client_req_t *req = NULL;
+    unsigned char *token = (unsigned char *)coap_msg_get_token(msg);
+    unsigned index = 0;
+
+    if (coap_msg_get_token_len(msg) != 4)
+    {
+        return NULL;
+    }
+    index = ((unsigned)token[1] << 8) | (unsigned)token[0];
+    if (index >= client->async_num)
+    {
+        return NULL;
+    }
+    req = &client->async_req[index];
+    if ((!req->active) || (!coap_client_match_token(&req->req, msg)))
+    {
+        return NULL;
+    }
+    return req;
+}
+
+/**
+ *  @brief Handle expired timers of asynchronous requests
+ *
+ *  Retransmit confirmable requests that have not been
+ *  acknowledged and complete requests that have run out
+ *  of retransmissions or waited too long for a response.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_client_async_handle_timer(coap_client_t *client)
+{
+    coap_client_req_t *next = NULL;
+    coap_client_req_t *req = NULL;
+    struct timespec now = {0};
+    unsigned msec = 0;
+    ssize_t num = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    req = client->async_first;
+    while (req != NULL)
+    {
+        next = req->next;
+        if (coap_client_time_cmp(&req->expiry, &now) <= 0)
+        {
+            if ((coap_msg_get_type(&req->req) == COAP_MSG_CON)
+             && (!req->acked)
+             && (req->num_retrans < COAP_CLIENT_MAX_RETRANSMIT))
+            {
+                msec = 2 * ((req->timeout.tv_sec * 1000) + (req->timeout.tv_nsec / 1000000));
+                req->timeout.tv_sec = msec / 1000;
+                req->timeout.tv_nsec = (msec % 1000) * 1000000;
+                req->num_retrans++;
+                req->expiry = now;
+                req->expiry.tv_sec += req->timeout.tv_sec;
+                req->expiry.tv_nsec += req->timeout.tv_nsec;
+                if (req->expiry.tv_nsec >= 1000000000)
+                {
+                    req->expiry.tv_sec++;
+                    req->expiry.tv_nsec -= 1000000000;
+                }
+                coap_log_debug("Retransmitting to host %s and port %s", client->server_host, client->server_port);
+                num = coap_client_send(client, &req->req);
+                if (num < 0)
+                {
+                    coap_log_warn("Failed to retransmit to host %s and port %s: %s", client->server_host, client->server_port, strerror(-num));
+                }
+            }
+            else
+            {
+                coap_log_info("No response received from host %s and port %s", client->server_host, client->server_port);
+                coap_client_async_complete(client, req, NULL, -ETIMEDOUT);
+            }
+        }
+        req = next;
+    }
+    return coap_client_async_set_timer(client);
+}
+
+/**
+ *  @brief Handle a message received while asynchronous requests are outstanding
+ *
+ *  Acknowledgement and reset messages are matched to
+ *  requests by message ID and other messages are matched
+ *  by token.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in] msg Pointer to the received message
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_client_async_handle_msg(coap_client_t *client, coap_msg_t *msg)
+{
+    coap_client_req_t *req = NULL;
+    int ret = 0;
+
+    if ((coap_msg_get_type(msg) == COAP_MSG_ACK)
+     || (coap_msg_get_type(msg) == COAP_MSG_RST))
+    {
+        req = coap_client_async_find_msg_id(client, coap_msg_get_msg_id(msg));
+        if (req == NULL)
+        {
+            /* message deduplication */
+            return coap_client_reject(client, msg);
+        }
+        if (coap_msg_get_type(msg) == COAP_MSG_RST)
+        {
+            coap_client_async_complete(client, req, NULL, -ECONNRESET);
+            return 0;
+        }
+        if ((coap_msg_get_type(&req->req) != COAP_MSG_CON) || (req->acked))
+        {
+            /* message deduplication */
+            coap_log_info("Received duplicate acknowledgement from host %s and port %s", client->server_host, client->server_port);
+            return 0;
+        }
+        if (coap_msg_is_empty(msg))
+        {
+            /* received ack message, wait for separate response message */
+            coap_log_info("Received acknowledgement from host %s and port %s", client->server_host, client->server_port);
+            req->acked = 1;
+            return coap_client_async_start_resp_timer(client, req);
+        }
+        if (!coap_client_match_token(&req->req, msg))
+        {
+            coap_client_reject(client, msg);
+            coap_client_async_complete(client, req, NULL, -EBADMSG);
+            return 0;
+        }
+        ret = coap_client_handle_piggybacked_response(client, msg);
+        coap_client_async_respond(client, req, ret == 0 ? msg : NULL, ret);
+        return 0;
+    }
+    req = coap_client_async_find_token(client, msg);
+    if (req == NULL)
+    {
+        /* message deduplication */
+        /* we might have received a duplicate message that was already received from the same server */
+        /* or a notification for an observation that has been cancelled */
+        return coap_client_reject(client, msg);
+    }
+    if (req->registered)
+    {
+        return coap_client_obs_handle_msg(client, req, msg);
+    }
+    ret = coap_client_handle_sep_response(client, msg);
+    coap_client_async_respond(client, req, ret == 0 ? msg : NULL, ret);
+    return 0;
+}
+
+/**
+ *  @brief Add a file descriptor to the asynchronous epoll file descriptor
+ *
+ *  @param[in] client Pointer to a client structure
+ *  @param[in] fd File descriptor
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_client_async_epoll_add(coap_client_t *client, int fd)
+{
+    struct epoll_event ev = {0};
+    int ret = 0;
+
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    ret = epoll_ctl(client->async_fd, EPOLL_CTL_ADD, fd, &ev);
+    if (ret < 0)
+    {
+        return -errno;
+    }
+    return 0;
+}
+
+int coap_client_async_create(coap_client_t *client, unsigned num)
+{
+    unsigned char msg_id[2] = {0};
+    unsigned num_buckets = 1;
+    unsigned i = 0;
+    int ret = 0;
+
+    if (client->async_req != NULL)
+    {
+        return -EBUSY;
+    }
+    if (num == 0)
+    {
+        num = COAP_CLIENT_ASYNC_NUM;
+    }
+    if (num > 0xffff)
+    {
+        /* the index of a request structure must fit in two bytes of the token */
+        return -EINVAL;
+    }
+    while (num_buckets < num)
+    {
+        num_buckets <<= 1;
+    }
+    client->async_req = calloc(num, sizeof(coap_client_req_t));
+    if (client->async_req == NULL)
+    {
+        return -ENOMEM;
+    }
+    client->async_hash = calloc(num_buckets, sizeof(coap_client_req_t *));
+    if (client->async_hash == NULL)
+    {
+        free(client->async_req);
+        client->async_req = NULL;
+        return -ENOMEM;
+    }
+    client->async_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (client->async_timer_fd < 0)
+    {
+        ret = -errno;
+        free(client->async_hash);
+        free(client->async_req);
+        client->async_hash = NULL;
+        client->async_req = NULL;
+        return ret;
+    }
+    client->async_fd = epoll_create1(0);
+    if (client->async_fd < 0)
+    {
+        ret = -errno;
+        close(client->async_timer_fd);
+        free(client->async_hash);
+        free(client->async_req);
+        client->async_hash = NULL;
+        client->async_req = NULL;
+        return ret;
+    }
+    ret = coap_client_async_epoll_add(client, client->sd);
+    if (ret == 0)
+    {
+        ret = coap_client_async_epoll_add(client, client->async_timer_fd);
+    }
+    if (ret < 0)
+    {
+        close(client->async_fd);
+        close(client->async_timer_fd);
+        free(client->async_hash);
+        free(client->async_req);
+        client->async_hash = NULL;
+        client->async_req = NULL;
+        return ret;
+    }
+    client->async_num = num;
+    client->async_hash_mask = num_buckets - 1;
+    client->async_pending = 0;
+    client->async_first = NULL;
+    client->async_free = NULL;
+    for (i = num; i > 0; i--)
+    {
+        client->async_req[i - 1].hash_next = client->async_free;
+        client->async_free = &client->async_req[i - 1];
+    }
+    coap_msg_gen_rand_str((char *)msg_id, sizeof(msg_id));
+    client->async_msg_id = (((unsigned)msg_id[1]) << 8) | (unsigned)msg_id[0];
+    memset(&client->async_expiry, 0, sizeof(client->async_expiry));
+    return 0;
+}
+
+void coap_client_async_destroy(coap_client_t *client)
+{
+    coap_client_req_t *req = NULL;
+    unsigned i = 0;
+
+    if (client->async_req == NULL)
+    {
+        return;
+    }
+    while (client->async_first != NULL)
+    {
+        coap_client_async_complete(client, client->async_first, NULL, -ECANCELED);
+    }
+    for (i = 0; i < client->async_num; i++)
+    {
+        req = &client->async_req[i];
+        if (req->registered)
+        {
+            req->handle(client, &req->req, NULL, -ECANCELED, req->data);
+            coap_client_async_release(client, req);
+        }
+    }
+    close(client->async_fd);
+    close(client->async_timer_fd);
+    free(client->async_hash);
+    free(client->async_req);
+    client->async_req = NULL;
+    client->async_num = 0;
+    client->async_hash = NULL;
+    client->async_hash_mask = 0;
+    client->async_free = NULL;
+    client->async_timer_fd = 0;
+    client->async_fd = 0;
+}
+
+/**
+ *  @brief Send an asynchronous request
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in,out] req Pointer to the request message
+ *  @param[in] handle Completion call-back function
+ *  @param[in] data Pointer to pass to the completion call-back function
+ *  @param[in] observe Flag to indicate that the request registers an observation
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval -ENOSPC Too many outstanding requests
+ *  @retval <0 Error
+ */
+static int coap_client_async_start(coap_client_t *client, coap_msg_t *req, coap_client_handler_t handle, void *data, int observe)
+{
+    coap_client_req_t *async_req = NULL;
+    unsigned index = 0;
+    ssize_t num = 0;
+    char token[4] = {0};
+    int ret = 0;
+
+    if ((client->async_req == NULL) || (handle == NULL))
+    {
+        return -EINVAL;
+    }
+
+    /* check for a valid request */
+    if (((coap_msg_get_type(req) != COAP_MSG_CON) && (coap_msg_get_type(req) != COAP_MSG_NON))
+     || (coap_msg_get_code_class(req) != COAP_MSG_REQ))
+    {
+        return -EINVAL;
+    }
+    async_req = client->async_free;
+    if (async_req == NULL)
+    {
+        return -ENOSPC;
+    }
+
+    /* generate the message ID */
+    client->async_msg_id = (client->async_msg_id + 1) & COAP_MSG_MAX_MSG_ID;
+    ret = coap_msg_set_msg_id(req, client->async_msg_id);
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    /* generate the token from the index of the request structure */
+    index = async_req - client->async_req;
+    token[0] = index & 0xff;
+    token[1] = (index >> 8) & 0xff;
+    coap_msg_gen_rand_str(&token[2], sizeof(token) - 2);
+    ret = coap_msg_set_token(req, token, sizeof(token));
+    if (ret < 0)
+    {
+        return ret;
+    }
+
+    coap_msg_create(&async_req->req);
+    ret = coap_msg_copy(&async_req->req, req);
+    if (ret < 0)
+    {
+        coap_msg_destroy(&async_req->req);
+        return ret;
+    }
+    if (coap_msg_get_type(req) == COAP_MSG_CON)
+    {
+        coap_log_info("Sending confirmable request to host %s and port %s", client->server_host, client->server_port);
+    }
+    else
+    {
+        coap_log_info("Sending non-confirmable request to host %s and port %s", client->server_host, client->server_port);
+    }
+    num = coap_client_send(client, req);
+    if (num < 0)
+    {
+        coap_msg_destroy(&async_req->req);
+        return num;
+    }
+    client->async_free = async_req->hash_next;
+    async_req->active = 1;
+    async_req->handle = handle;
+    async_req->data = data;
+    async_req->observe = observe;
+    coap_client_async_link(client, async_req);
+    if (coap_msg_get_type(req) == COAP_MSG_CON)
+        ret = coap_client_async_start_ack_timer(client, async_req);
+    else
+        ret = coap_client_async_start_resp_timer(client, async_req);
+    return ret;
+}
+
+int coap_client_async_send(coap_client_t *client, coap_msg_t *req, coap_client_handler_t handle, void *data)
+{
+    return coap_client_async_start(client, req, handle, data, 0);
+}
+
+int coap_client_async_observe(coap_client_t *client, coap_msg_t *req, coap_client_handler_t handle, void *data)
+{
+    char val[1] = {0};
+    int index = 0;
+    int ret = 0;
+
+    if ((client->async_req == NULL)
+     || (coap_msg_get_code_class(req) != COAP_MSG_REQ)
+     || (coap_msg_get_code_detail(req) != COAP_MSG_GET))
+    {
+        return -EINVAL;
+    }
+    if (client->async_free == NULL)
+    {
+        return -ENOSPC;
+    }
+    /* the observation keeps the request structure at the head of the free list */
+    index = client->async_free - client->async_req;
+    ret = coap_msg_add_op(req, COAP_MSG_OBSERVE, 0, val);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    ret = coap_client_async_start(client, req, handle, data, 1);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    return index;
+}
+
+int coap_client_async_cancel_observe(coap_client_t *client, int id)
+{
+    coap_client_req_t *req = NULL;
+    coap_msg_op_t *op = NULL;
+    coap_msg_t msg = {0};
+    ssize_t num = 0;
+    char val[1] = {1};
+    int ret = 0;
+
+    if ((client->async_req == NULL) || (id < 0) || ((unsigned)id >= client->async_num))
+    {
+        return -EINVAL;
+    }
+    req = &client->async_req[id];
+    if ((!req->active) || (!req->observe) || (req->cancelled))
+    {
+        return -EINVAL;
+    }
+    if (!req->registered)
+    {
+        /* the response has not arrived yet */
+        coap_client_async_complete(client, req, NULL, -ECANCELED);
+        return 0;
+    }
+
+    /* deregister with a copy of the registration request */
+    coap_msg_create(&msg);
+    ret = coap_msg_set_type(&msg, COAP_MSG_NON);
+    if (ret == 0)
+    {
+        ret = coap_msg_set_code(&msg, COAP_MSG_REQ, COAP_MSG_GET);
+    }
+    if (ret == 0)
+    {
+        client->async_msg_id = (client->async_msg_id + 1) & COAP_MSG_MAX_MSG_ID;
+        ret = coap_msg_set_msg_id(&msg, client->async_msg_id);
+    }
+    if (ret == 0)
+    {
+        ret = coap_msg_set_token(&msg, coap_msg_get_token(&req->req), coap_msg_get_token_len(&req->req));
+    }
+    for (op = coap_msg_get_first_op(&req->req); (op != NULL) && (ret == 0); op = coap_msg_op_get_next(op))
+    {
+        if (coap_msg_op_get_num(op) == COAP_MSG_OBSERVE)
+        {
+            ret = coap_msg_add_op(&msg, COAP_MSG_OBSERVE, sizeof(val), val);
+        }
+        else
+        {
+            ret = coap_msg_add_op(&msg, coap_msg_op_get_num(op), coap_msg_op_get_len(op), coap_msg_op_get_val(op));
+        }
+    }
+    if (ret == 0)
+    {
+        coap_log_info("Cancelling observation with host %s and port %s", client->server_host, client->server_port);
+        num = coap_client_send(client, &msg);
+        if (num < 0)
+        {
+            /* the next notification will be rejected */
+            coap_log_warn("Failed to send to host %s and port %s: %s", client->server_host, client->server_port, strerror(-num));
+        }
+    }
+    coap_msg_destroy(&msg);
+    if (req->in_handle)
+    {
+        req->cancelled = 1;
+    }
+    else
+    {
+        coap_client_async_release(client, req);
+    }
+    return ret;
+}
+
+int coap_client_async_process(coap_client_t *client)
+{
+    coap_msg_t msg = {0};
+    uint64_t exp = 0;
+    ssize_t num = 0;
+    int ret = 0;
+
+    if (client->async_req == NULL)
+    {
+        return -EINVAL;
+    }
+    while (1)
+    {
+        coap_msg_create(&msg);
+        num = coap_client_recv(client, &msg);
+        if (num == -EAGAIN)
+        {
+            coap_msg_destroy(&msg);
+            break;
+        }
+        if (num < 0)
+        {
+            coap_msg_destroy(&msg);
+            if (num == -EBADMSG)
+            {
+                /* a reset has already been sent if necessary */
+                continue;
+            }
+            return num;
+        }
+        ret = coap_client_async_handle_msg(client, &msg);
+        coap_msg_destroy(&msg);
+        if (ret < 0)
+        {
+            return ret;
+        }
+    }
+    num = read(client->async_timer_fd, &exp, sizeof(exp));
+    if ((num == sizeof(exp)) && (exp > 0))
+    {
+        return coap_client_async_handle_timer(client);
+    }
+    return 0;
+}
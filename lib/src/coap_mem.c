@@ -34,10 +34,21 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#ifdef COAP_MEM_THREAD_EN
+#include <pthread.h>
+#endif
 #include "coap_mem.h"
 
+#ifdef COAP_MEM_THREAD_EN
+#define COAP_MEM_CACHE_LEN    32                                                /**< Maximum number of buffers held in a per-thread cache */
+#define COAP_MEM_CACHE_DIV    8                                                 /**< A per-thread cache holds at most this fraction of the buffers in a shared memory allocator */
+#define COAP_MEM_NUM_SHARED   3                                                 /**< Number of shared memory allocators */
+#endif
+
 int coap_mem_create(coap_mem_t *mem, size_t num, size_t len)
 {
+    size_t i = 0;
+
     memset(mem, 0, sizeof(coap_mem_t));
     if (((num & 0x7) != 0) || (len == 0))
     {
@@ -57,79 +68,504 @@ int coap_mem_create(coap_mem_t *mem, size_t num, size_t len)
         memset(mem, 0, sizeof(coap_mem_t));
         return -ENOMEM;
     }
+    mem->free_list = (size_t *)malloc(num * sizeof(size_t));
+    if (mem->free_list == NULL)
+    {
+        free(mem->active);
+        free(mem->buf);
+        memset(mem, 0, sizeof(coap_mem_t));
+        return -ENOMEM;
+    }
+    /* the lowest index is at the top of the stack */
+    for (i = 0; i < num; i++)
+    {
+        mem->free_list[i] = num - 1 - i;
+    }
+    mem->free_num = num;
     return 0;
 }
 
 void coap_mem_destroy(coap_mem_t *mem)
 {
+    free(mem->free_list);
     free(mem->active);
     free(mem->buf);
     memset(mem, 0, sizeof(coap_mem_t));
 }
 
 void *coap_mem_alloc(coap_mem_t *mem, size_t len)
+{
+    size_t index = 0;
+
+    if ((len > mem->len) || (mem->free_num == 0))
+    {
+        return NULL;
+    }
+    index = mem->free_list[--mem->free_num];
+    mem->active[index >> 3] |= (1 << (index & 0x7));
+    return &mem->buf[index * mem->len];
+}
+
+/**
+ *  @brief Get the index of a buffer in a memory allocator
+ *
+ *  @param[in] mem Pointer to a memory allocator
+ *  @param[in] buf Pointer to a buffer
+ *  @param[out] index Index of the buffer
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_mem_get_index(coap_mem_t *mem, void *buf, size_t *index)
+{
+    size_t offset = 0;
+
+    if ((buf == NULL)
+     || ((char *)buf < mem->buf)
+     || ((char *)buf >= mem->buf + mem->num * mem->len))
+    {
+        return -EINVAL;
+    }
+    offset = (char *)buf - mem->buf;
+    if ((offset % mem->len) != 0)
+    {
+        return -EINVAL;
+    }
+    *index = offset / mem->len;
+    return 0;
+}
+
+void coap_mem_free(coap_mem_t *mem, void *buf)
 {
     unsigned char mask = 0;
-    size_t byte = 0;
-    size_t bit = 0;
-    void *mem_buf = NULL;
+    size_t index = 0;
+    int ret = 0;
+
+    ret = coap_mem_get_index(mem, buf, &index);
+    if (ret < 0)
+    {
+        return;
+    }
+    mask = (1 << (index & 0x7));
+    if ((mem->active[index >> 3] & mask) == 0)
+    {
+        return;
+    }
+    mem->active[index >> 3] &= (unsigned char)(~mask);
+    mem->free_list[mem->free_num++] = index;
+}
+
+#ifdef COAP_MEM_THREAD_EN
+
+/**
+ *  @brief Shared memory allocator structure
+ *
+ *  A shared memory allocator can be used by several threads
+ *  at once. Each thread keeps a small cache of free buffers
+ *  for each shared memory allocator and moves buffers between
+ *  its cache and the memory allocator in batches so that the
+ *  shared lock is only taken once every batch_len calls. When
+ *  both the calling thread's cache and the memory allocator
+ *  are empty, the caches of the other threads are drained
+ *  before the allocation fails. The active bitset is updated
+ *  atomically on every call and marks the buffers that are in
+ *  use by the application.
+ */
+typedef struct
+{
+    coap_mem_t *mem;                                                            /**< Pointer to the memory allocator */
+    pthread_mutex_t lock;                                                       /**< Lock protecting the free list in the memory allocator */
+    unsigned gen;                                                               /**< Incremented each time the memory allocator is initialised or deinitialised */
+    unsigned id;                                                                /**< Index of the per-thread cache for this memory allocator */
+    size_t cache_len;                                                           /**< Maximum number of buffers held in a per-thread cache */
+    size_t batch_len;                                                           /**< Number of buffers moved between a per-thread cache and the memory allocator at a time */
+}
+coap_mem_shared_t;
+
+/**
+ *  @brief Per-thread cache structure
+ *
+ *  The lock is only contended when another thread
+ *  drains the cache.
+ */
+typedef struct
+{
+    pthread_mutex_t lock;                                                       /**< Lock protecting the cache */
+    unsigned gen;                                                               /**< Generation of the shared memory allocator that the cached buffers belong to */
+    size_t num;                                                                 /**< Number of cached buffers */
+    size_t index[COAP_MEM_CACHE_LEN];                                           /**< Stack of indices of cached buffers */
+}
+coap_mem_cache_t;
+
+/**
+ *  @brief Per-thread caches structure
+ */
+typedef struct coap_mem_thread
+{
+    coap_mem_cache_t cache[COAP_MEM_NUM_SHARED];                                /**< Per-thread cache for each shared memory allocator */
+    struct coap_mem_thread *prev;                                               /**< Previous thread in the list of threads with caches */
+    struct coap_mem_thread *next;                                               /**< Next thread in the list of threads with caches */
+}
+coap_mem_thread_t;
+
+static __thread coap_mem_thread_t coap_mem_thread;                              /**< Per-thread caches */
+static __thread int coap_mem_thread_init = 0;                                   /**< Indicates whether or not the per-thread caches have been registered */
+static pthread_once_t coap_mem_cache_once = PTHREAD_ONCE_INIT;                  /**< Ensures the thread-specific data key is only created once */
+static pthread_key_t coap_mem_cache_key;                                        /**< Thread-specific data key used to flush the per-thread caches on thread exit */
+static pthread_mutex_t coap_mem_thread_lock = PTHREAD_MUTEX_INITIALIZER;        /**< Lock protecting the list of threads with caches */
+static coap_mem_thread_t *coap_mem_thread_first = NULL;                         /**< First thread in the list of threads with caches */
+static coap_mem_shared_t *coap_mem_shared[COAP_MEM_NUM_SHARED];                 /**< Array of shared memory allocators */
+
+/*  Locks are always taken in the order: list of threads,
+ *  per-thread cache, shared memory allocator.
+ */
+
+/**
+ *  @brief Move buffers from a per-thread cache to a shared memory allocator
+ *
+ *  The per-thread cache must be locked.
+ *
+ *  @param[in,out] shared Pointer to a shared memory allocator
+ *  @param[in,out] cache Pointer to a per-thread cache
+ *  @param[in] num Number of buffers to move
+ */
+static void coap_mem_cache_flush(coap_mem_shared_t *shared, coap_mem_cache_t *cache, size_t num)
+{
+    coap_mem_t *mem = shared->mem;
+
+    pthread_mutex_lock(&shared->lock);
+    if (cache->gen != shared->gen)
+    {
+        /* the memory allocator has been deinitialised */
+        cache->num = 0;
+        pthread_mutex_unlock(&shared->lock);
+        return;
+    }
+    while ((num > 0) && (cache->num > 0))
+    {
+        mem->free_list[mem->free_num++] = cache->index[--cache->num];
+        num--;
+    }
+    pthread_mutex_unlock(&shared->lock);
+}
+
+/**
+ *  @brief Move buffers from a shared memory allocator to an empty per-thread cache
+ *
+ *  The per-thread cache must be locked. The cache is
+ *  filled so that buffers with lower indices are
+ *  allocated from the cache first.
+ *
+ *  @param[in,out] shared Pointer to a shared memory allocator
+ *  @param[in,out] cache Pointer to a per-thread cache
+ */
+static void coap_mem_cache_fill(coap_mem_shared_t *shared, coap_mem_cache_t *cache)
+{
+    coap_mem_t *mem = shared->mem;
+    size_t num = 0;
+    size_t i = 0;
+
+    pthread_mutex_lock(&shared->lock);
+    cache->gen = shared->gen;
+    num = mem->free_num < shared->batch_len ? mem->free_num : shared->batch_len;
+    for (i = 0; i < num; i++)
+    {
+        cache->index[num - 1 - i] = mem->free_list[--mem->free_num];
+    }
+    cache->num = num;
+    pthread_mutex_unlock(&shared->lock);
+}
+
+/**
+ *  @brief Move the buffers in every per-thread cache for a shared memory allocator back to it
+ *
+ *  The calling thread must not hold the lock for any per-thread cache.
+ *
+ *  @param[in,out] shared Pointer to a shared memory allocator
+ */
+static void coap_mem_cache_drain(coap_mem_shared_t *shared)
+{
+    coap_mem_thread_t *thread = NULL;
+    coap_mem_cache_t *cache = NULL;
+
+    pthread_mutex_lock(&coap_mem_thread_lock);
+    thread = coap_mem_thread_first;
+    while (thread != NULL)
+    {
+        cache = &thread->cache[shared->id];
+        pthread_mutex_lock(&cache->lock);
+        if (cache->num > 0)
+        {
+            coap_mem_cache_flush(shared, cache, cache->num);
+        }
+        pthread_mutex_unlock(&cache->lock);
+        thread = thread->next;
+    }
+    pthread_mutex_unlock(&coap_mem_thread_lock);
+}
+
+/**
+ *  @brief Return the contents of the per-thread caches to the shared memory allocators
+ *
+ *  This function is called when a thread exits.
+ *
+ *  @param[in,out] data Pointer to the per-thread caches structure
+ */
+static void coap_mem_cache_destroy(void *data)
+{
+    coap_mem_thread_t *thread = (coap_mem_thread_t *)data;
+    coap_mem_cache_t *cache = NULL;
+    unsigned i = 0;
+
+    pthread_mutex_lock(&coap_mem_thread_lock);
+    for (i = 0; i < COAP_MEM_NUM_SHARED; i++)
+    {
+        cache = &thread->cache[i];
+        pthread_mutex_lock(&cache->lock);
+        if ((coap_mem_shared[i] != NULL) && (cache->num > 0))
+        {
+            coap_mem_cache_flush(coap_mem_shared[i], cache, cache->num);
+        }
+        pthread_mutex_unlock(&cache->lock);
+    }
+    if (thread->prev != NULL)
+    {
+        thread->prev->next = thread->next;
+    }
+    else
+    {
+        coap_mem_thread_first = thread->next;
+    }
+    if (thread->next != NULL)
+    {
+        thread->next->prev = thread->prev;
+    }
+    pthread_mutex_unlock(&coap_mem_thread_lock);
+    for (i = 0; i < COAP_MEM_NUM_SHARED; i++)
+    {
+        pthread_mutex_destroy(&thread->cache[i].lock);
+    }
+    memset(thread, 0, sizeof(coap_mem_thread_t));
+    coap_mem_thread_init = 0;
+}
+
+/**
+ *  @brief Create the thread-specific data key
+ */
+static void coap_mem_cache_key_create(void)
+{
+    pthread_key_create(&coap_mem_cache_key, coap_mem_cache_destroy);
+}
+
+/**
+ *  @brief Add the calling thread's caches to the list of threads with caches
+ */
+static void coap_mem_thread_register(void)
+{
+    coap_mem_thread_t *thread = &coap_mem_thread;
+    unsigned i = 0;
+
+    pthread_once(&coap_mem_cache_once, coap_mem_cache_key_create);
+    for (i = 0; i < COAP_MEM_NUM_SHARED; i++)
+    {
+        pthread_mutex_init(&thread->cache[i].lock, NULL);
+    }
+    pthread_mutex_lock(&coap_mem_thread_lock);
+    thread->prev = NULL;
+    thread->next = coap_mem_thread_first;
+    if (coap_mem_thread_first != NULL)
+    {
+        coap_mem_thread_first->prev = thread;
+    }
+    coap_mem_thread_first = thread;
+    pthread_mutex_unlock(&coap_mem_thread_lock);
+    pthread_setspecific(coap_mem_cache_key, thread);
+    coap_mem_thread_init = 1;
+}
+
+/**
+ *  @brief Get and lock the calling thread's cache for a shared memory allocator
+ *
+ *  Cached buffers that belong to a previous
+ *  instance of the memory allocator are dropped.
+ *
+ *  @param[in] shared Pointer to a shared memory allocator
+ *
+ *  @returns Pointer to a locked per-thread cache
+ */
+static coap_mem_cache_t *coap_mem_cache_lock(coap_mem_shared_t *shared)
+{
+    coap_mem_cache_t *cache = NULL;
+
+    if (!coap_mem_thread_init)
+    {
+        coap_mem_thread_register();
+    }
+    cache = &coap_mem_thread.cache[shared->id];
+    pthread_mutex_lock(&cache->lock);
+    if (cache->gen != __atomic_load_n(&shared->gen, __ATOMIC_ACQUIRE))
+    {
+        cache->num = 0;
+    }
+    return cache;
+}
+
+/**
+ *  @brief Initialise a shared memory allocator
+ *
+ *  @param[in,out] shared Pointer to a shared memory allocator
+ *  @param[in] num Number of buffers
+ *  @param[in] len Length of each buffer
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_mem_shared_create(coap_mem_shared_t *shared, size_t num, size_t len)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&shared->lock);
+    ret = coap_mem_create(shared->mem, num, len);
+    /* keep most of a small memory allocator out of the per-thread caches */
+    shared->cache_len = num / COAP_MEM_CACHE_DIV;
+    if (shared->cache_len > COAP_MEM_CACHE_LEN)
+    {
+        shared->cache_len = COAP_MEM_CACHE_LEN;
+    }
+    if (shared->cache_len == 0)
+    {
+        shared->cache_len = 1;
+    }
+    shared->batch_len = (shared->cache_len + 1) / 2;
+    __atomic_add_fetch(&shared->gen, 1, __ATOMIC_RELEASE);
+    coap_mem_shared[shared->id] = shared;
+    pthread_mutex_unlock(&shared->lock);
+    return ret;
+}
+
+/**
+ *  @brief Deinitialise a shared memory allocator
+ *
+ *  @param[in,out] shared Pointer to a shared memory allocator
+ */
+static void coap_mem_shared_destroy(coap_mem_shared_t *shared)
+{
+    pthread_mutex_lock(&shared->lock);
+    coap_mem_destroy(shared->mem);
+    __atomic_add_fetch(&shared->gen, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&shared->lock);
+}
+
+/**
+ *  @brief Allocate a buffer from a shared memory allocator
+ *
+ *  @param[in,out] shared Pointer to a shared memory allocator
+ *  @param[in] len Length of the buffer
+ *
+ *  @returns Pointer to a buffer or NULL
+ */
+static void *coap_mem_shared_alloc(coap_mem_shared_t *shared, size_t len)
+{
+    coap_mem_cache_t *cache = NULL;
+    coap_mem_t *mem = shared->mem;
+    size_t index = 0;
 
     if (len > mem->len)
     {
         return NULL;
     }
-    for (byte = 0; byte < coap_mem_get_active_len(mem); byte++)
+    cache = coap_mem_cache_lock(shared);
+    if (cache->num == 0)
     {
-        for (bit = 0; bit < 8; bit++)
+        coap_mem_cache_fill(shared, cache);
+    }
+    if (cache->num == 0)
+    {
+        /* free buffers may be held in the caches of other threads */
+        pthread_mutex_unlock(&cache->lock);
+        coap_mem_cache_drain(shared);
+        cache = coap_mem_cache_lock(shared);
+        if (cache->num == 0)
+        {
+            coap_mem_cache_fill(shared, cache);
+        }
+        if (cache->num == 0)
         {
-            mask = (1 << bit);
-            if ((mem->active[byte] & mask) == 0)
-            {
-                mem->active[byte] |= mask;
-                mem_buf = &mem->buf[(8 * byte + bit) * mem->len];
-                return mem_buf;
-            }
+            pthread_mutex_unlock(&cache->lock);
+            return NULL;
         }
     }
-    return NULL;
+    index = cache->index[--cache->num];
+    pthread_mutex_unlock(&cache->lock);
+    __atomic_fetch_or(&mem->active[index >> 3], (char)(1 << (index & 0x7)), __ATOMIC_RELAXED);
+    return &mem->buf[index * mem->len];
 }
 
-void coap_mem_free(coap_mem_t *mem, void *buf)
+/**
+ *  @brief Return a buffer back to a shared memory allocator
+ *
+ *  @param[in,out] shared Pointer to a shared memory allocator
+ *  @param[in] buf Pointer to a buffer
+ */
+static void coap_mem_shared_free(coap_mem_shared_t *shared, void *buf)
 {
+    coap_mem_cache_t *cache = NULL;
+    coap_mem_t *mem = shared->mem;
     unsigned char mask = 0;
-    size_t byte = 0;
-    size_t bit = 0;
-    void *mem_buf = NULL;
+    size_t index = 0;
+    char prev = 0;
+    int ret = 0;
 
-    for (byte = 0; byte < coap_mem_get_active_len(mem); byte++)
+    ret = coap_mem_get_index(mem, buf, &index);
+    if (ret < 0)
     {
-        for (bit = 0; bit < 8; bit++)
-        {
-            mem_buf = &mem->buf[(8 * byte + bit) * mem->len];
-            if (buf == mem_buf)
-            {
-                mask = ~(1 << bit);
-                mem->active[byte] &= mask;
-            }
-        }
+        return;
     }
+    mask = (1 << (index & 0x7));
+    prev = __atomic_fetch_and(&mem->active[index >> 3], (char)~mask, __ATOMIC_RELAXED);
+    if ((prev & mask) == 0)
+    {
+        return;
+    }
+    cache = coap_mem_cache_lock(shared);
+    if (cache->num >= shared->cache_len)
+    {
+        coap_mem_cache_flush(shared, cache, cache->num - shared->cache_len + shared->batch_len);
+    }
+    cache->index[cache->num++] = index;
+    pthread_mutex_unlock(&cache->lock);
 }
 
+#endif  /* COAP_MEM_THREAD_EN */
+
 /**
  *  Small memory allocator
  *
  *  This memory allocator can be used by any part of the CoAP library.
  */
 static coap_mem_t coap_mem_small = {0};
+#ifdef COAP_MEM_THREAD_EN
+static coap_mem_shared_t coap_mem_small_shared = {&coap_mem_small, PTHREAD_MUTEX_INITIALIZER, 0, 0};
+#endif
 
 int coap_mem_small_create(size_t num, size_t len)
 {
+#ifdef COAP_MEM_THREAD_EN
+    return coap_mem_shared_create(&coap_mem_small_shared, num, len);
+#else
     return coap_mem_create(&coap_mem_small, num, len);
+#endif
 }
 
 void coap_mem_small_destroy(void)
 {
+#ifdef COAP_MEM_THREAD_EN
+    coap_mem_shared_destroy(&coap_mem_small_shared);
+#else
     coap_mem_destroy(&coap_mem_small);
+#endif
 }
 
 char *coap_mem_small_get_buf(void)
@@ -159,12 +595,20 @@ char *coap_mem_small_get_active(void)
 
 void *coap_mem_small_alloc(size_t len)
 {
+#ifdef COAP_MEM_THREAD_EN
+    return coap_mem_shared_alloc(&coap_mem_small_shared, len);
+#else
     return coap_mem_alloc(&coap_mem_small, len);
+#endif
 }
 
 void coap_mem_small_free(void *buf)
 {
+#ifdef COAP_MEM_THREAD_EN
+    coap_mem_shared_free(&coap_mem_small_shared, buf);
+#else
     coap_mem_free(&coap_mem_small, buf);
+#endif
 }
 
 /**
@@ -173,15 +617,26 @@ void coap_mem_small_free(void *buf)
  *  This memory allocator can be used by any part of the CoAP library.
  */
 static coap_mem_t coap_mem_medium = {0};
+#ifdef COAP_MEM_THREAD_EN
+static coap_mem_shared_t coap_mem_medium_shared = {&coap_mem_medium, PTHREAD_MUTEX_INITIALIZER, 0, 1};
+#endif
 
 int coap_mem_medium_create(size_t num, size_t len)
 {
+#ifdef COAP_MEM_THREAD_EN
+    return coap_mem_shared_create(&coap_mem_medium_shared, num, len);
+#else
     return coap_mem_create(&coap_mem_medium, num, len);
+#endif
 }
 
 void coap_mem_medium_destroy(void)
 {
+#ifdef COAP_MEM_THREAD_EN
+    coap_mem_shared_destroy(&coap_mem_medium_shared);
+#else
     coap_mem_destroy(&coap_mem_medium);
+#endif
 }
 
 char *coap_mem_medium_get_buf(void)
@@ -211,12 +666,20 @@ char *coap_mem_medium_get_active(void)
 
 void *coap_mem_medium_alloc(size_t len)
 {
+#ifdef COAP_MEM_THREAD_EN
+    return coap_mem_shared_alloc(&coap_mem_medium_shared, len);
+#else
     return coap_mem_alloc(&coap_mem_medium, len);
+#endif
 }
 
 void coap_mem_medium_free(void *buf)
 {
+#ifdef COAP_MEM_THREAD_EN
+    coap_mem_shared_free(&coap_mem_medium_shared, buf);
+#else
     coap_mem_free(&coap_mem_medium, buf);
+#endif
 }
 
 /**
@@ -225,15 +688,26 @@ void coap_mem_medium_free(void *buf)
  *  This memory allocator can be used by any part of the CoAP library.
  */
 static coap_mem_t coap_mem_large = {0};
+#ifdef COAP_MEM_THREAD_EN
+static coap_mem_shared_t coap_mem_large_shared = {&coap_mem_large, PTHREAD_MUTEX_INITIALIZER, 0, 2};
+#endif
 
 int coap_mem_large_create(size_t num, size_t len)
 {
+#ifdef COAP_MEM_THREAD_EN
+    return coap_mem_shared_create(&coap_mem_large_shared, num, len);
+#else
     return coap_mem_create(&coap_mem_large, num, len);
+#endif
 }
 
 void coap_mem_large_destroy(void)
 {
+#ifdef COAP_MEM_THREAD_EN
+    coap_mem_shared_destroy(&coap_mem_large_shared);
+#else
     coap_mem_destroy(&coap_mem_large);
+#endif
 }
 
 char *coap_mem_large_get_buf(void)
@@ -263,12 +737,20 @@ char *coap_mem_large_get_active(void)
 
 void *coap_mem_large_alloc(size_t len)
 {
+#ifdef COAP_MEM_THREAD_EN
+    return coap_mem_shared_alloc(&coap_mem_large_shared, len);
+#else
     return coap_mem_alloc(&coap_mem_large, len);
+#endif
 }
 
 void coap_mem_large_free(void *buf)
 {
+#ifdef COAP_MEM_THREAD_EN
+    coap_mem_shared_free(&coap_mem_large_shared, buf);
+#else
     coap_mem_free(&coap_mem_large, buf);
+#endif
 }
 
 int coap_mem_all_create(size_t small_num, size_t small_len,
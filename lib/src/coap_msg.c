@@ -69,6 +69,7 @@ int coap_msg_op_num_is_recognized(unsigned num)
     case COAP_MSG_URI_HOST:
     case COAP_MSG_ETAG:
     case COAP_MSG_IF_NONE_MATCH:
+    case COAP_MSG_OBSERVE:
     case COAP_MSG_URI_PORT:
     case COAP_MSG_LOCATION_PATH:
     case COAP_MSG_URI_PATH:
@@ -182,9 +183,80 @@ int coap_msg_op_format_block_val(char *val, unsigned len, unsigned num, unsigned
     return -EINVAL;
 }
 
+int coap_msg_op_parse_uint_val(unsigned *num, const char *val, unsigned len)
+{
+    unsigned i = 0;
+
+    if (len > sizeof(unsigned))
+    {
+        return -EINVAL;
+    }
+    *num = 0;
+    for (i = 0; i < len; i++)
+    {
+        *num = (*num << 8) | (unsigned)(unsigned char)val[i];
+    }
+    return 0;
+}
+
+int coap_msg_op_format_uint_val(char *val, unsigned len, unsigned num)
+{
+    unsigned n = 0;
+    unsigned i = 0;
+
+    /* zero is encoded as an empty value */
+    for (i = num; i != 0; i >>= 8)
+    {
+        n++;
+    }
+    if (n > len)
+    {
+        return -EINVAL;
+    }
+    for (i = 0; i < n; i++)
+    {
+        val[n - 1 - i] = (num >> (8 * i)) & 0x000000ff;
+    }
+    return n;
+}
+
+/**
+ *  @brief Allocate storage for an option value
+ *
+ *  The option value is stored inline in the message
+ *  structure if there is space available. Otherwise
+ *  it is allocated from the medium memory allocator.
+ *
+ *  @param[in,out] msg Pointer to a message structure
+ *  @param[in] len Option length
+ *
+ *  @returns Pointer to the storage for the option value
+ *  @retval NULL Out-of-memory
+ */
+static char *coap_msg_op_alloc_val(coap_msg_t *msg, unsigned len)
+{
+    char *val = NULL;
+
+    if ((len <= COAP_MSG_OP_INLINE_MAX_LEN)
+     && (msg->op_buf_end + len <= sizeof(msg->op_buf)))
+    {
+        val = &msg->op_buf[msg->op_buf_end];
+        msg->op_buf_end += len;
+        return val;
+    }
+    return (char *)coap_mem_medium_alloc(len);
+}
+
 /**
  *  @brief Allocate an option structure
  *
+ *  The option structure and option value are stored inline
+ *  in the message structure if there is space available.
+ *  Otherwise they are allocated from the small and medium
+ *  memory allocators. If the message is a view then the
+ *  option value is not copied.
+ *
+ *  @param[in,out] msg Pointer to a message structure
  *  @param[in] num Option number
  *  @param[in] len Option length
  *  @param[in] val Pointer to the option value
@@ -192,73 +264,110 @@ int coap_msg_op_format_block_val(char *val, unsigned len, unsigned num, unsigned
  *  @returns Pointer to the option structure
  *  @retval NULL Out-of-memory
  */
-static coap_msg_op_t *coap_msg_op_new(unsigned num, unsigned len, const char *val)
+static coap_msg_op_t *coap_msg_op_new(coap_msg_t *msg, unsigned num, unsigned len, const char *val)
 {
     coap_msg_op_t *op = NULL;
 
-    op = (coap_msg_op_t *)coap_mem_small_alloc(sizeof(coap_msg_op_t));
-    if (op == NULL)
+    if (msg->op_inline_num < COAP_MSG_OP_INLINE_NUM)
     {
-        return NULL;
+        op = &msg->op_inline[msg->op_inline_num++];
+    }
+    else
+    {
+        op = (coap_msg_op_t *)coap_mem_small_alloc(sizeof(coap_msg_op_t));
+        if (op == NULL)
+        {
+            return NULL;
+        }
     }
     op->num = num;
     op->len = len;
-    op->val = (char *)coap_mem_medium_alloc(len);
+    op->next = NULL;
+    if (msg->view)
+    {
+        op->val = (char *)val;
+        return op;
+    }
+    op->val = coap_msg_op_alloc_val(msg, len);
     if (op->val == NULL)
     {
-        coap_mem_medium_free(op);
+        if (op == &msg->op_inline[msg->op_inline_num - 1])
+        {
+            msg->op_inline_num--;
+        }
+        else
+        {
+            coap_mem_small_free(op);
+        }
         return NULL;
     }
     memcpy(op->val, val, len);
-    op->next = NULL;
     return op;
 }
 
 /**
  *  @brief Free an option structure that was allocated by coap_msg_op_new
  *
+ *  Option structures and option values that are stored
+ *  inline in the message structure, and option values
+ *  in a message view, are not freed.
+ *
+ *  @param[in] msg Pointer to a message structure
  *  @param[in,out] op Pointer to the option structure
  */
-static void coap_msg_op_delete(coap_msg_op_t *op)
+static void coap_msg_op_delete(coap_msg_t *msg, coap_msg_op_t *op)
 {
-    coap_mem_medium_free(op->val);
-    coap_mem_small_free(op);
+    if ((!msg->view)
+     && ((op->val < msg->op_buf)
+      || (op->val >= msg->op_buf + sizeof(msg->op_buf))))
+    {
+        coap_mem_medium_free(op->val);
+    }
+    if ((op < msg->op_inline)
+     || (op >= msg->op_inline + COAP_MSG_OP_INLINE_NUM))
+    {
+        coap_mem_small_free(op);
+    }
 }
 
 /**
- *  @brief Initialise an option linked-list structure
+ *  @brief Initialise the option linked-list in a message structure
  *
- *  @param[out] list Pointer to an option linked-list structure
+ *  @param[out] msg Pointer to a message structure
  */
-static void coap_msg_op_list_create(coap_msg_op_list_t *list)
+static void coap_msg_op_list_create(coap_msg_t *msg)
 {
-    memset(list, 0, sizeof(coap_msg_op_list_t));
+    memset(&msg->op_list, 0, sizeof(coap_msg_op_list_t));
+    msg->op_inline_num = 0;
+    msg->op_buf_end = 0;
 }
 
 /**
- *  @brief Deinitialise an option linked-list structure
+ *  @brief Deinitialise the option linked-list in a message structure
  *
- *  @param[in,out] list Pointer to an option linked-list structure
+ *  @param[in,out] msg Pointer to a message structure
  */
-static void coap_msg_op_list_destroy(coap_msg_op_list_t *list)
+static void coap_msg_op_list_destroy(coap_msg_t *msg)
 {
     coap_msg_op_t *prev = NULL;
     coap_msg_op_t *op = NULL;
 
-    op = list->first;
+    op = msg->op_list.first;
     while (op != NULL)
     {
         prev = op;
         op = op->next;
-        coap_msg_op_delete(prev);
+        coap_msg_op_delete(msg, prev);
     }
-    memset(list, 0, sizeof(coap_msg_op_list_t));
+    memset(&msg->op_list, 0, sizeof(coap_msg_op_list_t));
+    msg->op_inline_num = 0;
+    msg->op_buf_end = 0;
 }
 
 /**
- *  @brief Allocate an option structure and add it to the end of an option linked-list structure
+ *  @brief Allocate an option structure and add it to the end of the option linked-list in a message structure
  *
- *  @param[in,out] list Pointer to an option linked-list structure
+ *  @param[in,out] msg Pointer to a message structure
  *  @param[in] num Option number
  *  @param[in] len Option length
  *  @param[in] val Pointer to a buffer containing the option value
@@ -267,11 +376,12 @@ static void coap_msg_op_list_destroy(coap_msg_op_list_t *list)
  *  @retval 0 Success
  *  @retval <0 Error
  */
-static int coap_msg_op_list_add_last(coap_msg_op_list_t *list, unsigned num, unsigned len, const char *val)
+static int coap_msg_op_list_add_last(coap_msg_t *msg, unsigned num, unsigned len, const char *val)
 {
+    coap_msg_op_list_t *list = &msg->op_list;
     coap_msg_op_t *op = NULL;
 
-    op = coap_msg_op_new(num, len, val);
+    op = coap_msg_op_new(msg, num, len, val);
     if (op == NULL)
     {
         return -ENOMEM;
@@ -290,11 +400,11 @@ static int coap_msg_op_list_add_last(coap_msg_op_list_t *list, unsigned num, uns
 }
 
 /**
- *  @brief Allocate an option structure and add it to an option linked-list structure
+ *  @brief Allocate an option structure and add it to the option linked-list in a message structure
  *
  *  The option is added to the list at a position determined by the option number.
  *
- *  @param[in,out] list Pointer to an option linked-list structure
+ *  @param[in,out] msg Pointer to a message structure
  *  @param[in] num Option number
  *  @param[in] len Option length
  *  @param[in] val Pointer to a buffer containing the option value
@@ -303,12 +413,13 @@ static int coap_msg_op_list_add_last(coap_msg_op_list_t *list, unsigned num, uns
  *  @retval 0 Success
  *  @retval <0 Error
  */
-static int coap_msg_op_list_add(coap_msg_op_list_t *list, unsigned num, unsigned len, const char *val)
+static int coap_msg_op_list_add(coap_msg_t *msg, unsigned num, unsigned len, const char *val)
 {
+    coap_msg_op_list_t *list = &msg->op_list;
     coap_msg_op_t *prev = NULL;
     coap_msg_op_t *op = NULL;
 
-    op = coap_msg_op_new(num, len, val);
+    op = coap_msg_op_new(msg, num, len, val);
     if (op == NULL)
     {
         return -ENOMEM;
@@ -349,13 +460,13 @@ void coap_msg_create(coap_msg_t *msg)
 {
     memset(msg, 0, sizeof(coap_msg_t));
     msg->ver = COAP_MSG_VER;
-    coap_msg_op_list_create(&msg->op_list);
+    coap_msg_op_list_create(msg);
 }
 
 void coap_msg_destroy(coap_msg_t *msg)
 {
-    coap_msg_op_list_destroy(&msg->op_list);
-    if (msg->payload != NULL)
+    coap_msg_op_list_destroy(msg);
+    if ((msg->payload != NULL) && (!msg->view))
     {
         coap_mem_medium_free(msg->payload);
     }
@@ -613,7 +724,7 @@ static ssize_t coap_msg_parse_op(coap_msg_t *msg, char *buf, size_t len)
     {
         op_num = coap_msg_op_get_num(prev) + op_delta;
     }
-    ret = coap_msg_op_list_add_last(&msg->op_list, op_num, op_len, p);
+    ret = coap_msg_op_list_add_last(msg, op_num, op_len, p);
     if (ret < 0)
     {
         return ret;
@@ -707,6 +818,13 @@ static ssize_t coap_msg_parse_payload(coap_msg_t *msg, char *buf, size_t len)
     {
         return -EBADMSG;
     }
+    if (msg->view)
+    {
+        msg->payload = p;
+        msg->payload_len = len;
+        p += len;
+        return p - buf;
+    }
     msg->payload = (char *)coap_mem_medium_alloc(len);
     if (msg->payload == NULL)
     {
@@ -719,12 +837,22 @@ static ssize_t coap_msg_parse_payload(coap_msg_t *msg, char *buf, size_t len)
     return p - buf;
 }
 
-ssize_t coap_msg_parse(coap_msg_t *msg, char *buf, size_t len)
+/**
+ *  @brief Parse a message into a message structure that has been reset
+ *
+ *  @param[in,out] msg Pointer to a message structure
+ *  @param[in] buf Pointer to a buffer containing the message
+ *  @param[in] len Length of the buffer
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static ssize_t coap_msg_parse_msg(coap_msg_t *msg, char *buf, size_t len)
 {
     ssize_t num = 0;
     char *p = buf;
 
-    coap_msg_reset(msg);
     num = coap_msg_parse_hdr(msg, p, len);
     if (num < 0)
     {
@@ -758,6 +886,68 @@ ssize_t coap_msg_parse(coap_msg_t *msg, char *buf, size_t len)
     return coap_msg_check(msg);
 }
 
+ssize_t coap_msg_parse(coap_msg_t *msg, char *buf, size_t len)
+{
+    coap_msg_reset(msg);
+    return coap_msg_parse_msg(msg, buf, len);
+}
+
+ssize_t coap_msg_parse_view(coap_msg_t *msg, char *buf, size_t len)
+{
+    coap_msg_reset(msg);
+    msg->view = 1;
+    return coap_msg_parse_msg(msg, buf, len);
+}
+
+int coap_msg_detach(coap_msg_t *msg)
+{
+    coap_msg_op_t *op = NULL;
+    char *payload = NULL;
+    char *val = NULL;
+
+    if (!msg->view)
+    {
+        return 0;
+    }
+    op = coap_msg_get_first_op(msg);
+    while (op != NULL)
+    {
+        val = coap_msg_op_alloc_val(msg, op->len);
+        if (val == NULL)
+        {
+            break;
+        }
+        memcpy(val, op->val, op->len);
+        op->val = val;
+        op = op->next;
+    }
+    if ((op == NULL) && (msg->payload != NULL))
+    {
+        payload = (char *)coap_mem_medium_alloc(msg->payload_len);
+        if (payload != NULL)
+        {
+            memset(payload, 0, coap_mem_medium_get_len());
+            memcpy(payload, msg->payload, msg->payload_len);
+        }
+    }
+    if ((op != NULL) || ((msg->payload != NULL) && (payload == NULL)))
+    {
+        /* drop the references into the buffer that were not copied */
+        while (op != NULL)
+        {
+            op->val = NULL;
+            op = op->next;
+        }
+        msg->payload = NULL;
+        msg->view = 0;
+        coap_msg_destroy(msg);
+        return -ENOMEM;
+    }
+    msg->payload = payload;
+    msg->view = 0;
+    return 0;
+}
+
 int coap_msg_set_type(coap_msg_t *msg, unsigned type)
 {
     if ((type != COAP_MSG_CON)
@@ -809,11 +999,19 @@ int coap_msg_set_token(coap_msg_t *msg, char *buf, size_t len)
 
 int coap_msg_add_op(coap_msg_t *msg, unsigned num, unsigned len, const char *val)
 {
-    return coap_msg_op_list_add(&msg->op_list, num, len, val);
+    if (msg->view)
+    {
+        return -EPERM;
+    }
+    return coap_msg_op_list_add(msg, num, len, val);
 }
 
 int coap_msg_set_payload(coap_msg_t *msg, char *buf, size_t len)
 {
+    if (msg->view)
+    {
+        return -EPERM;
+    }
     msg->payload_len = 0;
     if (msg->payload != NULL)
     {
@@ -837,11 +1035,11 @@ int coap_msg_set_payload(coap_msg_t *msg, char *buf, size_t len)
 void coap_msg_clear_payload(coap_msg_t *msg)
 {
     msg->payload_len = 0;
-    if (msg->payload != NULL)
+    if ((msg->payload != NULL) && (!msg->view))
     {
         coap_mem_medium_free(msg->payload);
-        msg->payload = NULL;
     }
+    msg->payload = NULL;
 }
 
 /**
@@ -931,7 +1129,7 @@ static ssize_t coap_msg_format_op(coap_msg_op_t *op, unsigned prev_num, char *bu
     {
         num += 2;
     }
-    else if (op->num >= 13)
+    else if (op->len >= 13)
     {
         num += 1;
     }
@@ -31,6 +31,9 @@
  *  @brief Source file for the FreeCoAP server library
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -43,8 +46,15 @@
 #include <netdb.h>
 #include <sys/socket.h>
 #include <sys/timerfd.h>
+#include <sys/eventfd.h>
 #include <sys/select.h>
 #include <sys/types.h>
+#ifdef COAP_EPOLL_EN
+#include <sys/epoll.h>
+#endif
+#ifdef COAP_SERVER_THREAD_EN
+#include <pthread.h>
+#endif
 #ifdef COAP_DTLS_EN
 #include <gnutls/x509.h>
 #endif
@@ -52,8 +62,29 @@
 #include "coap_mem.h"
 #include "coap_log.h"
 
+#if defined(COAP_SERVER_THREAD_EN) && !defined(COAP_MEM_THREAD_EN)
+#error "COAP_SERVER_THREAD_EN requires COAP_MEM_THREAD_EN"
+#endif
+
 #define COAP_SERVER_ACK_TIMEOUT_SEC             2                               /**< Minimum delay to wait before retransmitting a confirmable message */
 #define COAP_SERVER_MAX_RETRANSMIT              4                               /**< Maximum number of times a confirmable message can be retransmitted */
+#define COAP_SERVER_EXCHANGE_LIFETIME_SEC       247                             /**< Time from sending a confirmable message until its message ID can be safely reused (EXCHANGE_LIFETIME) */
+#define COAP_SERVER_TIMER_TICK_MSEC             10                              /**< Timer wheel tick duration (msec) */
+#define COAP_SERVER_TIMER_WHEEL_MASK            (COAP_SERVER_TIMER_WHEEL_SIZE - 1)
+                                                                                /**< Mask to wrap timer wheel slot numbers */
+#define COAP_SERVER_RES_MAX_SEG_LEN             255                             /**< Maximum length of a URI-Path option value */
+#define COAP_SERVER_OBS_HASH_MASK               (COAP_SERVER_OBS_HASH_SIZE - 1) /**< Mask to select an observer hash table bucket */
+#define COAP_SERVER_OBS_MAX_SEQ                 0xffffff                        /**< Mask to wrap Observe option values to 24 bits */
+#define COAP_SERVER_OBS_MAX_VAL_LEN             3                               /**< Maximum length of an Observe option value */
+#ifdef COAP_EPOLL_EN
+#define COAP_SERVER_NUM_EVENTS                  3                               /**< Maximum number of events returned by each call to epoll_wait */
+#endif
+#ifdef COAP_DTLS_EN
+#define coap_server_recv_pending(server)        0                               /**< Received datagrams are not batched when DTLS is enabled */
+#else
+#define coap_server_recv_pending(server)        ((server)->recv_next < (server)->recv_num)
+                                                                                /**< Check for datagrams waiting to be processed in the receive batch */
+#endif
 
 #ifdef COAP_DTLS_EN
 
@@ -69,2162 +100,5580 @@
 static int rand_init = 0;                                                       /**< Indicates if the random number generator has been initialised */
 
 /****************************************************************************************************
- *                                         coap_server_path                                         *
+ *                                         coap_server_res                                          *
  ****************************************************************************************************/
 
 /**
- *  @brief Allocate a URI path structure
+ *  @brief Compute the hash value of a resource
  *
- *  @param[in] str String representation of a URI path
+ *  @param[in] parent Pointer to the parent resource structure
+ *  @param[in] seg Buffer containing the URI path segment
+ *  @param[in] seg_len Length of the URI path segment
  *
- *  @returns New URI path structure
- *  @retval NULL Out-of-memory
+ *  @returns Hash value
  */
-static coap_server_path_t *coap_server_path_new(const char *str)
+static unsigned coap_server_res_hash(coap_server_res_t *parent, const char *seg, size_t seg_len)
 {
-    coap_server_path_t *path = NULL;
+    const unsigned char *p = (const unsigned char *)&parent;
+    uint32_t hash = 2166136261u;
+    size_t i = 0;
 
-    path = (coap_server_path_t *)coap_mem_small_alloc(sizeof(coap_server_path_t));
-    if (path == NULL)
+    /* FNV-1a */
+    for (i = 0; i < sizeof(parent); i++)
     {
-        return NULL;
+        hash ^= p[i];
+        hash *= 16777619u;
     }
-    path->str = (char *)coap_mem_small_alloc(strlen(str) + 1);
-    if (path->str == NULL)
+    p = (const unsigned char *)seg;
+    for (i = 0; i < seg_len; i++)
     {
-        coap_mem_small_free(path);
-        return NULL;
+        hash ^= p[i];
+        hash *= 16777619u;
     }
-    strncpy(path->str, str, coap_mem_small_get_len() - 1);
-    path->str[coap_mem_small_get_len() - 1] = '\0';
-    path->next = NULL;
-    return path;
+    return hash;
 }
 
 /**
- *  @brief Free a URI path structure
+ *  @brief Allocate a resource structure
+ *
+ *  @param[in] parent Pointer to the parent resource structure or NULL for the root
+ *  @param[in] seg Buffer containing the URI path segment
+ *  @param[in] seg_len Length of the URI path segment
  *
- *  @param[in,out] path Pointer to a URI path structure
+ *  @returns New resource structure
+ *  @retval NULL Out-of-memory
  */
-static void coap_server_path_delete(coap_server_path_t *path)
+static coap_server_res_t *coap_server_res_new(coap_server_res_t *parent, const char *seg, size_t seg_len)
 {
-    coap_mem_small_free(path->str);
-    coap_mem_small_free(path);
+    coap_server_res_t *res = NULL;
+
+    res = (coap_server_res_t *)calloc(1, sizeof(coap_server_res_t));
+    if (res == NULL)
+    {
+        return NULL;
+    }
+    res->seg = (char *)malloc(seg_len + 1);
+    if (res->seg == NULL)
+    {
+        free(res);
+        return NULL;
+    }
+    memcpy(res->seg, seg, seg_len);
+    res->seg[seg_len] = '\0';
+    res->seg_len = seg_len;
+    res->parent = parent;
+    res->hash = coap_server_res_hash(parent, seg, seg_len);
+    return res;
 }
 
 /**
- *  @brief Initialise a URI path list structure
+ *  @brief Free a resource structure
  *
- *  @param[out] list Pointer to a URI path list structure
+ *  @param[in,out] res Pointer to a resource structure
  */
-static void coap_server_path_list_create(coap_server_path_list_t *list)
+static void coap_server_res_delete(coap_server_res_t *res)
 {
-    memset(list, 0, sizeof(coap_server_path_list_t));
+    free(res->seg);
+    free(res);
 }
 
 /**
- *  @brief Deinitialise a URI path list structure
+ *  @brief Free all of the resource structures in a server structure
  *
- *  @param[in,out] list Pointer to a URI path list structure
+ *  @param[in,out] server Pointer to a server structure
  */
-static void coap_server_path_list_destroy(coap_server_path_list_t *list)
+static void coap_server_res_table_destroy(coap_server_t *server)
 {
-    coap_server_path_t *prev = NULL;
-    coap_server_path_t *path = NULL;
+    coap_server_res_t *next = NULL;
+    coap_server_res_t *res = NULL;
+    unsigned i = 0;
 
-    path = list->first;
-    while (path != NULL)
+    if (server->res_hash != NULL)
     {
-        prev = path;
-        path = path->next;
-        coap_server_path_delete(prev);
+        for (i = 0; i <= server->res_hash_mask; i++)
+        {
+            res = server->res_hash[i];
+            while (res != NULL)
+            {
+                next = res->hash_next;
+                coap_server_res_delete(res);
+                res = next;
+            }
+        }
+        free(server->res_hash);
     }
-    memset(list, 0, sizeof(coap_server_path_list_t));
+    if (server->res_root != NULL)
+    {
+        coap_server_res_delete(server->res_root);
+    }
+    server->res_root = NULL;
+    server->res_hash = NULL;
+    server->res_hash_mask = 0;
+    server->res_num = 0;
 }
 
 /**
- *  @brief Add a URI path to a URI path list structure
+ *  @brief Double the number of buckets in the resource hash table
  *
- *  @param[in,out] list Pointer to a URI path list structure
- *  @param[in] str String representation of a URI path
+ *  @param[in,out] server Pointer to a server structure
  *
  *  @returns Operation status
  *  @retval 0 Success
  *  @retval <0 Error
  */
-static int coap_server_path_list_add(coap_server_path_list_t *list, const char *str)
+static int coap_server_res_table_grow(coap_server_t *server)
 {
-    coap_server_path_t *path = NULL;
+    coap_server_res_t **res_hash = NULL;
+    coap_server_res_t *next = NULL;
+    coap_server_res_t *res = NULL;
+    unsigned num_buckets = 0;
+    unsigned mask = 0;
+    unsigned i = 0;
+    unsigned j = 0;
 
-    path = coap_server_path_new(str);
-    if (path == NULL)
+    num_buckets = 2 * (server->res_hash_mask + 1);
+    mask = num_buckets - 1;
+    res_hash = (coap_server_res_t **)calloc(num_buckets, sizeof(coap_server_res_t *));
+    if (res_hash == NULL)
     {
         return -ENOMEM;
     }
-    if (list->first == NULL)
-    {
-        list->first = path;
-        list->last = path;
-    }
-    else
+    for (i = 0; i <= server->res_hash_mask; i++)
     {
-        list->last->next = path;
-        list->last = path;
+        res = server->res_hash[i];
+        while (res != NULL)
+        {
+            next = res->hash_next;
+            j = res->hash & mask;
+            res->hash_next = res_hash[j];
+            res_hash[j] = res;
+            res = next;
+        }
     }
+    free(server->res_hash);
+    server->res_hash = res_hash;
+    server->res_hash_mask = mask;
     return 0;
 }
 
 /**
- *  @brief Search a URI path list structure for a URI path
+ *  @brief Search for the child of a resource with a given URI path segment
  *
- *  @param[in] list Pointer to a URI path list structure
- *  @param[in] str String representation of a URI path
+ *  @param[in] server Pointer to a server structure
+ *  @param[in] parent Pointer to the parent resource structure
+ *  @param[in] seg Buffer containing the URI path segment
+ *  @param[in] seg_len Length of the URI path segment
  *
- *  @returns Comparison value
- *  @retval 0 The URI path list structure does not contain the URI path
- *  @retval 1 The URI path list structure does contain the URI path
+ *  @returns Pointer to a resource structure
+ *  @retval NULL Not found
  */
-static int coap_server_path_list_match(coap_server_path_list_t *list, const char *str)
+static coap_server_res_t *coap_server_res_find(coap_server_t *server, coap_server_res_t *parent, const char *seg, size_t seg_len)
 {
-    coap_server_path_t *path = NULL;
+    coap_server_res_t *res = NULL;
+    unsigned hash = 0;
 
-    path = list->first;
-    while (path != NULL)
+    hash = coap_server_res_hash(parent, seg, seg_len);
+    for (res = server->res_hash[hash & server->res_hash_mask]; res != NULL; res = res->hash_next)
     {
-        coap_log_debug("Comparing URI path: '%s' with list URI path: '%s'", str, path->str);
-        if (strcmp(path->str, str) == 0)
+        if ((res->hash == hash)
+         && (res->parent == parent)
+         && (res->seg_len == seg_len)
+         && (memcmp(res->seg, seg, seg_len) == 0))
         {
-            coap_log_debug("Matched URI path: '%s' with list URI path: '%s'", str, path->str);
-            return 1;
+            return res;
         }
-        path = path->next;
     }
-    return 0;
+    return NULL;
 }
 
-#ifdef COAP_DTLS_EN
-
-/****************************************************************************************************
- *                                      coap_server_trans_dtls                                      *
- ****************************************************************************************************/
-
 /**
- *  @brief Listen for a packet from the client with a timeout
+ *  @brief Find or create the resource structure for a URI path
  *
- *  @param[in] trans Pointer to a transaction structure
- *  @param[in] ms Timeout value in msec
+ *  The URI path is split into segments on '/' characters.
+ *  A single leading '/' is ignored so "/a/b" and "a/b"
+ *  name the same resource and "/" and "" name the root.
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in] str String representation of a URI path
+ *  @param[in] create Flag to indicate that missing resource structures should be created
+ *  @param[out] res Pointer to a resource structure pointer
  *
  *  @returns Operation status
- *  @retval 1 Success
- *  @retval 0 Timeout
+ *  @retval 0 Success
+ *  @retval -ENOENT The resource structure does not exist and create is 0
  *  @retval <0 Error
  */
-static int coap_server_trans_dtls_listen_timeout(coap_server_trans_t *trans, unsigned ms)
+static int coap_server_res_get(coap_server_t *server, const char *str, int create, coap_server_res_t **res)
 {
-    coap_server_t *server = NULL;
-    struct timeval tv = {0};
-    fd_set read_fds = {{0}};
+    coap_server_res_t *child = NULL;
+    coap_server_res_t *node = NULL;
+    const char *end = NULL;
+    size_t seg_len = 0;
     int ret = 0;
 
-    server = trans->server;
-    tv.tv_sec = ms / 1000;
-    tv.tv_usec = (ms % 1000) * 1000;
-    while (1)
+    if ((server->res_root == NULL) && (!create))
     {
-        FD_ZERO(&read_fds);
-        FD_SET(server->sd, &read_fds);
-        ret = select(server->sd + 1, &read_fds, NULL, NULL, &tv);
-        if (ret < 0)
+        return -ENOENT;
+    }
+    if (server->res_root == NULL)
+    {
+        server->res_hash = (coap_server_res_t **)calloc(COAP_SERVER_RES_HASH_SIZE, sizeof(coap_server_res_t *));
+        if (server->res_hash == NULL)
         {
-            return -errno;
+            return -ENOMEM;
         }
-        if (ret == 0)
+        server->res_hash_mask = COAP_SERVER_RES_HASH_SIZE - 1;
+        server->res_root = coap_server_res_new(NULL, "", 0);
+        if (server->res_root == NULL)
         {
-            return 0;  /* timeout */
+            free(server->res_hash);
+            server->res_hash = NULL;
+            return -ENOMEM;
         }
-        if (FD_ISSET(server->sd, &read_fds))
+    }
+    node = server->res_root;
+    if (*str == '/')
+    {
+        str++;
+    }
+    while (*str != '\0')
+    {
+        end = strchr(str, '/');
+        seg_len = (end != NULL) ? (size_t)(end - str) : strlen(str);
+        if (seg_len > COAP_SERVER_RES_MAX_SEG_LEN)
         {
-            return 1;  /* success */
+            return -EINVAL;
+        }
+        child = coap_server_res_find(server, node, str, seg_len);
+        if ((child == NULL) && (!create))
+        {
+            return -ENOENT;
+        }
+        if (child == NULL)
+        {
+            if (server->res_num >= server->res_hash_mask + 1)
+            {
+                ret = coap_server_res_table_grow(server);
+                if (ret < 0)
+                {
+                    return ret;
+                }
+            }
+            child = coap_server_res_new(node, str, seg_len);
+            if (child == NULL)
+            {
+                return -ENOMEM;
+            }
+            child->hash_next = server->res_hash[child->hash & server->res_hash_mask];
+            server->res_hash[child->hash & server->res_hash_mask] = child;
+            server->res_num++;
+        }
+        node = child;
+        str += seg_len;
+        if (*str == '/')
+        {
+            str++;
         }
     }
+    *res = node;
+    return 0;
 }
 
 /**
- *  @brief Receive data from the client
- *
- *  This is a call-back function that the
- *  GnuTLS library uses to receive data.
- *  To report an error, it sets errno and
- *  returns -1.
+ *  @brief Search for the resource structure that matches the URI path of a message
  *
- *  @param[in,out] data Pointer to a transaction structure
- *  @param[out] buf Pointer to a buffer
- *  @param[in] len Length of the buffer
+ *  @param[in] server Pointer to a server structure
+ *  @param[in] msg Pointer to a message structure
  *
- *  @returns Number of bytes received or error
- *  @retval 0 Number of bytes received
- *  @retval -1 Error
+ *  @returns Pointer to a resource structure
+ *  @retval NULL Not found
  */
-static ssize_t coap_server_trans_dtls_pull_func(gnutls_transport_ptr_t data, void *buf, size_t len)
+static coap_server_res_t *coap_server_res_match(coap_server_t *server, coap_msg_t *msg)
 {
-    coap_ipv_sockaddr_in_t client_sin = {0};
-    coap_server_trans_t *trans = NULL;
-    coap_server_t *server = NULL;
-    socklen_t client_sin_len = 0;
-    ssize_t num = 0;
+    coap_server_res_t *res = NULL;
+    coap_msg_op_t *op = NULL;
 
-    trans = (coap_server_trans_t *)data;
-    server = trans->server;
-    client_sin_len = sizeof(client_sin);
-    num = recvfrom(server->sd, buf, len, MSG_PEEK, (struct sockaddr *)&client_sin, &client_sin_len);  /* peek data */
-    if (num < 0)
-    {
-        return -1;
-    }
-    if ((client_sin_len != trans->client_sin_len)
-     || (memcmp(&client_sin, &trans->client_sin, trans->client_sin_len) != 0))
-    {
-        errno = EINVAL;
-        return -1;
-    }
-    num = recvfrom(server->sd, buf, num, 0, (struct sockaddr *)&client_sin, &client_sin_len);  /* consume data */
-    if (num >= 0)
+    res = server->res_root;
+    op = coap_msg_get_first_op(msg);
+    while ((op != NULL) && (res != NULL))
     {
-        coap_log_debug("pulled %zd bytes", num);
+        if (coap_msg_op_get_num(op) == COAP_MSG_URI_PATH)
+        {
+            res = coap_server_res_find(server, res, coap_msg_op_get_val(op), coap_msg_op_get_len(op));
+        }
+        op = coap_msg_op_get_next(op);
     }
-    return num;
+    return res;
 }
 
 /**
- *  @brief Wait for receive data from the client
- *
- *  This is a call-back function that the GnuTLS
- *  library uses to wait for receive data. To
- *  report an error, it sets errno and returns -1.
+ *  @brief Add the URI-Path options that name a resource to a message
  *
- *  @param[in,out] data Pointer to a transaction structure
- *  @param[in] ms Timeout in msec
+ *  @param[in] res Pointer to a resource structure
+ *  @param[in,out] msg Pointer to a message structure
  *
- *  @returns Number of bytes received or error
- *  @retval >0 Number of bytes received
- *  @retval 0 Timeout
- *  @retval -1 Error
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
  */
-static int coap_server_trans_dtls_pull_timeout_func(gnutls_transport_ptr_t data, unsigned ms)
+static int coap_server_res_add_uri_path(coap_server_res_t *res, coap_msg_t *msg)
 {
-    coap_ipv_sockaddr_in_t client_sin = {0};
-    coap_server_trans_t *trans = NULL;
-    coap_server_t *server = NULL;
-    socklen_t client_sin_len = 0;
-    ssize_t num = 0;
-    char buf[COAP_SERVER_DTLS_MTU] = {0};
     int ret = 0;
 
-    trans = (coap_server_trans_t *)data;
-    server = trans->server;
-    ret = coap_server_trans_dtls_listen_timeout(trans, ms);
-    if (ret == 0)
+    if (res->parent == NULL)
     {
-        return 0;  /* timeout */
+        return 0;
     }
+    ret = coap_server_res_add_uri_path(res->parent, msg);
     if (ret < 0)
     {
-        /* errno has been set by coap_server_trans_dtls_listen_timeout */
-        return -1;
-    }
-    client_sin_len = sizeof(client_sin);
-    num = recvfrom(server->sd, buf, sizeof(buf), MSG_PEEK, (struct sockaddr *)&client_sin, &client_sin_len);  /* peek data */
-    if (num < 0)
-    {
-        return -1;
-    }
-    if ((client_sin_len != trans->client_sin_len)
-     || (memcmp(&client_sin, &trans->client_sin, trans->client_sin_len) != 0))
-    {
-        errno = EINVAL;
-        return -1;
+        return ret;
     }
-    return num;  /* success */
+    return coap_msg_add_op(msg, COAP_MSG_URI_PATH, res->seg_len, res->seg);
 }
 
+/****************************************************************************************************
+ *                                         coap_server_obs                                          *
+ ****************************************************************************************************/
+
 /**
- *  @brief Send data to the client
+ *  @brief Get the hash table bucket that holds the observers of a resource
  *
- *  This is a call-back function that the
- *  GnuTLS library uses to send data. To
- *  report an error, it sets errno and
- *  returns -1.
+ *  @param[in] server Pointer to a server structure
+ *  @param[in] res Pointer to a resource structure
  *
- *  @param[in] data Pointer to a transaction structure
- *  @param[in] buf Pointer to a buffer
- *  @param[in] len Length of the buffer
+ *  @returns Pointer to the head of the hash chain
+ */
+static coap_server_obs_t **coap_server_obs_bucket(coap_server_t *server, coap_server_res_t *res)
+{
+    return &server->obs_hash[res->hash & COAP_SERVER_OBS_HASH_MASK];
+}
+
+/**
+ *  @brief Search for the observer structure of a client endpoint for a resource
  *
- *  @returns Number of bytes sent or error
- *  @retval >0 Number of bytes sent
- *  @retval -1 Error
+ *  @param[in] trans Pointer to a transaction structure
+ *  @param[in] res Pointer to a resource structure
+ *
+ *  @returns Pointer to an observer structure
+ *  @retval NULL Not found
  */
-static ssize_t coap_server_trans_dtls_push_func(gnutls_transport_ptr_t data, const void *buf, size_t len)
+static coap_server_obs_t *coap_server_obs_find(coap_server_trans_t *trans, coap_server_res_t *res)
 {
-    coap_server_trans_t *trans = NULL;
-    coap_server_t *server = NULL;
-    ssize_t num = 0;
+    coap_server_obs_t *obs = NULL;
 
-    trans = (coap_server_trans_t *)data;
-    server = trans->server;
-    num = sendto(server->sd, buf, len, 0, (struct sockaddr *)&trans->client_sin, trans->client_sin_len);
-    if (num >= 0)
+    for (obs = trans->obs; obs != NULL; obs = obs->trans_next)
     {
-        coap_log_debug("pushed %zd bytes", num);
+        if (obs->res == res)
+        {
+            return obs;
+        }
     }
-    return num;
+    return NULL;
 }
 
 /**
- *  @brief Perform a DTLS handshake with the client
+ *  @brief Register a client endpoint as an observer of a resource
+ *
+ *  If the client endpoint already observes the resource
+ *  the token of the existing registration is replaced.
  *
  *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in] res Pointer to a resource structure
+ *  @param[in] req Pointer to the registration request message
+ *  @param[out] obs Pointer to an observer structure pointer
  *
- *  @returns Operation success
+ *  @returns Operation status
  *  @retval 0 Success
+ *  @retval -ENOSPC The client endpoint observes too many resources
  *  @retval <0 Error
  */
-static int coap_server_trans_dtls_handshake(coap_server_trans_t *trans)
+static int coap_server_obs_add(coap_server_trans_t *trans, coap_server_res_t *res, coap_msg_t *req, coap_server_obs_t **obs)
 {
-    gnutls_alert_description_t alert = 0;
-    gnutls_cipher_algorithm_t cipher = 0;
-    gnutls_mac_algorithm_t mac = 0;
-    gnutls_kx_algorithm_t kx = 0;
-    const char *cipher_suite = NULL;
-    const char *alert_name = NULL;
-    unsigned timeout = 0;
-    int ret = 0;
-    int i = 0;
+    coap_server_obs_t **bucket = NULL;
+    coap_server_obs_t *node = NULL;
 
-    coap_log_info("Initiating DTLS handshake");
-    for (i = 0; i < COAP_SERVER_DTLS_HANDSHAKE_ATTEMPTS; i++)
+    node = coap_server_obs_find(trans, res);
+    if (node == NULL)
     {
-        errno = 0;
-        ret = gnutls_handshake(trans->session);
-        coap_log_debug("DTLS handshake result: %s", gnutls_strerror_name(ret));
-        if ((errno != 0) && (errno != EAGAIN))
-        {
-            return -errno;
-        }
-        if (ret == GNUTLS_E_SUCCESS)
+        if (trans->num_obs >= COAP_SERVER_TRANS_MAX_OBS)
         {
-            coap_log_info("Completed DTLS handshake");
-            /* determine which cipher suite was negotiated */
-            kx = gnutls_kx_get(trans->session);
-            cipher = gnutls_cipher_get(trans->session);
-            mac = gnutls_mac_get(trans->session);
-            cipher_suite = gnutls_cipher_suite_get_name(kx, cipher, mac);
-            if (cipher_suite != NULL)
-                coap_log_info("Cipher suite is TLS_%s", cipher_suite);
-            else
-                coap_log_info("Cipher suite is unknown");
-            return 0;  /* success */
+            return -ENOSPC;
         }
-        if (ret == GNUTLS_E_TIMEDOUT)
+        node = (coap_server_obs_t *)calloc(1, sizeof(coap_server_obs_t));
+        if (node == NULL)
         {
-            break;
+            return -ENOMEM;
         }
-        if ((ret == GNUTLS_E_FATAL_ALERT_RECEIVED)
-         || (ret == GNUTLS_E_WARNING_ALERT_RECEIVED))
-        {
-            alert = gnutls_alert_get(trans->session);
-            alert_name = gnutls_alert_get_name(alert);
-            if (ret == GNUTLS_E_FATAL_ALERT_RECEIVED)
-                coap_log_error("Received DTLS alert from the client: %s", alert_name);
-            else
-                coap_log_warn("Received DTLS alert from the client: %s", alert_name);
-            return -ECONNRESET;
-        }
-        if (ret != GNUTLS_E_AGAIN)
-        {
-            coap_log_error("Failed to complete DTLS handshake: %s", gnutls_strerror_name(ret));
-            return -1;
-        }
-        if (i < COAP_SERVER_DTLS_HANDSHAKE_ATTEMPTS - 1)
-        {
-            timeout = gnutls_dtls_get_timeout(trans->session);
-            coap_log_debug("Handshake timeout: %u msec", timeout);
-            ret = coap_server_trans_dtls_listen_timeout(trans, timeout);
-            if (ret < 0)
-            {
-                return ret;
-            }
-        }
-    }
-    return -ETIMEDOUT;
+        node->res = res;
+        node->trans = trans;
+        bucket = coap_server_obs_bucket(trans->server, res);
+        node->hash_next = *bucket;
+        *bucket = node;
+        node->trans_next = trans->obs;
+        trans->obs = node;
+        trans->num_obs++;
+    }
+    memcpy(node->token, coap_msg_get_token(req), coap_msg_get_token_len(req));
+    node->token_len = coap_msg_get_token_len(req);
+    node->seq = __atomic_load_n(&res->obs_seq, __ATOMIC_ACQUIRE);
+    node->notified = 0;
+    *obs = node;
+    coap_log_info("Added observer at address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+    return 0;
 }
 
-#ifdef COAP_CLIENT_AUTH
-
 /**
- *  @brief Verify the clients's certificate
- *
- *  @param[in,out] trans Pointer to a transaction structure
+ *  @brief Remove an observer structure and free it
  *
- *  @returns Operation success
- *  @retval 0 Success
- *  @retval <0 Error
+ *  @param[in,out] obs Pointer to an observer structure
  */
-static int coap_server_trans_dtls_verify_peer_cert(coap_server_trans_t *trans)
+static void coap_server_obs_delete(coap_server_obs_t *obs)
 {
-    gnutls_certificate_type_t cert_type = 0;
-    const gnutls_datum_t *cert_list = NULL;
-    gnutls_x509_crt_t cert = {0};
-    unsigned cert_list_size = 0;
-    unsigned status = 0;
-    time_t expiration_time = 0;
-    time_t activation_time = 0;
-    time_t current_time = 0;
-    int ret = 0;
+    coap_server_trans_t *trans = obs->trans;
+    coap_server_obs_t **link = NULL;
 
-    ret = gnutls_certificate_verify_peers2(trans->session, &status);
-    if (ret != GNUTLS_E_SUCCESS)
-    {
-        coap_log_error("The peer certificate was not verified: %s", gnutls_strerror_name(ret));
-        return -1;
-    }
-    if (status & GNUTLS_CERT_INVALID)
-    {
-        coap_log_error("The peer certificate is not trusted");
-        return -1;
-    }
-    if (status & GNUTLS_CERT_SIGNER_NOT_FOUND)
-    {
-        coap_log_error("No issuer found for the peer certificate");
-        return -1;
-    }
-    if (status & GNUTLS_CERT_SIGNER_NOT_CA)
-    {
-        coap_log_error("The issuer for the peer certificate is not a certificate authority");
-        return -1;
-    }
-    if (status & GNUTLS_CERT_REVOKED)
+    link = coap_server_obs_bucket(trans->server, obs->res);
+    while (*link != obs)
     {
-        coap_log_error("The peer certificate has been revoked");
-        return -1;
+        link = &(*link)->hash_next;
     }
-    cert_type = gnutls_certificate_type_get(trans->session);
-    if (cert_type != GNUTLS_CRT_X509)
+    *link = obs->hash_next;
+    link = &trans->obs;
+    while (*link != obs)
     {
-        coap_log_error("The peer certificate is not an X509 certificate");
-        return -1;
+        link = &(*link)->trans_next;
     }
-    ret = gnutls_x509_crt_init(&cert);
-    if (ret != GNUTLS_E_SUCCESS)
+    *link = obs->trans_next;
+    trans->num_obs--;
+    coap_log_info("Removed observer at address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+    free(obs);
+}
+
+/**
+ *  @brief Remove all of the observer structures of a client endpoint
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ */
+static void coap_server_obs_delete_trans(coap_server_trans_t *trans)
+{
+    while (trans->obs != NULL)
     {
-        coap_log_error("Unable to initialise gnutls_x509_crt_t object: %s", gnutls_strerror_name(ret));
-        return -1;
+        coap_server_obs_delete(trans->obs);
     }
-    cert_list = gnutls_certificate_get_peers(trans->session, &cert_list_size);
-    if (cert_list == NULL)
+}
+
+/**
+ *  @brief Remove the observer structure that a reset message refers to
+ *
+ *  A client that is no longer interested in a resource
+ *  rejects the next notification with a reset message.
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in] msg Pointer to the reset message
+ *
+ *  @returns Comparison value
+ *  @retval 0 The reset message does not match a notification
+ *  @retval 1 The reset message matches a notification and the observer has been removed
+ */
+static int coap_server_obs_handle_reset(coap_server_trans_t *trans, coap_msg_t *msg)
+{
+    coap_server_obs_t *obs = NULL;
+
+    for (obs = trans->obs; obs != NULL; obs = obs->trans_next)
     {
-        coap_log_error("No peer certificate found");
-        gnutls_x509_crt_deinit(cert);
-        return -1;
+        if ((obs->notified) && (obs->msg_id == coap_msg_get_msg_id(msg)))
+        {
+            coap_server_obs_delete(obs);
+            return 1;
+        }
     }
-    /* We only check the first (leaf) certificate in the chain */
-    ret = gnutls_x509_crt_import(cert, &cert_list[0], GNUTLS_X509_FMT_DER);
-    if (ret != GNUTLS_E_SUCCESS)
+    return 0;
+}
+
+/**
+ *  @brief Format a message from a message formatted without a token
+ *
+ *  The type, message ID and token are inserted into the
+ *  header. The code, options and payload are copied.
+ *
+ *  @param[in] tmpl Buffer containing the message formatted without a token
+ *  @param[in] tmpl_len Length of the formatted message
+ *  @param[in] type Message type
+ *  @param[in] msg_id Message ID
+ *  @param[in] token Buffer containing the token
+ *  @param[in] token_len Length of the token
+ *  @param[out] buf Pointer to a buffer to contain the message
+ *  @param[in] len Length of the buffer
+ *
+ *  @returns Length of the message or error code
+ *  @retval >0 Length of the message
+ *  @retval <0 Error
+ */
+static ssize_t coap_server_format_tmpl(const char *tmpl, size_t tmpl_len,
+                                       unsigned type, unsigned msg_id,
+                                       const char *token, unsigned token_len,
+                                       char *buf, size_t len)
+{
+    if ((tmpl_len < 4) || (tmpl_len + token_len > len))
     {
-        coap_log_error("Unable to parse certificate: %s", gnutls_strerror_name(ret));
-        gnutls_x509_crt_deinit(cert);
-        return -1;
+        return -ENOSPC;
     }
-    current_time = time(NULL);
-    expiration_time = gnutls_x509_crt_get_expiration_time(cert);
-    if ((expiration_time == -1) || (expiration_time < current_time))
+    /* version, type and token length */
+    buf[0] = (tmpl[0] & 0xc0) | ((type & 0x03) << 4) | (token_len & 0x0f);
+    /* code */
+    buf[1] = tmpl[1];
+    /* message ID */
+    buf[2] = (msg_id >> 8) & 0xff;
+    buf[3] = msg_id & 0xff;
+    memcpy(buf + 4, token, token_len);
+    memcpy(buf + 4 + token_len, tmpl + 4, tmpl_len - 4);
+    return tmpl_len + token_len;
+}
+
+/****************************************************************************************************
+ *                                        coap_server_cache                                         *
+ ****************************************************************************************************/
+
+/**
+ *  @brief Compute the hash value of a response cache key
+ *
+ *  @param[in] key Buffer containing the key
+ *  @param[in] key_len Length of the key
+ *
+ *  @returns Hash value
+ */
+static unsigned coap_server_cache_hash(const char *key, size_t key_len)
+{
+    const unsigned char *p = (const unsigned char *)key;
+    uint32_t hash = 2166136261u;
+    size_t i = 0;
+
+    /* FNV-1a */
+    for (i = 0; i < key_len; i++)
     {
-        coap_log_error("The peer certificate has expired");
-        gnutls_x509_crt_deinit(cert);
-        return -1;
+        hash ^= p[i];
+        hash *= 16777619u;
     }
-    activation_time = gnutls_x509_crt_get_activation_time(cert);
-    if ((activation_time == -1) || (activation_time > current_time))
+    return hash;
+}
+
+/**
+ *  @brief Append an option to a response cache key
+ *
+ *  @param[out] key Buffer to contain the key
+ *  @param[in,out] key_len Length of the key
+ *  @param[in] op Pointer to an option structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval -ENOSPC The key is too long
+ */
+static int coap_server_cache_key_add_op(char *key, size_t *key_len, coap_msg_op_t *op)
+{
+    unsigned len = coap_msg_op_get_len(op);
+
+    if (*key_len + 3 + len > COAP_SERVER_CACHE_KEY_LEN)
     {
-        coap_log_error("The peer certificate is not yet activated");
-        gnutls_x509_crt_deinit(cert);
-        return -1;
+        return -ENOSPC;
     }
-    coap_log_info("Peer certificate validated");
-    gnutls_x509_crt_deinit(cert);
+    key[(*key_len)++] = coap_msg_op_get_num(op);
+    key[(*key_len)++] = (len >> 8) & 0xff;
+    key[(*key_len)++] = len & 0xff;
+    memcpy(key + *key_len, coap_msg_op_get_val(op), len);
+    *key_len += len;
     return 0;
 }
 
-#endif  /* COAP_CLIENT_AUTH */
-
 /**
- *  @brief Initialise the DTLS members of a transaction structure
+ *  @brief Form the response cache key of a request
  *
- *  Perform a DTLS handshake with the client.
+ *  The key is the method followed by the URI-Path, URI-Query
+ *  and Accept options in order. The options of a message are
+ *  kept sorted by option number so the URI-Path options form
+ *  a prefix of the key.
  *
- *  @param[out] trans Pointer to a transaction structure
+ *  @param[in] msg Pointer to the request message
+ *  @param[out] key Buffer to contain the key
+ *  @param[out] key_len Length of the key
+ *  @param[out] path_len Length of the part of the key that contains the method and URI-Path options
  *
  *  @returns Operation status
  *  @retval 0 Success
- *  @retval <0 Error
+ *  @retval -ENOENT The request contains an option that the cache does not handle
+ *  @retval -ENOSPC The key is too long
  */
-static int coap_server_trans_dtls_create(coap_server_trans_t *trans)
+static int coap_server_cache_key(coap_msg_t *msg, char *key, size_t *key_len, size_t *path_len)
 {
-    coap_server_t *server = NULL;
+    coap_msg_op_t *op = NULL;
+    unsigned num = 0;
     int ret = 0;
 
-    server = trans->server;
-    ret = gnutls_init(&trans->session, GNUTLS_SERVER | GNUTLS_DATAGRAM | GNUTLS_NONBLOCK);
-    if (ret != GNUTLS_E_SUCCESS)
-    {
-        coap_log_error("Failed to initialise DTLS session: %s", gnutls_strerror_name(ret));
-        return -1;
-    }
-    ret = gnutls_credentials_set(trans->session, GNUTLS_CRD_CERTIFICATE, server->cred);
-    if (ret != GNUTLS_E_SUCCESS)
-    {
-        coap_log_error("Failed to assign credentials to DTLS session: %s", gnutls_strerror_name(ret));
-        gnutls_deinit(trans->session);
-        return -1;
-    }
-    ret = gnutls_priority_set(trans->session, server->priority);
-    if (ret != GNUTLS_E_SUCCESS)
-    {
-        coap_log_error("Failed to assign priorities to DTLS session: %s", gnutls_strerror_name(ret));
-        gnutls_deinit(trans->session);
-        return -1;
-    }
-    gnutls_transport_set_ptr(trans->session, trans);
-    gnutls_transport_set_pull_function(trans->session, coap_server_trans_dtls_pull_func);
-    gnutls_transport_set_pull_timeout_function(trans->session, coap_server_trans_dtls_pull_timeout_func);
-    gnutls_transport_set_push_function(trans->session, coap_server_trans_dtls_push_func);
-    gnutls_dtls_set_mtu(trans->session, COAP_SERVER_DTLS_MTU);
-    gnutls_dtls_set_timeouts(trans->session, COAP_SERVER_DTLS_RETRANS_TIMEOUT, COAP_SERVER_DTLS_TOTAL_TIMEOUT);
-#ifdef COAP_CLIENT_AUTH
-    gnutls_certificate_server_set_request(trans->session, GNUTLS_CERT_REQUIRE);
-#endif
-    ret = coap_server_trans_dtls_handshake(trans);
-    if (ret < 0)
+    key[0] = coap_msg_get_code_detail(msg);
+    *key_len = 1;
+    *path_len = 0;
+    for (op = coap_msg_get_first_op(msg); op != NULL; op = coap_msg_op_get_next(op))
     {
-        gnutls_deinit(trans->session);
-        return ret;
+        num = coap_msg_op_get_num(op);
+        if (num == COAP_MSG_ETAG)
+        {
+            continue;
+        }
+        if ((num != COAP_MSG_URI_PATH)
+         && (num != COAP_MSG_URI_QUERY)
+         && (num != COAP_MSG_ACCEPT))
+        {
+            return -ENOENT;
+        }
+        if ((num != COAP_MSG_URI_PATH) && (*path_len == 0))
+        {
+            *path_len = *key_len;
+        }
+        ret = coap_server_cache_key_add_op(key, key_len, op);
+        if (ret < 0)
+        {
+            return ret;
+        }
     }
-#ifdef COAP_CLIENT_AUTH
-    ret = coap_server_trans_dtls_verify_peer_cert(trans);
-    if (ret < 0)
+    if (*path_len == 0)
     {
-        gnutls_deinit(trans->session);
-        return ret;
+        *path_len = *key_len;
     }
-#endif
     return 0;
 }
 
+#ifdef COAP_SERVER_THREAD_EN
+
 /**
- *  @brief Deinitialise the DTLS members of a transaction structure
+ *  @brief Get the response cache generation counter for a URI path
  *
- *  @param[in,out] trans Pointer to a transaction structure
+ *  The counters are kept in the server structure that
+ *  created the workers so that they are shared by all of them.
+ *
+ *  @param[in] server Pointer to a server structure
+ *  @param[in] path Buffer containing the method and URI-Path options of a key
+ *  @param[in] path_len Length of the method and URI-Path options
+ *
+ *  @returns Pointer to the generation counter
  */
-static void coap_server_trans_dtls_destroy(coap_server_trans_t *trans)
+static unsigned *coap_server_cache_gen(coap_server_t *server, const char *path, size_t path_len)
 {
-    gnutls_bye(trans->session, GNUTLS_SHUT_WR);
-    gnutls_deinit(trans->session);
+    if (server->master != NULL)
+    {
+        server = server->master;
+    }
+    return &server->cache_gen[coap_server_cache_hash(path, path_len) & (COAP_SERVER_CACHE_GEN_NUM - 1)];
 }
 
-#endif  /* COAP_DTLS_EN */
-
-/****************************************************************************************************
- *                                        coap_server_trans                                         *
- ****************************************************************************************************/
+#endif  /* COAP_SERVER_THREAD_EN */
 
 /**
- *  @brief Free the resources assigned to a blockwise transfer
+ *  @brief Add a response cache entry to the hash table and to the front of the LRU list
  *
- *  @param[out] trans Pointer to a transaction structure
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in,out] entry Pointer to a response cache entry structure
  */
-static void coap_server_trans_clear_blockwise(coap_server_trans_t *trans)
+static void coap_server_cache_link(coap_server_t *server, coap_server_cache_entry_t *entry)
 {
-    trans->type = COAP_SERVER_TRANS_REGULAR;
-    if (trans->body != NULL)
+    unsigned i = entry->hash & server->cache_hash_mask;
+
+    entry->hash_next = server->cache_hash[i];
+    server->cache_hash[i] = entry;
+    entry->lru_prev = NULL;
+    entry->lru_next = server->cache_lru_first;
+    if (server->cache_lru_first != NULL)
     {
-        coap_mem_large_free(trans->body);
-        trans->body = NULL;
+        server->cache_lru_first->lru_prev = entry;
     }
-    trans->body_len = 0;
-    trans->body_end = 0;
-    trans->block1_size = 0;
-    trans->block2_size = 0;
-    trans->block1_next = 0;
-    trans->block2_next = 0;
-    memset(trans->block_uri, 0, sizeof(trans->block_uri));
-    trans->block_detail = 0;
-    trans->block_rx = NULL;
+    else
+    {
+        server->cache_lru_last = entry;
+    }
+    server->cache_lru_first = entry;
 }
 
 /**
- *  @brief Deinitialise a transaction structure
+ *  @brief Remove a response cache entry from the hash table and the LRU list and free its buffers
  *
- *  @param[in,out] trans Pointer to a transaction structure
+ *  The entry is returned to the free list.
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in,out] entry Pointer to a response cache entry structure
  */
-static void coap_server_trans_destroy(coap_server_trans_t *trans)
-{
-    coap_log_debug("Destroyed transaction for address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
-    coap_server_trans_clear_blockwise(trans);
-#ifdef COAP_DTLS_EN
-    coap_server_trans_dtls_destroy(trans);
-#endif
-    coap_msg_destroy(&trans->resp);
-    coap_msg_destroy(&trans->req);
-    close(trans->timer_fd);
-    memset(trans, 0, sizeof(coap_server_trans_t));
-}
-
-/**
- *  @brief Mark the last time the transaction structure was used
- *
- *  @param[out] trans Pointer to a transaction structure
- */
-static void coap_server_trans_touch(coap_server_trans_t *trans)
+static void coap_server_cache_remove(coap_server_t *server, coap_server_cache_entry_t *entry)
 {
-    trans->last_use = time(NULL);
-}
+    coap_server_cache_entry_t **prev = NULL;
 
-/**
- *  @brief Compare a received message with the request part of a transaction structure
- *
- *  @param[in] trans Pointer to a trasaction structure
- *  @param[in] msg Pointer to a message structure
- *
- *  @returns Comparison value
- *  @retval 0 The message does not match the transaction
- *  @retval 1 The message matches the transaction
- */
-static int coap_server_trans_match_req(coap_server_trans_t *trans, coap_msg_t *msg)
-{
-    return ((coap_msg_get_ver(&trans->req) != 0)
-         && (coap_msg_get_msg_id(&trans->req) == coap_msg_get_msg_id(msg)));
+    prev = &server->cache_hash[entry->hash & server->cache_hash_mask];
+    while (*prev != NULL)
+    {
+        if (*prev == entry)
+        {
+            *prev = entry->hash_next;
+            break;
+        }
+        prev = &(*prev)->hash_next;
+    }
+    if (entry->lru_prev != NULL)
+        entry->lru_prev->lru_next = entry->lru_next;
+    else
+        server->cache_lru_first = entry->lru_next;
+    if (entry->lru_next != NULL)
+        entry->lru_next->lru_prev = entry->lru_prev;
+    else
+        server->cache_lru_last = entry->lru_prev;
+    free(entry->valid);
+    free(entry->resp);
+    memset(entry, 0, sizeof(coap_server_cache_entry_t));
+    entry->hash_next = server->cache_free;
+    server->cache_free = entry;
 }
 
 /**
- *  @brief Compare a recevied message with the response part of a transaction structure
+ *  @brief Search the response cache for a fresh response to a request
  *
- *  @param[in] trans Pointer to a trasaction structure
- *  @param[in] msg Pointer to a message structure
+ *  A matching entry that is no longer fresh, or that was
+ *  stored before an unsafe request for its URI path was
+ *  handled by another worker, is removed.
+ *  A matching entry that is fresh is moved to the front
+ *  of the LRU list.
  *
- *  @returns Comparison value
- *  @retval 0 The message does not match the transaction
- *  @retval 1 The message matches the transaction
- */
-static int coap_server_trans_match_resp(coap_server_trans_t *trans, coap_msg_t *msg)
-{
-    return ((coap_msg_get_ver(&trans->resp) != 0)
-         && (coap_msg_get_msg_id(&trans->resp) == coap_msg_get_msg_id(msg)));
-}
-
-/**
- *  @brief Clear the request message in a transaction structure
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in] key Buffer containing the key of the request
+ *  @param[in] key_len Length of the key
  *
- *  @param[in,out] trans Pointer to a transaction structure
+ *  @returns Pointer to a response cache entry structure
+ *  @retval NULL Not found
  */
-static void coap_server_trans_clear_req(coap_server_trans_t *trans)
+static coap_server_cache_entry_t *coap_server_cache_find(coap_server_t *server, const char *key, size_t key_len)
 {
-    coap_msg_destroy(&trans->req);
-}
+    coap_server_cache_entry_t *entry = NULL;
+    struct timespec now = {0};
+    unsigned hash = 0;
 
-/**
- *  @brief Clear the response message in a transaction structure
- *
- *  @param[in,out] trans Pointer to a transaction structure
- */
-static void coap_server_trans_clear_resp(coap_server_trans_t *trans)
-{
-    coap_msg_destroy(&trans->resp);
+    hash = coap_server_cache_hash(key, key_len);
+    for (entry = server->cache_hash[hash & server->cache_hash_mask]; entry != NULL; entry = entry->hash_next)
+    {
+        if ((entry->hash == hash)
+         && (entry->key_len == key_len)
+         && (memcmp(entry->key, key, key_len) == 0))
+        {
+            break;
+        }
+    }
+    if (entry == NULL)
+    {
+        return NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if ((now.tv_sec > entry->expiry.tv_sec)
+     || ((now.tv_sec == entry->expiry.tv_sec) && (now.tv_nsec >= entry->expiry.tv_nsec)))
+    {
+        coap_server_cache_remove(server, entry);
+        return NULL;
+    }
+#ifdef COAP_SERVER_THREAD_EN
+    if (entry->gen != __atomic_load_n(coap_server_cache_gen(server, entry->key, entry->path_len), __ATOMIC_ACQUIRE))
+    {
+        coap_server_cache_remove(server, entry);
+        return NULL;
+    }
+#endif
+    if (server->cache_lru_first != entry)
+    {
+        entry->lru_prev->lru_next = entry->lru_next;
+        if (entry->lru_next != NULL)
+            entry->lru_next->lru_prev = entry->lru_prev;
+        else
+            server->cache_lru_last = entry->lru_prev;
+        entry->lru_prev = NULL;
+        entry->lru_next = server->cache_lru_first;
+        server->cache_lru_first->lru_prev = entry;
+        server->cache_lru_first = entry;
+    }
+    return entry;
 }
 
 /**
- *  @brief Set the request message in a transaction structure
+ *  @brief Allocate a buffer and format a message into it
  *
- *  @param[in,out] trans Pointer to a transaction structure
  *  @param[in] msg Pointer to a message structure
+ *  @param[out] buf Pointer to the allocated buffer
+ *  @param[out] len Length of the formatted message
  *
  *  @returns Operation status
  *  @retval 0 Success
  *  @retval <0 Error
  */
-static int coap_server_trans_set_req(coap_server_trans_t *trans, coap_msg_t *msg)
+static int coap_server_cache_format(coap_msg_t *msg, char **buf, size_t *len)
 {
-    coap_msg_reset(&trans->req);
-    return coap_msg_copy(&trans->req, msg);
+    ssize_t num = 0;
+    char tmp[COAP_MSG_MAX_BUF_LEN] = {0};
+
+    num = coap_msg_format(msg, tmp, sizeof(tmp));
+    if (num < 0)
+    {
+        return num;
+    }
+    *buf = (char *)malloc(num);
+    if (*buf == NULL)
+    {
+        return -ENOMEM;
+    }
+    memcpy(*buf, tmp, num);
+    *len = num;
+    return 0;
 }
 
 /**
- *  @brief Set the response message in a transaction structure
+ *  @brief Find the Max-Age option in a formatted message
  *
- *  @param[in,out] trans Pointer to a transaction structure
- *  @param[in] msg Pointer to a message structure
+ *  @param[in] buf Buffer containing the formatted message
+ *  @param[in] len Length of the formatted message
+ *  @param[out] off Offset of the header of the Max-Age option
  *
  *  @returns Operation status
  *  @retval 0 Success
- *  @retval <0 Error
+ *  @retval -ENOENT The message has no Max-Age option
  */
-static int coap_server_trans_set_resp(coap_server_trans_t *trans, coap_msg_t *msg)
+static int coap_server_cache_find_max_age(const char *buf, size_t len, size_t *off)
 {
-    coap_msg_reset(&trans->resp);
-    return coap_msg_copy(&trans->resp, msg);
+    const unsigned char *p = (const unsigned char *)buf;
+    unsigned delta = 0;
+    unsigned num = 0;
+    size_t op_len = 0;
+    size_t start = 0;
+    size_t i = 0;
+
+    i = 4 + (p[0] & 0x0f);
+    while ((i < len) && (p[i] != 0xff))
+    {
+        start = i;
+        delta = p[i] >> 4;
+        op_len = p[i] & 0x0f;
+        i++;
+        if ((delta == 13) && (i + 1 <= len))
+        {
+            delta = p[i] + 13;
+            i++;
+        }
+        else if ((delta == 14) && (i + 2 <= len))
+        {
+            delta = ((p[i] << 8) | p[i + 1]) + 269;
+            i += 2;
+        }
+        if ((op_len == 13) && (i + 1 <= len))
+        {
+            op_len = p[i] + 13;
+            i++;
+        }
+        else if ((op_len == 14) && (i + 2 <= len))
+        {
+            op_len = ((p[i] << 8) | p[i + 1]) + 269;
+            i += 2;
+        }
+        num += delta;
+        if (num == COAP_MSG_MAX_AGE)
+        {
+            *off = start;
+            return 0;
+        }
+        i += op_len;
+    }
+    return -ENOENT;
 }
 
 /**
- *  @brief Initialise the acknowledgement timer in a transaction structure
+ *  @brief Format a stored response with the remaining lifetime as its Max-Age option
  *
- *  The timer is initialised to a random duration between:
+ *  The type, message ID and token are inserted as by
+ *  coap_server_format_tmpl and the value of the Max-Age
+ *  option is replaced so that downstream caches do not
+ *  consider the response fresh for longer than the entry.
  *
- *  ACK_TIMEOUT and (ACK_TIMEOUT * ACK_RANDOM_FACTOR)
- *  where:
- *  ACK_TIMEOUT = 2
- *  ACK_RANDOM_FACTOR = 1.5
+ *  @param[in] tmpl Buffer containing the response formatted without a token
+ *  @param[in] tmpl_len Length of the formatted response
+ *  @param[in] max_age_off Offset of the header of the Max-Age option in the formatted response
+ *  @param[in] max_age Max-Age option value
+ *  @param[in] type Message type
+ *  @param[in] msg_id Message ID
+ *  @param[in] token Buffer containing the token
+ *  @param[in] token_len Length of the token
+ *  @param[out] buf Pointer to a buffer to contain the message
+ *  @param[in] len Length of the buffer
  *
- *  @param[out] trans Pointer to a transaction structure
+ *  @returns Length of the message or error code
+ *  @retval >0 Length of the message
+ *  @retval <0 Error
  */
-static void coap_server_trans_init_ack_timeout(coap_server_trans_t *trans)
+static ssize_t coap_server_cache_format_resp(const char *tmpl, size_t tmpl_len,
+                                             size_t max_age_off, unsigned max_age,
+                                             unsigned type, unsigned msg_id,
+                                             const char *token, unsigned token_len,
+                                             char *buf, size_t len)
 {
-    if (!rand_init)
+    unsigned char hdr = 0;
+    size_t old_len = 0;
+    size_t val_off = 0;
+    ssize_t num = 0;
+    char val[sizeof(unsigned)] = {0};
+    int new_len = 0;
+
+    num = coap_server_format_tmpl(tmpl, tmpl_len, type, msg_id, token, token_len, buf, len);
+    if (num < 0)
     {
-        srand(time(NULL));
-        rand_init = 1;
+        return num;
     }
-    trans->timeout.tv_sec = COAP_SERVER_ACK_TIMEOUT_SEC;
-    trans->timeout.tv_nsec = (rand() % 1000) * 1000000;
-    coap_log_debug("Acknowledgement timeout initialised to: %lu sec, %lu nsec", trans->timeout.tv_sec, trans->timeout.tv_nsec);
+    new_len = coap_msg_op_format_uint_val(val, sizeof(val), max_age);
+    if (new_len < 0)
+    {
+        return new_len;
+    }
+    /* the stored option has a short length so only the delta may be extended */
+    hdr = (unsigned char)buf[max_age_off + token_len];
+    old_len = hdr & 0x0f;
+    val_off = max_age_off + token_len + 1;
+    if ((hdr >> 4) == 13)
+        val_off += 1;
+    else if ((hdr >> 4) == 14)
+        val_off += 2;
+    if (num - old_len + new_len > len)
+    {
+        return -ENOSPC;
+    }
+    memmove(buf + val_off + new_len, buf + val_off + old_len, num - val_off - old_len);
+    memcpy(buf + val_off, val, new_len);
+    buf[max_age_off + token_len] = (hdr & 0xf0) | new_len;
+    return num - old_len + new_len;
 }
 
 /**
- *  @brief Double the value of the timer in a transaction structure
+ *  @brief Store a response in the response cache
  *
- *  @param[in,out] trans Pointer to a trans structure
- */
-static void coap_server_trans_double_timeout(coap_server_trans_t *trans)
-{
-    unsigned msec = 2 * ((trans->timeout.tv_sec * 1000)
-                      + (trans->timeout.tv_nsec / 1000000));
-    trans->timeout.tv_sec = msec / 1000;
-    trans->timeout.tv_nsec = (msec % 1000) * 1000000;
-    coap_log_debug("Timeout doubled to: %lu sec, %lu nsec", trans->timeout.tv_sec, trans->timeout.tv_nsec);
-}
-
-/**
- *  @brief Start the timer in a transaction structure
+ *  The response must not yet contain a token. Responses
+ *  without a non-zero Max-Age option are not stored. If
+ *  the response contains an ETag option then a 2.03 (Valid)
+ *  response is formatted and stored with it. The least
+ *  recently used entry is replaced if the cache is full.
  *
- *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in] key Buffer containing the key of the request
+ *  @param[in] key_len Length of the key
+ *  @param[in] path_len Length of the part of the key that contains the method and URI-Path options
+ *  @param[in] gen Generation counter value of the URI path read before the response was generated
+ *  @param[in] resp Pointer to the response message
  *
  *  @returns Operation status
  *  @retval 0 Success
  *  @retval <0 Error
  */
-static int coap_server_trans_start_timer(coap_server_trans_t *trans)
+static int coap_server_cache_add(coap_server_t *server, const char *key, size_t key_len, size_t path_len, unsigned gen, coap_msg_t *resp)
 {
-    struct itimerspec its = {{0}};
+    coap_server_cache_entry_t *entry = NULL;
+    coap_msg_op_t *max_age_op = NULL;
+    coap_msg_op_t *etag_op = NULL;
+    coap_msg_op_t *op = NULL;
+    coap_msg_t valid = {0};
+    unsigned max_age = 0;
     int ret = 0;
 
-    its.it_value = trans->timeout;
-    ret = timerfd_settime(trans->timer_fd, 0, &its, NULL);
+    for (op = coap_msg_get_first_op(resp); op != NULL; op = coap_msg_op_get_next(op))
+    {
+        if ((coap_msg_op_get_num(op) == COAP_MSG_ETAG) && (etag_op == NULL))
+        {
+            etag_op = op;
+        }
+        else if (coap_msg_op_get_num(op) == COAP_MSG_MAX_AGE)
+        {
+            max_age_op = op;
+        }
+    }
+    if (max_age_op == NULL)
+    {
+        return 0;
+    }
+    ret = coap_msg_op_parse_uint_val(&max_age, coap_msg_op_get_val(max_age_op), coap_msg_op_get_len(max_age_op));
+    if ((ret < 0) || (max_age == 0))
+    {
+        return ret;
+    }
+    if ((etag_op != NULL) && (coap_msg_op_get_len(etag_op) > COAP_SERVER_CACHE_ETAG_LEN))
+    {
+        return -EINVAL;
+    }
+
+    /* take an entry, replacing the previous response to the same request */
+    /* or the least recently used entry */
+    entry = coap_server_cache_find(server, key, key_len);
+    if (entry != NULL)
+    {
+        coap_server_cache_remove(server, entry);
+    }
+    if (server->cache_free == NULL)
+    {
+        coap_server_cache_remove(server, server->cache_lru_last);
+    }
+    entry = server->cache_free;
+    server->cache_free = entry->hash_next;
+    entry->hash_next = NULL;
+
+    ret = coap_server_cache_format(resp, &entry->resp, &entry->resp_len);
+    if (ret == 0)
+    {
+        ret = coap_server_cache_find_max_age(entry->resp, entry->resp_len, &entry->resp_max_age_off);
+    }
+    if ((ret == 0) && (etag_op != NULL))
+    {
+        coap_msg_create(&valid);
+        ret = coap_msg_set_code(&valid, COAP_MSG_SUCCESS, COAP_MSG_VALID);
+        if (ret == 0)
+        {
+            ret = coap_msg_add_op(&valid, COAP_MSG_ETAG, coap_msg_op_get_len(etag_op), coap_msg_op_get_val(etag_op));
+        }
+        if (ret == 0)
+        {
+            ret = coap_msg_add_op(&valid, COAP_MSG_MAX_AGE, coap_msg_op_get_len(max_age_op), coap_msg_op_get_val(max_age_op));
+        }
+        if (ret == 0)
+        {
+            ret = coap_server_cache_format(&valid, &entry->valid, &entry->valid_len);
+        }
+        if (ret == 0)
+        {
+            ret = coap_server_cache_find_max_age(entry->valid, entry->valid_len, &entry->valid_max_age_off);
+        }
+        coap_msg_destroy(&valid);
+        if (ret == 0)
+        {
+            memcpy(entry->etag, coap_msg_op_get_val(etag_op), coap_msg_op_get_len(etag_op));
+            entry->etag_len = coap_msg_op_get_len(etag_op);
+        }
+    }
     if (ret < 0)
     {
-        return -errno;
+        free(entry->valid);
+        free(entry->resp);
+        memset(entry, 0, sizeof(coap_server_cache_entry_t));
+        entry->hash_next = server->cache_free;
+        server->cache_free = entry;
+        return ret;
     }
+    memcpy(entry->key, key, key_len);
+    entry->key_len = key_len;
+    entry->path_len = path_len;
+    entry->hash = coap_server_cache_hash(key, key_len);
+    entry->gen = gen;
+    clock_gettime(CLOCK_MONOTONIC, &entry->expiry);
+    entry->expiry.tv_sec += max_age;
+    coap_server_cache_link(server, entry);
     return 0;
 }
 
 /**
- *  @brief Stop the timer in a transaction structure
- *
- *  @param[out] trans Pointer to a transaction structure
+ *  @brief Remove the stored responses for the URI path of a request
  *
- *  @returns Operation status
- *  @retval 0 Success
- *  @retval <0 Error
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in] msg Pointer to the request message
  */
-static int coap_server_trans_stop_timer(coap_server_trans_t *trans)
+static void coap_server_cache_invalidate(coap_server_t *server, coap_msg_t *msg)
 {
-    struct itimerspec its = {{0}};
-    int ret = 0;
+    coap_server_cache_entry_t *entry = NULL;
+    coap_server_cache_entry_t *next = NULL;
+    coap_msg_op_t *op = NULL;
+    size_t path_len = 1;
+    char path[COAP_SERVER_CACHE_KEY_LEN] = {0};
 
-    ret = timerfd_settime(trans->timer_fd, 0, &its, NULL);
-    if (ret < 0)
+    path[0] = COAP_MSG_GET;
+    for (op = coap_msg_get_first_op(msg); op != NULL; op = coap_msg_op_get_next(op))
     {
-        return -errno;
+        if ((coap_msg_op_get_num(op) == COAP_MSG_URI_PATH)
+         && (coap_server_cache_key_add_op(path, &path_len, op) < 0))
+        {
+            /* too long to have been stored */
+            return;
+        }
+    }
+#ifdef COAP_SERVER_THREAD_EN
+    /* make the other workers discard their responses */
+    __atomic_add_fetch(coap_server_cache_gen(server, path, path_len), 1, __ATOMIC_RELEASE);
+#endif
+    entry = server->cache_lru_first;
+    while (entry != NULL)
+    {
+        next = entry->lru_next;
+        if ((entry->path_len == path_len)
+         && (memcmp(entry->key, path, path_len) == 0))
+        {
+            coap_server_cache_remove(server, entry);
+        }
+        entry = next;
     }
-    return 0;
 }
 
 /**
- *  @brief Initialise and start the acknowledgement timer in a transaction structure
+ *  @brief Compare the ETag options of a request with the ETag of a stored response
  *
- *  @param[out] trans Pointer to a trans structure
+ *  @param[in] entry Pointer to a response cache entry structure
+ *  @param[in] msg Pointer to the request message
  *
- *  @returns Operation status
- *  @retval 0 Success
- *  @retval <0 Error
+ *  @returns Comparison value
+ *  @retval 0 No ETag option of the request matches
+ *  @retval 1 An ETag option of the request matches
  */
-static int coap_server_trans_start_ack_timer(coap_server_trans_t *trans)
+static int coap_server_cache_match_etag(coap_server_cache_entry_t *entry, coap_msg_t *msg)
 {
-    trans->num_retrans = 0;
-    coap_server_trans_init_ack_timeout(trans);
-    return coap_server_trans_start_timer(trans);
+    coap_msg_op_t *op = NULL;
+
+    if (entry->valid == NULL)
+    {
+        return 0;
+    }
+    for (op = coap_msg_get_first_op(msg); op != NULL; op = coap_msg_op_get_next(op))
+    {
+        if ((coap_msg_op_get_num(op) == COAP_MSG_ETAG)
+         && (coap_msg_op_get_len(op) == entry->etag_len)
+         && (memcmp(coap_msg_op_get_val(op), entry->etag, entry->etag_len) == 0))
+        {
+            return 1;
+        }
+    }
+    return 0;
 }
 
 /**
- *  @brief Stop the acknowledgement timer in a transaction structure
- *
- *  @param[out] trans Pointer to a transaction structure
+ *  @brief Free the response cache in a server structure
  *
- *  @returns Operation status
- *  @retval 0 Success
- *  @retval <0 Error
+ *  @param[in,out] server Pointer to a server structure
  */
-static int coap_server_trans_stop_ack_timer(coap_server_trans_t *trans)
+static void coap_server_cache_destroy(coap_server_t *server)
 {
-    trans->num_retrans = 0;
-    return coap_server_trans_stop_timer(trans);
+    if (server->cache == NULL)
+    {
+        return;
+    }
+    while (server->cache_lru_first != NULL)
+    {
+        coap_server_cache_remove(server, server->cache_lru_first);
+    }
+    free(server->cache_hash);
+    free(server->cache);
+    server->cache = NULL;
+    server->cache_num = 0;
+    server->cache_hash = NULL;
+    server->cache_hash_mask = 0;
+    server->cache_free = NULL;
 }
 
+/****************************************************************************************************
+ *                                        coap_server_dedup                                         *
+ ****************************************************************************************************/
+
 /**
- *  @brief Update the acknowledgement timer in a transaction structure
- *
- *  Increase and restart the acknowledgement timer in a transaction structure
- *  and indicate if the maximum number of retransmits has been reached.
+ *  @brief Compute the hash value of a client endpoint and message ID
  *
- *  @param[in,out] trans Pointer to a trans structure
+ *  @param[in] sin Pointer to the socket structure of the client endpoint
+ *  @param[in] sin_len Length of the socket structure
+ *  @param[in] msg_id Message ID
  *
- *  @returns Operation status
- *  @retval 0 Success
- *  @retval <0 Error
+ *  @returns Hash value
  */
-static int coap_server_trans_update_ack_timer(coap_server_trans_t *trans)
+static unsigned coap_server_dedup_hash(const coap_ipv_sockaddr_in_t *sin, socklen_t sin_len, unsigned msg_id)
 {
-    int ret = 0;
+    const unsigned char *p = (const unsigned char *)sin;
+    uint32_t hash = 2166136261u;
+    socklen_t i = 0;
 
-    if (trans->num_retrans >= COAP_SERVER_MAX_RETRANSMIT)
-    {
-        return -ETIMEDOUT;
-    }
-    coap_server_trans_double_timeout(trans);
-    ret = coap_server_trans_start_timer(trans);
-    if (ret < 0)
+    /* FNV-1a */
+    for (i = 0; i < sin_len; i++)
     {
-        return ret;
+        hash ^= p[i];
+        hash *= 16777619u;
     }
-    trans->num_retrans++;
-    return 0;
+    hash ^= (msg_id >> 8) & 0xff;
+    hash *= 16777619u;
+    hash ^= msg_id & 0xff;
+    hash *= 16777619u;
+    return hash;
 }
 
 /**
- *  @brief Send a message to the client
+ *  @brief Get the current time for message ID deduplication
  *
- *  @param[in,out] trans Pointer to a transaction structure
- *  @param[in] msg Pointer to a message structure
+ *  @returns Number of seconds on the monotonic clock
+ */
+static time_t coap_server_dedup_now(void)
+{
+    struct timespec now = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+/**
+ *  @brief Remove the oldest message ID deduplication entry
  *
- *  @returns Number of bytes sent or error code
- *  @retval >0 Number of bytes sent
- *  @retval <0 Error
+ *  @param[in,out] server Pointer to a server structure
  */
-static ssize_t coap_server_trans_send(coap_server_trans_t *trans, coap_msg_t *msg)
+static void coap_server_dedup_remove_first(coap_server_t *server)
 {
-#ifndef COAP_DTLS_EN
-    coap_server_t *server = NULL;
-#endif
-    ssize_t num = 0;
-    char buf[COAP_MSG_MAX_BUF_LEN] = {0};
+    coap_server_dedup_t *entry = &server->dedup[server->dedup_first];
+    coap_server_dedup_t **prev = NULL;
 
-    num = coap_msg_format(msg, buf, sizeof(buf));
-    if (num < 0)
-    {
-        return num;
-    }
-#ifdef COAP_DTLS_EN
-    errno = 0;
-    num = gnutls_record_send(trans->session, buf, num);
-    if (errno != 0)
-    {
-        return -errno;
-    }
-    if (num == 0)
-    {
-        return -ECONNRESET;
-    }
-    if (num == GNUTLS_E_AGAIN)
-    {
-        return -EAGAIN;
-    }
-    if (num < 0)
+    prev = &server->dedup_hash[coap_server_dedup_hash(&entry->sin, entry->sin_len, entry->msg_id) & server->dedup_mask];
+    while (*prev != NULL)
     {
-        coap_log_error("Failed to send to client: %s", gnutls_strerror_name(num));
-        return -1;
+        if (*prev == entry)
+        {
+            *prev = entry->hash_next;
+            break;
+        }
+        prev = &(*prev)->hash_next;
     }
-#else
-    server = trans->server;
-    num = sendto(server->sd, buf, num, 0, (struct sockaddr *)&trans->client_sin, trans->client_sin_len);
-    if (num < 0)
+    free(entry->resp);
+    memset(entry, 0, sizeof(coap_server_dedup_t));
+    server->dedup_first = (server->dedup_first + 1) & server->dedup_mask;
+    server->dedup_num--;
+}
+
+/**
+ *  @brief Remove the expired message ID deduplication entries
+ *
+ *  Entries expire in the order they were added so only
+ *  the front of the ring is examined.
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in] now Current time
+ */
+static void coap_server_dedup_expire(coap_server_t *server, time_t now)
+{
+    while ((server->dedup_num > 0)
+        && (server->dedup[server->dedup_first].expiry <= now))
     {
-        return -errno;
+        coap_server_dedup_remove_first(server);
     }
-#endif
-    coap_server_trans_touch(trans);
-    coap_log_debug("Sent to address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
-    return num;
 }
 
 /**
- *  @brief Handle a format error in a received message
+ *  @brief Search for the message ID deduplication entry of a request
  *
- *  Special handling for the case where a received
- *  message could not be parsed due to a format error.
- *  Extract enough information from the received message
- *  to form a reset message.
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in] sin Pointer to the socket structure of the client endpoint
+ *  @param[in] sin_len Length of the socket structure
+ *  @param[in] msg_id Message ID of the request
  *
- *  @param[in,out] trans Pointer to a transaction structure
- *  @param[in] buf Buffer containing the message
- *  @param[in] len length of the buffer
+ *  @returns Pointer to a message ID deduplication entry structure
+ *  @retval NULL Not found
  */
-static void coap_server_trans_handle_format_error(coap_server_trans_t *trans, char *buf, unsigned len)
+static coap_server_dedup_t *coap_server_dedup_find(coap_server_t *server, const coap_ipv_sockaddr_in_t *sin, socklen_t sin_len, unsigned msg_id)
 {
-    coap_msg_t msg = {0};
-    unsigned msg_id = 0;
-    unsigned type = 0;
-    int ret = 0;
+    coap_server_dedup_t *entry = NULL;
 
-    /* extract enough information to form a reset message */
-    ret = coap_msg_parse_type_msg_id(buf, len, &type, &msg_id);
-    if ((ret == 0) && (type == COAP_MSG_CON))
+    if (server->dedup_num == 0)
     {
-        coap_msg_create(&msg);
-        ret = coap_msg_set_type(&msg, COAP_MSG_RST);
-        if (ret < 0)
-        {
-            coap_msg_destroy(&msg);
-            return;
-        }
-        ret = coap_msg_set_msg_id(&msg, msg_id);
-        if (ret < 0)
+        return NULL;
+    }
+    coap_server_dedup_expire(server, coap_server_dedup_now());
+    entry = server->dedup_hash[coap_server_dedup_hash(sin, sin_len, msg_id) & server->dedup_mask];
+    while (entry != NULL)
+    {
+        if ((entry->msg_id == msg_id)
+         && (entry->sin_len == sin_len)
+         && (memcmp(&entry->sin, sin, sin_len) == 0))
         {
-            coap_msg_destroy(&msg);
-            return;
+            return entry;
         }
-        coap_server_trans_send(trans, &msg);
-        coap_msg_destroy(&msg);
+        entry = entry->hash_next;
     }
+    return NULL;
 }
 
 /**
- *  @brief Receive a message from the client
+ *  @brief Check whether the message ID deduplication table is full
  *
- *  @param[in,out] trans Pointer to a transaction structure
- *  @param[in] msg Pointer to a message structure
+ *  Expired entries are removed first.
  *
- *  @returns Number of bytes received or error code
- *  @retval >0 Number of bytes received
+ *  @param[in,out] server Pointer to a server structure
+ *
+ *  @returns Comparison value
+ *  @retval 0 An entry can be added
+ *  @retval 1 Every entry is in use and has not expired
+ */
+static int coap_server_dedup_full(coap_server_t *server)
+{
+    coap_server_dedup_expire(server, coap_server_dedup_now());
+    return server->dedup_num > server->dedup_mask;
+}
+
+/**
+ *  @brief Add a message ID deduplication entry for a request
+ *
+ *  Entries that have not expired are never replaced, so
+ *  the request is not recorded if the ring is full.
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in] sin Pointer to the socket structure of the client endpoint
+ *  @param[in] sin_len Length of the socket structure
+ *  @param[in] msg_id Message ID of the request
+ *  @param[in] type Type of the request
+ *  @param[in] resp Buffer containing the formatted piggy-backed response or NULL
+ *  @param[in] resp_len Length of the formatted piggy-backed response
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval -ENOSPC The ring is full
  *  @retval <0 Error
  */
-static ssize_t coap_server_trans_recv(coap_server_trans_t *trans, coap_msg_t *msg)
+static int coap_server_dedup_add(coap_server_t *server, const coap_ipv_sockaddr_in_t *sin, socklen_t sin_len,
+                                 unsigned msg_id, unsigned type, const char *resp, size_t resp_len)
 {
-#ifdef COAP_DTLS_EN
-    gnutls_alert_description_t alert = 0;
-    const char *alert_name = NULL;
-#else
-    coap_ipv_sockaddr_in_t client_sin = {0};
-    coap_server_t *server = NULL;
-    socklen_t client_sin_len = 0;
-#endif
-    ssize_t num = 0;
-    ssize_t ret = 0;
-    char buf[COAP_MSG_MAX_BUF_LEN] = {0};
+    coap_server_dedup_t **bucket = NULL;
+    coap_server_dedup_t *entry = NULL;
+    time_t now = 0;
 
-#ifdef COAP_DTLS_EN
-    errno = 0;
-    num = gnutls_record_recv(trans->session, buf, sizeof(buf));
-    if (errno != 0)
-    {
-        return -errno;
-    }
-    if ((num == GNUTLS_E_FATAL_ALERT_RECEIVED)
-     || (num == GNUTLS_E_WARNING_ALERT_RECEIVED)
-     || (num == 0))
-    {
-        alert = gnutls_alert_get(trans->session);
-        alert_name = gnutls_alert_get_name(alert);
-        if (num == GNUTLS_E_FATAL_ALERT_RECEIVED)
-            coap_log_error("Received DTLS alert from the client: %s", alert_name);
-        else if (num == GNUTLS_E_WARNING_ALERT_RECEIVED)
-            coap_log_warn("Received DTLS alert from the client: %s", alert_name);
-        else
-            coap_log_info("Received DTLS alert from the client: %s", alert_name);
-        return -ECONNRESET;
-    }
-    if (num == GNUTLS_E_AGAIN)
-    {
-        return -EAGAIN;
-    }
-    if (num < 0)
-    {
-        coap_log_error("Failed to receive from client: %s", gnutls_strerror_name(num));
-        return -1;
-    }
-#else
-    server = trans->server;
-    client_sin_len = sizeof(client_sin);
-    num = recvfrom(server->sd, buf, sizeof(buf), MSG_PEEK, (struct sockaddr *)&client_sin, &client_sin_len);
-    if (num < 0)
-    {
-        return -errno;
-    }
-    if ((client_sin_len != trans->client_sin_len)
-     || (memcmp(&client_sin, &trans->client_sin, client_sin_len) != 0))
-    {
-        return -EINVAL;
-    }
-    num = recvfrom(server->sd, buf, num, 0, (struct sockaddr *)&client_sin, &client_sin_len);
-    if (num < 0)
+    now = coap_server_dedup_now();
+    coap_server_dedup_expire(server, now);
+    if (server->dedup_num > server->dedup_mask)
     {
-        return -errno;
+        return -ENOSPC;
     }
-#endif
-    ret = coap_msg_parse(msg, buf, num);
-    if (ret < 0)
+    entry = &server->dedup[(server->dedup_first + server->dedup_num) & server->dedup_mask];
+    if (resp != NULL)
     {
-        if (ret == -EBADMSG)
+        entry->resp = (char *)malloc(resp_len);
+        if (entry->resp == NULL)
         {
-            coap_server_trans_handle_format_error(trans, buf, num);
+            return -ENOMEM;
         }
-        return ret;
-    }
-    coap_server_trans_touch(trans);
-    coap_log_debug("Received from address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
-    return num;
+        memcpy(entry->resp, resp, resp_len);
+        entry->resp_len = resp_len;
+    }
+    memcpy(&entry->sin, sin, sin_len);
+    entry->sin_len = sin_len;
+    entry->msg_id = msg_id;
+    entry->type = type;
+    entry->expiry = now + COAP_SERVER_EXCHANGE_LIFETIME_SEC;
+    bucket = &server->dedup_hash[coap_server_dedup_hash(sin, sin_len, msg_id) & server->dedup_mask];
+    entry->hash_next = *bucket;
+    *bucket = entry;
+    server->dedup_num++;
+    return 0;
 }
 
 /**
- *  @brief Reject a received confirmable message
+ *  @brief Allocate the message ID deduplication table in a server structure
  *
- *  Send a reset message to the client.
+ *  The ring holds COAP_SERVER_DEDUP_PER_TRANS entries for
+ *  each transaction structure, rounded up to a power of 2.
  *
- *  @param[in,out] trans Pointer to a transaction structure
- *  @param[in] msg Pointer to a message structure
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in] num_trans Number of transaction structures or 0 for COAP_SERVER_NUM_TRANS
  *
  *  @returns Operation status
  *  @retval 0 Success
  *  @retval <0 Error
  */
-static int coap_server_trans_reject_con(coap_server_trans_t *trans, coap_msg_t *msg)
+static int coap_server_dedup_create(coap_server_t *server, unsigned num_trans)
 {
-    coap_msg_t rej = {0};
-    ssize_t num = 0;
-    int ret = 0;
+    unsigned num = 1;
 
-    coap_log_info("Rejecting confirmable message from address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
-    coap_msg_create(&rej);
-    ret = coap_msg_set_type(&rej, COAP_MSG_RST);
-    if (ret < 0)
+    if (num_trans == 0)
     {
-        coap_msg_destroy(&rej);
-        return ret;
+        num_trans = COAP_SERVER_NUM_TRANS;
     }
-    ret = coap_msg_set_msg_id(&rej, coap_msg_get_msg_id(msg));
-    if (ret < 0)
+    while (num < num_trans * COAP_SERVER_DEDUP_PER_TRANS)
     {
-        coap_msg_destroy(&rej);
-        return ret;
+        num <<= 1;
     }
-    num = coap_server_trans_send(trans, &rej);
-    coap_msg_destroy(&rej);
-    if (num < 0)
+    server->dedup = (coap_server_dedup_t *)calloc(num, sizeof(coap_server_dedup_t));
+    if (server->dedup == NULL)
     {
-        return num;
+        return -ENOMEM;
+    }
+    server->dedup_hash = (coap_server_dedup_t **)calloc(num, sizeof(coap_server_dedup_t *));
+    if (server->dedup_hash == NULL)
+    {
+        free(server->dedup);
+        server->dedup = NULL;
+        return -ENOMEM;
     }
+    server->dedup_mask = num - 1;
+    server->dedup_first = 0;
+    server->dedup_num = 0;
     return 0;
 }
 
 /**
- *  @brief Reject a received non-confirmable message
- *
- *  @param[in] trans Pointer to a transaction structure
- *  @param[in] msg Pointer to a message structure
+ *  @brief Free the message ID deduplication table in a server structure
  *
- *  @returns Operation status
- *  @retval 0 Success
+ *  @param[in,out] server Pointer to a server structure
  */
-static int coap_server_trans_reject_non(coap_server_trans_t *trans, coap_msg_t *msg)
+static void coap_server_dedup_destroy(coap_server_t *server)
 {
-    coap_log_info("Rejecting non-confirmable message from address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
-    return 0;
+    while (server->dedup_num > 0)
+    {
+        coap_server_dedup_remove_first(server);
+    }
+    free(server->dedup_hash);
+    free(server->dedup);
+    server->dedup_hash = NULL;
+    server->dedup = NULL;
+    server->dedup_mask = 0;
 }
 
+#ifdef COAP_SERVER_STATS_EN
+
+/****************************************************************************************************
+ *                                        coap_server_stats                                         *
+ ****************************************************************************************************/
+
+#define COAP_SERVER_HIST_SUB_NUM     (1 << COAP_SERVER_HIST_SUB_BITS)                  /**< Number of buckets for each power of 2 in a latency histogram */
+#define COAP_SERVER_HIST_SUB_MASK    (COAP_SERVER_HIST_SUB_NUM - 1)                    /**< Mask to select the bucket within a power of 2 */
+
+#define coap_server_stats_inc(server, field)   coap_server_stats_add(&(server)->stats.field, 1)                    /**< Increment a counter in the statistics of a server structure */
+#define coap_server_stats_dec(server, field)   coap_server_stats_add(&(server)->stats.field, (uint64_t)-1)         /**< Decrement a counter in the statistics of a server structure */
+#define coap_server_stats_begin(server)        clock_gettime(CLOCK_MONOTONIC, &(server)->stats_stage_start)        /**< Start timing a processing stage */
+#define coap_server_stats_end(server, stage)   coap_server_stats_end_stage(server, stage)                          /**< Stop timing a processing stage and start timing the next one */
+
+static const char *coap_server_stage_name[COAP_SERVER_NUM_STAGES] = {"recv", "parse", "handler", "format", "send", "flush"};
+
 /**
- *  @brief Reject a received acknowledgement message
+ *  @brief Add to a statistics counter
  *
- *  @param[in] trans Pointer to a transaction structure
- *  @param[in] msg Pointer to a message structure
+ *  Counters are only written by the thread running the
+ *  server structure so a relaxed load and store suffice
+ *  and other threads never see a torn value.
  *
- *  @returns Operation status
- *  @retval 0 Success
+ *  @param[in,out] val Pointer to the counter
+ *  @param[in] n Value to add
  */
-static int coap_server_trans_reject_ack(coap_server_trans_t *trans, coap_msg_t *msg)
+static void coap_server_stats_add(uint64_t *val, uint64_t n)
 {
-    coap_log_info("Rejecting acknowledgement message from address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
-    return 0;
+    __atomic_store_n(val, __atomic_load_n(val, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
 }
 
 /**
- *  @brief Reject a received reset message
+ *  @brief Get the index of the latency histogram bucket that counts a value
  *
- *  @param[in] trans Pointer to a transaction structure
- *  @param[in] msg Pointer to a message structure
+ *  @param[in] val Value
  *
- *  @returns Operation status
- *  @retval 0 Success
+ *  @returns Bucket index
  */
-static int coap_server_trans_reject_reset(coap_server_trans_t *trans, coap_msg_t *msg)
+static unsigned coap_server_hist_bucket(uint64_t val)
 {
-    coap_log_info("Rejecting reset message from address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
-    return 0;
+    unsigned msb = 0;
+
+    if (val < COAP_SERVER_HIST_SUB_NUM)
+    {
+        return val;
+    }
+    if ((val >> COAP_SERVER_HIST_MAX_BITS) != 0)
+    {
+        return COAP_SERVER_HIST_NUM_BUCKETS - 1;
+    }
+    msb = 63 - __builtin_clzll(val);
+    return ((msb - COAP_SERVER_HIST_SUB_BITS + 1) << COAP_SERVER_HIST_SUB_BITS)
+         + ((val >> (msb - COAP_SERVER_HIST_SUB_BITS)) & COAP_SERVER_HIST_SUB_MASK);
 }
 
 /**
- *  @brief Reject a received message
+ *  @brief Get the smallest value counted by a latency histogram bucket
  *
- *  @param[in,out] trans Pointer to a transaction structure
- *  @param[in] msg Pointer to a message structure
+ *  @param[in] i Bucket index
  *
- *  @returns Operation status
- *  @retval 0 Success
- *  @retval <0 Error
+ *  @returns Smallest value in the bucket
  */
-static int coap_server_trans_reject(coap_server_trans_t *trans, coap_msg_t *msg)
+static uint64_t coap_server_hist_bucket_low(unsigned i)
 {
-    if (coap_msg_get_type(msg) == COAP_MSG_CON)
+    if (i < COAP_SERVER_HIST_SUB_NUM)
     {
-        return coap_server_trans_reject_con(trans, msg);
+        return i;
     }
-    else if (coap_msg_get_type(msg) == COAP_MSG_NON)
+    return (uint64_t)(COAP_SERVER_HIST_SUB_NUM + (i & COAP_SERVER_HIST_SUB_MASK)) << ((i >> COAP_SERVER_HIST_SUB_BITS) - 1);
+}
+
+/**
+ *  @brief Add a value to a latency histogram
+ *
+ *  @param[in,out] hist Pointer to a latency histogram structure
+ *  @param[in] val Value
+ */
+static void coap_server_hist_add(coap_server_hist_t *hist, uint64_t val)
+{
+    coap_server_stats_add(&hist->count, 1);
+    coap_server_stats_add(&hist->sum, val);
+    coap_server_stats_add(&hist->bucket[coap_server_hist_bucket(val)], 1);
+    if (val > hist->max)
     {
-        return coap_server_trans_reject_non(trans, msg);
+        __atomic_store_n(&hist->max, val, __ATOMIC_RELAXED);
     }
-    else if (coap_msg_get_type(msg) == COAP_MSG_ACK)
+}
+
+/**
+ *  @brief Add the values in a latency histogram to another
+ *
+ *  @param[in,out] dst Pointer to the destination latency histogram structure
+ *  @param[in] src Pointer to the source latency histogram structure
+ */
+static void coap_server_hist_merge(coap_server_hist_t *dst, const coap_server_hist_t *src)
+{
+    uint64_t max = 0;
+    unsigned i = 0;
+
+    dst->count += __atomic_load_n(&src->count, __ATOMIC_RELAXED);
+    dst->sum += __atomic_load_n(&src->sum, __ATOMIC_RELAXED);
+    max = __atomic_load_n(&src->max, __ATOMIC_RELAXED);
+    if (max > dst->max)
     {
-        return coap_server_trans_reject_ack(trans, msg);
+        dst->max = max;
     }
-    else if (coap_msg_get_type(msg) == COAP_MSG_RST)
+    for (i = 0; i < COAP_SERVER_HIST_NUM_BUCKETS; i++)
     {
-        return coap_server_trans_reject_reset(trans, msg);
+        dst->bucket[i] += __atomic_load_n(&src->bucket[i], __ATOMIC_RELAXED);
     }
-    return 0;  /* should never arrive here */
 }
 
 /**
- *  @brief Handle a received message containing a bad option
- *
- *  @param[in,out] trans Pointer to a transaction structure
- *  @param[out] send_msg Pointer to the send message
- *  @param[in] op_num Option number of the bad option
+ *  @brief Add the statistics of a server structure to a statistics structure
  *
- *  @returns Operation status
- *  @retval 0 Success
- *  @retval <0 Error
+ *  @param[in,out] stats Pointer to a statistics structure
+ *  @param[in] server Pointer to a server structure
  */
-static int coap_server_trans_handle_bad_option(coap_server_trans_t *trans, coap_msg_t *send_msg, unsigned op_num)
+static void coap_server_stats_merge(coap_server_stats_t *stats, coap_server_t *server)
 {
-    char payload[COAP_SERVER_DIAG_PAYLOAD_LEN] = {0};
-    int ret = 0;
+    unsigned i = 0;
 
-    coap_log_info("Found bad option number %u in message from address %s and port %u", op_num, trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
-    coap_log_info("Sending 'Bad Option' response to address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
-    ret = coap_msg_set_code(send_msg, COAP_MSG_CLIENT_ERR, COAP_MSG_BAD_OPTION);
-    if (ret < 0)
+    for (i = 0; i < COAP_SERVER_NUM_STAGES; i++)
     {
-        return ret;
+        coap_server_hist_merge(&stats->stage[i], &server->stats.stage[i]);
     }
-    snprintf(payload, sizeof(payload), "Bad option number: %u", op_num);
-    ret = coap_msg_set_payload(send_msg, payload, strlen(payload));
-    if (ret < 0)
+    stats->num_req += __atomic_load_n(&server->stats.num_req, __ATOMIC_RELAXED);
+    stats->num_dup += __atomic_load_n(&server->stats.num_dup, __ATOMIC_RELAXED);
+    stats->num_retrans += __atomic_load_n(&server->stats.num_retrans, __ATOMIC_RELAXED);
+    stats->num_timeout += __atomic_load_n(&server->stats.num_timeout, __ATOMIC_RELAXED);
+    stats->num_evict += __atomic_load_n(&server->stats.num_evict, __ATOMIC_RELAXED);
+    stats->trans_active += __atomic_load_n(&server->stats.trans_active, __ATOMIC_RELAXED);
+    stats->trans_max += server->num_trans;
+}
+
+/**
+ *  @brief Record the duration of a processing stage
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in] stage Processing stage
+ *  @param[in] start Pointer to the start time of the processing stage
+ *  @param[in] end Pointer to the end time of the processing stage
+ */
+static void coap_server_stats_record(coap_server_t *server, coap_server_stage_t stage, const struct timespec *start, const struct timespec *end)
+{
+    int64_t nsec = 0;
+
+    nsec = (int64_t)(end->tv_sec - start->tv_sec) * 1000000000 + (end->tv_nsec - start->tv_nsec);
+    if (nsec < 0)
     {
-        return ret;
+        nsec = 0;
     }
-    return 0;
+    coap_server_hist_add(&server->stats.stage[stage], nsec);
 }
 
 /**
- *  @brief Send an acknowledgement message to the client
+ *  @brief Record the duration of the current processing stage and start the next one
  *
- *  @param[in,out] trans Pointer to a transaction structure
- *  @param[in] msg Pointer to a message structure
- *
- *  @returns Operation status
- *  @retval 0 Success
- *  @retval <0 Error
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in] stage Current processing stage
  */
-static int coap_server_trans_send_ack(coap_server_trans_t *trans, coap_msg_t *msg)
+static void coap_server_stats_end_stage(coap_server_t *server, coap_server_stage_t stage)
 {
-    coap_msg_t ack = {0};
-    ssize_t num = 0;
-    int ret = 0;
+    struct timespec now = {0};
 
-    coap_log_info("Acknowledging confirmable message from address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
-    coap_msg_create(&ack);
-    ret = coap_msg_set_type(&ack, COAP_MSG_ACK);
-    if (ret < 0)
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    coap_server_stats_record(server, stage, &server->stats_stage_start, &now);
+    server->stats_stage_start = now;
+}
+
+void coap_server_get_stats(coap_server_t *server, coap_server_stats_t *stats)
+{
+#ifdef COAP_SERVER_THREAD_EN
+    unsigned num_workers = 0;
+    unsigned i = 0;
+
+    if (server->master != NULL)
     {
-        coap_msg_destroy(&ack);
-        return ret;
+        server = server->master;
     }
-    ret = coap_msg_set_msg_id(&ack, coap_msg_get_msg_id(msg));
-    if (ret < 0)
+#endif
+    memset(stats, 0, sizeof(coap_server_stats_t));
+    coap_server_stats_merge(stats, server);
+#ifdef COAP_SERVER_THREAD_EN
+    num_workers = __atomic_load_n(&server->num_workers, __ATOMIC_ACQUIRE);
+    for (i = 0; i < num_workers; i++)
     {
-        coap_msg_destroy(&ack);
-        return ret;
+        coap_server_stats_merge(stats, &server->workers[i]);
     }
-    num = coap_server_trans_send(trans, &ack);
-    coap_msg_destroy(&ack);
-    if (num < 0)
+#endif
+}
+
+uint64_t coap_server_hist_get_percentile(const coap_server_hist_t *hist, unsigned pct)
+{
+    uint64_t target = 0;
+    uint64_t total = 0;
+    uint64_t val = 0;
+    unsigned i = 0;
+
+    if (hist->count == 0)
     {
-        return num;
+        return 0;
     }
-    return 0;
+    if (pct > 100)
+    {
+        pct = 100;
+    }
+    target = (hist->count * pct + 99) / 100;
+    if (target == 0)
+    {
+        target = 1;
+    }
+    for (i = 0; i < COAP_SERVER_HIST_NUM_BUCKETS - 1; i++)
+    {
+        total += hist->bucket[i];
+        if (total >= target)
+        {
+            break;
+        }
+    }
+    val = (i < COAP_SERVER_HIST_NUM_BUCKETS - 1) ? coap_server_hist_bucket_low(i + 1) - 1 : hist->max;
+    return (val < hist->max) ? val : hist->max;
 }
 
 /**
- *  @brief Handle an acknowledgement timeout
+ *  @brief Handle a request for the statistics resource
  *
- *  Update the acknowledgement timer in the transaction structure
- *  and if the maximum number of retransmits has not been reached
- *  then retransmit the last response to the client.
+ *  The response payload has a line for each counter and
+ *  a line for each processing stage with the number of
+ *  values and the mean, median, 90th percentile, 99th
+ *  percentile and maximum durations in nanoseconds.
  *
- *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in] trans Pointer to a transaction structure
+ *  @param[in] req Pointer to the request message
+ *  @param[out] resp Pointer to the response message
  *
  *  @returns Operation status
  *  @retval 0 Success
  *  @retval <0 Error
  */
-static int coap_server_trans_handle_ack_timeout(coap_server_trans_t *trans)
+static int coap_server_handle_stats(coap_server_trans_t *trans, coap_msg_t *req, coap_msg_t *resp)
 {
-    ssize_t num = 0;
+    coap_server_stats_t stats = {{{0}}};
+    coap_server_hist_t *hist = NULL;
+    size_t len = 0;
+    char buf[COAP_MSG_MAX_PAYLOAD_LEN] = {0};
+    unsigned i = 0;
+    int num = 0;
     int ret = 0;
 
-    coap_log_debug("Transaction expired for address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
-    ret = coap_server_trans_update_ack_timer(trans);
-    if (ret == 0)
-    {
-        coap_log_debug("Retransmitting to address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
-        num = coap_server_trans_send(trans, &trans->resp);
-        if (num < 0)
-        {
-            return num;
-        }
-    }
-    else if (ret == -ETIMEDOUT)
+    coap_server_get_stats(trans->server, &stats);
+    num = snprintf(buf, sizeof(buf),
+                   "requests %llu\nduplicates %llu\nretransmissions %llu\ntimeouts %llu\nevictions %llu\ntransactions %llu/%llu\n",
+                   (unsigned long long)stats.num_req,
+                   (unsigned long long)stats.num_dup,
+                   (unsigned long long)stats.num_retrans,
+                   (unsigned long long)stats.num_timeout,
+                   (unsigned long long)stats.num_evict,
+                   (unsigned long long)stats.trans_active,
+                   (unsigned long long)stats.trans_max);
+    for (i = 0; (i < COAP_SERVER_NUM_STAGES) && (num >= 0) && (len + num < sizeof(buf)); i++)
+    {
+        len += num;
+        hist = &stats.stage[i];
+        num = snprintf(buf + len, sizeof(buf) - len,
+                       "%s count %llu mean %llu p50 %llu p90 %llu p99 %llu max %llu\n",
+                       coap_server_stage_name[i],
+                       (unsigned long long)hist->count,
+                       (unsigned long long)(hist->count > 0 ? hist->sum / hist->count : 0),
+                       (unsigned long long)coap_server_hist_get_percentile(hist, 50),
+                       (unsigned long long)coap_server_hist_get_percentile(hist, 90),
+                       (unsigned long long)coap_server_hist_get_percentile(hist, 99),
+                       (unsigned long long)hist->max);
+    }
+    if ((num < 0) || (len + num >= sizeof(buf)))
+    {
+        return coap_msg_set_code(resp, COAP_MSG_SERVER_ERR, COAP_MSG_INT_SERVER_ERR);
+    }
+    len += num;
+    ret = coap_msg_set_payload(resp, buf, len);
+    if (ret < 0)
     {
-        coap_log_debug("Stopped retransmitting to address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
-        coap_log_info("No acknowledgement received from address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
-        coap_server_trans_destroy(trans);
-        ret = 0;
+        return ret;
     }
-    return ret;
+    return coap_msg_set_code(resp, COAP_MSG_SUCCESS, COAP_MSG_CONTENT);
 }
 
+#else  /* !COAP_SERVER_STATS_EN */
+
+#define coap_server_stats_inc(server, field)
+#define coap_server_stats_dec(server, field)
+#define coap_server_stats_begin(server)
+#define coap_server_stats_end(server, stage)
+
+#endif  /* COAP_SERVER_STATS_EN */
+
+#ifdef COAP_DTLS_EN
+
+/****************************************************************************************************
+ *                                      coap_server_trans_dtls                                      *
+ ****************************************************************************************************/
+
 /**
- *  @brief Initialise a transaction structure
+ *  @brief Listen for a packet from the client with a timeout
  *
- *  @param[out] trans Pointer to a transaction structure
- *  @param[in] server Pointer to a server structure
- *  @param[in] client_sin Pointer to a socket structure
- *  @param[in] client_sin_len Length of the socket structure
+ *  @param[in] trans Pointer to a transaction structure
+ *  @param[in] ms Timeout value in msec
  *
  *  @returns Operation status
- *  @retval 0 Success
+ *  @retval 1 Success
+ *  @retval 0 Timeout
  *  @retval <0 Error
  */
-static int coap_server_trans_create(coap_server_trans_t *trans, coap_server_t *server, coap_ipv_sockaddr_in_t *client_sin, socklen_t client_sin_len)
+static int coap_server_trans_dtls_listen_timeout(coap_server_trans_t *trans, unsigned ms)
 {
-    const char *p = NULL;
-#ifdef COAP_DTLS_EN
+    coap_server_t *server = NULL;
+    struct timeval tv = {0};
+    fd_set read_fds = {{0}};
     int ret = 0;
-#endif
 
-    memset(trans, 0, sizeof(coap_server_trans_t));
-    trans->active = 1;
-    coap_server_trans_touch(trans);
-    trans->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
-    if (trans->timer_fd < 0)
-    {
-        memset(trans, 0, sizeof(coap_server_trans_t));
-        return -errno;
-    }
-    memcpy(&trans->client_sin, client_sin, client_sin_len);
-    trans->client_sin_len = client_sin_len;
-    p = inet_ntop(COAP_IPV_AF_INET, &client_sin->COAP_IPV_SIN_ADDR, trans->client_addr, sizeof(trans->client_addr));
-    if (p == NULL)
-    {
-        close(trans->timer_fd);
-        memset(trans, 0, sizeof(coap_server_trans_t));
-        return -errno;
-    }
-    coap_msg_create(&trans->req);
-    coap_msg_create(&trans->resp);
-    trans->server = server;
-#ifdef COAP_DTLS_EN
-    ret = coap_server_trans_dtls_create(trans);
-    if (ret < 0)
+    server = trans->server;
+    tv.tv_sec = ms / 1000;
+    tv.tv_usec = (ms % 1000) * 1000;
+    while (1)
     {
-        coap_msg_destroy(&trans->resp);
-        coap_msg_destroy(&trans->req);
-        close(trans->timer_fd);
-        memset(trans, 0, sizeof(coap_server_trans_t));
-        return ret;
+        FD_ZERO(&read_fds);
+        FD_SET(server->sd, &read_fds);
+        ret = select(server->sd + 1, &read_fds, NULL, NULL, &tv);
+        if (ret < 0)
+        {
+            return -errno;
+        }
+        if (ret == 0)
+        {
+            return 0;  /* timeout */
+        }
+        if (FD_ISSET(server->sd, &read_fds))
+        {
+            return 1;  /* success */
+        }
     }
-#endif
-    coap_log_debug("Created transaction for address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
-    return 0;
 }
 
 /**
- *  @brief Generate a response for the next block in a blockwise transfer
+ *  @brief Receive data from the client
  *
- *  This function will choose the smaller of the block1_size
- *  value passed to the coap_server_trans_handle_blockwise
- *  function by the application and any value specified in
- *  the request message and similarly for the block2_size value.
+ *  This is a call-back function that the
+ *  GnuTLS library uses to receive data.
+ *  To report an error, it sets errno and
+ *  returns -1.
  *
- *  @param[in,out] trans Pointer to a transaction structure
- *  @param[in] req Pointer to the request message
- *  @param[out] resp Pointer to the response message
+ *  @param[in,out] data Pointer to a transaction structure
+ *  @param[out] buf Pointer to a buffer
+ *  @param[in] len Length of the buffer
  *
- *  @returns Operation status
- *  @retval 0 Success
- *  @retval <0 Error
+ *  @returns Number of bytes received or error
+ *  @retval 0 Number of bytes received
+ *  @retval -1 Error
  */
-static int coap_server_trans_handle_next_block(coap_server_trans_t *trans, coap_msg_t *req, coap_msg_t *resp)
+static ssize_t coap_server_trans_dtls_pull_func(gnutls_transport_ptr_t data, void *buf, size_t len)
 {
-    coap_msg_success_t code_detail = 0;
-    unsigned payload_len = 0;
-    unsigned block1_size = 0;
-    unsigned block2_size = 0;
-    unsigned block1_more = 0;
-    unsigned block2_more = 0;
-    unsigned block1_num = 0;
-    unsigned block2_num = 0;
-    unsigned block_len = 0;
-    size_t block1_next = 0;
-    size_t block2_next = 0;
-    char block_uri[COAP_MSG_OP_URI_PATH_MAX_LEN + 1] = {0};
-    char block_val[COAP_MSG_OP_MAX_BLOCK_VAL_LEN] = {0};
-    int block1_szx = -1;
-    int block2_szx = -1;
+    coap_ipv_sockaddr_in_t client_sin = {0};
+    coap_server_trans_t *trans = NULL;
+    coap_server_t *server = NULL;
+    socklen_t client_sin_len = 0;
+    ssize_t num = 0;
+
+    trans = (coap_server_trans_t *)data;
+    server = trans->server;
+    client_sin_len = sizeof(client_sin);
+    num = recvfrom(server->sd, buf, len, MSG_PEEK, (struct sockaddr *)&client_sin, &client_sin_len);  /* peek data */
+    if (num < 0)
+    {
+        return -1;
+    }
+    if ((client_sin_len != trans->client_sin_len)
+     || (memcmp(&client_sin, &trans->client_sin, trans->client_sin_len) != 0))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    num = recvfrom(server->sd, buf, num, 0, (struct sockaddr *)&client_sin, &client_sin_len);  /* consume data */
+    if (num >= 0)
+    {
+        coap_log_debug("pulled %zd bytes", num);
+    }
+    return num;
+}
+
+/**
+ *  @brief Wait for receive data from the client
+ *
+ *  This is a call-back function that the GnuTLS
+ *  library uses to wait for receive data. To
+ *  report an error, it sets errno and returns -1.
+ *
+ *  @param[in,out] data Pointer to a transaction structure
+ *  @param[in] ms Timeout in msec
+ *
+ *  @returns Number of bytes received or error
+ *  @retval >0 Number of bytes received
+ *  @retval 0 Timeout
+ *  @retval -1 Error
+ */
+static int coap_server_trans_dtls_pull_timeout_func(gnutls_transport_ptr_t data, unsigned ms)
+{
+    coap_ipv_sockaddr_in_t client_sin = {0};
+    coap_server_trans_t *trans = NULL;
+    coap_server_t *server = NULL;
+    socklen_t client_sin_len = 0;
+    ssize_t num = 0;
+    char buf[COAP_SERVER_DTLS_MTU] = {0};
     int ret = 0;
 
-    /* allow the client to resize the blocks */
-    ret = coap_msg_parse_block_op(&block1_num, &block1_more, &block1_size, req, COAP_MSG_BLOCK1);
+    trans = (coap_server_trans_t *)data;
+    server = trans->server;
+    ret = coap_server_trans_dtls_listen_timeout(trans, ms);
+    if (ret == 0)
+    {
+        return 0;  /* timeout */
+    }
     if (ret < 0)
     {
-        coap_log_info("Unable to parse block1 option in message from address %s and port %u",
-                      trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
-        coap_server_trans_clear_blockwise(trans);
-        return coap_msg_set_code(resp, COAP_MSG_CLIENT_ERR, COAP_MSG_BAD_REQ);
+        /* errno has been set by coap_server_trans_dtls_listen_timeout */
+        return -1;
     }
-    if ((ret == 0) && (block1_size < trans->block1_size))
+    client_sin_len = sizeof(client_sin);
+    num = recvfrom(server->sd, buf, sizeof(buf), MSG_PEEK, (struct sockaddr *)&client_sin, &client_sin_len);  /* peek data */
+    if (num < 0)
     {
-        trans->block1_size = block1_size;
+        return -1;
     }
-    ret = coap_msg_parse_block_op(&block2_num, &block2_more, &block2_size, req, COAP_MSG_BLOCK2);
-    if (ret < 0)
+    if ((client_sin_len != trans->client_sin_len)
+     || (memcmp(&client_sin, &trans->client_sin, trans->client_sin_len) != 0))
     {
-        coap_log_info("Unable to parse block2 option in message from address %s and port %u",
-                      trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
-        coap_server_trans_clear_blockwise(trans);
-        return coap_msg_set_code(resp, COAP_MSG_CLIENT_ERR, COAP_MSG_BAD_REQ);
+        errno = EINVAL;
+        return -1;
     }
-    if ((ret == 0) && (block2_size < trans->block2_size))
+    return num;  /* success */
+}
+
+/**
+ *  @brief Send data to the client
+ *
+ *  This is a call-back function that the
+ *  GnuTLS library uses to send data. To
+ *  report an error, it sets errno and
+ *  returns -1.
+ *
+ *  @param[in] data Pointer to a transaction structure
+ *  @param[in] buf Pointer to a buffer
+ *  @param[in] len Length of the buffer
+ *
+ *  @returns Number of bytes sent or error
+ *  @retval >0 Number of bytes sent
+ *  @retval -1 Error
+ */
+static ssize_t coap_server_trans_dtls_push_func(gnutls_transport_ptr_t data, const void *buf, size_t len)
+{
+    coap_server_trans_t *trans = NULL;
+    coap_server_t *server = NULL;
+    ssize_t num = 0;
+
+    trans = (coap_server_trans_t *)data;
+    server = trans->server;
+    num = sendto(server->sd, buf, len, 0, (struct sockaddr *)&trans->client_sin, trans->client_sin_len);
+    if (num >= 0)
     {
-        trans->block2_size = block2_size;
+        coap_log_debug("pushed %zd bytes", num);
     }
-    coap_msg_uri_path_to_str(req, block_uri, sizeof(block_uri));
-    if ((trans->type == COAP_SERVER_TRANS_BLOCKWISE_GET)
-     || (trans->type == COAP_SERVER_TRANS_BLOCKWISE_PUT2)
-     || (trans->type == COAP_SERVER_TRANS_BLOCKWISE_POST2))
+    return num;
+}
+
+/**
+ *  @brief Perform a DTLS handshake with the client
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *
+ *  @returns Operation success
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_trans_dtls_handshake(coap_server_trans_t *trans)
+{
+    gnutls_alert_description_t alert = 0;
+    gnutls_cipher_algorithm_t cipher = 0;
+    gnutls_mac_algorithm_t mac = 0;
+    gnutls_kx_algorithm_t kx = 0;
+    const char *cipher_suite = NULL;
+    const char *alert_name = NULL;
+    unsigned timeout = 0;
+    int ret = 0;
+    int i = 0;
+
+    coap_log_info("Initiating DTLS handshake");
+    for (i = 0; i < COAP_SERVER_DTLS_HANDSHAKE_ATTEMPTS; i++)
     {
-        coap_log_debug("Handling block with start byte index %u for blockwise transfer", trans->block2_next);
-        /* check for continuity between the current and previous blocks
-         * the client may not include a block2 option in the first message
-         * but must include a block2 option in subsequent messages
-         */
-        block2_next = block2_num * trans->block2_size;  /* start byte index according to the client or for the first block */
-        if (((trans->type == COAP_SERVER_TRANS_BLOCKWISE_GET) && (coap_msg_get_code_detail(req) != COAP_MSG_GET))
-         || ((trans->type == COAP_SERVER_TRANS_BLOCKWISE_PUT2) && (coap_msg_get_code_detail(req) != COAP_MSG_PUT))
-         || ((trans->type == COAP_SERVER_TRANS_BLOCKWISE_POST2) && (coap_msg_get_code_detail(req) != COAP_MSG_POST))
-         || (strcmp(block_uri, trans->block_uri) != 0)
-         || (block2_next != trans->block2_next))
-        {
-            coap_log_info("Unexpected request message during blockwise transfer from address %s and port %u",
-                          trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
-            coap_server_trans_clear_blockwise(trans);
-            return coap_msg_set_code(resp, COAP_MSG_CLIENT_ERR, COAP_MSG_BAD_REQ);
-        }
-        ret = coap_msg_op_calc_block_szx(trans->block2_size);
-        if (ret < 0)
+        errno = 0;
+        ret = gnutls_handshake(trans->session);
+        coap_log_debug("DTLS handshake result: %s", gnutls_strerror_name(ret));
+        if ((errno != 0) && (errno != EAGAIN))
         {
-            coap_log_warn("Failed to calculate block size exponent from block2 size %u", trans->block2_size);
-            coap_server_trans_clear_blockwise(trans);
-            return ret;
+            return -errno;
         }
-        block2_szx = ret;
-        block2_more = 1;
-        payload_len = trans->block2_size;
-        if (trans->block2_next + trans->block2_size > trans->body_end)
+        if (ret == GNUTLS_E_SUCCESS)
         {
-            block2_more = 0;
-            payload_len = trans->body_end - trans->block2_next;
+            coap_log_info("Completed DTLS handshake");
+            /* determine which cipher suite was negotiated */
+            kx = gnutls_kx_get(trans->session);
+            cipher = gnutls_cipher_get(trans->session);
+            mac = gnutls_mac_get(trans->session);
+            cipher_suite = gnutls_cipher_suite_get_name(kx, cipher, mac);
+            if (cipher_suite != NULL)
+                coap_log_info("Cipher suite is TLS_%s", cipher_suite);
+            else
+                coap_log_info("Cipher suite is unknown");
+            return 0;  /* success */
         }
-        block2_num = coap_msg_block_start_to_num(trans->block2_next, block2_szx);
-        ret = coap_msg_op_format_block_val(block_val, sizeof(block_val), block2_num, block2_more, trans->block2_size);
-        if (ret < 0)
+        if (ret == GNUTLS_E_TIMEDOUT)
         {
-            coap_log_warn("Failed to format block2 option value, num %u, more %u, size %u", block2_num, block2_more, trans->block2_size);
-            coap_server_trans_clear_blockwise(trans);
-            return ret;
+            break;
         }
-        block_len = ret;
-        ret = coap_msg_add_op(resp, COAP_MSG_BLOCK2, block_len, block_val);
-        if (ret < 0)
+        if ((ret == GNUTLS_E_FATAL_ALERT_RECEIVED)
+         || (ret == GNUTLS_E_WARNING_ALERT_RECEIVED))
         {
-            coap_server_trans_clear_blockwise(trans);
-            return ret;
+            alert = gnutls_alert_get(trans->session);
+            alert_name = gnutls_alert_get_name(alert);
+            if (ret == GNUTLS_E_FATAL_ALERT_RECEIVED)
+                coap_log_error("Received DTLS alert from the client: %s", alert_name);
+            else
+                coap_log_warn("Received DTLS alert from the client: %s", alert_name);
+            return -ECONNRESET;
         }
-        ret = coap_msg_set_payload(resp, trans->body + trans->block2_next, payload_len);
-        if (ret < 0)
+        if (ret != GNUTLS_E_AGAIN)
         {
-            coap_server_trans_clear_blockwise(trans);
-            return ret;
+            coap_log_error("Failed to complete DTLS handshake: %s", gnutls_strerror_name(ret));
+            return -1;
         }
-        trans->block2_next += payload_len;
-        code_detail = COAP_MSG_CONTINUE;
-        if (!block2_more)
+        if (i < COAP_SERVER_DTLS_HANDSHAKE_ATTEMPTS - 1)
         {
-            if (trans->type == COAP_SERVER_TRANS_BLOCKWISE_GET)
-            {
-                coap_log_info("Completed GET library-level blockwise transfer with address %s and port %u",
-                              trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
-                code_detail = COAP_MSG_CONTENT;
-            }
-            else if (trans->type == COAP_SERVER_TRANS_BLOCKWISE_PUT2)
-            {
-                coap_log_info("Completed PUT library-level blockwise transfer with address %s and port %u",
-                              trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
-                code_detail = trans->block_detail;
-            }
-            else
+            timeout = gnutls_dtls_get_timeout(trans->session);
+            coap_log_debug("Handshake timeout: %u msec", timeout);
+            ret = coap_server_trans_dtls_listen_timeout(trans, timeout);
+            if (ret < 0)
             {
-                coap_log_info("Completed POST library-level blockwise transfer with address %s and port %u",
-                              trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
-                code_detail = trans->block_detail;
+                return ret;
             }
-            coap_server_trans_clear_blockwise(trans);
         }
-        return coap_msg_set_code(resp, COAP_MSG_SUCCESS, code_detail);
     }
-    else if ((trans->type == COAP_SERVER_TRANS_BLOCKWISE_PUT1)
+    return -ETIMEDOUT;
+}
+
+#ifdef COAP_CLIENT_AUTH
+
+/**
+ *  @brief Verify the clients's certificate
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *
+ *  @returns Operation success
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_trans_dtls_verify_peer_cert(coap_server_trans_t *trans)
+{
+    gnutls_certificate_type_t cert_type = 0;
+    const gnutls_datum_t *cert_list = NULL;
+    gnutls_x509_crt_t cert = {0};
+    unsigned cert_list_size = 0;
+    unsigned status = 0;
+    time_t expiration_time = 0;
+    time_t activation_time = 0;
+    time_t current_time = 0;
+    int ret = 0;
+
+    ret = gnutls_certificate_verify_peers2(trans->session, &status);
+    if (ret != GNUTLS_E_SUCCESS)
+    {
+        coap_log_error("The peer certificate was not verified: %s", gnutls_strerror_name(ret));
+        return -1;
+    }
+    if (status & GNUTLS_CERT_INVALID)
+    {
+        coap_log_error("The peer certificate is not trusted");
+        return -1;
+    }
+    if (status & GNUTLS_CERT_SIGNER_NOT_FOUND)
+    {
+        coap_log_error("No issuer found for the peer certificate");
+        return -1;
+    }
+    if (status & GNUTLS_CERT_SIGNER_NOT_CA)
+    {
+        coap_log_error("The issuer for the peer certificate is not a certificate authority");
+        return -1;
+    }
+    if (status & GNUTLS_CERT_REVOKED)
+    {
+        coap_log_error("The peer certificate has been revoked");
+        return -1;
+    }
+    cert_type = gnutls_certificate_type_get(trans->session);
+    if (cert_type != GNUTLS_CRT_X509)
+    {
+        coap_log_error("The peer certificate is not an X509 certificate");
+        return -1;
+    }
+    ret = gnutls_x509_crt_init(&cert);
+    if (ret != GNUTLS_E_SUCCESS)
+    {
+        coap_log_error("Unable to initialise gnutls_x509_crt_t object: %s", gnutls_strerror_name(ret));
+        return -1;
+    }
+    cert_list = gnutls_certificate_get_peers(trans->session, &cert_list_size);
+    if (cert_list == NULL)
+    {
+        coap_log_error("No peer certificate found");
+        gnutls_x509_crt_deinit(cert);
+        return -1;
+    }
+    /* We only check the first (leaf) certificate in the chain */
+    ret = gnutls_x509_crt_import(cert, &cert_list[0], GNUTLS_X509_FMT_DER);
+    if (ret != GNUTLS_E_SUCCESS)
+    {
+        coap_log_error("Unable to parse certificate: %s", gnutls_strerror_name(ret));
+        gnutls_x509_crt_deinit(cert);
+        return -1;
+    }
+    current_time = time(NULL);
+    expiration_time = gnutls_x509_crt_get_expiration_time(cert);
+    if ((expiration_time == -1) || (expiration_time < current_time))
+    {
+        coap_log_error("The peer certificate has expired");
+        gnutls_x509_crt_deinit(cert);
+        return -1;
+    }
+    activation_time = gnutls_x509_crt_get_activation_time(cert);
+    if ((activation_time == -1) || (activation_time > current_time))
+    {
+        coap_log_error("The peer certificate is not yet activated");
+        gnutls_x509_crt_deinit(cert);
+        return -1;
+    }
+    coap_log_info("Peer certificate validated");
+    gnutls_x509_crt_deinit(cert);
+    return 0;
+}
+
+#endif  /* COAP_CLIENT_AUTH */
+
+/**
+ *  @brief Initialise the DTLS members of a transaction structure
+ *
+ *  Perform a DTLS handshake with the client.
+ *
+ *  @param[out] trans Pointer to a transaction structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_trans_dtls_create(coap_server_trans_t *trans)
+{
+    coap_server_t *server = NULL;
+    int ret = 0;
+
+    server = trans->server;
+    ret = gnutls_init(&trans->session, GNUTLS_SERVER | GNUTLS_DATAGRAM | GNUTLS_NONBLOCK);
+    if (ret != GNUTLS_E_SUCCESS)
+    {
+        coap_log_error("Failed to initialise DTLS session: %s", gnutls_strerror_name(ret));
+        return -1;
+    }
+    ret = gnutls_credentials_set(trans->session, GNUTLS_CRD_CERTIFICATE, server->cred);
+    if (ret != GNUTLS_E_SUCCESS)
+    {
+        coap_log_error("Failed to assign credentials to DTLS session: %s", gnutls_strerror_name(ret));
+        gnutls_deinit(trans->session);
+        return -1;
+    }
+    ret = gnutls_priority_set(trans->session, server->priority);
+    if (ret != GNUTLS_E_SUCCESS)
+    {
+        coap_log_error("Failed to assign priorities to DTLS session: %s", gnutls_strerror_name(ret));
+        gnutls_deinit(trans->session);
+        return -1;
+    }
+    gnutls_transport_set_ptr(trans->session, trans);
+    gnutls_transport_set_pull_function(trans->session, coap_server_trans_dtls_pull_func);
+    gnutls_transport_set_pull_timeout_function(trans->session, coap_server_trans_dtls_pull_timeout_func);
+    gnutls_transport_set_push_function(trans->session, coap_server_trans_dtls_push_func);
+    gnutls_dtls_set_mtu(trans->session, COAP_SERVER_DTLS_MTU);
+    gnutls_dtls_set_timeouts(trans->session, COAP_SERVER_DTLS_RETRANS_TIMEOUT, COAP_SERVER_DTLS_TOTAL_TIMEOUT);
+#ifdef COAP_CLIENT_AUTH
+    gnutls_certificate_server_set_request(trans->session, GNUTLS_CERT_REQUIRE);
+#endif
+    ret = coap_server_trans_dtls_handshake(trans);
+    if (ret < 0)
+    {
+        gnutls_deinit(trans->session);
+        return ret;
+    }
+#ifdef COAP_CLIENT_AUTH
+    ret = coap_server_trans_dtls_verify_peer_cert(trans);
+    if (ret < 0)
+    {
+        gnutls_deinit(trans->session);
+        return ret;
+    }
+#endif
+    return 0;
+}
+
+/**
+ *  @brief Deinitialise the DTLS members of a transaction structure
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ */
+static void coap_server_trans_dtls_destroy(coap_server_trans_t *trans)
+{
+    gnutls_bye(trans->session, GNUTLS_SHUT_WR);
+    gnutls_deinit(trans->session);
+}
+
+#endif  /* COAP_DTLS_EN */
+
+/****************************************************************************************************
+ *                                        coap_server_trans                                         *
+ ****************************************************************************************************/
+
+/**
+ *  @brief Free the resources assigned to a blockwise transfer
+ *
+ *  @param[out] trans Pointer to a transaction structure
+ */
+static void coap_server_trans_clear_blockwise(coap_server_trans_t *trans)
+{
+    trans->type = COAP_SERVER_TRANS_REGULAR;
+    if (trans->body != NULL)
+    {
+        coap_mem_large_free(trans->body);
+        trans->body = NULL;
+    }
+    trans->body_len = 0;
+    trans->body_end = 0;
+    trans->block1_size = 0;
+    trans->block2_size = 0;
+    trans->block1_next = 0;
+    trans->block2_next = 0;
+    memset(trans->block_uri, 0, sizeof(trans->block_uri));
+    trans->block_detail = 0;
+    trans->block_rx = NULL;
+    trans->block_read = NULL;
+    trans->block_write = NULL;
+    trans->block_data = NULL;
+}
+
+/**
+ *  @brief Start or stop the timer file descriptor that drives the timer wheel
+ *
+ *  @param[in] server Pointer to a server structure
+ *  @param[in] run Flag to indicate if the timer should tick or be stopped
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_timer_set(coap_server_t *server, int run)
+{
+    struct itimerspec its = {{0}};
+    int ret = 0;
+
+    if (run)
+    {
+        its.it_value.tv_sec = 0;
+        its.it_value.tv_nsec = COAP_SERVER_TIMER_TICK_MSEC * 1000000;
+        its.it_interval = its.it_value;
+    }
+    ret = timerfd_settime(server->timer_fd, 0, &its, NULL);
+    if (ret < 0)
+    {
+        return -errno;
+    }
+    return 0;
+}
+
+/**
+ *  @brief Remove the timer in a transaction structure from the timer wheel
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ */
+static void coap_server_trans_unlink_timer(coap_server_trans_t *trans)
+{
+    coap_server_t *server = trans->server;
+
+    if (trans->timer_prev != NULL)
+        trans->timer_prev->timer_next = trans->timer_next;
+    else
+        server->timer_wheel[trans->timer_slot] = trans->timer_next;
+    if (trans->timer_next != NULL)
+        trans->timer_next->timer_prev = trans->timer_prev;
+    trans->timer_prev = NULL;
+    trans->timer_next = NULL;
+    trans->timer_running = 0;
+    server->timer_num--;
+}
+
+/**
+ *  @brief Start the timer in a transaction structure
+ *
+ *  Insert the transaction structure into the timer wheel slot
+ *  that corresponds to the timeout value, replacing any timer
+ *  that is already running.
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_trans_start_timer(coap_server_trans_t *trans)
+{
+    coap_server_t *server = trans->server;
+    unsigned ticks = 0;
+    unsigned msec = 0;
+    int ret = 0;
+
+    if (trans->timer_running)
+    {
+        coap_server_trans_unlink_timer(trans);
+    }
+    msec = (trans->timeout.tv_sec * 1000) + (trans->timeout.tv_nsec / 1000000);
+    ticks = (msec + COAP_SERVER_TIMER_TICK_MSEC - 1) / COAP_SERVER_TIMER_TICK_MSEC;
+    if (ticks == 0)
+    {
+        ticks = 1;
+    }
+    if (server->timer_num == 0)
+    {
+        ret = coap_server_timer_set(server, 1);
+        if (ret < 0)
+        {
+            return ret;
+        }
+    }
+    trans->timer_slot = (server->timer_pos + ticks) & COAP_SERVER_TIMER_WHEEL_MASK;
+    trans->timer_rounds = (ticks - 1) / COAP_SERVER_TIMER_WHEEL_SIZE;
+    trans->timer_prev = NULL;
+    trans->timer_next = server->timer_wheel[trans->timer_slot];
+    if (trans->timer_next != NULL)
+    {
+        trans->timer_next->timer_prev = trans;
+    }
+    server->timer_wheel[trans->timer_slot] = trans;
+    trans->timer_running = 1;
+    server->timer_num++;
+    return 0;
+}
+
+/**
+ *  @brief Stop the timer in a transaction structure
+ *
+ *  @param[out] trans Pointer to a transaction structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_trans_stop_timer(coap_server_trans_t *trans)
+{
+    coap_server_t *server = trans->server;
+
+    if (!trans->timer_running)
+    {
+        return 0;
+    }
+    coap_server_trans_unlink_timer(trans);
+    if (server->timer_num == 0)
+    {
+        return coap_server_timer_set(server, 0);
+    }
+    return 0;
+}
+
+/**
+ *  @brief Compute the hash value of a client endpoint
+ *
+ *  @param[in] client_sin Pointer to a socket structure
+ *  @param[in] client_sin_len Length of the socket structure
+ *
+ *  @returns Hash value
+ */
+static unsigned coap_server_trans_hash(coap_ipv_sockaddr_in_t *client_sin, socklen_t client_sin_len)
+{
+    const unsigned char *p = (const unsigned char *)client_sin;
+    uint32_t hash = 2166136261u;
+    socklen_t i = 0;
+
+    /* FNV-1a */
+    for (i = 0; i < client_sin_len; i++)
+    {
+        hash ^= p[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ *  @brief Add a transaction structure to the hash table and to the front of the LRU list
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ */
+static void coap_server_trans_link(coap_server_trans_t *trans)
+{
+    coap_server_t *server = trans->server;
+    unsigned i = 0;
+
+    i = coap_server_trans_hash(&trans->client_sin, trans->client_sin_len) & server->trans_hash_mask;
+    trans->hash_next = server->trans_hash[i];
+    server->trans_hash[i] = trans;
+    trans->lru_prev = NULL;
+    trans->lru_next = server->trans_lru_first;
+    if (server->trans_lru_first != NULL)
+    {
+        server->trans_lru_first->lru_prev = trans;
+    }
+    else
+    {
+        server->trans_lru_last = trans;
+    }
+    server->trans_lru_first = trans;
+    coap_server_stats_inc(server, trans_active);
+}
+
+/**
+ *  @brief Remove a transaction structure from the hash table and the LRU list
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ */
+static void coap_server_trans_unlink(coap_server_trans_t *trans)
+{
+    coap_server_t *server = trans->server;
+    coap_server_trans_t **prev = NULL;
+    unsigned i = 0;
+
+    i = coap_server_trans_hash(&trans->client_sin, trans->client_sin_len) & server->trans_hash_mask;
+    prev = &server->trans_hash[i];
+    while (*prev != NULL)
+    {
+        if (*prev == trans)
+        {
+            *prev = trans->hash_next;
+            break;
+        }
+        prev = &(*prev)->hash_next;
+    }
+    if (trans->lru_prev != NULL)
+        trans->lru_prev->lru_next = trans->lru_next;
+    else
+        server->trans_lru_first = trans->lru_next;
+    if (trans->lru_next != NULL)
+        trans->lru_next->lru_prev = trans->lru_prev;
+    else
+        server->trans_lru_last = trans->lru_prev;
+    trans->hash_next = NULL;
+    trans->lru_prev = NULL;
+    trans->lru_next = NULL;
+    coap_server_stats_dec(server, trans_active);
+}
+
+/**
+ *  @brief Return an inactive transaction structure to the free list
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in,out] trans Pointer to a transaction structure
+ */
+static void coap_server_trans_release(coap_server_t *server, coap_server_trans_t *trans)
+{
+    trans->hash_next = server->trans_free;
+    server->trans_free = trans;
+}
+
+/**
+ *  @brief Make the formatted response message in a transaction structure safe to replace
+ *
+ *  Datagrams in the send batch that refer to the formatted
+ *  response message are given their own copy of it.
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ */
+static void coap_server_trans_release_resp_buf(coap_server_trans_t *trans)
+{
+#ifndef COAP_DTLS_EN
+    coap_server_t *server = trans->server;
+    coap_server_dgram_t *dgram = NULL;
+    unsigned i = 0;
+
+    if (trans->resp_queued)
+    {
+        for (i = 0; i < server->send_num; i++)
+        {
+            dgram = &server->send_batch[i];
+            if (dgram->trans == trans)
+            {
+                memcpy(dgram->buf, dgram->data, dgram->len);
+                dgram->data = dgram->buf;
+                dgram->trans = NULL;
+            }
+        }
+        trans->resp_queued = 0;
+    }
+#endif
+    trans->resp_len = 0;
+}
+
+/**
+ *  @brief Check whether the last request in a transaction structure is recorded when it is reused
+ *
+ *  @param[in] trans Pointer to a transaction structure
+ *
+ *  @returns Comparison value
+ *  @retval 0 The transaction structure holds no completed exchange
+ *  @retval 1 The last request and its response are in the transaction structure
+ */
+static int coap_server_trans_has_exchange(coap_server_trans_t *trans)
+{
+    return ((coap_msg_get_ver(&trans->req) != 0) && (coap_msg_get_ver(&trans->resp) != 0));
+}
+
+/**
+ *  @brief Move the last request in a transaction structure to the message ID deduplication table
+ *
+ *  Only requests with a response, or confirmable requests
+ *  with a separate response, are recorded.
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ */
+static void coap_server_trans_retire(coap_server_trans_t *trans)
+{
+    const char *resp = NULL;
+    unsigned type = 0;
+    int ret = 0;
+
+    if (!coap_server_trans_has_exchange(trans))
+    {
+        return;
+    }
+    type = coap_msg_get_type(&trans->req);
+    if ((type == COAP_MSG_CON)
+     && (coap_msg_get_type(&trans->resp) == COAP_MSG_ACK)
+     && (trans->resp_len > 0))
+    {
+        resp = trans->resp_buf;
+    }
+    ret = coap_server_dedup_add(trans->server, &trans->client_sin, trans->client_sin_len,
+                                coap_msg_get_msg_id(&trans->req), type, resp, trans->resp_len);
+    if (ret < 0)
+    {
+        coap_log_warn("Failed to record request from address %s and port %u: %s", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT), strerror(-ret));
+    }
+}
+
+/**
+ *  @brief Deinitialise a transaction structure
+ *
+ *  The transaction structure is returned to the
+ *  free list of the containing server structure.
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ */
+static void coap_server_trans_destroy(coap_server_trans_t *trans)
+{
+    coap_server_t *server = trans->server;
+
+    if (!trans->active)
+    {
+        return;
+    }
+    coap_log_debug("Destroyed transaction for address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+    coap_server_trans_retire(trans);
+    coap_server_trans_release_resp_buf(trans);
+    coap_server_trans_unlink(trans);
+    coap_server_trans_clear_blockwise(trans);
+    coap_server_obs_delete_trans(trans);
+#ifdef COAP_DTLS_EN
+    coap_server_trans_dtls_destroy(trans);
+#endif
+    coap_msg_destroy(&trans->resp);
+    coap_msg_destroy(&trans->req);
+    coap_server_trans_stop_timer(trans);
+    memset(trans, 0, sizeof(coap_server_trans_t));
+    coap_server_trans_release(server, trans);
+}
+
+/**
+ *  @brief Mark the last time the transaction structure was used
+ *
+ *  Move the transaction structure to the front of the LRU list.
+ *
+ *  @param[out] trans Pointer to a transaction structure
+ */
+static void coap_server_trans_touch(coap_server_trans_t *trans)
+{
+    coap_server_t *server = trans->server;
+
+    trans->last_use = time(NULL);
+    if (server->trans_lru_first == trans)
+    {
+        return;
+    }
+    trans->lru_prev->lru_next = trans->lru_next;
+    if (trans->lru_next != NULL)
+        trans->lru_next->lru_prev = trans->lru_prev;
+    else
+        server->trans_lru_last = trans->lru_prev;
+    trans->lru_prev = NULL;
+    trans->lru_next = server->trans_lru_first;
+    server->trans_lru_first->lru_prev = trans;
+    server->trans_lru_first = trans;
+}
+
+/**
+ *  @brief Compare a received message with the request part of a transaction structure
+ *
+ *  @param[in] trans Pointer to a trasaction structure
+ *  @param[in] msg Pointer to a message structure
+ *
+ *  @returns Comparison value
+ *  @retval 0 The message does not match the transaction
+ *  @retval 1 The message matches the transaction
+ */
+static int coap_server_trans_match_req(coap_server_trans_t *trans, coap_msg_t *msg)
+{
+    return ((coap_msg_get_ver(&trans->req) != 0)
+         && (coap_msg_get_msg_id(&trans->req) == coap_msg_get_msg_id(msg)));
+}
+
+/**
+ *  @brief Compare a recevied message with the response part of a transaction structure
+ *
+ *  @param[in] trans Pointer to a trasaction structure
+ *  @param[in] msg Pointer to a message structure
+ *
+ *  @returns Comparison value
+ *  @retval 0 The message does not match the transaction
+ *  @retval 1 The message matches the transaction
+ */
+static int coap_server_trans_match_resp(coap_server_trans_t *trans, coap_msg_t *msg)
+{
+    return ((coap_msg_get_ver(&trans->resp) != 0)
+         && (coap_msg_get_msg_id(&trans->resp) == coap_msg_get_msg_id(msg)));
+}
+
+/**
+ *  @brief Clear the request message in a transaction structure
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ */
+static void coap_server_trans_clear_req(coap_server_trans_t *trans)
+{
+    coap_msg_destroy(&trans->req);
+}
+
+/**
+ *  @brief Clear the response message in a transaction structure
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ */
+static void coap_server_trans_clear_resp(coap_server_trans_t *trans)
+{
+    coap_msg_destroy(&trans->resp);
+}
+
+/**
+ *  @brief Set the request message in a transaction structure
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in] msg Pointer to a message structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_trans_set_req(coap_server_trans_t *trans, coap_msg_t *msg)
+{
+    coap_msg_reset(&trans->req);
+    return coap_msg_copy(&trans->req, msg);
+}
+
+/**
+ *  @brief Set the response message in a transaction structure
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in] msg Pointer to a message structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_trans_set_resp(coap_server_trans_t *trans, coap_msg_t *msg)
+{
+    coap_msg_reset(&trans->resp);
+    return coap_msg_copy(&trans->resp, msg);
+}
+
+/**
+ *  @brief Initialise the acknowledgement timer in a transaction structure
+ *
+ *  The timer is initialised to a random duration between:
+ *
+ *  ACK_TIMEOUT and (ACK_TIMEOUT * ACK_RANDOM_FACTOR)
+ *  where:
+ *  ACK_TIMEOUT = 2
+ *  ACK_RANDOM_FACTOR = 1.5
+ *
+ *  @param[out] trans Pointer to a transaction structure
+ */
+static void coap_server_trans_init_ack_timeout(coap_server_trans_t *trans)
+{
+    if (!rand_init)
+    {
+        srand(time(NULL));
+        rand_init = 1;
+    }
+    trans->timeout.tv_sec = COAP_SERVER_ACK_TIMEOUT_SEC;
+    trans->timeout.tv_nsec = (rand() % 1000) * 1000000;
+    coap_log_debug("Acknowledgement timeout initialised to: %lu sec, %lu nsec", trans->timeout.tv_sec, trans->timeout.tv_nsec);
+}
+
+/**
+ *  @brief Double the value of the timer in a transaction structure
+ *
+ *  @param[in,out] trans Pointer to a trans structure
+ */
+static void coap_server_trans_double_timeout(coap_server_trans_t *trans)
+{
+    unsigned msec = 2 * ((trans->timeout.tv_sec * 1000)
+                      + (trans->timeout.tv_nsec / 1000000));
+    trans->timeout.tv_sec = msec / 1000;
+    trans->timeout.tv_nsec = (msec % 1000) * 1000000;
+    coap_log_debug("Timeout doubled to: %lu sec, %lu nsec", trans->timeout.tv_sec, trans->timeout.tv_nsec);
+}
+
+/**
+ *  @brief Initialise and start the acknowledgement timer in a transaction structure
+ *
+ *  @param[out] trans Pointer to a trans structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_trans_start_ack_timer(coap_server_trans_t *trans)
+{
+    trans->num_retrans = 0;
+    coap_server_trans_init_ack_timeout(trans);
+    return coap_server_trans_start_timer(trans);
+}
+
+/**
+ *  @brief Stop the acknowledgement timer in a transaction structure
+ *
+ *  @param[out] trans Pointer to a transaction structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_trans_stop_ack_timer(coap_server_trans_t *trans)
+{
+    trans->num_retrans = 0;
+    return coap_server_trans_stop_timer(trans);
+}
+
+/**
+ *  @brief Update the acknowledgement timer in a transaction structure
+ *
+ *  Increase and restart the acknowledgement timer in a transaction structure
+ *  and indicate if the maximum number of retransmits has been reached.
+ *
+ *  @param[in,out] trans Pointer to a trans structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_trans_update_ack_timer(coap_server_trans_t *trans)
+{
+    int ret = 0;
+
+    if (trans->num_retrans >= COAP_SERVER_MAX_RETRANSMIT)
+    {
+        return -ETIMEDOUT;
+    }
+    coap_server_trans_double_timeout(trans);
+    ret = coap_server_trans_start_timer(trans);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    trans->num_retrans++;
+    return 0;
+}
+
+#ifndef COAP_DTLS_EN
+
+/**
+ *  @brief Send all queued datagrams
+ *
+ *  The send batch is passed to sendmmsg until it has
+ *  been consumed. A datagram that cannot be sent is
+ *  dropped and relies on the normal retransmission
+ *  mechanism for recovery.
+ *
+ *  @param[in,out] server Pointer to a server structure
+ */
+static void coap_server_flush(coap_server_t *server)
+{
+    coap_server_dgram_t *dgram = NULL;
+    struct mmsghdr hdr[COAP_SERVER_BATCH_SIZE];
+    struct iovec iov[COAP_SERVER_BATCH_SIZE];
+#ifdef COAP_SERVER_STATS_EN
+    struct timespec start = {0};
+    struct timespec end = {0};
+#endif
+    unsigned i = 0;
+    int num = 0;
+
+    if (server->send_num == 0)
+    {
+        return;
+    }
+#ifdef COAP_SERVER_STATS_EN
+    clock_gettime(CLOCK_MONOTONIC, &start);
+#endif
+    memset(hdr, 0, sizeof(hdr));
+    for (i = 0; i < server->send_num; i++)
+    {
+        dgram = &server->send_batch[i];
+        iov[i].iov_base = (void *)dgram->data;
+        iov[i].iov_len = dgram->len;
+        hdr[i].msg_hdr.msg_name = &dgram->sin;
+        hdr[i].msg_hdr.msg_namelen = dgram->sin_len;
+        hdr[i].msg_hdr.msg_iov = &iov[i];
+        hdr[i].msg_hdr.msg_iovlen = 1;
+    }
+    i = 0;
+    while (i < server->send_num)
+    {
+        num = sendmmsg(server->sd, &hdr[i], server->send_num - i, 0);
+        if (num < 0)
+        {
+            /* skip the datagram that failed */
+            coap_log_warn("Failed to send to client: %s", strerror(errno));
+            i++;
+        }
+        else
+        {
+            i += num;
+        }
+    }
+    for (i = 0; i < server->send_num; i++)
+    {
+        dgram = &server->send_batch[i];
+        if (dgram->trans != NULL)
+        {
+            dgram->trans->resp_queued = 0;
+            dgram->trans = NULL;
+        }
+    }
+    server->send_num = 0;
+#ifdef COAP_SERVER_STATS_EN
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    coap_server_stats_record(server, COAP_SERVER_STAGE_FLUSH, &start, &end);
+#endif
+}
+
+/**
+ *  @brief Take the next datagram structure from the send batch
+ *
+ *  The send batch is flushed first if it is full.
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *
+ *  @returns Pointer to a datagram structure addressed to the client
+ */
+static coap_server_dgram_t *coap_server_trans_queue(coap_server_trans_t *trans)
+{
+    coap_server_dgram_t *dgram = NULL;
+    coap_server_t *server = trans->server;
+
+    if (server->send_num >= COAP_SERVER_BATCH_SIZE)
+    {
+        coap_server_flush(server);
+    }
+    dgram = &server->send_batch[server->send_num];
+    memcpy(&dgram->sin, &trans->client_sin, trans->client_sin_len);
+    dgram->sin_len = trans->client_sin_len;
+    dgram->data = dgram->buf;
+    dgram->trans = NULL;
+    return dgram;
+}
+
+#else  /* COAP_DTLS_EN */
+
+/**
+ *  @brief Send a formatted message over the DTLS session of a transaction structure
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in] buf Buffer containing the formatted message
+ *  @param[in] len Length of the formatted message
+ *
+ *  @returns Number of bytes sent or error code
+ *  @retval >0 Number of bytes sent
+ *  @retval <0 Error
+ */
+static ssize_t coap_server_trans_dtls_send(coap_server_trans_t *trans, const char *buf, size_t len)
+{
+    ssize_t num = 0;
+
+    errno = 0;
+    num = gnutls_record_send(trans->session, buf, len);
+    if (errno != 0)
+    {
+        return -errno;
+    }
+    if (num == 0)
+    {
+        return -ECONNRESET;
+    }
+    if (num == GNUTLS_E_AGAIN)
+    {
+        return -EAGAIN;
+    }
+    if (num < 0)
+    {
+        coap_log_error("Failed to send to client: %s", gnutls_strerror_name(num));
+        return -1;
+    }
+    return num;
+}
+
+#endif  /* !COAP_DTLS_EN */
+
+/**
+ *  @brief Send a message to the client
+ *
+ *  If DTLS is not enabled the message is formatted into the
+ *  send batch which is flushed before the server waits for
+ *  further events or when the batch is full.
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in] msg Pointer to a message structure
+ *
+ *  @returns Number of bytes sent or error code
+ *  @retval >0 Number of bytes sent
+ *  @retval <0 Error
+ */
+static ssize_t coap_server_trans_send(coap_server_trans_t *trans, coap_msg_t *msg)
+{
+#ifdef COAP_DTLS_EN
+    ssize_t num = 0;
+    char buf[COAP_MSG_MAX_BUF_LEN] = {0};
+
+    num = coap_msg_format(msg, buf, sizeof(buf));
+    if (num < 0)
+    {
+        return num;
+    }
+    num = coap_server_trans_dtls_send(trans, buf, num);
+    if (num < 0)
+    {
+        return num;
+    }
+#else
+    coap_server_dgram_t *dgram = NULL;
+    ssize_t num = 0;
+
+    dgram = coap_server_trans_queue(trans);
+    num = coap_msg_format(msg, dgram->buf, sizeof(dgram->buf));
+    if (num < 0)
+    {
+        return num;
+    }
+    dgram->len = num;
+    trans->server->send_num++;
+#endif
+    coap_server_trans_touch(trans);
+    coap_log_debug("Sent to address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+    return num;
+}
+
+/**
+ *  @brief Send the formatted response message in a transaction structure to the client
+ *
+ *  If DTLS is not enabled the send batch refers to the
+ *  formatted response message instead of copying it.
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *
+ *  @returns Number of bytes sent or error code
+ *  @retval >0 Number of bytes sent
+ *  @retval <0 Error
+ */
+static ssize_t coap_server_trans_send_resp_buf(coap_server_trans_t *trans)
+{
+#ifdef COAP_DTLS_EN
+    ssize_t num = 0;
+#else
+    coap_server_dgram_t *dgram = NULL;
+#endif
+
+    if (trans->resp_len == 0)
+    {
+        return -EINVAL;
+    }
+#ifdef COAP_DTLS_EN
+    num = coap_server_trans_dtls_send(trans, trans->resp_buf, trans->resp_len);
+    if (num < 0)
+    {
+        return num;
+    }
+#else
+    dgram = coap_server_trans_queue(trans);
+    dgram->data = trans->resp_buf;
+    dgram->len = trans->resp_len;
+    dgram->trans = trans;
+    trans->resp_queued = 1;
+    trans->server->send_num++;
+#endif
+    coap_server_trans_touch(trans);
+    coap_log_debug("Sent to address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+    return trans->resp_len;
+}
+
+/**
+ *  @brief Send a formatted message that is not held by a transaction structure to the client
+ *
+ *  If DTLS is not enabled the message is copied into the
+ *  send batch. The formatted response message in the
+ *  transaction structure is left untouched so that it can
+ *  still be retransmitted.
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in] buf Buffer containing the formatted message
+ *  @param[in] len Length of the formatted message
+ *
+ *  @returns Number of bytes sent or error code
+ *  @retval >0 Number of bytes sent
+ *  @retval <0 Error
+ */
+static ssize_t coap_server_trans_send_buf(coap_server_trans_t *trans, const char *buf, size_t len)
+{
+#ifdef COAP_DTLS_EN
+    ssize_t num = 0;
+
+    num = coap_server_trans_dtls_send(trans, buf, len);
+    if (num < 0)
+    {
+        return num;
+    }
+#else
+    coap_server_dgram_t *dgram = NULL;
+
+    if (len > sizeof(dgram->buf))
+    {
+        return -ENOSPC;
+    }
+    dgram = coap_server_trans_queue(trans);
+    memcpy(dgram->buf, buf, len);
+    dgram->len = len;
+    trans->server->send_num++;
+#endif
+    coap_server_trans_touch(trans);
+    coap_log_debug("Sent to address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+    return len;
+}
+
+/**
+ *  @brief Format a response message into a transaction structure
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in] msg Pointer to the response message
+ *
+ *  @returns Length of the formatted message or error code
+ *  @retval >0 Length of the formatted message
+ *  @retval <0 Error
+ */
+static ssize_t coap_server_trans_format_resp(coap_server_trans_t *trans, coap_msg_t *msg)
+{
+    ssize_t num = 0;
+
+    coap_server_trans_release_resp_buf(trans);
+    num = coap_msg_format(msg, trans->resp_buf, sizeof(trans->resp_buf));
+    if (num < 0)
+    {
+        return num;
+    }
+    trans->resp_len = num;
+    return num;
+}
+
+/**
+ *  @brief Send a notification to an observer
+ *
+ *  If DTLS is not enabled the notification is copied into
+ *  the send batch so notifications to many observers are
+ *  sent with few system calls.
+ *
+ *  @param[in,out] obs Pointer to an observer structure
+ *  @param[in] tmpl Buffer containing the notification formatted without a token
+ *  @param[in] tmpl_len Length of the formatted notification
+ *
+ *  @returns Number of bytes sent or error code
+ *  @retval >0 Number of bytes sent
+ *  @retval <0 Error
+ */
+static ssize_t coap_server_trans_send_notify(coap_server_obs_t *obs, const char *tmpl, size_t tmpl_len)
+{
+    coap_server_trans_t *trans = obs->trans;
+    unsigned msg_id = 0;
+#ifdef COAP_DTLS_EN
+    ssize_t num = 0;
+    char buf[COAP_MSG_MAX_BUF_LEN] = {0};
+
+    msg_id = coap_server_get_next_msg_id(trans->server);
+    num = coap_server_format_tmpl(tmpl, tmpl_len, COAP_MSG_NON, msg_id, obs->token, obs->token_len, buf, sizeof(buf));
+    if (num < 0)
+    {
+        return num;
+    }
+    num = coap_server_trans_dtls_send(trans, buf, num);
+    if (num < 0)
+    {
+        return num;
+    }
+#else
+    coap_server_dgram_t *dgram = NULL;
+    ssize_t num = 0;
+
+    msg_id = coap_server_get_next_msg_id(trans->server);
+    dgram = coap_server_trans_queue(trans);
+    num = coap_server_format_tmpl(tmpl, tmpl_len, COAP_MSG_NON, msg_id, obs->token, obs->token_len, dgram->buf, sizeof(dgram->buf));
+    if (num < 0)
+    {
+        return num;
+    }
+    dgram->len = num;
+    trans->server->send_num++;
+#endif
+    obs->msg_id = msg_id;
+    obs->notified = 1;
+    coap_log_debug("Sent notification to address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+    return num;
+}
+
+/**
+ *  @brief Handle a format error in a received message
+ *
+ *  Special handling for the case where a received
+ *  message could not be parsed due to a format error.
+ *  Extract enough information from the received message
+ *  to form a reset message.
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in] buf Buffer containing the message
+ *  @param[in] len length of the buffer
+ */
+static void coap_server_trans_handle_format_error(coap_server_trans_t *trans, char *buf, unsigned len)
+{
+    coap_msg_t msg = {0};
+    unsigned msg_id = 0;
+    unsigned type = 0;
+    int ret = 0;
+
+    /* extract enough information to form a reset message */
+    ret = coap_msg_parse_type_msg_id(buf, len, &type, &msg_id);
+    if ((ret == 0) && (type == COAP_MSG_CON))
+    {
+        coap_msg_create(&msg);
+        ret = coap_msg_set_type(&msg, COAP_MSG_RST);
+        if (ret < 0)
+        {
+            coap_msg_destroy(&msg);
+            return;
+        }
+        ret = coap_msg_set_msg_id(&msg, msg_id);
+        if (ret < 0)
+        {
+            coap_msg_destroy(&msg);
+            return;
+        }
+        coap_server_trans_send(trans, &msg);
+        coap_msg_destroy(&msg);
+    }
+}
+
+/**
+ *  @brief Receive a message from the client
+ *
+ *  The message is parsed as a view into the buffer
+ *  so the buffer must outlive the message structure.
+ *
+ *  If DTLS is not enabled the datagram has already been
+ *  received into the receive batch by coap_server_accept
+ *  and the message is parsed as a view into the batch
+ *  instead of the supplied buffer. The batch is not
+ *  refilled until the current datagram has been handled.
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in] msg Pointer to a message structure
+ *  @param[out] buf Pointer to a buffer to receive the message
+ *  @param[in] len Length of the buffer
+ *
+ *  @returns Number of bytes received or error code
+ *  @retval >0 Number of bytes received
+ *  @retval <0 Error
+ */
+static ssize_t coap_server_trans_recv(coap_server_trans_t *trans, coap_msg_t *msg, char *buf, size_t len)
+{
+#ifdef COAP_DTLS_EN
+    gnutls_alert_description_t alert = 0;
+    const char *alert_name = NULL;
+#else
+    coap_server_dgram_t *dgram = NULL;
+#endif
+    ssize_t num = 0;
+    ssize_t ret = 0;
+
+#ifdef COAP_DTLS_EN
+    errno = 0;
+    num = gnutls_record_recv(trans->session, buf, len);
+    if (errno != 0)
+    {
+        return -errno;
+    }
+    if ((num == GNUTLS_E_FATAL_ALERT_RECEIVED)
+     || (num == GNUTLS_E_WARNING_ALERT_RECEIVED)
+     || (num == 0))
+    {
+        alert = gnutls_alert_get(trans->session);
+        alert_name = gnutls_alert_get_name(alert);
+        if (num == GNUTLS_E_FATAL_ALERT_RECEIVED)
+            coap_log_error("Received DTLS alert from the client: %s", alert_name);
+        else if (num == GNUTLS_E_WARNING_ALERT_RECEIVED)
+            coap_log_warn("Received DTLS alert from the client: %s", alert_name);
+        else
+            coap_log_info("Received DTLS alert from the client: %s", alert_name);
+        return -ECONNRESET;
+    }
+    if (num == GNUTLS_E_AGAIN)
+    {
+        return -EAGAIN;
+    }
+    if (num < 0)
+    {
+        coap_log_error("Failed to receive from client: %s", gnutls_strerror_name(num));
+        return -1;
+    }
+#else
+    /* the datagram has already been received into the batch */
+    dgram = trans->server->recv_cur;
+    if ((dgram == NULL)
+     || (dgram->sin_len != trans->client_sin_len)
+     || (memcmp(&dgram->sin, &trans->client_sin, dgram->sin_len) != 0))
+    {
+        return -EINVAL;
+    }
+    buf = dgram->buf;
+    num = dgram->len;
+#endif
+    coap_server_stats_end(trans->server, COAP_SERVER_STAGE_RECV);
+    ret = coap_msg_parse_view(msg, buf, num);
+    if (ret < 0)
+    {
+        if (ret == -EBADMSG)
+        {
+            coap_server_trans_handle_format_error(trans, buf, num);
+        }
+        return ret;
+    }
+    coap_server_stats_end(trans->server, COAP_SERVER_STAGE_PARSE);
+    coap_server_trans_touch(trans);
+    coap_log_debug("Received from address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+    return num;
+}
+
+/**
+ *  @brief Reject a received confirmable message
+ *
+ *  Send a reset message to the client.
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in] msg Pointer to a message structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_trans_reject_con(coap_server_trans_t *trans, coap_msg_t *msg)
+{
+    coap_msg_t rej = {0};
+    ssize_t num = 0;
+    int ret = 0;
+
+    coap_log_info("Rejecting confirmable message from address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+    coap_msg_create(&rej);
+    ret = coap_msg_set_type(&rej, COAP_MSG_RST);
+    if (ret < 0)
+    {
+        coap_msg_destroy(&rej);
+        return ret;
+    }
+    ret = coap_msg_set_msg_id(&rej, coap_msg_get_msg_id(msg));
+    if (ret < 0)
+    {
+        coap_msg_destroy(&rej);
+        return ret;
+    }
+    num = coap_server_trans_send(trans, &rej);
+    coap_msg_destroy(&rej);
+    if (num < 0)
+    {
+        return num;
+    }
+    return 0;
+}
+
+/**
+ *  @brief Reject a received non-confirmable message
+ *
+ *  @param[in] trans Pointer to a transaction structure
+ *  @param[in] msg Pointer to a message structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ */
+static int coap_server_trans_reject_non(coap_server_trans_t *trans, coap_msg_t *msg)
+{
+    coap_log_info("Rejecting non-confirmable message from address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+    return 0;
+}
+
+/**
+ *  @brief Reject a received acknowledgement message
+ *
+ *  @param[in] trans Pointer to a transaction structure
+ *  @param[in] msg Pointer to a message structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ */
+static int coap_server_trans_reject_ack(coap_server_trans_t *trans, coap_msg_t *msg)
+{
+    coap_log_info("Rejecting acknowledgement message from address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+    return 0;
+}
+
+/**
+ *  @brief Reject a received reset message
+ *
+ *  @param[in] trans Pointer to a transaction structure
+ *  @param[in] msg Pointer to a message structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ */
+static int coap_server_trans_reject_reset(coap_server_trans_t *trans, coap_msg_t *msg)
+{
+    coap_log_info("Rejecting reset message from address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+    return 0;
+}
+
+/**
+ *  @brief Reject a received message
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in] msg Pointer to a message structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_trans_reject(coap_server_trans_t *trans, coap_msg_t *msg)
+{
+    if (coap_msg_get_type(msg) == COAP_MSG_CON)
+    {
+        return coap_server_trans_reject_con(trans, msg);
+    }
+    else if (coap_msg_get_type(msg) == COAP_MSG_NON)
+    {
+        return coap_server_trans_reject_non(trans, msg);
+    }
+    else if (coap_msg_get_type(msg) == COAP_MSG_ACK)
+    {
+        return coap_server_trans_reject_ack(trans, msg);
+    }
+    else if (coap_msg_get_type(msg) == COAP_MSG_RST)
+    {
+        return coap_server_trans_reject_reset(trans, msg);
+    }
+    return 0;  /* should never arrive here */
+}
+
+/**
+ *  @brief Handle a received message containing a bad option
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[out] send_msg Pointer to the send message
+ *  @param[in] op_num Option number of the bad option
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_trans_handle_bad_option(coap_server_trans_t *trans, coap_msg_t *send_msg, unsigned op_num)
+{
+    char payload[COAP_SERVER_DIAG_PAYLOAD_LEN] = {0};
+    int ret = 0;
+
+    coap_log_info("Found bad option number %u in message from address %s and port %u", op_num, trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+    coap_log_info("Sending 'Bad Option' response to address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+    ret = coap_msg_set_code(send_msg, COAP_MSG_CLIENT_ERR, COAP_MSG_BAD_OPTION);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    snprintf(payload, sizeof(payload), "Bad option number: %u", op_num);
+    ret = coap_msg_set_payload(send_msg, payload, strlen(payload));
+    if (ret < 0)
+    {
+        return ret;
+    }
+    return 0;
+}
+
+/**
+ *  @brief Send an acknowledgement message to the client
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in] msg Pointer to a message structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_trans_send_ack(coap_server_trans_t *trans, coap_msg_t *msg)
+{
+    coap_msg_t ack = {0};
+    ssize_t num = 0;
+    int ret = 0;
+
+    coap_log_info("Acknowledging confirmable message from address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+    coap_msg_create(&ack);
+    ret = coap_msg_set_type(&ack, COAP_MSG_ACK);
+    if (ret < 0)
+    {
+        coap_msg_destroy(&ack);
+        return ret;
+    }
+    ret = coap_msg_set_msg_id(&ack, coap_msg_get_msg_id(msg));
+    if (ret < 0)
+    {
+        coap_msg_destroy(&ack);
+        return ret;
+    }
+    num = coap_server_trans_send(trans, &ack);
+    coap_msg_destroy(&ack);
+    if (num < 0)
+    {
+        return num;
+    }
+    return 0;
+}
+
+/**
+ *  @brief Handle an acknowledgement timeout
+ *
+ *  Update the acknowledgement timer in the transaction structure
+ *  and if the maximum number of retransmits has not been reached
+ *  then retransmit the last response to the client.
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_trans_handle_ack_timeout(coap_server_trans_t *trans)
+{
+    ssize_t num = 0;
+    int ret = 0;
+
+    coap_log_debug("Transaction expired for address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+    ret = coap_server_trans_update_ack_timer(trans);
+    if (ret == 0)
+    {
+        coap_log_debug("Retransmitting to address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+        coap_server_stats_inc(trans->server, num_retrans);
+        num = coap_server_trans_send_resp_buf(trans);
+        if (num < 0)
+        {
+            return num;
+        }
+    }
+    else if (ret == -ETIMEDOUT)
+    {
+        coap_log_debug("Stopped retransmitting to address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+        coap_log_info("No acknowledgement received from address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+        coap_server_stats_inc(trans->server, num_timeout);
+        coap_server_trans_destroy(trans);
+        ret = 0;
+    }
+    return ret;
+}
+
+/**
+ *  @brief Initialise a transaction structure
+ *
+ *  The transaction structure must have been taken from the
+ *  free list by coap_server_find_empty_trans. On failure it
+ *  is returned to the free list.
+ *
+ *  @param[out] trans Pointer to a transaction structure
+ *  @param[in] server Pointer to a server structure
+ *  @param[in] client_sin Pointer to a socket structure
+ *  @param[in] client_sin_len Length of the socket structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_trans_create(coap_server_trans_t *trans, coap_server_t *server, coap_ipv_sockaddr_in_t *client_sin, socklen_t client_sin_len)
+{
+    const char *p = NULL;
+#ifdef COAP_DTLS_EN
+    int ret = 0;
+#endif
+
+    memset(trans, 0, sizeof(coap_server_trans_t));
+    trans->active = 1;
+    trans->last_use = time(NULL);
+    memcpy(&trans->client_sin, client_sin, client_sin_len);
+    trans->client_sin_len = client_sin_len;
+    p = inet_ntop(COAP_IPV_AF_INET, &client_sin->COAP_IPV_SIN_ADDR, trans->client_addr, sizeof(trans->client_addr));
+    if (p == NULL)
+    {
+        memset(trans, 0, sizeof(coap_server_trans_t));
+        coap_server_trans_release(server, trans);
+        return -errno;
+    }
+    coap_msg_create(&trans->req);
+    coap_msg_create(&trans->resp);
+    trans->server = server;
+    coap_server_trans_link(trans);
+#ifdef COAP_DTLS_EN
+    ret = coap_server_trans_dtls_create(trans);
+    if (ret < 0)
+    {
+        coap_server_trans_unlink(trans);
+        coap_msg_destroy(&trans->resp);
+        coap_msg_destroy(&trans->req);
+        memset(trans, 0, sizeof(coap_server_trans_t));
+        coap_server_trans_release(server, trans);
+        return ret;
+    }
+#endif
+    coap_log_debug("Created transaction for address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+    return 0;
+}
+
+/**
+ *  @brief Generate a response for the next block in a blockwise transfer
+ *
+ *  This function will choose the smaller of the block1_size
+ *  value passed to the coap_server_trans_handle_blockwise
+ *  function by the application and any value specified in
+ *  the request message and similarly for the block2_size value.
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in] req Pointer to the request message
+ *  @param[out] resp Pointer to the response message
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_trans_handle_next_block(coap_server_trans_t *trans, coap_msg_t *req, coap_msg_t *resp)
+{
+    coap_msg_success_t code_detail = 0;
+    unsigned payload_len = 0;
+    unsigned block1_size = 0;
+    unsigned block2_size = 0;
+    unsigned block1_more = 0;
+    unsigned block2_more = 0;
+    unsigned block1_num = 0;
+    unsigned block2_num = 0;
+    unsigned block_len = 0;
+    size_t block1_next = 0;
+    size_t block2_next = 0;
+    char block_uri[COAP_MSG_OP_URI_PATH_MAX_LEN + 1] = {0};
+    char block_val[COAP_MSG_OP_MAX_BLOCK_VAL_LEN] = {0};
+    char block_buf[COAP_MSG_OP_MAX_BLOCK_SIZE + 1] = {0};
+    char *payload = NULL;
+    ssize_t num = 0;
+    int block1_szx = -1;
+    int block2_szx = -1;
+    int ret = 0;
+
+    /* allow the client to resize the blocks */
+    ret = coap_msg_parse_block_op(&block1_num, &block1_more, &block1_size, req, COAP_MSG_BLOCK1);
+    if (ret < 0)
+    {
+        coap_log_info("Unable to parse block1 option in message from address %s and port %u",
+                      trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+        coap_server_trans_clear_blockwise(trans);
+        return coap_msg_set_code(resp, COAP_MSG_CLIENT_ERR, COAP_MSG_BAD_REQ);
+    }
+    if ((ret == 0) && (block1_size < trans->block1_size))
+    {
+        trans->block1_size = block1_size;
+    }
+    ret = coap_msg_parse_block_op(&block2_num, &block2_more, &block2_size, req, COAP_MSG_BLOCK2);
+    if (ret < 0)
+    {
+        coap_log_info("Unable to parse block2 option in message from address %s and port %u",
+                      trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+        coap_server_trans_clear_blockwise(trans);
+        return coap_msg_set_code(resp, COAP_MSG_CLIENT_ERR, COAP_MSG_BAD_REQ);
+    }
+    if ((ret == 0) && (block2_size < trans->block2_size))
+    {
+        trans->block2_size = block2_size;
+    }
+    coap_msg_uri_path_to_str(req, block_uri, sizeof(block_uri));
+    if ((trans->type == COAP_SERVER_TRANS_BLOCKWISE_GET)
+     || (trans->type == COAP_SERVER_TRANS_BLOCKWISE_PUT2)
+     || (trans->type == COAP_SERVER_TRANS_BLOCKWISE_POST2))
+    {
+        coap_log_debug("Handling block with start byte index %u for blockwise transfer", trans->block2_next);
+        /* check for continuity between the current and previous blocks
+         * the client may not include a block2 option in the first message
+         * but must include a block2 option in subsequent messages
+         * a GET body can be read again so blocks may be requested in any
+         * order which allows the client to keep several requests in flight
+         */
+        block2_next = block2_num * trans->block2_size;  /* start byte index according to the client or for the first block */
+        if ((trans->type == COAP_SERVER_TRANS_BLOCKWISE_GET)
+         && ((block2_next < trans->body_end) || (trans->block_read != NULL)))
+        {
+            trans->block2_next = block2_next;
+        }
+        if (((trans->type == COAP_SERVER_TRANS_BLOCKWISE_GET) && (coap_msg_get_code_detail(req) != COAP_MSG_GET))
+         || ((trans->type == COAP_SERVER_TRANS_BLOCKWISE_PUT2) && (coap_msg_get_code_detail(req) != COAP_MSG_PUT))
+         || ((trans->type == COAP_SERVER_TRANS_BLOCKWISE_POST2) && (coap_msg_get_code_detail(req) != COAP_MSG_POST))
+         || (strcmp(block_uri, trans->block_uri) != 0)
+         || (block2_next != trans->block2_next))
+        {
+            coap_log_info("Unexpected request message during blockwise transfer from address %s and port %u",
+                          trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+            coap_server_trans_clear_blockwise(trans);
+            return coap_msg_set_code(resp, COAP_MSG_CLIENT_ERR, COAP_MSG_BAD_REQ);
+        }
+        ret = coap_msg_op_calc_block_szx(trans->block2_size);
+        if (ret < 0)
+        {
+            coap_log_warn("Failed to calculate block size exponent from block2 size %u", trans->block2_size);
+            coap_server_trans_clear_blockwise(trans);
+            return ret;
+        }
+        block2_szx = ret;
+        if (trans->block_read != NULL)
+        {
+            /* ask for one byte more than a block to find out if another block follows */
+            num = (*trans->block_read)(trans, trans->block2_next, block_buf, trans->block2_size + 1, trans->block_data);
+            if (num < 0)
+            {
+                coap_log_warn("Call to blockwise read callback function failed");
+                coap_server_trans_clear_blockwise(trans);
+                return coap_msg_set_code(resp, COAP_MSG_SERVER_ERR, COAP_MSG_INT_SERVER_ERR);
+            }
+            if ((num == 0) && (trans->block2_next > 0))
+            {
+                coap_log_info("Block requested beyond the end of the body in blockwise transfer from address %s and port %u",
+                              trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+                coap_server_trans_clear_blockwise(trans);
+                return coap_msg_set_code(resp, COAP_MSG_CLIENT_ERR, COAP_MSG_BAD_REQ);
+            }
+            payload = block_buf;
+            block2_more = 0;
+            payload_len = num;
+            if (payload_len > trans->block2_size)
+            {
+                block2_more = 1;
+                payload_len = trans->block2_size;
+            }
+        }
+        else
+        {
+            payload = trans->body + trans->block2_next;
+            block2_more = 1;
+            payload_len = trans->block2_size;
+            if (trans->block2_next + trans->block2_size > trans->body_end)
+            {
+                block2_more = 0;
+                payload_len = trans->body_end - trans->block2_next;
+            }
+        }
+        block2_num = coap_msg_block_start_to_num(trans->block2_next, block2_szx);
+        ret = coap_msg_op_format_block_val(block_val, sizeof(block_val), block2_num, block2_more, trans->block2_size);
+        if (ret < 0)
+        {
+            coap_log_warn("Failed to format block2 option value, num %u, more %u, size %u", block2_num, block2_more, trans->block2_size);
+            coap_server_trans_clear_blockwise(trans);
+            return ret;
+        }
+        block_len = ret;
+        ret = coap_msg_add_op(resp, COAP_MSG_BLOCK2, block_len, block_val);
+        if (ret < 0)
+        {
+            coap_server_trans_clear_blockwise(trans);
+            return ret;
+        }
+        ret = coap_msg_set_payload(resp, payload, payload_len);
+        if (ret < 0)
+        {
+            coap_server_trans_clear_blockwise(trans);
+            return ret;
+        }
+        trans->block2_next += payload_len;
+        code_detail = COAP_MSG_CONTINUE;
+        if (!block2_more)
+        {
+            if (trans->type == COAP_SERVER_TRANS_BLOCKWISE_GET)
+            {
+                coap_log_info("Completed GET library-level blockwise transfer with address %s and port %u",
+                              trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+                code_detail = COAP_MSG_CONTENT;
+            }
+            else if (trans->type == COAP_SERVER_TRANS_BLOCKWISE_PUT2)
+            {
+                coap_log_info("Completed PUT library-level blockwise transfer with address %s and port %u",
+                              trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+                code_detail = trans->block_detail;
+            }
+            else
+            {
+                coap_log_info("Completed POST library-level blockwise transfer with address %s and port %u",
+                              trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+                code_detail = trans->block_detail;
+            }
+            coap_server_trans_clear_blockwise(trans);
+        }
+        return coap_msg_set_code(resp, COAP_MSG_SUCCESS, code_detail);
+    }
+    else if ((trans->type == COAP_SERVER_TRANS_BLOCKWISE_PUT1)
           || (trans->type == COAP_SERVER_TRANS_BLOCKWISE_POST1))
     {
-        coap_log_debug("Handling block with start byte index %u for blockwise transfer", trans->block1_next);
-        /* check for continuity between the current and previous blocks */
-        block1_next = block1_num * trans->block1_size;  /* start byte index according to the client */
-        if (((trans->type == COAP_SERVER_TRANS_BLOCKWISE_PUT1) && (coap_msg_get_code_detail(req) != COAP_MSG_PUT))
-         || ((trans->type == COAP_SERVER_TRANS_BLOCKWISE_POST1) && (coap_msg_get_code_detail(req) != COAP_MSG_POST))
-         || (strcmp(block_uri, trans->block_uri) != 0))
-        {
-            coap_log_info("Unexpected request message during blockwise transfer from address %s and port %u",
-                          trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
-            coap_server_trans_clear_blockwise(trans);
-            return coap_msg_set_code(resp, COAP_MSG_CLIENT_ERR, COAP_MSG_BAD_REQ);
-        }
-        if (block1_next != trans->block1_next)
-        {
-            coap_log_info("Out-of-sequence block received from address %s and port %u",
-                          trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
-            coap_server_trans_clear_blockwise(trans);
-            return coap_msg_set_code(resp, COAP_MSG_CLIENT_ERR, COAP_MSG_INCOMPLETE);
-        }
-        if (coap_msg_get_payload(req) == NULL)
-        {
-            coap_log_info("Missing payload in request message during blockwise transfer from address %s and port %u",
-                          trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
-            coap_server_trans_clear_blockwise(trans);
-            return coap_msg_set_code(resp, COAP_MSG_CLIENT_ERR, COAP_MSG_BAD_REQ);
-        }
-        ret = coap_msg_op_calc_block_szx(trans->block1_size);
-        if (ret < 0)
-        {
-            coap_log_warn("Failed to calculate block size exponent from block1 size %u", trans->block1_size);
-            coap_server_trans_clear_blockwise(trans);
-            return ret;
-        }
-        block1_szx = ret;
-        payload_len = coap_msg_get_payload_len(req);
-        if (trans->block1_next + payload_len > trans->body_len)
+        coap_log_debug("Handling block with start byte index %u for blockwise transfer", trans->block1_next);
+        /* check for continuity between the current and previous blocks */
+        block1_next = block1_num * trans->block1_size;  /* start byte index according to the client */
+        if (((trans->type == COAP_SERVER_TRANS_BLOCKWISE_PUT1) && (coap_msg_get_code_detail(req) != COAP_MSG_PUT))
+         || ((trans->type == COAP_SERVER_TRANS_BLOCKWISE_POST1) && (coap_msg_get_code_detail(req) != COAP_MSG_POST))
+         || (strcmp(block_uri, trans->block_uri) != 0))
+        {
+            coap_log_info("Unexpected request message during blockwise transfer from address %s and port %u",
+                          trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+            coap_server_trans_clear_blockwise(trans);
+            return coap_msg_set_code(resp, COAP_MSG_CLIENT_ERR, COAP_MSG_BAD_REQ);
+        }
+        if (block1_next != trans->block1_next)
+        {
+            coap_log_info("Out-of-sequence block received from address %s and port %u",
+                          trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+            coap_server_trans_clear_blockwise(trans);
+            return coap_msg_set_code(resp, COAP_MSG_CLIENT_ERR, COAP_MSG_INCOMPLETE);
+        }
+        if (coap_msg_get_payload(req) == NULL)
+        {
+            coap_log_info("Missing payload in request message during blockwise transfer from address %s and port %u",
+                          trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+            coap_server_trans_clear_blockwise(trans);
+            return coap_msg_set_code(resp, COAP_MSG_CLIENT_ERR, COAP_MSG_BAD_REQ);
+        }
+        ret = coap_msg_op_calc_block_szx(trans->block1_size);
+        if (ret < 0)
+        {
+            coap_log_warn("Failed to calculate block size exponent from block1 size %u", trans->block1_size);
+            coap_server_trans_clear_blockwise(trans);
+            return ret;
+        }
+        block1_szx = ret;
+        payload_len = coap_msg_get_payload_len(req);
+        if ((trans->block_write == NULL) && (trans->block1_next + payload_len > trans->body_len))
+        {
+            coap_log_info("Insufficient buffer size in blockwise transfer from address %s and port %u",
+                          trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+            coap_server_trans_clear_blockwise(trans);
+            return coap_msg_set_code(resp, COAP_MSG_CLIENT_ERR, COAP_MSG_REQ_ENT_TOO_LARGE);
+        }
+        block1_num = coap_msg_block_start_to_num(trans->block1_next, block1_szx);
+        ret = coap_msg_op_format_block_val(block_val, sizeof(block_val), block1_num, block1_more, trans->block1_size);
+        if (ret < 0)
+        {
+            coap_log_warn("Failed to format block2 option value, num %d, size %d", block1_num, trans->block1_size);
+            coap_server_trans_clear_blockwise(trans);
+            return ret;
+        }
+        block_len = ret;
+        ret = coap_msg_add_op(resp, COAP_MSG_BLOCK1, block_len, block_val);
+        if (ret < 0)
+        {
+            coap_server_trans_clear_blockwise(trans);
+            return ret;
+        }
+        if (trans->block_write != NULL)
+        {
+            ret = (*trans->block_write)(trans, trans->block1_next, coap_msg_get_payload(req), payload_len, block1_more, trans->block_data);
+            if (ret < 0)
+            {
+                coap_log_warn("Call to blockwise write callback function failed");
+                coap_server_trans_clear_blockwise(trans);
+                if (ret == -ENOSPC)
+                {
+                    return coap_msg_set_code(resp, COAP_MSG_CLIENT_ERR, COAP_MSG_REQ_ENT_TOO_LARGE);
+                }
+                return coap_msg_set_code(resp, COAP_MSG_SERVER_ERR, COAP_MSG_INT_SERVER_ERR);
+            }
+        }
+        else
+        {
+            memcpy(trans->body + trans->block1_next, coap_msg_get_payload(req), payload_len);
+        }
+        trans->block1_next += payload_len;
+        trans->body_end += payload_len;
+        code_detail = COAP_MSG_CONTINUE;
+        if (!block1_more)
+        {
+            /* copy received data to the application's buffer */
+            if (trans->type == COAP_SERVER_TRANS_BLOCKWISE_PUT1)
+            {
+                coap_log_info("Completed PUT library-level blockwise transfer with address %s and port %u",
+                              trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+            }
+            else
+            {
+                coap_log_info("Completed POST library-level blockwise transfer with address %s and port %u",
+                              trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+            }
+            /* allow the application to process the received data */
+            /* and generate a body for the response */
+            ret = (*trans->block_rx)(trans, req, resp);
+            if (ret < 0)
+            {
+                coap_log_warn("Call to blockwise receive callback function failed");
+                coap_server_trans_clear_blockwise(trans);
+                return ret;
+            }
+            if (coap_msg_get_code_class(resp) != COAP_MSG_SUCCESS)
+            {
+                /* return the response generated by the call to trans->block_rx */
+                coap_server_trans_clear_blockwise(trans);
+                return 0;
+            }
+            code_detail = coap_msg_get_code_detail(resp);
+            if (((trans->block_write == NULL) && (trans->body_end > 0))
+             || ((trans->block_write != NULL) && (trans->block_read != NULL)))
+            {
+                if (trans->type == COAP_SERVER_TRANS_BLOCKWISE_PUT1)
+                {
+                    trans->type = COAP_SERVER_TRANS_BLOCKWISE_PUT2;
+                }
+                else
+                {
+                    trans->type = COAP_SERVER_TRANS_BLOCKWISE_POST2;
+                }
+                trans->block_detail = coap_msg_get_code_detail(resp);
+                /* the response contains a body as well as the request
+                 * handle this block twice:
+                 *   this time to process the request payload
+                 *   next time to generate the response
+                 */
+                return coap_server_trans_handle_next_block(trans, req, resp);
+            }
+            coap_server_trans_clear_blockwise(trans);
+        }
+        return coap_msg_set_code(resp, COAP_MSG_SUCCESS, code_detail);
+    }
+    return 0;
+}
+
+int coap_server_trans_handle_blockwise(coap_server_trans_t *trans,
+                                       coap_msg_t *req,
+                                       coap_msg_t *resp,
+                                       unsigned block1_size,
+                                       unsigned block2_size,
+                                       char *body,
+                                       size_t body_len,
+                                       coap_server_trans_handler_t block_rx)
+{
+    unsigned code_detail = 0;
+    int ret = 0;
+
+    coap_server_trans_clear_blockwise(trans);
+    if (block1_size > 0)
+    {
+        ret = coap_msg_op_calc_block_szx(block1_size);
+        if (ret < 0)
+        {
+            return -EINVAL;
+        }
+    }
+    if (block2_size > 0)
+    {
+        ret = coap_msg_op_calc_block_szx(block2_size);
+        if (ret < 0)
+        {
+            return -EINVAL;
+        }
+    }
+    if (body_len > coap_mem_large_get_len())
+    {
+        return -ENOSPC;
+    }
+    trans->body = coap_mem_large_alloc(body_len);
+    if (trans->body == NULL)
+    {
+        return -ENOMEM;
+    }
+    trans->body_len = coap_mem_large_get_len();
+    memset(trans->body, 0, trans->body_len);
+    code_detail = coap_msg_get_code_detail(req);
+    if (code_detail == COAP_MSG_GET)
+    {
+        coap_log_info("Starting new GET library-level blockwise transfer with address %s and port %u",
+                      trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+        trans->type = COAP_SERVER_TRANS_BLOCKWISE_GET;
+        memcpy(trans->body, body, body_len);
+        trans->body_end = body_len;
+    }
+    else if ((code_detail == COAP_MSG_PUT)
+          || (code_detail == COAP_MSG_POST))
+    {
+        if (block_rx == NULL)
+        {
+            coap_server_trans_clear_blockwise(trans);
+            return -EINVAL;
+        }
+        if (code_detail == COAP_MSG_PUT)
+        {
+            coap_log_info("Starting new PUT library-level blockwise transfer with address %s and port %u",
+                          trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+            trans->type = COAP_SERVER_TRANS_BLOCKWISE_PUT1;
+        }
+        else
+        {
+            coap_log_info("Starting new POST library-level blockwise transfer with address %s and port %u",
+                          trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+            trans->type = COAP_SERVER_TRANS_BLOCKWISE_POST1;
+        }
+        memset(trans->body, 0, trans->body_len);
+        trans->body_end = 0;
+    }
+    else
+    {
+        coap_log_warn("Request method unsupported in blockwise transfer with address %s and port %u",
+                      trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+        coap_server_trans_clear_blockwise(trans);
+        return coap_msg_set_code(resp, COAP_MSG_SERVER_ERR, COAP_MSG_NOT_IMPL);
+    }
+    trans->block1_size = block1_size;
+    trans->block2_size = block2_size;
+    coap_msg_uri_path_to_str(req, trans->block_uri, sizeof(trans->block_uri));
+    trans->block_rx = block_rx;
+    return coap_server_trans_handle_next_block(trans, req, resp);
+}
+
+int coap_server_trans_handle_blockwise_stream(coap_server_trans_t *trans,
+                                              coap_msg_t *req,
+                                              coap_msg_t *resp,
+                                              unsigned block1_size,
+                                              unsigned block2_size,
+                                              coap_server_trans_block_read_t block_read,
+                                              coap_server_trans_block_write_t block_write,
+                                              coap_server_trans_handler_t block_rx,
+                                              void *data)
+{
+    unsigned code_detail = 0;
+    int ret = 0;
+
+    coap_server_trans_clear_blockwise(trans);
+    if (block1_size > 0)
+    {
+        ret = coap_msg_op_calc_block_szx(block1_size);
+        if (ret < 0)
+        {
+            return -EINVAL;
+        }
+    }
+    if (block2_size > 0)
+    {
+        ret = coap_msg_op_calc_block_szx(block2_size);
+        if (ret < 0)
+        {
+            return -EINVAL;
+        }
+    }
+    code_detail = coap_msg_get_code_detail(req);
+    if (code_detail == COAP_MSG_GET)
+    {
+        if (block_read == NULL)
+        {
+            return -EINVAL;
+        }
+        coap_log_info("Starting new GET streaming library-level blockwise transfer with address %s and port %u",
+                      trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+        trans->type = COAP_SERVER_TRANS_BLOCKWISE_GET;
+    }
+    else if ((code_detail == COAP_MSG_PUT)
+          || (code_detail == COAP_MSG_POST))
+    {
+        if ((block_write == NULL) || (block_rx == NULL))
+        {
+            return -EINVAL;
+        }
+        if (code_detail == COAP_MSG_PUT)
+        {
+            coap_log_info("Starting new PUT streaming library-level blockwise transfer with address %s and port %u",
+                          trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+            trans->type = COAP_SERVER_TRANS_BLOCKWISE_PUT1;
+        }
+        else
+        {
+            coap_log_info("Starting new POST streaming library-level blockwise transfer with address %s and port %u",
+                          trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+            trans->type = COAP_SERVER_TRANS_BLOCKWISE_POST1;
+        }
+    }
+    else
+    {
+        coap_log_warn("Request method unsupported in blockwise transfer with address %s and port %u",
+                      trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+        return coap_msg_set_code(resp, COAP_MSG_SERVER_ERR, COAP_MSG_NOT_IMPL);
+    }
+    trans->block1_size = block1_size;
+    trans->block2_size = block2_size;
+    coap_msg_uri_path_to_str(req, trans->block_uri, sizeof(trans->block_uri));
+    trans->block_rx = block_rx;
+    trans->block_read = block_read;
+    trans->block_write = block_write;
+    trans->block_data = data;
+    return coap_server_trans_handle_next_block(trans, req, resp);
+}
+
+#ifdef COAP_DTLS_EN
+
+/****************************************************************************************************
+ *                                         coap_server_dtls                                         *
+ ****************************************************************************************************/
+
+/**
+ *  @brief Initialise the DTLS members of a server structure
+ *
+ *  @param[out] server Pointer to a server structure
+ *  @param[in] key_file_name String containing the DTLS key file name
+ *  @param[in] cert_file_name String containing the DTLS certificate file name
+ *  @param[in] trust_file_name String containing the DTLS trust file name
+ *  @param[in] crl_file_name String containing the DTLS certificate revocation list file name
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval -1 Error
+ */
+static int coap_server_dtls_create(coap_server_t *server,
+                                   const char *key_file_name,
+                                   const char *cert_file_name,
+                                   const char *trust_file_name,
+                                   const char *crl_file_name)
+{
+    int ret = 0;
+
+    ret = gnutls_global_init();
+    if (ret != GNUTLS_E_SUCCESS)
+    {
+        coap_log_error("Failed to initialise DTLS library: %s", gnutls_strerror_name(ret));
+        return -1;
+    }
+    ret = gnutls_certificate_allocate_credentials(&server->cred);
+    if (ret != GNUTLS_E_SUCCESS)
+    {
+        gnutls_global_deinit();
+        coap_log_error("Failed to allocate DTLS credentials: %s", gnutls_strerror_name(ret));
+        return -1;
+    }
+    if ((trust_file_name != NULL) && (strlen(trust_file_name) != 0))
+    {
+        ret = gnutls_certificate_set_x509_trust_file(server->cred, trust_file_name, GNUTLS_X509_FMT_PEM);
+        if (ret <= 0)
+        {
+            if (ret < 0)
+                coap_log_error("Failed to assign X.509 trust file to DTLS credentials: %s", gnutls_strerror_name(ret));
+            else
+                coap_log_error("Failed to assign X.509 trust file to DTLS credentials");
+            gnutls_certificate_free_credentials(server->cred);
+            gnutls_global_deinit();
+            return -1;
+        }
+    }
+    if ((crl_file_name != NULL) && (strlen(crl_file_name) != 0))
+    {
+        ret = gnutls_certificate_set_x509_crl_file(server->cred, crl_file_name, GNUTLS_X509_FMT_PEM);
+        if (ret <= 0)
+        {
+            if (ret < 0)
+                coap_log_error("Failed to assign X.509 certificate revocation list to DTLS credentials: %s", gnutls_strerror_name(ret));
+            else
+                coap_log_error("Failed to assign X.509 certificate revocation list to DTLS credentials");
+            gnutls_certificate_free_credentials(server->cred);
+            gnutls_global_deinit();
+            return -1;
+        }
+    }
+    ret = gnutls_certificate_set_x509_key_file(server->cred, cert_file_name, key_file_name, GNUTLS_X509_FMT_PEM);
+    if (ret != GNUTLS_E_SUCCESS)
+    {
+        coap_log_error("Failed to assign X.509 certificate file and key file to DTLS credentials: %s", gnutls_strerror_name(ret));
+        gnutls_certificate_free_credentials(server->cred);
+        gnutls_global_deinit();
+        return -1;
+    }
+    ret = gnutls_dh_params_init(&server->dh_params);
+    if (ret != GNUTLS_E_SUCCESS)
+    {
+        coap_log_error("Failed to initialise Diffie-Hellman parameters for DTLS credentials: %s", gnutls_strerror_name(ret));
+        gnutls_certificate_free_credentials(server->cred);
+        gnutls_global_deinit();
+        return -1;
+    }
+    ret = gnutls_dh_params_generate2(server->dh_params, COAP_SERVER_DTLS_NUM_DH_BITS);
+    if (ret != GNUTLS_E_SUCCESS)
+    {
+        coap_log_error("Failed to generate Diffie-Hellman parameters for DTLS credentials: %s", gnutls_strerror_name(ret));
+        gnutls_dh_params_deinit(server->dh_params);
+        gnutls_certificate_free_credentials(server->cred);
+        gnutls_global_deinit();
+        return -1;
+    }
+    gnutls_certificate_set_dh_params(server->cred, server->dh_params);
+    ret = gnutls_priority_init(&server->priority, COAP_SERVER_DTLS_PRIORITIES, NULL);
+    if (ret != GNUTLS_E_SUCCESS)
+    {
+        coap_log_error("Failed to initialise priorities for DTLS session: %s", gnutls_strerror_name(ret));
+        gnutls_dh_params_deinit(server->dh_params);
+        gnutls_certificate_free_credentials(server->cred);
+        gnutls_global_deinit();
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ *  @brief Deinitialise the DTLS members of a server structure
+ *
+ *  @param[in,out] trans Pointer to a server structure
+ */
+static void coap_server_dtls_destroy(coap_server_t *server)
+{
+    gnutls_priority_deinit(server->priority);
+    gnutls_certificate_free_credentials(server->cred);
+    gnutls_dh_params_deinit(server->dh_params);
+    gnutls_global_deinit();
+}
+
+#endif  /* COAP_DTLS_EN */
+
+/****************************************************************************************************
+ *                                           coap_server                                            *
+ ****************************************************************************************************/
+
+#ifdef COAP_EPOLL_EN
+
+/**
+ *  @brief Add a file descriptor to the epoll instance in a server structure
+ *
+ *  The file descriptor is registered for edge-triggered read events.
+ *
+ *  @param[in] server Pointer to a server structure
+ *  @param[in] fd File descriptor
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_epoll_add(coap_server_t *server, int fd)
+{
+    struct epoll_event ev = {0};
+    int ret = 0;
+
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.fd = fd;
+    ret = epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    if (ret < 0)
+    {
+        return -errno;
+    }
+    return 0;
+}
+
+/**
+ *  @brief Create the epoll instance in a server structure
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_epoll_create(coap_server_t *server)
+{
+    int ret = 0;
+
+    server->epoll_fd = epoll_create1(0);
+    if (server->epoll_fd < 0)
+    {
+        return -errno;
+    }
+    ret = coap_server_epoll_add(server, server->sd);
+    if (ret < 0)
+    {
+        close(server->epoll_fd);
+        return ret;
+    }
+    ret = coap_server_epoll_add(server, server->timer_fd);
+    if (ret < 0)
+    {
+        close(server->epoll_fd);
+        return ret;
+    }
+    ret = coap_server_epoll_add(server, server->notify_fd);
+    if (ret < 0)
+    {
+        close(server->epoll_fd);
+        return ret;
+    }
+    /* data may have arrived before the socket was registered */
+    server->sd_ready = 1;
+    return 0;
+}
+
+#endif  /* COAP_EPOLL_EN */
+
+/**
+ *  @brief Allocate the transaction structures and hash table in a server structure
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in] num_trans Number of transaction structures or 0 for COAP_SERVER_NUM_TRANS
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_trans_table_create(coap_server_t *server, unsigned num_trans)
+{
+    unsigned num_buckets = 1;
+    unsigned i = 0;
+
+    if (num_trans == 0)
+    {
+        num_trans = COAP_SERVER_NUM_TRANS;
+    }
+    while (num_buckets < num_trans)
+    {
+        num_buckets <<= 1;
+    }
+    server->trans = (coap_server_trans_t *)calloc(num_trans, sizeof(coap_server_trans_t));
+    if (server->trans == NULL)
+    {
+        return -ENOMEM;
+    }
+    server->trans_hash = (coap_server_trans_t **)calloc(num_buckets, sizeof(coap_server_trans_t *));
+    if (server->trans_hash == NULL)
+    {
+        free(server->trans);
+        server->trans = NULL;
+        return -ENOMEM;
+    }
+    server->num_trans = num_trans;
+    server->trans_hash_mask = num_buckets - 1;
+    server->trans_lru_first = NULL;
+    server->trans_lru_last = NULL;
+    server->trans_free = NULL;
+    for (i = num_trans; i > 0; i--)
+    {
+        coap_server_trans_release(server, &server->trans[i - 1]);
+    }
+    return 0;
+}
+
+/**
+ *  @brief Deinitialise the active transaction structures and free the hash table in a server structure
+ *
+ *  @param[in,out] server Pointer to a server structure
+ */
+static void coap_server_trans_table_destroy(coap_server_t *server)
+{
+    while (server->trans_lru_first != NULL)
+    {
+        coap_server_trans_destroy(server->trans_lru_first);
+    }
+    free(server->trans_hash);
+    free(server->trans);
+    server->trans_hash = NULL;
+    server->trans = NULL;
+    server->num_trans = 0;
+    server->trans_free = NULL;
+}
+
+/**
+ *  @brief Prepare a bound socket for use and allocate the per-socket resources
+ *
+ *  Make the socket non-blocking and create the timer, the
+ *  notification event, the event queue, if enabled, the
+ *  message ID deduplication table, the transaction table and
+ *  the observer table. On failure
+ *  the socket is closed and the server structure is cleared.
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in] num_trans Maximum number of active transactions
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_open(coap_server_t *server, unsigned num_trans)
+{
+    unsigned char msg_id[2] = {0};
+    int flags = 0;
+    int ret = 0;
+
+    flags = fcntl(server->sd, F_GETFL, 0);
+    if (flags < 0)
+    {
+        close(server->sd);
+        memset(server, 0, sizeof(coap_server_t));
+        return -errno;
+    }
+    ret = fcntl(server->sd, F_SETFL, flags | O_NONBLOCK);
+    if (ret < 0)
+    {
+        close(server->sd);
+        memset(server, 0, sizeof(coap_server_t));
+        return -errno;
+    }
+    server->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (server->timer_fd < 0)
+    {
+        close(server->sd);
+        memset(server, 0, sizeof(coap_server_t));
+        return -errno;
+    }
+    server->notify_fd = eventfd(0, EFD_NONBLOCK);
+    if (server->notify_fd < 0)
+    {
+        ret = -errno;
+        close(server->timer_fd);
+        close(server->sd);
+        memset(server, 0, sizeof(coap_server_t));
+        return ret;
+    }
+    server->obs_hash = (coap_server_obs_t **)calloc(COAP_SERVER_OBS_HASH_SIZE, sizeof(coap_server_obs_t *));
+    if (server->obs_hash == NULL)
+    {
+        close(server->notify_fd);
+        close(server->timer_fd);
+        close(server->sd);
+        memset(server, 0, sizeof(coap_server_t));
+        return -ENOMEM;
+    }
+#ifdef COAP_EPOLL_EN
+    ret = coap_server_epoll_create(server);
+    if (ret < 0)
+    {
+        free(server->obs_hash);
+        close(server->notify_fd);
+        close(server->timer_fd);
+        close(server->sd);
+        memset(server, 0, sizeof(coap_server_t));
+        return ret;
+    }
+#else
+    server->epoll_fd = -1;
+#endif
+    ret = coap_server_dedup_create(server, num_trans);
+    if (ret < 0)
+    {
+#ifdef COAP_EPOLL_EN
+        close(server->epoll_fd);
+#endif
+        free(server->obs_hash);
+        close(server->notify_fd);
+        close(server->timer_fd);
+        close(server->sd);
+        memset(server, 0, sizeof(coap_server_t));
+        return ret;
+    }
+    ret = coap_server_trans_table_create(server, num_trans);
+    if (ret < 0)
+    {
+        coap_server_dedup_destroy(server);
+#ifdef COAP_EPOLL_EN
+        close(server->epoll_fd);
+#endif
+        free(server->obs_hash);
+        close(server->notify_fd);
+        close(server->timer_fd);
+        close(server->sd);
+        memset(server, 0, sizeof(coap_server_t));
+        return ret;
+    }
+    coap_msg_gen_rand_str((char *)msg_id, sizeof(msg_id));
+    server->msg_id = (((unsigned)msg_id[1]) << 8) | (unsigned)msg_id[0];
+    return 0;
+}
+
+/**
+ *  @brief Release the per-socket resources and close the socket
+ *
+ *  Queued datagrams are sent before the socket is closed.
+ *  The observer structures are released with the
+ *  transaction structures that registered them.
+ *
+ *  @param[in,out] server Pointer to a server structure
+ */
+static void coap_server_close(coap_server_t *server)
+{
+#ifndef COAP_DTLS_EN
+    coap_server_flush(server);
+#endif
+    coap_server_trans_table_destroy(server);
+    coap_server_dedup_destroy(server);
+    coap_server_cache_destroy(server);
+    free(server->obs_hash);
+    server->obs_hash = NULL;
+#ifdef COAP_EPOLL_EN
+    close(server->epoll_fd);
+#endif
+    close(server->notify_fd);
+    close(server->timer_fd);
+    close(server->sd);
+}
+
+#ifdef COAP_DTLS_EN
+int coap_server_create(coap_server_t *server,
+                       coap_server_trans_handler_t handle,
+                       const char *host,
+                       const char *port,
+                       unsigned num_trans,
+                       const char *key_file_name,
+                       const char *cert_file_name,
+                       const char *trust_file_name,
+                       const char *crl_file_name)
+#else
+int coap_server_create(coap_server_t *server,
+                       coap_server_trans_handler_t handle,
+                       const char *host,
+                       const char *port,
+                       unsigned num_trans)
+#endif
+{
+    struct addrinfo hints = {0};
+    struct addrinfo *list = NULL;
+    struct addrinfo *node = NULL;
+    int opt_val = 0;
+    int ret = 0;
+
+    if ((server == NULL) || (host == NULL) || (port == NULL))
+    {
+        return -EINVAL;
+    }
+    memset(server, 0, sizeof(coap_server_t));
+    /* resolve host and port */
+    hints.ai_flags = 0;
+    hints.ai_family = COAP_IPV_AF_INET;  /* preferred socket domain */
+    hints.ai_socktype = SOCK_DGRAM;      /* preferred socket type */
+    hints.ai_protocol = 0;               /* preferred protocol (3rd argument to socket()) - 0 specifies that any protocol will do */
+    hints.ai_addrlen = 0;                /* must be 0 */
+    hints.ai_addr = NULL;                /* must be NULL */
+    hints.ai_canonname = NULL;           /* must be NULL */
+    hints.ai_next = NULL;                /* must be NULL */
+    ret = getaddrinfo(host, port, &hints, &list);
+    if (ret < 0)
+    {
+        return -EBUSY;
+    }
+    for (node = list; node != NULL; node = node->ai_next)
+    {
+        if ((node->ai_family == COAP_IPV_AF_INET)
+         && (node->ai_socktype == SOCK_DGRAM))
         {
-            coap_log_info("Insufficient buffer size in blockwise transfer from address %s and port %u",
-                          trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
-            coap_server_trans_clear_blockwise(trans);
-            return coap_msg_set_code(resp, COAP_MSG_CLIENT_ERR, COAP_MSG_REQ_ENT_TOO_LARGE);
+            server->sd = socket(node->ai_family, node->ai_socktype, node->ai_protocol);
+            if (server->sd < 0)
+            {
+                continue;
+            }
+            opt_val = 1;
+            ret = setsockopt(server->sd, SOL_SOCKET, SO_REUSEADDR, &opt_val, (socklen_t)sizeof(opt_val));
+            if (ret < 0)
+            {
+                close(server->sd);
+                freeaddrinfo(list);
+                return -EBUSY;
+            }
+#ifdef COAP_SERVER_THREAD_EN
+            /* allow worker sockets to bind to the same address and port */
+            ret = setsockopt(server->sd, SOL_SOCKET, SO_REUSEPORT, &opt_val, (socklen_t)sizeof(opt_val));
+            if (ret < 0)
+            {
+                close(server->sd);
+                freeaddrinfo(list);
+                return -EBUSY;
+            }
+#endif
+            ret = bind(server->sd, node->ai_addr, node->ai_addrlen);
+            if (ret < 0)
+            {
+                close(server->sd);
+                continue;
+            }
+            break;
         }
-        block1_num = coap_msg_block_start_to_num(trans->block1_next, block1_szx);
-        ret = coap_msg_op_format_block_val(block_val, sizeof(block_val), block1_num, block1_more, trans->block1_size);
-        if (ret < 0)
+    }
+    freeaddrinfo(list);
+    if (node == NULL)
+    {
+        memset(server, 0, sizeof(coap_server_t));
+        return -EBUSY;
+    }
+    ret = coap_server_open(server, num_trans);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    server->handle = handle;
+#ifdef COAP_DTLS_EN
+    ret = coap_server_dtls_create(server, key_file_name, cert_file_name, trust_file_name, crl_file_name);
+    if (ret < 0)
+    {
+        coap_server_close(server);
+        memset(server, 0, sizeof(coap_server_t));
+        return ret;
+    }
+#endif
+#ifdef COAP_SERVER_STATS_EN
+    ret = coap_server_add_resource(server, COAP_SERVER_STATS_URI_PATH, COAP_MSG_GET, coap_server_handle_stats);
+    if (ret < 0)
+    {
+        coap_server_close(server);
+        coap_server_res_table_destroy(server);
+#ifdef COAP_DTLS_EN
+        coap_server_dtls_destroy(server);
+#endif
+        memset(server, 0, sizeof(coap_server_t));
+        return ret;
+    }
+#endif
+    coap_log_notice("Listening on address %s and port %s", host, port);
+    return 0;
+}
+
+void coap_server_destroy(coap_server_t *server)
+{
+    coap_server_close(server);
+    coap_server_res_table_destroy(server);
+#ifdef COAP_DTLS_EN
+    coap_server_dtls_destroy(server);
+#endif
+    memset(server, 0, sizeof(coap_server_t));
+}
+
+unsigned coap_server_get_next_msg_id(coap_server_t *server)
+{
+    unsigned char msg_id[2] = {0};
+
+    server->msg_id++;
+    while (server->msg_id > COAP_MSG_MAX_MSG_ID)
+    {
+        coap_msg_gen_rand_str((char *)msg_id, sizeof(msg_id));
+        server->msg_id = (((unsigned)msg_id[1]) << 8) | (unsigned)msg_id[0];
+    }
+    return server->msg_id;
+}
+
+/**
+ *  @brief Check that all of the options in a message are acceptable
+ *
+ *  For a proxy, options are acceptable if they are safe to forward or recognized or both.
+ *  For a server, options are acceptable if they are elective or recognized or both.
+ *
+ *  @param[in] msg Pointer to message structure
+ *
+ *  @returns Operation status or bad option number
+ *  @retval 0 Success
+ *  @retval >0 Bad option number
+ */
+static unsigned coap_server_check_options(coap_msg_t *msg)
+{
+#ifdef COAP_PROXY
+    return coap_msg_check_unsafe_ops(msg);
+#else  /* !COAP_PROXY */
+    return coap_msg_check_critical_ops(msg);
+#endif  /* COAP_PROXY */
+}
+
+/**
+ *  @brief Search for a transaction structure in a server structure that matches an endpoint
+ *
+ *  @param[in] server Pointer to a server structure
+ *  @param[in] client_sin Pointer to a socket structure
+ *  @param[in] client_sin_len Length of the socket structure
+ *
+ *  @returns Pointer to a transaction structure
+ *  @retval NULL No matching transaction structure found
+ */
+static coap_server_trans_t *coap_server_find_trans(coap_server_t *server, coap_ipv_sockaddr_in_t *client_sin, socklen_t client_sin_len)
+{
+    coap_server_trans_t *trans = NULL;
+    unsigned i = 0;
+
+    i = coap_server_trans_hash(client_sin, client_sin_len) & server->trans_hash_mask;
+    for (trans = server->trans_hash[i]; trans != NULL; trans = trans->hash_next)
+    {
+        if ((trans->client_sin_len == client_sin_len)
+         && (memcmp(&trans->client_sin, client_sin, client_sin_len) == 0))
         {
-            coap_log_warn("Failed to format block2 option value, num %d, size %d", block1_num, trans->block1_size);
-            coap_server_trans_clear_blockwise(trans);
-            return ret;
+            coap_log_debug("Found existing transaction at index %u", (unsigned)(trans - server->trans));
+            return trans;
         }
-        block_len = ret;
-        ret = coap_msg_add_op(resp, COAP_MSG_BLOCK1, block_len, block_val);
-        if (ret < 0)
+    }
+    return NULL;
+}
+
+/**
+ *  @brief Take an empty transaction structure from the free list in a server structure
+ *
+ *  @param[in] server Pointer to a server structure
+ *
+ *  @returns Pointer to a transaction structure
+ *  @retval NULL No empty transaction structures available
+ */
+static coap_server_trans_t *coap_server_find_empty_trans(coap_server_t *server)
+{
+    coap_server_trans_t *trans = NULL;
+
+    trans = server->trans_free;
+    if (trans != NULL)
+    {
+        server->trans_free = trans->hash_next;
+        trans->hash_next = NULL;
+        coap_log_debug("Found empty transaction at index %u", (unsigned)(trans - server->trans));
+    }
+    return trans;
+}
+
+/**
+ *  @brief Search for the oldest transaction structure in a server structure
+ *
+ *  Return the transaction structure in a server structure that was
+ *  used least recently.
+ *
+ *  @param[in] server Pointer to a server structure
+ *
+ *  @returns Pointer to a transaction structure
+ */
+static coap_server_trans_t *coap_server_find_oldest_trans(coap_server_t *server)
+{
+    coap_server_trans_t *oldest = server->trans_lru_last;
+
+    coap_log_debug("Found oldest transaction at index %u", (unsigned)(oldest - server->trans));
+    return oldest;
+}
+
+/**
+ *  @brief Advance the timer wheel
+ *
+ *  Advance the timer wheel by the number of ticks that have
+ *  elapsed and handle the acknowledgement timeouts that expire.
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_handle_timer(coap_server_t *server)
+{
+    coap_server_trans_t *trans = NULL;
+    coap_server_trans_t *next = NULL;
+    uint64_t ticks = 0;
+    ssize_t num = 0;
+    int ret = 0;
+
+    num = read(server->timer_fd, &ticks, sizeof(ticks));
+    if (num < 0)
+    {
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
         {
-            coap_server_trans_clear_blockwise(trans);
-            return ret;
+            return 0;
         }
-        memcpy(trans->body + trans->block1_next, coap_msg_get_payload(req), payload_len);
-        trans->block1_next += payload_len;
-        trans->body_end += payload_len;
-        code_detail = COAP_MSG_CONTINUE;
-        if (!block1_more)
+        return -errno;
+    }
+    while ((ticks > 0) && (server->timer_num > 0))
+    {
+        server->timer_pos = (server->timer_pos + 1) & COAP_SERVER_TIMER_WHEEL_MASK;
+        trans = server->timer_wheel[server->timer_pos];
+        while (trans != NULL)
         {
-            /* copy received data to the application's buffer */
-            if (trans->type == COAP_SERVER_TRANS_BLOCKWISE_PUT1)
+            /* the timeout handler may restart the timer or destroy the transaction */
+            next = trans->timer_next;
+            if (trans->timer_rounds == 0)
             {
-                coap_log_info("Completed PUT library-level blockwise transfer with address %s and port %u",
-                              trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+                coap_server_trans_unlink_timer(trans);
+                ret = coap_server_trans_handle_ack_timeout(trans);
+                if (ret < 0)
+                {
+                    return ret;
+                }
             }
             else
             {
-                coap_log_info("Completed POST library-level blockwise transfer with address %s and port %u",
-                              trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
-            }
-            /* allow the application to process the received data */
-            /* and generate a body for the response */
-            ret = (*trans->block_rx)(trans, req, resp);
-            if (ret < 0)
-            {
-                coap_log_warn("Call to blockwise receive callback function failed");
-                coap_server_trans_clear_blockwise(trans);
-                return ret;
-            }
-            if (coap_msg_get_code_class(resp) != COAP_MSG_SUCCESS)
-            {
-                /* return the response generated by the call to trans->block_rx */
-                coap_server_trans_clear_blockwise(trans);
-                return 0;
-            }
-            code_detail = coap_msg_get_code_detail(resp);
-            if (trans->body_end > 0)
-            {
-                if (trans->type == COAP_SERVER_TRANS_BLOCKWISE_PUT1)
-                {
-                    trans->type = COAP_SERVER_TRANS_BLOCKWISE_PUT2;
-                }
-                else
-                {
-                    trans->type = COAP_SERVER_TRANS_BLOCKWISE_POST2;
-                }
-                trans->block_detail = coap_msg_get_code_detail(resp);
-                /* the response contains a body as well as the request
-                 * handle this block twice:
-                 *   this time to process the request payload
-                 *   next time to generate the response
-                 */
-                return coap_server_trans_handle_next_block(trans, req, resp);
+                trans->timer_rounds--;
             }
-            coap_server_trans_clear_blockwise(trans);
+            trans = next;
         }
-        return coap_msg_set_code(resp, COAP_MSG_SUCCESS, code_detail);
+        ticks--;
+    }
+    if (server->timer_num == 0)
+    {
+        return coap_server_timer_set(server, 0);
     }
     return 0;
 }
 
-int coap_server_trans_handle_blockwise(coap_server_trans_t *trans,
-                                       coap_msg_t *req,
-                                       coap_msg_t *resp,
-                                       unsigned block1_size,
-                                       unsigned block2_size,
-                                       char *body,
-                                       size_t body_len,
-                                       coap_server_trans_handler_t block_rx)
+/**
+ *  @brief Initialise a scratch transaction structure used to generate a notification
+ *
+ *  The scratch transaction structure carries the server
+ *  and the client endpoint of an observer so that the GET
+ *  handler of a resource can be called without touching
+ *  the request, response or blockwise state of a live
+ *  transaction.
+ *
+ *  @param[out] scratch Pointer to the scratch transaction structure
+ *  @param[in] trans Pointer to the transaction structure of an observer
+ *  @param[in] req Pointer to the request for the resource
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_notify_trans_create(coap_server_trans_t *scratch, coap_server_trans_t *trans, coap_msg_t *req)
 {
-    unsigned code_detail = 0;
+    memset(scratch, 0, sizeof(coap_server_trans_t));
+    scratch->type = COAP_SERVER_TRANS_REGULAR;
+    memcpy(&scratch->client_sin, &trans->client_sin, trans->client_sin_len);
+    scratch->client_sin_len = trans->client_sin_len;
+    memcpy(scratch->client_addr, trans->client_addr, sizeof(scratch->client_addr));
+    scratch->server = trans->server;
+    coap_msg_create(&scratch->req);
+    coap_msg_create(&scratch->resp);
+    return coap_msg_copy(&scratch->req, req);
+}
+
+/**
+ *  @brief Deinitialise a scratch transaction structure used to generate a notification
+ *
+ *  @param[in,out] scratch Pointer to the scratch transaction structure
+ */
+static void coap_server_notify_trans_destroy(coap_server_trans_t *scratch)
+{
+    coap_server_trans_clear_blockwise(scratch);
+    coap_msg_destroy(&scratch->resp);
+    coap_msg_destroy(&scratch->req);
+}
+
+/**
+ *  @brief Notify the observers of a resource that have not been sent its latest change
+ *
+ *  The GET handler of the resource is called once with a
+ *  request for the resource and a scratch transaction
+ *  structure for the client endpoint of the first observer.
+ *  The response is formatted once without a token and
+ *  copied to each observer with its own token and message ID.
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *  @param[in] res Pointer to a resource structure
+ *  @param[in,out] first Pointer to the first observer structure that needs a notification
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_notify_res(coap_server_t *server, coap_server_res_t *res, coap_server_obs_t *first)
+{
+    coap_server_trans_t scratch = {0};
+    coap_server_obs_t *next = NULL;
+    coap_server_obs_t *obs = NULL;
+    coap_msg_t req = {0};
+    coap_msg_t resp = {0};
+    unsigned seq = 0;
+    ssize_t tmpl_len = 0;
+    ssize_t num = 0;
+    char tmpl[COAP_MSG_MAX_BUF_LEN] = {0};
+    char val[COAP_SERVER_OBS_MAX_VAL_LEN] = {0};
+    int success = 0;
     int ret = 0;
 
-    coap_server_trans_clear_blockwise(trans);
-    if (block1_size > 0)
+    /* generate the representation */
+    seq = __atomic_load_n(&res->obs_seq, __ATOMIC_ACQUIRE);
+    coap_msg_create(&req);
+    coap_msg_create(&resp);
+    ret = coap_msg_set_type(&req, COAP_MSG_NON);
+    if (ret == 0)
     {
-        ret = coap_msg_op_calc_block_szx(block1_size);
-        if (ret < 0)
-        {
-            return -EINVAL;
-        }
+        ret = coap_msg_set_code(&req, COAP_MSG_REQ, COAP_MSG_GET);
     }
-    if (block2_size > 0)
+    if (ret == 0)
     {
-        ret = coap_msg_op_calc_block_szx(block2_size);
-        if (ret < 0)
-        {
-            return -EINVAL;
-        }
+        ret = coap_server_res_add_uri_path(res, &req);
     }
-    if (body_len > coap_mem_large_get_len())
+    if (ret == 0)
     {
-        return -ENOSPC;
+        ret = coap_server_notify_trans_create(&scratch, first->trans, &req);
+        if (ret == 0)
+        {
+            ret = (*res->handle[COAP_MSG_GET])(&scratch, &req, &resp);
+        }
+        if ((ret == 0) && (coap_server_trans_get_type(&scratch) != COAP_SERVER_TRANS_REGULAR))
+        {
+            /* notifications must fit in a single message */
+            ret = -EMSGSIZE;
+        }
+        coap_server_notify_trans_destroy(&scratch);
     }
-    trans->body = coap_mem_large_alloc(body_len);
-    if (trans->body == NULL)
+    success = (coap_msg_get_code_class(&resp) == COAP_MSG_SUCCESS);
+    if ((ret == 0) && (success))
     {
-        return -ENOMEM;
+        ret = coap_msg_op_format_uint_val(val, sizeof(val), seq & COAP_SERVER_OBS_MAX_SEQ);
+        if (ret >= 0)
+        {
+            ret = coap_msg_add_op(&resp, COAP_MSG_OBSERVE, ret, val);
+        }
     }
-    trans->body_len = coap_mem_large_get_len();
-    memset(trans->body, 0, trans->body_len);
-    code_detail = coap_msg_get_code_detail(req);
-    if (code_detail == COAP_MSG_GET)
+    if (ret == 0)
     {
-        coap_log_info("Starting new GET library-level blockwise transfer with address %s and port %u",
-                      trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
-        trans->type = COAP_SERVER_TRANS_BLOCKWISE_GET;
-        memcpy(trans->body, body, body_len);
-        trans->body_end = body_len;
+        ret = coap_msg_set_type(&resp, COAP_MSG_NON);
     }
-    else if ((code_detail == COAP_MSG_PUT)
-          || (code_detail == COAP_MSG_POST))
+    if (ret == 0)
     {
-        if (block_rx == NULL)
+        tmpl_len = coap_msg_format(&resp, tmpl, sizeof(tmpl));
+        if (tmpl_len < 0)
         {
-            coap_server_trans_clear_blockwise(trans);
-            return -EINVAL;
+            ret = tmpl_len;
         }
-        if (code_detail == COAP_MSG_PUT)
+    }
+    coap_msg_destroy(&resp);
+    coap_msg_destroy(&req);
+
+    /* send it to every observer that has not seen the change */
+    obs = first;
+    while (obs != NULL)
+    {
+        next = obs->hash_next;
+        if ((obs->res == res) && (obs->seq != seq))
         {
-            coap_log_info("Starting new PUT library-level blockwise transfer with address %s and port %u",
-                          trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
-            trans->type = COAP_SERVER_TRANS_BLOCKWISE_PUT1;
+            obs->seq = seq;
+            if (ret == 0)
+            {
+                num = coap_server_trans_send_notify(obs, tmpl, tmpl_len);
+                if (num < 0)
+                {
+                    coap_log_warn("Failed to send notification to address %s and port %u: %s",
+                                  obs->trans->client_addr, ntohs(obs->trans->client_sin.COAP_IPV_SIN_PORT), strerror(-num));
+                }
+                if (!success)
+                {
+                    /* an error response ends the observation */
+                    coap_server_obs_delete(obs);
+                }
+            }
         }
-        else
+        obs = next;
+    }
+    return ret;
+}
+
+/**
+ *  @brief Send notifications for the resources that have changed
+ *
+ *  Scan the observer hash table for observers that have
+ *  not been sent the latest change to their resource. The
+ *  observers of a resource share a hash chain so each
+ *  changed resource is handled once.
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_handle_notify(coap_server_t *server)
+{
+    coap_server_obs_t *obs = NULL;
+    uint64_t count = 0;
+    ssize_t num = 0;
+    unsigned i = 0;
+    int ret = 0;
+
+    num = read(server->notify_fd, &count, sizeof(count));
+    if (num < 0)
+    {
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
         {
-            coap_log_info("Starting new POST library-level blockwise transfer with address %s and port %u",
-                          trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
-            trans->type = COAP_SERVER_TRANS_BLOCKWISE_POST1;
+            return 0;
         }
-        memset(trans->body, 0, trans->body_len);
-        trans->body_end = 0;
+        return -errno;
     }
-    else
+    for (i = 0; i < COAP_SERVER_OBS_HASH_SIZE; i++)
     {
-        coap_log_warn("Request method unsupported in blockwise transfer with address %s and port %u",
-                      trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
-        coap_server_trans_clear_blockwise(trans);
-        return coap_msg_set_code(resp, COAP_MSG_SERVER_ERR, COAP_MSG_NOT_IMPL);
+        obs = server->obs_hash[i];
+        while (obs != NULL)
+        {
+            if (obs->seq != __atomic_load_n(&obs->res->obs_seq, __ATOMIC_ACQUIRE))
+            {
+                ret = coap_server_notify_res(server, obs->res, obs);
+                if (ret < 0)
+                {
+                    coap_log_warn("Failed to generate notification: %s", strerror(-ret));
+                }
+                /* observers may have been removed from the hash chain */
+                obs = server->obs_hash[i];
+                continue;
+            }
+            obs = obs->hash_next;
+        }
     }
-    trans->block1_size = block1_size;
-    trans->block2_size = block2_size;
-    coap_msg_uri_path_to_str(req, trans->block_uri, sizeof(trans->block_uri));
-    trans->block_rx = block_rx;
-    return coap_server_trans_handle_next_block(trans, req, resp);
+    return 0;
 }
 
-#ifdef COAP_DTLS_EN
-
-/****************************************************************************************************
- *                                         coap_server_dtls                                         *
- ****************************************************************************************************/
+#ifdef COAP_EPOLL_EN
 
 /**
- *  @brief Initialise the DTLS members of a server structure
+ *  @brief Wait for a message to arrive or an acknowledgement
+ *         timer in any of the active transactions to expire
  *
- *  @param[out] server Pointer to a server structure
- *  @param[in] key_file_name String containing the DTLS key file name
- *  @param[in] cert_file_name String containing the DTLS certificate file name
- *  @param[in] trust_file_name String containing the DTLS trust file name
- *  @param[in] crl_file_name String containing the DTLS certificate revocation list file name
+ *  Notifications for changed resources are sent while waiting.
+ *
+ *  Events are edge-triggered so the socket is considered
+ *  ready until a read from it would block. Pending timer
+ *  events are still handled while the socket is ready.
+ *
+ *  Datagrams left in the receive batch are processed
+ *  before waiting and queued responses are flushed
+ *  before each wait.
+ *
+ *  @param[in,out] server Pointer to a server structure
  *
  *  @returns Operation status
  *  @retval 0 Success
- *  @retval -1 Error
+ *  @retval <0 Error
  */
-static int coap_server_dtls_create(coap_server_t *server,
-                                   const char *key_file_name,
-                                   const char *cert_file_name,
-                                   const char *trust_file_name,
-                                   const char *crl_file_name)
+static int coap_server_listen(coap_server_t *server)
 {
+    struct epoll_event events[COAP_SERVER_NUM_EVENTS] = {{0}};
+    int num = 0;
     int ret = 0;
+    int i = 0;
 
-    ret = gnutls_global_init();
-    if (ret != GNUTLS_E_SUCCESS)
-    {
-        coap_log_error("Failed to initialise DTLS library: %s", gnutls_strerror_name(ret));
-        return -1;
-    }
-    ret = gnutls_certificate_allocate_credentials(&server->cred);
-    if (ret != GNUTLS_E_SUCCESS)
+    if (coap_server_recv_pending(server))
     {
-        gnutls_global_deinit();
-        coap_log_error("Failed to allocate DTLS credentials: %s", gnutls_strerror_name(ret));
-        return -1;
+        return 0;
     }
-    if ((trust_file_name != NULL) && (strlen(trust_file_name) != 0))
+    while (1)
     {
-        ret = gnutls_certificate_set_x509_trust_file(server->cred, trust_file_name, GNUTLS_X509_FMT_PEM);
-        if (ret <= 0)
+#ifndef COAP_DTLS_EN
+        coap_server_flush(server);
+#endif
+#ifdef COAP_SERVER_THREAD_EN
+        if (__atomic_load_n(&server->stop, __ATOMIC_ACQUIRE))
         {
-            if (ret < 0)
-                coap_log_error("Failed to assign X.509 trust file to DTLS credentials: %s", gnutls_strerror_name(ret));
-            else
-                coap_log_error("Failed to assign X.509 trust file to DTLS credentials");
-            gnutls_certificate_free_credentials(server->cred);
-            gnutls_global_deinit();
-            return -1;
+            return -ECANCELED;
         }
-    }
-    if ((crl_file_name != NULL) && (strlen(crl_file_name) != 0))
-    {
-        ret = gnutls_certificate_set_x509_crl_file(server->cred, crl_file_name, GNUTLS_X509_FMT_PEM);
-        if (ret <= 0)
+#endif
+        num = epoll_wait(server->epoll_fd, events, COAP_SERVER_NUM_EVENTS, server->sd_ready ? 0 : -1);
+        if (num < 0)
         {
-            if (ret < 0)
-                coap_log_error("Failed to assign X.509 certificate revocation list to DTLS credentials: %s", gnutls_strerror_name(ret));
-            else
-                coap_log_error("Failed to assign X.509 certificate revocation list to DTLS credentials");
-            gnutls_certificate_free_credentials(server->cred);
-            gnutls_global_deinit();
-            return -1;
+            return -errno;
+        }
+        for (i = 0; i < num; i++)
+        {
+            if (events[i].data.fd == server->timer_fd)
+            {
+                ret = coap_server_handle_timer(server);
+                if (ret < 0)
+                {
+                    return ret;
+                }
+            }
+            else if (events[i].data.fd == server->notify_fd)
+            {
+                ret = coap_server_handle_notify(server);
+                if (ret < 0)
+                {
+                    return ret;
+                }
+            }
+            else if (events[i].data.fd == server->sd)
+            {
+                server->sd_ready = 1;
+            }
+        }
+        if (server->sd_ready)
+        {
+            return 0;
         }
-    }
-    ret = gnutls_certificate_set_x509_key_file(server->cred, cert_file_name, key_file_name, GNUTLS_X509_FMT_PEM);
-    if (ret != GNUTLS_E_SUCCESS)
-    {
-        coap_log_error("Failed to assign X.509 certificate file and key file to DTLS credentials: %s", gnutls_strerror_name(ret));
-        gnutls_certificate_free_credentials(server->cred);
-        gnutls_global_deinit();
-        return -1;
-    }
-    ret = gnutls_dh_params_init(&server->dh_params);
-    if (ret != GNUTLS_E_SUCCESS)
-    {
-        coap_log_error("Failed to initialise Diffie-Hellman parameters for DTLS credentials: %s", gnutls_strerror_name(ret));
-        gnutls_certificate_free_credentials(server->cred);
-        gnutls_global_deinit();
-        return -1;
-    }
-    ret = gnutls_dh_params_generate2(server->dh_params, COAP_SERVER_DTLS_NUM_DH_BITS);
-    if (ret != GNUTLS_E_SUCCESS)
-    {
-        coap_log_error("Failed to generate Diffie-Hellman parameters for DTLS credentials: %s", gnutls_strerror_name(ret));
-        gnutls_dh_params_deinit(server->dh_params);
-        gnutls_certificate_free_credentials(server->cred);
-        gnutls_global_deinit();
-        return -1;
-    }
-    gnutls_certificate_set_dh_params(server->cred, server->dh_params);
-    ret = gnutls_priority_init(&server->priority, COAP_SERVER_DTLS_PRIORITIES, NULL);
-    if (ret != GNUTLS_E_SUCCESS)
-    {
-        coap_log_error("Failed to initialise priorities for DTLS session: %s", gnutls_strerror_name(ret));
-        gnutls_dh_params_deinit(server->dh_params);
-        gnutls_certificate_free_credentials(server->cred);
-        gnutls_global_deinit();
-        return -1;
     }
     return 0;
 }
 
+#else  /* !COAP_EPOLL_EN */
+
 /**
- *  @brief Deinitialise the DTLS members of a server structure
+ *  @brief Wait for a message to arrive or an acknowledgement
+ *         timer in any of the active transactions to expire
  *
- *  @param[in,out] trans Pointer to a server structure
+ *  Notifications for changed resources are sent while waiting.
+ *
+ *  Datagrams left in the receive batch are processed
+ *  before waiting and queued responses are flushed
+ *  before each wait.
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
  */
-static void coap_server_dtls_destroy(coap_server_t *server)
-{
-    gnutls_priority_deinit(server->priority);
-    gnutls_certificate_free_credentials(server->cred);
-    gnutls_dh_params_deinit(server->dh_params);
-    gnutls_global_deinit();
-}
-
-#endif  /* COAP_DTLS_EN */
-
-/****************************************************************************************************
- *                                           coap_server                                            *
- ****************************************************************************************************/
-
-#ifdef COAP_DTLS_EN
-int coap_server_create(coap_server_t *server,
-                       coap_server_trans_handler_t handle,
-                       const char *host,
-                       const char *port,
-                       const char *key_file_name,
-                       const char *cert_file_name,
-                       const char *trust_file_name,
-                       const char *crl_file_name)
-#else
-int coap_server_create(coap_server_t *server,
-                       coap_server_trans_handler_t handle,
-                       const char *host,
-                       const char *port)
-#endif
+static int coap_server_listen(coap_server_t *server)
 {
-    unsigned char msg_id[2] = {0};
-    struct addrinfo hints = {0};
-    struct addrinfo *list = NULL;
-    struct addrinfo *node = NULL;
-    int opt_val = 0;
-    int flags = 0;
+    fd_set read_fds = {{0}};
+    int max_fd = 0;
     int ret = 0;
 
-    if ((server == NULL) || (host == NULL) || (port == NULL))
-    {
-        return -EINVAL;
-    }
-    memset(server, 0, sizeof(coap_server_t));
-    /* resolve host and port */
-    hints.ai_flags = 0;
-    hints.ai_family = COAP_IPV_AF_INET;  /* preferred socket domain */
-    hints.ai_socktype = SOCK_DGRAM;      /* preferred socket type */
-    hints.ai_protocol = 0;               /* preferred protocol (3rd argument to socket()) - 0 specifies that any protocol will do */
-    hints.ai_addrlen = 0;                /* must be 0 */
-    hints.ai_addr = NULL;                /* must be NULL */
-    hints.ai_canonname = NULL;           /* must be NULL */
-    hints.ai_next = NULL;                /* must be NULL */
-    ret = getaddrinfo(host, port, &hints, &list);
-    if (ret < 0)
+    if (coap_server_recv_pending(server))
     {
-        return -EBUSY;
+        return 0;
     }
-    for (node = list; node != NULL; node = node->ai_next)
+    while (1)
     {
-        if ((node->ai_family == COAP_IPV_AF_INET)
-         && (node->ai_socktype == SOCK_DGRAM))
+#ifndef COAP_DTLS_EN
+        coap_server_flush(server);
+#endif
+#ifdef COAP_SERVER_THREAD_EN
+        if (__atomic_load_n(&server->stop, __ATOMIC_ACQUIRE))
         {
-            server->sd = socket(node->ai_family, node->ai_socktype, node->ai_protocol);
-            if (server->sd < 0)
-            {
-                continue;
-            }
-            opt_val = 1;
-            ret = setsockopt(server->sd, SOL_SOCKET, SO_REUSEADDR, &opt_val, (socklen_t)sizeof(opt_val));
+            return -ECANCELED;
+        }
+#endif
+        FD_ZERO(&read_fds);
+        FD_SET(server->sd, &read_fds);
+        FD_SET(server->timer_fd, &read_fds);
+        FD_SET(server->notify_fd, &read_fds);
+        max_fd = server->sd > server->timer_fd ? server->sd : server->timer_fd;
+        max_fd = max_fd > server->notify_fd ? max_fd : server->notify_fd;
+        ret = select(max_fd + 1, &read_fds, NULL, NULL, NULL);
+        if (ret < 0)
+        {
+            return -errno;
+        }
+        if (FD_ISSET(server->timer_fd, &read_fds))
+        {
+            ret = coap_server_handle_timer(server);
             if (ret < 0)
             {
-                close(server->sd);
-                freeaddrinfo(list);
-                return -EBUSY;
+                return ret;
             }
-            ret = bind(server->sd, node->ai_addr, node->ai_addrlen);
+        }
+        if (FD_ISSET(server->notify_fd, &read_fds))
+        {
+            ret = coap_server_handle_notify(server);
             if (ret < 0)
             {
-                close(server->sd);
-                continue;
+                return ret;
             }
-            break;
+        }
+        if (FD_ISSET(server->sd, &read_fds))
+        {
+            return 0;
         }
     }
-    freeaddrinfo(list);
-    if (node == NULL)
-    {
-        memset(server, 0, sizeof(coap_server_t));
-        return -EBUSY;
-    }
-    flags = fcntl(server->sd, F_GETFL, 0);
-    if (flags < 0)
-    {
-        close(server->sd);
-        memset(server, 0, sizeof(coap_server_t));
-        return -errno;
-    }
-    ret = fcntl(server->sd, F_SETFL, flags | O_NONBLOCK);
-    if (ret < 0)
-    {
-        close(server->sd);
-        memset(server, 0, sizeof(coap_server_t));
-        return -errno;
-    }
-    coap_msg_gen_rand_str((char *)msg_id, sizeof(msg_id));
-    server->msg_id = (((unsigned)msg_id[1]) << 8) | (unsigned)msg_id[0];
-    coap_server_path_list_create(&server->sep_list);
-    server->handle = handle;
-#ifdef COAP_DTLS_EN
-    ret = coap_server_dtls_create(server, key_file_name, cert_file_name, trust_file_name, crl_file_name);
-    if (ret < 0)
-    {
-        coap_server_path_list_destroy(&server->sep_list);
-        close(server->sd);
-        memset(server, 0, sizeof(coap_server_t));
-        return ret;
-    }
-#endif
-    coap_log_notice("Listening on address %s and port %s", host, port);
     return 0;
 }
 
-void coap_server_destroy(coap_server_t *server)
+#endif  /* COAP_EPOLL_EN */
+
+#ifndef COAP_DTLS_EN
+
+/**
+ *  @brief Receive a batch of datagrams
+ *
+ *  Read as many datagrams as are waiting on the socket,
+ *  up to the size of the receive batch, with a single
+ *  call to recvmmsg.
+ *
+ *  @param[in,out] server Pointer to a server structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_recv_batch(coap_server_t *server)
 {
-    coap_server_trans_t *trans = NULL;
+    coap_server_dgram_t *dgram = NULL;
+    struct mmsghdr hdr[COAP_SERVER_BATCH_SIZE];
+    struct iovec iov[COAP_SERVER_BATCH_SIZE];
     unsigned i = 0;
+    int num = 0;
 
-    for (i = 0; i < COAP_SERVER_NUM_TRANS; i++)
+    server->recv_num = 0;
+    server->recv_next = 0;
+    server->recv_cur = NULL;
+    memset(hdr, 0, sizeof(hdr));
+    for (i = 0; i < COAP_SERVER_BATCH_SIZE; i++)
+    {
+        dgram = &server->recv_batch[i];
+        iov[i].iov_base = dgram->buf;
+        iov[i].iov_len = sizeof(dgram->buf);
+        hdr[i].msg_hdr.msg_name = &dgram->sin;
+        hdr[i].msg_hdr.msg_namelen = sizeof(dgram->sin);
+        hdr[i].msg_hdr.msg_iov = &iov[i];
+        hdr[i].msg_hdr.msg_iovlen = 1;
+    }
+    num = recvmmsg(server->sd, hdr, COAP_SERVER_BATCH_SIZE, 0, NULL);
+    if (num < 0)
     {
-        trans = &server->trans[i];
-        if (trans->active)
+#ifdef COAP_EPOLL_EN
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
         {
-            coap_server_trans_destroy(trans);
+            /* wait for the next edge */
+            server->sd_ready = 0;
         }
+#endif
+        return -errno;
+    }
+    if (num == 0)
+    {
+        return -EAGAIN;
+    }
+#ifdef COAP_EPOLL_EN
+    if (num < COAP_SERVER_BATCH_SIZE)
+    {
+        /* the socket has been drained so wait for the next edge */
+        server->sd_ready = 0;
     }
-#ifdef COAP_DTLS_EN
-    coap_server_dtls_destroy(server);
 #endif
-    coap_server_path_list_destroy(&server->sep_list);
-    close(server->sd);
-    memset(server, 0, sizeof(coap_server_t));
+    for (i = 0; i < (unsigned)num; i++)
+    {
+        server->recv_batch[i].len = hdr[i].msg_len;
+        server->recv_batch[i].sin_len = hdr[i].msg_hdr.msg_namelen;
+    }
+    server->recv_num = num;
+    return 0;
 }
 
-unsigned coap_server_get_next_msg_id(coap_server_t *server)
+/**
+ *  @brief Accept an incoming connection
+ *
+ *  @param[in] server Pointer to a server structure
+ *  @param[out] client_sin Pointer to a socket structure
+ *  @param[out] client_sin_len Length of the socket structure
+ *
+ *  Take the next datagram from the receive batch, refilling
+ *  the batch from the socket if it is empty, and get the
+ *  address and port number of the client.
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_accept(coap_server_t *server, coap_ipv_sockaddr_in_t *client_sin, socklen_t *client_sin_len)
 {
-    unsigned char msg_id[2] = {0};
+    int ret = 0;
 
-    server->msg_id++;
-    while (server->msg_id > COAP_MSG_MAX_MSG_ID)
+    if (!coap_server_recv_pending(server))
     {
-        coap_msg_gen_rand_str((char *)msg_id, sizeof(msg_id));
-        server->msg_id = (((unsigned)msg_id[1]) << 8) | (unsigned)msg_id[0];
+        ret = coap_server_recv_batch(server);
+        if (ret < 0)
+        {
+            return ret;
+        }
     }
-    return server->msg_id;
+    server->recv_cur = &server->recv_batch[server->recv_next++];
+    memcpy(client_sin, &server->recv_cur->sin, server->recv_cur->sin_len);
+    *client_sin_len = server->recv_cur->sin_len;
+    return 0;
 }
 
 /**
- *  @brief Check that all of the options in a message are acceptable
- *
- *  For a proxy, options are acceptable if they are safe to forward or recognized or both.
- *  For a server, options are acceptable if they are elective or recognized or both.
+ *  @brief Discard the datagram returned by coap_server_accept
  *
- *  @param[in] msg Pointer to message structure
+ *  The datagram has already been taken from the receive
+ *  batch so there is nothing to do.
  *
- *  @returns Operation status or bad option number
- *  @retval 0 Success
- *  @retval >0 Bad option number
+ *  @param[in,out] server Pointer to a server structure
  */
-static unsigned coap_server_check_options(coap_msg_t *msg)
+static void coap_server_discard(coap_server_t *server)
 {
-#ifdef COAP_PROXY
-    return coap_msg_check_unsafe_ops(msg);
-#else  /* !COAP_PROXY */
-    return coap_msg_check_critical_ops(msg);
-#endif  /* COAP_PROXY */
+    server->recv_cur = NULL;
 }
 
+#else  /* COAP_DTLS_EN */
+
 /**
- *  @brief Search for a transaction structure in a server structure that matches an endpoint
+ *  @brief Accept an incoming connection
  *
  *  @param[in] server Pointer to a server structure
- *  @param[in] client_sin Pointer to a socket structure
- *  @param[in] client_sin_len Length of the socket structure
+ *  @param[out] client_sin Pointer to a socket structure
+ *  @param[out] client_sin_len Length of the socket structure
  *
- *  @returns Pointer to a transaction structure
- *  @retval NULL No matching transaction structure found
+ *  Get the address and port number of the client.
+ *  Do not read the received data.
+ *
+ *  @returns Number of bytes received or error code
+ *  @retval 0 Success
+ *  @retval <0 Error
  */
-static coap_server_trans_t *coap_server_find_trans(coap_server_t *server, coap_ipv_sockaddr_in_t *client_sin, socklen_t client_sin_len)
+static int coap_server_accept(coap_server_t *server, coap_ipv_sockaddr_in_t *client_sin, socklen_t *client_sin_len)
 {
-    coap_server_trans_t *trans = NULL;
-    unsigned i = 0;
+    ssize_t num = 0;
+    char buf[COAP_MSG_MAX_BUF_LEN] = {0};
 
-    for (i = 0; i < COAP_SERVER_NUM_TRANS; i++)
+    *client_sin_len = sizeof(coap_ipv_sockaddr_in_t);
+    num = recvfrom(server->sd, buf, sizeof(buf), MSG_PEEK, (struct sockaddr *)client_sin, client_sin_len);
+    if (num < 0)
     {
-        trans = &server->trans[i];
-        if ((trans->active)
-         && (trans->client_sin_len == client_sin_len)
-         && (memcmp(&trans->client_sin, client_sin, client_sin_len) == 0))
+#ifdef COAP_EPOLL_EN
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
         {
-            coap_log_debug("Found existing transaction at index %u", i);
-            return trans;
+            /* wait for the next edge */
+            server->sd_ready = 0;
         }
+#endif
+        return -errno;
     }
-    return NULL;
+    return 0;
+}
+
+/**
+ *  @brief Discard the datagram returned by coap_server_accept
+ *
+ *  @param[in,out] server Pointer to a server structure
+ */
+static void coap_server_discard(coap_server_t *server)
+{
+    char buf[COAP_MSG_MAX_BUF_LEN] = {0};
+
+    /* coap_server_accept only peeked at the datagram */
+    recv(server->sd, buf, sizeof(buf), 0);
+}
+
+#endif  /* !COAP_DTLS_EN */
+
+int coap_server_add_resource(coap_server_t *server, const char *str, coap_msg_method_t method, coap_server_trans_handler_t handle)
+{
+    coap_server_res_t *res = NULL;
+    int ret = 0;
+
+    if ((method < COAP_MSG_GET) || (method >= COAP_SERVER_RES_NUM_METHODS) || (handle == NULL))
+    {
+        return -EINVAL;
+    }
+    ret = coap_server_res_get(server, str, 1, &res);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    res->handle[method] = handle;
+    return 0;
+}
+
+int coap_server_add_sep_resp_uri_path(coap_server_t *server, const char *str)
+{
+    coap_server_res_t *res = NULL;
+    int ret = 0;
+
+    ret = coap_server_res_get(server, str, 1, &res);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    res->sep = 1;
+    return 0;
+}
+
+int coap_server_cache_create(coap_server_t *server, unsigned num)
+{
+    unsigned num_buckets = 1;
+    unsigned i = 0;
+
+    if (server->cache != NULL)
+    {
+        return -EALREADY;
+    }
+    if (num == 0)
+    {
+        num = COAP_SERVER_CACHE_NUM;
+    }
+    while (num_buckets < num)
+    {
+        num_buckets <<= 1;
+    }
+    server->cache = (coap_server_cache_entry_t *)calloc(num, sizeof(coap_server_cache_entry_t));
+    if (server->cache == NULL)
+    {
+        return -ENOMEM;
+    }
+    server->cache_hash = (coap_server_cache_entry_t **)calloc(num_buckets, sizeof(coap_server_cache_entry_t *));
+    if (server->cache_hash == NULL)
+    {
+        free(server->cache);
+        server->cache = NULL;
+        return -ENOMEM;
+    }
+    server->cache_num = num;
+    server->cache_hash_mask = num_buckets - 1;
+    server->cache_lru_first = NULL;
+    server->cache_lru_last = NULL;
+    server->cache_free = NULL;
+    for (i = num; i > 0; i--)
+    {
+        server->cache[i - 1].hash_next = server->cache_free;
+        server->cache_free = &server->cache[i - 1];
+    }
+    return 0;
 }
 
 /**
- *  @brief Search for an empty transaction structure in a server structure
+ *  @brief Wake a server structure to send notifications
  *
  *  @param[in] server Pointer to a server structure
  *
- *  @returns Pointer to a transaction structure
- *  @retval NULL No empty transaction structures available
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
  */
-static coap_server_trans_t *coap_server_find_empty_trans(coap_server_t *server)
+static int coap_server_wake(coap_server_t *server)
 {
-    coap_server_trans_t *trans = NULL;
+    uint64_t count = 1;
+    ssize_t num = 0;
+
+    num = write(server->notify_fd, &count, sizeof(count));
+    if ((num < 0) && (errno != EAGAIN))
+    {
+        return -errno;
+    }
+    return 0;
+}
+
+int coap_server_notify(coap_server_t *server, const char *str)
+{
+    coap_server_res_t *res = NULL;
+#ifdef COAP_SERVER_THREAD_EN
+    unsigned num = 0;
     unsigned i = 0;
+#endif
+    int ret = 0;
 
-    for (i = 0; i < COAP_SERVER_NUM_TRANS; i++)
+#ifdef COAP_SERVER_THREAD_EN
+    if (server->master != NULL)
+    {
+        /* called from a worker handle call-back function */
+        server = server->master;
+    }
+#endif
+    ret = coap_server_res_get(server, str, 0, &res);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    if (res->handle[COAP_MSG_GET] == NULL)
+    {
+        return -ENOENT;
+    }
+    __atomic_add_fetch(&res->obs_seq, 1, __ATOMIC_ACQ_REL);
+    ret = coap_server_wake(server);
+    if (ret < 0)
     {
-        trans = &server->trans[i];
-        if (!trans->active)
+        return ret;
+    }
+#ifdef COAP_SERVER_THREAD_EN
+    num = __atomic_load_n(&server->num_workers, __ATOMIC_ACQUIRE);
+    for (i = 0; i < num; i++)
+    {
+        ret = coap_server_wake(&server->workers[i]);
+        if (ret < 0)
         {
-            coap_log_debug("Found empty transaction at index %u", i);
-            return trans;
+            return ret;
         }
     }
-    return NULL;
+#endif
+    return 0;
 }
 
 /**
- *  @brief Search for the oldest transaction structure in a server structure
+ *  @brief Determine whether a request warrants a piggy-backed
+ *         response or a separate response
  *
- *  Search for the transaction structure in a server structure that was
- *  used least recently.
+ *  This function makes the decision on whether to send a separate
+ *  response or a piggy-backed response by looking up the URI path
+ *  taken from the request message structure in the resource trie
+ *  and checking whether it was registered as requiring a separate
+ *  response. The idea being that some resources will consistently
+ *  require time to retrieve and others will not.
  *
  *  @param[in] server Pointer to a server structure
+ *  @param[in] msg Pointer to a message structure
  *
- *  @returns Pointer to a transaction structure
+ *  @returns Response type
+ *  @retval COAP_SERVER_PIGGYBACKED Piggy-backed response
+ *  @retval COAP_SERVER_SEPARATE Separate response
+ */ 
+static int coap_server_get_resp_type(coap_server_t *server, coap_msg_t *msg)
+{
+    coap_server_res_t *res = NULL;
+
+    res = coap_server_res_match(server, msg);
+    return ((res != NULL) && (res->sep)) ? COAP_SERVER_SEPARATE : COAP_SERVER_PIGGYBACKED;
+}
+
+/**
+ *  @brief Pass a GET request to the handler for its resource and
+ *         register or deregister the client as an observer
+ *
+ *  A request with an Observe option value of 0 registers the
+ *  client if the handler generates a 2.xx response that fits
+ *  in a single message. The Observe option is then added to
+ *  the response. A value of 1 removes the registration.
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in] res Pointer to the resource structure that matches the request
+ *  @param[in] req Pointer to the request message
+ *  @param[out] resp Pointer to the response message
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
  */
-static coap_server_trans_t *coap_server_find_oldest_trans(coap_server_t *server)
+static int coap_server_trans_handle_get(coap_server_trans_t *trans, coap_server_res_t *res, coap_msg_t *req, coap_msg_t *resp)
 {
-    coap_server_trans_t *oldest = NULL;
-    coap_server_trans_t *trans = NULL;
-    unsigned i = 0;
-    unsigned j = 0;
-    time_t min_last_use = 0;
+    coap_server_obs_t *obs = NULL;
+    coap_msg_op_t *op = NULL;
+    unsigned observe = 0;
+    char val[COAP_SERVER_OBS_MAX_VAL_LEN] = {0};
+    int found = 0;
+    int ret = 0;
 
-    for (i = 0; i < COAP_SERVER_NUM_TRANS; i++)
+    for (op = coap_msg_get_first_op(req); op != NULL; op = coap_msg_op_get_next(op))
     {
-        trans = &server->trans[i];
-        if (trans->active)
+        if (coap_msg_op_get_num(op) == COAP_MSG_OBSERVE)
         {
-            if ((min_last_use == 0) || (trans->last_use < min_last_use))
-            {
-                oldest = trans;
-                min_last_use = trans->last_use;
-                j = i;
-            }
+            ret = coap_msg_op_parse_uint_val(&observe, coap_msg_op_get_val(op), coap_msg_op_get_len(op));
+            found = (ret == 0);
+            break;
         }
     }
-    coap_log_debug("Found oldest transaction at index %u", j);
-    return oldest != NULL ? oldest : &server->trans[0];
+    if ((found) && (observe == 1))
+    {
+        obs = coap_server_obs_find(trans, res);
+        if ((obs != NULL)
+         && (obs->token_len == coap_msg_get_token_len(req))
+         && (memcmp(obs->token, coap_msg_get_token(req), obs->token_len) == 0))
+        {
+            coap_server_obs_delete(obs);
+        }
+    }
+    ret = (*res->handle[COAP_MSG_GET])(trans, req, resp);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    if ((!found)
+     || (observe != 0)
+     || (coap_msg_get_code_class(resp) != COAP_MSG_SUCCESS)
+     || (coap_server_trans_get_type(trans) != COAP_SERVER_TRANS_REGULAR))
+    {
+        return 0;
+    }
+    ret = coap_server_obs_add(trans, res, req, &obs);
+    if (ret == -ENOSPC)
+    {
+        /* respond without an Observe option */
+        coap_log_warn("Too many observations from address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+        return 0;
+    }
+    if (ret < 0)
+    {
+        return ret;
+    }
+    ret = coap_msg_op_format_uint_val(val, sizeof(val), obs->seq & COAP_SERVER_OBS_MAX_SEQ);
+    if (ret < 0)
+    {
+        coap_server_obs_delete(obs);
+        return ret;
+    }
+    ret = coap_msg_add_op(resp, COAP_MSG_OBSERVE, ret, val);
+    if (ret < 0)
+    {
+        coap_server_obs_delete(obs);
+        return ret;
+    }
+    return 0;
 }
 
 /**
- *  @brief Wait for a message to arrive or an acknowledgement
- *         timer in any of the active transactions to expire
+ *  @brief Pass a request to the handler for its resource and method
  *
- *  @param[in,out] server Pointer to a server structure
+ *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in] req Pointer to the request message
+ *  @param[out] resp Pointer to the response message
  *
  *  @returns Operation status
  *  @retval 0 Success
  *  @retval <0 Error
  */
-static int coap_server_listen(coap_server_t *server)
-{
-    coap_server_trans_t *trans = NULL;
-    unsigned i = 0;
-    fd_set read_fds = {{0}};
-    int max_fd = 0;
-    int ret = 0;
+static int coap_server_trans_dispatch(coap_server_trans_t *trans, coap_msg_t *req, coap_msg_t *resp)
+{
+    coap_server_t *server = trans->server;
+    coap_server_res_t *res = NULL;
+    unsigned method = 0;
+    unsigned i = 0;
 
-    while (1)
-    {
-        FD_ZERO(&read_fds);
-        FD_SET(server->sd, &read_fds);
-        max_fd = server->sd;
-        for (i = 0; i < COAP_SERVER_NUM_TRANS; i++)
-        {
-            trans = &server->trans[i];
-            if (trans->active)
-            {
-                FD_SET(trans->timer_fd, &read_fds);
-                if (trans->timer_fd > max_fd)
-                {
-                    max_fd = trans->timer_fd;
-                }
-            }
-        }
-        ret = select(max_fd + 1, &read_fds, NULL, NULL, NULL);
-        if (ret < 0)
-        {
-            return -errno;
-        }
-        if (FD_ISSET(server->sd, &read_fds))
+    res = coap_server_res_match(server, req);
+    method = coap_msg_get_code_detail(req);
+    if ((res != NULL)
+     && (coap_msg_get_code_class(req) == COAP_MSG_REQ)
+     && (method < COAP_SERVER_RES_NUM_METHODS)
+     && (res->handle[method] != NULL))
+    {
+        if (method == COAP_MSG_GET)
         {
-            return 0;
+            return coap_server_trans_handle_get(trans, res, req, resp);
         }
-        for (i = 0; i < COAP_SERVER_NUM_TRANS; i++)
+        return (*res->handle[method])(trans, req, resp);
+    }
+    if (server->handle != NULL)
+    {
+        return (*server->handle)(trans, req, resp);
+    }
+    if (res != NULL)
+    {
+        for (i = 0; i < COAP_SERVER_RES_NUM_METHODS; i++)
         {
-            trans = &server->trans[i];
-            if ((trans->active) && (FD_ISSET(trans->timer_fd, &read_fds)))
+            if (res->handle[i] != NULL)
             {
-                ret = coap_server_trans_handle_ack_timeout(trans);
-                if (ret < 0)
-                {
-                    return ret;
-                }
+                return coap_msg_set_code(resp, COAP_MSG_CLIENT_ERR, COAP_MSG_METHOD_NOT_ALLOWED);
             }
         }
     }
-    return 0;
+    return coap_msg_set_code(resp, COAP_MSG_CLIENT_ERR, COAP_MSG_NOT_FOUND);
 }
 
 /**
- *  @brief Accept an incoming connection
+ *  @brief Answer a request with a stored response
  *
- *  @param[in] server Pointer to a server structure
- *  @param[out] client_sin Pointer to a socket structure
- *  @param[out] client_sin_len Length of the socket structure
+ *  The stored response, or the stored 2.03 (Valid) response
+ *  if an ETag option of the request matches, is sent with
+ *  the message ID and token of the request and with the
+ *  remaining lifetime of the entry as its Max-Age option.
+ *  The request and response are recorded in the transaction
+ *  structure so that duplicate requests are answered as
+ *  usual. The recorded response refers to the formatted
+ *  response in the transaction structure rather than
+ *  copying its options and payload.
  *
- *  Get the address and port number of the client.
- *  Do not read the received data.
+ *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in] entry Pointer to a response cache entry structure
+ *  @param[in] req Pointer to the request message
  *
- *  @returns Number of bytes received or error code
+ *  @returns Operation status
  *  @retval 0 Success
  *  @retval <0 Error
  */
-static int coap_server_accept(coap_server_t *server, coap_ipv_sockaddr_in_t *client_sin, socklen_t *client_sin_len)
+static int coap_server_trans_send_cached(coap_server_trans_t *trans, coap_server_cache_entry_t *entry, coap_msg_t *req)
 {
+    struct timespec now = {0};
+    const char *tmpl = NULL;
+    size_t tmpl_len = 0;
+    size_t max_age_off = 0;
+    unsigned max_age = 0;
+    unsigned msg_id = 0;
+    unsigned type = 0;
     ssize_t num = 0;
-    char buf[COAP_MSG_MAX_BUF_LEN] = {0};
 
-    *client_sin_len = sizeof(coap_ipv_sockaddr_in_t);
-    num = recvfrom(server->sd, buf, sizeof(buf), MSG_PEEK, (struct sockaddr *)client_sin, client_sin_len);
+    if (coap_server_cache_match_etag(entry, req))
+    {
+        tmpl = entry->valid;
+        tmpl_len = entry->valid_len;
+        max_age_off = entry->valid_max_age_off;
+    }
+    else
+    {
+        tmpl = entry->resp;
+        tmpl_len = entry->resp_len;
+        max_age_off = entry->resp_max_age_off;
+    }
+    /* whole seconds left before the entry expires */
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (now.tv_sec < entry->expiry.tv_sec)
+    {
+        max_age = entry->expiry.tv_sec - now.tv_sec;
+        if (now.tv_nsec > entry->expiry.tv_nsec)
+        {
+            max_age--;
+        }
+    }
+    if (coap_msg_get_type(req) == COAP_MSG_CON)
+    {
+        type = COAP_MSG_ACK;
+        msg_id = coap_msg_get_msg_id(req);
+    }
+    else
+    {
+        type = COAP_MSG_NON;
+        msg_id = coap_server_get_next_msg_id(trans->server);
+    }
+    coap_server_trans_release_resp_buf(trans);
+    num = coap_server_cache_format_resp(tmpl, tmpl_len, max_age_off, max_age, type, msg_id,
+                                        coap_msg_get_token(req), coap_msg_get_token_len(req),
+                                        trans->resp_buf, sizeof(trans->resp_buf));
     if (num < 0)
     {
-        return -errno;
+        return num;
     }
-    return 0;
-}
-
-int coap_server_add_sep_resp_uri_path(coap_server_t *server, const char *str)
-{
-    return coap_server_path_list_add(&server->sep_list, str);
-}
-
-/**
- *  @brief Determine whether a request warrants a piggy-backed
- *         response or a separate response
- *
- *  This function makes the decision on whether to send a separate
- *  response or a piggy-backed response by searching for the URI
- *  path taken from the request message structure in a user supplied
- *  URI path list. The idea being that some resources will consistently
- *  require time to retrieve and others will not.
- *
- *  @param[in] server Pointer to a server structure
- *  @param[in] msg Pointer to a message structure
- *
- *  @returns Response type
- *  @retval COAP_SERVER_PIGGYBACKED Piggy-backed response
- *  @retval COAP_SERVER_SEPARATE Separate response
- */ 
-static int coap_server_get_resp_type(coap_server_t *server, coap_msg_t *msg)
-{
-    char buf[COAP_MSG_OP_URI_PATH_MAX_LEN] = {0};
-    int match = 0;
-
-    coap_msg_uri_path_to_str(msg, buf, sizeof(buf));
-    match = coap_server_path_list_match(&server->sep_list, buf);
-    return match ? COAP_SERVER_SEPARATE : COAP_SERVER_PIGGYBACKED;
+    trans->resp_len = num;
+    num = coap_server_trans_send_resp_buf(trans);
+    if (num < 0)
+    {
+        return num;
+    }
+    num = coap_msg_parse_view(&trans->resp, trans->resp_buf, trans->resp_len);
+    if (num < 0)
+    {
+        return num;
+    }
+    return coap_server_trans_set_req(trans, req);
 }
 
 /**
@@ -2240,18 +5689,31 @@ static int coap_server_exchange(coap_server_t *server)
 {
     coap_ipv_sockaddr_in_t client_sin = {0};
     coap_server_trans_t *trans = NULL;
-    coap_msg_t *prev_resp_msg = NULL;
+    coap_server_cache_entry_t *entry = NULL;
+    coap_server_dedup_t *dedup = NULL;
     coap_msg_t recv_msg = {0};
     coap_msg_t send_msg = {0};
     socklen_t client_sin_len = 0;
     unsigned op_num = 0;
     unsigned msg_id = 0;
+    unsigned method = 0;
+    size_t cache_key_len = 0;
+    size_t cache_path_len = 0;
+    unsigned cache_gen = 0;
     ssize_t num = 0;
+    char recv_buf[COAP_MSG_MAX_BUF_LEN] = {0};
+    char cache_key[COAP_SERVER_CACHE_KEY_LEN] = {0};
+    int cacheable = 0;
     int resp_type = 0;
     int ret = 0;
 
     /* accept incoming connection */
+    coap_server_stats_begin(server);
     ret = coap_server_accept(server, &client_sin, &client_sin_len);
+    if (ret == -EAGAIN)
+    {
+        return 0;
+    }
     if (ret < 0)
     {
         return ret;
@@ -2265,7 +5727,18 @@ static int coap_server_exchange(coap_server_t *server)
         if (trans == NULL)
         {
             trans = coap_server_find_oldest_trans(server);
+            if ((coap_server_trans_has_exchange(trans))
+             && (coap_server_dedup_full(server)))
+            {
+                /* reusing the transaction structure now would forget */
+                /* a request that the client may still retransmit */
+                coap_log_warn("Ignored request from a new client as the message ID deduplication table is full");
+                coap_server_discard(server);
+                return 0;
+            }
+            coap_server_stats_inc(server, num_evict);
             coap_server_trans_destroy(trans);
+            trans = coap_server_find_empty_trans(server);
         }
         ret = coap_server_trans_create(trans, server, &client_sin, client_sin_len);
         if (ret < 0)
@@ -2282,7 +5755,7 @@ static int coap_server_exchange(coap_server_t *server)
 
     /* receive message */
     coap_msg_create(&recv_msg);
-    num = coap_server_trans_recv(trans, &recv_msg);
+    num = coap_server_trans_recv(trans, &recv_msg, recv_buf, sizeof(recv_buf));
     if (num == -EAGAIN)
     {
         coap_msg_destroy(&recv_msg);
@@ -2302,6 +5775,7 @@ static int coap_server_exchange(coap_server_t *server)
         {
             /* message deduplication */
             coap_log_info("Received duplicate confirmable request from address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+            coap_server_stats_inc(server, num_dup);
             resp_type = coap_server_get_resp_type(server, &recv_msg);
             if (resp_type == COAP_SERVER_SEPARATE)
             {
@@ -2317,8 +5791,7 @@ static int coap_server_exchange(coap_server_t *server)
             else
             {
                 /* send the previous piggy-backed response */
-                prev_resp_msg = coap_server_trans_get_resp(trans);
-                num = coap_server_trans_send(trans, prev_resp_msg);
+                num = coap_server_trans_send_resp_buf(trans);
                 coap_msg_destroy(&recv_msg);
                 if (num < 0)
                 {
@@ -2333,6 +5806,41 @@ static int coap_server_exchange(coap_server_t *server)
             /* message deduplication */
             /* do not acknowledge the (non-confirmable) request again */
             coap_log_info("Received duplicate non-confirmable request from address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+            coap_server_stats_inc(server, num_dup);
+            coap_msg_destroy(&recv_msg);
+            return 0;
+        }
+    }
+
+    /* check for a duplicate of a request whose transaction has been recycled */
+    if ((coap_msg_get_code_class(&recv_msg) == COAP_MSG_REQ)
+     && (coap_msg_get_code_detail(&recv_msg) != 0))
+    {
+        dedup = coap_server_dedup_find(server, &trans->client_sin, trans->client_sin_len, coap_msg_get_msg_id(&recv_msg));
+        if ((dedup != NULL) && (dedup->type == coap_msg_get_type(&recv_msg)))
+        {
+            coap_log_info("Received duplicate request from address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+            coap_server_stats_inc(server, num_dup);
+            if (coap_msg_get_type(&recv_msg) == COAP_MSG_CON)
+            {
+                if (dedup->resp != NULL)
+                {
+                    /* send the previous piggy-backed response */
+                    /* without disturbing the response of the current exchange */
+                    num = coap_server_trans_send_buf(trans, dedup->resp, dedup->resp_len);
+                }
+                else
+                {
+                    /* send another acknowledgement */
+                    num = coap_server_trans_send_ack(trans, &recv_msg);
+                }
+                if (num < 0)
+                {
+                    coap_msg_destroy(&recv_msg);
+                    coap_server_trans_destroy(trans);
+                    return num;
+                }
+            }
             coap_msg_destroy(&recv_msg);
             return 0;
         }
@@ -2371,6 +5879,15 @@ static int coap_server_exchange(coap_server_t *server)
         }
     }
 
+    /* check for a reset in reply to a notification */
+    if ((coap_msg_get_type(&recv_msg) == COAP_MSG_RST)
+     && (coap_server_obs_handle_reset(trans, &recv_msg)))
+    {
+        coap_log_info("Received reset to notification from address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+        coap_msg_destroy(&recv_msg);
+        return 0;
+    }
+
     /* check for a valid request */
     if ((coap_msg_get_type(&recv_msg) == COAP_MSG_ACK)
      || (coap_msg_get_type(&recv_msg) == COAP_MSG_RST)
@@ -2381,6 +5898,7 @@ static int coap_server_exchange(coap_server_t *server)
         coap_server_trans_destroy(trans);
         return -EBADMSG;
     }
+    coap_server_stats_inc(server, num_req);
 
     if (coap_msg_get_type(&recv_msg) == COAP_MSG_CON)
     {
@@ -2409,6 +5927,33 @@ static int coap_server_exchange(coap_server_t *server)
         }
     }
 
+    /* answer from the response cache if possible */
+    method = coap_msg_get_code_detail(&recv_msg);
+    if ((server->cache != NULL)
+     && (method == COAP_MSG_GET)
+     && (resp_type == COAP_SERVER_PIGGYBACKED)
+     && (coap_server_trans_get_type(trans) == COAP_SERVER_TRANS_REGULAR)
+     && (coap_server_cache_key(&recv_msg, cache_key, &cache_key_len, &cache_path_len) == 0))
+    {
+        cacheable = 1;
+#ifdef COAP_SERVER_THREAD_EN
+        cache_gen = __atomic_load_n(coap_server_cache_gen(server, cache_key, cache_path_len), __ATOMIC_ACQUIRE);
+#endif
+        entry = coap_server_cache_find(server, cache_key, cache_key_len);
+    }
+    if (entry != NULL)
+    {
+        coap_log_info("Responding from the cache to address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
+        ret = coap_server_trans_send_cached(trans, entry, &recv_msg);
+        coap_msg_destroy(&recv_msg);
+        if (ret < 0)
+        {
+            coap_server_trans_destroy(trans);
+            return ret;
+        }
+        return 0;
+    }
+
     /* send an acknowledgement if necessary */
     if ((coap_msg_get_type(&recv_msg) == COAP_MSG_CON)
      && (resp_type == COAP_SERVER_SEPARATE))
@@ -2425,6 +5970,7 @@ static int coap_server_exchange(coap_server_t *server)
     /* generate response */
     coap_log_info("Responding to address %s and port %u", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT));
     coap_msg_create(&send_msg);
+    coap_server_stats_begin(server);
     /* check options */
     op_num = coap_server_check_options(&recv_msg);
     if (op_num != 0)
@@ -2437,7 +5983,15 @@ static int coap_server_exchange(coap_server_t *server)
     }
     else
     {
-        ret = (*server->handle)(trans, &recv_msg, &send_msg);
+        ret = coap_server_trans_dispatch(trans, &recv_msg, &send_msg);
+    }
+    if ((server->cache != NULL)
+     && ((method == COAP_MSG_PUT) || (method == COAP_MSG_POST) || (method == COAP_MSG_DELETE)))
+    {
+        /* invalidate once each block has been handled so that neither */
+        /* the first block nor the completion of a blockwise transfer */
+        /* leaves a response stored by another client or worker */
+        coap_server_cache_invalidate(server, &recv_msg);
     }
     if (ret < 0)
     {
@@ -2446,6 +6000,19 @@ static int coap_server_exchange(coap_server_t *server)
         coap_msg_destroy(&recv_msg);
         return ret;
     }
+    coap_server_stats_end(server, COAP_SERVER_STAGE_HANDLER);
+    /* store the response before the message ID and token are set */
+    if ((cacheable)
+     && (coap_server_trans_get_type(trans) == COAP_SERVER_TRANS_REGULAR)
+     && (coap_msg_get_code_class(&send_msg) == COAP_MSG_SUCCESS)
+     && (coap_msg_get_code_detail(&send_msg) == COAP_MSG_CONTENT))
+    {
+        ret = coap_server_cache_add(server, cache_key, cache_key_len, cache_path_len, cache_gen, &send_msg);
+        if (ret < 0)
+        {
+            coap_log_warn("Failed to store response to address %s and port %u: %s", trans->client_addr, ntohs(trans->client_sin.COAP_IPV_SIN_PORT), strerror(-ret));
+        }
+    }
     if ((coap_msg_get_type(&recv_msg) == COAP_MSG_CON)
      && (resp_type == COAP_SERVER_PIGGYBACKED))
     {
@@ -2497,7 +6064,16 @@ static int coap_server_exchange(coap_server_t *server)
     }
 
     /* send response */
-    num = coap_server_trans_send(trans, &send_msg);
+    num = coap_server_trans_format_resp(trans, &send_msg);
+    if (num < 0)
+    {
+        coap_msg_destroy(&send_msg);
+        coap_server_trans_destroy(trans);
+        coap_msg_destroy(&recv_msg);
+        return num;
+    }
+    coap_server_stats_end(server, COAP_SERVER_STAGE_FORMAT);
+    num = coap_server_trans_send_resp_buf(trans);
     if (num < 0)
     {
         coap_msg_destroy(&send_msg);
@@ -2505,6 +6081,7 @@ static int coap_server_exchange(coap_server_t *server)
         coap_msg_destroy(&recv_msg);
         return num;
     }
+    coap_server_stats_end(server, COAP_SERVER_STAGE_SEND);
 
     /* record the request in the transaction structure */
     ret = coap_server_trans_set_req(trans, &recv_msg);
@@ -2571,3 +6148,207 @@ int coap_server_run(coap_server_t *server)
     }
     return 0;
 }
+
+#ifdef COAP_SERVER_THREAD_EN
+
+/**
+ *  @brief Initialise a worker server structure
+ *
+ *  Open a socket bound to the same address and port as
+ *  the server socket. The worker shares the handle call-back
+ *  function, the resource trie and the DTLS credentials of
+ *  the server.
+ *
+ *  @param[out] worker Pointer to a worker server structure
+ *  @param[in] server Pointer to a server structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int coap_server_worker_create(coap_server_t *worker, coap_server_t *server)
+{
+    coap_ipv_sockaddr_in_t sin = {0};
+    socklen_t sin_len = 0;
+    int opt_val = 0;
+    int ret = 0;
+
+    memset(worker, 0, sizeof(coap_server_t));
+    sin_len = sizeof(sin);
+    ret = getsockname(server->sd, (struct sockaddr *)&sin, &sin_len);
+    if (ret < 0)
+    {
+        return -errno;
+    }
+    worker->sd = socket(COAP_IPV_AF_INET, SOCK_DGRAM, 0);
+    if (worker->sd < 0)
+    {
+        return -errno;
+    }
+    opt_val = 1;
+    ret = setsockopt(worker->sd, SOL_SOCKET, SO_REUSEADDR, &opt_val, (socklen_t)sizeof(opt_val));
+    if (ret == 0)
+    {
+        ret = setsockopt(worker->sd, SOL_SOCKET, SO_REUSEPORT, &opt_val, (socklen_t)sizeof(opt_val));
+    }
+    if (ret == 0)
+    {
+        ret = bind(worker->sd, (struct sockaddr *)&sin, sin_len);
+    }
+    if (ret < 0)
+    {
+        ret = -errno;
+        close(worker->sd);
+        memset(worker, 0, sizeof(coap_server_t));
+        return ret;
+    }
+    ret = coap_server_open(worker, server->num_trans);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    worker->res_root = server->res_root;
+    worker->res_hash = server->res_hash;
+    worker->res_hash_mask = server->res_hash_mask;
+    worker->res_num = server->res_num;
+    worker->handle = server->handle;
+    worker->master = server;
+    if (server->cache != NULL)
+    {
+        ret = coap_server_cache_create(worker, server->cache_num);
+        if (ret < 0)
+        {
+            coap_server_close(worker);
+            memset(worker, 0, sizeof(coap_server_t));
+            return ret;
+        }
+    }
+#ifdef COAP_DTLS_EN
+    worker->cred = server->cred;
+    worker->priority = server->priority;
+    worker->dh_params = server->dh_params;
+#endif
+    return 0;
+}
+
+/**
+ *  @brief Deinitialise a worker server structure
+ *
+ *  The resource trie and the DTLS credentials are owned
+ *  by the server structure and are not released.
+ *
+ *  @param[in,out] worker Pointer to a worker server structure
+ */
+static void coap_server_worker_destroy(coap_server_t *worker)
+{
+    coap_server_close(worker);
+    memset(worker, 0, sizeof(coap_server_t));
+}
+
+/**
+ *  @brief Make a running server structure stop
+ *
+ *  Set the stop flag and expire the timer so that a
+ *  worker blocked waiting for events wakes up and
+ *  returns -ECANCELED from coap_server_run.
+ *
+ *  @param[in,out] worker Pointer to a worker server structure
+ */
+static void coap_server_worker_stop(coap_server_t *worker)
+{
+    struct itimerspec its = {{0}};
+
+    __atomic_store_n(&worker->stop, 1, __ATOMIC_RELEASE);
+    its.it_value.tv_nsec = 1;
+    timerfd_settime(worker->timer_fd, 0, &its, NULL);
+}
+
+/**
+ *  @brief Worker thread function
+ *
+ *  @param[in,out] arg Pointer to a worker server structure
+ *
+ *  @returns NULL
+ */
+static void *coap_server_worker_func(void *arg)
+{
+    coap_server_t *worker = (coap_server_t *)arg;
+    int ret = 0;
+
+    ret = coap_server_run(worker);
+    if ((ret < 0) && (ret != -ECANCELED) && (ret != -1))
+    {
+        coap_log_error("Worker stopped: %s", strerror(-ret));
+    }
+    return NULL;
+}
+
+int coap_server_run_workers(coap_server_t *server, unsigned num_workers)
+{
+    coap_server_t *workers = NULL;
+    pthread_t *threads = NULL;
+    unsigned num = 0;
+    unsigned i = 0;
+    long num_cpus = 0;
+    int ret = 0;
+
+    if (num_workers == 0)
+    {
+        num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_workers = (num_cpus > 0) ? (unsigned)num_cpus : 1;
+    }
+    if (num_workers == 1)
+    {
+        return coap_server_run(server);
+    }
+    workers = calloc(num_workers - 1, sizeof(coap_server_t));
+    if (workers == NULL)
+    {
+        return -ENOMEM;
+    }
+    threads = calloc(num_workers - 1, sizeof(pthread_t));
+    if (threads == NULL)
+    {
+        free(workers);
+        return -ENOMEM;
+    }
+    for (num = 0; num < num_workers - 1; num++)
+    {
+        ret = coap_server_worker_create(&workers[num], server);
+        if (ret < 0)
+        {
+            break;
+        }
+        ret = pthread_create(&threads[num], NULL, coap_server_worker_func, &workers[num]);
+        if (ret != 0)
+        {
+            coap_server_worker_destroy(&workers[num]);
+            ret = -ret;
+            break;
+        }
+    }
+    if (ret == 0)
+    {
+        /* let coap_server_notify wake the workers */
+        server->workers = workers;
+        __atomic_store_n(&server->num_workers, num, __ATOMIC_RELEASE);
+        coap_log_notice("Running %u workers", num_workers);
+        ret = coap_server_run(server);
+        __atomic_store_n(&server->num_workers, 0, __ATOMIC_RELEASE);
+        server->workers = NULL;
+    }
+    for (i = 0; i < num; i++)
+    {
+        coap_server_worker_stop(&workers[i]);
+    }
+    for (i = 0; i < num; i++)
+    {
+        pthread_join(threads[i], NULL);
+        coap_server_worker_destroy(&workers[i]);
+    }
+    free(threads);
+    free(workers);
+    return ret;
+}
+
+#endif  /* COAP_SERVER_THREAD_EN */
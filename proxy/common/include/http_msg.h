@@ -69,6 +69,23 @@ typedef struct
 }
 http_msg_list_t;
 
+/**
+ *  @brief Message parser structure
+ *
+ *  Holds the position reached while parsing a message
+ *  that has not been received in full so that parsing
+ *  can continue where it stopped when more data arrives.
+ */
+typedef struct
+{
+    int state;                                                                  /**< Part of the message being parsed */
+    size_t pos;                                                                 /**< Number of bytes parsed */
+    size_t scan;                                                                /**< Offset at which to continue the search for the end of a line */
+    size_t len;                                                                 /**< Length of the message body or of the current chunk */
+    size_t body_size;                                                           /**< Size of the memory allocated for a chunked message body */
+}
+http_msg_parser_t;
+
 /**
  *  @brief Message structure
  */
@@ -124,6 +141,42 @@ void http_msg_reset(http_msg_t *msg);
  */
 ssize_t http_msg_parse(http_msg_t *msg, const char *buf, size_t len);
 
+/**
+ *  @brief Initialise a message parser structure
+ *
+ *  A parser is ready for the next message after it has
+ *  returned a complete message or an error so this is
+ *  only needed to abandon a message part way through.
+ *
+ *  @param[out] parser Pointer to a message parser structure
+ */
+void http_msg_parser_create(http_msg_parser_t *parser);
+
+/**
+ *  @brief Parse the next part of a message
+ *
+ *  The buffer holds the part of the message received so
+ *  far, starting from its first byte. Each call continues
+ *  from the position reached by the previous call, so each
+ *  byte is only examined once no matter how many calls it
+ *  takes for the message to arrive. The buffer is parsed
+ *  in place and is not modified. It may be moved between
+ *  calls but the bytes already in it must not change. The
+ *  message structure is reset at the start of a message
+ *  and must not be changed until the message is complete.
+ *
+ *  @param[in,out] parser Pointer to a message parser structure
+ *  @param[in,out] msg Pointer to a message structure
+ *  @param[in] buf Pointer to a buffer containing the message received so far
+ *  @param[in] len Length of the buffer containing the message received so far
+ *
+ *  @returns Number of bytes parsed or error code
+ *  @retval >0 Number of bytes in the complete message
+ *  @retval -EAGAIN The message is incomplete
+ *  @retval <0 Error code
+ */
+ssize_t http_msg_parse_next(http_msg_parser_t *parser, http_msg_t *msg, const char *buf, size_t len);
+
 /**
  *  @brief Set the start line in a message
  *
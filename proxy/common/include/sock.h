@@ -70,7 +70,8 @@
 #define SOCK_PEER_CERT_VERIFY_ERROR         -30
 #define SOCK_CLOSE_ERROR                    -31
 #define SOCK_LOCK_ERROR                     -32
-#define SOCK_NUM_ERRORS                      33
+#define SOCK_AGAIN                          -33
+#define SOCK_NUM_ERRORS                      34
 
 #ifdef SOCK_IP6
 
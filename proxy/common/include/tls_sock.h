@@ -91,8 +91,10 @@ int tls_sock_rehandshake(tls_sock_t *s);
 void tls_sock_get_addr_string_(char *out, size_t out_len, sock_in_addr_t sin_addr);
 ssize_t tls_sock_read(tls_sock_t *s, void *buf, size_t len);
 ssize_t tls_sock_read_full(tls_sock_t *s, void *buf, size_t len);
+ssize_t tls_sock_try_read(tls_sock_t *s, void *buf, size_t len);
 ssize_t tls_sock_write(tls_sock_t *s, void *buf, size_t len);
 ssize_t tls_sock_write_full(tls_sock_t *s, void *buf, size_t len);
+ssize_t tls_sock_try_write(tls_sock_t *s, void *buf, size_t len);
 
 int tls_ssock_open(tls_ssock_t *ss, tls_server_t *server, const char *port, int timeout, int backlog);
 void tls_ssock_close(tls_ssock_t *ss);
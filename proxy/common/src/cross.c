@@ -37,7 +37,7 @@
 #include "cross.h"
 #include "uri.h"
 
-#define CROSS_NUM_HTTP_RESP  5                                                  /**< Number of HTTP response codes */
+#define CROSS_NUM_HTTP_RESP  7                                                  /**< Number of HTTP response codes */
 #define CROSS_COAP_SCHEME    "coaps"                                            /**< CoAP scheme */
 #define CROSS_TMP_BUF_LEN    256                                                /**< Length of temporary buffer */
 
@@ -51,6 +51,8 @@ static const char *cross_http_resp_str[CROSS_NUM_HTTP_RESP + 1] =
     "Internal Server Error",                                                    /**< 500 Internal Server Error HTTP response description */
     "Not Implemented",                                                          /**< 501 Not Implemented HTTP response description */
     "Bad Gateway",                                                              /**< 502 Bad Gateway HTTP response description */
+    "Service Unavailable",                                                      /**< 503 Service Unavailable HTTP response description */
+    "Gateway Timeout",                                                          /**< 504 Gateway Timeout HTTP response description */
     "(Unknown)"                                                                 /**< Unknown HTTP response description */
 };
 
@@ -68,6 +70,10 @@ const char *cross_http_resp_code_to_str(unsigned code)
         return cross_http_resp_str[3];
     case 502:
         return cross_http_resp_str[4];
+    case 503:
+        return cross_http_resp_str[5];
+    case 504:
+        return cross_http_resp_str[6];
     }
     return cross_http_resp_str[CROSS_NUM_HTTP_RESP];
 }
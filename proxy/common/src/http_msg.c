@@ -35,6 +35,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdint.h>
 #include <errno.h>
 #include "http_msg.h"
 #include "util.h"
@@ -143,6 +144,21 @@ static void http_msg_list_destroy(http_msg_list_t *list)
     memset(list, 0, sizeof(http_msg_list_t));
 }
 
+/**
+ *  @brief Append a message header to a message header linked-list structure
+ *
+ *  @param[in,out] list Pointer to a message header linked-list structure
+ *  @param[in] header Pointer to a message header structure
+ */
+static void http_msg_list_append(http_msg_list_t *list, http_msg_header_t *header)
+{
+    if (list->first == NULL)
+        list->first = header;
+    else
+        list->last->next = header;
+    list->last = header;
+}
+
 /**
  *  @brief Add a message header to a message header linked-list structure
  *
@@ -159,58 +175,83 @@ static int http_msg_list_add(http_msg_list_t *list, const char *name, const char
     header = http_msg_header_new(name, value);
     if (header == NULL)
         return -ENOMEM;
-    if (list->first == NULL)
-        list->first = header;
-    else
-        list->last->next = header;
-    list->last = header;
+    http_msg_list_append(list, header);
     return 0;
 }
 
 /**
- *  @brief Remove redundant whitespace from a message field
+ *  @brief Copy a message field into a new string
+ *
+ *  @param[in] str Pointer to the message field
+ *  @param[in] len Length of the message field
+ *
+ *  @returns String containing the message field or NULL
+ *  @retval String containing the message field, Success
+ *  @retval NULL, Out-of-memory
+ */
+static char *http_msg_dup(const char *str, size_t len)
+{
+    char *dup = NULL;
+
+    dup = malloc(len + 1);
+    if (dup == NULL)
+    {
+        return NULL;
+    }
+    memcpy(dup, str, len);
+    dup[len] = '\0';
+    return dup;
+}
+
+/**
+ *  @brief Copy a message field into a new string without redundant whitespace
  *
  *  Remove leading and trailing whitespace and replace each
  *  contiguous sequence of whitespace with a single space.
  *
- *  @param[in,out] str String containing the message field
+ *  @param[in] str Pointer to the message field
+ *  @param[in] len Length of the message field
  *
- *  @returns String containing the trimmed message field
+ *  @returns String containing the trimmed message field or NULL
+ *  @retval String containing the trimmed message field, Success
+ *  @retval NULL, Out-of-memory
  */
-static char *http_msg_trim_ws(char *str)
+static char *http_msg_dup_ws(const char *str, size_t len)
 {
-    char *s = NULL;
+    const char *end = str + len;
+    char *dup = NULL;
     char *d = NULL;
     int sp = 0;
 
-    while (isspace(*str))
+    dup = malloc(len + 1);
+    if (dup == NULL)
     {
-        *str++ = '\0';
+        return NULL;
+    }
+    while ((str < end) && isspace((unsigned char)*str))
+    {
+        str++;
     }
-    s = str;
-    d = str;
-    while (*s != '\0')
+    d = dup;
+    while (str < end)
     {
-        if (isspace(*s))
+        if (isspace((unsigned char)*str))
         {
             sp = 1;
-            s++;
-        }
-        else if (sp)
-        {
-            *d++ = ' ';
-            sp = 0;
         }
         else
         {
-            *d++ = *s++;
+            if (sp)
+            {
+                *d++ = ' ';
+                sp = 0;
+            }
+            *d++ = *str;
         }
+        str++;
     }
-    while (d < s)
-    {
-        *d++ = '\0';
-    }
-    return str;
+    *d = '\0';
+    return dup;
 }
 
 void http_msg_create(http_msg_t *msg)
@@ -244,146 +285,230 @@ void http_msg_reset(http_msg_t *msg)
     http_msg_create(msg);
 }
 
+#define HTTP_MSG_PARSE_START       0                                            /**< Parsing the start line */
+#define HTTP_MSG_PARSE_HEADERS     1                                            /**< Parsing the headers */
+#define HTTP_MSG_PARSE_BODY        2                                            /**< Waiting for a message body with a known length */
+#define HTTP_MSG_PARSE_CHUNK_SIZE  3                                            /**< Parsing a chunk-size line */
+#define HTTP_MSG_PARSE_CHUNK_DATA  4                                            /**< Waiting for chunk data */
+#define HTTP_MSG_PARSE_TRAILERS    5                                            /**< Parsing the trailers */
+
+void http_msg_parser_create(http_msg_parser_t *parser)
+{
+    memset(parser, 0, sizeof(http_msg_parser_t));
+    parser->state = HTTP_MSG_PARSE_START;
+}
+
+/**
+ *  @brief Find the end of the line that starts at the parse position
+ *
+ *  The search continues from where the previous search
+ *  stopped so the same bytes are not searched twice.
+ *
+ *  @param[in,out] parser Pointer to a message parser structure
+ *  @param[in] buf Pointer to a buffer containing the message
+ *  @param[in] len Length of the buffer containing the message
+ *
+ *  @returns Offset of the "\r\n" that ends the line or error code
+ *  @retval >=0 Offset of the "\r\n"
+ *  @retval -EAGAIN The line is incomplete
+ */
+static ssize_t http_msg_parser_find_eol(http_msg_parser_t *parser, const char *buf, size_t len)
+{
+    const char *lf = NULL;
+
+    if (parser->scan < parser->pos + 1)
+    {
+        parser->scan = parser->pos + 1;
+    }
+    while (parser->scan < len)
+    {
+        lf = memchr(buf + parser->scan, '\n', len - parser->scan);
+        if (lf == NULL)
+        {
+            parser->scan = len;
+            return -EAGAIN;
+        }
+        parser->scan = lf - buf;
+        if (*(lf - 1) == '\r')
+        {
+            return parser->scan - 1;
+        }
+        parser->scan++;
+    }
+    return -EAGAIN;
+}
+
+/**
+ *  @brief Move the parse position past the end of a line
+ *
+ *  @param[in,out] parser Pointer to a message parser structure
+ *  @param[in] eol Offset of the "\r\n" that ends the line
+ */
+static void http_msg_parser_next_line(http_msg_parser_t *parser, size_t eol)
+{
+    parser->pos = eol + 2;
+    parser->scan = parser->pos;
+}
+
 /**
  *  @brief Parse the start line in a message
  *
+ *  @param[in,out] parser Pointer to a message parser structure
  *  @param[out] msg Pointer to a message structure
- *  @param[in,out] str String containing the message
+ *  @param[in] buf Pointer to a buffer containing the message
+ *  @param[in] len Length of the buffer containing the message
  *
- *  @returns Number of bytes parsed or error code
- *  @retval >0 Number of bytes parsed
+ *  @returns Error code
+ *  @retval 0 Success
  *  @retval <0 Error code
  */
-static ssize_t http_msg_parse_start(http_msg_t *msg, char *str)
+static int http_msg_parse_start(http_msg_parser_t *parser, http_msg_t *msg, const char *buf, size_t len)
 {
-    size_t len = 0;
-    char *start = NULL;
-    char *next = str;
-    char *end = NULL;
+    const char *start = NULL;
+    const char *next = NULL;
+    const char *end = NULL;
+    ssize_t eol = 0;
     int i = 0;
 
-    end = strstr(str, "\r\n");
-    if (end == NULL)
+    eol = http_msg_parser_find_eol(parser, buf, len);
+    if (eol < 0)
     {
-        return -EAGAIN;
+        return eol;
     }
-    *end++ = '\0';
-    *end++ = '\0';
-
+    next = buf + parser->pos;
+    end = buf + eol;
     for (i = 0; i < HTTP_MSG_NUM_START; i++)
     {
         start = next;
         if (i < HTTP_MSG_NUM_START - 1)
         {
-            next = strchr(start, ' ');
+            next = memchr(start, ' ', end - start);
             if (next == NULL)
             {
                 return -EBADMSG;
             }
-            *next++ = '\0';
         }
-        len = strlen(start);
-        if (len == 0)
+        else
+        {
+            next = end;
+        }
+        if (next == start)
         {
             return -EBADMSG;
         }
-        msg->start[i] = malloc(len + 1);
+        msg->start[i] = http_msg_dup(start, next - start);
         if (msg->start[i] == NULL)
         {
             return -ENOMEM;
         }
-        strncpy(msg->start[i], start, len);
-        msg->start[i][len] = '\0';
+        next++;
+    }
+    http_msg_parser_next_line(parser, eol);
+    return 0;
+}
+
+/**
+ *  @brief Parse a header in a message
+ *
+ *  @param[in,out] msg Pointer to a message structure
+ *  @param[in] str Pointer to the header
+ *  @param[in] len Length of the header
+ *
+ *  @returns Error code
+ *  @retval 0 Success
+ *  @retval <0 Error code
+ */
+static int http_msg_parse_header(http_msg_t *msg, const char *str, size_t len)
+{
+    http_msg_header_t *header = NULL;
+    const char *value = NULL;
+
+    value = memchr(str, ':', len);
+    if (value == NULL)
+    {
+        return -EBADMSG;
     }
-    return end - str;
+    value++;
+    header = (http_msg_header_t *)calloc(1, sizeof(http_msg_header_t));
+    if (header == NULL)
+    {
+        return -ENOMEM;
+    }
+    header->name = http_msg_dup_ws(str, (value - 1) - str);
+    header->value = http_msg_dup_ws(value, (str + len) - value);
+    if ((header->name == NULL) || (header->value == NULL))
+    {
+        http_msg_header_delete(header);
+        return -ENOMEM;
+    }
+    http_msg_list_append(&msg->header, header);
+    return 0;
 }
 
 /**
- *  @brief Parse the headers in a message
+ *  @brief Parse the headers or trailers in a message
  *
+ *  A header that continues on the next line is only
+ *  complete once the first byte of the next line has
+ *  been received.
+ *
+ *  @param[in,out] parser Pointer to a message parser structure
  *  @param[in,out] msg Pointer to a message structure
- *  @param[in,out] str String representation of the message
+ *  @param[in] buf Pointer to a buffer containing the message
+ *  @param[in] len Length of the buffer containing the message
  *
- *  @returns Number of bytes parsed or error code
- *  @retval >0 Number of bytes parsed
+ *  @returns Error code
+ *  @retval 0 Success, the blank line that ends the headers has been parsed
  *  @retval <0 Error code
  */
-static ssize_t http_msg_parse_headers(http_msg_t *msg, char *str)
+static int http_msg_parse_headers(http_msg_parser_t *parser, http_msg_t *msg, const char *buf, size_t len)
 {
-    char *value = NULL;
-    char *name = NULL;
-    char *next = str;
+    ssize_t eol = 0;
     int ret = 0;
 
     while (1)
     {
-        name = next;
-        while (1)
+        eol = http_msg_parser_find_eol(parser, buf, len);
+        if (eol < 0)
         {
-            next = strstr(next, "\r\n");
-            if (next == NULL)
-            {
-                return -EAGAIN;
-            }
-            else if (next == name)
-            {
-                /* blank line */
-                return (next + 2) - str;
-            }
-            else if ((*(next + 2) == ' ') || (*(next + 2) == '\t'))
-            {
-                next += 3;
-            }
-            else
-            {
-                *next++ = '\0';
-                *next++ = '\0';
-                break;
-            }
+            return eol;
         }
-        value = strchr(name, ':');
-        if (value == NULL)
+        if (eol == parser->pos)
         {
-            return -EBADMSG;
+            /* blank line */
+            http_msg_parser_next_line(parser, eol);
+            return 0;
+        }
+        if (eol + 2 >= len)
+        {
+            return -EAGAIN;
+        }
+        if ((buf[eol + 2] == ' ') || (buf[eol + 2] == '\t'))
+        {
+            parser->scan = eol + 3;
+            continue;
         }
-        *value++ = '\0';
-        ret = http_msg_list_add(&msg->header, http_msg_trim_ws(name), http_msg_trim_ws(value));
+        ret = http_msg_parse_header(msg, buf + parser->pos, eol - parser->pos);
         if (ret < 0)
         {
             return ret;
         }
+        http_msg_parser_next_line(parser, eol);
     }
     return 0;  /* should never arrive here */
 }
 
 /**
- *  @brief Parse the body in a message
+ *  @brief Choose how to parse the body in a message from its headers
  *
- *  @param[in,out] msg Pointer to a message structure
- *  @param[in] str String representation of the message body
- *
- *  @returns Number of bytes parsed or error code
- *  @retval >=0 Number of bytes parsed
- *  @retval <0 Error code
+ *  @param[in,out] parser Pointer to a message parser structure
+ *  @param[in] msg Pointer to a message structure
  */
-static ssize_t http_msg_parse_body(http_msg_t *msg, char *str)
+static void http_msg_parse_body_start(http_msg_parser_t *parser, http_msg_t *msg)
 {
     http_msg_header_t *header = NULL;
-    ssize_t num = 0;
     size_t content_len = 0;
-    size_t str_len = 0;
-    char *chunk_size = NULL;
-    char *chunk_data = NULL;
-    char *param = NULL;
-    char *next = NULL;
-    char *dest = NULL;
-    int total_len = 0;
-    int chunk_len = 0;
     int chunked = 0;
-    int ret = 0;
-    int i = 0;
-
-    str_len = strlen(str);
 
     header = http_msg_get_first_header(msg);
     while (header != NULL)
@@ -401,177 +526,278 @@ static ssize_t http_msg_parse_body(http_msg_t *msg, char *str)
     }
     if (chunked)
     {
-        /* 1: "06\r\nchunk1\r\n06\r\nchunk2\r\n0\r\n\r\n"                */
-        /* 2: "06\r\nchunk1\r\n06\r\nchunk2\r\n0\r\nname: value\r\n\r\n" */
-        /* 3: "06\r\nchunk1\r\n06; param=value\r\nchunk2\r\n0\r\n\r\n"   */
+        parser->state = HTTP_MSG_PARSE_CHUNK_SIZE;
+    }
+    else
+    {
+        parser->state = HTTP_MSG_PARSE_BODY;
+        parser->len = content_len;
+    }
+}
 
-        /* make 2 passes */
-        /* the first pass determines the total size of all chunks */
-        /* the second pass copies data */
-        for (i = 0; i < 2; i++)
-        {
-            next = str;
-            while (1)
-            {
-                chunk_size = next;
-
-                /* find the end of the chunk-size field */
-                next = strstr(next, "\r\n");
-                if (next == NULL)
-                {
-                    return -EAGAIN;
-                }
-                next += 2;
-
-                /* ignore unrecognised parameters in the chunk-size field */
-                param = strchr(chunk_size, ';');
-                if ((param != NULL) && (param < next))
-                {
-                    *param = ' ';
-                }
-
-                /* parse chunk length */
-                ret = sscanf(chunk_size, "%x", &chunk_len);
-                if (ret != 1)
-                {
-                    return -EBADMSG;
-                }
-                if (chunk_len == 0)
-                {
-                    break;
-                }
-                if (i == 0)
-                {
-                    total_len += chunk_len;
-                }
-
-                chunk_data = next;
-                next += chunk_len;
-
-                /* parse the end of chunk-data */
-                if (next + 2 > str + str_len)
-                {
-                    return -EAGAIN;
-                }
-                if ((*next != '\r')
-                 || (*(next + 1) != '\n'))
-                {
-                    return -EBADMSG;
-                }
-                next += 2;
-
-                /* copy data on the second pass */
-                if (i == 1)
-                {
-                    memcpy(dest, chunk_data, chunk_len);
-                    dest += chunk_len;
-                }
-            }
+/**
+ *  @brief Parse a message body with a known length
+ *
+ *  @param[in,out] parser Pointer to a message parser structure
+ *  @param[out] msg Pointer to a message structure
+ *  @param[in] buf Pointer to a buffer containing the message
+ *  @param[in] len Length of the buffer containing the message
+ *
+ *  @returns Error code
+ *  @retval 0 Success
+ *  @retval <0 Error code
+ */
+static int http_msg_parse_body(http_msg_parser_t *parser, http_msg_t *msg, const char *buf, size_t len)
+{
+    if (parser->len == 0)
+    {
+        return 0;
+    }
+    if (parser->len > len - parser->pos)
+    {
+        return -EAGAIN;
+    }
+    msg->body = http_msg_dup(buf + parser->pos, parser->len);
+    if (msg->body == NULL)
+    {
+        return -ENOMEM;
+    }
+    msg->body_len = parser->len;
+    parser->pos += parser->len;
+    return 0;
+}
 
-            /* allocate memory after the first pass */
-            if (i == 0)
-            {
-                msg->body = malloc(total_len + 1);
-                if (msg->body == NULL)
-                {
-                    return -ENOMEM;
-                }
-                msg->body[total_len] = '\0';
-                msg->body_len = total_len;
-                dest = msg->body;
-            }
+/**
+ *  @brief Parse a chunk-size line in a message body with chunked transfer encoding
+ *
+ *  Parameters in the chunk-size line are ignored.
+ *
+ *  @param[in,out] parser Pointer to a message parser structure
+ *  @param[in] buf Pointer to a buffer containing the message
+ *  @param[in] len Length of the buffer containing the message
+ *
+ *  @returns Error code
+ *  @retval 0 Success
+ *  @retval <0 Error code
+ */
+static int http_msg_parse_chunk_size(http_msg_parser_t *parser, const char *buf, size_t len)
+{
+    const char *next = NULL;
+    const char *end = NULL;
+    size_t chunk_len = 0;
+    ssize_t eol = 0;
+    int digit = 0;
+
+    eol = http_msg_parser_find_eol(parser, buf, len);
+    if (eol < 0)
+    {
+        return eol;
+    }
+    next = buf + parser->pos;
+    end = buf + eol;
+    while ((next < end) && ((*next == ' ') || (*next == '\t')))
+    {
+        next++;
+    }
+    if ((next == end) || (!isxdigit((unsigned char)*next)))
+    {
+        return -EBADMSG;
+    }
+    while ((next < end) && isxdigit((unsigned char)*next))
+    {
+        if (chunk_len > (SIZE_MAX >> 4))
+        {
+            return -EBADMSG;
         }
+        digit = isdigit((unsigned char)*next) ? *next - '0' : tolower((unsigned char)*next) - 'a' + 10;
+        chunk_len = (chunk_len << 4) + digit;
+        next++;
+    }
+    http_msg_parser_next_line(parser, eol);
+    parser->len = chunk_len;
+    parser->state = (chunk_len == 0) ? HTTP_MSG_PARSE_TRAILERS : HTTP_MSG_PARSE_CHUNK_DATA;
+    return 0;
+}
 
-        /* 1: "\r\n"                */
-        /* 2: "name: value\r\n\r\n" */
-        /* 3: "\r\n"                */
+/**
+ *  @brief Parse the data in a chunk and add it to the message body
+ *
+ *  @param[in,out] parser Pointer to a message parser structure
+ *  @param[in,out] msg Pointer to a message structure
+ *  @param[in] buf Pointer to a buffer containing the message
+ *  @param[in] len Length of the buffer containing the message
+ *
+ *  @returns Error code
+ *  @retval 0 Success
+ *  @retval <0 Error code
+ */
+static int http_msg_parse_chunk_data(http_msg_parser_t *parser, http_msg_t *msg, const char *buf, size_t len)
+{
+    const char *data = NULL;
+    size_t body_size = 0;
+    char *body = NULL;
 
-        /* process trailers */
-        num = http_msg_parse_headers(msg, next);
-        if (num < 0)
-        {
-            return num;
-        }
-        return (next + num) - str;
+    if ((len - parser->pos < 2)
+     || (parser->len > len - parser->pos - 2))
+    {
+        return -EAGAIN;
+    }
+    data = buf + parser->pos;
+    if ((data[parser->len] != '\r')
+     || (data[parser->len + 1] != '\n'))
+    {
+        return -EBADMSG;
     }
-    else if (content_len)
+    /* grow the body geometrically so that many small chunks are not copied repeatedly */
+    if (msg->body_len + parser->len + 1 > parser->body_size)
     {
-        if (content_len > str_len)
+        body_size = 2 * parser->body_size;
+        if (body_size < msg->body_len + parser->len + 1)
         {
-            return -EAGAIN;
+            body_size = msg->body_len + parser->len + 1;
         }
-        msg->body = malloc(content_len + 1);
-        if (msg->body == NULL)
+        body = realloc(msg->body, body_size);
+        if (body == NULL)
         {
             return -ENOMEM;
         }
-        memcpy(msg->body, str, content_len);
-        msg->body[content_len] = '\0';
-        msg->body_len = content_len;
-        return content_len;
+        msg->body = body;
+        parser->body_size = body_size;
     }
+    memcpy(msg->body + msg->body_len, data, parser->len);
+    msg->body_len += parser->len;
+    msg->body[msg->body_len] = '\0';
+    parser->pos += parser->len + 2;
+    parser->scan = parser->pos;
+    parser->state = HTTP_MSG_PARSE_CHUNK_SIZE;
     return 0;
 }
 
 /**
- *  @brief Parse a message
- *
- *  This function expects the message body to be contained
- *  in a mutable string with a terminating null character.
+ *  @brief Parse the trailers at the end of a message body with chunked transfer encoding
  *
- *  @param[out] msg Pointer to a message structure
- *  @param[in,out] str String containing the message
+ *  @param[in,out] parser Pointer to a message parser structure
+ *  @param[in,out] msg Pointer to a message structure
+ *  @param[in] buf Pointer to a buffer containing the message
+ *  @param[in] len Length of the buffer containing the message
  *
- *  @returns Number of bytes parsed or error code
- *  @retval >0 Number of bytes
+ *  @returns Error code
+ *  @retval 0 Success
  *  @retval <0 Error code
- */static ssize_t __http_msg_parse(http_msg_t *msg, char *str)
+ */
+static int http_msg_parse_trailers(http_msg_parser_t *parser, http_msg_t *msg, const char *buf, size_t len)
 {
-    ssize_t num = 0;
-    char *next = str;
+    int ret = 0;
 
-    num = http_msg_parse_start(msg, next);
-    if (num < 0)
+    ret = http_msg_parse_headers(parser, msg, buf, len);
+    if (ret < 0)
     {
-        return num;
+        return ret;
     }
-    next += num;
-
-    num = http_msg_parse_headers(msg, next);
-    if (num < 0 )
+    /* a message with chunked transfer encoding always has a body */
+    if (msg->body == NULL)
     {
-        return num;
+        msg->body = calloc(1, 1);
+        if (msg->body == NULL)
+        {
+            return -ENOMEM;
+        }
     }
-    next += num;
+    return 0;
+}
+
+/**
+ *  @brief Parse as much of a message as has been received
+ *
+ *  @param[in,out] parser Pointer to a message parser structure
+ *  @param[in,out] msg Pointer to a message structure
+ *  @param[in] buf Pointer to a buffer containing the message
+ *  @param[in] len Length of the buffer containing the message
+ *
+ *  @returns Error code
+ *  @retval 0 Success, the message is complete
+ *  @retval <0 Error code
+ */
+static int http_msg_parse_parts(http_msg_parser_t *parser, http_msg_t *msg, const char *buf, size_t len)
+{
+    int ret = 0;
 
-    num = http_msg_parse_body(msg, next);
-    if (num < 0)
+    while (1)
     {
-        return num;
+        switch (parser->state)
+        {
+        case HTTP_MSG_PARSE_START:
+            ret = http_msg_parse_start(parser, msg, buf, len);
+            if (ret < 0)
+            {
+                return ret;
+            }
+            parser->state = HTTP_MSG_PARSE_HEADERS;
+            break;
+        case HTTP_MSG_PARSE_HEADERS:
+            ret = http_msg_parse_headers(parser, msg, buf, len);
+            if (ret < 0)
+            {
+                return ret;
+            }
+            http_msg_parse_body_start(parser, msg);
+            break;
+        case HTTP_MSG_PARSE_BODY:
+            return http_msg_parse_body(parser, msg, buf, len);
+        case HTTP_MSG_PARSE_CHUNK_SIZE:
+            ret = http_msg_parse_chunk_size(parser, buf, len);
+            if (ret < 0)
+            {
+                return ret;
+            }
+            break;
+        case HTTP_MSG_PARSE_CHUNK_DATA:
+            ret = http_msg_parse_chunk_data(parser, msg, buf, len);
+            if (ret < 0)
+            {
+                return ret;
+            }
+            break;
+        case HTTP_MSG_PARSE_TRAILERS:
+            return http_msg_parse_trailers(parser, msg, buf, len);
+        default:
+            return -EINVAL;
+        }
     }
-    next += num;
-
-    return next - str;
+    return 0;  /* should never arrive here */
 }
 
-ssize_t http_msg_parse(http_msg_t *msg, const char *buf, size_t len)
+ssize_t http_msg_parse_next(http_msg_parser_t *parser, http_msg_t *msg, const char *buf, size_t len)
 {
     ssize_t num = 0;
-    char *str = NULL;
+    int ret = 0;
 
-    http_msg_reset(msg);
-    str = malloc(len + 1);
-    if (str == NULL)
+    if ((parser->state == HTTP_MSG_PARSE_START) && (parser->pos == 0))
     {
-        return -ENOMEM;
+        http_msg_reset(msg);
+    }
+    ret = http_msg_parse_parts(parser, msg, buf, len);
+    if (ret == -EAGAIN)
+    {
+        return ret;
+    }
+    num = parser->pos;
+    http_msg_parser_create(parser);
+    if (ret < 0)
+    {
+        return ret;
     }
-    memcpy(str, buf, len);
-    str[len] = '\0';
-    num = __http_msg_parse(msg, str);
-    free(str);
     return num;
 }
 
+ssize_t http_msg_parse(http_msg_t *msg, const char *buf, size_t len)
+{
+    http_msg_parser_t parser = {0};
+
+    http_msg_parser_create(&parser);
+    return http_msg_parse_next(&parser, msg, buf, len);
+}
+
 int http_msg_set_start(http_msg_t *msg, const char *start1, const char *start2, const char *start3)
 {
     msg->start[0] = strdup(start1);
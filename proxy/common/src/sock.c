@@ -72,7 +72,8 @@ static const char *sock_error_str[] = {
     /* -30 */    "peer certificate verification failed",
     /* -31 */    "unable to close socket",
 
-    /* -32 */    "lock error"
+    /* -32 */    "lock error",
+    /* -33 */    "operation would block"
 };
 
 const char *sock_strerror(int error)
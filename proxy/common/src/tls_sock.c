@@ -604,6 +604,48 @@ ssize_t tls_sock_read_full(tls_sock_t *s, void *buf, size_t len)
     return total_bytes;
 }
 
+/*  like tls_sock_read but does not wait for data
+ *
+ *  return { > 0,        number of bytes read
+ *         {   0,        connection closed
+ *         { SOCK_AGAIN, no data available
+ *         { < 0,        error
+ */
+ssize_t tls_sock_try_read(tls_sock_t *s, void *buf, size_t len)
+{
+    ssize_t num = 0;
+    int ret = 0;
+
+    while (1)
+    {
+        num = gnutls_record_recv(s->session, buf, len);
+        if (num >= 0)
+        {
+            return num;
+        }
+        if (num == GNUTLS_E_REHANDSHAKE)
+        {
+            ret = tls_sock_handshake(s);
+            if (ret != SOCK_OK)
+            {
+                return ret;
+            }
+        }
+        else if (num == GNUTLS_E_AGAIN)
+        {
+            return SOCK_AGAIN;
+        }
+        else if (num == GNUTLS_E_INTERRUPTED)
+        {
+            return SOCK_INTR;
+        }
+        else
+        {
+            return SOCK_READ_ERROR;
+        }
+    }
+}
+
 /*  return { > 0, number of bytes read
  *         {   0, connection closed
  *         { < 0, error
@@ -678,6 +720,34 @@ ssize_t tls_sock_write_full(tls_sock_t *s, void *buf, size_t len)
     return total_bytes;
 }
 
+/*  like tls_sock_write but does not wait for the socket to become writable,
+ *  after SOCK_AGAIN the same data must be written again
+ *
+ *  return { > 0,        number of bytes written
+ *         {   0,        connection closed
+ *         { SOCK_AGAIN, socket not writable
+ *         { < 0,        error
+ */
+ssize_t tls_sock_try_write(tls_sock_t *s, void *buf, size_t len)
+{
+    ssize_t num = 0;
+
+    num = gnutls_record_send(s->session, buf, len);
+    if (num >= 0)
+    {
+        return num;
+    }
+    if (num == GNUTLS_E_AGAIN)
+    {
+        return SOCK_AGAIN;
+    }
+    if (num == GNUTLS_E_INTERRUPTED)
+    {
+        return SOCK_INTR;
+    }
+    return SOCK_WRITE_ERROR;
+}
+
 int tls_ssock_open(tls_ssock_t *ss, tls_server_t *server, const char *port, int timeout, int backlog)
 {
     int opt_val = 0;
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2015 Keith Cullen.
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *  @file cache.h
+ *
+ *  @brief Include file for the FreeCoAP HTTP/CoAP proxy cache module
+ *
+ *  The cache module stores 2.05 (Content) responses from
+ *  CoAP servers keyed by the Uri-Host, Uri-Port, Uri-Path,
+ *  Uri-Query and Accept options of the request. Only
+ *  responses that carry a Max-Age or an ETag option are
+ *  stored. Fresh entries are served directly and stale
+ *  entries with an ETag are revalidated with the CoAP
+ *  server, whose response replaces, refreshes or removes
+ *  them. The cache is split into shards, each with its
+ *  own lock, and each shard evicts its least recently
+ *  used entries to stay within its share of the size limit.
+ *  Responses are stored formatted, in memory from the heap,
+ *  so that the cache does not use the buffers of the CoAP
+ *  memory allocator.
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <time.h>
+#include "coap_msg.h"
+
+#define CACHE_FRESH  0                                                          /* entry found and fresh */
+#define CACHE_STALE  1                                                          /* entry found but must be revalidated */
+#define CACHE_MISS   2                                                          /* entry not found */
+
+typedef struct cache_entry
+{
+    char *key;
+    size_t key_len;
+    size_t uri_len;                                                             /* length of the part of the key taken from the Uri-* options */
+    size_t size;                                                                /* number of bytes charged to the shard */
+    time_t expiry;                                                              /* monotonic time in seconds at which the entry becomes stale */
+    int has_etag;
+    char *buf;                                                                  /* formatted response without its Max-Age option */
+    size_t len;
+    struct cache_entry *hash_next;
+    struct cache_entry *prev;                                                   /* links in the LRU list of the shard */
+    struct cache_entry *next;
+}
+cache_entry_t;
+
+int cache_init(size_t max_size);
+void cache_deinit(void);
+int cache_key(coap_msg_t *req_msg, char **key, size_t *key_len, size_t *uri_len);
+int cache_get(const char *key, size_t key_len, size_t uri_len, coap_msg_t *resp_msg);
+int cache_put(const char *key, size_t key_len, size_t uri_len, coap_msg_t *resp_msg);
+int cache_revalidate(const char *key, size_t key_len, size_t uri_len, coap_msg_t *valid_msg, coap_msg_t *stale_msg);
+void cache_delete(const char *key, size_t key_len, size_t uri_len);
+void cache_invalidate(const char *key, size_t uri_len);
+
+#endif
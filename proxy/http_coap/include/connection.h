@@ -35,13 +35,31 @@
 #define CONNECTION_H
 
 #include <stddef.h>
+#include <time.h>
 #include <netinet/in.h>
 #include "coap_client.h"
 #include "tls_sock.h"
 #include "data_buf.h"
+#include "http_msg.h"
 #include "param.h"
+#include "upstream.h"
+#include "flight.h"
+#include "cache.h"
 
-typedef struct
+#define CONNECTION_DONE          0                                              /* the connection has finished and can be deleted */
+#define CONNECTION_WAIT_HTTP     1                                              /* the connection waits for its HTTP socket to become readable */
+#define CONNECTION_WAIT_COAP     2                                              /* the connection waits for its CoAP client to become readable */
+#define CONNECTION_WAIT_FLIGHT   3                                              /* the connection waits for another connection to complete an identical request */
+#define CONNECTION_WAIT_SEND     4                                              /* the connection waits for its HTTP socket to become writable */
+#define CONNECTION_WAIT_UPSTREAM 5                                              /* the connection waits for a CoAP client from the pool */
+
+#define connection_get_sd(con)          (tls_sock_get_sd((con)->sock))
+#define connection_get_coap_fd(con)     (coap_client_async_get_fd(upstream_get_client((con)->upstream)))
+#define connection_get_flight_fd(con)   (flight_waiter_get_fd(&(con)->flight_waiter))
+#define connection_get_upstream_fd(con) (upstream_waiter_get_fd(&(con)->upstream_waiter))
+#define connection_get_timeout(con)     (tls_sock_get_timeout((con)->sock))
+
+typedef struct connection
 {
     unsigned listener_index;
     unsigned con_index;
@@ -50,20 +68,49 @@ typedef struct
     tls_sock_t *sock;
     data_buf_t recv_buf;
     data_buf_t send_buf;
+    http_msg_parser_t parser;                                                   /* position reached in the request in the receive buffer */
     param_t *param;
-    int coap_client_active;
-    char *coap_client_host;
-    char *coap_client_port;
-    coap_client_t coap_client;
+    upstream_t *upstream;                                                       /* CoAP client leased from the pool for the current exchange */
+    upstream_waiter_t upstream_waiter;
     char *body;
     size_t body_len;
     size_t body_end;
+    http_msg_t req_msg;                                                         /* request from the HTTP client being processed */
+    http_msg_t resp_msg;                                                        /* response to the HTTP client being generated */
+    coap_msg_t coap_req_msg;                                                    /* request sent asynchronously to the CoAP server */
+    coap_msg_t coap_resp_msg;                                                   /* response from the CoAP server */
+    int coap_status;                                                            /* status of the asynchronous CoAP request, 1 while it is outstanding */
+    flight_t *lead_flight;                                                      /* flight of the CoAP request sent by this connection */
+    flight_t *wait_flight;                                                      /* flight of an identical CoAP request sent by another connection */
+    flight_waiter_t flight_waiter;
+    char *cache_key;                                                            /* key of a GET request that can be served from the cache */
+    size_t cache_key_len;
+    size_t cache_uri_len;
+    int cache_state;                                                            /* result of looking up the request in the cache */
+    coap_msg_t cache_resp_msg;                                                  /* stale response being revalidated */
+    size_t block1_start;                                                        /* start byte index of the block of the request body sent to the CoAP server */
+    size_t block1_len;                                                          /* length of the block of the request body sent to the CoAP server */
+    unsigned block1_size;                                                       /* size of the blocks of the request body, 0 if the body is not sent in blocks */
+    size_t block2_start;                                                        /* start byte index of the next block of the response body */
+    unsigned block2_size;                                                       /* size of the blocks of the response body, 0 if the body is not streamed */
+    struct timespec coap_start;                                                 /* time at which the asynchronous CoAP request was sent */
+    int wait;                                                                   /* event the connection waits for */
+    time_t expiry;                                                              /* monotonic time in seconds at which waiting for the HTTP client times out */
+    struct connection *prev;                                                    /* links in the list of connections of a worker */
+    struct connection *next;
 }
 connection_t;
 
-int connection_init(void);
-void *connection_thread_func(void *data);
+int connection_init(param_t *param);
+void connection_deinit(void);
 connection_t *connection_new(tls_sock_t *sock, unsigned listener_index, unsigned con_index, param_t *param);
 void connection_delete(connection_t *con);
+int connection_start(connection_t *con);
+int connection_handle_http(connection_t *con);
+int connection_handle_send(connection_t *con);
+int connection_handle_coap(connection_t *con);
+int connection_handle_flight(connection_t *con);
+int connection_handle_upstream(connection_t *con);
+void connection_expire(connection_t *con);
 
 #endif
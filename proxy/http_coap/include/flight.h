@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2015 Keith Cullen.
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *  @file flight.h
+ *
+ *  @brief Include file for the FreeCoAP HTTP/CoAP proxy flight module
+ *
+ *  A flight is a GET exchange with a CoAP server that is
+ *  in progress. The first connection to send a request
+ *  leads the flight and performs the exchange. Connections
+ *  that send an identical request while the flight is in
+ *  progress join it as waiters instead of sending their
+ *  own request. Each waiter has an event file descriptor
+ *  that becomes readable when the leader completes the
+ *  flight, after which the waiter copies the result.
+ */
+
+#ifndef FLIGHT_H
+#define FLIGHT_H
+
+#include <stddef.h>
+#include "coap_msg.h"
+
+#define FLIGHT_RETRY  1                                                         /* the result cannot be shared, waiters must send their own request */
+
+#define flight_waiter_get_fd(waiter)  ((waiter)->fd)
+
+typedef struct flight_waiter
+{
+    int fd;
+    struct flight_waiter *next;
+}
+flight_waiter_t;
+
+typedef struct flight
+{
+    char *key;                                                                  /* options of the CoAP request */
+    size_t key_len;
+    unsigned num_refs;                                                          /* leader and waiters */
+    int done;
+    int status;
+    coap_msg_t resp_msg;                                                        /* valid when done and status is 0 */
+    flight_waiter_t *waiter_first;
+    struct flight *next;                                                        /* hash chain */
+}
+flight_t;
+
+int flight_init(void);
+void flight_deinit(void);
+int flight_join(flight_t **flight, flight_waiter_t *waiter, coap_msg_t *req_msg);
+void flight_complete(flight_t *flight, int status, coap_msg_t *resp_msg);
+int flight_get_result(flight_t *flight, coap_msg_t *resp_msg);
+void flight_leave(flight_t *flight, flight_waiter_t *waiter);
+
+#endif
@@ -38,13 +38,17 @@
 #include "tls.h"
 #include "thread.h"
 #include "param.h"
+#include "worker.h"
 
 typedef struct
 {
     unsigned index;
     param_t *param;
     thread_ctx_t ctx;
+    thread_ctx_t worker_ctx;
     tls_ssock_t ssock;
+    worker_t *workers;
+    unsigned num_workers;
 }
 listener_t;
 
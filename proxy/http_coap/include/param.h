@@ -44,6 +44,15 @@
 #define PARAM_DEF_COAP_CLIENT_TRUST_FILE_NAME         "coap_client_trust.pem"   /**< DTLS trust file name */
 #define PARAM_DEF_COAP_CLIENT_CERT_FILE_NAME          "coap_client_cert.pem"    /**< DTLS certificate file name */
 #define PARAM_DEF_COAP_CLIENT_KEY_FILE_NAME           "coap_client_privkey.pem" /**< DTLS key file name */
+#define PARAM_DEF_STATS_FILE_NAME                     "proxy_stats.txt"         /**< Statistics dump file name */
+#define PARAM_DEF_NUM_WORKERS                         "4"                       /**< Number of worker threads */
+#define PARAM_MAX_NUM_WORKERS                         64                        /**< Maximum number of worker threads */
+#define PARAM_DEF_COAP_CLIENT_MAX_PER_ORIGIN          "4"                       /**< Number of pooled CoAP clients per CoAP server */
+#define PARAM_MAX_COAP_CLIENT_MAX_PER_ORIGIN          256                       /**< Maximum number of pooled CoAP clients per CoAP server */
+#define PARAM_DEF_COAP_CLIENT_IDLE_TIMEOUT            "60"                      /**< Seconds before an idle pooled CoAP client is closed */
+#define PARAM_MAX_COAP_CLIENT_IDLE_TIMEOUT            3600                      /**< Maximum idle timeout for pooled CoAP clients */
+#define PARAM_DEF_CACHE_MAX_SIZE                      "1048576"                 /**< Size of the response cache in bytes, 0 disables the cache */
+#define PARAM_MAX_CACHE_MAX_SIZE                      1073741824                /**< Maximum size of the response cache in bytes */
 
 #define param_get_port(param)                         ((param)->port)
 #define param_get_max_log_level(param)                ((param)->max_log_level)
@@ -53,6 +62,11 @@
 #define param_get_coap_client_key_file_name(param)    ((param)->coap_client_key_file_name)
 #define param_get_coap_client_cert_file_name(param)   ((param)->coap_client_cert_file_name)
 #define param_get_coap_client_trust_file_name(param)  ((param)->coap_client_trust_file_name)
+#define param_get_stats_file_name(param)              ((param)->stats_file_name)
+#define param_get_num_workers(param)                  ((param)->num_workers)
+#define param_get_coap_client_max_per_origin(param)   ((param)->coap_client_max_per_origin)
+#define param_get_coap_client_idle_timeout(param)     ((param)->coap_client_idle_timeout)
+#define param_get_cache_max_size(param)               ((param)->cache_max_size)
 
 typedef struct
 {
@@ -64,6 +78,11 @@ typedef struct
     char *coap_client_key_file_name;
     char *coap_client_cert_file_name;
     char *coap_client_trust_file_name;
+    char *stats_file_name;
+    unsigned num_workers;
+    unsigned coap_client_max_per_origin;
+    unsigned coap_client_idle_timeout;
+    unsigned cache_max_size;
 }
 param_t;
 
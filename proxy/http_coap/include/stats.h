@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2015 Keith Cullen.
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *  @file stats.h
+ *
+ *  @brief Include file for the FreeCoAP HTTP/CoAP proxy statistics module
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define STATS_NUM_SHARDS        16                                              /**< Number of counter shards (must be a power of 2) */
+#define STATS_NUM_BUCKETS       32                                              /**< Number of buckets in a latency histogram */
+#define STATS_CACHE_LINE_SIZE   64                                              /**< Alignment of a counter shard */
+
+typedef enum
+{
+    STATS_OK_CON = 0,
+    STATS_FAIL_CON,
+    STATS_OK_TRANS,
+    STATS_FAIL_TRANS,
+    STATS_SHARED_TRANS,
+    STATS_CACHED_TRANS,
+    STATS_NUM_COUNTERS
+}
+stats_counter_t;
+
+typedef enum
+{
+    STATS_HTTP_PARSE = 0,
+    STATS_COAP_EXCHANGE,
+    STATS_TLS_WRITE,
+    STATS_NUM_HISTS
+}
+stats_hist_t;
+
+/*  bucket 0 counts durations of 0 microseconds and
+ *  bucket n counts durations of [2^(n-1), 2^n) microseconds
+ */
+typedef struct
+{
+    uint64_t count;
+    uint64_t sum_usec;
+    uint64_t bucket[STATS_NUM_BUCKETS];
+}
+stats_hist_snapshot_t;
+
+typedef struct
+{
+    uint64_t counter[STATS_NUM_COUNTERS];
+    stats_hist_snapshot_t hist[STATS_NUM_HISTS];
+}
+stats_snapshot_t;
+
+void stats_init(void);
+void stats_inc(stats_counter_t counter);
+void stats_start(struct timespec *start);
+void stats_record(stats_hist_t hist, const struct timespec *start);
+void stats_aggregate(stats_snapshot_t *snap);
+uint64_t stats_percentile(const stats_hist_snapshot_t *hist, unsigned pct);
+void stats_log(void);
+int stats_dump(const char *file_name);
+
+#endif
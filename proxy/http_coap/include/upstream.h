@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2015 Keith Cullen.
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *  @file upstream.h
+ *
+ *  @brief Include file for the FreeCoAP HTTP/CoAP proxy upstream module
+ *
+ *  The upstream module keeps a process-wide pool of CoAP
+ *  clients, each with its own DTLS session, keyed by the
+ *  host and port of the CoAP server. A connection takes a
+ *  client from the pool for one exchange and gives it back
+ *  afterwards, so the next exchange with the same server
+ *  from any connection skips the DTLS handshake.
+ *
+ *  A connection that finds no idle client waits in a queue
+ *  of the server. New clients are connected by a separate
+ *  thread, at most the configured number per server, and
+ *  each connected or released client is handed to the
+ *  first waiter. Each waiter has an event file descriptor
+ *  that becomes readable when it has been given a client
+ *  or the attempt to connect has failed.
+ */
+
+#ifndef UPSTREAM_H
+#define UPSTREAM_H
+
+#include <time.h>
+#include "coap_client.h"
+#include "param.h"
+
+#define upstream_get_client(up)  (&(up)->client)
+#define upstream_get_host(up)    ((up)->origin->host)
+#define upstream_get_port(up)    ((up)->origin->port)
+
+#define upstream_waiter_get_fd(waiter)      ((waiter)->fd)
+#define upstream_waiter_is_waiting(waiter)  ((waiter)->origin != NULL)
+
+struct upstream_origin;
+
+typedef struct upstream
+{
+    coap_client_t client;
+    struct upstream_origin *origin;
+    time_t expiry;                                                              /* monotonic time in seconds at which the idle client is closed */
+    struct upstream *prev;                                                      /* links in the list of idle clients of the origin */
+    struct upstream *next;
+}
+upstream_t;
+
+typedef struct upstream_waiter
+{
+    int fd;
+    int done;
+    int status;                                                                 /* valid when done */
+    upstream_t *up;                                                             /* client handed to the waiter when done */
+    struct upstream_origin *origin;                                             /* set while the waiter has not taken the result */
+    struct upstream_waiter *next;
+}
+upstream_waiter_t;
+
+typedef struct upstream_origin
+{
+    char *host;
+    char *port;
+    unsigned num;                                                               /* number of clients, idle, in use or connecting */
+    upstream_t *idle_first;                                                     /* most recently used first */
+    upstream_t *idle_last;
+    upstream_waiter_t *waiter_first;                                            /* first come first served */
+    upstream_waiter_t *waiter_last;
+    struct upstream_origin *next;                                               /* hash chain */
+}
+upstream_origin_t;
+
+int upstream_init(param_t *param);
+void upstream_deinit(void);
+int upstream_acquire(upstream_t **up, upstream_waiter_t *waiter, const char *host, const char *port);
+int upstream_get_result(upstream_waiter_t *waiter, upstream_t **up);
+void upstream_leave(upstream_waiter_t *waiter);
+void upstream_release(upstream_t *up, int fail);
+void upstream_expire(void);
+
+#endif
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2015 Keith Cullen.
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *  @file worker.h
+ *
+ *  @brief Include file for the FreeCoAP HTTP/CoAP proxy worker module
+ *
+ *  Each worker thread multiplexes many connections with
+ *  one epoll instance. A connection is registered for at
+ *  most one event at a time: its HTTP socket, the file
+ *  descriptor of its CoAP client or the file descriptor
+ *  on which it waits for another connection to complete
+ *  an identical request.
+ */
+
+#ifndef WORKER_H
+#define WORKER_H
+
+#include <time.h>
+#include "connection.h"
+#include "thread.h"
+
+typedef struct
+{
+    unsigned index;
+    int epoll_fd;
+    int pipe_fd[2];             /* connections handed over by the listener */
+    thread_t thread;
+    int running;
+    connection_t *idle_first;   /* connections waiting for their HTTP client, in order of expiry */
+    connection_t *idle_last;
+    connection_t *busy_first;   /* connections waiting for their CoAP server, another connection or a CoAP client */
+    unsigned num_cons;
+}
+worker_t;
+
+int worker_create(worker_t *worker, unsigned index);
+void worker_destroy(worker_t *worker);
+int worker_run(worker_t *worker, thread_ctx_t *ctx);
+int worker_add(worker_t *worker, connection_t *con);
+
+#endif
@@ -0,0 +1,644 @@
+/*
+ * Copyright (c) 2015 Keith Cullen.
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *  @file cache.c
+ *
+ *  @brief Source file for the FreeCoAP HTTP/CoAP proxy cache module
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "cache.h"
+#include "lock.h"
+
+#define CACHE_NUM_SHARDS   16                                                   /* must be a power of 2 */
+#define CACHE_NUM_BUCKETS  64                                                   /* per shard, must be a power of 2 */
+#define CACHE_DEF_MAX_AGE  60                                                   /* seconds, used when a response has no Max-Age option */
+#define CACHE_MAX_AGE_LEN  4
+
+#define cache_get_shard(hash)   (&cache_shard[(hash) & (CACHE_NUM_SHARDS - 1)])
+#define cache_get_bucket(hash)  (((hash) / CACHE_NUM_SHARDS) & (CACHE_NUM_BUCKETS - 1))
+
+typedef struct
+{
+    lock_t lock;
+    size_t size;
+    cache_entry_t *bucket[CACHE_NUM_BUCKETS];
+    cache_entry_t *first;                                                       /* most recently used first */
+    cache_entry_t *last;
+}
+cache_shard_t;
+
+static cache_shard_t cache_shard[CACHE_NUM_SHARDS];
+static size_t cache_shard_max_size = 0;                                         /* 0 if the cache is disabled */
+
+static time_t cache_now(void)
+{
+    struct timespec ts = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+/* entries for the same URI with different Accept options are in the same bucket */
+static unsigned cache_hash(const char *key, size_t uri_len)
+{
+    unsigned hash = 5381;
+    size_t i = 0;
+
+    for (i = 0; i < uri_len; i++)
+    {
+        hash = (hash * 33) ^ (unsigned char)key[i];
+    }
+    return hash;
+}
+
+static int cache_op_is_uri(unsigned num)
+{
+    return ((num == COAP_MSG_URI_HOST)
+         || (num == COAP_MSG_URI_PORT)
+         || (num == COAP_MSG_URI_PATH)
+         || (num == COAP_MSG_URI_QUERY));
+}
+
+/*  return: { 1, present
+ *          { 0, not present
+ */
+static int cache_get_max_age(coap_msg_t *msg, unsigned *max_age)
+{
+    coap_msg_op_t *op = NULL;
+
+    op = coap_msg_get_first_op(msg);
+    while (op != NULL)
+    {
+        if (coap_msg_op_get_num(op) == COAP_MSG_MAX_AGE)
+        {
+            if (coap_msg_op_parse_uint_val(max_age, coap_msg_op_get_val(op), coap_msg_op_get_len(op)) < 0)
+            {
+                *max_age = 0;
+            }
+            return 1;
+        }
+        op = coap_msg_op_get_next(op);
+    }
+    *max_age = CACHE_DEF_MAX_AGE;
+    return 0;
+}
+
+static int cache_has_etag(coap_msg_t *msg)
+{
+    coap_msg_op_t *op = NULL;
+
+    op = coap_msg_get_first_op(msg);
+    while (op != NULL)
+    {
+        if (coap_msg_op_get_num(op) == COAP_MSG_ETAG)
+        {
+            return 1;
+        }
+        op = coap_msg_op_get_next(op);
+    }
+    return 0;
+}
+
+static int cache_add_max_age(coap_msg_t *msg, unsigned max_age)
+{
+    char val[CACHE_MAX_AGE_LEN] = {0};
+    int ret = 0;
+
+    ret = coap_msg_op_format_uint_val(val, sizeof(val), max_age);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    return coap_msg_add_op(msg, COAP_MSG_MAX_AGE, ret, val);
+}
+
+/* copy a response without its Max-Age option */
+static int cache_strip(coap_msg_t *dst, coap_msg_t *src)
+{
+    coap_msg_op_t *op = NULL;
+    int ret = 0;
+
+    ret = coap_msg_set_type(dst, coap_msg_get_type(src));
+    if (ret < 0)
+    {
+        return ret;
+    }
+    ret = coap_msg_set_code(dst, coap_msg_get_code_class(src), coap_msg_get_code_detail(src));
+    if (ret < 0)
+    {
+        return ret;
+    }
+    ret = coap_msg_set_msg_id(dst, coap_msg_get_msg_id(src));
+    if (ret < 0)
+    {
+        return ret;
+    }
+    ret = coap_msg_set_token(dst, coap_msg_get_token(src), coap_msg_get_token_len(src));
+    if (ret < 0)
+    {
+        return ret;
+    }
+    op = coap_msg_get_first_op(src);
+    while (op != NULL)
+    {
+        if (coap_msg_op_get_num(op) != COAP_MSG_MAX_AGE)
+        {
+            ret = coap_msg_add_op(dst, coap_msg_op_get_num(op), coap_msg_op_get_len(op), coap_msg_op_get_val(op));
+            if (ret < 0)
+            {
+                return ret;
+            }
+        }
+        op = coap_msg_op_get_next(op);
+    }
+    if (coap_msg_get_payload_len(src) > 0)
+    {
+        return coap_msg_set_payload(dst, coap_msg_get_payload(src), coap_msg_get_payload_len(src));
+    }
+    return 0;
+}
+
+/*  format a response without its Max-Age option into a buffer
+ *  allocated from the heap
+ *
+ *  return: { 0, success
+ *          {<0, error
+ */
+static int cache_format(coap_msg_t *msg, char **buf, size_t *len)
+{
+    coap_msg_op_t *op = NULL;
+    coap_msg_t stripped = {0};
+    ssize_t num = 0;
+    size_t max = 0;
+    int ret = 0;
+
+    coap_msg_create(&stripped);
+    ret = cache_strip(&stripped, msg);
+    if (ret < 0)
+    {
+        coap_msg_destroy(&stripped);
+        return ret;
+    }
+    /* header, token, payload marker and payload, plus at most 5 bytes of header per option */
+    max = 4 + coap_msg_get_token_len(&stripped) + 1 + coap_msg_get_payload_len(&stripped);
+    op = coap_msg_get_first_op(&stripped);
+    while (op != NULL)
+    {
+        max += 5 + coap_msg_op_get_len(op);
+        op = coap_msg_op_get_next(op);
+    }
+    *buf = (char *)malloc(max);
+    if (*buf == NULL)
+    {
+        coap_msg_destroy(&stripped);
+        return -ENOMEM;
+    }
+    num = coap_msg_format(&stripped, *buf, max);
+    coap_msg_destroy(&stripped);
+    if (num < 0)
+    {
+        free(*buf);
+        *buf = NULL;
+        return num;
+    }
+    *len = num;
+    return 0;
+}
+
+static void cache_entry_delete(cache_entry_t *entry)
+{
+    free(entry->buf);
+    free(entry->key);
+    free(entry);
+}
+
+/* must be called with the shard lock held */
+static cache_entry_t *cache_find(cache_shard_t *shard, unsigned hash, const char *key, size_t key_len)
+{
+    cache_entry_t *entry = NULL;
+
+    entry = shard->bucket[cache_get_bucket(hash)];
+    while (entry != NULL)
+    {
+        if ((entry->key_len == key_len)
+         && (memcmp(entry->key, key, key_len) == 0))
+        {
+            return entry;
+        }
+        entry = entry->hash_next;
+    }
+    return NULL;
+}
+
+/* must be called with the shard lock held */
+static void cache_lru_unlink(cache_shard_t *shard, cache_entry_t *entry)
+{
+    if (entry->prev != NULL)
+    {
+        entry->prev->next = entry->next;
+    }
+    else
+    {
+        shard->first = entry->next;
+    }
+    if (entry->next != NULL)
+    {
+        entry->next->prev = entry->prev;
+    }
+    else
+    {
+        shard->last = entry->prev;
+    }
+    entry->prev = NULL;
+    entry->next = NULL;
+}
+
+/* must be called with the shard lock held */
+static void cache_lru_push(cache_shard_t *shard, cache_entry_t *entry)
+{
+    entry->prev = NULL;
+    entry->next = shard->first;
+    if (shard->first != NULL)
+    {
+        shard->first->prev = entry;
+    }
+    else
+    {
+        shard->last = entry;
+    }
+    shard->first = entry;
+}
+
+/* must be called with the shard lock held */
+static void cache_remove(cache_shard_t *shard, cache_entry_t *entry)
+{
+    cache_entry_t **prev = NULL;
+
+    prev = &shard->bucket[cache_get_bucket(cache_hash(entry->key, entry->uri_len))];
+    while (*prev != entry)
+    {
+        prev = &(*prev)->hash_next;
+    }
+    *prev = entry->hash_next;
+    cache_lru_unlink(shard, entry);
+    shard->size -= entry->size;
+    cache_entry_delete(entry);
+}
+
+int cache_init(size_t max_size)
+{
+    unsigned i = 0;
+    int ret = 0;
+
+    memset(cache_shard, 0, sizeof(cache_shard));
+    for (i = 0; i < CACHE_NUM_SHARDS; i++)
+    {
+        ret = lock_create(&cache_shard[i].lock);
+        if (ret < 0)
+        {
+            while (i > 0)
+            {
+                i--;
+                lock_destroy(&cache_shard[i].lock);
+            }
+            return ret;
+        }
+    }
+    cache_shard_max_size = max_size / CACHE_NUM_SHARDS;
+    return 0;
+}
+
+void cache_deinit(void)
+{
+    cache_shard_t *shard = NULL;
+    unsigned i = 0;
+
+    for (i = 0; i < CACHE_NUM_SHARDS; i++)
+    {
+        shard = &cache_shard[i];
+        while (shard->first != NULL)
+        {
+            cache_remove(shard, shard->first);
+        }
+        lock_destroy(&shard->lock);
+    }
+}
+
+/*  the key holds the number, length and value of the Uri-Host,
+ *  Uri-Port, Uri-Path, Uri-Query and Accept options in order
+ *
+ *  return: { 1, the request has other options and cannot be served from the cache
+ *          { 0, success
+ *          {<0, error
+ */
+int cache_key(coap_msg_t *req_msg, char **key, size_t *key_len, size_t *uri_len)
+{
+    coap_msg_op_t *op = NULL;
+    unsigned num = 0;
+    size_t len = 0;
+    char *p = NULL;
+    int other = 0;
+
+    *uri_len = 0;
+    op = coap_msg_get_first_op(req_msg);
+    while (op != NULL)
+    {
+        num = coap_msg_op_get_num(op);
+        if (cache_op_is_uri(num))
+        {
+            *uri_len += 4 + coap_msg_op_get_len(op);
+            len += 4 + coap_msg_op_get_len(op);
+        }
+        else if (num == COAP_MSG_ACCEPT)
+        {
+            len += 4 + coap_msg_op_get_len(op);
+        }
+        else
+        {
+            other = 1;
+        }
+        op = coap_msg_op_get_next(op);
+    }
+    *key = (char *)malloc(len + 1);
+    if (*key == NULL)
+    {
+        return -ENOMEM;
+    }
+    /* options are kept in order of option number so the Uri-* options come first */
+    p = *key;
+    op = coap_msg_get_first_op(req_msg);
+    while (op != NULL)
+    {
+        num = coap_msg_op_get_num(op);
+        if (cache_op_is_uri(num) || (num == COAP_MSG_ACCEPT))
+        {
+            p[0] = (num >> 8) & 0xff;
+            p[1] = num & 0xff;
+            p[2] = (coap_msg_op_get_len(op) >> 8) & 0xff;
+            p[3] = coap_msg_op_get_len(op) & 0xff;
+            memcpy(p + 4, coap_msg_op_get_val(op), coap_msg_op_get_len(op));
+            p += 4 + coap_msg_op_get_len(op);
+        }
+        op = coap_msg_op_get_next(op);
+    }
+    *key_len = len;
+    return other;
+}
+
+/*  a fresh response is copied with its Max-Age option set to the
+ *  remaining freshness, a stale response is copied without one
+ *
+ *  return: { CACHE_FRESH, fresh response copied
+ *          { CACHE_STALE, stale response copied
+ *          { CACHE_MISS,  no usable entry
+ *          {<0,           error
+ */
+int cache_get(const char *key, size_t key_len, size_t uri_len, coap_msg_t *resp_msg)
+{
+    cache_shard_t *shard = NULL;
+    cache_entry_t *entry = NULL;
+    unsigned hash = 0;
+    ssize_t num = 0;
+    time_t now = 0;
+    int ret = 0;
+
+    if (cache_shard_max_size == 0)
+    {
+        return CACHE_MISS;
+    }
+    hash = cache_hash(key, uri_len);
+    shard = cache_get_shard(hash);
+    now = cache_now();
+    lock_get(&shard->lock);
+    entry = cache_find(shard, hash, key, key_len);
+    if (entry == NULL)
+    {
+        lock_put(&shard->lock);
+        return CACHE_MISS;
+    }
+    if ((entry->expiry <= now) && (!entry->has_etag))
+    {
+        /* a stale entry without an ETag cannot be revalidated */
+        cache_remove(shard, entry);
+        lock_put(&shard->lock);
+        return CACHE_MISS;
+    }
+    cache_lru_unlink(shard, entry);
+    cache_lru_push(shard, entry);
+    num = coap_msg_parse(resp_msg, entry->buf, entry->len);
+    if (num < 0)
+    {
+        lock_put(&shard->lock);
+        return num;
+    }
+    if (entry->expiry <= now)
+    {
+        lock_put(&shard->lock);
+        return CACHE_STALE;
+    }
+    lock_put(&shard->lock);
+    ret = cache_add_max_age(resp_msg, entry->expiry - now);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    return CACHE_FRESH;
+}
+
+/*  return: { 1, response not stored
+ *          { 0, response stored
+ *          {<0, error
+ */
+int cache_put(const char *key, size_t key_len, size_t uri_len, coap_msg_t *resp_msg)
+{
+    cache_shard_t *shard = NULL;
+    cache_entry_t *entry = NULL;
+    cache_entry_t *old = NULL;
+    unsigned block_size = 0;
+    unsigned block_more = 0;
+    unsigned block_num = 0;
+    unsigned max_age = 0;
+    unsigned hash = 0;
+    int has_etag = 0;
+    int ret = 0;
+
+    if (cache_shard_max_size == 0)
+    {
+        return 1;
+    }
+    if ((coap_msg_get_code_class(resp_msg) != COAP_MSG_SUCCESS)
+     || (coap_msg_get_code_detail(resp_msg) != COAP_MSG_CONTENT))
+    {
+        return 1;
+    }
+    if (coap_msg_parse_block_op(&block_num, &block_more, &block_size, resp_msg, COAP_MSG_BLOCK2) != 1)
+    {
+        /* only complete representations are stored */
+        return 1;
+    }
+    /* servers that say nothing about freshness are not cached */
+    has_etag = cache_has_etag(resp_msg);
+    if ((!cache_get_max_age(resp_msg, &max_age)) && (!has_etag))
+    {
+        return 1;
+    }
+    entry = (cache_entry_t *)calloc(1, sizeof(cache_entry_t));
+    if (entry == NULL)
+    {
+        return -ENOMEM;
+    }
+    ret = cache_format(resp_msg, &entry->buf, &entry->len);
+    if (ret < 0)
+    {
+        free(entry);
+        return ret;
+    }
+    entry->size = sizeof(cache_entry_t) + key_len + entry->len;
+    if (entry->size > cache_shard_max_size)
+    {
+        cache_entry_delete(entry);
+        return 1;
+    }
+    entry->key = (char *)malloc(key_len + 1);
+    if (entry->key == NULL)
+    {
+        cache_entry_delete(entry);
+        return -ENOMEM;
+    }
+    memcpy(entry->key, key, key_len);
+    entry->key_len = key_len;
+    entry->uri_len = uri_len;
+    entry->has_etag = has_etag;
+    entry->expiry = cache_now() + max_age;
+
+    hash = cache_hash(key, uri_len);
+    shard = cache_get_shard(hash);
+    lock_get(&shard->lock);
+    old = cache_find(shard, hash, key, key_len);
+    if (old != NULL)
+    {
+        cache_remove(shard, old);
+    }
+    entry->hash_next = shard->bucket[cache_get_bucket(hash)];
+    shard->bucket[cache_get_bucket(hash)] = entry;
+    cache_lru_push(shard, entry);
+    shard->size += entry->size;
+    while (shard->size > cache_shard_max_size)
+    {
+        cache_remove(shard, shard->last);
+    }
+    lock_put(&shard->lock);
+    return 0;
+}
+
+/*  called when the CoAP server has answered a revalidation request
+ *  with 2.03 (Valid), the stale response is stored again with the
+ *  freshness given by the valid response and copied into it
+ *
+ *  return: { 0, success
+ *          {<0, error
+ */
+int cache_revalidate(const char *key, size_t key_len, size_t uri_len, coap_msg_t *valid_msg, coap_msg_t *stale_msg)
+{
+    unsigned max_age = 0;
+    int ret = 0;
+
+    /* the stale response has no Max-Age option */
+    cache_get_max_age(valid_msg, &max_age);
+    coap_msg_reset(valid_msg);
+    ret = coap_msg_copy(valid_msg, stale_msg);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    ret = cache_add_max_age(valid_msg, max_age);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    ret = cache_put(key, key_len, uri_len, valid_msg);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    return 0;
+}
+
+/* remove the entry for a key */
+void cache_delete(const char *key, size_t key_len, size_t uri_len)
+{
+    cache_shard_t *shard = NULL;
+    cache_entry_t *entry = NULL;
+    unsigned hash = 0;
+
+    if (cache_shard_max_size == 0)
+    {
+        return;
+    }
+    hash = cache_hash(key, uri_len);
+    shard = cache_get_shard(hash);
+    lock_get(&shard->lock);
+    entry = cache_find(shard, hash, key, key_len);
+    if (entry != NULL)
+    {
+        cache_remove(shard, entry);
+    }
+    lock_put(&shard->lock);
+}
+
+/* remove the entries for a URI, whatever their Accept options */
+void cache_invalidate(const char *key, size_t uri_len)
+{
+    cache_shard_t *shard = NULL;
+    cache_entry_t *entry = NULL;
+    cache_entry_t *next = NULL;
+    unsigned hash = 0;
+
+    if (cache_shard_max_size == 0)
+    {
+        return;
+    }
+    hash = cache_hash(key, uri_len);
+    shard = cache_get_shard(hash);
+    lock_get(&shard->lock);
+    entry = shard->bucket[cache_get_bucket(hash)];
+    while (entry != NULL)
+    {
+        next = entry->hash_next;
+        if ((entry->uri_len == uri_len)
+         && (memcmp(entry->key, key, uri_len) == 0))
+        {
+            cache_remove(shard, entry);
+        }
+        entry = next;
+    }
+    lock_put(&shard->lock);
+}
@@ -36,14 +36,14 @@
 #include <string.h>
 #include <signal.h>
 #include <errno.h>
+#include <time.h>
 #include <fcntl.h>
 #include <sys/types.h>
 #include "connection.h"
 #include "http_msg.h"
 #include "uri.h"
 #include "cross.h"
-#include "thread.h"
-#include "lock.h"
+#include "stats.h"
 #include "coap_log.h"
 
 #define CONNECTION_DATA_BUF_SIZE       4096
@@ -58,168 +58,420 @@ typedef enum
 {
     CON_RET_TIMEDOUT = 1,
     CON_RET_CLOSED = 2,
+    CON_RET_STREAM = 3,
+    CON_RET_AGAIN = 4,
+    CON_RET_PENDING = 5,
+    CON_RET_FLIGHT = 6,
+    CON_RET_UPSTREAM = 7
 }
 con_ret_t;
 
 #ifdef CONNECTION_STATS
 
-#define STATS_BUF_LEN  256
+#define stats_ok_con()                  stats_inc(STATS_OK_CON)
+#define stats_fail_con()                stats_inc(STATS_FAIL_CON)
+#define stats_ok_trans()                stats_inc(STATS_OK_TRANS)
+#define stats_fail_trans()              stats_inc(STATS_FAIL_TRANS)
+#define stats_shared_trans()            stats_inc(STATS_SHARED_TRANS)
+#define stats_cached_trans()            stats_inc(STATS_CACHED_TRANS)
+#define stats_time_start(start)         stats_start(start)
+#define stats_time_http_parse(start)    stats_record(STATS_HTTP_PARSE, start)
+#define stats_time_coap_exchange(start) stats_record(STATS_COAP_EXCHANGE, start)
+#define stats_time_tls_write(start)     stats_record(STATS_TLS_WRITE, start)
 
-typedef struct
-{
-    unsigned ok_con;
-    unsigned fail_con;
-    unsigned ok_trans;
-    unsigned fail_trans;
-    lock_t lock;
-}
-connection_stats_t;
+#else  /* !CONNECTION_STATS */
 
-connection_stats_t stats = {0};
+#define stats_ok_con()
+#define stats_fail_con()
+#define stats_ok_trans()
+#define stats_fail_trans()
+#define stats_shared_trans()
+#define stats_cached_trans()
+#define stats_time_start(start)         ((void)(start))
+#define stats_time_http_parse(start)
+#define stats_time_coap_exchange(start)
+#define stats_time_tls_write(start)
+#define stats_init()
 
-#define stats_lock()        {lock_get(&stats.lock);}
-#define stats_unlock()      {lock_put(&stats.lock);}
-#define stats_ok_con()      {stats_lock(); stats.ok_con++;      stats_unlock();}
-#define stats_fail_con()    {stats_lock(); stats.fail_con++;    stats_unlock();}
-#define stats_ok_trans()    {stats_lock(); stats.ok_trans++;    stats_unlock();}
-#define stats_fail_trans()  {stats_lock(); stats.fail_trans++;  stats_unlock();}
+#endif  /* CONNECTION_STATS */
 
-static int stats_init(void)
+int connection_init(param_t *param)
 {
-    memset(&stats, 0, sizeof(connection_stats_t));
-    return lock_create(&stats.lock);
+    int ret = 0;
+
+    stats_init();
+    ret = cache_init(param_get_cache_max_size(param));
+    if (ret < 0)
+    {
+        return ret;
+    }
+    ret = flight_init();
+    if (ret < 0)
+    {
+        cache_deinit();
+        return ret;
+    }
+    ret = upstream_init(param);
+    if (ret < 0)
+    {
+        flight_deinit();
+        cache_deinit();
+        return ret;
+    }
+    return 0;
 }
 
-static void stats_log(void)
+void connection_deinit(void)
 {
-    stats_lock();
+    upstream_deinit();
+    flight_deinit();
+    cache_deinit();
+}
 
-    coap_log_info("OK connections:      %u", stats.ok_con);
-    coap_log_info("Failed connections:  %u", stats.fail_con);
-    coap_log_info("OK transactions:     %u", stats.ok_trans);
-    coap_log_info("Failed transactions: %u", stats.fail_trans);
-    fflush(stdout);
+/*  return: { CON_RET_UPSTREAM, waiting for a client from the pool
+ *          { 0,                success
+ *          {<0,                error
+ */
+static int connection_upstream_acquire(connection_t *con, uri_t *uri)
+{
+    int ret = 0;
 
-    stats_unlock();
+    ret = upstream_acquire(&con->upstream, &con->upstream_waiter, uri_get_host(uri), uri_get_port(uri));
+    if (ret == 0)
+    {
+        coap_log_debug("[%u] <%u> %s Reusing connection to CoAP server host %s and port %s",
+                       con->listener_index, con->con_index, con->addr,
+                       uri_get_host(uri), uri_get_port(uri));
+        return 0;
+    }
+    if (ret == 1)
+    {
+        coap_log_debug("[%u] <%u> %s Waiting for connection to CoAP server host %s and port %s",
+                       con->listener_index, con->con_index, con->addr,
+                       uri_get_host(uri), uri_get_port(uri));
+        return CON_RET_UPSTREAM;
+    }
+    con->upstream = NULL;
+    coap_log_error("[%u] <%u> %s Failed to connect to CoAP server host %s and port %s: %s",
+                   con->listener_index, con->con_index, con->addr,
+                   uri_get_host(uri), uri_get_port(uri),
+                   strerror(-ret));
+    return ret;
 }
 
-#else  /* !CONNECTION_STATS */
+/*  return: { 0, success
+ *          {<0, error
+ */
+static int connection_upstream_get_result(connection_t *con)
+{
+    int ret = 0;
 
-#define stats_ok_con()
-#define stats_fail_con()
-#define stats_ok_trans()
-#define stats_fail_trans()
-#define stats_log()
+    ret = upstream_get_result(&con->upstream_waiter, &con->upstream);
+    if (ret == 0)
+    {
+        coap_log_debug("[%u] <%u> %s Reusing connection to CoAP server host %s and port %s",
+                       con->listener_index, con->con_index, con->addr,
+                       upstream_get_host(con->upstream), upstream_get_port(con->upstream));
+        return 0;
+    }
+    if (ret == 1)
+    {
+        coap_log_info("[%u] <%u> %s Connected to CoAP server host %s and port %s",
+                      con->listener_index, con->con_index, con->addr,
+                      upstream_get_host(con->upstream), upstream_get_port(con->upstream));
+        return 0;
+    }
+    con->upstream = NULL;
+    coap_log_error("[%u] <%u> %s Failed to connect to CoAP server: %s",
+                   con->listener_index, con->con_index, con->addr, strerror(-ret));
+    return ret;
+}
 
-static int stats_init(void)
+static void connection_upstream_leave(connection_t *con)
 {
-    return 0;
+    if (upstream_waiter_is_waiting(&con->upstream_waiter))
+    {
+        upstream_leave(&con->upstream_waiter);
+    }
 }
 
-#endif  /* CONNECTION_STATS */
+static void connection_upstream_release(connection_t *con, int fail)
+{
+    if (con->upstream == NULL)
+    {
+        return;
+    }
+    if (fail)
+    {
+        coap_log_info("[%u] <%u> %s Disconnecting from CoAP server host %s and port %s",
+                      con->listener_index, con->con_index, con->addr,
+                      upstream_get_host(con->upstream), upstream_get_port(con->upstream));
+    }
+    upstream_release(con->upstream, fail);
+    con->upstream = NULL;
+}
 
-int connection_init(void)
+static void connection_cache_clear(connection_t *con)
 {
-    return stats_init();
+    free(con->cache_key);
+    con->cache_key = NULL;
+    con->cache_key_len = 0;
+    con->cache_uri_len = 0;
+    con->cache_state = CACHE_MISS;
+    coap_msg_reset(&con->cache_resp_msg);
 }
 
-/*  return: { 0, success
+/*  a stale response is revalidated by adding its ETag to the request
+ *
+ *  return: { CACHE_FRESH, response copied from the cache
+ *          { CACHE_STALE, request changed to revalidate the cached response
+ *          { CACHE_MISS,  response not in the cache
+ */
+static int connection_cache_lookup(connection_t *con)
+{
+    coap_msg_op_t *op = NULL;
+    int ret = 0;
+
+    ret = cache_key(&con->coap_req_msg, &con->cache_key, &con->cache_key_len, &con->cache_uri_len);
+    if (ret < 0)
+    {
+        coap_log_warn("[%u] <%u> %s Failed to look up response in cache: %s",
+                      con->listener_index, con->con_index, con->addr, strerror(-ret));
+        con->cache_key = NULL;
+        return CACHE_MISS;
+    }
+    if (ret == 1)
+    {
+        /* the request has options that the cache does not consider */
+        connection_cache_clear(con);
+        return CACHE_MISS;
+    }
+    ret = cache_get(con->cache_key, con->cache_key_len, con->cache_uri_len, &con->cache_resp_msg);
+    if (ret == CACHE_FRESH)
+    {
+        coap_log_info("[%u] <%u> %s Serving response from cache",
+                      con->listener_index, con->con_index, con->addr);
+        ret = coap_msg_copy(&con->coap_resp_msg, &con->cache_resp_msg);
+        connection_cache_clear(con);
+        if (ret < 0)
+        {
+            coap_msg_reset(&con->coap_resp_msg);
+            return CACHE_MISS;
+        }
+        return CACHE_FRESH;
+    }
+    if (ret == CACHE_STALE)
+    {
+        op = coap_msg_get_first_op(&con->cache_resp_msg);
+        while ((op != NULL) && (coap_msg_op_get_num(op) != COAP_MSG_ETAG))
+        {
+            op = coap_msg_op_get_next(op);
+        }
+        ret = coap_msg_add_op(&con->coap_req_msg, COAP_MSG_ETAG, coap_msg_op_get_len(op), coap_msg_op_get_val(op));
+        if (ret < 0)
+        {
+            coap_log_warn("[%u] <%u> %s Failed to revalidate response in cache: %s",
+                          con->listener_index, con->con_index, con->addr, strerror(-ret));
+            connection_cache_clear(con);
+            return CACHE_MISS;
+        }
+        coap_log_info("[%u] <%u> %s Revalidating response in cache",
+                      con->listener_index, con->con_index, con->addr);
+        con->cache_state = CACHE_STALE;
+        return CACHE_STALE;
+    }
+    if (ret < 0)
+    {
+        coap_log_warn("[%u] <%u> %s Failed to look up response in cache: %s",
+                      con->listener_index, con->con_index, con->addr, strerror(-ret));
+    }
+    coap_msg_reset(&con->cache_resp_msg);
+    con->cache_state = CACHE_MISS;
+    return CACHE_MISS;
+}
+
+/*  store the response to a GET request or invalidate the
+ *  responses for the URI of a successful unsafe request,
+ *  a stale response that fails revalidation is removed
+ *
+ *  return: { 0, success
  *          {<0, error
  */
-static int connection_coap_client_create(connection_t *con, uri_t *uri)
+static int connection_cache_update(connection_t *con)
 {
+    size_t key_len = 0;
+    size_t uri_len = 0;
+    char *key = NULL;
     int ret = 0;
 
-    coap_log_info("[%u] <%u> %s Connecting to CoAP server host %s and port %s",
-                  con->listener_index, con->con_index, con->addr,
-                  uri_get_host(uri), uri_get_port(uri));
-
-    ret = coap_client_create(&con->coap_client,
-                            uri_get_host(uri),
-                            uri_get_port(uri),
-                            param_get_coap_client_key_file_name(con->param),
-                            param_get_coap_client_cert_file_name(con->param),
-                            param_get_coap_client_trust_file_name(con->param),
-                            NULL,
-                            NULL);
+    if (coap_msg_get_code_detail(&con->coap_req_msg) != COAP_MSG_GET)
+    {
+        if (coap_msg_get_code_class(&con->coap_resp_msg) == COAP_MSG_SUCCESS)
+        {
+            ret = cache_key(&con->coap_req_msg, &key, &key_len, &uri_len);
+            if (ret >= 0)
+            {
+                cache_invalidate(key, uri_len);
+                free(key);
+            }
+        }
+        return 0;
+    }
+    if (con->cache_key == NULL)
+    {
+        return 0;
+    }
+    if ((con->cache_state == CACHE_STALE)
+     && (coap_msg_get_code_class(&con->coap_resp_msg) == COAP_MSG_SUCCESS)
+     && (coap_msg_get_code_detail(&con->coap_resp_msg) == COAP_MSG_VALID))
+    {
+        ret = cache_revalidate(con->cache_key, con->cache_key_len, con->cache_uri_len,
+                               &con->coap_resp_msg, &con->cache_resp_msg);
+        if (ret < 0)
+        {
+            coap_log_error("[%u] <%u> %s Failed to revalidate response in cache: %s",
+                           con->listener_index, con->con_index, con->addr, strerror(-ret));
+            return ret;
+        }
+        coap_log_info("[%u] <%u> %s Serving revalidated response from cache",
+                      con->listener_index, con->con_index, con->addr);
+        stats_cached_trans();
+        return 0;
+    }
+    ret = cache_put(con->cache_key, con->cache_key_len, con->cache_uri_len, &con->coap_resp_msg);
     if (ret < 0)
     {
-        coap_log_error("[%u] <%u> %s Failed to connect to CoAP server host %s and port %s: %s",
-                       con->listener_index, con->con_index, con->addr,
-                       uri_get_host(uri), uri_get_port(uri),
-                       strerror(-ret));
-        return ret;
+        coap_log_warn("[%u] <%u> %s Failed to store response in cache: %s",
+                      con->listener_index, con->con_index, con->addr, strerror(-ret));
     }
-    con->coap_client_host = strdup(uri->host);
-    if (con->coap_client_host == NULL)
+    if ((ret != 0) && (con->cache_state == CACHE_STALE))
     {
-        coap_client_destroy(&con->coap_client);
-        coap_log_error("[%u] <%u> %s Out-of-memory",
-                       con->listener_index, con->con_index, con->addr);
-        return -ENOMEM;
+        /* the stale response was not replaced so it must not be revalidated again */
+        cache_delete(con->cache_key, con->cache_key_len, con->cache_uri_len);
+        coap_log_info("[%u] <%u> %s Removed response from cache",
+                      con->listener_index, con->con_index, con->addr);
     }
-    con->coap_client_port = strdup(uri->port);
-    if (con->coap_client_port == NULL)
+    return 0;
+}
+
+/*  return: { CON_RET_FLIGHT, waiting for another connection to complete an identical request
+ *          { 0,              send the request
+ */
+static int connection_flight_join(connection_t *con)
+{
+    flight_t *flight = NULL;
+    int ret = 0;
+
+    ret = flight_join(&flight, &con->flight_waiter, &con->coap_req_msg);
+    if (ret < 0)
     {
-        free(con->coap_client_host);
-        con->coap_client_host = NULL;
-        coap_client_destroy(&con->coap_client);
-        coap_log_error("[%u] <%u> %s Out-of-memory",
-                       con->listener_index, con->con_index, con->addr);
-        return -ENOMEM;
+        /* the request can still be sent on its own */
+        coap_log_warn("[%u] <%u> %s Failed to share request to CoAP server: %s",
+                      con->listener_index, con->con_index, con->addr, strerror(-ret));
+        return 0;
     }
-    con->coap_client_active = 1;
+    if (ret == 1)
+    {
+        coap_log_info("[%u] <%u> %s Waiting for the response to an identical request to CoAP server",
+                      con->listener_index, con->con_index, con->addr);
+        con->wait_flight = flight;
+        return CON_RET_FLIGHT;
+    }
+    con->lead_flight = flight;
     return 0;
 }
 
-static void connection_coap_client_destroy(connection_t *con)
+/* pass the result of the exchange to connections waiting for it */
+static void connection_flight_complete(connection_t *con, int status)
 {
-    coap_log_info("[%u] <%u> %s Disconnecting from CoAP server host %s and port %s",
-                  con->listener_index, con->con_index, con->addr,
-                  con->coap_client_host, con->coap_client_port);
-    con->coap_client_active = 0;
-    free(con->coap_client_port);
-    con->coap_client_port = NULL;
-    free(con->coap_client_host);
-    con->coap_client_host = NULL;
-    coap_client_destroy(&con->coap_client);
+    if (con->lead_flight == NULL)
+    {
+        return;
+    }
+    if (status > 0)
+    {
+        /* the response continues in further blocks that only this connection receives */
+        status = FLIGHT_RETRY;
+    }
+    flight_complete(con->lead_flight, status, &con->coap_resp_msg);
+    con->lead_flight = NULL;
 }
 
-/*  return: { CON_RET_CLOSED,   socket closed remotely
- *          { CON_RET_TIMEDOUT, timeout
- *          { 0,                success
- *          {<0,                error
+static void connection_flight_leave(connection_t *con)
+{
+    if (con->wait_flight == NULL)
+    {
+        return;
+    }
+    flight_leave(con->wait_flight, &con->flight_waiter);
+    con->wait_flight = NULL;
+}
+
+/*  return: { CON_RET_CLOSED, socket closed remotely
+ *          { CON_RET_AGAIN,  waiting for more data from the HTTP client
+ *          { 0,              success
+ *          {<0,              error
  */
 static int connection_recv(connection_t *con, http_msg_t *msg)
 {
-    struct timeval tv = {0};
+    struct timespec start = {0};
     ssize_t num = 0;
-    fd_set readfds = {{0}};
     int ret = 0;
-    int sd = 0;
 
-    tv.tv_sec = tls_sock_get_timeout(con->sock);
-    tv.tv_usec = 0;
-    sd = tls_sock_get_sd(con->sock);
     while (1)
     {
-        FD_ZERO(&readfds);
-        FD_SET(sd, &readfds);
-        errno = 0;
-        ret = select(sd + 1, &readfds, NULL, NULL, &tv);
-        if (ret == 0)
+        /* data left over from a previous read may hold a complete request */
+        if (data_buf_get_count(&con->recv_buf) > 0)
         {
-            coap_log_info("[%u] <%u> %s Timed out waiting to read from socket connected to HTTP client",
-                          con->listener_index, con->con_index, con->addr);
-            return CON_RET_TIMEDOUT;
+            /* parsing continues from where it stopped after the previous read */
+            stats_time_start(&start);
+            num = http_msg_parse_next(&con->parser, msg, data_buf_get_data(&con->recv_buf), data_buf_get_count(&con->recv_buf));
+            stats_time_http_parse(&start);
+            if (num > 0)
+            {
+                data_buf_consume(&con->recv_buf, num);
+                coap_log_debug("[%u] <%u> %s Received from HTTP client: %s %s %s",
+                               con->listener_index, con->con_index, con->addr,
+                               http_msg_get_start(msg, 0),
+                               http_msg_get_start(msg, 1),
+                               http_msg_get_start(msg, 2));
+                return 0;  /* success */
+            }
+            else if (num == -EAGAIN)
+            {
+                coap_log_debug("[%u] <%u> %s Received incomplete request message from HTTP client",
+                               con->listener_index, con->con_index, con->addr);
+                if (data_buf_get_space(&con->recv_buf) < CONNECTION_DATA_BUF_MIN_SPACE)
+                {
+                    coap_log_debug("[%u] <%u> %s Increasing size of receive buffer",
+                                   con->listener_index, con->con_index, con->addr);
+                    ret = data_buf_expand(&con->recv_buf);
+                    if (ret == -EINVAL)
+                    {
+                        coap_log_error("[%u] <%u> %s Request message from HTTP client too long",
+                                       con->listener_index, con->con_index, con->addr);
+                        return ret;
+                    }
+                    else if (ret == -ENOMEM)
+                    {
+                        coap_log_error("[%u] <%u> %s Out of memory",
+                                       con->listener_index, con->con_index, con->addr);
+                        return ret;
+                    }
+                }
+            }
+            else
+            {
+                coap_log_error("[%u] <%u> %s Failed to parse request message from HTTP client: %s",
+                               con->listener_index, con->con_index, con->addr, http_msg_strerror(num));
+                return num;
+            }
         }
-        else if (ret == -1)
+        num = tls_sock_try_read(con->sock, data_buf_get_next(&con->recv_buf), data_buf_get_space(&con->recv_buf));
+        if (num == SOCK_AGAIN)
         {
-            coap_log_error("[%u] <%u> %s Call to select returned: -1, errno: %d (%s)",
-                           con->listener_index, con->con_index, con->addr, errno, strerror(errno));
-            return -errno;
+            return CON_RET_AGAIN;
         }
-        num = tls_sock_read(con->sock, data_buf_get_next(&con->recv_buf), data_buf_get_space(&con->recv_buf));
         if (num < 0)
         {
             coap_log_error("[%u] <%u> %s Failed to read from socket connected to HTTP client: %s",
@@ -233,67 +485,20 @@ static int connection_recv(connection_t *con, http_msg_t *msg)
             return CON_RET_CLOSED;
         }
         data_buf_add(&con->recv_buf, num);
-        num = http_msg_parse(msg, data_buf_get_data(&con->recv_buf), data_buf_get_count(&con->recv_buf));
-        if (num > 0)
-        {
-            data_buf_consume(&con->recv_buf, num);
-            coap_log_debug("[%u] <%u> %s Received from HTTP client: %s %s %s",
-                           con->listener_index, con->con_index, con->addr,
-                           http_msg_get_start(msg, 0),
-                           http_msg_get_start(msg, 1),
-                           http_msg_get_start(msg, 2));
-            return 0;  /* success */
-        }
-        else if (num == -EAGAIN)
-        {
-            coap_log_debug("[%u] <%u> %s Received incomplete request message from HTTP client",
-                           con->listener_index, con->con_index, con->addr);
-            if (data_buf_get_space(&con->recv_buf) < CONNECTION_DATA_BUF_MIN_SPACE)
-            {
-                coap_log_debug("[%u] <%u> %s Increasing size of receive buffer",
-                               con->listener_index, con->con_index, con->addr);
-                ret = data_buf_expand(&con->recv_buf);
-                if (ret == -EINVAL)
-                {
-                    coap_log_error("[%u] <%u> %s Request message from HTTP client too long",
-                                   con->listener_index, con->con_index, con->addr);
-                    return ret;
-                }
-                else if (ret == -ENOMEM)
-                {
-                    coap_log_error("[%u] <%u> %s Out of memory",
-                                   con->listener_index, con->con_index, con->addr);
-                    return ret;
-                }
-            }
-        }
-        else
-        {
-            coap_log_error("[%u] <%u> %s Failed to parse request message from HTTP client: %s",
-                           con->listener_index, con->con_index, con->addr, http_msg_strerror(ret));
-            return num;
-        }
     }
-    return 0;
 }
 
-/*  return: { CON_RET_CLOSED, socket closed remotely
- *          { 0,              success
- *          {<0,              error
+/*  make room in the send buffer for more than len bytes
+ *
+ *  return: { 0, success
+ *          {<0, error
  */
-static int connection_send(connection_t *con, http_msg_t *msg)
+static int connection_reserve(connection_t *con, size_t len)
 {
-    ssize_t num = 0;
-    size_t len = 0;
     int ret = 0;
 
-    while (1)
+    while (data_buf_get_space(&con->send_buf) <= len)
     {
-        len = http_msg_generate(msg, data_buf_get_data(&con->send_buf), data_buf_get_space(&con->send_buf));
-        if (len <= data_buf_get_space(&con->send_buf))
-        {
-            break;
-        }
         coap_log_debug("[%u] <%u> %s Increasing size of send buffer",
                        con->listener_index, con->con_index, con->addr);
         ret = data_buf_expand(&con->send_buf);
@@ -310,24 +515,107 @@ static int connection_send(connection_t *con, http_msg_t *msg)
             return ret;
         }
     }
-    num = tls_sock_write_full(con->sock, data_buf_get_data(&con->send_buf), len);
-    if (num < 0)
+    return 0;
+}
+
+/*  return: { 0, success
+ *          {<0, error
+ */
+static int connection_queue(connection_t *con, http_msg_t *msg)
+{
+    size_t len = 0;
+    int ret = 0;
+
+    while (1)
     {
-        coap_log_error("[%u] <%u> %s Failed to write to socket conected to HTTP client: %s",
-                       con->listener_index, con->con_index, con->addr, sock_strerror(num));
-        return -1;
+        len = http_msg_generate(msg, data_buf_get_next(&con->send_buf), data_buf_get_space(&con->send_buf));
+        if (len < data_buf_get_space(&con->send_buf))
+        {
+            break;
+        }
+        ret = connection_reserve(con, len);
+        if (ret < 0)
+        {
+            return ret;
+        }
     }
-    if (num == 0)
+    data_buf_add(&con->send_buf, len);
+    return 0;
+}
+
+/*  return: { 0, success
+ *          {<0, error
+ */
+static int connection_queue_chunk(connection_t *con, const char *buf, size_t len)
+{
+    size_t chunk_len = 0;
+    int ret = 0;
+
+    ret = connection_reserve(con, len + CONNECTION_INT_BUF_LEN);
+    if (ret < 0)
     {
-        coap_log_error("[%u] <%u> %s Socket connection to HTTP client closed remotely",
-                       con->listener_index, con->con_index, con->addr);
-        return CON_RET_CLOSED;
+        return ret;
+    }
+    chunk_len = http_msg_generate_chunk(data_buf_get_next(&con->send_buf), data_buf_get_space(&con->send_buf), buf, len);
+    data_buf_add(&con->send_buf, chunk_len);
+    return 0;
+}
+
+/*  return: { 0, success
+ *          {<0, error
+ */
+static int connection_queue_last_chunk(connection_t *con)
+{
+    size_t len = 0;
+    int ret = 0;
+
+    ret = connection_reserve(con, CONNECTION_INT_BUF_LEN);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    len = http_msg_generate_last_chunk(data_buf_get_next(&con->send_buf), data_buf_get_space(&con->send_buf));
+    len += http_msg_generate_blank_line(data_buf_get_next(&con->send_buf) + len, data_buf_get_space(&con->send_buf) - len);
+    data_buf_add(&con->send_buf, len);
+    return 0;
+}
+
+/*  write as much of the send buffer as the socket accepts
+ *
+ *  return: { CON_RET_CLOSED, socket closed remotely
+ *          { CON_RET_AGAIN,  waiting for the socket to become writable
+ *          { 0,              send buffer written
+ *          {<0,              error
+ */
+static int connection_flush(connection_t *con)
+{
+    struct timespec start = {0};
+    ssize_t num = 0;
+
+    while (data_buf_get_count(&con->send_buf) > 0)
+    {
+        /* the same data is written again after the socket becomes writable */
+        stats_time_start(&start);
+        num = tls_sock_try_write(con->sock, data_buf_get_data(&con->send_buf), data_buf_get_count(&con->send_buf));
+        stats_time_tls_write(&start);
+        if (num == SOCK_AGAIN)
+        {
+            return CON_RET_AGAIN;
+        }
+        if (num < 0)
+        {
+            coap_log_error("[%u] <%u> %s Failed to write to socket conected to HTTP client: %s",
+                           con->listener_index, con->con_index, con->addr, sock_strerror(num));
+            return -1;
+        }
+        if (num == 0)
+        {
+            coap_log_error("[%u] <%u> %s Socket connection to HTTP client closed remotely",
+                           con->listener_index, con->con_index, con->addr);
+            return CON_RET_CLOSED;
+        }
+        data_buf_consume(&con->send_buf, num);
     }
-    coap_log_debug("[%u] <%u> %s Sent to HTTP client: %s %s %s",
-                   con->listener_index, con->con_index, con->addr,
-                   http_msg_get_start(msg, 0),
-                   http_msg_get_start(msg, 1),
-                   http_msg_get_start(msg, 2));
     return 0;
 }
 
@@ -352,237 +640,483 @@ static int connection_gen_error_resp(connection_t *con, http_msg_t *msg, unsigne
     return 0;
 }
 
+static const char *connection_coap_method_str(coap_msg_t *msg)
+{
+    switch (coap_msg_get_code_detail(msg))
+    {
+    case COAP_MSG_GET:
+        return "GET";
+    case COAP_MSG_PUT:
+        return "PUT";
+    case COAP_MSG_POST:
+        return "POST";
+    case COAP_MSG_DELETE:
+        return "DELETE";
+    }
+    return NULL;
+}
+
 /*  return: { 0, success
  *          {<0, error
  */
-static int connection_coap_exchange(connection_t *con, coap_msg_t *req_msg, coap_msg_t *resp_msg)
+static int connection_coap_add_block_op(coap_msg_t *msg, unsigned type, size_t start, unsigned more, unsigned size)
 {
-    unsigned code_detail = 0;
-    unsigned code_class = 0;
-    unsigned block_size = 0;
-    unsigned block_more = 0;
-    unsigned block_num = 0;
-    ssize_t num = 0;
+    char block_val[COAP_MSG_OP_MAX_BLOCK_VAL_LEN] = {0};
+    int szx = 0;
     int ret = 0;
 
-    if (coap_msg_get_code_detail(req_msg) == COAP_MSG_GET)
+    ret = coap_msg_op_calc_block_szx(size);
+    if (ret < 0)
     {
-        /* execute regular exchange */
-        coap_log_info("[%u] <%u> %s Sending GET request to CoAP server host %s and port %s",
-                      con->listener_index, con->con_index, con->addr,
-                      con->coap_client_host, con->coap_client_port);
-        ret = coap_client_exchange(&con->coap_client, req_msg, resp_msg);
-        if (ret < 0)
-        {
-            return ret;
-        }
-        ret = coap_msg_parse_block_op(&block_num, &block_more, &block_size, resp_msg, COAP_MSG_BLOCK2);
-        if (ret == 1)  /* not found */
-        {
-            return 0;
-        }
+        return ret;
+    }
+    szx = ret;
+    ret = coap_msg_op_format_block_val(block_val, sizeof(block_val), coap_msg_block_start_to_num(start, szx), more, size);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    return coap_msg_add_op(msg, type, ret, block_val);
+}
+
+static void connection_coap_handle(coap_client_t *client, coap_msg_t *req, coap_msg_t *resp, int status, void *data)
+{
+    connection_t *con = (connection_t *)data;
+
+    if (status == 0)
+    {
+        /* the response is only valid for the duration of the call */
+        coap_msg_reset(&con->coap_resp_msg);
+        status = coap_msg_copy(&con->coap_resp_msg, resp);
+    }
+    con->coap_status = status;
+}
+
+/*  return: { CON_RET_PENDING, waiting for the response from the CoAP server
+ *          {<0,               error
+ */
+static int connection_coap_async_send(connection_t *con, coap_msg_t *req_msg)
+{
+    int ret = 0;
+
+    stats_time_start(&con->coap_start);
+    con->coap_status = 1;
+    ret = coap_client_async_send(upstream_get_client(con->upstream), req_msg, connection_coap_handle, con);
+    if (ret < 0)
+    {
+        con->coap_status = 0;
+        return ret;
+    }
+    return CON_RET_PENDING;
+}
+
+/*  send the block of the request body that starts at block1_start
+ *
+ *  return: { CON_RET_PENDING, waiting for the response from the CoAP server
+ *          {<0,               error
+ */
+static int connection_coap_send_block1(connection_t *con)
+{
+    coap_msg_t msg = {0};
+    unsigned more = 0;
+    size_t len = 0;
+    int ret = 0;
+
+    len = con->body_end - con->block1_start;
+    if (len > con->block1_size)
+    {
+        len = con->block1_size;
+        more = 1;
+    }
+    coap_msg_create(&msg);
+    ret = coap_msg_copy(&msg, &con->coap_req_msg);
+    if (ret < 0)
+    {
+        coap_msg_destroy(&msg);
+        return ret;
+    }
+    ret = connection_coap_add_block_op(&msg, COAP_MSG_BLOCK1, con->block1_start, more, con->block1_size);
+    if (ret < 0)
+    {
+        coap_msg_destroy(&msg);
+        return ret;
+    }
+    if (!more)
+    {
+        /* the last block sets the size of the blocks in the response */
+        ret = connection_coap_add_block_op(&msg, COAP_MSG_BLOCK2, 0, 0, CONNECTION_COAP_BLOCK2_SIZE);
         if (ret < 0)
         {
+            coap_msg_destroy(&msg);
             return ret;
         }
-        /* continue using block transfer */
-        coap_log_info("[%u] <%u> %s Continuing GET request using blockwise transfer to CoAP server host %s and port %s",
-                      con->listener_index, con->con_index, con->addr,
-                      con->coap_client_host, con->coap_client_port);
-        num = coap_client_exchange_blockwise(&con->coap_client,
-                                             req_msg, resp_msg,
-                                             block_size,
-                                             block_size,
-                                             con->body, con->body_len,
-                                             /* have_resp */ 1);
-        if (num < 0)
-        {
-            return num;
-        }
-        con->body_end = num;
     }
-    else if (coap_msg_get_code_detail(req_msg) == COAP_MSG_PUT)
+    ret = coap_msg_set_payload(&msg, con->body + con->block1_start, len);
+    if (ret < 0)
     {
-        if (con->body_end > 0)
-        {
-            /* execute blockwise exchange */
-            coap_log_info("[%u] <%u> %s Sending PUT request using blockwise transfer to CoAP server host %s and port %s",
-                          con->listener_index, con->con_index, con->addr,
-                          con->coap_client_host, con->coap_client_port);
-            num = coap_client_exchange_blockwise(&con->coap_client,
-                                                 req_msg, resp_msg,
-                                                 CONNECTION_COAP_BLOCK1_SIZE,
-                                                 CONNECTION_COAP_BLOCK2_SIZE,
-                                                 con->body, con->body_end,
-                                                 /* have_resp */ 0);
-            if (num < 0)
-            {
-                return num;
-            }
-            con->body_end = num;
-            return 0;
-        }
-        /* execute regular exchange */
-        coap_log_info("[%u] <%u> %s Sending PUT request to CoAP server host %s and port %s",
-                      con->listener_index, con->con_index, con->addr,
-                      con->coap_client_host, con->coap_client_port);
-        ret = coap_client_exchange(&con->coap_client, req_msg, resp_msg);
-        if (ret < 0)
+        coap_msg_destroy(&msg);
+        return ret;
+    }
+    con->block1_len = len;
+    ret = connection_coap_async_send(con, &msg);
+    coap_msg_destroy(&msg);
+    return ret;
+}
+
+/*  each block of the request body is sent when the previous one has been acknowledged
+ *
+ *  return: { CON_RET_PENDING, waiting for the response from the CoAP server
+ *          { 0,               success
+ *          {<0,               error
+ */
+static int connection_coap_send(connection_t *con, coap_msg_t *req_msg)
+{
+    const char *method = NULL;
+
+    method = connection_coap_method_str(req_msg);
+    if (method == NULL)
+    {
+        return 0;
+    }
+    if ((coap_msg_get_code_detail(req_msg) != COAP_MSG_GET)
+     && (con->body_end > 0))
+    {
+        /* execute blockwise exchange */
+        coap_log_info("[%u] <%u> %s Sending %s request using blockwise transfer to CoAP server host %s and port %s",
+                      con->listener_index, con->con_index, con->addr, method,
+                      upstream_get_host(con->upstream), upstream_get_port(con->upstream));
+        con->block1_start = 0;
+        con->block1_size = CONNECTION_COAP_BLOCK1_SIZE;
+        return connection_coap_send_block1(con);
+    }
+    /* execute regular exchange */
+    coap_log_info("[%u] <%u> %s Sending %s request to CoAP server host %s and port %s",
+                  con->listener_index, con->con_index, con->addr, method,
+                  upstream_get_host(con->upstream), upstream_get_port(con->upstream));
+    return connection_coap_async_send(con, req_msg);
+}
+
+/*  called when the response to a block of the request body has been received
+ *
+ *  return: { CON_RET_PENDING, waiting for the response to the next block
+ *          { 0,               success
+ *          {<0,               error
+ */
+static int connection_coap_complete_block1(connection_t *con, coap_msg_t *resp_msg)
+{
+    unsigned block_size = 0;
+    unsigned block_more = 0;
+    unsigned block_num = 0;
+    int ret = 0;
+
+    if ((coap_msg_get_code_class(resp_msg) != COAP_MSG_SUCCESS)
+     || ((coap_msg_get_code_detail(resp_msg) != COAP_MSG_CONTINUE)
+      && (coap_msg_get_code_detail(resp_msg) != COAP_MSG_CREATED)
+      && (coap_msg_get_code_detail(resp_msg) != COAP_MSG_CHANGED)))
+    {
+        /* the response is passed on to the HTTP client */
+        con->block1_size = 0;
+        con->body_end = 0;
+        return 0;
+    }
+    ret = coap_msg_parse_block_op(&block_num, &block_more, &block_size, resp_msg, COAP_MSG_BLOCK1);
+    if (ret != 0)
+    {
+        return -EBADMSG;
+    }
+    /* allow the server to resize the blocks */
+    if (block_size < con->block1_size)
+    {
+        con->block1_size = block_size;
+    }
+    /* check that the acknowledged block is the one that was sent */
+    if (block_num * con->block1_size != con->block1_start)
+    {
+        return -EBADMSG;
+    }
+    con->block1_start += con->block1_len;
+    if (con->block1_start < con->body_end)
+    {
+        return connection_coap_send_block1(con);
+    }
+    /* the body of the HTTP response comes from the CoAP response */
+    con->block1_size = 0;
+    con->body_end = 0;
+    return 0;
+}
+
+/*  called when the response to an exchange has been received
+ *
+ *  return: { CON_RET_PENDING, waiting for the response to the next block of the request body
+ *          { 1,               response body continues in further blocks
+ *          { 0,               success
+ *          {<0,               error
+ */
+static int connection_coap_complete(connection_t *con, coap_msg_t *req_msg, coap_msg_t *resp_msg)
+{
+    unsigned block_size = 0;
+    unsigned block_more = 0;
+    unsigned block_num = 0;
+    int ret = 0;
+
+    if (con->block1_size > 0)
+    {
+        ret = connection_coap_complete_block1(con, resp_msg);
+        if (ret != 0)
         {
             return ret;
         }
-        code_class = coap_msg_get_code_class(resp_msg);
-        code_detail = coap_msg_get_code_detail(resp_msg);
-        if ((code_class == COAP_MSG_CLIENT_ERR)
-         && (code_detail == COAP_MSG_REQ_ENT_TOO_LARGE))
-        {
-            /* retry using block transfer */
-            memcpy(con->body, coap_msg_get_payload(req_msg), coap_msg_get_payload_len(req_msg));
-            con->body_end = coap_msg_get_payload_len(req_msg);
-            coap_msg_clear_payload(req_msg);
-            coap_log_info("[%u] <%u> %s Resending PUT request using blockwise transfer to CoAP server host %s and port %s",
-                          con->listener_index, con->con_index, con->addr,
-                          con->coap_client_host, con->coap_client_port);
-            num = coap_client_exchange_blockwise(&con->coap_client,
-                                                 req_msg, resp_msg,
-                                                 CONNECTION_COAP_BLOCK1_SIZE,
-                                                 CONNECTION_COAP_BLOCK2_SIZE,
-                                                 con->body, con->body_end,
-                                                 /* have_resp */ 0);
-            if (num < 0)
-            {
-                return num;
-            }
-            con->body_end = num;
-        }
     }
-    else if (coap_msg_get_code_detail(req_msg) == COAP_MSG_POST)
+    else if ((coap_msg_get_code_detail(req_msg) != COAP_MSG_GET)
+          && (coap_msg_get_code_class(resp_msg) == COAP_MSG_CLIENT_ERR)
+          && (coap_msg_get_code_detail(resp_msg) == COAP_MSG_REQ_ENT_TOO_LARGE))
     {
-        if (con->body_end > 0)
-        {
-            /* execute blockwise exchange */
-            coap_log_info("[%u] <%u> %s Sending POST request using blockwise transfer to CoAP server host %s and port %s",
-                          con->listener_index, con->con_index, con->addr,
-                          con->coap_client_host, con->coap_client_port);
-            num = coap_client_exchange_blockwise(&con->coap_client,
-                                                 req_msg, resp_msg,
-                                                 CONNECTION_COAP_BLOCK1_SIZE,
-                                                 CONNECTION_COAP_BLOCK2_SIZE,
-                                                 con->body, con->body_end,
-                                                 /* have_resp */ 0);
-            if (num < 0)
-            {
-                return num;
-            }
-            con->body_end = num;
-            return 0;
-        }
-        /* execute regular exchange */
-        coap_log_info("[%u] <%u> %s Sending POST request to CoAP server host %s and port %s",
+        /* retry using block transfer */
+        memcpy(con->body, coap_msg_get_payload(req_msg), coap_msg_get_payload_len(req_msg));
+        con->body_end = coap_msg_get_payload_len(req_msg);
+        coap_msg_clear_payload(req_msg);
+        coap_log_info("[%u] <%u> %s Resending %s request using blockwise transfer to CoAP server host %s and port %s",
                       con->listener_index, con->con_index, con->addr,
-                      con->coap_client_host, con->coap_client_port);
-        ret = coap_client_exchange(&con->coap_client, req_msg, resp_msg);
+                      connection_coap_method_str(req_msg),
+                      upstream_get_host(con->upstream), upstream_get_port(con->upstream));
+        coap_msg_reset(resp_msg);
+        con->block1_start = 0;
+        con->block1_size = CONNECTION_COAP_BLOCK1_SIZE;
+        return connection_coap_send_block1(con);
+    }
+    ret = coap_msg_parse_block_op(&block_num, &block_more, &block_size, resp_msg, COAP_MSG_BLOCK2);
+    if (ret == 1)  /* not found */
+    {
+        return 0;
+    }
+    if (ret < 0)
+    {
+        return ret;
+    }
+    if ((coap_msg_get_code_class(resp_msg) != COAP_MSG_SUCCESS)
+     || (block_more == 0))
+    {
+        return 0;
+    }
+    /* continue using block transfer */
+    return 1;
+}
+
+/*  queue the block of the response body in a response from the CoAP server as a chunk
+ *
+ *  return: { 0, success
+ *          {<0, error
+ */
+static int connection_stream_block(connection_t *con, coap_msg_t *coap_resp_msg)
+{
+    unsigned payload_len = 0;
+    unsigned block_size = 0;
+    unsigned block_more = 0;
+    unsigned block_num = 0;
+    int ret = 0;
+
+    if (coap_msg_get_code_class(coap_resp_msg) != COAP_MSG_SUCCESS)
+    {
+        coap_log_error("[%u] <%u> %s CoAP server returned an error after sending response head",
+                       con->listener_index, con->con_index, con->addr);
+        return -EBADMSG;
+    }
+    ret = coap_msg_parse_block_op(&block_num, &block_more, &block_size, coap_resp_msg, COAP_MSG_BLOCK2);
+    if (ret != 0)
+    {
+        return -EBADMSG;
+    }
+    /* allow the server to resize the blocks */
+    if (block_size < con->block2_size)
+    {
+        con->block2_size = block_size;
+    }
+    /* check that the received block is the next one in sequence */
+    payload_len = coap_msg_get_payload_len(coap_resp_msg);
+    if ((block_num * con->block2_size != con->block2_start)
+     || (payload_len > con->block2_size)
+     || ((block_more) && (payload_len != con->block2_size)))
+    {
+        coap_log_error("[%u] <%u> %s CoAP server returned an unexpected block after sending response head",
+                       con->listener_index, con->con_index, con->addr);
+        return -EBADMSG;
+    }
+    /* a zero-length chunk would terminate the HTTP message body */
+    if (payload_len > 0)
+    {
+        ret = connection_queue_chunk(con, coap_msg_get_payload(coap_resp_msg), payload_len);
         if (ret < 0)
         {
             return ret;
         }
-        code_class = coap_msg_get_code_class(resp_msg);
-        code_detail = coap_msg_get_code_detail(resp_msg);
-        if ((code_class == COAP_MSG_CLIENT_ERR)
-         && (code_detail == COAP_MSG_REQ_ENT_TOO_LARGE))
-        {
-            /* retry using block transfer */
-            memcpy(con->body, coap_msg_get_payload(req_msg), coap_msg_get_payload_len(req_msg));
-            con->body_end = coap_msg_get_payload_len(req_msg);
-            coap_msg_clear_payload(req_msg);
-            coap_log_info("[%u] <%u> %s Resending POST request using blockwise transfer to CoAP server host %s and port %s",
-                          con->listener_index, con->con_index, con->addr,
-                          con->coap_client_host, con->coap_client_port);
-            num = coap_client_exchange_blockwise(&con->coap_client,
-                                                 req_msg, resp_msg,
-                                                 CONNECTION_COAP_BLOCK1_SIZE,
-                                                 CONNECTION_COAP_BLOCK2_SIZE,
-                                                 con->body, con->body_end,
-                                                 /* have_resp */ 0);
-            if (num < 0)
-            {
-                return num;
-            }
-            con->body_end = num;
-        }
     }
-    return 0;
+    con->block2_start += payload_len;
+    if (block_more)
+    {
+        return 0;
+    }
+    con->block2_size = 0;
+    return connection_queue_last_chunk(con);
+}
+
+/*  request the next block of the response body
+ *
+ *  return: { CON_RET_PENDING, waiting for the response from the CoAP server
+ *          {<0,               error
+ */
+static int connection_stream_next(connection_t *con)
+{
+    coap_msg_t msg = {0};
+    int ret = 0;
+
+    coap_msg_create(&msg);
+    ret = coap_msg_copy(&msg, &con->coap_req_msg);
+    if (ret < 0)
+    {
+        coap_msg_destroy(&msg);
+        return ret;
+    }
+    /* the request body has already been sent */
+    coap_msg_clear_payload(&msg);
+    ret = connection_coap_add_block_op(&msg, COAP_MSG_BLOCK2, con->block2_start, 0, con->block2_size);
+    if (ret < 0)
+    {
+        coap_msg_destroy(&msg);
+        return ret;
+    }
+    ret = connection_coap_async_send(con, &msg);
+    coap_msg_destroy(&msg);
+    return ret;
 }
 
-/*  return: { 0, success
- *          {<0, error
+/*  queue the response head and the first block of the response body,
+ *  the remaining blocks are requested as the HTTP client takes them
+ *
+ *  return: { CON_RET_STREAM, response queued
+ *          { 0,              response generated but not queued
+ *          {<0,              error
  */
-static int connection_process(connection_t *con, http_msg_t *req_msg, http_msg_t *resp_msg)
+static int connection_stream(connection_t *con, coap_msg_t *coap_resp_msg, http_msg_t *resp_msg)
 {
-    coap_msg_t coap_resp_msg = {0};
-    coap_msg_t coap_req_msg = {0};
+    coap_msg_t coap_head_msg = {0};
+    unsigned block_size = 0;
+    unsigned block_more = 0;
+    unsigned block_num = 0;
     unsigned code = 0;
-    uri_t uri = {0};
     int ret = 0;
 
-    coap_msg_create(&coap_req_msg);
-    ret = cross_req_http_to_coap(&coap_req_msg, con->body, con->body_len, &con->body_end, req_msg, &code);
+    ret = coap_msg_parse_block_op(&block_num, &block_more, &block_size, coap_resp_msg, COAP_MSG_BLOCK2);
+    if (ret != 0)
+    {
+        return connection_gen_error_resp(con, resp_msg, 502);
+    }
+
+    /* the HTTP response head is generated from the first block */
+    coap_msg_create(&coap_head_msg);
+    ret = coap_msg_copy(&coap_head_msg, coap_resp_msg);
     if (ret < 0)
     {
-        coap_log_error("[%u] <%u> %s Failed to convert HTTP message to CoAP message: %s",
+        coap_msg_destroy(&coap_head_msg);
+        return ret;
+    }
+    coap_msg_clear_payload(&coap_head_msg);
+    if (coap_msg_get_code_detail(&coap_head_msg) == COAP_MSG_CONTINUE)
+    {
+        /* the status of the whole representation */
+        coap_msg_set_code(&coap_head_msg, COAP_MSG_SUCCESS, COAP_MSG_CONTENT);
+    }
+    ret = cross_resp_coap_to_http(resp_msg, &coap_head_msg, NULL, 0, &code);
+    coap_msg_destroy(&coap_head_msg);
+    if (ret < 0)
+    {
+        coap_log_error("[%u] <%u> %s Failed to convert CoAP message to HTTP message: %s",
                        con->listener_index, con->con_index, con->addr, strerror(-ret));
-        coap_msg_destroy(&coap_req_msg);
         return connection_gen_error_resp(con, resp_msg, code);
     }
-    uri_create(&uri);
-    ret = uri_parse(&uri, http_msg_get_start(req_msg, 1));
+    ret = http_msg_set_header(resp_msg, "Transfer-Encoding", "chunked");
     if (ret < 0)
     {
-        coap_log_error("[%u] <%u> %s Failed to parse request URI in request message from HTTP client: %s",
-                       con->listener_index, con->con_index, con->addr, strerror(-ret));
-        uri_destroy(&uri);
-        coap_msg_destroy(&coap_req_msg);
+        coap_log_error("[%u] <%u> %s Failed to set header in response message to HTTP client: %s",
+                       con->listener_index, con->con_index, con->addr, http_msg_strerror(ret));
         return ret;
     }
-    if (!con->coap_client_active)
+    ret = connection_queue(con, resp_msg);
+    if (ret < 0)
     {
-        /* first exchange with a CoAP server */
-        ret = connection_coap_client_create(con, &uri);
-        if (ret < 0)
-        {
-            uri_destroy(&uri);
-            coap_msg_destroy(&coap_req_msg);
-            return ret;
-        }
+        return ret;
     }
-    else if ((strcasecmp(uri_get_host(&uri), con->coap_client_host) != 0)
-          || (strcmp(uri_get_port(&uri), con->coap_client_port) != 0))
+
+    /* the status line has been queued so errors from */
+    /* here on can only be reported by closing the    */
+    /* connection before the last chunk               */
+    coap_log_info("[%u] <%u> %s Continuing %s request using blockwise transfer to CoAP server host %s and port %s",
+                  con->listener_index, con->con_index, con->addr,
+                  connection_coap_method_str(&con->coap_req_msg),
+                  upstream_get_host(con->upstream), upstream_get_port(con->upstream));
+    con->block2_start = 0;
+    con->block2_size = block_size;
+    ret = connection_stream_block(con, coap_resp_msg);
+    if (ret < 0)
     {
-        /* subsequent exchange with a different CoAP server */
-        connection_coap_client_destroy(con);
-        ret = connection_coap_client_create(con, &uri);
-        if (ret < 0)
-        {
-            uri_destroy(&uri);
-            coap_msg_destroy(&coap_req_msg);
-            return ret;
-        }
+        return ret;
     }
-    else
+    return CON_RET_STREAM;
+}
+
+/*  write the queued response, the next block of a streamed
+ *  response body is only requested once the send buffer is empty
+ *
+ *  return: { CON_RET_CLOSED,  socket closed remotely
+ *          { CON_RET_AGAIN,   waiting for the socket to become writable
+ *          { CON_RET_PENDING, waiting for the next block from the CoAP server
+ *          { 0,               response sent
+ *          {<0,               error
+ */
+static int connection_send(connection_t *con)
+{
+    int ret = 0;
+
+    ret = connection_flush(con);
+    if (ret != 0)  /* this must be if (ret != 0) and not if (ret < 0) */
     {
-        /* subsequent exchange with the same CoAP server */
-        coap_log_debug("[%u] <%u> %s Maintaining connection to CoAP server host %s and port %s",
-                       con->listener_index, con->con_index, con->addr,
-                       con->coap_client_host, con->coap_client_port);
+        return ret;
+    }
+    if (con->block2_size > 0)
+    {
+        return connection_stream_next(con);
+    }
+    coap_log_debug("[%u] <%u> %s Sent to HTTP client: %s %s %s",
+                   con->listener_index, con->con_index, con->addr,
+                   http_msg_get_start(&con->resp_msg, 0),
+                   http_msg_get_start(&con->resp_msg, 1),
+                   http_msg_get_start(&con->resp_msg, 2));
+    return 0;
+}
+
+/*  return: { CON_RET_STREAM, response queued
+ *          { 0,              success
+ *          {<0,              error
+ */
+static int connection_process_resp(connection_t *con, int ret, http_msg_t *resp_msg)
+{
+    unsigned code = 0;
+
+    if (ret == 0)
+    {
+        ret = connection_cache_update(con);
+    }
+    connection_flight_complete(con, ret);
+    if (ret == 1)
+    {
+        /* stream the remaining blocks to the HTTP client */
+        return connection_stream(con, &con->coap_resp_msg, resp_msg);
     }
-    uri_destroy(&uri);
-    coap_msg_create(&coap_resp_msg);
-    ret = connection_coap_exchange(con, &coap_req_msg, &coap_resp_msg);
-    coap_msg_destroy(&coap_req_msg);
     if (ret < 0)
     {
         coap_log_error("[%u] <%u> %s CoAP client exchange failed: %s",
                        con->listener_index, con->con_index, con->addr, strerror(-ret));
+        /* the client is not returned to the pool in an unknown state */
+        connection_upstream_release(con, 1);
         switch (ret)
         {
         case -ETIMEDOUT:
@@ -590,26 +1124,20 @@ static int connection_process(connection_t *con, http_msg_t *req_msg, http_msg_t
              * (such as the CoAP origin server) and is unable to obtain a result within
              * a reasonable time frame, a 504 (Gateway Timeout) response is returned.
              */
-            ret = connection_gen_error_resp(con, resp_msg, 504);
-            break;
+            return connection_gen_error_resp(con, resp_msg, 504);
         case -EBADMSG:
             /* If a result can be obtained but is not understood, a 502 (Bad Gateway)
              * response is returned.
              */
-            ret = connection_gen_error_resp(con, resp_msg, 502);
-            break;
+            return connection_gen_error_resp(con, resp_msg, 502);
         default:
             /* If the proxy is unable or unwilling to service a request with a CoAP URI,
              * a 501 (Not Implemented) response is returned to the client.
              */
-            ret = connection_gen_error_resp(con, resp_msg, 501);
-            break;
+            return connection_gen_error_resp(con, resp_msg, 501);
         }
-        coap_msg_destroy(&coap_resp_msg);
-        return ret;
     }
-    ret = cross_resp_coap_to_http(resp_msg, &coap_resp_msg, con->body, con->body_end, &code);
-    coap_msg_destroy(&coap_resp_msg);
+    ret = cross_resp_coap_to_http(resp_msg, &con->coap_resp_msg, con->body, con->body_end, &code);
     if (ret < 0)
     {
         coap_log_error("[%u] <%u> %s Failed to convert CoAP message to HTTP message: %s",
@@ -619,61 +1147,140 @@ static int connection_process(connection_t *con, http_msg_t *req_msg, http_msg_t
     return 0;
 }
 
-/*  return: { CON_RET_CLOSED,   socket closed remotely
- *          { CON_RET_TIMEDOUT, timeout
- *          { 0,                success
- *          {<0,                error
+/*  return: { CON_RET_STREAM,  response queued
+ *          { CON_RET_PENDING, waiting for the response from the CoAP server
+ *          { 0,               success
+ *          {<0,               error
  */
-static int __connection_exchange(connection_t *con, http_msg_t *req_msg, http_msg_t *resp_msg)
+static int connection_exchange_send(connection_t *con, http_msg_t *resp_msg)
 {
     int ret = 0;
 
-    /* receive request */
-    ret = connection_recv(con, req_msg);
-    if (ret != 0)  /* this must be if (ret != 0) and not if (ret < 0) */
+    ret = connection_coap_send(con, &con->coap_req_msg);
+    if (ret == CON_RET_PENDING)
     {
-        return ret;  /* timeout or error */
+        return ret;
     }
+    return connection_process_resp(con, ret, resp_msg);
+}
+
+/*  return: { CON_RET_STREAM,   response queued
+ *          { CON_RET_PENDING,  waiting for the response from the CoAP server
+ *          { CON_RET_UPSTREAM, waiting for a client from the pool
+ *          { 0,                success
+ *          {<0,                error
+ */
+static int connection_exchange(connection_t *con, http_msg_t *req_msg, http_msg_t *resp_msg)
+{
+    uri_t uri = {0};
+    int ret = 0;
 
-    /* process request and generate response */
-    ret = connection_process(con, req_msg, resp_msg);
+    uri_create(&uri);
+    ret = uri_parse(&uri, http_msg_get_start(req_msg, 1));
     if (ret < 0)
     {
+        coap_log_error("[%u] <%u> %s Failed to parse request URI in request message from HTTP client: %s",
+                       con->listener_index, con->con_index, con->addr, strerror(-ret));
+        uri_destroy(&uri);
+        connection_flight_complete(con, FLIGHT_RETRY);
         return ret;
     }
-
-    /* send response */
-    ret = connection_send(con, resp_msg);
-    if (ret != 0)  /* this must be if (ret != 0) and not if (ret < 0) */
+    ret = connection_upstream_acquire(con, &uri);
+    uri_destroy(&uri);
+    if (ret == CON_RET_UPSTREAM)
     {
         return ret;
     }
-
-    return 0;
+    if (ret < 0)
+    {
+        connection_flight_complete(con, FLIGHT_RETRY);
+        return ret;
+    }
+    return connection_exchange_send(con, resp_msg);
 }
 
-/*  return: { CON_RET_CLOSED,   socket closed remotely
- *          { CON_RET_TIMEDOUT, timeout
+/*  return: { CON_RET_STREAM,   response queued
+ *          { CON_RET_PENDING,  waiting for the response from the CoAP server
+ *          { CON_RET_UPSTREAM, waiting for a client from the pool
+ *          { CON_RET_FLIGHT,   waiting for another connection to complete an identical request
  *          { 0,                success
  *          {<0,                error
  */
-static int connection_exchange(connection_t *con)
+static int connection_process(connection_t *con, http_msg_t *req_msg, http_msg_t *resp_msg)
 {
-    http_msg_t resp_msg = {{0}};
-    http_msg_t req_msg = {{0}};
-    int status = 0;
+    unsigned code = 0;
+    int ret = 0;
+
+    ret = cross_req_http_to_coap(&con->coap_req_msg, con->body, con->body_len, &con->body_end, req_msg, &code);
+    if (ret < 0)
+    {
+        coap_log_error("[%u] <%u> %s Failed to convert HTTP message to CoAP message: %s",
+                       con->listener_index, con->con_index, con->addr, strerror(-ret));
+        return connection_gen_error_resp(con, resp_msg, code);
+    }
+    if (coap_msg_get_code_detail(&con->coap_req_msg) == COAP_MSG_GET)
+    {
+        ret = connection_cache_lookup(con);
+        if (ret == CACHE_FRESH)
+        {
+            stats_cached_trans();
+            return connection_process_resp(con, 0, resp_msg);
+        }
+        /* identical GET requests in progress at the same time share one exchange */
+        ret = connection_flight_join(con);
+        if (ret == CON_RET_FLIGHT)
+        {
+            return ret;
+        }
+    }
+    return connection_exchange(con, req_msg, resp_msg);
+}
+
+/*  return: { CON_RET_CLOSED,  socket closed remotely
+ *          { CON_RET_AGAIN,   waiting for the socket to become writable
+ *          { CON_RET_PENDING, waiting for the next block from the CoAP server
+ *          { 0,               success
+ *          {<0,               error
+ */
+static int connection_respond(connection_t *con, int status, http_msg_t *resp_msg)
+{
+    if (status == 0)
+    {
+        status = connection_queue(con, resp_msg);
+        if (status < 0)
+        {
+            return status;
+        }
+    }
+    else if (status != CON_RET_STREAM)
+    {
+        return status;
+    }
+    return connection_send(con);
+}
+
+static void connection_start_exchange(connection_t *con)
+{
+    struct timespec now = {0};
 
     coap_log_notice("[%u] <%u> %s Transaction with HTTP client started",
                     con->listener_index, con->con_index, con->addr);
 
     memset(con->body, 0, con->body_len);
     con->body_end = 0;
+    con->block1_start = 0;
+    con->block1_len = 0;
+    con->block1_size = 0;
+    con->block2_start = 0;
+    con->block2_size = 0;
 
-    http_msg_create(&req_msg);
-    http_msg_create(&resp_msg);
-
-    status = __connection_exchange(con, &req_msg, &resp_msg);
+    /* the whole request must arrive before the timeout */
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    con->expiry = now.tv_sec + connection_get_timeout(con);
+}
 
+static void connection_end_exchange(connection_t *con, int status)
+{
     if (status == CON_RET_TIMEDOUT)
     {
         coap_log_notice("[%u] <%u> %s Transaction with HTTP client timed out",
@@ -697,41 +1304,264 @@ static int connection_exchange(connection_t *con)
         stats_fail_trans();
     }
 
-    http_msg_destroy(&resp_msg);
-    http_msg_destroy(&req_msg);
+    /* a client that is still held here was interrupted during the exchange */
+    connection_upstream_release(con, status != 0);
+
+    /* idle connections do not hold message buffers */
+    connection_cache_clear(con);
+    coap_msg_reset(&con->coap_resp_msg);
+    coap_msg_reset(&con->coap_req_msg);
+    http_msg_destroy(&con->resp_msg);
+    http_msg_destroy(&con->req_msg);
+    http_msg_create(&con->req_msg);
+    http_msg_create(&con->resp_msg);
 
     con->num_exchanges++;
+}
+
+static void connection_end(connection_t *con, int status)
+{
+    if (status < 0)
+    {
+        coap_log_notice("[%u] <%u> %s Connection with HTTP client failed",
+                        con->listener_index, con->con_index, con->addr);
+        stats_fail_con();
+    }
+    else
+    {
+        coap_log_notice("[%u] <%u> %s Connection with HTTP client successful",
+                        con->listener_index, con->con_index, con->addr);
+        stats_ok_con();
+    }
+}
+
+/* a client that does not take any of the response before the timeout is dropped */
+static int connection_wait_send(connection_t *con)
+{
+    struct timespec now = {0};
 
-    return status;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    con->expiry = now.tv_sec + connection_get_timeout(con);
+    return CONNECTION_WAIT_SEND;
 }
 
-void *connection_thread_func(void *data)
+/*  serve requests until the connection has to wait
+ *
+ *  return: { CONNECTION_WAIT_HTTP,     waiting for the HTTP client to send
+ *          { CONNECTION_WAIT_SEND,     waiting for the HTTP client to receive
+ *          { CONNECTION_WAIT_COAP,     waiting for the CoAP server
+ *          { CONNECTION_WAIT_FLIGHT,   waiting for another connection
+ *          { CONNECTION_WAIT_UPSTREAM, waiting for a client from the pool
+ *          { CONNECTION_DONE,          connection finished
+ */
+static int connection_serve(connection_t *con)
 {
-    connection_t *con = (connection_t *)data;
     int status = 0;
 
-    thread_block_signals();
+    while (1)
+    {
+        status = connection_recv(con, &con->req_msg);
+        if (status == CON_RET_AGAIN)
+        {
+            return CONNECTION_WAIT_HTTP;
+        }
+        if (status == 0)
+        {
+            status = connection_process(con, &con->req_msg, &con->resp_msg);
+            if (status == CON_RET_PENDING)
+            {
+                return CONNECTION_WAIT_COAP;
+            }
+            if (status == CON_RET_FLIGHT)
+            {
+                return CONNECTION_WAIT_FLIGHT;
+            }
+            if (status == CON_RET_UPSTREAM)
+            {
+                return CONNECTION_WAIT_UPSTREAM;
+            }
+            status = connection_respond(con, status, &con->resp_msg);
+            if (status == CON_RET_AGAIN)
+            {
+                return connection_wait_send(con);
+            }
+            if (status == CON_RET_PENDING)
+            {
+                return CONNECTION_WAIT_COAP;
+            }
+        }
+        connection_end_exchange(con, status);
+        if (status != 0)
+        {
+            connection_end(con, status);
+            return CONNECTION_DONE;
+        }
+        connection_start_exchange(con);
+    }
+}
+
+int connection_start(connection_t *con)
+{
     coap_log_notice("[%u] <%u> %s Connection with HTTP client started",
                     con->listener_index, con->con_index, con->addr);
-    while (status == 0)
+    connection_start_exchange(con);
+    return connection_serve(con);
+}
+
+int connection_handle_http(connection_t *con)
+{
+    return connection_serve(con);
+}
+
+/*  complete an exchange that had to wait and serve
+ *  further requests until the connection has to wait again
+ */
+static int connection_continue(connection_t *con, int status)
+{
+    if (status == CON_RET_AGAIN)
+    {
+        return connection_wait_send(con);
+    }
+    if (status == CON_RET_PENDING)
+    {
+        return CONNECTION_WAIT_COAP;
+    }
+    connection_end_exchange(con, status);
+    if (status != 0)
+    {
+        connection_end(con, status);
+        return CONNECTION_DONE;
+    }
+    connection_start_exchange(con);
+    return connection_serve(con);
+}
+
+static int connection_finish(connection_t *con, int status)
+{
+    return connection_continue(con, connection_respond(con, status, &con->resp_msg));
+}
+
+int connection_handle_send(connection_t *con)
+{
+    return connection_continue(con, connection_send(con));
+}
+
+int connection_handle_coap(connection_t *con)
+{
+    int status = 0;
+    int ret = 0;
+
+    ret = coap_client_async_process(upstream_get_client(con->upstream));
+    if (ret < 0)
+    {
+        coap_log_error("[%u] <%u> %s Failed to process messages from CoAP server host %s and port %s: %s",
+                       con->listener_index, con->con_index, con->addr,
+                       upstream_get_host(con->upstream), upstream_get_port(con->upstream),
+                       strerror(-ret));
+        /* this cancels the outstanding request */
+        connection_upstream_release(con, 1);
+        con->coap_status = ret;
+    }
+    else if (con->coap_status == 1)
+    {
+        return CONNECTION_WAIT_COAP;  /* still outstanding */
+    }
+    stats_time_coap_exchange(&con->coap_start);
+    status = con->coap_status;
+    if (con->block2_size > 0)
+    {
+        /* a block of a response body that is being streamed */
+        if (status == 0)
+        {
+            status = connection_stream_block(con, &con->coap_resp_msg);
+        }
+        else
+        {
+            coap_log_error("[%u] <%u> %s CoAP client exchange failed after sending response head: %s",
+                           con->listener_index, con->con_index, con->addr, strerror(-status));
+        }
+        if (status == 0)
+        {
+            status = connection_send(con);
+        }
+        return connection_continue(con, status);
+    }
+    if (status == 0)
+    {
+        status = connection_coap_complete(con, &con->coap_req_msg, &con->coap_resp_msg);
+        if (status == CON_RET_PENDING)
+        {
+            return CONNECTION_WAIT_COAP;
+        }
+    }
+    status = connection_process_resp(con, status, &con->resp_msg);
+    return connection_finish(con, status);
+}
+
+int connection_handle_flight(connection_t *con)
+{
+    int status = 0;
+
+    status = flight_get_result(con->wait_flight, &con->coap_resp_msg);
+    connection_flight_leave(con);
+    if (status == FLIGHT_RETRY)
+    {
+        coap_log_info("[%u] <%u> %s Unable to share the response to an identical request to CoAP server",
+                      con->listener_index, con->con_index, con->addr);
+        status = connection_exchange(con, &con->req_msg, &con->resp_msg);
+        if (status == CON_RET_PENDING)
+        {
+            return CONNECTION_WAIT_COAP;
+        }
+        if (status == CON_RET_UPSTREAM)
+        {
+            return CONNECTION_WAIT_UPSTREAM;
+        }
+    }
+    else
     {
-        status = connection_exchange(con);
+        coap_log_info("[%u] <%u> %s Received the response to an identical request to CoAP server",
+                      con->listener_index, con->con_index, con->addr);
+        stats_shared_trans();
+        /* the leader has already updated the cache */
+        connection_cache_clear(con);
+        status = connection_process_resp(con, status, &con->resp_msg);
     }
+    return connection_finish(con, status);
+}
+
+int connection_handle_upstream(connection_t *con)
+{
+    int status = 0;
+
+    status = connection_upstream_get_result(con);
     if (status < 0)
     {
-        coap_log_notice("[%u] <%u> %s Connection with HTTP client failed",
-                        con->listener_index, con->con_index, con->addr);
-        stats_fail_con();
+        connection_flight_complete(con, FLIGHT_RETRY);
+        return connection_finish(con, status);
+    }
+    status = connection_exchange_send(con, &con->resp_msg);
+    if (status == CON_RET_PENDING)
+    {
+        return CONNECTION_WAIT_COAP;
+    }
+    return connection_finish(con, status);
+}
+
+void connection_expire(connection_t *con)
+{
+    if (con->wait == CONNECTION_WAIT_SEND)
+    {
+        coap_log_info("[%u] <%u> %s Timed out waiting to write to socket connected to HTTP client",
+                      con->listener_index, con->con_index, con->addr);
     }
     else
     {
-        coap_log_notice("[%u] <%u> %s Connection with HTTP client successful",
-                        con->listener_index, con->con_index, con->addr);
-        stats_ok_con();
+        coap_log_info("[%u] <%u> %s Timed out waiting to read from socket connected to HTTP client",
+                      con->listener_index, con->con_index, con->addr);
     }
-    connection_delete(con);
-    stats_log();
-    return NULL;
+    connection_end_exchange(con, CON_RET_TIMEDOUT);
+    connection_end(con, CON_RET_TIMEDOUT);
 }
 
 connection_t *connection_new(tls_sock_t *sock, unsigned listener_index, unsigned con_index, param_t *param)
@@ -794,15 +1624,29 @@ connection_t *connection_new(tls_sock_t *sock, unsigned listener_index, unsigned
     }
     con->body_len = CONNECTION_BODY_LEN;
     con->body_end = 0;
+    http_msg_parser_create(&con->parser);
+    http_msg_create(&con->req_msg);
+    http_msg_create(&con->resp_msg);
+    coap_msg_create(&con->coap_req_msg);
+    coap_msg_create(&con->coap_resp_msg);
+    coap_msg_create(&con->cache_resp_msg);
+    con->cache_state = CACHE_MISS;
     return con;
 }
 
 void connection_delete(connection_t *con)
 {
-    if (con->coap_client_active)
-    {
-        connection_coap_client_destroy(con);
-    }
+    /* this cancels any outstanding request */
+    connection_upstream_leave(con);
+    connection_upstream_release(con, 1);
+    connection_flight_complete(con, FLIGHT_RETRY);
+    connection_flight_leave(con);
+    free(con->cache_key);
+    coap_msg_destroy(&con->cache_resp_msg);
+    coap_msg_destroy(&con->coap_resp_msg);
+    coap_msg_destroy(&con->coap_req_msg);
+    http_msg_destroy(&con->resp_msg);
+    http_msg_destroy(&con->req_msg);
     data_buf_destroy(&con->send_buf);
     data_buf_destroy(&con->recv_buf);
     free(con->body);
@@ -0,0 +1,299 @@
+/*
+ * Copyright (c) 2015 Keith Cullen.
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *  @file flight.c
+ *
+ *  @brief Source file for the FreeCoAP HTTP/CoAP proxy flight module
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "flight.h"
+#include "lock.h"
+
+#define FLIGHT_HASH_NUM  64                                                     /* must be a power of 2 */
+
+static lock_t flight_lock;
+static flight_t *flight_hash[FLIGHT_HASH_NUM] = {0};
+
+/* the key holds the number, length and value of each option in order */
+static int flight_key(coap_msg_t *msg, char **key, size_t *key_len)
+{
+    coap_msg_op_t *op = NULL;
+    size_t len = 0;
+    char *p = NULL;
+
+    op = coap_msg_get_first_op(msg);
+    while (op != NULL)
+    {
+        len += 4 + coap_msg_op_get_len(op);
+        op = coap_msg_op_get_next(op);
+    }
+    *key = (char *)malloc(len + 1);
+    if (*key == NULL)
+    {
+        return -ENOMEM;
+    }
+    p = *key;
+    op = coap_msg_get_first_op(msg);
+    while (op != NULL)
+    {
+        p[0] = (coap_msg_op_get_num(op) >> 8) & 0xff;
+        p[1] = coap_msg_op_get_num(op) & 0xff;
+        p[2] = (coap_msg_op_get_len(op) >> 8) & 0xff;
+        p[3] = coap_msg_op_get_len(op) & 0xff;
+        memcpy(p + 4, coap_msg_op_get_val(op), coap_msg_op_get_len(op));
+        p += 4 + coap_msg_op_get_len(op);
+        op = coap_msg_op_get_next(op);
+    }
+    *key_len = len;
+    return 0;
+}
+
+static unsigned flight_hash_key(const char *key, size_t key_len)
+{
+    unsigned hash = 5381;
+    size_t i = 0;
+
+    for (i = 0; i < key_len; i++)
+    {
+        hash = (hash * 33) ^ (unsigned char)key[i];
+    }
+    return hash & (FLIGHT_HASH_NUM - 1);
+}
+
+/* must be called with the lock held */
+static flight_t *flight_find(const char *key, size_t key_len)
+{
+    flight_t *flight = NULL;
+
+    flight = flight_hash[flight_hash_key(key, key_len)];
+    while (flight != NULL)
+    {
+        if ((flight->key_len == key_len)
+         && (memcmp(flight->key, key, key_len) == 0))
+        {
+            return flight;
+        }
+        flight = flight->next;
+    }
+    return NULL;
+}
+
+/* must be called with the lock held */
+static void flight_unlink(flight_t *flight)
+{
+    flight_t **prev = NULL;
+
+    prev = &flight_hash[flight_hash_key(flight->key, flight->key_len)];
+    while ((*prev != NULL) && (*prev != flight))
+    {
+        prev = &(*prev)->next;
+    }
+    if (*prev != NULL)
+    {
+        *prev = flight->next;
+    }
+    flight->next = NULL;
+}
+
+static void flight_delete(flight_t *flight)
+{
+    coap_msg_destroy(&flight->resp_msg);
+    free(flight->key);
+    free(flight);
+}
+
+int flight_init(void)
+{
+    memset(flight_hash, 0, sizeof(flight_hash));
+    return lock_create(&flight_lock);
+}
+
+/* flights in progress belong to their connections */
+void flight_deinit(void)
+{
+    lock_destroy(&flight_lock);
+}
+
+/*  return: { 1, joined the flight as a waiter
+ *          { 0, leading a new flight
+ *          {<0, error
+ */
+int flight_join(flight_t **flight, flight_waiter_t *waiter, coap_msg_t *req_msg)
+{
+    flight_t *new_flight = NULL;
+    unsigned index = 0;
+    size_t key_len = 0;
+    char *key = NULL;
+    int ret = 0;
+
+    ret = flight_key(req_msg, &key, &key_len);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    lock_get(&flight_lock);
+    *flight = flight_find(key, key_len);
+    if (*flight != NULL)
+    {
+        waiter->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (waiter->fd == -1)
+        {
+            ret = -errno;
+            lock_put(&flight_lock);
+            free(key);
+            *flight = NULL;
+            return ret;
+        }
+        waiter->next = (*flight)->waiter_first;
+        (*flight)->waiter_first = waiter;
+        (*flight)->num_refs++;
+        lock_put(&flight_lock);
+        free(key);
+        return 1;
+    }
+    new_flight = (flight_t *)calloc(1, sizeof(flight_t));
+    if (new_flight == NULL)
+    {
+        lock_put(&flight_lock);
+        free(key);
+        return -ENOMEM;
+    }
+    new_flight->key = key;
+    new_flight->key_len = key_len;
+    new_flight->num_refs = 1;
+    coap_msg_create(&new_flight->resp_msg);
+    index = flight_hash_key(key, key_len);
+    new_flight->next = flight_hash[index];
+    flight_hash[index] = new_flight;
+    lock_put(&flight_lock);
+    *flight = new_flight;
+    return 0;
+}
+
+/*  called by the leader, status is 0 if the response is to
+ *  be shared, FLIGHT_RETRY or a negative error code otherwise
+ *
+ *  the leader must not use the flight afterwards
+ */
+void flight_complete(flight_t *flight, int status, coap_msg_t *resp_msg)
+{
+    flight_waiter_t *waiter = NULL;
+    uint64_t val = 1;
+    ssize_t num = 0;
+    int ret = 0;
+
+    if (status == 0)
+    {
+        ret = coap_msg_copy(&flight->resp_msg, resp_msg);
+        if (ret < 0)
+        {
+            status = FLIGHT_RETRY;
+        }
+    }
+    lock_get(&flight_lock);
+    flight_unlink(flight);
+    flight->status = status;
+    flight->done = 1;
+    waiter = flight->waiter_first;
+    while (waiter != NULL)
+    {
+        num = write(waiter->fd, &val, sizeof(val));
+        (void)num;  /* the counter of a new event file descriptor cannot overflow */
+        waiter = waiter->next;
+    }
+    flight->num_refs--;
+    if (flight->num_refs > 0)
+    {
+        flight = NULL;
+    }
+    lock_put(&flight_lock);
+    if (flight != NULL)
+    {
+        flight_delete(flight);
+    }
+}
+
+/*  called by a waiter after its file descriptor has become readable
+ *
+ *  return: { FLIGHT_RETRY, the waiter must send its own request
+ *          { 0,            response copied
+ *          {<0,            error
+ */
+int flight_get_result(flight_t *flight, coap_msg_t *resp_msg)
+{
+    int status = 0;
+    int done = 0;
+
+    lock_get(&flight_lock);
+    done = flight->done;
+    status = flight->status;
+    lock_put(&flight_lock);
+    if (!done)
+    {
+        return -EAGAIN;
+    }
+    if (status != 0)
+    {
+        return status;
+    }
+    /* the response does not change once the flight is done */
+    return coap_msg_copy(resp_msg, &flight->resp_msg);
+}
+
+/* called by a waiter when it no longer needs the flight */
+void flight_leave(flight_t *flight, flight_waiter_t *waiter)
+{
+    flight_waiter_t **prev = NULL;
+
+    lock_get(&flight_lock);
+    prev = &flight->waiter_first;
+    while (*prev != waiter)
+    {
+        prev = &(*prev)->next;
+    }
+    *prev = waiter->next;
+    waiter->next = NULL;
+    flight->num_refs--;
+    if (flight->num_refs > 0)
+    {
+        flight = NULL;
+    }
+    lock_put(&flight_lock);
+    close(waiter->fd);
+    waiter->fd = -1;
+    if (flight != NULL)
+    {
+        flight_delete(flight);
+    }
+}
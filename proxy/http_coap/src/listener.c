@@ -32,6 +32,8 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include "listener.h"
 #include "connection.h"
 #include "sock.h"
@@ -45,7 +47,7 @@ static void *listener_thread_func(void *data)
     connection_t *con = NULL;
     tls_sock_t *sock = NULL;
     unsigned con_index = 0;
-    thread_t thread = {0};
+    worker_t *worker = NULL;
     int ret = 0;
 
     thread_block_signals();
@@ -72,7 +74,7 @@ static void *listener_thread_func(void *data)
             continue;
         }
 
-        con = connection_new(sock, listener->index, con_index++, listener->param);
+        con = connection_new(sock, listener->index, con_index, listener->param);
         if (con == NULL)
         {
             coap_log_error("Unable to create connection data");
@@ -81,10 +83,13 @@ static void *listener_thread_func(void *data)
             break;
         }
 
-        ret = thread_init(&thread, &listener->ctx, connection_thread_func, con);
+        /* the connections are spread evenly over the workers */
+        worker = &listener->workers[con_index % listener->num_workers];
+        con_index++;
+        ret = worker_add(worker, con);
         if (ret < 0)
         {
-            coap_log_error("Unable to create connection thread");
+            coap_log_error("Unable to pass connection to worker");
             connection_delete(con);
             break;
         }
@@ -94,6 +99,42 @@ static void *listener_thread_func(void *data)
     return NULL;
 }
 
+static void listener_destroy_workers(listener_t *listener, unsigned num)
+{
+    unsigned i = 0;
+
+    for (i = 0; i < num; i++)
+    {
+        worker_destroy(&listener->workers[i]);
+    }
+    free(listener->workers);
+    listener->workers = NULL;
+}
+
+static int listener_create_workers(listener_t *listener)
+{
+    unsigned i = 0;
+    int ret = 0;
+
+    listener->num_workers = param_get_num_workers(listener->param);
+    listener->workers = (worker_t *)calloc(listener->num_workers, sizeof(worker_t));
+    if (listener->workers == NULL)
+    {
+        coap_log_error("Out of memory");
+        return -ENOMEM;
+    }
+    for (i = 0; i < listener->num_workers; i++)
+    {
+        ret = worker_create(&listener->workers[i], i);
+        if (ret < 0)
+        {
+            coap_log_error("Unable to create worker: %s", strerror(-ret));
+            listener_destroy_workers(listener, i);
+            return ret;
+        }
+    }
+    return 0;
+}
 
 listener_t *listener_new(unsigned index, tls_server_t *server, param_t *param, int timeout, int backlog)
 {
@@ -118,10 +159,30 @@ listener_t *listener_new(unsigned index, tls_server_t *server, param_t *param, i
         return NULL;
     }
 
+    ret = thread_joinable_ctx_create(&listener->worker_ctx);
+    if (ret < 0)
+    {
+        coap_log_error("Unable to initialise thread context");
+        thread_ctx_destroy(&listener->ctx);
+        free(listener);
+        return NULL;
+    }
+
+    ret = listener_create_workers(listener);
+    if (ret < 0)
+    {
+        thread_ctx_destroy(&listener->worker_ctx);
+        thread_ctx_destroy(&listener->ctx);
+        free(listener);
+        return NULL;
+    }
+
     ret = tls_ssock_open(&listener->ssock, server, param_get_port(param), timeout, backlog);
     if (ret != SOCK_OK)
     {
         coap_log_error(sock_strerror(ret));
+        listener_destroy_workers(listener, listener->num_workers);
+        thread_ctx_destroy(&listener->worker_ctx);
         thread_ctx_destroy(&listener->ctx);
         free(listener);
         return NULL;
@@ -133,6 +194,8 @@ listener_t *listener_new(unsigned index, tls_server_t *server, param_t *param, i
 void listener_delete(listener_t *listener)
 {
     tls_ssock_close(&listener->ssock);
+    listener_destroy_workers(listener, listener->num_workers);
+    thread_ctx_destroy(&listener->worker_ctx);
     thread_ctx_destroy(&listener->ctx);
     free(listener);
 }
@@ -140,8 +203,18 @@ void listener_delete(listener_t *listener)
 int listener_run(listener_t *listener)
 {
     thread_t thread = {0};
+    unsigned i = 0;
     int ret = 0;
 
+    for (i = 0; i < listener->num_workers; i++)
+    {
+        ret = worker_run(&listener->workers[i], &listener->worker_ctx);
+        if (ret < 0)
+        {
+            coap_log_error("Unable to create worker thread");
+            return -1;
+        }
+    }
     ret = thread_init(&thread, &listener->ctx, listener_thread_func, listener);
     if (ret < 0)
     {
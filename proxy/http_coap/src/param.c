@@ -107,6 +107,28 @@ static int param_parse_log_level(param_t *param, config_t *config)
     return 0;
 }
 
+static int param_parse_uint(config_t *config, const char *section, const char *key, const char *def_val, long min, long max, unsigned *val)
+{
+    const char *str = NULL;
+    char *end = NULL;
+    long num = 0;
+
+    str = config_get(config, section, key);
+    if (str == NULL)
+    {
+        str = def_val;
+    }
+    num = strtol(str, &end, 10);
+    if ((*str == '\0') || (*end != '\0') || (num < min) || (num > max))
+    {
+        param_report_unknown(key, str);
+        return -1;
+    }
+    *val = num;
+    param_report_success(key, str);
+    return 0;
+}
+
 static int param_parse(param_t *param, const char *file_name, config_t *config, const char *buf)
 {
     unsigned line = 0;
@@ -196,6 +218,64 @@ static int param_parse(param_t *param, const char *file_name, config_t *config,
         return ret;
     }
 
+    ret = param_parse_key_val(config,
+                              "",
+                              "stats_file",
+                              PARAM_DEF_STATS_FILE_NAME,
+                              &param->stats_file_name);
+    if (ret != 0)
+    {
+        return ret;
+    }
+
+    ret = param_parse_uint(config,
+                           "",
+                           "workers",
+                           PARAM_DEF_NUM_WORKERS,
+                           1,
+                           PARAM_MAX_NUM_WORKERS,
+                           &param->num_workers);
+    if (ret != 0)
+    {
+        return ret;
+    }
+
+    ret = param_parse_uint(config,
+                           "coap_client",
+                           "max_per_origin",
+                           PARAM_DEF_COAP_CLIENT_MAX_PER_ORIGIN,
+                           1,
+                           PARAM_MAX_COAP_CLIENT_MAX_PER_ORIGIN,
+                           &param->coap_client_max_per_origin);
+    if (ret != 0)
+    {
+        return ret;
+    }
+
+    ret = param_parse_uint(config,
+                           "coap_client",
+                           "idle_timeout",
+                           PARAM_DEF_COAP_CLIENT_IDLE_TIMEOUT,
+                           1,
+                           PARAM_MAX_COAP_CLIENT_IDLE_TIMEOUT,
+                           &param->coap_client_idle_timeout);
+    if (ret != 0)
+    {
+        return ret;
+    }
+
+    ret = param_parse_uint(config,
+                           "cache",
+                           "max_size",
+                           PARAM_DEF_CACHE_MAX_SIZE,
+                           0,
+                           PARAM_MAX_CACHE_MAX_SIZE,
+                           &param->cache_max_size);
+    if (ret != 0)
+    {
+        return ret;
+    }
+
     return ret;
 }
 
@@ -240,6 +320,10 @@ int param_create(param_t *param, const char *file_name)
 
 void param_destroy(param_t *param)
 {
+    if (param->stats_file_name != NULL)
+    {
+        free(param->stats_file_name);
+    }
     if (param->coap_client_trust_file_name != NULL)
     {
         free(param->coap_client_trust_file_name);
@@ -42,6 +42,7 @@
 #include "connection.h"
 #include "param.h"
 #include "tls.h"
+#include "stats.h"
 #include "coap_mem.h"
 #include "coap_log.h"
 
@@ -57,6 +58,7 @@
 #define LARGE_BUF_LEN      8192                                                 /**< Length of each buffer in the large memory allocator */
 
 int go = 1;                                                                     /**< Global variable used to indicate to the listener module to run or stop */
+static volatile sig_atomic_t dump = 0;                                          /**< Flag to indicate that the statistics should be written to the statistics file */
 
 /**
  *  @brief Signal handler for the interrupt signal
@@ -68,6 +70,16 @@ static void signal_handler(int signo)
     go = 0;
 }
 
+/**
+ *  @brief Signal handler for the user-defined signal 1
+ *
+ *  @param[in] signo Signal number
+ */
+static void dump_signal_handler(int signo)
+{
+    dump = 1;
+}
+
 /**
  *  @brief Helper function to list command line options
  */
@@ -100,6 +112,7 @@ int main(int argc, char **argv)
     };
     struct sigaction sah = {{0}};
     struct sigaction sai = {{0}};
+    struct sigaction sau = {{0}};
     const char *config_file_name = CONFIG_FILE_NAME;
     const char *short_opts = ":hc:";
     const char *gnutls_ver = NULL;
@@ -116,14 +129,18 @@ int main(int argc, char **argv)
     sah.sa_flags = 0;
     sai.sa_handler = SIG_IGN;
     sai.sa_flags = 0;
+    sau.sa_handler = dump_signal_handler;
+    sau.sa_flags = 0;
     if ((sigemptyset(&sai.sa_mask) == -1)
      || (sigfillset(&sah.sa_mask)  == -1)    /* block all signals while handling this one */
+     || (sigfillset(&sau.sa_mask)  == -1)
      || (sigaction(SIGHUP,  &sah, NULL) == -1)
      || (sigaction(SIGINT,  &sah, NULL) == -1)
      || (sigaction(SIGQUIT, &sah, NULL) == -1)
      || (sigaction(SIGABRT, &sah, NULL) == -1)
      || (sigaction(SIGPIPE, &sai, NULL) == -1)
      || (sigaction(SIGTERM, &sah, NULL) == -1)
+     || (sigaction(SIGUSR1, &sau, NULL) == -1)
         )
     {
         fprintf(stderr, "Error: unable to set singal handler\n");
@@ -225,7 +242,7 @@ int main(int argc, char **argv)
         return EXIT_FAILURE;
     }
 
-    ret = connection_init();
+    ret = connection_init(&param);
     if (ret < 0)
     {
         coap_log_error("Unable to initialise connection module");
@@ -243,6 +260,7 @@ int main(int argc, char **argv)
                             SOCKET_BACKLOG);
     if (listener == NULL)
     {
+        connection_deinit();
         tls_server_destroy(&server);
         tls_deinit();
         param_destroy(&param);
@@ -254,6 +272,7 @@ int main(int argc, char **argv)
     if (ret < 0)
     {
         listener_delete(listener);
+        connection_deinit();
         tls_server_destroy(&server);
         tls_deinit();
         param_destroy(&param);
@@ -268,14 +287,31 @@ int main(int argc, char **argv)
 
     coap_log_notice("Proxy running");
 
+    /* sleep() returns early when a signal is handled */
     while (go)
     {
         sleep(3600);
+#ifdef CONNECTION_STATS
+        if (dump)
+        {
+            dump = 0;
+            ret = stats_dump(param_get_stats_file_name(&param));
+            if (ret < 0)
+            {
+                coap_log_error("Unable to write statistics file '%s': %s",
+                               param_get_stats_file_name(&param), strerror(-ret));
+            }
+        }
+#endif
     }
     sleep(2);
 
     coap_log_notice("Proxy stopped");
+#ifdef CONNECTION_STATS
+    stats_log();
+#endif
 
+    connection_deinit();
     tls_server_destroy(&server);
     tls_deinit();
     param_destroy(&param);
@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) 2015 Keith Cullen.
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *  @file stats.c
+ *
+ *  @brief Source file for the FreeCoAP HTTP/CoAP proxy statistics module
+ *
+ *  Each thread updates its own cache-line aligned shard
+ *  of counters and latency histograms using relaxed atomic
+ *  operations so no lock is taken per transaction. The
+ *  shards are summed when the statistics are read.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "stats.h"
+#include "coap_log.h"
+
+#define STATS_FILE_NAME_LEN  256
+
+typedef struct
+{
+    stats_snapshot_t data;
+}
+__attribute__((aligned(STATS_CACHE_LINE_SIZE))) stats_shard_t;
+
+static const char *stats_counter_name[STATS_NUM_COUNTERS] = {"ok_connections",
+                                                             "failed_connections",
+                                                             "ok_transactions",
+                                                             "failed_transactions",
+                                                             "shared_transactions",
+                                                             "cached_transactions"};
+
+static const char *stats_hist_name[STATS_NUM_HISTS] = {"http_parse",
+                                                       "coap_exchange",
+                                                       "tls_write"};
+
+static stats_shard_t stats_shard[STATS_NUM_SHARDS];
+static unsigned stats_next_shard = 0;
+static __thread stats_shard_t *stats_thread_shard = NULL;
+
+/* threads are assigned to shards in turn on first use */
+static stats_shard_t *stats_get_shard(void)
+{
+    unsigned index = 0;
+
+    if (stats_thread_shard == NULL)
+    {
+        index = __atomic_fetch_add(&stats_next_shard, 1, __ATOMIC_RELAXED);
+        stats_thread_shard = &stats_shard[index & (STATS_NUM_SHARDS - 1)];
+    }
+    return stats_thread_shard;
+}
+
+static unsigned stats_bucket(uint64_t usec)
+{
+    unsigned bucket = 0;
+
+    if (usec == 0)
+    {
+        return 0;
+    }
+    bucket = 64 - __builtin_clzll(usec);
+    if (bucket >= STATS_NUM_BUCKETS)
+    {
+        bucket = STATS_NUM_BUCKETS - 1;
+    }
+    return bucket;
+}
+
+void stats_init(void)
+{
+    memset(stats_shard, 0, sizeof(stats_shard));
+    stats_next_shard = 0;
+}
+
+void stats_inc(stats_counter_t counter)
+{
+    stats_shard_t *shard = stats_get_shard();
+
+    __atomic_fetch_add(&shard->data.counter[counter], 1, __ATOMIC_RELAXED);
+}
+
+void stats_start(struct timespec *start)
+{
+    clock_gettime(CLOCK_MONOTONIC, start);
+}
+
+void stats_record(stats_hist_t hist, const struct timespec *start)
+{
+    stats_hist_snapshot_t *h = NULL;
+    struct timespec end = {0};
+    uint64_t usec = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    usec = (uint64_t)(end.tv_sec - start->tv_sec) * 1000000
+         + (end.tv_nsec - start->tv_nsec) / 1000;
+    h = &stats_get_shard()->data.hist[hist];
+    __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->sum_usec, usec, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->bucket[stats_bucket(usec)], 1, __ATOMIC_RELAXED);
+}
+
+void stats_aggregate(stats_snapshot_t *snap)
+{
+    stats_snapshot_t *data = NULL;
+    unsigned i = 0;
+    unsigned j = 0;
+    unsigned k = 0;
+
+    memset(snap, 0, sizeof(stats_snapshot_t));
+    for (i = 0; i < STATS_NUM_SHARDS; i++)
+    {
+        data = &stats_shard[i].data;
+        for (j = 0; j < STATS_NUM_COUNTERS; j++)
+        {
+            snap->counter[j] += __atomic_load_n(&data->counter[j], __ATOMIC_RELAXED);
+        }
+        for (j = 0; j < STATS_NUM_HISTS; j++)
+        {
+            snap->hist[j].count += __atomic_load_n(&data->hist[j].count, __ATOMIC_RELAXED);
+            snap->hist[j].sum_usec += __atomic_load_n(&data->hist[j].sum_usec, __ATOMIC_RELAXED);
+            for (k = 0; k < STATS_NUM_BUCKETS; k++)
+            {
+                snap->hist[j].bucket[k] += __atomic_load_n(&data->hist[j].bucket[k], __ATOMIC_RELAXED);
+            }
+        }
+    }
+}
+
+/*  return: upper bound in microseconds of the bucket
+ *          containing the pct percentile, 0 if empty
+ */
+uint64_t stats_percentile(const stats_hist_snapshot_t *hist, unsigned pct)
+{
+    uint64_t target = 0;
+    uint64_t total = 0;
+    unsigned i = 0;
+
+    if (hist->count == 0)
+    {
+        return 0;
+    }
+    target = (hist->count * pct + 99) / 100;
+    for (i = 0; i < STATS_NUM_BUCKETS; i++)
+    {
+        total += hist->bucket[i];
+        if ((total >= target) && (total > 0))
+        {
+            break;
+        }
+    }
+    if (i >= STATS_NUM_BUCKETS)
+    {
+        i = STATS_NUM_BUCKETS - 1;
+    }
+    return i == 0 ? 0 : (uint64_t)1 << i;
+}
+
+void stats_log(void)
+{
+    stats_snapshot_t snap = {{0}};
+    stats_hist_snapshot_t *h = NULL;
+    unsigned i = 0;
+
+    stats_aggregate(&snap);
+    for (i = 0; i < STATS_NUM_COUNTERS; i++)
+    {
+        coap_log_info("%s: %llu", stats_counter_name[i], (unsigned long long)snap.counter[i]);
+    }
+    for (i = 0; i < STATS_NUM_HISTS; i++)
+    {
+        h = &snap.hist[i];
+        coap_log_info("%s: count: %llu, p50: %lluus, p99: %lluus",
+                      stats_hist_name[i],
+                      (unsigned long long)h->count,
+                      (unsigned long long)stats_percentile(h, 50),
+                      (unsigned long long)stats_percentile(h, 99));
+    }
+}
+
+/*  the statistics are written to a temporary file which
+ *  is renamed so that readers never see a partial file
+ *
+ *  return: { 0, success
+ *          {<0, error
+ */
+int stats_dump(const char *file_name)
+{
+    stats_snapshot_t snap = {{0}};
+    stats_hist_snapshot_t *h = NULL;
+    unsigned i = 0;
+    unsigned j = 0;
+    FILE *file = NULL;
+    char tmp_name[STATS_FILE_NAME_LEN] = {0};
+    int ret = 0;
+
+    ret = snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", file_name);
+    if ((ret < 0) || ((size_t)ret >= sizeof(tmp_name)))
+    {
+        return -ENAMETOOLONG;
+    }
+    stats_aggregate(&snap);
+    file = fopen(tmp_name, "w");
+    if (file == NULL)
+    {
+        return -errno;
+    }
+    for (i = 0; i < STATS_NUM_COUNTERS; i++)
+    {
+        fprintf(file, "%s %llu\n", stats_counter_name[i], (unsigned long long)snap.counter[i]);
+    }
+    for (i = 0; i < STATS_NUM_HISTS; i++)
+    {
+        h = &snap.hist[i];
+        fprintf(file, "%s_count %llu\n", stats_hist_name[i], (unsigned long long)h->count);
+        fprintf(file, "%s_sum_usec %llu\n", stats_hist_name[i], (unsigned long long)h->sum_usec);
+        fprintf(file, "%s_p50_usec %llu\n", stats_hist_name[i], (unsigned long long)stats_percentile(h, 50));
+        fprintf(file, "%s_p90_usec %llu\n", stats_hist_name[i], (unsigned long long)stats_percentile(h, 90));
+        fprintf(file, "%s_p99_usec %llu\n", stats_hist_name[i], (unsigned long long)stats_percentile(h, 99));
+        for (j = 0; j < STATS_NUM_BUCKETS; j++)
+        {
+            if (h->bucket[j] != 0)
+            {
+                fprintf(file, "%s_bucket_lt_usec %llu %llu\n", stats_hist_name[i],
+                        (unsigned long long)(j == 0 ? 1 : (uint64_t)1 << j),
+                        (unsigned long long)h->bucket[j]);
+            }
+        }
+    }
+    if (fclose(file) != 0)
+    {
+        ret = -errno;
+        remove(tmp_name);
+        return ret;
+    }
+    if (rename(tmp_name, file_name) != 0)
+    {
+        ret = -errno;
+        remove(tmp_name);
+        return ret;
+    }
+    return 0;
+}
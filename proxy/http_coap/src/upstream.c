@@ -0,0 +1,617 @@
+/*
+ * Copyright (c) 2015 Keith Cullen.
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *  @file upstream.c
+ *
+ *  @brief Source file for the FreeCoAP HTTP/CoAP proxy upstream module
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "upstream.h"
+#include "thread.h"
+#include "lock.h"
+#include "coap_log.h"
+
+#define UPSTREAM_HASH_NUM  64                                                   /* must be a power of 2 */
+#define UPSTREAM_WAIT_NS   10000000                                             /* interval at which deinit checks for connecting threads */
+
+static lock_t upstream_lock;
+static thread_ctx_t upstream_ctx;
+static param_t *upstream_param = NULL;
+static upstream_origin_t *upstream_hash[UPSTREAM_HASH_NUM] = {0};
+static unsigned upstream_num_connecting = 0;
+
+static time_t upstream_now(void)
+{
+    struct timespec ts = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+/* host names are compared without regard to case */
+static unsigned upstream_hash_key(const char *host, const char *port)
+{
+    unsigned hash = 5381;
+
+    while (*host != '\0')
+    {
+        hash = (hash * 33) ^ (unsigned char)tolower((unsigned char)*host++);
+    }
+    while (*port != '\0')
+    {
+        hash = (hash * 33) ^ (unsigned char)*port++;
+    }
+    return hash & (UPSTREAM_HASH_NUM - 1);
+}
+
+/* must be called with the lock held */
+static upstream_origin_t *upstream_origin_find(const char *host, const char *port)
+{
+    upstream_origin_t *origin = NULL;
+
+    origin = upstream_hash[upstream_hash_key(host, port)];
+    while (origin != NULL)
+    {
+        if ((strcasecmp(origin->host, host) == 0)
+         && (strcmp(origin->port, port) == 0))
+        {
+            return origin;
+        }
+        origin = origin->next;
+    }
+    return NULL;
+}
+
+/* must be called with the lock held */
+static upstream_origin_t *upstream_origin_new(const char *host, const char *port)
+{
+    upstream_origin_t *origin = NULL;
+    unsigned key = 0;
+
+    origin = (upstream_origin_t *)calloc(1, sizeof(upstream_origin_t));
+    if (origin == NULL)
+    {
+        return NULL;
+    }
+    origin->host = strdup(host);
+    if (origin->host == NULL)
+    {
+        free(origin);
+        return NULL;
+    }
+    origin->port = strdup(port);
+    if (origin->port == NULL)
+    {
+        free(origin->host);
+        free(origin);
+        return NULL;
+    }
+    key = upstream_hash_key(host, port);
+    origin->next = upstream_hash[key];
+    upstream_hash[key] = origin;
+    return origin;
+}
+
+/* must be called with the lock held, the origin is deleted when it has no clients */
+static void upstream_origin_put(upstream_origin_t *origin)
+{
+    upstream_origin_t **prev = NULL;
+
+    origin->num--;
+    if (origin->num > 0)
+    {
+        return;
+    }
+    prev = &upstream_hash[upstream_hash_key(origin->host, origin->port)];
+    while (*prev != origin)
+    {
+        prev = &(*prev)->next;
+    }
+    *prev = origin->next;
+    free(origin->port);
+    free(origin->host);
+    free(origin);
+}
+
+/* must be called with the lock held */
+static void upstream_idle_unlink(upstream_t *up)
+{
+    upstream_origin_t *origin = up->origin;
+
+    if (up->prev != NULL)
+    {
+        up->prev->next = up->next;
+    }
+    else
+    {
+        origin->idle_first = up->next;
+    }
+    if (up->next != NULL)
+    {
+        up->next->prev = up->prev;
+    }
+    else
+    {
+        origin->idle_last = up->prev;
+    }
+    up->prev = NULL;
+    up->next = NULL;
+}
+
+/* must be called with the lock held */
+static void upstream_idle_push(upstream_t *up)
+{
+    upstream_origin_t *origin = up->origin;
+
+    up->prev = NULL;
+    up->next = origin->idle_first;
+    if (origin->idle_first != NULL)
+    {
+        origin->idle_first->prev = up;
+    }
+    else
+    {
+        origin->idle_last = up;
+    }
+    origin->idle_first = up;
+}
+
+/* must be called with the lock held */
+static void upstream_waiter_push(upstream_origin_t *origin, upstream_waiter_t *waiter)
+{
+    waiter->origin = origin;
+    waiter->next = NULL;
+    if (origin->waiter_last != NULL)
+    {
+        origin->waiter_last->next = waiter;
+    }
+    else
+    {
+        origin->waiter_first = waiter;
+    }
+    origin->waiter_last = waiter;
+}
+
+/* must be called with the lock held */
+static void upstream_waiter_unlink(upstream_waiter_t *waiter)
+{
+    upstream_origin_t *origin = waiter->origin;
+    upstream_waiter_t **prev = NULL;
+    upstream_waiter_t *last = NULL;
+
+    prev = &origin->waiter_first;
+    while (*prev != waiter)
+    {
+        last = *prev;
+        prev = &(*prev)->next;
+    }
+    *prev = waiter->next;
+    if (origin->waiter_last == waiter)
+    {
+        origin->waiter_last = last;
+    }
+    waiter->next = NULL;
+}
+
+/* must be called with the lock held */
+static void upstream_waiter_signal(upstream_waiter_t *waiter, int status, upstream_t *up)
+{
+    uint64_t val = 1;
+    ssize_t num = 0;
+
+    upstream_waiter_unlink(waiter);
+    waiter->status = status;
+    waiter->up = up;
+    waiter->done = 1;
+    num = write(waiter->fd, &val, sizeof(val));
+    (void)num;  /* the counter of a new event file descriptor cannot overflow */
+}
+
+/* must be called with the lock held, status is 1 for a new client and 0 otherwise */
+static void upstream_hand_over(upstream_t *up, int status)
+{
+    upstream_origin_t *origin = up->origin;
+
+    if (origin->waiter_first != NULL)
+    {
+        upstream_waiter_signal(origin->waiter_first, status, up);
+        return;
+    }
+    up->expiry = upstream_now() + param_get_coap_client_idle_timeout(upstream_param);
+    upstream_idle_push(up);
+}
+
+/* must be called with the lock held when a client could not be connected */
+static void upstream_fail(upstream_origin_t *origin, int status)
+{
+    if (origin->waiter_first != NULL)
+    {
+        upstream_waiter_signal(origin->waiter_first, status, NULL);
+    }
+    if (origin->num == 1)
+    {
+        /* no other client will become available */
+        while (origin->waiter_first != NULL)
+        {
+            upstream_waiter_signal(origin->waiter_first, status, NULL);
+        }
+    }
+    upstream_origin_put(origin);
+}
+
+/*  return: { 0, success
+ *          {<0, error
+ */
+static int upstream_create(upstream_t *up, const char *host, const char *port)
+{
+    int ret = 0;
+
+    ret = coap_client_create(&up->client,
+                             host,
+                             port,
+                             param_get_coap_client_key_file_name(upstream_param),
+                             param_get_coap_client_cert_file_name(upstream_param),
+                             param_get_coap_client_trust_file_name(upstream_param),
+                             NULL,
+                             NULL);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    ret = coap_client_async_create(&up->client, 1);
+    if (ret < 0)
+    {
+        coap_client_destroy(&up->client);
+        return ret;
+    }
+    return 0;
+}
+
+/* the DTLS handshake runs on its own thread so that it does not hold up a worker */
+static void *upstream_connect_func(void *data)
+{
+    upstream_origin_t *origin = (upstream_origin_t *)data;
+    upstream_t *up = NULL;
+    int ret = 0;
+
+    thread_block_signals();
+
+    /* the host and port of the origin do not change */
+    up = (upstream_t *)calloc(1, sizeof(upstream_t));
+    if (up == NULL)
+    {
+        ret = -ENOMEM;
+    }
+    else
+    {
+        ret = upstream_create(up, origin->host, origin->port);
+    }
+    if (ret < 0)
+    {
+        coap_log_error("Failed to connect to CoAP server host %s and port %s: %s",
+                       origin->host, origin->port, strerror(-ret));
+        free(up);
+        up = NULL;
+    }
+    lock_get(&upstream_lock);
+    if (up != NULL)
+    {
+        up->origin = origin;
+        upstream_hand_over(up, 1);
+    }
+    else
+    {
+        upstream_fail(origin, ret);
+    }
+    upstream_num_connecting--;
+    lock_put(&upstream_lock);
+    return NULL;
+}
+
+/*  must be called with the lock held after a place
+ *  has been reserved for the new client in the origin
+ *
+ *  return: { 0, success
+ *          {<0, error
+ */
+static int upstream_connect(upstream_origin_t *origin)
+{
+    thread_t thread = {0};
+    int ret = 0;
+
+    ret = thread_init(&thread, &upstream_ctx, upstream_connect_func, origin);
+    if (ret < 0)
+    {
+        return -EAGAIN;
+    }
+    upstream_num_connecting++;
+    return 0;
+}
+
+int upstream_init(param_t *param)
+{
+    int ret = 0;
+
+    ret = lock_create(&upstream_lock);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    ret = thread_detached_ctx_create(&upstream_ctx);
+    if (ret < 0)
+    {
+        lock_destroy(&upstream_lock);
+        return ret;
+    }
+    upstream_param = param;
+    upstream_num_connecting = 0;
+    memset(upstream_hash, 0, sizeof(upstream_hash));
+    return 0;
+}
+
+/* clients still in use belong to their connections */
+void upstream_deinit(void)
+{
+    struct timespec ts = {0};
+    upstream_origin_t *origin = NULL;
+    upstream_t *up = NULL;
+    unsigned i = 0;
+
+    ts.tv_nsec = UPSTREAM_WAIT_NS;
+    lock_get(&upstream_lock);
+    while (upstream_num_connecting > 0)
+    {
+        /* the clients being connected are added to the idle lists */
+        lock_put(&upstream_lock);
+        nanosleep(&ts, NULL);
+        lock_get(&upstream_lock);
+    }
+    for (i = 0; i < UPSTREAM_HASH_NUM; i++)
+    {
+        while (upstream_hash[i] != NULL)
+        {
+            origin = upstream_hash[i];
+            while (origin->idle_first != NULL)
+            {
+                up = origin->idle_first;
+                upstream_idle_unlink(up);
+                coap_client_destroy(&up->client);
+                free(up);
+                if (origin->num == 1)
+                {
+                    upstream_origin_put(origin);
+                    origin = NULL;
+                    break;
+                }
+                origin->num--;
+            }
+            if (origin != NULL)
+            {
+                /* detach the origins of clients that are still in use */
+                upstream_hash[i] = origin->next;
+                origin->next = NULL;
+            }
+        }
+    }
+    lock_put(&upstream_lock);
+    thread_ctx_destroy(&upstream_ctx);
+    lock_destroy(&upstream_lock);
+}
+
+/*  return: { 1, waiting for a client, the file descriptor of the waiter becomes readable
+ *          { 0, idle client reused
+ *          {<0, error
+ */
+int upstream_acquire(upstream_t **up, upstream_waiter_t *waiter, const char *host, const char *port)
+{
+    upstream_origin_t *origin = NULL;
+    int ret = 0;
+
+    lock_get(&upstream_lock);
+    origin = upstream_origin_find(host, port);
+    if ((origin != NULL) && (origin->idle_first != NULL))
+    {
+        *up = origin->idle_first;
+        upstream_idle_unlink(*up);
+        lock_put(&upstream_lock);
+        return 0;
+    }
+    if (origin == NULL)
+    {
+        origin = upstream_origin_new(host, port);
+        if (origin == NULL)
+        {
+            lock_put(&upstream_lock);
+            return -ENOMEM;
+        }
+    }
+    waiter->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (waiter->fd == -1)
+    {
+        ret = -errno;
+        if (origin->num == 0)
+        {
+            /* the origin was created for this client */
+            origin->num++;
+            upstream_origin_put(origin);
+        }
+        lock_put(&upstream_lock);
+        return ret;
+    }
+    waiter->status = 0;
+    waiter->up = NULL;
+    waiter->done = 0;
+    upstream_waiter_push(origin, waiter);
+    if (origin->num < param_get_coap_client_max_per_origin(upstream_param))
+    {
+        /* reserve a place for the new client */
+        origin->num++;
+        ret = upstream_connect(origin);
+        if (ret < 0)
+        {
+            upstream_waiter_unlink(waiter);
+            upstream_origin_put(origin);
+            lock_put(&upstream_lock);
+            close(waiter->fd);
+            waiter->fd = -1;
+            waiter->origin = NULL;
+            return ret;
+        }
+    }
+    lock_put(&upstream_lock);
+    return 1;
+}
+
+/*  called by a waiter after its file descriptor has become readable
+ *
+ *  return: { 1, new client connected
+ *          { 0, client reused
+ *          {<0, error
+ */
+int upstream_get_result(upstream_waiter_t *waiter, upstream_t **up)
+{
+    int ret = 0;
+
+    lock_get(&upstream_lock);
+    ret = waiter->status;
+    *up = waiter->up;
+    waiter->up = NULL;
+    waiter->origin = NULL;
+    lock_put(&upstream_lock);
+    close(waiter->fd);
+    waiter->fd = -1;
+    return ret;
+}
+
+/* called by a waiter when it no longer needs a client */
+void upstream_leave(upstream_waiter_t *waiter)
+{
+    lock_get(&upstream_lock);
+    if (!waiter->done)
+    {
+        upstream_waiter_unlink(waiter);
+    }
+    else if (waiter->up != NULL)
+    {
+        /* the client has been handed over but not taken */
+        upstream_hand_over(waiter->up, 0);
+        waiter->up = NULL;
+    }
+    waiter->origin = NULL;
+    lock_put(&upstream_lock);
+    close(waiter->fd);
+    waiter->fd = -1;
+}
+
+/*  a client that failed an exchange may have lost its DTLS session so it
+ *  is not reused, another one is connected in its place if there are waiters
+ */
+void upstream_release(upstream_t *up, int fail)
+{
+    upstream_origin_t *origin = up->origin;
+    int ret = 0;
+
+    lock_get(&upstream_lock);
+    if (!fail)
+    {
+        upstream_hand_over(up, 0);
+        lock_put(&upstream_lock);
+        return;
+    }
+    if (origin->waiter_first != NULL)
+    {
+        ret = upstream_connect(origin);
+        if (ret < 0)
+        {
+            upstream_fail(origin, ret);
+        }
+    }
+    else
+    {
+        upstream_origin_put(origin);
+    }
+    lock_put(&upstream_lock);
+    coap_client_destroy(&up->client);
+    free(up);
+}
+
+/* close clients that have been idle for longer than the idle timeout */
+void upstream_expire(void)
+{
+    upstream_origin_t *origin = NULL;
+    upstream_origin_t *next = NULL;
+    upstream_t *expired = NULL;
+    upstream_t *up = NULL;
+    time_t now = 0;
+    unsigned i = 0;
+
+    now = upstream_now();
+    lock_get(&upstream_lock);
+    for (i = 0; i < UPSTREAM_HASH_NUM; i++)
+    {
+        origin = upstream_hash[i];
+        while (origin != NULL)
+        {
+            next = origin->next;
+            while ((origin->idle_last != NULL) && (origin->idle_last->expiry <= now))
+            {
+                up = origin->idle_last;
+                upstream_idle_unlink(up);
+                coap_log_info("Closing idle connection to CoAP server host %s and port %s",
+                              origin->host, origin->port);
+                up->next = expired;
+                expired = up;
+                if (origin->num == 1)
+                {
+                    upstream_origin_put(origin);
+                    break;
+                }
+                origin->num--;
+            }
+            origin = next;
+        }
+    }
+    lock_put(&upstream_lock);
+
+    /* the clients are destroyed without holding the lock */
+    while (expired != NULL)
+    {
+        up = expired;
+        expired = up->next;
+        coap_client_destroy(&up->client);
+        free(up);
+    }
+}
@@ -0,0 +1,417 @@
+/*
+ * Copyright (c) 2015 Keith Cullen.
+ * All Rights Reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The name of the author may not be used to endorse or promote products
+ *    derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR "AS IS" AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ *  @file worker.c
+ *
+ *  @brief Source file for the FreeCoAP HTTP/CoAP proxy worker module
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include "worker.h"
+#include "upstream.h"
+#include "coap_log.h"
+
+#define WORKER_MAX_EVENTS   64
+#define WORKER_WAIT_MS      1000                                                /* interval at which timeouts and the go flag are checked */
+
+#define worker_is_idle(wait)  (((wait) == CONNECTION_WAIT_HTTP) || ((wait) == CONNECTION_WAIT_SEND))
+
+extern int go;
+
+static time_t worker_now(void)
+{
+    struct timespec ts = {0};
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+/* connections waiting for their HTTP client are kept in order of expiry */
+static void worker_link_idle(worker_t *worker, connection_t *con)
+{
+    connection_t *prev = worker->idle_last;
+
+    /* usually the connection expires last */
+    while ((prev != NULL) && (prev->expiry > con->expiry))
+    {
+        prev = prev->prev;
+    }
+    con->prev = prev;
+    if (prev == NULL)
+    {
+        con->next = worker->idle_first;
+        worker->idle_first = con;
+    }
+    else
+    {
+        con->next = prev->next;
+        prev->next = con;
+    }
+    if (con->next == NULL)
+    {
+        worker->idle_last = con;
+    }
+    else
+    {
+        con->next->prev = con;
+    }
+}
+
+static void worker_link_busy(worker_t *worker, connection_t *con)
+{
+    con->prev = NULL;
+    con->next = worker->busy_first;
+    if (worker->busy_first != NULL)
+    {
+        worker->busy_first->prev = con;
+    }
+    worker->busy_first = con;
+}
+
+static void worker_unlink(worker_t *worker, connection_t *con)
+{
+    if (con->prev != NULL)
+    {
+        con->prev->next = con->next;
+    }
+    else if (worker_is_idle(con->wait))
+    {
+        worker->idle_first = con->next;
+    }
+    else
+    {
+        worker->busy_first = con->next;
+    }
+    if (con->next != NULL)
+    {
+        con->next->prev = con->prev;
+    }
+    else if (worker_is_idle(con->wait))
+    {
+        worker->idle_last = con->prev;
+    }
+    con->prev = NULL;
+    con->next = NULL;
+}
+
+static void worker_delete_con(worker_t *worker, connection_t *con)
+{
+    connection_delete(con);
+    worker->num_cons--;
+}
+
+/* register the connection for a single event on the file descriptor */
+static int worker_arm(worker_t *worker, connection_t *con, int fd, uint32_t events)
+{
+    struct epoll_event ev = {0};
+    int ret = 0;
+
+    ev.events = events | EPOLLONESHOT;
+    ev.data.ptr = con;
+    ret = epoll_ctl(worker->epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+    if ((ret == -1) && (errno == ENOENT))
+    {
+        /* first wait on this file descriptor */
+        ret = epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    }
+    if (ret == -1)
+    {
+        return -errno;
+    }
+    return 0;
+}
+
+/* wait has been returned by a connection handler function */
+static void worker_wait(worker_t *worker, connection_t *con, int wait)
+{
+    uint32_t events = EPOLLIN;
+    int ret = 0;
+    int fd = 0;
+
+    if (wait == CONNECTION_DONE)
+    {
+        worker_delete_con(worker, con);
+        return;
+    }
+    con->wait = wait;
+    if (wait == CONNECTION_WAIT_HTTP)
+    {
+        fd = connection_get_sd(con);
+        worker_link_idle(worker, con);
+    }
+    else if (wait == CONNECTION_WAIT_SEND)
+    {
+        fd = connection_get_sd(con);
+        events = EPOLLOUT;
+        worker_link_idle(worker, con);
+    }
+    else if (wait == CONNECTION_WAIT_COAP)
+    {
+        fd = connection_get_coap_fd(con);
+        worker_link_busy(worker, con);
+    }
+    else if (wait == CONNECTION_WAIT_FLIGHT)
+    {
+        fd = connection_get_flight_fd(con);
+        worker_link_busy(worker, con);
+    }
+    else
+    {
+        fd = connection_get_upstream_fd(con);
+        worker_link_busy(worker, con);
+    }
+    ret = worker_arm(worker, con, fd, events);
+    if (ret < 0)
+    {
+        coap_log_error("[%u] <%u> %s Unable to wait for events: %s",
+                       con->listener_index, con->con_index, con->addr, strerror(-ret));
+        worker_unlink(worker, con);
+        worker_delete_con(worker, con);
+    }
+}
+
+static void worker_handle(worker_t *worker, connection_t *con)
+{
+    int wait = 0;
+
+    worker_unlink(worker, con);
+    if (con->wait == CONNECTION_WAIT_HTTP)
+    {
+        wait = connection_handle_http(con);
+    }
+    else if (con->wait == CONNECTION_WAIT_SEND)
+    {
+        wait = connection_handle_send(con);
+    }
+    else if (con->wait == CONNECTION_WAIT_COAP)
+    {
+        wait = connection_handle_coap(con);
+    }
+    else if (con->wait == CONNECTION_WAIT_FLIGHT)
+    {
+        wait = connection_handle_flight(con);
+    }
+    else
+    {
+        wait = connection_handle_upstream(con);
+    }
+    worker_wait(worker, con, wait);
+}
+
+/*  return: { 1, stop requested
+ *          { 0, success
+ */
+static int worker_adopt(worker_t *worker)
+{
+    connection_t *con = NULL;
+    ssize_t num = 0;
+
+    while (1)
+    {
+        num = read(worker->pipe_fd[0], &con, sizeof(con));
+        if (num != sizeof(con))
+        {
+            return 0;
+        }
+        if (con == NULL)
+        {
+            return 1;
+        }
+        worker->num_cons++;
+        worker_wait(worker, con, connection_start(con));
+    }
+}
+
+static void worker_expire(worker_t *worker)
+{
+    connection_t *con = NULL;
+    time_t now = 0;
+
+    now = worker_now();
+    while ((worker->idle_first != NULL) && (worker->idle_first->expiry <= now))
+    {
+        con = worker->idle_first;
+        worker_unlink(worker, con);
+        connection_expire(con);
+        worker_delete_con(worker, con);
+    }
+    upstream_expire();
+}
+
+static void worker_delete_all(worker_t *worker)
+{
+    connection_t *con = NULL;
+
+    while (worker->idle_first != NULL)
+    {
+        con = worker->idle_first;
+        worker_unlink(worker, con);
+        worker_delete_con(worker, con);
+    }
+    while (worker->busy_first != NULL)
+    {
+        con = worker->busy_first;
+        worker_unlink(worker, con);
+        worker_delete_con(worker, con);
+    }
+}
+
+static void *worker_thread_func(void *data)
+{
+    struct epoll_event events[WORKER_MAX_EVENTS] = {{0}};
+    worker_t *worker = (worker_t *)data;
+    int stop = 0;
+    int num = 0;
+    int i = 0;
+
+    thread_block_signals();
+
+    coap_log_info("[%u] Worker started", worker->index);
+    while ((go) && (!stop))
+    {
+        num = epoll_wait(worker->epoll_fd, events, WORKER_MAX_EVENTS, WORKER_WAIT_MS);
+        if (num == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            coap_log_error("[%u] Worker failed to wait for events: %s", worker->index, strerror(errno));
+            break;
+        }
+        for (i = 0; i < num; i++)
+        {
+            if (events[i].data.ptr == NULL)
+            {
+                stop = worker_adopt(worker);
+            }
+            else
+            {
+                worker_handle(worker, (connection_t *)events[i].data.ptr);
+            }
+        }
+        worker_expire(worker);
+    }
+    worker_delete_all(worker);
+    coap_log_info("[%u] Worker stopped", worker->index);
+    return NULL;
+}
+
+int worker_create(worker_t *worker, unsigned index)
+{
+    struct epoll_event ev = {0};
+    int flags = 0;
+    int ret = 0;
+
+    memset(worker, 0, sizeof(worker_t));
+    worker->index = index;
+    ret = pipe(worker->pipe_fd);
+    if (ret == -1)
+    {
+        return -errno;
+    }
+    flags = fcntl(worker->pipe_fd[0], F_GETFL, 0);
+    if ((flags == -1)
+     || (fcntl(worker->pipe_fd[0], F_SETFL, flags | O_NONBLOCK) == -1))
+    {
+        ret = -errno;
+        close(worker->pipe_fd[1]);
+        close(worker->pipe_fd[0]);
+        return ret;
+    }
+    worker->epoll_fd = epoll_create1(0);
+    if (worker->epoll_fd == -1)
+    {
+        ret = -errno;
+        close(worker->pipe_fd[1]);
+        close(worker->pipe_fd[0]);
+        return ret;
+    }
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    ret = epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->pipe_fd[0], &ev);
+    if (ret == -1)
+    {
+        ret = -errno;
+        close(worker->epoll_fd);
+        close(worker->pipe_fd[1]);
+        close(worker->pipe_fd[0]);
+        return ret;
+    }
+    return 0;
+}
+
+void worker_destroy(worker_t *worker)
+{
+    connection_t *con = NULL;
+    void *result = NULL;
+
+    if (worker->running)
+    {
+        /* a null pointer asks the worker thread to stop */
+        if (write(worker->pipe_fd[1], &con, sizeof(con)) == sizeof(con))
+        {
+            thread_join(&worker->thread, &result);
+        }
+        worker->running = 0;
+    }
+    close(worker->epoll_fd);
+    close(worker->pipe_fd[1]);
+    close(worker->pipe_fd[0]);
+}
+
+int worker_run(worker_t *worker, thread_ctx_t *ctx)
+{
+    int ret = 0;
+
+    ret = thread_init(&worker->thread, ctx, worker_thread_func, worker);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    worker->running = 1;
+    return 0;
+}
+
+/* called by the listener thread, the worker thread takes ownership of the connection */
+int worker_add(worker_t *worker, connection_t *con)
+{
+    ssize_t num = 0;
+
+    num = write(worker->pipe_fd[1], &con, sizeof(con));
+    if (num != sizeof(con))
+    {
+        return -EIO;
+    }
+    return 0;
+}
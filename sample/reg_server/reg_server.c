@@ -36,7 +36,6 @@
 #include "coap_mem.h"
 #include "coap_log.h"
 
-#define REG_SERVER_URI_PATH_BUF_LEN  32
 #define REG_SERVER_PAYLOAD_LEN       32
 #define REG_SERVER_SMALL_BUF_NUM     128                                        /**< Number of buffers in the small memory allocator */
 #define REG_SERVER_SMALL_BUF_LEN     256                                        /**< Length of each buffer in the small memory allocator */
@@ -147,31 +146,6 @@ static int reg_server_handle_client_id(coap_server_trans_t *trans, coap_msg_t *r
     return coap_msg_set_code(resp, COAP_MSG_SERVER_ERR, COAP_MSG_NOT_IMPL);
 }
 
-static int reg_server_handle(coap_server_trans_t *trans, coap_msg_t *req, coap_msg_t *resp)
-{
-    size_t n = 0;
-    char uri_path[REG_SERVER_URI_PATH_BUF_LEN] = {0};
-
-    if (coap_msg_get_ver(req) != COAP_MSG_VER)
-    {
-        coap_log_warn("Received request message with invalid version: %d", coap_msg_get_ver(req));
-        return -EBADMSG;
-    }
-    n = coap_msg_uri_path_to_str(req, uri_path, sizeof(uri_path));
-    if ((n + 1) > sizeof(uri_path))
-    {
-        coap_log_warn("URI path buffer too small by %zd bytes", (n + 1) - sizeof(uri_path));
-        return -ENOSPC;
-    }
-    coap_log_info("Received request URI path: '%s'", uri_path);
-    if (strcmp(uri_path, "/client/id") != 0)
-    {
-        coap_log_warn("URI path not recognised");
-        return coap_msg_set_code(resp, COAP_MSG_CLIENT_ERR, COAP_MSG_NOT_FOUND);
-    }
-    return reg_server_handle_client_id(trans, req, resp);
-}
-
 /* one-time initialisation */
 int reg_server_init(void)
 {
@@ -220,18 +194,20 @@ int reg_server_create(reg_server_t *server,
     memset(server, 0, sizeof(reg_server_t));
 #ifdef COAP_DTLS_EN
     ret = coap_server_create(&server->coap_server,
-                             reg_server_handle,
+                             NULL,
                              host,
                              port,
+                             COAP_SERVER_NUM_TRANS,
                              key_file_name,
                              cert_file_name,
                              trust_file_name,
                              crl_file_name);
 #else
     ret = coap_server_create(&server->coap_server,
-                             reg_server_handle,
+                             NULL,
                              host,
-                             port);
+                             port,
+                             COAP_SERVER_NUM_TRANS);
 #endif
     if (ret < 0)
     {
@@ -243,6 +219,14 @@ int reg_server_create(reg_server_t *server,
         memset(server, 0, sizeof(reg_server_t));
         return ret;
     }
+    ret = coap_server_add_resource(&server->coap_server, "/client/id", COAP_MSG_POST, reg_server_handle_client_id);
+    if (ret < 0)
+    {
+        coap_log_error("%s", strerror(-ret));
+        coap_server_destroy(&server->coap_server);
+        memset(server, 0, sizeof(reg_server_t));
+        return ret;
+    }
     registrar_create(&server->registrar);
     return ret;
 }
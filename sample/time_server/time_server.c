@@ -36,7 +36,6 @@
 #include "coap_mem.h"
 #include "coap_log.h"
 
-#define TIME_SERVER_URI_PATH_BUF_LEN  32
 #define TIME_SERVER_PAYLOAD_BUF_LEN   32                                        /**< Buffer of at least 36 bytes for ctime_r to write to */
 #define TIME_SERVER_SMALL_BUF_NUM     128                                       /**< Number of buffers in the small memory allocator */
 #define TIME_SERVER_SMALL_BUF_LEN     256                                       /**< Length of each buffer in the small memory allocator */
@@ -91,31 +90,6 @@ static int time_server_handle_time(coap_server_trans_t *trans, coap_msg_t *req,
     return coap_msg_set_code(resp, COAP_MSG_SERVER_ERR, COAP_MSG_NOT_IMPL);
 }
 
-static int time_server_handle(coap_server_trans_t *trans, coap_msg_t *req, coap_msg_t *resp)
-{
-    size_t n = 0;
-    char uri_path_buf[TIME_SERVER_URI_PATH_BUF_LEN] = {0};
-
-    if (coap_msg_get_ver(req) != COAP_MSG_VER)
-    {
-        coap_log_warn("Received request message with invalid version: %d", coap_msg_get_ver(req));
-        return -EBADMSG;
-    }
-    n = coap_msg_uri_path_to_str(req, uri_path_buf, sizeof(uri_path_buf));
-    if ((n + 1) > sizeof(uri_path_buf))
-    {
-        coap_log_warn("URI path buffer too small by %zd bytes", (n + 1) - sizeof(uri_path_buf));
-        return -ENOSPC;
-    }
-    coap_log_info("Received request URI path: '%s'", uri_path_buf);
-    if (strcmp(uri_path_buf, "/time") != 0)
-    {
-        coap_log_warn("URI path not recognised");
-        return coap_msg_set_code(resp, COAP_MSG_CLIENT_ERR, COAP_MSG_NOT_FOUND);
-    }
-    return time_server_handle_time(trans, req, resp);
-}
-
 /* one-time initialisation */
 int time_server_init(void)
 {
@@ -164,18 +138,20 @@ int time_server_create(time_server_t *server,
     memset(server, 0, sizeof(time_server_t));
 #ifdef COAP_DTLS_EN
     ret = coap_server_create(&server->coap_server,
-                             time_server_handle,
+                             NULL,
                              host,
                              port,
+                             COAP_SERVER_NUM_TRANS,
                              key_file_name,
                              cert_file_name,
                              trust_file_name,
                              crl_file_name);
 #else
     ret = coap_server_create(&server->coap_server,
-                             time_server_handle,
+                             NULL,
                              host,
-                             port);
+                             port,
+                             COAP_SERVER_NUM_TRANS);
 #endif
     if (ret < 0)
     {
@@ -187,6 +163,14 @@ int time_server_create(time_server_t *server,
         memset(server, 0, sizeof(time_server_t));
         return ret;
     }
+    ret = coap_server_add_resource(&server->coap_server, "/time", COAP_MSG_GET, time_server_handle_time);
+    if (ret < 0)
+    {
+        coap_log_error("%s", strerror(-ret));
+        coap_server_destroy(&server->coap_server);
+        memset(server, 0, sizeof(time_server_t));
+        return ret;
+    }
     return ret;
 }
 
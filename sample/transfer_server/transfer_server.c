@@ -38,7 +38,6 @@
 #include "coap_mem.h"
 #include "coap_log.h"
 
-#define TRANSFER_SERVER_URI_PATH_BUF_LEN  32
 #define TRANSFER_SERVER_SMALL_BUF_NUM     128                                   /**< Number of buffers in the small memory allocator */
 #define TRANSFER_SERVER_SMALL_BUF_LEN     256                                   /**< Length of each buffer in the small memory allocator */
 #define TRANSFER_SERVER_MEDIUM_BUF_NUM    128                                   /**< Number of buffers in the medium memory allocator */
@@ -76,37 +75,8 @@ static int transfer_server_handle_rx(coap_server_trans_t *trans, coap_msg_t *req
     return coap_msg_set_code(resp, COAP_MSG_SUCCESS, COAP_MSG_CHANGED);
 }
 
-static int transfer_server_handle(coap_server_trans_t *trans, coap_msg_t *req, coap_msg_t *resp)
+static int transfer_server_handle_transfer(coap_server_trans_t *trans, coap_msg_t *req, coap_msg_t *resp)
 {
-    unsigned code_detail = 0;
-    unsigned code_class = 0;
-    size_t n = 0;
-    char uri_path[TRANSFER_SERVER_URI_PATH_BUF_LEN] = {0};
-
-    if (coap_msg_get_ver(req) != COAP_MSG_VER)
-    {
-        coap_log_warn("Received request message with invalid version: %d", coap_msg_get_ver(req));
-        return -EBADMSG;
-    }
-    code_class = coap_msg_get_code_class(req);
-    code_detail = coap_msg_get_code_detail(req);
-    if ((code_class != COAP_MSG_REQ) || (code_detail != COAP_MSG_PUT))
-    {
-        coap_log_warn("Request method not implemented");
-        return coap_msg_set_code(resp, COAP_MSG_SERVER_ERR, COAP_MSG_NOT_IMPL);
-    }
-    n = coap_msg_uri_path_to_str(req, uri_path, sizeof(uri_path));
-    if ((n + 1) > sizeof(uri_path))
-    {
-        coap_log_warn("URI path buffer too small by %zd bytes", (n + 1) - sizeof(uri_path));
-        return -ENOSPC;
-    }
-    coap_log_info("Received request URI path: '%s'", uri_path);
-    if (strcmp(uri_path, "/client/transfer") != 0)
-    {
-        coap_log_warn("URI path not recognised");
-        return coap_msg_set_code(resp, COAP_MSG_CLIENT_ERR, COAP_MSG_NOT_FOUND);
-    }
     return coap_server_trans_handle_blockwise(trans, req, resp,
                                               TRANSFER_SERVER_BLOCK1_SIZE,
                                               TRANSFER_SERVER_BLOCK2_SIZE,
@@ -162,18 +132,20 @@ int transfer_server_create(transfer_server_t *server,
     memset(server, 0, sizeof(transfer_server_t));
 #ifdef COAP_DTLS_EN
     ret = coap_server_create(&server->coap_server,
-                             transfer_server_handle,
+                             NULL,
                              host,
                              port,
+                             COAP_SERVER_NUM_TRANS,
                              key_file_name,
                              cert_file_name,
                              trust_file_name,
                              crl_file_name);
 #else
     ret = coap_server_create(&server->coap_server,
-                             transfer_server_handle,
+                             NULL,
                              host,
-                             port);
+                             port,
+                             COAP_SERVER_NUM_TRANS);
 #endif
     if (ret < 0)
     {
@@ -185,6 +157,14 @@ int transfer_server_create(transfer_server_t *server,
         memset(server, 0, sizeof(transfer_server_t));
         return ret;
     }
+    ret = coap_server_add_resource(&server->coap_server, "/client/transfer", COAP_MSG_PUT, transfer_server_handle_transfer);
+    if (ret < 0)
+    {
+        coap_log_error("%s", strerror(-ret));
+        coap_server_destroy(&server->coap_server);
+        memset(server, 0, sizeof(transfer_server_t));
+        return ret;
+    }
     return ret;
 }
 
@@ -36,6 +36,8 @@
 #include <string.h>
 #include <errno.h>
 #include <getopt.h>
+#include <poll.h>
+#include <sys/socket.h>
 #ifdef COAP_DTLS_EN
 #include <gnutls/gnutls.h>
 #endif
@@ -70,7 +72,22 @@
 #define APP_LEVEL_BLOCKWISE_URI_PATH_LEN    19                                  /**< Length of the URI path that causes the server to use application-level blockwise transfers */
 #define LIB_LEVEL_BLOCKWISE_URI_PATH        "lib-level-blockwise"               /**< URI path that causes the server to use library-level blockwise transfers */
 #define LIB_LEVEL_BLOCKWISE_URI_PATH_LEN    19                                  /**< Length of the URI path that causes the server to use library-level blockwise transfers */
+#define STREAM_BLOCKWISE_URI_PATH           "stream-blockwise"                  /**< URI path that causes the server to use streaming library-level blockwise transfers */
+#define STREAM_BLOCKWISE_URI_PATH_LEN       16                                  /**< Length of the URI path that causes the server to use streaming library-level blockwise transfers */
+#define STREAM_BLOCKWISE_BODY_LEN           10000                               /**< Length of the body used in streaming library-level blockwise transfers (larger than a large buffer) */
+#define OBSERVE_URI_PATH                    "observe"                           /**< URI path of a resource that can be observed */
+#define OBSERVE_URI_PATH_LEN                7                                   /**< Length of the URI path of a resource that can be observed */
+#define CACHE_URI_PATH                      "cache"                             /**< URI path of a resource whose responses are cached */
+#define CACHE_URI_PATH_LEN                  5                                   /**< Length of the URI path of a resource whose responses are cached */
+#define UNKNOWN_URI_PATH                    "unknown"                           /**< URI path that is not registered with the server */
+#define UNKNOWN_URI_PATH_LEN                7                                   /**< Length of the URI path that is not registered with the server */
+#define STATS_URI_PATH1                     ".well-known"                       /**< First URI path option value of the server statistics resource */
+#define STATS_URI_PATH1_LEN                 11                                  /**< Length of the first URI path option value of the server statistics resource */
+#define STATS_URI_PATH2                     "stats"                             /**< Second URI path option value of the server statistics resource */
+#define STATS_URI_PATH2_LEN                 5                                   /**< Length of the second URI path option value of the server statistics resource */
+#define OBSERVE_WAIT_MS                     500                                 /**< Time to wait for unexpected notifications in milliseconds */
 #define BLOCK_SIZE                          16                                  /**< Size of an individual block in a blockwise transfer */
+#define TEST_ASYNC_MAX_NUM_MSG              8                                   /**< Maximum number of requests in an asynchronous exchange test */
 #define SMALL_BUF_NUM                       128                                 /**< Number of buffers in the small memory allocator */
 #define SMALL_BUF_LEN                       256                                 /**< Length of each buffer in the small memory allocator */
 #define MEDIUM_BUF_NUM                      128                                 /**< Number of buffers in the medium memory allocator */
@@ -125,6 +142,7 @@ typedef struct
     size_t num_msg;                                                             /**< Length of the arrays of test message structures */
     const char *body;                                                           /**< Buffers to store the body */
     size_t body_len;                                                            /**< Length of the buffer to store the body */
+    unsigned block_window;                                                      /**< Number of block2 requests kept in flight by blockwise GET transfers */
 }
 test_coap_client_data_t;
 
@@ -2103,478 +2121,3149 @@ test_coap_client_data_t test20_data =
     .body_len = 0
 };
 
+#define TEST21_NUM_MSG      6
+#define TEST21_REQ_OP1_LEN  REGULAR_URI_PATH_LEN
+#define TEST21_NUM_OPS      1
+
+char test21_req_op1_val[TEST21_REQ_OP1_LEN + 1] = REGULAR_URI_PATH;
+
+test_coap_client_msg_op_t test21_req_ops[TEST21_NUM_OPS] =
+{
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST21_REQ_OP1_LEN,
+        .val = test21_req_op1_val
+    }
+};
+
+test_coap_client_msg_t test21_req[TEST21_NUM_MSG] =
+{
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_GET,
+        .ops = test21_req_ops,
+        .num_ops = TEST21_NUM_OPS,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_NON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_GET,
+        .ops = test21_req_ops,
+        .num_ops = TEST21_NUM_OPS,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_GET,
+        .ops = test21_req_ops,
+        .num_ops = TEST21_NUM_OPS,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_NON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_GET,
+        .ops = test21_req_ops,
+        .num_ops = TEST21_NUM_OPS,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_GET,
+        .ops = test21_req_ops,
+        .num_ops = TEST21_NUM_OPS,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_NON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_GET,
+        .ops = test21_req_ops,
+        .num_ops = TEST21_NUM_OPS,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    }
+};
+
+test_coap_client_msg_t test21_resp[TEST21_NUM_MSG] =
+{
+    {
+        .type = COAP_MSG_ACK,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CONTENT,
+        .ops = NULL,
+        .num_ops = 0,
+        .payload = "qwertyuiopasdfgh",
+        .payload_len = 16,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_NON,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CONTENT,
+        .ops = NULL,
+        .num_ops = 0,
+        .payload = "qwertyuiopasdfgh",
+        .payload_len = 16,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_ACK,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CONTENT,
+        .ops = NULL,
+        .num_ops = 0,
+        .payload = "qwertyuiopasdfgh",
+        .payload_len = 16,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_NON,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CONTENT,
+        .ops = NULL,
+        .num_ops = 0,
+        .payload = "qwertyuiopasdfgh",
+        .payload_len = 16,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_ACK,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CONTENT,
+        .ops = NULL,
+        .num_ops = 0,
+        .payload = "qwertyuiopasdfgh",
+        .payload_len = 16,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_NON,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CONTENT,
+        .ops = NULL,
+        .num_ops = 0,
+        .payload = "qwertyuiopasdfgh",
+        .payload_len = 16,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    }
+};
+
+test_coap_client_data_t test21_data =
+{
+    .desc = "test 21: send three confirmable and three non-confirmable GET requests asynchronously and expect all of the responses",
+    .host = HOST,
+    .port = PORT,
+    .key_file_name = KEY_FILE_NAME,
+    .cert_file_name = CERT_FILE_NAME,
+    .trust_file_name = TRUST_FILE_NAME,
+    .crl_file_name = CRL_FILE_NAME,
+    .common_name = COMMON_NAME,
+    .test_req = test21_req,
+    .test_resp = test21_resp,
+    .num_msg = TEST21_NUM_MSG,
+    .body = NULL,
+    .body_len = 0
+};
+
+#define TEST22_NUM_MSG      1
+#define TEST22_REQ_OP1_LEN  SEP_URI_PATH1_LEN
+#define TEST22_REQ_OP2_LEN  SEP_URI_PATH2_LEN
+#define TEST22_REQ_OP3_LEN  SEP_URI_PATH3_LEN
+#define TEST22_NUM_OPS      3
+
+char test22_req_op1_val[TEST22_REQ_OP1_LEN + 1] = SEP_URI_PATH1;
+char test22_req_op2_val[TEST22_REQ_OP2_LEN + 1] = SEP_URI_PATH2;
+char test22_req_op3_val[TEST22_REQ_OP3_LEN + 1] = SEP_URI_PATH3;
+
+test_coap_client_msg_op_t test22_req_ops[TEST22_NUM_OPS] =
+{
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST22_REQ_OP1_LEN,
+        .val = test22_req_op1_val
+    },
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST22_REQ_OP2_LEN,
+        .val = test22_req_op2_val
+    },
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST22_REQ_OP3_LEN,
+        .val = test22_req_op3_val
+    }
+};
+
+test_coap_client_msg_t test22_req[TEST22_NUM_MSG] =
+{
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_GET,
+        .ops = test22_req_ops,
+        .num_ops = TEST22_NUM_OPS,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    }
+};
+
+test_coap_client_msg_t test22_resp[TEST22_NUM_MSG] =
+{
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CONTENT,
+        .ops = NULL,
+        .num_ops = 0,
+        .payload = "qwertyuiopasdfgh",
+        .payload_len = 16,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    }
+};
+
+test_coap_client_data_t test22_data =
+{
+    .desc = "test 22: send a confirmable GET request asynchronously and expect a separate response",
+    .host = HOST,
+    .port = PORT,
+    .key_file_name = KEY_FILE_NAME,
+    .cert_file_name = CERT_FILE_NAME,
+    .trust_file_name = TRUST_FILE_NAME,
+    .crl_file_name = CRL_FILE_NAME,
+    .common_name = COMMON_NAME,
+    .test_req = test22_req,
+    .test_resp = test22_resp,
+    .num_msg = TEST22_NUM_MSG,
+    .body = NULL,
+    .body_len = 0
+};
+
+/**
+ *  @brief Body used in streaming library-level blockwise transfers
+ *
+ *  The byte at offset i is 'a' + (i % 26). The buffer
+ *  is filled in by test_stream_body_init.
+ */
+static char test_stream_body[STREAM_BLOCKWISE_BODY_LEN] = {0};
+
+#define TEST23_NUM_MSG       1
+#define TEST23_REQ_OP1_LEN   STREAM_BLOCKWISE_URI_PATH_LEN
+#define TEST23_NUM_REQ_OPS   1
+#define TEST23_RESP_OP1_LEN  3
+#define TEST23_NUM_RESP_OPS  1
+#define TEST23_BODY_LEN      STREAM_BLOCKWISE_BODY_LEN
+
+char test23_req_op1_val[TEST23_REQ_OP1_LEN + 1] = STREAM_BLOCKWISE_URI_PATH;
+char test23_resp_op1_val[TEST23_RESP_OP1_LEN] =  {0x00, 0x00, 0x96};  /* num: 9, more: 0, size: 1024 */
+
+test_coap_client_msg_op_t test23_req_ops[TEST23_NUM_REQ_OPS] =
+{
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST23_REQ_OP1_LEN,
+        .val = test23_req_op1_val
+    }
+};
+
+test_coap_client_msg_op_t test23_resp_ops[TEST23_NUM_RESP_OPS] =
+{
+    {
+        .num = COAP_MSG_BLOCK2,
+        .len = TEST23_RESP_OP1_LEN,
+        .val = test23_resp_op1_val
+    }
+};
+
+test_coap_client_msg_t test23_req[TEST23_NUM_MSG] =
+{
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_GET,
+        .ops = test23_req_ops,
+        .num_ops = TEST23_NUM_REQ_OPS,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 1024,
+        .block2_size = 1024,
+        .body_end = 0
+    }
+};
+
+test_coap_client_msg_t test23_resp[TEST23_NUM_MSG] =
+{
+    {
+        .type = COAP_MSG_ACK,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CONTENT,
+        .ops = test23_resp_ops,
+        .num_ops = TEST23_NUM_RESP_OPS,
+        .payload = test_stream_body + 9 * 1024,  /* partial last block */
+        .payload_len = TEST23_BODY_LEN - 9 * 1024,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = TEST23_BODY_LEN
+    }
+};
+
+test_coap_client_data_t test23_data =
+{
+    .desc = "test 23: perform a GET streaming library-level blockwise transfer with a body larger than a large buffer",
+    .host = HOST,
+    .port = PORT,
+    .key_file_name = KEY_FILE_NAME,
+    .cert_file_name = CERT_FILE_NAME,
+    .trust_file_name = TRUST_FILE_NAME,
+    .crl_file_name = CRL_FILE_NAME,
+    .common_name = COMMON_NAME,
+    .test_req = test23_req,
+    .test_resp = test23_resp,
+    .num_msg = TEST23_NUM_MSG,
+    .body = test_stream_body,
+    .body_len = TEST23_BODY_LEN
+};
+
+#define TEST24_NUM_MSG       1
+#define TEST24_REQ_OP1_LEN   STREAM_BLOCKWISE_URI_PATH_LEN
+#define TEST24_NUM_REQ_OPS   1
+#define TEST24_RESP_OP1_LEN  3
+#define TEST24_NUM_RESP_OPS  1
+#define TEST24_BODY_LEN      STREAM_BLOCKWISE_BODY_LEN
+
+char test24_req_op1_val[TEST24_REQ_OP1_LEN + 1] = STREAM_BLOCKWISE_URI_PATH;
+char test24_resp_op1_val[TEST24_RESP_OP1_LEN] =  {0x00, 0x00, 0x96};  /* num: 9, more: 0, size: 1024 */
+
+test_coap_client_msg_op_t test24_req_ops[TEST24_NUM_REQ_OPS] =
+{
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST24_REQ_OP1_LEN,
+        .val = test24_req_op1_val
+    }
+};
+
+test_coap_client_msg_op_t test24_resp_ops[TEST24_NUM_RESP_OPS] =
+{
+    {
+        .num = COAP_MSG_BLOCK1,
+        .len = TEST24_RESP_OP1_LEN,
+        .val = test24_resp_op1_val
+    }
+};
+
+test_coap_client_msg_t test24_req[TEST24_NUM_MSG] =
+{
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_PUT,
+        .ops = test24_req_ops,
+        .num_ops = TEST24_NUM_REQ_OPS,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 1024,
+        .block2_size = 1024,
+        .body_end = 0
+    }
+};
+
+test_coap_client_msg_t test24_resp[TEST24_NUM_MSG] =
+{
+    {
+        .type = COAP_MSG_ACK,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CHANGED,
+        .ops = test24_resp_ops,
+        .num_ops = TEST24_NUM_RESP_OPS,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    }
+};
+
+test_coap_client_data_t test24_data =
+{
+    .desc = "test 24: perform a PUT streaming library-level blockwise transfer with a body larger than a large buffer",
+    .host = HOST,
+    .port = PORT,
+    .key_file_name = KEY_FILE_NAME,
+    .cert_file_name = CERT_FILE_NAME,
+    .trust_file_name = TRUST_FILE_NAME,
+    .crl_file_name = CRL_FILE_NAME,
+    .common_name = COMMON_NAME,
+    .test_req = test24_req,
+    .test_resp = test24_resp,
+    .num_msg = TEST24_NUM_MSG,
+    .body = test_stream_body,
+    .body_len = TEST24_BODY_LEN
+};
+
+test_coap_client_data_t test25_data =
+{
+    .desc = "test 25: perform a windowed GET streaming library-level blockwise transfer with a body larger than a large buffer",
+    .host = HOST,
+    .port = PORT,
+    .key_file_name = KEY_FILE_NAME,
+    .cert_file_name = CERT_FILE_NAME,
+    .trust_file_name = TRUST_FILE_NAME,
+    .crl_file_name = CRL_FILE_NAME,
+    .common_name = COMMON_NAME,
+    .test_req = test23_req,
+    .test_resp = test23_resp,
+    .num_msg = TEST23_NUM_MSG,
+    .body = test_stream_body,
+    .body_len = TEST23_BODY_LEN,
+    .block_window = 4
+};
+
+test_coap_client_data_t test26_data =
+{
+    .desc = "test 26: perform a windowed GET library-level blockwise transfer with more requests allowed in flight than there are blocks",
+    .host = HOST,
+    .port = PORT,
+    .key_file_name = KEY_FILE_NAME,
+    .cert_file_name = CERT_FILE_NAME,
+    .trust_file_name = TRUST_FILE_NAME,
+    .crl_file_name = CRL_FILE_NAME,
+    .common_name = COMMON_NAME,
+    .test_req = test11_req,
+    .test_resp = test11_resp,
+    .num_msg = TEST11_NUM_MSG,
+    .body = "0123456789abcdefghijABCDEFGHIJasdfghjklpqlfktnghrexi49s1zlkdfiecvntfbghq",
+    .body_len = TEST11_BODY_LEN,
+    .block_window = 8
+};
+
+test_coap_client_data_t test27_data =
+{
+    .desc = "test 27: perform a GET streaming library-level blockwise transfer into a client sink without a body buffer",
+    .host = HOST,
+    .port = PORT,
+    .key_file_name = KEY_FILE_NAME,
+    .cert_file_name = CERT_FILE_NAME,
+    .trust_file_name = TRUST_FILE_NAME,
+    .crl_file_name = CRL_FILE_NAME,
+    .common_name = COMMON_NAME,
+    .test_req = test23_req,
+    .test_resp = test23_resp,
+    .num_msg = TEST23_NUM_MSG,
+    .body = test_stream_body,
+    .body_len = TEST23_BODY_LEN
+};
+
+test_coap_client_data_t test28_data =
+{
+    .desc = "test 28: perform a PUT streaming library-level blockwise transfer from a client source without a body buffer",
+    .host = HOST,
+    .port = PORT,
+    .key_file_name = KEY_FILE_NAME,
+    .cert_file_name = CERT_FILE_NAME,
+    .trust_file_name = TRUST_FILE_NAME,
+    .crl_file_name = CRL_FILE_NAME,
+    .common_name = COMMON_NAME,
+    .test_req = test24_req,
+    .test_resp = test24_resp,
+    .num_msg = TEST24_NUM_MSG,
+    .body = test_stream_body,
+    .body_len = TEST24_BODY_LEN
+};
+
+#define TEST29_NUM_MSG      3
+#define TEST29_REQ_OP1_LEN  OBSERVE_URI_PATH_LEN
+#define TEST29_NUM_OPS      1
+
+char test29_req_op1_val[TEST29_REQ_OP1_LEN + 1] = OBSERVE_URI_PATH;
+
+test_coap_client_msg_op_t test29_req_ops[TEST29_NUM_OPS] =
+{
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST29_REQ_OP1_LEN,
+        .val = test29_req_op1_val
+    }
+};
+
+test_coap_client_msg_t test29_req[TEST29_NUM_MSG] =
+{
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_GET,
+        .ops = test29_req_ops,
+        .num_ops = TEST29_NUM_OPS,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_PUT,
+        .ops = test29_req_ops,
+        .num_ops = TEST29_NUM_OPS,
+        .payload = "0123456789qwerty",
+        .payload_len = 16,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_PUT,
+        .ops = test29_req_ops,
+        .num_ops = TEST29_NUM_OPS,
+        .payload = "asdfghjkl9876543",
+        .payload_len = 16,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    }
+};
+
+test_coap_client_msg_t test29_resp[TEST29_NUM_MSG + 1] =
+{
+    {
+        .type = COAP_MSG_ACK,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CONTENT,
+        .ops = NULL,
+        .num_ops = 0,
+        .payload = "zxcvbnmlkjhgfdsa",
+        .payload_len = 16,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_ACK,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CHANGED,
+        .ops = NULL,
+        .num_ops = 0,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_ACK,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CHANGED,
+        .ops = NULL,
+        .num_ops = 0,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_NON,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CONTENT,
+        .ops = NULL,
+        .num_ops = 0,
+        .payload = "0123456789qwerty",
+        .payload_len = 16,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    }
+};
+
+test_coap_client_data_t test29_data =
+{
+    .desc = "test 29: observe a resource, change it and expect one notification, then cancel the observation, change it again and expect no notification",
+    .host = HOST,
+    .port = PORT,
+    .key_file_name = KEY_FILE_NAME,
+    .cert_file_name = CERT_FILE_NAME,
+    .trust_file_name = TRUST_FILE_NAME,
+    .crl_file_name = CRL_FILE_NAME,
+    .common_name = COMMON_NAME,
+    .test_req = test29_req,
+    .test_resp = test29_resp,
+    .num_msg = TEST29_NUM_MSG,
+    .body = NULL,
+    .body_len = 0
+};
+
+#define TEST30_NUM_MSG          6
+#define TEST30_REQ_OP1_LEN      CACHE_URI_PATH_LEN
+#define TEST30_NUM_OPS          1
+#define TEST30_ETAG_NUM_OPS     2
+#define TEST30_RESP_NUM_OPS     2
+
+char test30_req_op1_val[TEST30_REQ_OP1_LEN + 1] = CACHE_URI_PATH;
+
+test_coap_client_msg_op_t test30_req_ops[TEST30_NUM_OPS] =
+{
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST30_REQ_OP1_LEN,
+        .val = test30_req_op1_val
+    }
+};
+
+test_coap_client_msg_op_t test30_etag_req_ops[TEST30_ETAG_NUM_OPS] =
+{
+    {
+        .num = COAP_MSG_ETAG,
+        .len = 1,
+        .val = "0"
+    },
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST30_REQ_OP1_LEN,
+        .val = test30_req_op1_val
+    }
+};
+
+test_coap_client_msg_op_t test30_resp_ops[TEST30_RESP_NUM_OPS] =
+{
+    {
+        .num = COAP_MSG_ETAG,
+        .len = 1,
+        .val = "0"
+    },
+    {
+        .num = COAP_MSG_MAX_AGE,
+        .len = 1,
+        .val = "\x3c"
+    }
+};
+
+/* responses from the cache carry the remaining lifetime of the stored response */
+test_coap_client_msg_op_t test30_cached_resp_ops[TEST30_RESP_NUM_OPS] =
+{
+    {
+        .num = COAP_MSG_ETAG,
+        .len = 1,
+        .val = "0"
+    },
+    {
+        .num = COAP_MSG_MAX_AGE,
+        .len = 1,
+        .val = "\x3b"
+    }
+};
+
+test_coap_client_msg_t test30_req[TEST30_NUM_MSG] =
+{
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_PUT,
+        .ops = test30_req_ops,
+        .num_ops = TEST30_NUM_OPS,
+        .payload = "0123456789abcde0",
+        .payload_len = 16,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_GET,
+        .ops = test30_req_ops,
+        .num_ops = TEST30_NUM_OPS,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_GET,
+        .ops = test30_req_ops,
+        .num_ops = TEST30_NUM_OPS,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_GET,
+        .ops = test30_etag_req_ops,
+        .num_ops = TEST30_ETAG_NUM_OPS,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_PUT,
+        .ops = test30_req_ops,
+        .num_ops = TEST30_NUM_OPS,
+        .payload = "fedcba9876543210",
+        .payload_len = 16,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_GET,
+        .ops = test30_req_ops,
+        .num_ops = TEST30_NUM_OPS,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    }
+};
+
+test_coap_client_msg_t test30_resp[TEST30_NUM_MSG] =
+{
+    {
+        .type = COAP_MSG_ACK,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CHANGED,
+        .ops = NULL,
+        .num_ops = 0,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_ACK,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CONTENT,
+        .ops = test30_resp_ops,
+        .num_ops = TEST30_RESP_NUM_OPS,
+        .payload = "0123456789abcde0",
+        .payload_len = 16,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_ACK,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CONTENT,
+        .ops = test30_cached_resp_ops,
+        .num_ops = TEST30_RESP_NUM_OPS,
+        .payload = "0123456789abcde0",
+        .payload_len = 16,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_ACK,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_VALID,
+        .ops = test30_cached_resp_ops,
+        .num_ops = TEST30_RESP_NUM_OPS,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_ACK,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CHANGED,
+        .ops = NULL,
+        .num_ops = 0,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_ACK,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CONTENT,
+        .ops = test30_resp_ops,
+        .num_ops = TEST30_RESP_NUM_OPS,
+        .payload = "fedcba9876543210",
+        .payload_len = 16,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    }
+};
+
+test_coap_client_data_t test30_data =
+{
+    .desc = "test 30: change a resource, GET it twice and expect the second response from the server cache, revalidate it with an ETag, then change it again and expect the cache to be invalidated",
+    .host = HOST,
+    .port = PORT,
+    .key_file_name = KEY_FILE_NAME,
+    .cert_file_name = CERT_FILE_NAME,
+    .trust_file_name = TRUST_FILE_NAME,
+    .crl_file_name = CRL_FILE_NAME,
+    .common_name = COMMON_NAME,
+    .test_req = test30_req,
+    .test_resp = test30_resp,
+    .num_msg = TEST30_NUM_MSG,
+    .body = NULL,
+    .body_len = 0
+};
+
+#define TEST31_NUM_MSG      2
+#define TEST31_REQ_OP1_LEN  STATS_URI_PATH1_LEN
+#define TEST31_REQ_OP2_LEN  STATS_URI_PATH2_LEN
+#define TEST31_NUM_OPS      2
+
+char test31_req_op1_val[TEST31_REQ_OP1_LEN + 1] = STATS_URI_PATH1;
+char test31_req_op2_val[TEST31_REQ_OP2_LEN + 1] = STATS_URI_PATH2;
+
+test_coap_client_msg_op_t test31_req_ops[TEST31_NUM_OPS] =
+{
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST31_REQ_OP1_LEN,
+        .val = test31_req_op1_val
+    },
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST31_REQ_OP2_LEN,
+        .val = test31_req_op2_val
+    }
+};
+
+test_coap_client_msg_t test31_req[TEST31_NUM_MSG] =
+{
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_GET,
+        .ops = test31_req_ops,
+        .num_ops = TEST31_NUM_OPS,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_GET,
+        .ops = test31_req_ops,
+        .num_ops = TEST31_NUM_OPS,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    }
+};
+
+/* only the start of each payload is compared */
+test_coap_client_msg_t test31_resp[TEST31_NUM_MSG] =
+{
+    {
+        .type = COAP_MSG_ACK,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CONTENT,
+        .ops = NULL,
+        .num_ops = 0,
+        .payload = "requests ",
+        .payload_len = 9,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_ACK,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CONTENT,
+        .ops = NULL,
+        .num_ops = 0,
+        .payload = "requests ",
+        .payload_len = 9,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    }
+};
+
+test_coap_client_data_t test31_data =
+{
+    .desc = "test 31: GET the server statistics twice and expect the request counter to increase",
+    .host = HOST,
+    .port = PORT,
+    .key_file_name = KEY_FILE_NAME,
+    .cert_file_name = CERT_FILE_NAME,
+    .trust_file_name = TRUST_FILE_NAME,
+    .crl_file_name = CRL_FILE_NAME,
+    .common_name = COMMON_NAME,
+    .test_req = test31_req,
+    .test_resp = test31_resp,
+    .num_msg = TEST31_NUM_MSG,
+    .body = NULL,
+    .body_len = 0
+};
+
+#define TEST32_NUM_MSG              7
+#define TEST32_REQ_OP1_LEN          CACHE_URI_PATH_LEN
+#define TEST32_BLOCK_OP_LEN         3
+#define TEST32_NUM_OPS              1
+#define TEST32_BLOCK_NUM_OPS        2
+#define TEST32_RESP_NUM_OPS         2
+#define TEST32_BLOCK_RESP_NUM_OPS   1
+
+char test32_req_op1_val[TEST32_REQ_OP1_LEN + 1] = CACHE_URI_PATH;
+char test32_block_op1_val[TEST32_BLOCK_OP_LEN] = {0x00, 0x00, 0x08};  /* num: 0, more: 1, size: 16 */
+char test32_block_op2_val[TEST32_BLOCK_OP_LEN] = {0x00, 0x00, 0x10};  /* num: 1, more: 0, size: 16 */
+
+test_coap_client_msg_op_t test32_req_ops[TEST32_NUM_OPS] =
+{
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST32_REQ_OP1_LEN,
+        .val = test32_req_op1_val
+    }
+};
+
+test_coap_client_msg_op_t test32_req_ops1[TEST32_BLOCK_NUM_OPS] =
+{
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST32_REQ_OP1_LEN,
+        .val = test32_req_op1_val
+    },
+    {
+        .num = COAP_MSG_BLOCK1,
+        .len = TEST32_BLOCK_OP_LEN,
+        .val = test32_block_op1_val
+    }
+};
+
+test_coap_client_msg_op_t test32_req_ops2[TEST32_BLOCK_NUM_OPS] =
+{
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST32_REQ_OP1_LEN,
+        .val = test32_req_op1_val
+    },
+    {
+        .num = COAP_MSG_BLOCK1,
+        .len = TEST32_BLOCK_OP_LEN,
+        .val = test32_block_op2_val
+    }
+};
+
+test_coap_client_msg_op_t test32_resp_ops1[TEST32_RESP_NUM_OPS] =
+{
+    {
+        .num = COAP_MSG_ETAG,
+        .len = 1,
+        .val = "0"
+    },
+    {
+        .num = COAP_MSG_MAX_AGE,
+        .len = 1,
+        .val = "\x3c"
+    }
+};
+
+/* responses from the cache carry the remaining lifetime of the stored response */
+test_coap_client_msg_op_t test32_cached_resp_ops[TEST32_RESP_NUM_OPS] =
+{
+    {
+        .num = COAP_MSG_ETAG,
+        .len = 1,
+        .val = "0"
+    },
+    {
+        .num = COAP_MSG_MAX_AGE,
+        .len = 1,
+        .val = "\x3b"
+    }
+};
+
+test_coap_client_msg_op_t test32_resp_ops2[TEST32_RESP_NUM_OPS] =
+{
+    {
+        .num = COAP_MSG_ETAG,
+        .len = 1,
+        .val = "1"
+    },
+    {
+        .num = COAP_MSG_MAX_AGE,
+        .len = 1,
+        .val = "\x3c"
+    }
+};
+
+test_coap_client_msg_op_t test32_block_resp_ops1[TEST32_BLOCK_RESP_NUM_OPS] =
+{
+    {
+        .num = COAP_MSG_BLOCK1,
+        .len = TEST32_BLOCK_OP_LEN,
+        .val = test32_block_op1_val
+    }
+};
+
+test_coap_client_msg_op_t test32_block_resp_ops2[TEST32_BLOCK_RESP_NUM_OPS] =
+{
+    {
+        .num = COAP_MSG_BLOCK1,
+        .len = TEST32_BLOCK_OP_LEN,
+        .val = test32_block_op2_val
+    }
+};
+
+test_coap_client_msg_t test32_req[TEST32_NUM_MSG] =
+{
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_PUT,
+        .ops = test32_req_ops,
+        .num_ops = TEST32_NUM_OPS,
+        .payload = "0123456789abcde0",
+        .payload_len = 16,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_GET,
+        .ops = test32_req_ops,
+        .num_ops = TEST32_NUM_OPS,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_GET,
+        .ops = test32_req_ops,
+        .num_ops = TEST32_NUM_OPS,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_PUT,
+        .ops = test32_req_ops1,
+        .num_ops = TEST32_BLOCK_NUM_OPS,
+        .payload = "fedcba9876543210",
+        .payload_len = 16,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_GET,
+        .ops = test32_req_ops,
+        .num_ops = TEST32_NUM_OPS,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_PUT,
+        .ops = test32_req_ops2,
+        .num_ops = TEST32_BLOCK_NUM_OPS,
+        .payload = "FEDCBA9876543210",
+        .payload_len = 16,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_GET,
+        .ops = test32_req_ops,
+        .num_ops = TEST32_NUM_OPS,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    }
+};
+
+test_coap_client_msg_t test32_resp[TEST32_NUM_MSG] =
+{
+    {
+        .type = COAP_MSG_ACK,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CHANGED,
+        .ops = NULL,
+        .num_ops = 0,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_ACK,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CONTENT,
+        .ops = test32_resp_ops1,
+        .num_ops = TEST32_RESP_NUM_OPS,
+        .payload = "0123456789abcde0",
+        .payload_len = 16,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_ACK,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CONTENT,
+        .ops = test32_cached_resp_ops,
+        .num_ops = TEST32_RESP_NUM_OPS,
+        .payload = "0123456789abcde0",
+        .payload_len = 16,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_ACK,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CONTINUE,
+        .ops = test32_block_resp_ops1,
+        .num_ops = TEST32_BLOCK_RESP_NUM_OPS,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_ACK,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CONTENT,
+        .ops = test32_resp_ops2,
+        .num_ops = TEST32_RESP_NUM_OPS,
+        .payload = "0123456789abcde1",
+        .payload_len = 16,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_ACK,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CHANGED,
+        .ops = test32_block_resp_ops2,
+        .num_ops = TEST32_BLOCK_RESP_NUM_OPS,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_ACK,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CONTENT,
+        .ops = test32_resp_ops1,
+        .num_ops = TEST32_RESP_NUM_OPS,
+        .payload = "fedcba9876543210FEDCBA9876543210",
+        .payload_len = 32,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    }
+};
+
+test_coap_client_data_t test32_data =
+{
+    .desc = "test 32: change a resource with a library-level blockwise PUT while a second client GETs it and expect the server cache to be invalidated by the first and the last block",
+    .host = HOST,
+    .port = PORT,
+    .key_file_name = KEY_FILE_NAME,
+    .cert_file_name = CERT_FILE_NAME,
+    .trust_file_name = TRUST_FILE_NAME,
+    .crl_file_name = CRL_FILE_NAME,
+    .common_name = COMMON_NAME,
+    .test_req = test32_req,
+    .test_resp = test32_resp,
+    .num_msg = TEST32_NUM_MSG,
+    .body = NULL,
+    .body_len = 0
+};
+
+#define TEST33_NUM_MSG          2
+#define TEST33_REQ_OP1_LEN      OBSERVE_URI_PATH_LEN
+#define TEST33_REQ_OP2_LEN      RESET_URI_PATH_LEN
+#define TEST33_REQ_NUM_OPS      1
+
+char test33_req_op1_val[TEST33_REQ_OP1_LEN + 1] = OBSERVE_URI_PATH;
+char test33_req_op2_val[TEST33_REQ_OP2_LEN + 1] = RESET_URI_PATH;
+
+test_coap_client_msg_op_t test33_req_ops1[TEST33_REQ_NUM_OPS] =
+{
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST33_REQ_OP1_LEN,
+        .val = test33_req_op1_val
+    }
+};
+
+test_coap_client_msg_op_t test33_req_ops2[TEST33_REQ_NUM_OPS] =
+{
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST33_REQ_OP2_LEN,
+        .val = test33_req_op2_val
+    }
+};
+
+test_coap_client_msg_t test33_req[TEST33_NUM_MSG] =
+{
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_DELETE,
+        .ops = test33_req_ops1,
+        .num_ops = TEST33_REQ_NUM_OPS,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_PUT,
+        .ops = test33_req_ops2,
+        .num_ops = TEST33_REQ_NUM_OPS,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    }
+};
+
+test_coap_client_msg_t test33_resp[TEST33_NUM_MSG] =
+{
+    {
+        .type = COAP_MSG_ACK,
+        .code_class = COAP_MSG_CLIENT_ERR,
+        .code_detail = COAP_MSG_METHOD_NOT_ALLOWED,
+        .ops = NULL,
+        .num_ops = 0,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_ACK,
+        .code_class = COAP_MSG_CLIENT_ERR,
+        .code_detail = COAP_MSG_METHOD_NOT_ALLOWED,
+        .ops = NULL,
+        .num_ops = 0,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    }
+};
+
+test_coap_client_data_t test33_data =
+{
+    .desc = "test 33: send requests with methods that are not registered for their URI paths to a server without a fallback handler and expect method not allowed responses",
+    .host = HOST,
+    .port = PORT,
+    .key_file_name = KEY_FILE_NAME,
+    .cert_file_name = CERT_FILE_NAME,
+    .trust_file_name = TRUST_FILE_NAME,
+    .crl_file_name = CRL_FILE_NAME,
+    .common_name = COMMON_NAME,
+    .test_req = test33_req,
+    .test_resp = test33_resp,
+    .num_msg = TEST33_NUM_MSG,
+    .body = NULL,
+    .body_len = 0
+};
+
+#define TEST34_NUM_MSG          3
+#define TEST34_REQ_OP1_LEN      UNKNOWN_URI_PATH_LEN
+#define TEST34_REQ_OP2_LEN      SEP_URI_PATH1_LEN
+#define TEST34_REQ_NUM_OPS      1
+
+char test34_req_op1_val[TEST34_REQ_OP1_LEN + 1] = UNKNOWN_URI_PATH;
+char test34_req_op2_val[TEST34_REQ_OP2_LEN + 1] = SEP_URI_PATH1;
+
+test_coap_client_msg_op_t test34_req_ops1[TEST34_REQ_NUM_OPS] =
+{
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST34_REQ_OP1_LEN,
+        .val = test34_req_op1_val
+    }
+};
+
+test_coap_client_msg_op_t test34_req_ops2[TEST34_REQ_NUM_OPS] =
+{
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST34_REQ_OP2_LEN,
+        .val = test34_req_op2_val
+    }
+};
+
+test_coap_client_msg_t test34_req[TEST34_NUM_MSG] =
+{
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_GET,
+        .ops = test34_req_ops1,
+        .num_ops = TEST34_REQ_NUM_OPS,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_DELETE,
+        .ops = test34_req_ops1,
+        .num_ops = TEST34_REQ_NUM_OPS,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_GET,
+        .ops = test34_req_ops2,
+        .num_ops = TEST34_REQ_NUM_OPS,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    }
+};
+
+test_coap_client_msg_t test34_resp[TEST34_NUM_MSG] =
+{
+    {
+        .type = COAP_MSG_ACK,
+        .code_class = COAP_MSG_CLIENT_ERR,
+        .code_detail = COAP_MSG_NOT_FOUND,
+        .ops = NULL,
+        .num_ops = 0,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_ACK,
+        .code_class = COAP_MSG_CLIENT_ERR,
+        .code_detail = COAP_MSG_NOT_FOUND,
+        .ops = NULL,
+        .num_ops = 0,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_ACK,
+        .code_class = COAP_MSG_CLIENT_ERR,
+        .code_detail = COAP_MSG_NOT_FOUND,
+        .ops = NULL,
+        .num_ops = 0,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    }
+};
+
+test_coap_client_data_t test34_data =
+{
+    .desc = "test 34: send requests for an unknown URI path and for the prefix of a registered URI path to a server without a fallback handler and expect not found responses",
+    .host = HOST,
+    .port = PORT,
+    .key_file_name = KEY_FILE_NAME,
+    .cert_file_name = CERT_FILE_NAME,
+    .trust_file_name = TRUST_FILE_NAME,
+    .crl_file_name = CRL_FILE_NAME,
+    .common_name = COMMON_NAME,
+    .test_req = test34_req,
+    .test_resp = test34_resp,
+    .num_msg = TEST34_NUM_MSG,
+    .body = NULL,
+    .body_len = 0
+};
+
+#ifndef COAP_DTLS_EN
+
+#define TEST35_NUM_MSG          2
+#define TEST35_REQ_OP1_LEN      REGULAR_URI_PATH_LEN
+#define TEST35_REQ_NUM_OPS1     1
+#define TEST35_REQ_NUM_OPS2     3
+
+char test35_req_op1_val[TEST35_REQ_OP1_LEN + 1] = REGULAR_URI_PATH;
+char test35_req_op2_val[SEP_URI_PATH1_LEN + 1] = SEP_URI_PATH1;
+char test35_req_op3_val[SEP_URI_PATH2_LEN + 1] = SEP_URI_PATH2;
+char test35_req_op4_val[SEP_URI_PATH3_LEN + 1] = SEP_URI_PATH3;
+
+test_coap_client_msg_op_t test35_req_ops1[TEST35_REQ_NUM_OPS1] =
+{
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST35_REQ_OP1_LEN,
+        .val = test35_req_op1_val
+    }
+};
+
+test_coap_client_msg_op_t test35_req_ops2[TEST35_REQ_NUM_OPS2] =
+{
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = SEP_URI_PATH1_LEN,
+        .val = test35_req_op2_val
+    },
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = SEP_URI_PATH2_LEN,
+        .val = test35_req_op3_val
+    },
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = SEP_URI_PATH3_LEN,
+        .val = test35_req_op4_val
+    }
+};
+
+test_coap_client_msg_t test35_req[TEST35_NUM_MSG] =
+{
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_GET,
+        .ops = test35_req_ops1,
+        .num_ops = TEST35_REQ_NUM_OPS1,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_REQ,
+        .code_detail = COAP_MSG_GET,
+        .ops = test35_req_ops2,
+        .num_ops = TEST35_REQ_NUM_OPS2,
+        .payload = NULL,
+        .payload_len = 0,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    }
+};
+
+test_coap_client_msg_t test35_resp[TEST35_NUM_MSG] =
+{
+    {
+        .type = COAP_MSG_ACK,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CONTENT,
+        .ops = NULL,
+        .num_ops = 0,
+        .payload = "qwertyuiopasdfgh",
+        .payload_len = 16,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    },
+    {
+        .type = COAP_MSG_CON,
+        .code_class = COAP_MSG_SUCCESS,
+        .code_detail = COAP_MSG_CONTENT,
+        .ops = NULL,
+        .num_ops = 0,
+        .payload = "qwertyuiopasdfgh",
+        .payload_len = 16,
+        .block1_size = 0,
+        .block2_size = 0,
+        .body_end = 0
+    }
+};
+
+test_coap_client_data_t test35_data =
+{
+    .desc = "test 35: repeat a confirmable request whose transaction has been recycled while a separate response waits for an acknowledgement and expect both responses to be sent unchanged",
+    .host = HOST,
+    .port = PORT,
+    .test_req = test35_req,
+    .test_resp = test35_resp,
+    .num_msg = TEST35_NUM_MSG,
+    .body = NULL,
+    .body_len = 0
+};
+
+#endif  /* !COAP_DTLS_EN */
+
+/**
+ *  @brief Fill in the body used in streaming library-level blockwise transfers
+ */
+static void test_stream_body_init(void)
+{
+    size_t i = 0;
+
+    for (i = 0; i < sizeof(test_stream_body); i++)
+    {
+        test_stream_body[i] = 'a' + (i % 26);
+    }
+}
+
+/**
+ *  @brief Asynchronous exchange test state structure
+ */
+typedef struct
+{
+    test_coap_client_msg_t *test_resp;                                          /**< Pointer to the expected response test message structure */
+    test_result_t result;                                                       /**< Test result */
+    int done;                                                                   /**< Flag to indicate that the request has completed */
+}
+test_coap_client_async_t;
+
+/**
+ *  @brief Observation test state structure
+ */
+typedef struct
+{
+    test_coap_client_msg_t *test_resp;                                          /**< Pointer to the expected registration response test message structure */
+    test_coap_client_msg_t *test_notify;                                        /**< Pointer to the expected notification test message structure */
+    test_result_t result;                                                       /**< Test result */
+    unsigned num;                                                               /**< Number of times the call-back function has been called */
+}
+test_coap_client_observe_t;
+
+/**
+ *  @brief Print a CoAP message
+ *
+ *  @param[in] str String to be printed before the message
+ *  @param[in] msg Pointer to a message structure
+ */
+static void print_coap_msg(const char *str, coap_msg_t *msg)
+{
+    coap_log_level_t log_level = 0;
+    coap_msg_op_t *op = NULL;
+    unsigned num = 0;
+    unsigned len = 0;
+    unsigned i = 0;
+    unsigned j = 0;
+    char *payload = NULL;
+    char *token = NULL;
+    char *val = NULL;
+
+    log_level = coap_log_get_level();
+    if (log_level < COAP_LOG_INFO)
+    {
+        return;
+    }
+    printf("%s\n", str);
+    printf("ver:         0x%02x\n", coap_msg_get_ver(msg));
+    printf("type:        0x%02x\n", coap_msg_get_type(msg));
+    printf("token_len:   %d\n", coap_msg_get_token_len(msg));
+    printf("code_class:  %d\n", coap_msg_get_code_class(msg));
+    printf("code_detail: %d\n", coap_msg_get_code_detail(msg));
+    printf("msg_id:      0x%04x\n", coap_msg_get_msg_id(msg));
+    printf("token:      ");
+    token = coap_msg_get_token(msg);
+    for (i = 0; i < coap_msg_get_token_len(msg); i++)
+    {
+        printf(" 0x%02x", (unsigned char)token[i]);
+    }
+    printf("\n");
+    op = coap_msg_get_first_op(msg);
+    while (op != NULL)
+    {
+        num = coap_msg_op_get_num(op);
+        len = coap_msg_op_get_len(op);
+        val = coap_msg_op_get_val(op);
+        printf("op[%u].num:   %u\n", j, num);
+        printf("op[%u].len:   %u\n", j, len);
+        printf("op[%u].val:  ", j);
+        for (i = 0; i < len; i++)
+        {
+            printf(" 0x%02x", (unsigned char)val[i]);
+        }
+        printf("\n");
+        op = coap_msg_op_get_next(op);
+        j++;
+    }
+    printf("payload:     ");
+    payload = coap_msg_get_payload(msg);
+    for (i = 0; i < coap_msg_get_payload_len(msg); i++)
+    {
+        printf("%c", payload[i]);
+    }
+    printf("\n");
+    printf("payload_len: %zu\n", coap_msg_get_payload_len(msg));
+}
+
+/**
+ *  @brief Populate a request message with details from a test request message structure
+ *
+ *  @param[in] test_req Pointer to a test request message structure
+ *  @param[out] req Pointer to a request message structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int populate_req(test_coap_client_msg_t *test_req, coap_msg_t *req)
+{
+    unsigned i = 0;
+    int ret = 0;
+
+    ret = coap_msg_set_type(req, test_req->type);
+    if (ret < 0)
+    {
+        coap_log_error("%s", strerror(-ret));
+        return ret;
+    }
+    ret = coap_msg_set_code(req, test_req->code_class, test_req->code_detail);
+    if (ret < 0)
+    {
+        coap_log_error("%s", strerror(-ret));
+        return ret;
+    }
+    for (i = 0; i < test_req->num_ops; i++)
+    {
+        ret = coap_msg_add_op(req, test_req->ops[i].num, test_req->ops[i].len, test_req->ops[i].val);
+        if (ret < 0)
+        {
+            coap_log_error("%s", strerror(-ret));
+            return ret;
+        }
+    }
+    if (test_req->payload)
+    {
+        ret = coap_msg_set_payload(req, test_req->payload, test_req->payload_len);
+        if (ret < 0)
+        {
+            coap_log_error("%s", strerror(-ret));
+            return ret;
+        }
+    }
+    return 0;
+}
+
+/**
+ *  @brief Send a request to the server to reset it to a known state
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[out] req Pointer to a request message structure
+ *  @param[out] resp Pointer to a response message structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int exchange_reset(coap_client_t *client, coap_msg_t *req, coap_msg_t *resp)
+{
+    int ret = 0;
+
+    ret = coap_msg_set_type(req, COAP_MSG_CON);
+    if (ret < 0)
+    {
+        coap_log_error("%s", strerror(-ret));
+        return ret;
+    }
+    ret = coap_msg_set_code(req, COAP_MSG_REQ, COAP_MSG_GET);
+    if (ret < 0)
+    {
+        coap_log_error("%s", strerror(-ret));
+        return ret;
+    }
+    ret = coap_msg_add_op(req, COAP_MSG_URI_PATH, RESET_URI_PATH_LEN, RESET_URI_PATH);
+    if (ret < 0)
+    {
+        coap_log_error("%s", strerror(-ret));
+        return ret;
+    }
+    ret = coap_client_exchange(client, req, resp);
+    if (ret < 0)
+    {
+        if (ret != -1)
+        {
+            /* a return value of -1 indicates a DTLS failure which has already been logged */
+            coap_log_error("%s", strerror(-ret));
+        }
+        return ret;
+    }
+    return 0;
+}
+
+/**
+ *  @brief Send a request to the server and receive the response
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in] test_req Pointer to a test request message structure
+ *  @param[out] req Pointer to a request message structure
+ *  @param[out] resp Pointer to a response message structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int exchange(coap_client_t *client, test_coap_client_msg_t *test_req, coap_msg_t *req, coap_msg_t *resp)
+{
+    int ret = 0;
+
+    ret = coap_client_exchange(client, req, resp);
+    if (ret < 0)
+    {
+        if (ret != -1)
+        {
+            /* a return value of -1 indicates a DTLS failure which has already been logged */
+            coap_log_error("%s", strerror(-ret));
+        }
+        return ret;
+    }
+    print_coap_msg("Sent:", req);
+    print_coap_msg("Received:", resp);
+    return 0;
+}
+
+/**
+ *  @brief Send a blockwise request to the server and receive the response
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in] test_req Pointer to a test request message structure
+ *  @param[out] req Pointer to a request message structure
+ *  @param[out] resp Pointer to a response message structure
+ *  @param[out] body Buffer to hold the body
+ *  @param[in] body_len Length of the buffer to hold the body
+ *
+ *  @returns Operation status
+ *  @retval >0 Length of the data sent/received
+ *  @retval <0 Error
+ */
+static ssize_t exchange_blockwise(coap_client_t *client,
+                                 test_coap_client_msg_t *test_req,
+                                 coap_msg_t *req, coap_msg_t *resp,
+                                 char *body, size_t body_len, int have_resp)
+{
+    ssize_t num = 0;
+
+    num = coap_client_exchange_blockwise(client,
+                                         req, resp,
+                                         test_req->block1_size,
+                                         test_req->block2_size,
+                                         body, body_len, have_resp);
+    if (num < 0)
+    {
+        if (num != -1)
+        {
+            /* a return value of -1 indicates a DTLS failure which has already been logged */
+            coap_log_error("%s", strerror(-num));
+        }
+        return num;
+    }
+    print_coap_msg("Sent:", req);
+    print_coap_msg("Received:", resp);
+    return num;
+}
+
+/**
+ *  @brief Compare the version and token fields in a request message and a response message
+ *
+ *  @param[out] req Pointer to a request message structure
+ *  @param[out] resp Pointer to a response message structure
+ *
+ *  @returns Test result
+ */
+static test_result_t compare_ver_token(coap_msg_t *req, coap_msg_t *resp)
+{
+    if (coap_msg_get_ver(req) != coap_msg_get_ver(resp))
+    {
+        coap_log_warn("Version in request and response messages do not match");
+        return FAIL;
+    }
+    if (coap_msg_get_token_len(req) != coap_msg_get_token_len(resp))
+    {
+        coap_log_warn("Token length in request and response messages do not match");
+        return FAIL;
+    }
+    else if (memcmp(coap_msg_get_token(req), coap_msg_get_token(resp), coap_msg_get_token_len(req)) != 0)
+    {
+        coap_log_warn("Token in request and response messages do not match");
+        return FAIL;
+    }
+    return PASS;
+}
+
+/**
+ *  @brief Check the fields in a response message against the expected values
+ *
+ *  @param[out] test_resp Pointer to a test response message structure
+ *  @param[out] resp Pointer to a response message structure
+ *
+ *  @returns Test result
+ */
+static test_result_t check_resp(test_coap_client_msg_t *test_resp, coap_msg_t *resp)
+{
+    test_coap_client_msg_op_t *exp_op = NULL;
+    coap_msg_op_t *resp_op = NULL;
+    unsigned match = 0;
+    unsigned i = 0;
+
+    if (test_resp->type != coap_msg_get_type(resp))
+    {
+        coap_log_warn("Unexpected type in response message");
+        coap_log_debug("Received: %d", coap_msg_get_type(resp));
+        coap_log_debug("Expected: %d", test_resp->type);
+        return FAIL;
+    }
+    if (test_resp->code_class != coap_msg_get_code_class(resp))
+    {
+        coap_log_warn("Unexpected code class in response message");
+        coap_log_debug("Received: %d", coap_msg_get_code_class(resp));
+        coap_log_debug("Expected: %d", test_resp->code_class);
+        return FAIL;
+    }
+    if (test_resp->code_detail != coap_msg_get_code_detail(resp))
+    {
+        coap_log_warn("Unexpected code detail in response message");
+        coap_log_debug("Received: %d", coap_msg_get_code_detail(resp));
+        coap_log_debug("Expected: %d", test_resp->code_detail);
+        return FAIL;
+    }
+    for (i = 0; i < test_resp->num_ops; i++)
+    {
+        match = 0;
+        exp_op = &test_resp->ops[i];
+        resp_op = coap_msg_get_first_op(resp);
+        while (resp_op != NULL)
+        {
+            if ((coap_msg_op_get_num(resp_op) == exp_op->num)
+             && (coap_msg_op_get_len(resp_op) == exp_op->len)
+             && (memcmp(coap_msg_op_get_val(resp_op), exp_op->val, exp_op->len) == 0))
+            {
+                match = 1;
+                break;
+            }
+            resp_op = coap_msg_op_get_next(resp_op);
+        }
+        if (!match)
+        {
+            coap_log_warn("Expected option: %d not found in response message", exp_op->num);
+            return FAIL;
+        }
+    }
+    if (test_resp->payload_len != coap_msg_get_payload_len(resp))
+    {
+        coap_log_warn("Unexpected payload length in response message");
+        coap_log_debug("Received: %d", coap_msg_get_payload_len(resp));
+        coap_log_debug("Expected: %d", test_resp->payload_len);
+        return FAIL;
+    }
+    if ((test_resp->payload_len > 0)
+     && (memcmp(test_resp->payload, coap_msg_get_payload(resp), test_resp->payload_len)))
+    {
+        coap_log_warn("Unexpected payload in response message");
+        coap_log_debug("Received: %s", coap_msg_get_payload(resp));
+        coap_log_debug("Expected: %s", test_resp->payload);
+        return FAIL;
+    }
+    return PASS;
+}
+
+/**
+ *  @brief Check the body in the response messages against the expected values
+ *
+ *  @param[in] test_data Pointer to a client test data structure
+ *  @param[in] test_resp Pointer to a test response message structure
+ *  @param[in] body Buffer to contain the expected body content
+ *  @param[in] body_end Amount of relevant data in the buffer to contain the expected body content
+ *
+ *  @returns Test result
+ */
+static test_result_t check_resp_body(test_coap_client_data_t *test_data,
+                                     test_coap_client_msg_t *test_resp,
+                                     const char *body, size_t body_end)
+{
+    if (body_end != test_resp->body_end)
+    {
+        coap_log_warn("Unexpected body length in response messages");
+        coap_log_debug("Received: %s", body_end);
+        coap_log_debug("Expected: %s", test_resp->body_end);
+        return FAIL;
+    }
+    if (memcmp(body, test_data->body, test_resp->body_end) != 0)
+    {
+        coap_log_warn("Unexpected body in response messages");
+        coap_log_debug("Received: %s", body);
+        coap_log_debug("Expected: %s", test_data->body);
+        return FAIL;
+    }
+    return PASS;
+}
+
+/**
+ *  @brief Test an exchange with the server
+ *
+ *  @param[in] data Pointer to a client test data structure
+ *
+ *  @returns Test result
+ */
+static test_result_t test_exchange_func(test_data_t data)
+{
+    test_coap_client_data_t *test_data = (test_coap_client_data_t *)data;
+    test_result_t result = PASS;
+    coap_client_t client = {0};
+    coap_msg_t resp = {0};
+    coap_msg_t req = {0};
+    unsigned i = 0;
+    int ret = 0;
+
+    printf("%s\n", test_data->desc);
+
+#ifdef COAP_DTLS_EN
+    ret = coap_client_create(&client,
+                             test_data->host,
+                             test_data->port,
+                             test_data->key_file_name,
+                             test_data->cert_file_name,
+                             test_data->trust_file_name,
+                             test_data->crl_file_name,
+                             test_data->common_name);
+#else
+    ret = coap_client_create(&client,
+                             test_data->host,
+                             test_data->port);
+#endif
+    if (ret < 0)
+    {
+        if (ret != -1)
+        {
+            /* a return value of -1 indicates a DTLS failure which has already been logged */
+            coap_log_error("%s", strerror(-ret));
+        }
+        return FAIL;
+    }
+    coap_msg_create(&req);
+    coap_msg_create(&resp);
+    exchange_reset(&client, &req, &resp);
+    coap_msg_destroy(&resp);
+    coap_msg_destroy(&req);
+    for (i = 0; i < test_data->num_msg; i++)
+    {
+        coap_msg_create(&req);
+        coap_msg_create(&resp);
+        ret = populate_req(&test_data->test_req[i], &req);
+        if (ret < 0)
+        {
+            coap_msg_destroy(&resp);
+            coap_msg_destroy(&req);
+            coap_client_destroy(&client);
+            return FAIL;
+        }
+        ret = exchange(&client, &test_data->test_req[i], &req, &resp);
+        if (ret < 0)
+        {
+            coap_msg_destroy(&resp);
+            coap_msg_destroy(&req);
+            coap_client_destroy(&client);
+            return FAIL;
+        }
+        ret = compare_ver_token(&req, &resp);
+        if (ret != PASS)
+        {
+            coap_msg_destroy(&resp);
+            coap_msg_destroy(&req);
+            coap_client_destroy(&client);
+            return ret;
+        }
+        ret = check_resp(&test_data->test_resp[i], &resp);
+        if (ret != PASS)
+        {
+            coap_msg_destroy(&resp);
+            coap_msg_destroy(&req);
+            coap_client_destroy(&client);
+            return ret;
+        }
+        coap_msg_destroy(&resp);
+        coap_msg_destroy(&req);
+    }
+    coap_client_destroy(&client);
+    return result;
+}
+
+/**
+ *  @brief Asynchronous request completion call-back function
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in] req Pointer to the request message
+ *  @param[in] resp Pointer to the response message or NULL
+ *  @param[in] status Completion status
+ *  @param[in] data Pointer to an asynchronous exchange test state structure
+ */
+static void async_handle(coap_client_t *client, coap_msg_t *req, coap_msg_t *resp, int status, void *data)
+{
+    test_coap_client_async_t *state = (test_coap_client_async_t *)data;
+
+    state->done = 1;
+    if (status < 0)
+    {
+        coap_log_error("%s", strerror(-status));
+        state->result = FAIL;
+        return;
+    }
+    print_coap_msg("Sent:", req);
+    print_coap_msg("Received:", resp);
+    state->result = compare_ver_token(req, resp);
+    if (state->result != PASS)
+    {
+        return;
+    }
+    state->result = check_resp(state->test_resp, resp);
+}
+
+/**
+ *  @brief Test asynchronous exchanges with the server
+ *
+ *  All of the requests are sent before any of the
+ *  responses are processed.
+ *
+ *  @param[in] data Pointer to a client test data structure
+ *
+ *  @returns Test result
+ */
+static test_result_t test_exchange_async_func(test_data_t data)
+{
+    test_coap_client_data_t *test_data = (test_coap_client_data_t *)data;
+    test_coap_client_async_t state[TEST_ASYNC_MAX_NUM_MSG] = {{0}};
+    test_result_t result = PASS;
+    coap_client_t client = {0};
+    struct pollfd pfd = {0};
+    coap_msg_t resp = {0};
+    coap_msg_t req = {0};
+    unsigned i = 0;
+    int ret = 0;
+
+    printf("%s\n", test_data->desc);
+
+    if (test_data->num_msg > TEST_ASYNC_MAX_NUM_MSG)
+    {
+        return FAIL;
+    }
+#ifdef COAP_DTLS_EN
+    ret = coap_client_create(&client,
+                             test_data->host,
+                             test_data->port,
+                             test_data->key_file_name,
+                             test_data->cert_file_name,
+                             test_data->trust_file_name,
+                             test_data->crl_file_name,
+                             test_data->common_name);
+#else
+    ret = coap_client_create(&client,
+                             test_data->host,
+                             test_data->port);
+#endif
+    if (ret < 0)
+    {
+        if (ret != -1)
+        {
+            /* a return value of -1 indicates a DTLS failure which has already been logged */
+            coap_log_error("%s", strerror(-ret));
+        }
+        return FAIL;
+    }
+    coap_msg_create(&req);
+    coap_msg_create(&resp);
+    exchange_reset(&client, &req, &resp);
+    coap_msg_destroy(&resp);
+    coap_msg_destroy(&req);
+    ret = coap_client_async_create(&client, 0);
+    if (ret < 0)
+    {
+        coap_log_error("%s", strerror(-ret));
+        coap_client_destroy(&client);
+        return FAIL;
+    }
+    for (i = 0; i < test_data->num_msg; i++)
+    {
+        state[i].test_resp = &test_data->test_resp[i];
+        coap_msg_create(&req);
+        ret = populate_req(&test_data->test_req[i], &req);
+        if (ret < 0)
+        {
+            coap_msg_destroy(&req);
+            coap_client_destroy(&client);
+            return FAIL;
+        }
+        ret = coap_client_async_send(&client, &req, async_handle, &state[i]);
+        coap_msg_destroy(&req);
+        if (ret < 0)
+        {
+            coap_log_error("%s", strerror(-ret));
+            coap_client_destroy(&client);
+            return FAIL;
+        }
+    }
+    pfd.fd = coap_client_async_get_fd(&client);
+    pfd.events = POLLIN;
+    while (coap_client_async_get_num(&client) > 0)
+    {
+        ret = poll(&pfd, 1, -1);
+        if (ret < 0)
+        {
+            coap_log_error("%s", strerror(errno));
+            coap_client_destroy(&client);
+            return FAIL;
+        }
+        ret = coap_client_async_process(&client);
+        if (ret < 0)
+        {
+            coap_log_error("%s", strerror(-ret));
+            coap_client_destroy(&client);
+            return FAIL;
+        }
+    }
+    for (i = 0; i < test_data->num_msg; i++)
+    {
+        if ((!state[i].done) || (state[i].result != PASS))
+        {
+            result = FAIL;
+        }
+    }
+    coap_client_destroy(&client);
+    return result;
+}
+
+/**
+ *  @brief Search a message for an Observe option
+ *
+ *  @param[in] msg Pointer to a message structure
+ *
+ *  @returns Test result
+ */
+static test_result_t check_observe_op(coap_msg_t *msg)
+{
+    coap_msg_op_t *op = NULL;
+
+    op = coap_msg_get_first_op(msg);
+    while (op != NULL)
+    {
+        if (coap_msg_op_get_num(op) == COAP_MSG_OBSERVE)
+        {
+            return PASS;
+        }
+        op = coap_msg_op_get_next(op);
+    }
+    coap_log_warn("Expected option: %d not found in response message", COAP_MSG_OBSERVE);
+    return FAIL;
+}
+
+/**
+ *  @brief Observation call-back function
+ *
+ *  The first call is expected to deliver the registration
+ *  response and the second the notification. Any further
+ *  call fails the test.
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in] req Pointer to the request message
+ *  @param[in] resp Pointer to the response message or NULL
+ *  @param[in] status Completion status
+ *  @param[in] data Pointer to an observation test state structure
+ */
+static void observe_handle(coap_client_t *client, coap_msg_t *req, coap_msg_t *resp, int status, void *data)
+{
+    test_coap_client_observe_t *state = (test_coap_client_observe_t *)data;
+    test_coap_client_msg_t *test_resp = NULL;
+    test_result_t result = PASS;
+
+    state->num++;
+    if (status < 0)
+    {
+        coap_log_error("%s", strerror(-status));
+        state->result = FAIL;
+        return;
+    }
+    print_coap_msg("Sent:", req);
+    print_coap_msg("Received:", resp);
+    if (state->num == 1)
+    {
+        test_resp = state->test_resp;
+    }
+    else if (state->num == 2)
+    {
+        test_resp = state->test_notify;
+    }
+    else
+    {
+        coap_log_warn("Unexpected notification");
+        state->result = FAIL;
+        return;
+    }
+    result = compare_ver_token(req, resp);
+    if (result == PASS)
+    {
+        result = check_observe_op(resp);
+    }
+    if (result == PASS)
+    {
+        result = check_resp(test_resp, resp);
+    }
+    if (result != PASS)
+    {
+        state->result = FAIL;
+    }
+}
+
+/**
+ *  @brief Wait for and process the messages received by an asynchronous client
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in] timeout Maximum time to wait in milliseconds, -1 to wait indefinitely
+ *
+ *  @returns Operation status
+ *  @retval 1 Messages processed
+ *  @retval 0 Timeout
+ *  @retval <0 Error
+ */
+static int async_wait(coap_client_t *client, int timeout)
+{
+    struct pollfd pfd = {0};
+    int ret = 0;
+
+    pfd.fd = coap_client_async_get_fd(client);
+    pfd.events = POLLIN;
+    ret = poll(&pfd, 1, timeout);
+    if (ret < 0)
+    {
+        return -errno;
+    }
+    if (ret == 0)
+    {
+        return 0;
+    }
+    ret = coap_client_async_process(client);
+    if (ret < 0)
+    {
+        return ret;
+    }
+    return 1;
+}
+
+/**
+ *  @brief Send an asynchronous request
+ *
+ *  @param[in,out] client Pointer to a client structure
+ *  @param[in] test_req Pointer to a test request message structure
+ *  @param[in,out] state Pointer to an asynchronous exchange test state structure
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int async_send(coap_client_t *client, test_coap_client_msg_t *test_req, test_coap_client_async_t *state)
+{
+    coap_msg_t req = {0};
+    int ret = 0;
+
+    coap_msg_create(&req);
+    ret = populate_req(test_req, &req);
+    if (ret == 0)
+    {
+        ret = coap_client_async_send(client, &req, async_handle, state);
+    }
+    coap_msg_destroy(&req);
+    return ret;
+}
+
+/**
+ *  @brief Test an observation of a resource on the server
+ *
+ *  The first request registers the observation, the second
+ *  changes the resource and the third changes it again after
+ *  the observation has been cancelled. The response test
+ *  messages that follow the responses to the requests are
+ *  the expected notifications.
+ *
+ *  @param[in] data Pointer to a client test data structure
+ *
+ *  @returns Test result
+ */
+static test_result_t test_exchange_observe_func(test_data_t data)
+{
+    test_coap_client_data_t *test_data = (test_coap_client_data_t *)data;
+    test_coap_client_observe_t obs_state = {0};
+    test_coap_client_async_t state[2] = {{0}};
+    test_result_t result = PASS;
+    coap_client_t client = {0};
+    coap_msg_t resp = {0};
+    coap_msg_t req = {0};
+    int id = 0;
+    int ret = 0;
+
+    printf("%s\n", test_data->desc);
+
+#ifdef COAP_DTLS_EN
+    ret = coap_client_create(&client,
+                             test_data->host,
+                             test_data->port,
+                             test_data->key_file_name,
+                             test_data->cert_file_name,
+                             test_data->trust_file_name,
+                             test_data->crl_file_name,
+                             test_data->common_name);
+#else
+    ret = coap_client_create(&client,
+                             test_data->host,
+                             test_data->port);
+#endif
+    if (ret < 0)
+    {
+        if (ret != -1)
+        {
+            /* a return value of -1 indicates a DTLS failure which has already been logged */
+            coap_log_error("%s", strerror(-ret));
+        }
+        return FAIL;
+    }
+    coap_msg_create(&req);
+    coap_msg_create(&resp);
+    exchange_reset(&client, &req, &resp);
+    coap_msg_destroy(&resp);
+    coap_msg_destroy(&req);
+    ret = coap_client_async_create(&client, 0);
+    if (ret < 0)
+    {
+        coap_log_error("%s", strerror(-ret));
+        coap_client_destroy(&client);
+        return FAIL;
+    }
+
+    /* register the observation */
+    obs_state.result = PASS;
+    obs_state.test_resp = &test_data->test_resp[0];
+    obs_state.test_notify = &test_data->test_resp[test_data->num_msg];
+    coap_msg_create(&req);
+    ret = populate_req(&test_data->test_req[0], &req);
+    if (ret == 0)
+    {
+        ret = coap_client_async_observe(&client, &req, observe_handle, &obs_state);
+    }
+    coap_msg_destroy(&req);
+    id = ret;
+    while ((ret >= 0) && (obs_state.num < 1))
+    {
+        ret = async_wait(&client, -1);
+    }
+    if (ret < 0)
+    {
+        coap_log_error("%s", strerror(-ret));
+        coap_client_destroy(&client);
+        return FAIL;
+    }
+
+    /* change the resource and expect a notification */
+    state[0].test_resp = &test_data->test_resp[1];
+    ret = async_send(&client, &test_data->test_req[1], &state[0]);
+    while ((ret >= 0) && ((!state[0].done) || (obs_state.num < 2)))
+    {
+        ret = async_wait(&client, -1);
+    }
+    if (ret < 0)
+    {
+        coap_log_error("%s", strerror(-ret));
+        coap_client_destroy(&client);
+        return FAIL;
+    }
+
+    /* cancel the observation, change the resource and expect no notification */
+    ret = coap_client_async_cancel_observe(&client, id);
+    if (ret == 0)
+    {
+        state[1].test_resp = &test_data->test_resp[2];
+        ret = async_send(&client, &test_data->test_req[2], &state[1]);
+    }
+    while ((ret >= 0) && (!state[1].done))
+    {
+        ret = async_wait(&client, -1);
+    }
+    while (ret > 0)
+    {
+        ret = async_wait(&client, OBSERVE_WAIT_MS);
+    }
+    if (ret < 0)
+    {
+        coap_log_error("%s", strerror(-ret));
+        coap_client_destroy(&client);
+        return FAIL;
+    }
+
+    if ((obs_state.num != 2) || (obs_state.result != PASS)
+     || (state[0].result != PASS) || (state[1].result != PASS))
+    {
+        result = FAIL;
+    }
+    coap_client_destroy(&client);
+    return result;
+}
+
 /**
- *  @brief Print a CoAP message
+ *  @brief Test an exchange with the server using library-level blockwise transfers
  *
- *  @param[in] str String to be printed before the message
- *  @param[in] msg Pointer to a message structure
+ *  @param[in] data Pointer to a client test data structure
+ *  @param[in] index Message index
+ *
+ *  @returns Test result
  */
-static void print_coap_msg(const char *str, coap_msg_t *msg)
+static test_result_t test_exchange_blockwise_func(test_data_t data)
 {
-    coap_log_level_t log_level = 0;
-    coap_msg_op_t *op = NULL;
-    unsigned num = 0;
-    unsigned len = 0;
+    test_coap_client_data_t *test_data = (test_coap_client_data_t *)data;
+    test_result_t result = PASS;
+    coap_client_t client = {0};
+    coap_msg_t resp = {0};
+    coap_msg_t req = {0};
     unsigned i = 0;
-    unsigned j = 0;
-    char *payload = NULL;
-    char *token = NULL;
-    char *val = NULL;
+    ssize_t num = 0;
+    size_t body_len = 0;
+    char body[test_data->body_len];
+    int ret = 0;
 
-    log_level = coap_log_get_level();
-    if (log_level < COAP_LOG_INFO)
-    {
-        return;
-    }
-    printf("%s\n", str);
-    printf("ver:         0x%02x\n", coap_msg_get_ver(msg));
-    printf("type:        0x%02x\n", coap_msg_get_type(msg));
-    printf("token_len:   %d\n", coap_msg_get_token_len(msg));
-    printf("code_class:  %d\n", coap_msg_get_code_class(msg));
-    printf("code_detail: %d\n", coap_msg_get_code_detail(msg));
-    printf("msg_id:      0x%04x\n", coap_msg_get_msg_id(msg));
-    printf("token:      ");
-    token = coap_msg_get_token(msg);
-    for (i = 0; i < coap_msg_get_token_len(msg); i++)
+    printf("%s\n", test_data->desc);
+
+#ifdef COAP_DTLS_EN
+    ret = coap_client_create(&client,
+                             test_data->host,
+                             test_data->port,
+                             test_data->key_file_name,
+                             test_data->cert_file_name,
+                             test_data->trust_file_name,
+                             test_data->crl_file_name,
+                             test_data->common_name);
+#else
+    ret = coap_client_create(&client,
+                             test_data->host,
+                             test_data->port);
+#endif
+    if (ret < 0)
     {
-        printf(" 0x%02x", (unsigned char)token[i]);
+        if (ret != -1)
+        {
+            /* a return value of -1 indicates a DTLS failure which has already been logged */
+            coap_log_error("%s", strerror(-ret));
+        }
+        return FAIL;
     }
-    printf("\n");
-    op = coap_msg_get_first_op(msg);
-    while (op != NULL)
+    coap_client_set_block_window(&client, test_data->block_window);
+    coap_msg_create(&req);
+    coap_msg_create(&resp);
+    exchange_reset(&client, &req, &resp);
+    coap_msg_destroy(&resp);
+    coap_msg_destroy(&req);
+    for (i = 0; i < test_data->num_msg; i++)
     {
-        num = coap_msg_op_get_num(op);
-        len = coap_msg_op_get_len(op);
-        val = coap_msg_op_get_val(op);
-        printf("op[%u].num:   %u\n", j, num);
-        printf("op[%u].len:   %u\n", j, len);
-        printf("op[%u].val:  ", j);
-        for (i = 0; i < len; i++)
+        coap_msg_create(&req);
+        coap_msg_create(&resp);
+        memset(body, 0, sizeof(body));
+        ret = populate_req(&test_data->test_req[i], &req);
+        if (ret < 0)
         {
-            printf(" 0x%02x", (unsigned char)val[i]);
+            coap_msg_destroy(&resp);
+            coap_msg_destroy(&req);
+            coap_client_destroy(&client);
+            return FAIL;
         }
-        printf("\n");
-        op = coap_msg_op_get_next(op);
-        j++;
+        if (test_data->test_req[i].code_detail == COAP_MSG_GET)
+        {
+            memset(body, 0, sizeof(body));
+            body_len = sizeof(body);
+        }
+        else if ((test_data->test_req[i].code_detail == COAP_MSG_PUT)
+              || (test_data->test_req[i].code_detail == COAP_MSG_POST))
+        {
+            memcpy(body, test_data->body, test_data->body_len);
+            body_len = test_data->body_len;
+        }
+        num = exchange_blockwise(&client,
+                                 &test_data->test_req[i],
+                                 &req, &resp,
+                                 body, body_len, 0);
+        if (num < 0)
+        {
+            coap_msg_destroy(&resp);
+            coap_msg_destroy(&req);
+            coap_client_destroy(&client);
+            return FAIL;
+        }
+        ret = check_resp(&test_data->test_resp[i], &resp);
+        if (ret != PASS)
+        {
+            coap_msg_destroy(&resp);
+            coap_msg_destroy(&req);
+            coap_client_destroy(&client);
+            return ret;
+        }
+        ret = check_resp_body(test_data, &test_data->test_resp[i], body, num);
+        if (ret != PASS)
+        {
+            coap_msg_destroy(&resp);
+            coap_msg_destroy(&req);
+            coap_client_destroy(&client);
+            return ret;
+        }
+        coap_msg_destroy(&resp);
+        coap_msg_destroy(&req);
     }
-    printf("payload:     ");
-    payload = coap_msg_get_payload(msg);
-    for (i = 0; i < coap_msg_get_payload_len(msg); i++)
+    coap_client_destroy(&client);
+    return result;
+}
+
+/**
+ *  @brief Streaming blockwise transfer test state structure
+ */
+typedef struct
+{
+    const char *body;                                                           /**< Expected body */
+    size_t body_len;                                                            /**< Length of the expected body */
+    size_t body_end;                                                            /**< Number of bytes passed to the sink in order */
+    int err;                                                                    /**< Flag to indicate that the sink received unexpected data */
+}
+test_coap_client_stream_t;
+
+/**
+ *  @brief Produce part of the request body in a streaming blockwise transfer
+ */
+static ssize_t stream_read(coap_client_t *client, size_t offset, char *buf, size_t len, void *data)
+{
+    test_coap_client_stream_t *stream = (test_coap_client_stream_t *)data;
+
+    if (offset >= stream->body_len)
     {
-        printf("%c", payload[i]);
+        return 0;
     }
-    printf("\n");
-    printf("payload_len: %zu\n", coap_msg_get_payload_len(msg));
+    if (offset + len > stream->body_len)
+    {
+        len = stream->body_len - offset;
+    }
+    memcpy(buf, stream->body + offset, len);
+    return len;
 }
 
 /**
- *  @brief Populate a request message with details from a test request message structure
+ *  @brief Consume part of the response body in a streaming blockwise transfer
+ */
+static int stream_write(coap_client_t *client, size_t offset, const char *buf, size_t len, int more, void *data)
+{
+    test_coap_client_stream_t *stream = (test_coap_client_stream_t *)data;
+
+    if ((offset != stream->body_end)
+     || (offset + len > stream->body_len)
+     || (memcmp(buf, stream->body + offset, len) != 0))
+    {
+        coap_log_warn("Unexpected block at byte %zu in streaming blockwise transfer", offset);
+        stream->err = 1;
+        return -EBADMSG;
+    }
+    stream->body_end += len;
+    return 0;
+}
+
+/**
+ *  @brief Test an exchange with the server using streaming library-level blockwise transfers
  *
- *  @param[in] test_req Pointer to a test request message structure
- *  @param[out] req Pointer to a request message structure
+ *  The request body is produced and the response body
+ *  is checked one block at a time without a body buffer.
  *
- *  @returns Operation status
- *  @retval 0 Success
- *  @retval <0 Error
+ *  @param[in] data Pointer to a client test data structure
+ *
+ *  @returns Test result
  */
-static int populate_req(test_coap_client_msg_t *test_req, coap_msg_t *req)
+static test_result_t test_exchange_stream_func(test_data_t data)
 {
+    test_coap_client_data_t *test_data = (test_coap_client_data_t *)data;
+    test_coap_client_stream_t stream = {0};
+    test_result_t result = PASS;
+    coap_client_t client = {0};
+    coap_msg_t resp = {0};
+    coap_msg_t req = {0};
     unsigned i = 0;
+    ssize_t num = 0;
     int ret = 0;
 
-    ret = coap_msg_set_type(req, test_req->type);
-    if (ret < 0)
-    {
-        coap_log_error("%s", strerror(-ret));
-        return ret;
-    }
-    ret = coap_msg_set_code(req, test_req->code_class, test_req->code_detail);
+    printf("%s\n", test_data->desc);
+
+#ifdef COAP_DTLS_EN
+    ret = coap_client_create(&client,
+                             test_data->host,
+                             test_data->port,
+                             test_data->key_file_name,
+                             test_data->cert_file_name,
+                             test_data->trust_file_name,
+                             test_data->crl_file_name,
+                             test_data->common_name);
+#else
+    ret = coap_client_create(&client,
+                             test_data->host,
+                             test_data->port);
+#endif
     if (ret < 0)
     {
-        coap_log_error("%s", strerror(-ret));
-        return ret;
-    }
-    for (i = 0; i < test_req->num_ops; i++)
-    {
-        ret = coap_msg_add_op(req, test_req->ops[i].num, test_req->ops[i].len, test_req->ops[i].val);
-        if (ret < 0)
+        if (ret != -1)
         {
+            /* a return value of -1 indicates a DTLS failure which has already been logged */
             coap_log_error("%s", strerror(-ret));
-            return ret;
         }
+        return FAIL;
     }
-    if (test_req->payload)
+    coap_msg_create(&req);
+    coap_msg_create(&resp);
+    exchange_reset(&client, &req, &resp);
+    coap_msg_destroy(&resp);
+    coap_msg_destroy(&req);
+    for (i = 0; i < test_data->num_msg; i++)
     {
-        ret = coap_msg_set_payload(req, test_req->payload, test_req->payload_len);
+        coap_msg_create(&req);
+        coap_msg_create(&resp);
+        ret = populate_req(&test_data->test_req[i], &req);
         if (ret < 0)
         {
-            coap_log_error("%s", strerror(-ret));
+            coap_msg_destroy(&resp);
+            coap_msg_destroy(&req);
+            coap_client_destroy(&client);
+            return FAIL;
+        }
+        memset(&stream, 0, sizeof(stream));
+        stream.body = test_data->body;
+        stream.body_len = test_data->body_len;
+        num = coap_client_exchange_blockwise_stream(&client, &req, &resp,
+                                                    test_data->test_req[i].block1_size,
+                                                    test_data->test_req[i].block2_size,
+                                                    stream_read, stream_write,
+                                                    &stream, 0);
+        if ((num < 0) || (stream.err))
+        {
+            if (num < 0)
+            {
+                coap_log_error("%s", strerror(-num));
+            }
+            coap_msg_destroy(&resp);
+            coap_msg_destroy(&req);
+            coap_client_destroy(&client);
+            return FAIL;
+        }
+        print_coap_msg("Sent:", &req);
+        print_coap_msg("Received:", &resp);
+        ret = check_resp(&test_data->test_resp[i], &resp);
+        if (ret != PASS)
+        {
+            coap_msg_destroy(&resp);
+            coap_msg_destroy(&req);
+            coap_client_destroy(&client);
             return ret;
         }
+        if ((num != test_data->test_resp[i].body_end)
+         || (stream.body_end != test_data->test_resp[i].body_end))
+        {
+            coap_log_warn("Unexpected body length in response messages");
+            result = FAIL;
+        }
+        coap_msg_destroy(&resp);
+        coap_msg_destroy(&req);
     }
-    return 0;
+    coap_client_destroy(&client);
+    return result;
 }
 
 /**
- *  @brief Send a request to the server to reset it to a known state
+ *  @brief Test an exchange with the server using two clients
  *
- *  @param[in,out] client Pointer to a client structure
- *  @param[out] req Pointer to a request message structure
- *  @param[out] resp Pointer to a response message structure
+ *  Requests with the GET method are sent by a second
+ *  client so that they can be interleaved with a
+ *  blockwise transfer by the first client.
  *
- *  @returns Operation status
- *  @retval 0 Success
- *  @retval <0 Error
+ *  @param[in] data Pointer to a client test data structure
+ *
+ *  @returns Test result
  */
-static int exchange_reset(coap_client_t *client, coap_msg_t *req, coap_msg_t *resp)
+static test_result_t test_exchange_clients_func(test_data_t data)
 {
+    test_coap_client_data_t *test_data = (test_coap_client_data_t *)data;
+    test_result_t result = PASS;
+    coap_client_t client[2] = {{0}};
+    coap_msg_t resp = {0};
+    coap_msg_t req = {0};
+    unsigned i = 0;
+    unsigned j = 0;
     int ret = 0;
 
-    ret = coap_msg_set_type(req, COAP_MSG_CON);
-    if (ret < 0)
-    {
-        coap_log_error("%s", strerror(-ret));
-        return ret;
-    }
-    ret = coap_msg_set_code(req, COAP_MSG_REQ, COAP_MSG_GET);
-    if (ret < 0)
-    {
-        coap_log_error("%s", strerror(-ret));
-        return ret;
-    }
-    ret = coap_msg_add_op(req, COAP_MSG_URI_PATH, RESET_URI_PATH_LEN, RESET_URI_PATH);
-    if (ret < 0)
+    printf("%s\n", test_data->desc);
+
+    for (j = 0; j < 2; j++)
     {
-        coap_log_error("%s", strerror(-ret));
-        return ret;
+#ifdef COAP_DTLS_EN
+        ret = coap_client_create(&client[j],
+                                 test_data->host,
+                                 test_data->port,
+                                 test_data->key_file_name,
+                                 test_data->cert_file_name,
+                                 test_data->trust_file_name,
+                                 test_data->crl_file_name,
+                                 test_data->common_name);
+#else
+        ret = coap_client_create(&client[j],
+                                 test_data->host,
+                                 test_data->port);
+#endif
+        if (ret < 0)
+        {
+            if (ret != -1)
+            {
+                /* a return value of -1 indicates a DTLS failure which has already been logged */
+                coap_log_error("%s", strerror(-ret));
+            }
+            if (j > 0)
+            {
+                coap_client_destroy(&client[0]);
+            }
+            return FAIL;
+        }
     }
-    ret = coap_client_exchange(client, req, resp);
-    if (ret < 0)
+    coap_msg_create(&req);
+    coap_msg_create(&resp);
+    exchange_reset(&client[0], &req, &resp);
+    coap_msg_destroy(&resp);
+    coap_msg_destroy(&req);
+    for (i = 0; i < test_data->num_msg; i++)
     {
-        if (ret != -1)
+        j = (test_data->test_req[i].code_detail == COAP_MSG_GET) ? 1 : 0;
+        coap_msg_create(&req);
+        coap_msg_create(&resp);
+        ret = populate_req(&test_data->test_req[i], &req);
+        if (ret == 0)
         {
-            /* a return value of -1 indicates a DTLS failure which has already been logged */
-            coap_log_error("%s", strerror(-ret));
+            ret = exchange(&client[j], &test_data->test_req[i], &req, &resp);
+        }
+        if (ret < 0)
+        {
+            result = FAIL;
+        }
+        if (result == PASS)
+        {
+            result = compare_ver_token(&req, &resp);
+        }
+        if (result == PASS)
+        {
+            result = check_resp(&test_data->test_resp[i], &resp);
+        }
+        coap_msg_destroy(&resp);
+        coap_msg_destroy(&req);
+        if (result != PASS)
+        {
+            break;
         }
-        return ret;
     }
-    return 0;
+    coap_client_destroy(&client[1]);
+    coap_client_destroy(&client[0]);
+    return result;
 }
 
+#ifndef COAP_DTLS_EN
+
+#define TEST_RAW_MSG_ID         0x5a01                                          /**< Message ID of the first message sent by test_exchange_dedup_func */
+#define TEST_RAW_TIMEOUT        10000                                           /**< Time (msec) to wait for a message in test_exchange_dedup_func */
+
 /**
- *  @brief Send a request to the server and receive the response
+ *  @brief Send a message on the socket of a client without the client protocol layer
  *
- *  @param[in,out] client Pointer to a client structure
- *  @param[in] test_req Pointer to a test request message structure
- *  @param[out] req Pointer to a request message structure
- *  @param[out] resp Pointer to a response message structure
+ *  @param[in] client Pointer to a client structure
+ *  @param[in] msg Pointer to a message structure
  *
  *  @returns Operation status
  *  @retval 0 Success
  *  @retval <0 Error
  */
-static int exchange(coap_client_t *client, test_coap_client_msg_t *test_req, coap_msg_t *req, coap_msg_t *resp)
+static int raw_send(coap_client_t *client, coap_msg_t *msg)
 {
-    int ret = 0;
+    ssize_t num = 0;
+    char buf[COAP_MSG_MAX_BUF_LEN] = {0};
 
-    ret = coap_client_exchange(client, req, resp);
-    if (ret < 0)
+    num = coap_msg_format(msg, buf, sizeof(buf));
+    if (num < 0)
     {
-        if (ret != -1)
-        {
-            /* a return value of -1 indicates a DTLS failure which has already been logged */
-            coap_log_error("%s", strerror(-ret));
-        }
-        return ret;
+        coap_log_error("%s", strerror(-num));
+        return num;
     }
-    print_coap_msg("Sent:", req);
-    print_coap_msg("Received:", resp);
+    num = send(client->sd, buf, num, 0);
+    if (num < 0)
+    {
+        coap_log_error("%s", strerror(errno));
+        return -errno;
+    }
+    print_coap_msg("Sent:", msg);
     return 0;
 }
 
 /**
- *  @brief Send a blockwise request to the server and receive the response
+ *  @brief Receive a message on the socket of a client without the client protocol layer
  *
- *  @param[in,out] client Pointer to a client structure
- *  @param[in] test_req Pointer to a test request message structure
- *  @param[out] req Pointer to a request message structure
- *  @param[out] resp Pointer to a response message structure
- *  @param[out] body Buffer to hold the body
- *  @param[in] body_len Length of the buffer to hold the body
+ *  The message is parsed as a view into the buffer.
  *
- *  @returns Operation status
- *  @retval >0 Length of the data sent/received
+ *  @param[in] client Pointer to a client structure
+ *  @param[out] msg Pointer to a message structure
+ *  @param[out] buf Buffer to hold the received message
+ *  @param[in] len Length of the buffer
+ *
+ *  @returns Number of bytes received or error code
+ *  @retval >0 Number of bytes received
  *  @retval <0 Error
  */
-static ssize_t exchange_blockwise(coap_client_t *client,
-                                 test_coap_client_msg_t *test_req,
-                                 coap_msg_t *req, coap_msg_t *resp,
-                                 char *body, size_t body_len, int have_resp)
+static ssize_t raw_recv(coap_client_t *client, coap_msg_t *msg, char *buf, size_t len)
 {
+    struct pollfd pfd = {0};
     ssize_t num = 0;
+    int ret = 0;
 
-    num = coap_client_exchange_blockwise(client,
-                                         req, resp,
-                                         test_req->block1_size,
-                                         test_req->block2_size,
-                                         body, body_len, have_resp);
+    pfd.fd = client->sd;
+    pfd.events = POLLIN;
+    ret = poll(&pfd, 1, TEST_RAW_TIMEOUT);
+    if (ret < 0)
+    {
+        coap_log_error("%s", strerror(errno));
+        return -errno;
+    }
+    if (ret == 0)
+    {
+        coap_log_warn("Timed out waiting for a message");
+        return -ETIMEDOUT;
+    }
+    num = recv(client->sd, buf, len, 0);
     if (num < 0)
     {
-        if (num != -1)
-        {
-            /* a return value of -1 indicates a DTLS failure which has already been logged */
-            coap_log_error("%s", strerror(-num));
-        }
-        return num;
+        coap_log_error("%s", strerror(errno));
+        return -errno;
     }
-    print_coap_msg("Sent:", req);
-    print_coap_msg("Received:", resp);
+    ret = coap_msg_parse(msg, buf, num);
+    if (ret < 0)
+    {
+        coap_log_error("%s", strerror(-ret));
+        return ret;
+    }
+    print_coap_msg("Received:", msg);
     return num;
 }
 
 /**
- *  @brief Compare the version and token fields in a request message and a response message
+ *  @brief Replay a recorded response while a confirmable response is outstanding
  *
- *  @param[out] req Pointer to a request message structure
+ *  @param[in] client Pointer to a client structure
+ *  @param[in] test_data Pointer to a client test data structure
+ *  @param[in] req1 Pointer to the request that is answered with a piggy-backed response
+ *  @param[in] req2 Pointer to the request that is answered with a separate response
+ *  @param[in,out] ack Pointer to an acknowledgement message structure
  *  @param[out] resp Pointer to a response message structure
  *
  *  @returns Test result
  */
-static test_result_t compare_ver_token(coap_msg_t *req, coap_msg_t *resp)
+static test_result_t exchange_dedup(coap_client_t *client, test_coap_client_data_t *test_data,
+                                    coap_msg_t *req1, coap_msg_t *req2, coap_msg_t *ack, coap_msg_t *resp)
 {
-    if (coap_msg_get_ver(req) != coap_msg_get_ver(resp))
+    ssize_t resp1_len = 0;
+    ssize_t resp2_len = 0;
+    ssize_t num = 0;
+    char resp1_buf[COAP_MSG_MAX_BUF_LEN] = {0};
+    char resp2_buf[COAP_MSG_MAX_BUF_LEN] = {0};
+    char buf[COAP_MSG_MAX_BUF_LEN] = {0};
+    int ret = 0;
+
+    /* piggy-backed response to the first request */
+    ret = raw_send(client, req1);
+    if (ret < 0)
     {
-        coap_log_warn("Version in request and response messages do not match");
         return FAIL;
     }
-    if (coap_msg_get_token_len(req) != coap_msg_get_token_len(resp))
+    resp1_len = raw_recv(client, resp, resp1_buf, sizeof(resp1_buf));
+    if ((resp1_len < 0)
+     || (compare_ver_token(req1, resp) != PASS)
+     || (check_resp(&test_data->test_resp[0], resp) != PASS))
     {
-        coap_log_warn("Token length in request and response messages do not match");
         return FAIL;
     }
-    else if (memcmp(coap_msg_get_token(req), coap_msg_get_token(resp), coap_msg_get_token_len(req)) != 0)
+
+    /* an acknowledgement that matches nothing recycles the transaction */
+    /* and moves the first request to the deduplication table */
+    ret = raw_send(client, ack);
+    if (ret < 0)
     {
-        coap_log_warn("Token in request and response messages do not match");
         return FAIL;
     }
-    return PASS;
-}
-
-/**
- *  @brief Check the fields in a response message against the expected values
- *
- *  @param[out] test_resp Pointer to a test response message structure
- *  @param[out] resp Pointer to a response message structure
- *
- *  @returns Test result
- */
-static test_result_t check_resp(test_coap_client_msg_t *test_resp, coap_msg_t *resp)
-{
-    test_coap_client_msg_op_t *exp_op = NULL;
-    coap_msg_op_t *resp_op = NULL;
-    unsigned match = 0;
-    unsigned i = 0;
 
-    if (test_resp->type != coap_msg_get_type(resp))
-    {
-        coap_log_warn("Unexpected type in response message");
-        coap_log_debug("Received: %d", coap_msg_get_type(resp));
-        coap_log_debug("Expected: %d", test_resp->type);
+    /* separate response to the second request */
+    ret = raw_send(client, req2);
+    if (ret < 0)
+    {
         return FAIL;
     }
-    if (test_resp->code_class != coap_msg_get_code_class(resp))
+    num = raw_recv(client, resp, buf, sizeof(buf));
+    if ((num < 0)
+     || (coap_msg_get_type(resp) != COAP_MSG_ACK)
+     || (coap_msg_get_msg_id(resp) != coap_msg_get_msg_id(req2)))
     {
-        coap_log_warn("Unexpected code class in response message");
-        coap_log_debug("Received: %d", coap_msg_get_code_class(resp));
-        coap_log_debug("Expected: %d", test_resp->code_class);
+        coap_log_warn("Expected an acknowledgement to the second request");
         return FAIL;
     }
-    if (test_resp->code_detail != coap_msg_get_code_detail(resp))
+    resp2_len = raw_recv(client, resp, resp2_buf, sizeof(resp2_buf));
+    if ((resp2_len < 0)
+     || (compare_ver_token(req2, resp) != PASS)
+     || (check_resp(&test_data->test_resp[1], resp) != PASS))
     {
-        coap_log_warn("Unexpected code detail in response message");
-        coap_log_debug("Received: %d", coap_msg_get_code_detail(resp));
-        coap_log_debug("Expected: %d", test_resp->code_detail);
         return FAIL;
     }
-    for (i = 0; i < test_resp->num_ops; i++)
+
+    /* the first request again, answered from the deduplication table */
+    ret = raw_send(client, req1);
+    if (ret < 0)
     {
-        match = 0;
-        exp_op = &test_resp->ops[i];
-        resp_op = coap_msg_get_first_op(resp);
-        while (resp_op != NULL)
-        {
-            if ((coap_msg_op_get_num(resp_op) == exp_op->num)
-             && (coap_msg_op_get_len(resp_op) == exp_op->len)
-             && (memcmp(coap_msg_op_get_val(resp_op), exp_op->val, exp_op->len) == 0))
-            {
-                match = 1;
-                break;
-            }
-            resp_op = coap_msg_op_get_next(resp_op);
-        }
-        if (!match)
-        {
-            coap_log_warn("Expected option: %d not found in response message", exp_op->num);
-            return FAIL;
-        }
+        return FAIL;
     }
-    if (test_resp->payload_len != coap_msg_get_payload_len(resp))
+    num = raw_recv(client, resp, buf, sizeof(buf));
+    if ((num != resp1_len) || (memcmp(buf, resp1_buf, num) != 0))
     {
-        coap_log_warn("Unexpected payload length in response message");
-        coap_log_debug("Received: %d", coap_msg_get_payload_len(resp));
-        coap_log_debug("Expected: %d", test_resp->payload_len);
+        coap_log_warn("Expected the recorded response to the first request");
         return FAIL;
     }
-    if ((test_resp->payload_len > 0)
-     && (memcmp(test_resp->payload, coap_msg_get_payload(resp), test_resp->payload_len)))
+
+    /* the separate response is retransmitted unchanged */
+    num = raw_recv(client, resp, buf, sizeof(buf));
+    if ((num != resp2_len) || (memcmp(buf, resp2_buf, num) != 0))
     {
-        coap_log_warn("Unexpected payload in response message");
-        coap_log_debug("Received: %s", coap_msg_get_payload(resp));
-        coap_log_debug("Expected: %s", test_resp->payload);
+        coap_log_warn("Expected a retransmission of the separate response");
         return FAIL;
     }
-    return PASS;
-}
-
-/**
- *  @brief Check the body in the response messages against the expected values
- *
- *  @param[in] test_data Pointer to a client test data structure
- *  @param[in] test_resp Pointer to a test response message structure
- *  @param[in] body Buffer to contain the expected body content
- *  @param[in] body_end Amount of relevant data in the buffer to contain the expected body content
- *
- *  @returns Test result
- */
-static test_result_t check_resp_body(test_coap_client_data_t *test_data,
-                                     test_coap_client_msg_t *test_resp,
-                                     const char *body, size_t body_end)
-{
-    if (body_end != test_resp->body_end)
+    ret = coap_msg_set_msg_id(ack, coap_msg_get_msg_id(resp));
+    if (ret < 0)
     {
-        coap_log_warn("Unexpected body length in response messages");
-        coap_log_debug("Received: %s", body_end);
-        coap_log_debug("Expected: %s", test_resp->body_end);
+        coap_log_error("%s", strerror(-ret));
         return FAIL;
     }
-    if (memcmp(body, test_data->body, test_resp->body_end) != 0)
+    ret = raw_send(client, ack);
+    if (ret < 0)
     {
-        coap_log_warn("Unexpected body in response messages");
-        coap_log_debug("Received: %s", body);
-        coap_log_debug("Expected: %s", test_data->body);
         return FAIL;
     }
     return PASS;
 }
 
 /**
- *  @brief Test an exchange with the server
+ *  @brief Test the replay of a recorded response while a confirmable response is outstanding
+ *
+ *  The first request is sent and answered with a
+ *  piggy-backed response. An unexpected acknowledgement
+ *  makes the server recycle the transaction and record
+ *  the request in its deduplication table. The second
+ *  request gets a separate confirmable response which is
+ *  left unacknowledged while the first request is sent
+ *  again. The recorded piggy-backed response and then a
+ *  retransmission of the separate response must be
+ *  received unchanged.
  *
  *  @param[in] data Pointer to a client test data structure
  *
  *  @returns Test result
  */
-static test_result_t test_exchange_func(test_data_t data)
+static test_result_t test_exchange_dedup_func(test_data_t data)
 {
     test_coap_client_data_t *test_data = (test_coap_client_data_t *)data;
     test_result_t result = PASS;
     coap_client_t client = {0};
     coap_msg_t resp = {0};
-    coap_msg_t req = {0};
-    unsigned i = 0;
+    coap_msg_t req1 = {0};
+    coap_msg_t req2 = {0};
+    coap_msg_t ack = {0};
     int ret = 0;
 
     printf("%s\n", test_data->desc);
 
-#ifdef COAP_DTLS_EN
-    ret = coap_client_create(&client,
-                             test_data->host,
-                             test_data->port,
-                             test_data->key_file_name,
-                             test_data->cert_file_name,
-                             test_data->trust_file_name,
-                             test_data->crl_file_name,
-                             test_data->common_name);
-#else
     ret = coap_client_create(&client,
                              test_data->host,
                              test_data->port);
-#endif
     if (ret < 0)
     {
-        if (ret != -1)
-        {
-            /* a return value of -1 indicates a DTLS failure which has already been logged */
-            coap_log_error("%s", strerror(-ret));
-        }
+        coap_log_error("%s", strerror(-ret));
         return FAIL;
     }
-    coap_msg_create(&req);
+    coap_msg_create(&req1);
     coap_msg_create(&resp);
-    exchange_reset(&client, &req, &resp);
+    exchange_reset(&client, &req1, &resp);
     coap_msg_destroy(&resp);
-    coap_msg_destroy(&req);
-    for (i = 0; i < test_data->num_msg; i++)
+    coap_msg_destroy(&req1);
+    coap_msg_create(&req1);
+    coap_msg_create(&req2);
+    coap_msg_create(&ack);
+    coap_msg_create(&resp);
+    ret = populate_req(&test_data->test_req[0], &req1);
+    if (ret == 0)
     {
-        coap_msg_create(&req);
-        coap_msg_create(&resp);
-        ret = populate_req(&test_data->test_req[i], &req);
-        if (ret < 0)
-        {
-            coap_msg_destroy(&resp);
-            coap_msg_destroy(&req);
-            coap_client_destroy(&client);
-            return FAIL;
-        }
-        ret = exchange(&client, &test_data->test_req[i], &req, &resp);
-        if (ret < 0)
-        {
-            coap_msg_destroy(&resp);
-            coap_msg_destroy(&req);
-            coap_client_destroy(&client);
-            return FAIL;
-        }
-        ret = compare_ver_token(&req, &resp);
-        if (ret != PASS)
-        {
-            coap_msg_destroy(&resp);
-            coap_msg_destroy(&req);
-            coap_client_destroy(&client);
-            return ret;
-        }
-        ret = check_resp(&test_data->test_resp[i], &resp);
-        if (ret != PASS)
-        {
-            coap_msg_destroy(&resp);
-            coap_msg_destroy(&req);
-            coap_client_destroy(&client);
-            return ret;
-        }
-        coap_msg_destroy(&resp);
-        coap_msg_destroy(&req);
+        ret = coap_msg_set_msg_id(&req1, TEST_RAW_MSG_ID);
+    }
+    if (ret == 0)
+    {
+        ret = coap_msg_set_token(&req1, "\x01\x02", 2);
+    }
+    if (ret == 0)
+    {
+        ret = populate_req(&test_data->test_req[1], &req2);
+    }
+    if (ret == 0)
+    {
+        ret = coap_msg_set_msg_id(&req2, TEST_RAW_MSG_ID + 1);
+    }
+    if (ret == 0)
+    {
+        ret = coap_msg_set_token(&req2, "\x03\x04", 2);
+    }
+    if (ret == 0)
+    {
+        ret = coap_msg_set_type(&ack, COAP_MSG_ACK);
+    }
+    if (ret == 0)
+    {
+        ret = coap_msg_set_msg_id(&ack, TEST_RAW_MSG_ID + 2);
+    }
+    if (ret < 0)
+    {
+        coap_log_error("%s", strerror(-ret));
+        result = FAIL;
+    }
+    else
+    {
+        result = exchange_dedup(&client, test_data, &req1, &req2, &ack, &resp);
     }
+    coap_msg_destroy(&resp);
+    coap_msg_destroy(&ack);
+    coap_msg_destroy(&req2);
+    coap_msg_destroy(&req1);
     coap_client_destroy(&client);
     return result;
 }
 
+#endif  /* !COAP_DTLS_EN */
+
 /**
- *  @brief Test an exchange with the server using library-level blockwise transfers
+ *  @brief Test an exchange with the server using different transfer types
  *
  *  @param[in] data Pointer to a client test data structure
- *  @param[in] index Message index
  *
  *  @returns Test result
  */
-static test_result_t test_exchange_blockwise_func(test_data_t data)
+static test_result_t test_exchange_different_func(test_data_t data)
 {
     test_coap_client_data_t *test_data = (test_coap_client_data_t *)data;
     test_result_t result = PASS;
     coap_client_t client = {0};
     coap_msg_t resp = {0};
     coap_msg_t req = {0};
+    unsigned block2_size = 0;
+    unsigned block2_more = 0;
+    unsigned block2_num = 0;
     unsigned i = 0;
     ssize_t num = 0;
-    size_t body_len = 0;
     char body[test_data->body_len];
     int ret = 0;
 
@@ -2612,7 +5301,6 @@ static test_result_t test_exchange_blockwise_func(test_data_t data)
     {
         coap_msg_create(&req);
         coap_msg_create(&resp);
-        memset(body, 0, sizeof(body));
         ret = populate_req(&test_data->test_req[i], &req);
         if (ret < 0)
         {
@@ -2621,21 +5309,29 @@ static test_result_t test_exchange_blockwise_func(test_data_t data)
             coap_client_destroy(&client);
             return FAIL;
         }
-        if (test_data->test_req[i].code_detail == COAP_MSG_GET)
+        /* try using a regular transfer */
+        ret = exchange(&client, &test_data->test_req[i], &req, &resp);
+        if (ret < 0)
         {
-            memset(body, 0, sizeof(body));
-            body_len = sizeof(body);
+            coap_msg_destroy(&resp);
+            coap_msg_destroy(&req);
+            coap_client_destroy(&client);
+            return FAIL;
         }
-        else if ((test_data->test_req[i].code_detail == COAP_MSG_PUT)
-              || (test_data->test_req[i].code_detail == COAP_MSG_POST))
+        /* inspect the block2 option in the response */
+        ret = coap_msg_parse_block_op(&block2_num, &block2_more, &block2_size, &resp, COAP_MSG_BLOCK2);
+        if (ret != 0)
         {
-            memcpy(body, test_data->body, test_data->body_len);
-            body_len = test_data->body_len;
+            coap_msg_destroy(&resp);
+            coap_msg_destroy(&req);
+            coap_client_destroy(&client);
+            return FAIL;
         }
+        /* continue using a blockwise transfer */
         num = exchange_blockwise(&client,
                                  &test_data->test_req[i],
                                  &req, &resp,
-                                 body, body_len, 0);
+                                 body, sizeof(body), 1);
         if (num < 0)
         {
             coap_msg_destroy(&resp);
@@ -2651,14 +5347,6 @@ static test_result_t test_exchange_blockwise_func(test_data_t data)
             coap_client_destroy(&client);
             return ret;
         }
-        ret = check_resp_body(test_data, &test_data->test_resp[i], body, num);
-        if (ret != PASS)
-        {
-            coap_msg_destroy(&resp);
-            coap_msg_destroy(&req);
-            coap_client_destroy(&client);
-            return ret;
-        }
         coap_msg_destroy(&resp);
         coap_msg_destroy(&req);
     }
@@ -2667,25 +5355,28 @@ static test_result_t test_exchange_blockwise_func(test_data_t data)
 }
 
 /**
- *  @brief Test an exchange with the server using different transfer types
+ *  @brief Test requests for the server statistics
+ *
+ *  The payload of each response must start with the
+ *  expected payload and the request counter that follows
+ *  must be larger than in the previous response.
  *
  *  @param[in] data Pointer to a client test data structure
  *
  *  @returns Test result
  */
-static test_result_t test_exchange_different_func(test_data_t data)
+static test_result_t test_exchange_stats_func(test_data_t data)
 {
     test_coap_client_data_t *test_data = (test_coap_client_data_t *)data;
+    test_coap_client_msg_t test_resp = {0};
+    unsigned long long num_req = 0;
+    unsigned long long prev = 0;
     test_result_t result = PASS;
     coap_client_t client = {0};
     coap_msg_t resp = {0};
     coap_msg_t req = {0};
-    unsigned block2_size = 0;
-    unsigned block2_more = 0;
-    unsigned block2_num = 0;
     unsigned i = 0;
-    ssize_t num = 0;
-    char body[test_data->body_len];
+    char buf[COAP_MSG_MAX_PAYLOAD_LEN + 1] = {0};
     int ret = 0;
 
     printf("%s\n", test_data->desc);
@@ -2730,7 +5421,6 @@ static test_result_t test_exchange_different_func(test_data_t data)
             coap_client_destroy(&client);
             return FAIL;
         }
-        /* try using a regular transfer */
         ret = exchange(&client, &test_data->test_req[i], &req, &resp);
         if (ret < 0)
         {
@@ -2739,28 +5429,29 @@ static test_result_t test_exchange_different_func(test_data_t data)
             coap_client_destroy(&client);
             return FAIL;
         }
-        /* inspect the block2 option in the response */
-        ret = coap_msg_parse_block_op(&block2_num, &block2_more, &block2_size, &resp, COAP_MSG_BLOCK2);
-        if (ret != 0)
+        ret = compare_ver_token(&req, &resp);
+        if (ret != PASS)
         {
             coap_msg_destroy(&resp);
             coap_msg_destroy(&req);
             coap_client_destroy(&client);
-            return FAIL;
+            return ret;
         }
-        /* continue using a blockwise transfer */
-        num = exchange_blockwise(&client,
-                                 &test_data->test_req[i],
-                                 &req, &resp,
-                                 body, sizeof(body), 1);
-        if (num < 0)
+        test_resp = test_data->test_resp[i];
+        if ((coap_msg_get_payload_len(&resp) < test_resp.payload_len)
+         || (memcmp(coap_msg_get_payload(&resp), test_resp.payload, test_resp.payload_len) != 0))
         {
+            coap_log_warn("Unexpected payload in response message");
             coap_msg_destroy(&resp);
             coap_msg_destroy(&req);
             coap_client_destroy(&client);
             return FAIL;
         }
-        ret = check_resp(&test_data->test_resp[i], &resp);
+        memcpy(buf, coap_msg_get_payload(&resp), coap_msg_get_payload_len(&resp));
+        buf[coap_msg_get_payload_len(&resp)] = '\0';
+        test_resp.payload = buf;
+        test_resp.payload_len = coap_msg_get_payload_len(&resp);
+        ret = check_resp(&test_resp, &resp);
         if (ret != PASS)
         {
             coap_msg_destroy(&resp);
@@ -2768,6 +5459,16 @@ static test_result_t test_exchange_different_func(test_data_t data)
             coap_client_destroy(&client);
             return ret;
         }
+        num_req = strtoull(buf + test_data->test_resp[i].payload_len, NULL, 10);
+        if ((i > 0) && (num_req <= prev))
+        {
+            coap_log_warn("Request counter did not increase");
+            coap_msg_destroy(&resp);
+            coap_msg_destroy(&req);
+            coap_client_destroy(&client);
+            return FAIL;
+        }
+        prev = num_req;
         coap_msg_destroy(&resp);
         coap_msg_destroy(&req);
     }
@@ -2826,7 +5527,25 @@ int main(int argc, char **argv)
                       {test_exchange_blockwise_func, &test17_data},
                       {test_exchange_blockwise_func, &test18_data},
                       {test_exchange_func,           &test19_data},
-                      {test_exchange_func,           &test20_data}};
+                      {test_exchange_func,           &test20_data},
+                      {test_exchange_async_func,     &test21_data},
+                      {test_exchange_async_func,     &test22_data},
+                      {test_exchange_blockwise_func, &test23_data},
+                      {test_exchange_blockwise_func, &test24_data},
+                      {test_exchange_blockwise_func, &test25_data},
+                      {test_exchange_blockwise_func, &test26_data},
+                      {test_exchange_stream_func,    &test27_data},
+                      {test_exchange_stream_func,    &test28_data},
+                      {test_exchange_observe_func,   &test29_data},
+                      {test_exchange_func,           &test30_data},
+                      {test_exchange_stats_func,     &test31_data},
+                      {test_exchange_clients_func,   &test32_data},
+                      {test_exchange_func,           &test33_data},
+                      {test_exchange_func,           &test34_data},
+#ifndef COAP_DTLS_EN
+                      {test_exchange_dedup_func,     &test35_data}
+#endif
+                     };
 
     opterr = 0;
     while ((c = getopt(argc, argv, opts)) != -1)
@@ -2856,6 +5575,7 @@ int main(int argc, char **argv)
     }
 
     coap_log_set_level(log_level);
+    test_stream_body_init();
     ret = coap_mem_all_create(SMALL_BUF_NUM, SMALL_BUF_LEN,
                               MEDIUM_BUF_NUM, MEDIUM_BUF_LEN,
                               LARGE_BUF_NUM, LARGE_BUF_LEN);
@@ -2958,8 +5678,70 @@ int main(int argc, char **argv)
         num_tests = 1;
         num_pass = test_run(&tests[19], num_tests);
         break;
+    case 21:
+        num_tests = 1;
+        num_pass = test_run(&tests[20], num_tests);
+        break;
+    case 22:
+        num_tests = 1;
+        num_pass = test_run(&tests[21], num_tests);
+        break;
+    case 23:
+        num_tests = 1;
+        num_pass = test_run(&tests[22], num_tests);
+        break;
+    case 24:
+        num_tests = 1;
+        num_pass = test_run(&tests[23], num_tests);
+        break;
+    case 25:
+        num_tests = 1;
+        num_pass = test_run(&tests[24], num_tests);
+        break;
+    case 26:
+        num_tests = 1;
+        num_pass = test_run(&tests[25], num_tests);
+        break;
+    case 27:
+        num_tests = 1;
+        num_pass = test_run(&tests[26], num_tests);
+        break;
+    case 28:
+        num_tests = 1;
+        num_pass = test_run(&tests[27], num_tests);
+        break;
+    case 29:
+        num_tests = 1;
+        num_pass = test_run(&tests[28], num_tests);
+        break;
+    case 30:
+        num_tests = 1;
+        num_pass = test_run(&tests[29], num_tests);
+        break;
+    case 31:
+        num_tests = 1;
+        num_pass = test_run(&tests[30], num_tests);
+        break;
+    case 32:
+        num_tests = 1;
+        num_pass = test_run(&tests[31], num_tests);
+        break;
+    case 33:
+        num_tests = 1;
+        num_pass = test_run(&tests[32], num_tests);
+        break;
+    case 34:
+        num_tests = 1;
+        num_pass = test_run(&tests[33], num_tests);
+        break;
+#ifndef COAP_DTLS_EN
+    case 35:
+        num_tests = 1;
+        num_pass = test_run(&tests[34], num_tests);
+        break;
+#endif
     default:
-        num_tests = 20;
+        num_tests = sizeof(tests) / sizeof(tests[0]);
         num_pass = test_run(tests, num_tests);
     }
     coap_mem_all_destroy();
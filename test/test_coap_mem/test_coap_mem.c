@@ -35,12 +35,22 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#ifdef COAP_MEM_THREAD_EN
+#include <pthread.h>
+#endif
 #include <coap_mem.h>
 #include "coap_log.h"
 #include "test.h"
 
 #define DIM(x) (sizeof(x) / sizeof(x[0]))                                       /**< Calculate the size of an array */
 
+#ifdef COAP_MEM_THREAD_EN
+#define TEST_COAP_MEM_NUM_THREADS    8                                          /**< Number of threads in the multi-threaded test */
+#define TEST_COAP_MEM_NUM_ITER       10000                                      /**< Number of iterations per thread in the multi-threaded test */
+#define TEST_COAP_MEM_NUM_BUFS       8                                          /**< Number of buffers held at once by each thread in the multi-threaded test */
+#define TEST_COAP_MEM_NUM_EXHAUST    4                                          /**< Number of threads in the multi-threaded exhaustion test */
+#endif
+
 /**
  *  @brief Memory allocator test data structure
  */
@@ -192,6 +202,36 @@ test_coap_mem_data_t test20_coap_mem_data =
     .len = 0
 };
 
+test_coap_mem_data_t test21_coap_mem_data =
+{
+    .desc = "test 21: free and reallocate buffers in a memory allocator with 4096 buffers of 8 bytes each",
+    .num = 4096,
+    .len = 8
+};
+
+test_coap_mem_data_t test22_coap_mem_data =
+{
+    .desc = "test 22: attempt to free invalid buffers in a memory allocator with 16 buffers of 8 bytes each",
+    .num = 16,
+    .len = 8
+};
+
+#ifdef COAP_MEM_THREAD_EN
+test_coap_mem_data_t test23_coap_mem_data =
+{
+    .desc = "test 23: allocate and free buffers from the small memory allocator with 256 buffers of 16 bytes each in 8 threads",
+    .num = 256,
+    .len = 16
+};
+
+test_coap_mem_data_t test24_coap_mem_data =
+{
+    .desc = "test 24: allocate all of the buffers in the small memory allocator with 64 buffers of 16 bytes each from 4 threads with filled caches",
+    .num = 64,
+    .len = 16
+};
+#endif
+
 /**
  *  @brief Coap memory allocator test function
  *
@@ -382,6 +422,173 @@ static test_result_t test_coap_mem_invalid_func(test_data_t data)
     return result;
 }
 
+/**
+ *  @brief Coap memory allocator free list test function
+ *
+ *  Allocate every buffer, free every other buffer and check
+ *  that the freed buffers are reallocated in reverse order.
+ *
+ *  @param[in] data Pointer to a memory allocator test data structure
+ *
+ *  @returns Test result
+ */
+static test_result_t test_coap_mem_free_list_func(test_data_t data)
+{
+    test_coap_mem_data_t *test_data = (test_coap_mem_data_t *)data;
+    coap_mem_t mem = {0};
+    test_result_t result = PASS;
+    unsigned char mask = 0;
+    size_t i = 0;
+    char *p[test_data->num];
+    char *q = NULL;
+    int ret = 0;
+
+    printf("%s\n", test_data->desc);
+    memset(p, 0, sizeof(p));
+    ret = coap_mem_create(&mem, test_data->num, test_data->len);
+    if (ret < 0)
+    {
+        coap_log_error("Failed to create memory allocator");
+        return FAIL;
+    }
+    /* allocate buffers */
+    for (i = 0; i < test_data->num; i++)
+    {
+        p[i] = (char *)coap_mem_alloc(&mem, test_data->len);
+        if (p[i] != coap_mem_get_buf(&mem) + i * test_data->len)
+        {
+            coap_log_error("Unexpected buffer allocated");
+            coap_mem_destroy(&mem);
+            return FAIL;
+        }
+    }
+    if (coap_mem_get_free_num(&mem) != 0)
+    {
+        coap_log_error("Incorrect number of free buffers after allocation");
+        coap_mem_destroy(&mem);
+        return FAIL;
+    }
+    /* free every other buffer */
+    for (i = 1; i < test_data->num; i += 2)
+    {
+        coap_mem_free(&mem, p[i]);
+    }
+    if (coap_mem_get_free_num(&mem) != test_data->num / 2)
+    {
+        coap_log_error("Incorrect number of free buffers after free");
+        coap_mem_destroy(&mem);
+        return FAIL;
+    }
+    for (i = 0; i < test_data->num; i++)
+    {
+        mask = (1 << (i & 0x7));
+        if (((coap_mem_get_active(&mem)[i >> 3] & mask) != 0) != ((i & 1) == 0))
+        {
+            coap_log_error("Incorrect active bitset encountered after buffer free");
+            coap_mem_destroy(&mem);
+            return FAIL;
+        }
+    }
+    /* the most recently freed buffer is allocated first */
+    for (i = test_data->num - 1; i < test_data->num; i -= 2)
+    {
+        q = (char *)coap_mem_alloc(&mem, test_data->len);
+        if (q != p[i])
+        {
+            coap_log_error("Unexpected buffer reallocated");
+            coap_mem_destroy(&mem);
+            return FAIL;
+        }
+    }
+    q = (char *)coap_mem_alloc(&mem, test_data->len);
+    if (q != NULL)
+    {
+        coap_log_error("Too many buffers allocated");
+        coap_mem_destroy(&mem);
+        return FAIL;
+    }
+    /* free buffers */
+    for (i = 0; i < test_data->num; i++)
+    {
+        coap_mem_free(&mem, p[i]);
+    }
+    if (coap_mem_get_free_num(&mem) != test_data->num)
+    {
+        coap_log_error("Incorrect number of free buffers after free");
+        result = FAIL;
+    }
+    for (i = 0; i < coap_mem_get_active_len(&mem); i++)
+    {
+        if (coap_mem_get_active(&mem)[i] != 0)
+        {
+            coap_log_error("Incorrect active bitset encountered after buffer free");
+            result = FAIL;
+        }
+    }
+    coap_mem_destroy(&mem);
+    return result;
+}
+
+/**
+ *  @brief Coap memory allocator invalid free test function
+ *
+ *  Check that pointers that do not refer to an active
+ *  buffer in the memory allocator are ignored.
+ *
+ *  @param[in] data Pointer to a memory allocator test data structure
+ *
+ *  @returns Test result
+ */
+static test_result_t test_coap_mem_free_invalid_func(test_data_t data)
+{
+    test_coap_mem_data_t *test_data = (test_coap_mem_data_t *)data;
+    coap_mem_t mem = {0};
+    test_result_t result = PASS;
+    char active[test_data->num >> 3];
+    char other[test_data->len];
+    char *p = NULL;
+    char *q = NULL;
+    int ret = 0;
+
+    printf("%s\n", test_data->desc);
+    ret = coap_mem_create(&mem, test_data->num, test_data->len);
+    if (ret < 0)
+    {
+        coap_log_error("Failed to create memory allocator");
+        return FAIL;
+    }
+    p = (char *)coap_mem_alloc(&mem, test_data->len);
+    q = (char *)coap_mem_alloc(&mem, test_data->len);
+    if ((p == NULL) || (q == NULL))
+    {
+        coap_log_error("Failed to allocate buffer");
+        coap_mem_destroy(&mem);
+        return FAIL;
+    }
+    memcpy(active, coap_mem_get_active(&mem), sizeof(active));
+    coap_mem_free(&mem, NULL);
+    coap_mem_free(&mem, other);
+    coap_mem_free(&mem, p + 1);
+    coap_mem_free(&mem, coap_mem_get_buf(&mem) + test_data->num * test_data->len);
+    if ((coap_mem_get_free_num(&mem) != test_data->num - 2)
+     || (memcmp(coap_mem_get_active(&mem), active, sizeof(active)) != 0))
+    {
+        coap_log_error("Invalid buffer freed");
+        result = FAIL;
+    }
+    /* free the same buffer twice */
+    coap_mem_free(&mem, p);
+    coap_mem_free(&mem, p);
+    if (coap_mem_get_free_num(&mem) != test_data->num - 1)
+    {
+        coap_log_error("Buffer freed twice");
+        result = FAIL;
+    }
+    coap_mem_free(&mem, q);
+    coap_mem_destroy(&mem);
+    return result;
+}
+
 /**
  *  @brief Coap small memory allocator test function
  *
@@ -946,6 +1153,301 @@ static test_result_t test_coap_mem_large_invalid_func(test_data_t data)
     return result;
 }
 
+#ifdef COAP_MEM_THREAD_EN
+
+/**
+ *  @brief Multi-threaded test thread data structure
+ */
+typedef struct
+{
+    test_coap_mem_data_t *test_data;                                            /**< Pointer to a memory allocator test data structure */
+    char id;                                                                    /**< Value written to each buffer allocated by the thread */
+    test_result_t result;                                                       /**< Thread result */
+}
+test_coap_mem_thread_data_t;
+
+/**
+ *  @brief Multi-threaded test thread function
+ *
+ *  Repeatedly allocate a number of buffers from the small memory
+ *  allocator, fill them with a value unique to the thread, check
+ *  that no other thread has written to them and free them.
+ *
+ *  @param[in,out] data Pointer to a multi-threaded test thread data structure
+ *
+ *  @returns NULL
+ */
+static void *test_coap_mem_thread_func(void *data)
+{
+    test_coap_mem_thread_data_t *thread_data = (test_coap_mem_thread_data_t *)data;
+    size_t len = thread_data->test_data->len;
+    size_t i = 0;
+    size_t j = 0;
+    size_t k = 0;
+    char *p[TEST_COAP_MEM_NUM_BUFS];
+
+    for (i = 0; i < TEST_COAP_MEM_NUM_ITER; i++)
+    {
+        for (j = 0; j < TEST_COAP_MEM_NUM_BUFS; j++)
+        {
+            p[j] = (char *)coap_mem_small_alloc(len);
+            if (p[j] != NULL)
+            {
+                memset(p[j], thread_data->id, len);
+            }
+        }
+        for (j = 0; j < TEST_COAP_MEM_NUM_BUFS; j++)
+        {
+            if (p[j] != NULL)
+            {
+                for (k = 0; k < len; k++)
+                {
+                    if (p[j][k] != thread_data->id)
+                    {
+                        thread_data->result = FAIL;
+                    }
+                }
+                coap_mem_small_free(p[j]);
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ *  @brief Coap small memory allocator multi-threaded test function
+ *
+ *  @param[in] data Pointer to a memory allocator test data structure
+ *
+ *  @returns Test result
+ */
+static test_result_t test_coap_mem_small_thread_func(test_data_t data)
+{
+    test_coap_mem_thread_data_t thread_data[TEST_COAP_MEM_NUM_THREADS];
+    test_coap_mem_data_t *test_data = (test_coap_mem_data_t *)data;
+    test_result_t result = PASS;
+    pthread_t thread[TEST_COAP_MEM_NUM_THREADS];
+    size_t i = 0;
+    char *p[test_data->num];
+    char *q = NULL;
+    int ret = 0;
+
+    printf("%s\n", test_data->desc);
+    ret = coap_mem_small_create(test_data->num, test_data->len);
+    if (ret < 0)
+    {
+        coap_log_error("Failed to create memory allocator");
+        return FAIL;
+    }
+    for (i = 0; i < TEST_COAP_MEM_NUM_THREADS; i++)
+    {
+        thread_data[i].test_data = test_data;
+        thread_data[i].id = (char)(i + 1);
+        thread_data[i].result = PASS;
+        ret = pthread_create(&thread[i], NULL, test_coap_mem_thread_func, &thread_data[i]);
+        if (ret != 0)
+        {
+            coap_log_error("Failed to create thread");
+            while (i-- > 0)
+            {
+                pthread_join(thread[i], NULL);
+            }
+            coap_mem_small_destroy();
+            return FAIL;
+        }
+    }
+    for (i = 0; i < TEST_COAP_MEM_NUM_THREADS; i++)
+    {
+        pthread_join(thread[i], NULL);
+        if (thread_data[i].result != PASS)
+        {
+            coap_log_error("Buffer shared between threads");
+            result = FAIL;
+        }
+    }
+    /* the threads must have returned all of their buffers on exit */
+    for (i = 0; i < coap_mem_small_get_active_len(); i++)
+    {
+        if (coap_mem_small_get_active()[i] != 0)
+        {
+            coap_log_error("Incorrect active bitset encountered after threads exited");
+            result = FAIL;
+        }
+    }
+    for (i = 0; i < test_data->num; i++)
+    {
+        p[i] = (char *)coap_mem_small_alloc(test_data->len);
+        if (p[i] == NULL)
+        {
+            coap_log_error("Failed to allocate buffer");
+            result = FAIL;
+        }
+    }
+    q = (char *)coap_mem_small_alloc(test_data->len);
+    if (q != NULL)
+    {
+        coap_log_error("Too many buffers allocated");
+        result = FAIL;
+    }
+    for (i = 0; i < test_data->num; i++)
+    {
+        coap_mem_small_free(p[i]);
+    }
+    coap_mem_small_destroy();
+    return result;
+}
+
+/**
+ *  @brief Multi-threaded exhaustion test thread data structure
+ */
+typedef struct
+{
+    test_coap_mem_data_t *test_data;                                            /**< Pointer to a memory allocator test data structure */
+    pthread_barrier_t *barrier;                                                 /**< Barrier shared by the threads */
+    size_t id;                                                                  /**< Index of the thread */
+    test_result_t result;                                                       /**< Thread result */
+}
+test_coap_mem_exhaust_data_t;
+
+/**
+ *  @brief Multi-threaded exhaustion test thread function
+ *
+ *  Fill the thread's cache, then allocate a share of the
+ *  small memory allocator at the same time as the other
+ *  threads, then let the first thread allocate all of it
+ *  while the caches of the other threads are full. Every
+ *  allocation must succeed as long as a buffer is free in
+ *  any cache.
+ *
+ *  @param[in,out] data Pointer to a multi-threaded exhaustion test thread data structure
+ *
+ *  @returns NULL
+ */
+static void *test_coap_mem_exhaust_thread_func(void *data)
+{
+    test_coap_mem_exhaust_data_t *thread_data = (test_coap_mem_exhaust_data_t *)data;
+    size_t share = thread_data->test_data->num / TEST_COAP_MEM_NUM_EXHAUST;
+    size_t num = thread_data->test_data->num;
+    size_t len = thread_data->test_data->len;
+    size_t i = 0;
+    char *p[num];
+    char *q = NULL;
+
+    /* fill the cache of this thread */
+    for (i = 0; i < 2; i++)
+    {
+        p[i] = (char *)coap_mem_small_alloc(len);
+    }
+    for (i = 0; i < 2; i++)
+    {
+        coap_mem_small_free(p[i]);
+    }
+    pthread_barrier_wait(thread_data->barrier);
+
+    /* allocate a share of the memory allocator in each thread */
+    for (i = 0; i < share; i++)
+    {
+        p[i] = (char *)coap_mem_small_alloc(len);
+        if (p[i] == NULL)
+        {
+            thread_data->result = FAIL;
+        }
+    }
+    pthread_barrier_wait(thread_data->barrier);
+    for (i = 0; i < share; i++)
+    {
+        coap_mem_small_free(p[i]);
+    }
+    pthread_barrier_wait(thread_data->barrier);
+
+    /* allocate the whole memory allocator in the first thread */
+    if (thread_data->id == 0)
+    {
+        for (i = 0; i < num; i++)
+        {
+            p[i] = (char *)coap_mem_small_alloc(len);
+            if (p[i] == NULL)
+            {
+                thread_data->result = FAIL;
+            }
+        }
+        q = (char *)coap_mem_small_alloc(len);
+        if (q != NULL)
+        {
+            thread_data->result = FAIL;
+        }
+        for (i = 0; i < num; i++)
+        {
+            coap_mem_small_free(p[i]);
+        }
+    }
+    pthread_barrier_wait(thread_data->barrier);
+    return NULL;
+}
+
+/**
+ *  @brief Coap small memory allocator multi-threaded exhaustion test function
+ *
+ *  @param[in] data Pointer to a memory allocator test data structure
+ *
+ *  @returns Test result
+ */
+static test_result_t test_coap_mem_small_exhaust_func(test_data_t data)
+{
+    test_coap_mem_exhaust_data_t thread_data[TEST_COAP_MEM_NUM_EXHAUST];
+    test_coap_mem_data_t *test_data = (test_coap_mem_data_t *)data;
+    test_result_t result = PASS;
+    pthread_barrier_t barrier;
+    pthread_t thread[TEST_COAP_MEM_NUM_EXHAUST];
+    size_t i = 0;
+    int ret = 0;
+
+    printf("%s\n", test_data->desc);
+    ret = coap_mem_small_create(test_data->num, test_data->len);
+    if (ret < 0)
+    {
+        coap_log_error("Failed to create memory allocator");
+        return FAIL;
+    }
+    pthread_barrier_init(&barrier, NULL, TEST_COAP_MEM_NUM_EXHAUST);
+    for (i = 0; i < TEST_COAP_MEM_NUM_EXHAUST; i++)
+    {
+        thread_data[i].test_data = test_data;
+        thread_data[i].barrier = &barrier;
+        thread_data[i].id = i;
+        thread_data[i].result = PASS;
+        ret = pthread_create(&thread[i], NULL, test_coap_mem_exhaust_thread_func, &thread_data[i]);
+        if (ret != 0)
+        {
+            /* the threads already created cannot pass the barrier */
+            coap_log_error("Failed to create thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (i = 0; i < TEST_COAP_MEM_NUM_EXHAUST; i++)
+    {
+        pthread_join(thread[i], NULL);
+        if (thread_data[i].result != PASS)
+        {
+            coap_log_error("Failed to allocate a free buffer held in the cache of another thread");
+            result = FAIL;
+        }
+    }
+    pthread_barrier_destroy(&barrier);
+    for (i = 0; i < coap_mem_small_get_active_len(); i++)
+    {
+        if (coap_mem_small_get_active()[i] != 0)
+        {
+            coap_log_error("Incorrect active bitset encountered after threads exited");
+            result = FAIL;
+        }
+    }
+    coap_mem_small_destroy();
+    return result;
+}
+
+#endif  /* COAP_MEM_THREAD_EN */
+
 /**
  *  @brief Coap all memory allocators test function
  *
@@ -1025,7 +1527,14 @@ int main(void)
                       {test_coap_mem_all_func,            &test17_coap_mem_data},
                       {test_coap_mem_all_invalid_func,    &test18_coap_mem_data},
                       {test_coap_mem_all_invalid_func,    &test19_coap_mem_data},
-                      {test_coap_mem_all_invalid_func,    &test20_coap_mem_data}};
+                      {test_coap_mem_all_invalid_func,    &test20_coap_mem_data},
+                      {test_coap_mem_free_list_func,      &test21_coap_mem_data},
+                      {test_coap_mem_free_invalid_func,   &test22_coap_mem_data},
+#ifdef COAP_MEM_THREAD_EN
+                      {test_coap_mem_small_thread_func,   &test23_coap_mem_data},
+                      {test_coap_mem_small_exhaust_func,  &test24_coap_mem_data},
+#endif
+                     };
     unsigned num_tests = DIM(tests);
     unsigned num_pass = 0;
 
@@ -63,6 +63,7 @@ typedef struct
     unsigned block_num;                                                         /**< Block number for Block1 or Block2 option */
     unsigned block_more;                                                        /**< More value for Block1 or Block2 option */
     unsigned block_size;                                                        /**< Block size (in bytes) for Block1 or Block2 option */
+    unsigned uint_val;                                                          /**< Value for an unsigned integer option */
 }
 test_coap_msg_op_t;
 
@@ -78,6 +79,8 @@ typedef struct
     const char *check_critical_desc;                                            /**< Test description for the check critical options test */
     const char *check_unsafe_desc;                                              /**< Test description for the check unsafe options test */
     const char *uri_path_to_str_desc;                                           /**< Test description for the URI path to string representation test */
+    const char *parse_inline_desc;                                              /**< Test description for the parse with inline options test */
+    const char *parse_view_desc;                                                /**< Test description for the parse view test */
     ssize_t parse_ret;                                                          /**< Expected return value for the parse function */
     int set_type_ret;                                                           /**< Expected return value for the set type function */
     int set_code_ret;                                                           /**< Expected return value for the set code function */
@@ -91,6 +94,8 @@ typedef struct
     unsigned check_critical_ops_ret;                                            /**< Expected return value for the check critical options function */
     unsigned check_unsafe_ops_ret;                                              /**< Expected return value for the check unsafe options function */
     size_t uri_path_to_str_ret;                                                 /**< Expected return value for the URI path to string function */
+    unsigned small_alloc_num;                                                   /**< Expected number of small buffers allocated by the parse function */
+    unsigned medium_alloc_num;                                                  /**< Expected number of medium buffers allocated by the parse function */
     char *buf;                                                                  /**< Buffer containing a message */
     size_t buf_len;                                                             /**< Length of the buffer containing a message */
     unsigned ver;                                                               /**< CoAP version */
@@ -159,6 +164,8 @@ test_coap_msg_data_t test1_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = "test 98: parse CoAP message view with token, with options, with payload",
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -172,6 +179,8 @@ test_coap_msg_data_t test1_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = test1_buf,
     .buf_len = TEST1_BUF_LEN,
     .ver = COAP_MSG_VER,
@@ -236,6 +245,8 @@ test_coap_msg_data_t test2_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -249,6 +260,8 @@ test_coap_msg_data_t test2_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = test2_buf,
     .buf_len = TEST2_BUF_LEN,
     .ver = COAP_MSG_VER,
@@ -287,6 +300,8 @@ test_coap_msg_data_t test3_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -300,6 +315,8 @@ test_coap_msg_data_t test3_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = test3_buf,
     .buf_len = TEST3_BUF_LEN,
     .ver = COAP_MSG_VER,
@@ -363,6 +380,8 @@ test_coap_msg_data_t test4_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -376,6 +395,8 @@ test_coap_msg_data_t test4_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = test4_buf,
     .buf_len = TEST4_BUF_LEN,
     .ver = COAP_MSG_VER,
@@ -411,6 +432,8 @@ test_coap_msg_data_t test5_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -424,6 +447,8 @@ test_coap_msg_data_t test5_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = test5_buf,
     .buf_len = TEST5_BUF_LEN,
     .ver = COAP_MSG_VER,
@@ -484,6 +509,8 @@ test_coap_msg_data_t test6_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -497,6 +524,8 @@ test_coap_msg_data_t test6_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = test6_buf,
     .buf_len = TEST6_BUF_LEN,
     .ver = COAP_MSG_VER,
@@ -531,6 +560,8 @@ test_coap_msg_data_t test7_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -544,6 +575,8 @@ test_coap_msg_data_t test7_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = test7_buf,
     .buf_len = TEST7_BUF_LEN,
     .ver = COAP_MSG_VER,
@@ -575,6 +608,8 @@ test_coap_msg_data_t test8_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -588,6 +623,8 @@ test_coap_msg_data_t test8_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = test8_buf,
     .buf_len = TEST8_BUF_LEN,
     .ver = COAP_MSG_VER,
@@ -655,6 +692,8 @@ test_coap_msg_data_t test9_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -668,6 +707,8 @@ test_coap_msg_data_t test9_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = test9_buf,
     .buf_len = TEST9_BUF_LEN,
     .ver = COAP_MSG_VER,
@@ -735,6 +776,8 @@ test_coap_msg_data_t test10_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -748,6 +791,8 @@ test_coap_msg_data_t test10_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = test10_buf,
     .buf_len = TEST10_BUF_LEN,
     .ver = COAP_MSG_VER,
@@ -815,6 +860,8 @@ test_coap_msg_data_t test11_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -828,6 +875,8 @@ test_coap_msg_data_t test11_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = test11_buf,
     .buf_len = TEST11_BUF_LEN,
     .ver = COAP_MSG_VER,
@@ -895,6 +944,8 @@ test_coap_msg_data_t test12_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -908,6 +959,8 @@ test_coap_msg_data_t test12_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = test12_buf,
     .buf_len = TEST12_BUF_LEN,
     .ver = COAP_MSG_VER,
@@ -975,6 +1028,8 @@ test_coap_msg_data_t test13_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -988,6 +1043,8 @@ test_coap_msg_data_t test13_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = test13_buf,
     .buf_len = TEST13_BUF_LEN,
     .ver = COAP_MSG_VER,
@@ -1055,6 +1112,8 @@ test_coap_msg_data_t test14_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -1068,6 +1127,8 @@ test_coap_msg_data_t test14_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = test14_buf,
     .buf_len = TEST14_BUF_LEN,
     .ver = COAP_MSG_VER,
@@ -1135,6 +1196,8 @@ test_coap_msg_data_t test15_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -1148,6 +1211,8 @@ test_coap_msg_data_t test15_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = test15_buf,
     .buf_len = TEST15_BUF_LEN,
     .ver = COAP_MSG_VER,
@@ -1215,6 +1280,8 @@ test_coap_msg_data_t test16_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -1228,6 +1295,8 @@ test_coap_msg_data_t test16_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = test16_buf,
     .buf_len = TEST16_BUF_LEN,
     .ver = COAP_MSG_VER,
@@ -1259,6 +1328,8 @@ test_coap_msg_data_t test17_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = -EINVAL,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -1272,6 +1343,8 @@ test_coap_msg_data_t test17_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = test17_buf,
     .buf_len = TEST17_BUF_LEN,
     .ver = 0,
@@ -1303,6 +1376,8 @@ test_coap_msg_data_t test18_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = -EBADMSG,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -1316,6 +1391,8 @@ test_coap_msg_data_t test18_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = test18_buf,
     .buf_len = TEST18_BUF_LEN,
     .ver = COAP_MSG_VER,
@@ -1347,6 +1424,8 @@ test_coap_msg_data_t test19_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = -EBADMSG,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -1360,6 +1439,8 @@ test_coap_msg_data_t test19_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = test19_buf,
     .buf_len = TEST19_BUF_LEN,
     .ver = COAP_MSG_VER,
@@ -1394,6 +1475,8 @@ test_coap_msg_data_t test20_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = -EBADMSG,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -1407,6 +1490,8 @@ test_coap_msg_data_t test20_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = test20_buf,
     .buf_len = TEST20_BUF_LEN,
     .ver = COAP_MSG_VER,
@@ -1441,6 +1526,8 @@ test_coap_msg_data_t test21_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = -EBADMSG,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -1454,6 +1541,8 @@ test_coap_msg_data_t test21_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = test21_buf,
     .buf_len = TEST21_BUF_LEN,
     .ver = 0,
@@ -1488,6 +1577,8 @@ test_coap_msg_data_t test22_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = -EBADMSG,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -1501,6 +1592,8 @@ test_coap_msg_data_t test22_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = test22_buf,
     .buf_len = TEST22_BUF_LEN,
     .ver = COAP_MSG_VER,
@@ -1536,6 +1629,8 @@ test_coap_msg_data_t test23_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = -EBADMSG,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -1549,6 +1644,8 @@ test_coap_msg_data_t test23_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = test23_buf,
     .buf_len = TEST23_BUF_LEN,
     .ver = COAP_MSG_VER,
@@ -1582,6 +1679,8 @@ test_coap_msg_data_t test24_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = -EBADMSG,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -1595,6 +1694,8 @@ test_coap_msg_data_t test24_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = test24_buf,
     .buf_len = TEST24_BUF_LEN,
     .ver = 0,
@@ -1628,6 +1729,8 @@ test_coap_msg_data_t test25_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = -EBADMSG,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -1641,6 +1744,8 @@ test_coap_msg_data_t test25_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = test25_buf,
     .buf_len = TEST25_BUF_LEN,
     .ver = 0,
@@ -1673,6 +1778,8 @@ test_coap_msg_data_t test26_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = -EBADMSG,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -1686,6 +1793,8 @@ test_coap_msg_data_t test26_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = test26_buf,
     .buf_len = TEST26_BUF_LEN,
     .ver = 0,
@@ -1717,6 +1826,8 @@ test_coap_msg_data_t test27_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -1730,6 +1841,8 @@ test_coap_msg_data_t test27_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = test27_buf,
     .buf_len = TEST27_BUF_LEN,
     .ver = 0,
@@ -1761,6 +1874,8 @@ test_coap_msg_data_t test28_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = -EBADMSG,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -1774,6 +1889,8 @@ test_coap_msg_data_t test28_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = test28_buf,
     .buf_len = TEST28_BUF_LEN,
     .ver = 0,
@@ -2026,6 +2143,8 @@ test_coap_msg_data_t test29_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -2039,6 +2158,8 @@ test_coap_msg_data_t test29_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = NULL,
     .buf_len = 0,
     .ver = 0,
@@ -2102,6 +2223,8 @@ test_coap_msg_data_t test30_data =
     .check_critical_desc = "test 68: Check recognized elective options",
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -2115,6 +2238,8 @@ test_coap_msg_data_t test30_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = NULL,
     .buf_len = 0,
     .ver = 0,
@@ -2178,6 +2303,8 @@ test_coap_msg_data_t test31_data =
     .check_critical_desc = "test 69: Check recognized elective and recognized critical options",
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -2191,6 +2318,8 @@ test_coap_msg_data_t test31_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = NULL,
     .buf_len = 0,
     .ver = 0,
@@ -2254,6 +2383,8 @@ test_coap_msg_data_t test32_data =
     .check_critical_desc = "test 70: Check recognized elective and recognized critical options",
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -2267,6 +2398,8 @@ test_coap_msg_data_t test32_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = NULL,
     .buf_len = 0,
     .ver = 0,
@@ -2330,6 +2463,8 @@ test_coap_msg_data_t test33_data =
     .check_critical_desc = "test 71: Check recognized elective and recognized critical options",
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -2343,6 +2478,8 @@ test_coap_msg_data_t test33_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = NULL,
     .buf_len = 0,
     .ver = 0,
@@ -2406,6 +2543,8 @@ test_coap_msg_data_t test34_data =
     .check_critical_desc = "test 72: Check recognized and unrecognized elective options",
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -2419,6 +2558,8 @@ test_coap_msg_data_t test34_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = NULL,
     .buf_len = 0,
     .ver = 0,
@@ -2482,6 +2623,8 @@ test_coap_msg_data_t test35_data =
     .check_critical_desc = "test 73: Check recognized and unrecognized elective options",
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -2495,6 +2638,8 @@ test_coap_msg_data_t test35_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = NULL,
     .buf_len = 0,
     .ver = 0,
@@ -2558,6 +2703,8 @@ test_coap_msg_data_t test36_data =
     .check_critical_desc = "test 74: Check recognized and unrecognized elective options",
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -2571,6 +2718,8 @@ test_coap_msg_data_t test36_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = NULL,
     .buf_len = 0,
     .ver = 0,
@@ -2634,6 +2783,8 @@ test_coap_msg_data_t test37_data =
     .check_critical_desc = "test 75: Check recognized elective and unrecognized critical options",
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -2647,6 +2798,8 @@ test_coap_msg_data_t test37_data =
     .check_critical_ops_ret = 0x61,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = NULL,
     .buf_len = 0,
     .ver = 0,
@@ -2710,6 +2863,8 @@ test_coap_msg_data_t test38_data =
     .check_critical_desc = "test 76: Check recognized elective and unrecognized critical options",
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -2723,6 +2878,8 @@ test_coap_msg_data_t test38_data =
     .check_critical_ops_ret = 0x63,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = NULL,
     .buf_len = 0,
     .ver = 0,
@@ -2786,6 +2943,8 @@ test_coap_msg_data_t test39_data =
     .check_critical_desc = "test 77: Check recognized elective and unrecognized critical options",
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -2799,6 +2958,8 @@ test_coap_msg_data_t test39_data =
     .check_critical_ops_ret = 0x65,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = NULL,
     .buf_len = 0,
     .ver = 0,
@@ -2862,6 +3023,8 @@ test_coap_msg_data_t test40_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = "test 78: Check recognized safe options",
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -2875,6 +3038,8 @@ test_coap_msg_data_t test40_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = NULL,
     .buf_len = 0,
     .ver = 0,
@@ -2938,6 +3103,8 @@ test_coap_msg_data_t test41_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = "test 79: Check recognized safe and recognized unsafe options",
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -2951,6 +3118,8 @@ test_coap_msg_data_t test41_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = NULL,
     .buf_len = 0,
     .ver = 0,
@@ -3014,6 +3183,8 @@ test_coap_msg_data_t test42_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = "test 80: Check recognized safe and recognized unsafe options",
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -3027,6 +3198,8 @@ test_coap_msg_data_t test42_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = NULL,
     .buf_len = 0,
     .ver = 0,
@@ -3090,6 +3263,8 @@ test_coap_msg_data_t test43_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = "test 81: Check recognized safe and recognized unsafe options",
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -3103,6 +3278,8 @@ test_coap_msg_data_t test43_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = NULL,
     .buf_len = 0,
     .ver = 0,
@@ -3166,6 +3343,8 @@ test_coap_msg_data_t test44_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = "test 82: Check recognized and unrecognized safe options",
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -3179,6 +3358,8 @@ test_coap_msg_data_t test44_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = NULL,
     .buf_len = 0,
     .ver = 0,
@@ -3242,6 +3423,8 @@ test_coap_msg_data_t test45_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = "test 83: Check recognized and unrecognized safe options",
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -3255,6 +3438,8 @@ test_coap_msg_data_t test45_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = NULL,
     .buf_len = 0,
     .ver = 0,
@@ -3318,6 +3503,8 @@ test_coap_msg_data_t test46_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = "test 84: Check recognized and unrecognized safe options",
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -3331,6 +3518,8 @@ test_coap_msg_data_t test46_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = NULL,
     .buf_len = 0,
     .ver = 0,
@@ -3394,6 +3583,8 @@ test_coap_msg_data_t test47_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = "test 85: Check recognized safe and unrecognized unsafe options",
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -3407,6 +3598,8 @@ test_coap_msg_data_t test47_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0x62,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = NULL,
     .buf_len = 0,
     .ver = 0,
@@ -3470,6 +3663,8 @@ test_coap_msg_data_t test48_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = "test 86: Check recognized safe and unrecognized unsafe options",
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -3483,6 +3678,8 @@ test_coap_msg_data_t test48_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0x63,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = NULL,
     .buf_len = 0,
     .ver = 0,
@@ -3546,6 +3743,8 @@ test_coap_msg_data_t test49_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = "test 87: Check recognized safe and unrecognized unsafe options",
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -3559,6 +3758,8 @@ test_coap_msg_data_t test49_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0x66,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = NULL,
     .buf_len = 0,
     .ver = 0,
@@ -3667,6 +3868,8 @@ test_coap_msg_data_t test50_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -3680,6 +3883,8 @@ test_coap_msg_data_t test50_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = test50_buf,
     .buf_len = TEST50_BUF_LEN,
     .ver = COAP_MSG_VER,
@@ -3776,6 +3981,8 @@ test_coap_msg_data_t test51_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -3789,6 +3996,8 @@ test_coap_msg_data_t test51_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = NULL,
     .buf_len = 0,
     .ver = 0,
@@ -3885,6 +4094,8 @@ test_coap_msg_data_t test52_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = -EINVAL,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -3898,6 +4109,8 @@ test_coap_msg_data_t test52_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = NULL,
     .buf_len = 0,
     .ver = 0,
@@ -3982,6 +4195,8 @@ test_coap_msg_data_t test53_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -3995,6 +4210,8 @@ test_coap_msg_data_t test53_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = NULL,
     .buf_len = 0,
     .ver = 0,
@@ -4038,6 +4255,8 @@ test_coap_msg_data_t test54_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = "test 93: convert the URI path in a message to a string representation",
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -4051,6 +4270,8 @@ test_coap_msg_data_t test54_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 5,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = test54_buf,
     .buf_len = TEST54_BUF_LEN,
     .ver = COAP_MSG_VER,
@@ -4116,6 +4337,8 @@ test_coap_msg_data_t test55_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = "test 94: convert the URI path in a message to a string representation",
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -4129,6 +4352,8 @@ test_coap_msg_data_t test55_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 17,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = test55_buf,
     .buf_len = TEST55_BUF_LEN,
     .ver = COAP_MSG_VER,
@@ -4157,6 +4382,8 @@ test_coap_msg_data_t test56_data =
     .check_critical_desc = NULL,
     .check_unsafe_desc = NULL,
     .uri_path_to_str_desc = "test 95: convert the URI path in a message to a string representation",
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
     .parse_ret = 0,
     .set_type_ret = 0,
     .set_code_ret = 0,
@@ -4170,6 +4397,8 @@ test_coap_msg_data_t test56_data =
     .check_critical_ops_ret = 0,
     .check_unsafe_ops_ret = 0,
     .uri_path_to_str_ret = 1,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
     .buf = test56_buf,
     .buf_len = TEST56_BUF_LEN,
     .ver = COAP_MSG_VER,
@@ -4185,6 +4414,385 @@ test_coap_msg_data_t test56_data =
     .payload_len = 0
 };
 
+#define TEST57_BUF_LEN      (4 + 2 + 8 + 5 + 5 + 2)
+#define TEST57_TOKEN_LEN    2
+#define TEST57_OP1_LEN      7
+#define TEST57_OP2_LEN      4
+#define TEST57_OP3_LEN      4
+#define TEST57_OP4_LEN      1
+#define TEST57_NUM_OPS      4
+
+char test57_buf[TEST57_BUF_LEN] =
+{
+    /* header:         */ 0x42, 0x01, 0x12, 0x34,
+    /* token:          */ 0xab, 0xcd,
+    /* option1:        */ 0xb7, 's', 'e', 'n', 's', 'o', 'r', 's',
+    /* option2:        */ 0x04, 't', 'e', 'm', 'p',
+    /* option3:        */ 0x44, 'u', 'n', 'i', 't',
+    /* option4:        */ 0x21, 0x00
+};
+char test57_token[TEST57_TOKEN_LEN] = {0xab, 0xcd};
+char test57_op1_val[TEST57_OP1_LEN] = {'s', 'e', 'n', 's', 'o', 'r', 's'};
+char test57_op2_val[TEST57_OP2_LEN] = {'t', 'e', 'm', 'p'};
+char test57_op3_val[TEST57_OP3_LEN] = {'u', 'n', 'i', 't'};
+char test57_op4_val[TEST57_OP4_LEN] = {0x00};
+test_coap_msg_op_t test57_ops[TEST57_NUM_OPS] =
+{
+    [0] =
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST57_OP1_LEN,
+        .val = test57_op1_val,
+        .block_num = 0,
+        .block_more = 0,
+        .block_size = 0
+    },
+    [1] =
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST57_OP2_LEN,
+        .val = test57_op2_val,
+        .block_num = 0,
+        .block_more = 0,
+        .block_size = 0
+    },
+    [2] =
+    {
+        .num = COAP_MSG_URI_QUERY,
+        .len = TEST57_OP3_LEN,
+        .val = test57_op3_val,
+        .block_num = 0,
+        .block_more = 0,
+        .block_size = 0
+    },
+    [3] =
+    {
+        .num = COAP_MSG_ACCEPT,
+        .len = TEST57_OP4_LEN,
+        .val = test57_op4_val,
+        .block_num = 0,
+        .block_more = 0,
+        .block_size = 0
+    }
+};
+
+test_coap_msg_data_t test57_data =
+{
+    .parse_desc = NULL,
+    .format_desc = NULL,
+    .copy_desc = NULL,
+    .recognize_desc = NULL,
+    .check_critical_desc = NULL,
+    .check_unsafe_desc = NULL,
+    .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = "test 96: parse CoAP message with options stored inline",
+    .parse_view_desc = NULL,
+    .parse_ret = 0,
+    .set_type_ret = 0,
+    .set_code_ret = 0,
+    .set_msg_id_ret = 0,
+    .set_token_ret = 0,
+    .add_op_ret = NULL,
+    .set_payload_ret = 0,
+    .format_ret = TEST57_BUF_LEN,
+    .copy_ret = 0,
+    .recognize_ret = NULL,
+    .check_critical_ops_ret = 0,
+    .check_unsafe_ops_ret = 0,
+    .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
+    .buf = test57_buf,
+    .buf_len = TEST57_BUF_LEN,
+    .ver = COAP_MSG_VER,
+    .type = COAP_MSG_CON,
+    .code_class = 0x0,
+    .code_detail = 0x1,
+    .msg_id = 0x1234,
+    .token = test57_token,
+    .token_len = TEST57_TOKEN_LEN,
+    .ops = test57_ops,
+    .num_ops = TEST57_NUM_OPS,
+    .payload = NULL,
+    .payload_len = 0
+};
+
+#define TEST58_BUF_LEN      (4 + 9 * 3 + 2 + 70)
+#define TEST58_OP_LEN       2
+#define TEST58_OP10_LEN     70
+#define TEST58_NUM_OPS      10
+
+char test58_buf[TEST58_BUF_LEN] =
+{
+    /* header:         */ 0x50, 0x01, 0x00, 0x01,
+    /* option1:        */ 0xb2, 'p', '1',
+    /* option2:        */ 0x02, 'p', '2',
+    /* option3:        */ 0x02, 'p', '3',
+    /* option4:        */ 0x02, 'p', '4',
+    /* option5:        */ 0x02, 'p', '5',
+    /* option6:        */ 0x02, 'p', '6',
+    /* option7:        */ 0x02, 'p', '7',
+    /* option8:        */ 0x02, 'p', '8',
+    /* option9:        */ 0x02, 'p', '9',
+    /* option10:       */ 0x4d, 0x39,
+                          0xd0, 0xd1, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9,
+                          0xda, 0xdb, 0xdc, 0xdd, 0xde, 0xdf, 0xd0, 0xd1, 0xd2, 0xd3,
+                          0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xdb, 0xdc, 0xdd,
+                          0xde, 0xdf, 0xd0, 0xd1, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7,
+                          0xd8, 0xd9, 0xda, 0xdb, 0xdc, 0xdd, 0xde, 0xdf, 0xd0, 0xd1,
+                          0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xdb,
+                          0xdc, 0xdd, 0xde, 0xdf, 0xd0, 0xd1, 0xd2, 0xd3, 0xd4, 0xd5
+};
+char test58_op1_val[TEST58_OP_LEN] = {'p', '1'};
+char test58_op2_val[TEST58_OP_LEN] = {'p', '2'};
+char test58_op3_val[TEST58_OP_LEN] = {'p', '3'};
+char test58_op4_val[TEST58_OP_LEN] = {'p', '4'};
+char test58_op5_val[TEST58_OP_LEN] = {'p', '5'};
+char test58_op6_val[TEST58_OP_LEN] = {'p', '6'};
+char test58_op7_val[TEST58_OP_LEN] = {'p', '7'};
+char test58_op8_val[TEST58_OP_LEN] = {'p', '8'};
+char test58_op9_val[TEST58_OP_LEN] = {'p', '9'};
+char test58_op10_val[TEST58_OP10_LEN] =
+{
+    0xd0, 0xd1, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9,
+    0xda, 0xdb, 0xdc, 0xdd, 0xde, 0xdf, 0xd0, 0xd1, 0xd2, 0xd3,
+    0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xdb, 0xdc, 0xdd,
+    0xde, 0xdf, 0xd0, 0xd1, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7,
+    0xd8, 0xd9, 0xda, 0xdb, 0xdc, 0xdd, 0xde, 0xdf, 0xd0, 0xd1,
+    0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xdb,
+    0xdc, 0xdd, 0xde, 0xdf, 0xd0, 0xd1, 0xd2, 0xd3, 0xd4, 0xd5
+};
+test_coap_msg_op_t test58_ops[TEST58_NUM_OPS] =
+{
+    [0] =
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST58_OP_LEN,
+        .val = test58_op1_val,
+        .block_num = 0,
+        .block_more = 0,
+        .block_size = 0
+    },
+    [1] =
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST58_OP_LEN,
+        .val = test58_op2_val,
+        .block_num = 0,
+        .block_more = 0,
+        .block_size = 0
+    },
+    [2] =
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST58_OP_LEN,
+        .val = test58_op3_val,
+        .block_num = 0,
+        .block_more = 0,
+        .block_size = 0
+    },
+    [3] =
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST58_OP_LEN,
+        .val = test58_op4_val,
+        .block_num = 0,
+        .block_more = 0,
+        .block_size = 0
+    },
+    [4] =
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST58_OP_LEN,
+        .val = test58_op5_val,
+        .block_num = 0,
+        .block_more = 0,
+        .block_size = 0
+    },
+    [5] =
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST58_OP_LEN,
+        .val = test58_op6_val,
+        .block_num = 0,
+        .block_more = 0,
+        .block_size = 0
+    },
+    [6] =
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST58_OP_LEN,
+        .val = test58_op7_val,
+        .block_num = 0,
+        .block_more = 0,
+        .block_size = 0
+    },
+    [7] =
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST58_OP_LEN,
+        .val = test58_op8_val,
+        .block_num = 0,
+        .block_more = 0,
+        .block_size = 0
+    },
+    [8] =
+    {
+        .num = COAP_MSG_URI_PATH,
+        .len = TEST58_OP_LEN,
+        .val = test58_op9_val,
+        .block_num = 0,
+        .block_more = 0,
+        .block_size = 0
+    },
+    [9] =
+    {
+        .num = COAP_MSG_URI_QUERY,
+        .len = TEST58_OP10_LEN,
+        .val = test58_op10_val,
+        .block_num = 0,
+        .block_more = 0,
+        .block_size = 0
+    }
+};
+
+test_coap_msg_data_t test58_data =
+{
+    .parse_desc = NULL,
+    .format_desc = NULL,
+    .copy_desc = NULL,
+    .recognize_desc = NULL,
+    .check_critical_desc = NULL,
+    .check_unsafe_desc = NULL,
+    .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = "test 97: parse CoAP message with more options than can be stored inline",
+    .parse_view_desc = "test 99: parse CoAP message view with more options than can be stored inline",
+    .parse_ret = 0,
+    .set_type_ret = 0,
+    .set_code_ret = 0,
+    .set_msg_id_ret = 0,
+    .set_token_ret = 0,
+    .add_op_ret = NULL,
+    .set_payload_ret = 0,
+    .format_ret = TEST58_BUF_LEN,
+    .copy_ret = 0,
+    .recognize_ret = NULL,
+    .check_critical_ops_ret = 0,
+    .check_unsafe_ops_ret = 0,
+    .uri_path_to_str_ret = 0,
+    .small_alloc_num = TEST58_NUM_OPS - COAP_MSG_OP_INLINE_NUM,
+    .medium_alloc_num = 1,
+    .buf = test58_buf,
+    .buf_len = TEST58_BUF_LEN,
+    .ver = COAP_MSG_VER,
+    .type = COAP_MSG_NON,
+    .code_class = 0x0,
+    .code_detail = 0x1,
+    .msg_id = 0x0001,
+    .token = NULL,
+    .token_len = 0,
+    .ops = test58_ops,
+    .num_ops = TEST58_NUM_OPS,
+    .payload = NULL,
+    .payload_len = 0
+};
+
+#define TEST59_OP1_LEN  0
+#define TEST59_OP2_LEN  1
+#define TEST59_OP3_LEN  2
+#define TEST59_OP4_LEN  3
+#define TEST59_NUM_OPS  4
+
+char test59_op1_val[1] = {0};
+char test59_op2_val[TEST59_OP2_LEN] = {0x01};
+char test59_op3_val[TEST59_OP3_LEN] = {0x12, 0x34};
+char test59_op4_val[TEST59_OP4_LEN] = {0xff, 0xff, 0xff};
+
+test_coap_msg_op_t test59_ops[TEST59_NUM_OPS] =
+{
+    [0] =
+    {
+        .num = COAP_MSG_OBSERVE,
+        .len = TEST59_OP1_LEN,
+        .val = test59_op1_val,
+        .block_num = 0,
+        .block_more = 0,
+        .block_size = 0,
+        .uint_val = 0
+    },
+    [1] =
+    {
+        .num = COAP_MSG_OBSERVE,
+        .len = TEST59_OP2_LEN,
+        .val = test59_op2_val,
+        .block_num = 0,
+        .block_more = 0,
+        .block_size = 0,
+        .uint_val = 1
+    },
+    [2] =
+    {
+        .num = COAP_MSG_MAX_AGE,
+        .len = TEST59_OP3_LEN,
+        .val = test59_op3_val,
+        .block_num = 0,
+        .block_more = 0,
+        .block_size = 0,
+        .uint_val = 0x1234
+    },
+    [3] =
+    {
+        .num = COAP_MSG_OBSERVE,
+        .len = TEST59_OP4_LEN,
+        .val = test59_op4_val,
+        .block_num = 0,
+        .block_more = 0,
+        .block_size = 0,
+        .uint_val = 0xffffff
+    }
+};
+
+test_coap_msg_data_t test59_data =
+{
+    .parse_desc = "test 100: parse CoAP unsigned integer option values",
+    .format_desc = "test 101: format CoAP unsigned integer option values",
+    .copy_desc = NULL,
+    .recognize_desc = NULL,
+    .check_critical_desc = NULL,
+    .check_unsafe_desc = NULL,
+    .uri_path_to_str_desc = NULL,
+    .parse_inline_desc = NULL,
+    .parse_view_desc = NULL,
+    .parse_ret = 0,
+    .set_type_ret = 0,
+    .set_code_ret = 0,
+    .set_msg_id_ret = 0,
+    .set_token_ret = 0,
+    .add_op_ret = NULL,
+    .set_payload_ret = 0,
+    .format_ret = 0,
+    .copy_ret = 0,
+    .recognize_ret = NULL,
+    .check_critical_ops_ret = 0,
+    .check_unsafe_ops_ret = 0,
+    .uri_path_to_str_ret = 0,
+    .small_alloc_num = 0,
+    .medium_alloc_num = 0,
+    .buf = NULL,
+    .buf_len = 0,
+    .ver = 0,
+    .type = 0,
+    .code_class = 0,
+    .code_detail = 0,
+    .msg_id = 0,
+    .token = NULL,
+    .token_len = 0,
+    .ops = test59_ops,
+    .num_ops = TEST59_NUM_OPS,
+    .payload = NULL,
+    .payload_len = 0
+};
+
 /**
  *  @brief Print a CoAP message
  *
@@ -4822,6 +5430,73 @@ static test_result_t test_format_block_op_func(test_data_t data)
     return result;
 }
 
+/**
+ *  @brief Parse unsigned integer option values test function
+ *
+ *  @param[in] data Pointer to a message test structure
+ *
+ *  @returns Test result
+ */
+static test_result_t test_parse_uint_op_func(test_data_t data)
+{
+    test_coap_msg_data_t *test_data = (test_coap_msg_data_t *)data;
+    test_result_t result = PASS;
+    unsigned num = 0;
+    unsigned i = 0;
+    int ret = 0;
+
+    printf("%s\n", test_data->parse_desc);
+
+    for (i = 0; i < test_data->num_ops; i++)
+    {
+        ret = coap_msg_op_parse_uint_val(&num, test_data->ops[i].val, test_data->ops[i].len);
+        if (ret != test_data->parse_ret)
+        {
+            result = FAIL;
+        }
+        if ((test_data->parse_ret == 0) && (num != test_data->ops[i].uint_val))
+        {
+            result = FAIL;
+        }
+    }
+    return result;
+}
+
+/**
+ *  @brief Format unsigned integer option values test function
+ *
+ *  @param[in] data Pointer to a message test structure
+ *
+ *  @returns Test result
+ */
+static test_result_t test_format_uint_op_func(test_data_t data)
+{
+    test_coap_msg_data_t *test_data = (test_coap_msg_data_t *)data;
+    test_result_t result = PASS;
+    unsigned i = 0;
+    char val[sizeof(unsigned)] = {0};
+    int ret = 0;
+
+    printf("%s\n", test_data->format_desc);
+
+    for (i = 0; i < test_data->num_ops; i++)
+    {
+        ret = coap_msg_op_format_uint_val(val, sizeof(val), test_data->ops[i].uint_val);
+        if ((ret != test_data->ops[i].len)
+         || (memcmp(val, test_data->ops[i].val, test_data->ops[i].len) != 0))
+        {
+            result = FAIL;
+        }
+    }
+    /* value too large for the buffer */
+    ret = coap_msg_op_format_uint_val(val, 1, 0x100);
+    if (ret != -EINVAL)
+    {
+        result = FAIL;
+    }
+    return result;
+}
+
 /**
  *  @brief Convert the URI path in a message to a string representation test function
  *
@@ -4889,6 +5564,242 @@ static test_result_t test_uri_path_to_str_func(test_data_t data)
     return result;
 }
 
+/**
+ *  @brief Count the number of active buffers in a memory allocator
+ *
+ *  @param[in] active Pointer to the active bitset
+ *  @param[in] len Length of the active bitset
+ *
+ *  @returns Number of active buffers
+ */
+static unsigned count_active(const char *active, size_t len)
+{
+    unsigned num = 0;
+    size_t i = 0;
+    unsigned j = 0;
+
+    for (i = 0; i < len; i++)
+    {
+        for (j = 0; j < 8; j++)
+        {
+            if ((active[i] >> j) & 0x1)
+            {
+                num++;
+            }
+        }
+    }
+    return num;
+}
+
+/**
+ *  @brief Parse with inline options test function
+ *
+ *  Parse a message, check the number of buffers allocated
+ *  from the small and medium memory allocators, check the
+ *  options and format the message again.
+ *
+ *  @param[in] data Pointer to a message test structure
+ *
+ *  @returns Test result
+ */
+static test_result_t test_parse_inline_func(test_data_t data)
+{
+    test_coap_msg_data_t *test_data = (test_coap_msg_data_t *)data;
+    test_result_t result = PASS;
+    coap_msg_op_t *op = NULL;
+    coap_msg_t msg = {0};
+    unsigned small_num = 0;
+    unsigned medium_num = 0;
+    unsigned i = 0;
+    ssize_t num = 0;
+    char tmp[test_data->buf_len];
+
+    printf("%s\n", test_data->parse_inline_desc);
+
+    small_num = count_active(coap_mem_small_get_active(), coap_mem_small_get_active_len());
+    medium_num = count_active(coap_mem_medium_get_active(), coap_mem_medium_get_active_len());
+    coap_msg_create(&msg);
+    num = coap_msg_parse(&msg, test_data->buf, test_data->buf_len);
+    if (num != test_data->parse_ret)
+    {
+        coap_msg_destroy(&msg);
+        return FAIL;
+    }
+    print_coap_msg("Parsed message:", &msg);
+    if (count_active(coap_mem_small_get_active(), coap_mem_small_get_active_len()) != small_num + test_data->small_alloc_num)
+    {
+        result = FAIL;
+    }
+    if (count_active(coap_mem_medium_get_active(), coap_mem_medium_get_active_len()) != medium_num + test_data->medium_alloc_num)
+    {
+        result = FAIL;
+    }
+    op = coap_msg_get_first_op(&msg);
+    for (i = 0; i < test_data->num_ops; i++)
+    {
+        if (op == NULL)
+        {
+            result = FAIL;
+            break;
+        }
+        if ((coap_msg_op_get_num(op) != test_data->ops[i].num)
+         || (coap_msg_op_get_len(op) != test_data->ops[i].len)
+         || (memcmp(coap_msg_op_get_val(op), test_data->ops[i].val, test_data->ops[i].len) != 0))
+        {
+            result = FAIL;
+        }
+        op = coap_msg_op_get_next(op);
+    }
+    if (op != NULL)
+    {
+        result = FAIL;
+    }
+    num = coap_msg_format(&msg, tmp, sizeof(tmp));
+    if (num != test_data->format_ret)
+    {
+        result = FAIL;
+    }
+    else if (memcmp(tmp, test_data->buf, test_data->buf_len) != 0)
+    {
+        result = FAIL;
+    }
+    coap_msg_destroy(&msg);
+    if (count_active(coap_mem_small_get_active(), coap_mem_small_get_active_len()) != small_num)
+    {
+        result = FAIL;
+    }
+    if (count_active(coap_mem_medium_get_active(), coap_mem_medium_get_active_len()) != medium_num)
+    {
+        result = FAIL;
+    }
+    return result;
+}
+
+/**
+ *  @brief Parse view test function
+ *
+ *  Parse a message view, check that the option values
+ *  and payload point into the buffer and that no medium
+ *  buffers are allocated, then detach the message from
+ *  the buffer and check it again.
+ *
+ *  @param[in] data Pointer to a message test structure
+ *
+ *  @returns Test result
+ */
+static test_result_t test_parse_view_func(test_data_t data)
+{
+    test_coap_msg_data_t *test_data = (test_coap_msg_data_t *)data;
+    test_result_t result = PASS;
+    coap_msg_op_t *op = NULL;
+    coap_msg_t msg = {0};
+    unsigned small_num = 0;
+    unsigned medium_num = 0;
+    unsigned i = 0;
+    ssize_t num = 0;
+    char buf[test_data->buf_len];
+    int ret = 0;
+
+    printf("%s\n", test_data->parse_view_desc);
+
+    memcpy(buf, test_data->buf, test_data->buf_len);
+    small_num = count_active(coap_mem_small_get_active(), coap_mem_small_get_active_len());
+    medium_num = count_active(coap_mem_medium_get_active(), coap_mem_medium_get_active_len());
+    coap_msg_create(&msg);
+    num = coap_msg_parse_view(&msg, buf, test_data->buf_len);
+    if (num != test_data->parse_ret)
+    {
+        coap_msg_destroy(&msg);
+        return FAIL;
+    }
+    print_coap_msg("Parsed message:", &msg);
+    if (!coap_msg_is_view(&msg))
+    {
+        result = FAIL;
+    }
+    if (count_active(coap_mem_small_get_active(), coap_mem_small_get_active_len()) != small_num + test_data->small_alloc_num)
+    {
+        result = FAIL;
+    }
+    if (count_active(coap_mem_medium_get_active(), coap_mem_medium_get_active_len()) != medium_num)
+    {
+        result = FAIL;
+    }
+    op = coap_msg_get_first_op(&msg);
+    for (i = 0; i < test_data->num_ops; i++)
+    {
+        if (op == NULL)
+        {
+            result = FAIL;
+            break;
+        }
+        if ((coap_msg_op_get_val(op) < buf)
+         || (coap_msg_op_get_val(op) + coap_msg_op_get_len(op) > buf + test_data->buf_len))
+        {
+            result = FAIL;
+        }
+        op = coap_msg_op_get_next(op);
+    }
+    if ((test_data->payload_len > 0)
+     && ((coap_msg_get_payload(&msg) < buf)
+      || (coap_msg_get_payload(&msg) + coap_msg_get_payload_len(&msg) != buf + test_data->buf_len)))
+    {
+        result = FAIL;
+    }
+    ret = coap_msg_add_op(&msg, COAP_MSG_URI_PATH, 1, "a");
+    if (ret != -EPERM)
+    {
+        result = FAIL;
+    }
+    ret = coap_msg_detach(&msg);
+    if (ret < 0)
+    {
+        coap_msg_destroy(&msg);
+        return FAIL;
+    }
+    memset(buf, 0, test_data->buf_len);
+    if (coap_msg_is_view(&msg))
+    {
+        result = FAIL;
+    }
+    op = coap_msg_get_first_op(&msg);
+    for (i = 0; i < test_data->num_ops; i++)
+    {
+        if (op == NULL)
+        {
+            result = FAIL;
+            break;
+        }
+        if ((coap_msg_op_get_num(op) != test_data->ops[i].num)
+         || (coap_msg_op_get_len(op) != test_data->ops[i].len)
+         || (memcmp(coap_msg_op_get_val(op), test_data->ops[i].val, test_data->ops[i].len) != 0))
+        {
+            result = FAIL;
+        }
+        op = coap_msg_op_get_next(op);
+    }
+    if (op != NULL)
+    {
+        result = FAIL;
+    }
+    if ((coap_msg_get_payload_len(&msg) != test_data->payload_len)
+     || ((test_data->payload_len > 0)
+      && (memcmp(coap_msg_get_payload(&msg), test_data->payload, test_data->payload_len) != 0)))
+    {
+        result = FAIL;
+    }
+    coap_msg_destroy(&msg);
+    if (count_active(coap_mem_small_get_active(), coap_mem_small_get_active_len()) != small_num)
+    {
+        result = FAIL;
+    }
+    if (count_active(coap_mem_medium_get_active(), coap_mem_medium_get_active_len()) != medium_num)
+    {
+        result = FAIL;
+    }
+    return result;
+}
+
 /**
  *  @brief Main function for the FreeCoAP message parser/formatter unit tests
  *
@@ -4992,7 +5903,13 @@ int main(void)
                       {test_format_block_op_func,    &test53_data},
                       {test_uri_path_to_str_func,    &test54_data},
                       {test_uri_path_to_str_func,    &test55_data},
-                      {test_uri_path_to_str_func,    &test56_data}
+                      {test_uri_path_to_str_func,    &test56_data},
+                      {test_parse_inline_func,       &test57_data},
+                      {test_parse_inline_func,       &test58_data},
+                      {test_parse_view_func,         &test1_data},
+                      {test_parse_view_func,         &test58_data},
+                      {test_parse_uint_op_func,      &test59_data},
+                      {test_format_uint_op_func,     &test59_data}
     };
     unsigned num_tests = DIM(tests);
     unsigned num_pass = 0;
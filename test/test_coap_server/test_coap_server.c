@@ -35,6 +35,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
 #ifdef COAP_DTLS_EN
 #include <gnutls/gnutls.h>
 #endif
@@ -49,6 +50,12 @@
 #define HOST                                "0.0.0.0"                           /**< Host address to listen on */
 #endif
 #define PORT                                "12436"                             /**< UDP port number to listen on */
+#define NUM_TRANS                           64                                  /**< Maximum number of active transactions */
+#ifdef COAP_SERVER_THREAD_EN
+#define NUM_WORKERS                         4                                   /**< Number of worker threads */
+#else
+#define NUM_WORKERS                         1                                   /**< Number of worker threads */
+#endif
 #define KEY_FILE_NAME                       "../../certs/server_privkey.pem"    /**< DTLS key file name */
 #define CERT_FILE_NAME                      "../../certs/server_cert.pem"       /**< DTLS certificate file name */
 #define TRUST_FILE_NAME                     "../../certs/root_client_cert.pem"  /**< DTLS trust file name */
@@ -65,18 +72,40 @@
 #define APP_LEVEL_BLOCKWISE_URI_PATH_LEN    19                                  /**< Length of the URI path that causes the server to use application-level blockwise transfers */
 #define LIB_LEVEL_BLOCKWISE_URI_PATH        "lib-level-blockwise"               /**< URI path that causes the server to use library-level blockwise transfers */
 #define LIB_LEVEL_BLOCKWISE_URI_PATH_LEN    19                                  /**< Length of the URI path that causes the server to use library-level blockwise transfers */
+#define STREAM_BLOCKWISE_URI_PATH           "stream-blockwise"                  /**< URI path that causes the server to use streaming library-level blockwise transfers */
+#define STREAM_BLOCKWISE_URI_PATH_LEN       16                                  /**< Length of the URI path that causes the server to use streaming library-level blockwise transfers */
+#define OBSERVE_URI_PATH                    "observe"                           /**< URI path of a resource that can be observed */
+#define OBSERVE_URI_PATH_LEN                7                                   /**< Length of the URI path of a resource that can be observed */
+#define CACHE_URI_PATH                      "cache"                             /**< URI path of a resource whose responses are cached */
+#define CACHE_URI_PATH_LEN                  5                                   /**< Length of the URI path of a resource whose responses are cached */
+#define CACHE_MAX_AGE                       60                                  /**< Max-Age option value of the responses from the resource whose responses are cached */
+#define VALID_URI_PATH                      "valid"                             /**< URI path of a resource whose cached responses are revalidated */
+#define VALID_URI_PATH_LEN                  5                                   /**< Length of the URI path of a resource whose cached responses are revalidated */
+#define VALID_MAX_AGE                       1                                   /**< Max-Age option value of the 2.05 (Content) responses from the resource whose cached responses are revalidated */
+#define VALID_REFRESH_MAX_AGE               60                                  /**< Max-Age option value of the 2.03 (Valid) responses from the resource whose cached responses are revalidated */
+#define SLOW_URI_PATH                       "slow"                              /**< URI path of a resource that is slow to respond */
+#define SLOW_URI_PATH_LEN                   4                                   /**< Length of the URI path of a resource that is slow to respond */
+#define SLOW_BLOCKWISE_URI_PATH             "slow-blockwise"                    /**< URI path of a resource that is slow to respond and uses library-level blockwise transfers */
+#define SLOW_BLOCKWISE_URI_PATH_LEN         14                                  /**< Length of the URI path of a resource that is slow to respond and uses library-level blockwise transfers */
+#define SLOW_DELAY                          1                                   /**< Number of seconds that the resources that are slow to respond take */
+#define SLOW_BUF_LEN                        16                                  /**< Length of the buffer used by the resource that is slow to respond */
 #define REGULAR_BUF_LEN                     16                                  /**< Length of the buffer used in regular transfers */
 #define APP_LEVEL_BLOCKWISE_BUF_LEN         40                                  /**< Length of the buffer used in application-level blockwise transfers */
 #define LIB_LEVEL_BLOCKWISE_BUF_LEN         72                                  /**< Length of the buffers used in library-level blockwise transfers */
+#define OBSERVE_BUF_LEN                     16                                  /**< Length of the buffer used by the resource that can be observed */
+#define CACHE_BUF_LEN                       32                                  /**< Length of the buffer used by the resource whose responses are cached */
+#define VALID_BUF_LEN                       32                                  /**< Length of the buffer used by the resource whose cached responses are revalidated */
+#define STREAM_BLOCKWISE_BODY_LEN           10000                               /**< Length of the body used in streaming library-level blockwise transfers */
 #define BLOCK_SIZE                          16                                  /**< Size of an individual block in a blockwise transfer */
-#define SMALL_BUF_NUM                       128                                 /**< Number of buffers in the small memory allocator */
+#define SMALL_BUF_NUM                       (128 * NUM_WORKERS)                 /**< Number of buffers in the small memory allocator */
 #define SMALL_BUF_LEN                       256                                 /**< Length of each buffer in the small memory allocator */
-#define MEDIUM_BUF_NUM                      128                                 /**< Number of buffers in the medium memory allocator */
+#define MEDIUM_BUF_NUM                      (128 * NUM_WORKERS)                 /**< Number of buffers in the medium memory allocator */
 #define MEDIUM_BUF_LEN                      1024                                /**< Length of each buffer in the medium memory allocator */
-#define LARGE_BUF_NUM                       32                                  /**< Number of buffers in the large memory allocator */
+#define LARGE_BUF_NUM                       (32 * NUM_WORKERS)                  /**< Number of buffers in the large memory allocator */
 #define LARGE_BUF_LEN                       8192                                /**< Length of each buffer in the large memory allocator */
 #define BLOCK1_SIZE                         32                                  /**< Preferred block1 size for blockwise transfers */
 #define BLOCK2_SIZE                         32                                  /**< Preferred block2 size for blockwise transfers */
+#define STREAM_BLOCK_SIZE                   1024                                /**< Preferred block1 and block2 size for streaming blockwise transfers */
 
 /**
  *  @brief Buffer used for regular transfers
@@ -96,6 +125,39 @@ static char app_level_blockwise_buf[APP_LEVEL_BLOCKWISE_BUF_LEN] = {0};
 static char *lib_level_blockwise_def_val = "0123456789abcdefghijABCDEFGHIJasdfghjklpqlfktnghrexi49s1zlkdfiecvntfbghq";
 static char lib_level_blockwise_buf[LIB_LEVEL_BLOCKWISE_BUF_LEN] = {0};
 
+/**
+ *  @brief Buffer used by the resource that can be observed
+ */
+static char *observe_def_val = "zxcvbnmlkjhgfdsa";
+static char observe_buf[OBSERVE_BUF_LEN] = {0};
+
+/**
+ *  @brief Buffer used by the resource whose responses are cached
+ *
+ *  The last byte is incremented each time the GET handler
+ *  is called so responses from the cache can be recognised.
+ *  The resource does not exist while the length is 0.
+ */
+static char cache_buf[CACHE_BUF_LEN] = {0};
+static size_t cache_len = 0;
+
+/**
+ *  @brief Buffer used by the resource whose cached responses are revalidated
+ *
+ *  The last byte is the ETag of the representation. The
+ *  resource does not exist while the length is 0.
+ */
+static char valid_buf[VALID_BUF_LEN] = {0};
+static size_t valid_len = 0;
+
+/**
+ *  @brief Number of GET requests for the resource that is slow to respond
+ *
+ *  The number is returned in the response so a response
+ *  shared by several requests can be recognised.
+ */
+static unsigned slow_num = 0;
+
 /**
  *  @brief Print a CoAP message
  *
@@ -161,44 +223,6 @@ static void print_coap_msg(const char *str, coap_msg_t *msg)
     fflush(stdout);
 }
 
-/**
- *  @brief Match the URI path in a CoAP message
- *
- *  Check the URI path option in a CoAP message
- *  against a specific value.
- *
- *  @param[in] msg Pointer to a CoAP message
- *  @param[in] str String containing the URI path
- *
- *  @returns Operation status
- *  @retval 1 match
- *  @retval 0 no match
- */
-static int server_match_uri_path(coap_msg_t *msg, const char *str)
-{
-    coap_msg_op_t *op = NULL;
-    unsigned num = 0;
-    unsigned len = 0;
-    char *val = NULL;
-
-    op = coap_msg_get_first_op(msg);
-    while (op != NULL)
-    {
-        num = coap_msg_op_get_num(op);
-        if (num == COAP_MSG_URI_PATH)
-        {
-            len = coap_msg_op_get_len(op);
-            val = coap_msg_op_get_val(op);
-            if ((len == strlen(str)) && (strncmp(val, str, len) == 0))
-            {
-                return 1;  /* match */
-            }
-        }
-        op = coap_msg_op_get_next(op);
-    }
-    return 0;  /* no match */
-}
-
 /**
  *  @brief Find and parse a Block1 or Block2 option
  *
@@ -262,6 +286,11 @@ static int server_handle_reset(coap_server_trans_t *trans, coap_msg_t *req, coap
     memset(lib_level_blockwise_buf, 0, sizeof(lib_level_blockwise_buf));
     memcpy(lib_level_blockwise_buf, lib_level_blockwise_def_val, sizeof(lib_level_blockwise_buf));
 
+    memset(observe_buf, 0, sizeof(observe_buf));
+    memcpy(observe_buf, observe_def_val, sizeof(observe_buf));
+
+    slow_num = 0;
+
     return coap_msg_set_code(resp, COAP_MSG_SUCCESS, COAP_MSG_CONTENT);
 }
 
@@ -365,6 +394,239 @@ static int server_handle_regular(coap_server_trans_t *trans, coap_msg_t *req, co
     return coap_msg_set_code(resp, COAP_MSG_SERVER_ERR, COAP_MSG_NOT_IMPL);
 }
 
+/**
+ *  @brief Handle requests for the resource that can be observed
+ *
+ *  A GET request returns the contents of the buffer. A PUT
+ *  request replaces the contents of the buffer and notifies
+ *  the observers of the resource.
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in] req Pointer to the request message
+ *  @param[out] resp Pointer to the response message
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int server_handle_observe(coap_server_trans_t *trans, coap_msg_t *req, coap_msg_t *resp)
+{
+    unsigned code_detail = 0;
+    int ret = 0;
+
+    code_detail = coap_msg_get_code_detail(req);
+    if (code_detail == COAP_MSG_GET)
+    {
+        ret = coap_msg_set_payload(resp, observe_buf, sizeof(observe_buf));
+        if (ret < 0)
+        {
+            coap_log_error("Failed to add payload to response message");
+            return ret;
+        }
+        return coap_msg_set_code(resp, COAP_MSG_SUCCESS, COAP_MSG_CONTENT);
+    }
+    if (coap_msg_get_payload_len(req) > sizeof(observe_buf))
+    {
+        return coap_msg_set_code(resp, COAP_MSG_CLIENT_ERR, COAP_MSG_REQ_ENT_TOO_LARGE);
+    }
+    memset(observe_buf, 0, sizeof(observe_buf));
+    memcpy(observe_buf, coap_msg_get_payload(req), coap_msg_get_payload_len(req));
+    ret = coap_server_notify(trans->server, "/"OBSERVE_URI_PATH);
+    if (ret < 0)
+    {
+        coap_log_error("Failed to notify observers: %s", strerror(-ret));
+        return ret;
+    }
+    return coap_msg_set_code(resp, COAP_MSG_SUCCESS, COAP_MSG_CHANGED);
+}
+
+/**
+ *  @brief Handle received blockwise body for the resource whose responses are cached
+ */
+static int server_handle_cache_rx(coap_server_trans_t *trans, coap_msg_t *req, coap_msg_t *resp)
+{
+    if ((coap_server_trans_get_body_end(trans) == 0)
+     || (coap_server_trans_get_body_end(trans) > sizeof(cache_buf)))
+    {
+        return coap_msg_set_code(resp, COAP_MSG_CLIENT_ERR, COAP_MSG_REQ_ENT_TOO_LARGE);
+    }
+    memset(cache_buf, 0, sizeof(cache_buf));
+    memcpy(cache_buf, coap_server_trans_get_body(trans), coap_server_trans_get_body_end(trans));
+    cache_len = coap_server_trans_get_body_end(trans);
+    coap_server_trans_set_body_end(trans, 0);
+    return coap_msg_set_code(resp, COAP_MSG_SUCCESS, COAP_MSG_CHANGED);
+}
+
+/**
+ *  @brief Handle requests for the resource whose responses are cached
+ *
+ *  A GET request returns the contents of the buffer with
+ *  Max-Age and ETag options, the ETag being the last byte
+ *  of the contents, and then increments the last byte of the
+ *  contents. A PUT request replaces the contents of the buffer
+ *  and may use library-level blockwise transfers. A DELETE
+ *  request removes the resource until the next PUT request.
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in] req Pointer to the request message
+ *  @param[out] resp Pointer to the response message
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int server_handle_cache(coap_server_trans_t *trans, coap_msg_t *req, coap_msg_t *resp)
+{
+    unsigned block_size = 0;
+    unsigned code_detail = 0;
+    unsigned block_num = 0;
+    unsigned block_more = 0;
+    char val[1] = {CACHE_MAX_AGE};
+    int ret = 0;
+
+    code_detail = coap_msg_get_code_detail(req);
+    if (code_detail == COAP_MSG_DELETE)
+    {
+        memset(cache_buf, 0, sizeof(cache_buf));
+        cache_len = 0;
+        return coap_msg_set_code(resp, COAP_MSG_SUCCESS, COAP_MSG_DELETED);
+    }
+    if ((code_detail == COAP_MSG_GET) && (cache_len == 0))
+    {
+        return coap_msg_set_code(resp, COAP_MSG_CLIENT_ERR, COAP_MSG_NOT_FOUND);
+    }
+    if (code_detail == COAP_MSG_GET)
+    {
+        ret = coap_msg_add_op(resp, COAP_MSG_ETAG, 1, &cache_buf[cache_len - 1]);
+        if (ret < 0)
+        {
+            coap_log_error("Failed to add CoAP option to response message");
+            return ret;
+        }
+        ret = coap_msg_add_op(resp, COAP_MSG_MAX_AGE, sizeof(val), val);
+        if (ret < 0)
+        {
+            coap_log_error("Failed to add CoAP option to response message");
+            return ret;
+        }
+        ret = coap_msg_set_payload(resp, cache_buf, cache_len);
+        if (ret < 0)
+        {
+            coap_log_error("Failed to add payload to response message");
+            return ret;
+        }
+        cache_buf[cache_len - 1]++;
+        return coap_msg_set_code(resp, COAP_MSG_SUCCESS, COAP_MSG_CONTENT);
+    }
+    ret = coap_msg_parse_block_op(&block_num, &block_more, &block_size, req, COAP_MSG_BLOCK1);
+    if (ret == 0)
+    {
+        return coap_server_trans_handle_blockwise(trans, req, resp,
+                                                  BLOCK_SIZE, BLOCK_SIZE,
+                                                  cache_buf,
+                                                  sizeof(cache_buf),
+                                                  server_handle_cache_rx);
+    }
+    if ((coap_msg_get_payload_len(req) == 0)
+     || (coap_msg_get_payload_len(req) > sizeof(cache_buf)))
+    {
+        return coap_msg_set_code(resp, COAP_MSG_CLIENT_ERR, COAP_MSG_REQ_ENT_TOO_LARGE);
+    }
+    memset(cache_buf, 0, sizeof(cache_buf));
+    memcpy(cache_buf, coap_msg_get_payload(req), coap_msg_get_payload_len(req));
+    cache_len = coap_msg_get_payload_len(req);
+    return coap_msg_set_code(resp, COAP_MSG_SUCCESS, COAP_MSG_CHANGED);
+}
+
+/**
+ *  @brief Handle requests for the resource whose cached responses are revalidated
+ *
+ *  A GET request with an ETag option that matches the last
+ *  byte of the contents of the buffer returns 2.03 (Valid)
+ *  with a long Max-Age option. Any other GET request returns
+ *  the contents of the buffer with an ETag option and a Max-Age
+ *  option short enough for the response to become stale in
+ *  the cache of the proxy during a test. A PUT request
+ *  replaces the contents of the buffer. A DELETE request
+ *  removes the resource until the next PUT request.
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in] req Pointer to the request message
+ *  @param[out] resp Pointer to the response message
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int server_handle_valid(coap_server_trans_t *trans, coap_msg_t *req, coap_msg_t *resp)
+{
+    coap_msg_op_t *op = NULL;
+    unsigned code_detail = 0;
+    char val[1] = {VALID_MAX_AGE};
+    int ret = 0;
+
+    code_detail = coap_msg_get_code_detail(req);
+    if (code_detail == COAP_MSG_DELETE)
+    {
+        memset(valid_buf, 0, sizeof(valid_buf));
+        valid_len = 0;
+        return coap_msg_set_code(resp, COAP_MSG_SUCCESS, COAP_MSG_DELETED);
+    }
+    if (code_detail == COAP_MSG_PUT)
+    {
+        if ((coap_msg_get_payload_len(req) == 0)
+         || (coap_msg_get_payload_len(req) > sizeof(valid_buf)))
+        {
+            return coap_msg_set_code(resp, COAP_MSG_CLIENT_ERR, COAP_MSG_REQ_ENT_TOO_LARGE);
+        }
+        memset(valid_buf, 0, sizeof(valid_buf));
+        memcpy(valid_buf, coap_msg_get_payload(req), coap_msg_get_payload_len(req));
+        valid_len = coap_msg_get_payload_len(req);
+        return coap_msg_set_code(resp, COAP_MSG_SUCCESS, COAP_MSG_CHANGED);
+    }
+    if (valid_len == 0)
+    {
+        return coap_msg_set_code(resp, COAP_MSG_CLIENT_ERR, COAP_MSG_NOT_FOUND);
+    }
+    ret = coap_msg_add_op(resp, COAP_MSG_ETAG, 1, &valid_buf[valid_len - 1]);
+    if (ret < 0)
+    {
+        coap_log_error("Failed to add CoAP option to response message");
+        return ret;
+    }
+    op = coap_msg_get_first_op(req);
+    while ((op != NULL) && (coap_msg_op_get_num(op) != COAP_MSG_ETAG))
+    {
+        op = coap_msg_op_get_next(op);
+    }
+    if ((op != NULL)
+     && (coap_msg_op_get_len(op) == 1)
+     && (coap_msg_op_get_val(op)[0] == valid_buf[valid_len - 1]))
+    {
+        val[0] = VALID_REFRESH_MAX_AGE;
+        ret = coap_msg_add_op(resp, COAP_MSG_MAX_AGE, sizeof(val), val);
+        if (ret < 0)
+        {
+            coap_log_error("Failed to add CoAP option to response message");
+            return ret;
+        }
+        return coap_msg_set_code(resp, COAP_MSG_SUCCESS, COAP_MSG_VALID);
+    }
+    ret = coap_msg_add_op(resp, COAP_MSG_MAX_AGE, sizeof(val), val);
+    if (ret < 0)
+    {
+        coap_log_error("Failed to add CoAP option to response message");
+        return ret;
+    }
+    ret = coap_msg_set_payload(resp, valid_buf, valid_len);
+    if (ret < 0)
+    {
+        coap_log_error("Failed to add payload to response message");
+        return ret;
+    }
+    return coap_msg_set_code(resp, COAP_MSG_SUCCESS, COAP_MSG_CONTENT);
+}
+
 /**
  *  @brief Handle application-level blockwise transfers
  *
@@ -573,10 +835,11 @@ static int server_handle_lib_level_blockwise(coap_server_trans_t *trans, coap_ms
 }
 
 /**
- *  @brief Callback function to handle requests and generate responses
+ *  @brief Handle requests for the resource that is slow to respond
  *
- *  The handler function is called to service a request
- *  and produce a response.
+ *  A GET request waits before returning the number of GET
+ *  requests received since the last reset. The response
+ *  has no Max-Age or ETag option so it is not cached.
  *
  *  @param[in,out] trans Pointer to a transaction structure
  *  @param[in] req Pointer to the request message
@@ -586,40 +849,251 @@ static int server_handle_lib_level_blockwise(coap_server_trans_t *trans, coap_ms
  *  @retval 0 Success
  *  @retval <0 Error
  */
-static int server_handle(coap_server_trans_t *trans, coap_msg_t *req, coap_msg_t *resp)
+static int server_handle_slow(coap_server_trans_t *trans, coap_msg_t *req, coap_msg_t *resp)
+{
+    char buf[SLOW_BUF_LEN] = {0};
+    int ret = 0;
+
+    sleep(SLOW_DELAY);
+    slow_num++;
+    snprintf(buf, sizeof(buf), "%u", slow_num);
+    ret = coap_msg_set_payload(resp, buf, strlen(buf));
+    if (ret < 0)
+    {
+        coap_log_error("Failed to add payload to response message");
+        return ret;
+    }
+    return coap_msg_set_code(resp, COAP_MSG_SUCCESS, COAP_MSG_CONTENT);
+}
+
+/**
+ *  @brief Handle requests for the resource that is slow to respond and uses library-level blockwise transfers
+ *
+ *  A GET request for the first block waits before the
+ *  contents of the buffer used for library-level blockwise
+ *  transfers are returned using library-level blockwise
+ *  transfers.
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in] req Pointer to the request message
+ *  @param[out] resp Pointer to the response message
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int server_handle_slow_blockwise(coap_server_trans_t *trans, coap_msg_t *req, coap_msg_t *resp)
 {
+    unsigned block_size = 0;
+    unsigned block_more = 0;
+    unsigned block_num = 0;
     int ret = 0;
 
-    if (server_match_uri_path(req, RESET_URI_PATH))
+    ret = coap_msg_parse_block_op(&block_num, &block_more, &block_size, req, COAP_MSG_BLOCK2);
+    if ((ret == 1) || ((ret == 0) && (block_num == 0)))
     {
-        coap_log_notice("handle reset");
-        return server_handle_reset(trans, req, resp);
+        sleep(SLOW_DELAY);
     }
-    else if (server_match_uri_path(req, UNSAFE_URI_PATH))
+    return coap_server_trans_handle_blockwise(trans, req, resp,
+                                              BLOCK1_SIZE, BLOCK2_SIZE,
+                                              lib_level_blockwise_buf,
+                                              sizeof(lib_level_blockwise_buf),
+                                              server_handle_lib_level_blockwise_rx);
+}
+
+/**
+ *  @brief Generate the byte at an offset in the streaming body
+ *
+ *  @param[in] offset Byte offset into the body
+ *
+ *  @returns Byte value
+ */
+static char server_stream_blockwise_byte(size_t offset)
+{
+    return 'a' + (offset % 26);
+}
+
+/**
+ *  @brief Produce part of the body of a streaming blockwise transfer
+ */
+static ssize_t server_stream_blockwise_read(coap_server_trans_t *trans, size_t offset, char *buf, size_t len, void *data)
+{
+    size_t i = 0;
+
+    if (offset >= STREAM_BLOCKWISE_BODY_LEN)
+    {
+        return 0;
+    }
+    if (offset + len > STREAM_BLOCKWISE_BODY_LEN)
     {
-        coap_log_notice("handle unsafe");
-        ret = server_handle_unsafe(trans, req, resp);
+        len = STREAM_BLOCKWISE_BODY_LEN - offset;
     }
-    else if (server_match_uri_path(req, APP_LEVEL_BLOCKWISE_URI_PATH))
+    for (i = 0; i < len; i++)
     {
-        coap_log_notice("handle application-level blockwise");
-        ret = server_handle_app_level_blockwise(trans, req, resp);
+        buf[i] = server_stream_blockwise_byte(offset + i);
     }
-    else if (server_match_uri_path(req, LIB_LEVEL_BLOCKWISE_URI_PATH))
+    return len;
+}
+
+/**
+ *  @brief Consume part of the body of a streaming blockwise transfer
+ */
+static int server_stream_blockwise_write(coap_server_trans_t *trans, size_t offset, const char *buf, size_t len, int more, void *data)
+{
+    size_t i = 0;
+
+    if (offset + len > STREAM_BLOCKWISE_BODY_LEN)
     {
-        coap_log_notice("handle library-level blockwise");
-        ret = server_handle_lib_level_blockwise(trans, req, resp);
+        return -ENOSPC;
     }
-    else
+    for (i = 0; i < len; i++)
     {
-        coap_log_notice("handle regular");
-        ret = server_handle_regular(trans, req, resp);
+        if (buf[i] != server_stream_blockwise_byte(offset + i))
+        {
+            coap_log_warn("Unexpected data at byte %zu of streaming blockwise transfer", offset + i);
+            return -EBADMSG;
+        }
     }
+    return 0;
+}
+
+/**
+ *  @brief Handle received streaming blockwise body
+ */
+static int server_handle_stream_blockwise_rx(coap_server_trans_t *trans, coap_msg_t *req, coap_msg_t *resp)
+{
+    if (coap_server_trans_get_body_end(trans) != STREAM_BLOCKWISE_BODY_LEN)
+    {
+        return coap_msg_set_code(resp, COAP_MSG_CLIENT_ERR, COAP_MSG_INCOMPLETE);
+    }
+    return coap_msg_set_code(resp, COAP_MSG_SUCCESS, COAP_MSG_CHANGED);
+}
+
+/**
+ *  @brief Handle streaming library-level blockwise transfers
+ *
+ *  This function handles requests and responses
+ *  that involve blockwise transfers with a body
+ *  larger than a buffer in the large memory
+ *  allocator that is produced and consumed one
+ *  block at a time.
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in] req Pointer to the request message
+ *  @param[out] resp Pointer to the response message
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int server_handle_stream_blockwise(coap_server_trans_t *trans, coap_msg_t *req, coap_msg_t *resp)
+{
+    unsigned code_detail = 0;
+    unsigned code_class = 0;
+
+    /* determine method */
+    code_class = coap_msg_get_code_class(req);
+    code_detail = coap_msg_get_code_detail(req);
+    if (code_class != COAP_MSG_REQ)
+    {
+        coap_log_warn("Received request message with invalid code class: %d", code_class);
+        return coap_msg_set_code(resp, COAP_MSG_CLIENT_ERR, COAP_MSG_BAD_REQ);
+    }
+    if ((code_detail != COAP_MSG_GET)
+     && (code_detail != COAP_MSG_PUT))
+    {
+        coap_log_warn("Received request message with unsupported code detail: %d", code_detail);
+        return coap_msg_set_code(resp, COAP_MSG_SERVER_ERR, COAP_MSG_NOT_IMPL);
+    }
+    /* request */
+    if (code_detail == COAP_MSG_GET)
+    {
+        return coap_server_trans_handle_blockwise_stream(trans, req, resp,
+                                                         STREAM_BLOCK_SIZE, STREAM_BLOCK_SIZE,
+                                                         server_stream_blockwise_read,
+                                                         NULL, NULL, NULL);
+    }
+    return coap_server_trans_handle_blockwise_stream(trans, req, resp,
+                                                     STREAM_BLOCK_SIZE, STREAM_BLOCK_SIZE,
+                                                     NULL,
+                                                     server_stream_blockwise_write,
+                                                     server_handle_stream_blockwise_rx,
+                                                     NULL);
+}
+
+/**
+ *  @brief Callback function to handle requests and generate responses
+ *
+ *  The handler function is called to service a request
+ *  for the resources that use regular transfers, including
+ *  the one that requires a separate response, and produce
+ *  a response.
+ *
+ *  @param[in,out] trans Pointer to a transaction structure
+ *  @param[in] req Pointer to the request message
+ *  @param[out] resp Pointer to the response message
+ *
+ *  @returns Operation status
+ *  @retval 0 Success
+ *  @retval <0 Error
+ */
+static int server_handle(coap_server_trans_t *trans, coap_msg_t *req, coap_msg_t *resp)
+{
+    int ret = 0;
+
+    coap_log_notice("handle regular");
+    ret = server_handle_regular(trans, req, resp);
     print_coap_msg("Received:", req);
     print_coap_msg("Sent: ", resp);
     return ret;
 }
 
+/**
+ *  @brief Resource registration structure
+ */
+typedef struct
+{
+    const char *str;                                                            /**< String representation of the URI path */
+    coap_msg_method_t method;                                                   /**< Request method */
+    coap_server_trans_handler_t handle;                                         /**< Call-back function to handle requests for the resource */
+}
+server_res_t;
+
+/**
+ *  @brief Resources handled by the test server
+ *
+ *  The server has no fallback handler so a request for a
+ *  URI path that is not in this table gets a 4.04 response
+ *  and a request with a method that is not registered for
+ *  its URI path gets a 4.05 response.
+ */
+static server_res_t server_res[] =
+{
+    {"/"RESET_URI_PATH,               COAP_MSG_GET,    server_handle_reset},
+    {"/"REGULAR_URI_PATH,             COAP_MSG_GET,    server_handle},
+    {"/"REGULAR_URI_PATH,             COAP_MSG_PUT,    server_handle},
+    {"/"REGULAR_URI_PATH,             COAP_MSG_POST,   server_handle},
+    {SEP_URI_PATH,                    COAP_MSG_GET,    server_handle},
+    {"/"UNSAFE_URI_PATH,              COAP_MSG_GET,    server_handle_unsafe},
+    {"/"APP_LEVEL_BLOCKWISE_URI_PATH, COAP_MSG_GET,    server_handle_app_level_blockwise},
+    {"/"APP_LEVEL_BLOCKWISE_URI_PATH, COAP_MSG_PUT,    server_handle_app_level_blockwise},
+    {"/"LIB_LEVEL_BLOCKWISE_URI_PATH, COAP_MSG_GET,    server_handle_lib_level_blockwise},
+    {"/"LIB_LEVEL_BLOCKWISE_URI_PATH, COAP_MSG_PUT,    server_handle_lib_level_blockwise},
+    {"/"LIB_LEVEL_BLOCKWISE_URI_PATH, COAP_MSG_POST,   server_handle_lib_level_blockwise},
+    {"/"STREAM_BLOCKWISE_URI_PATH,    COAP_MSG_GET,    server_handle_stream_blockwise},
+    {"/"STREAM_BLOCKWISE_URI_PATH,    COAP_MSG_PUT,    server_handle_stream_blockwise},
+    {"/"OBSERVE_URI_PATH,             COAP_MSG_GET,    server_handle_observe},
+    {"/"OBSERVE_URI_PATH,             COAP_MSG_PUT,    server_handle_observe},
+    {"/"CACHE_URI_PATH,               COAP_MSG_GET,    server_handle_cache},
+    {"/"CACHE_URI_PATH,               COAP_MSG_PUT,    server_handle_cache},
+    {"/"CACHE_URI_PATH,               COAP_MSG_DELETE, server_handle_cache},
+    {"/"VALID_URI_PATH,               COAP_MSG_GET,    server_handle_valid},
+    {"/"VALID_URI_PATH,               COAP_MSG_PUT,    server_handle_valid},
+    {"/"VALID_URI_PATH,               COAP_MSG_DELETE, server_handle_valid},
+    {"/"SLOW_URI_PATH,                COAP_MSG_GET,    server_handle_slow},
+    {"/"SLOW_BLOCKWISE_URI_PATH,      COAP_MSG_GET,    server_handle_slow_blockwise}
+};
+
 /**
  *  @brief Main function for the CoAP server test application
  *
@@ -633,6 +1107,7 @@ int main(void)
 #ifdef COAP_DTLS_EN
     const char *gnutls_ver = NULL;
 #endif
+    size_t i = 0;
     int ret = 0;
 
     coap_log_set_level(COAP_LOG_INFO);
@@ -655,9 +1130,9 @@ int main(void)
     }
     coap_log_info("GnuTLS version: %s", gnutls_ver);
 
-    ret = coap_server_create(&server, server_handle, HOST, PORT, KEY_FILE_NAME, CERT_FILE_NAME, TRUST_FILE_NAME, CRL_FILE_NAME);
+    ret = coap_server_create(&server, NULL, HOST, PORT, NUM_TRANS, KEY_FILE_NAME, CERT_FILE_NAME, TRUST_FILE_NAME, CRL_FILE_NAME);
 #else
-    ret = coap_server_create(&server, server_handle, HOST, PORT);
+    ret = coap_server_create(&server, NULL, HOST, PORT, NUM_TRANS);
 #endif
     if (ret < 0)
     {
@@ -669,6 +1144,17 @@ int main(void)
         coap_mem_all_destroy();
         return EXIT_FAILURE;
     }
+    for (i = 0; i < sizeof(server_res) / sizeof(server_res[0]); i++)
+    {
+        ret = coap_server_add_resource(&server, server_res[i].str, server_res[i].method, server_res[i].handle);
+        if (ret < 0)
+        {
+            coap_log_error("%s", strerror(-ret));
+            coap_server_destroy(&server);
+            coap_mem_all_destroy();
+            return EXIT_FAILURE;
+        }
+    }
     ret = coap_server_add_sep_resp_uri_path(&server, SEP_URI_PATH);
     if (ret < 0)
     {
@@ -677,7 +1163,19 @@ int main(void)
         coap_mem_all_destroy();
         return EXIT_FAILURE;
     }
+    ret = coap_server_cache_create(&server, 0);
+    if (ret < 0)
+    {
+        coap_log_error("%s", strerror(-ret));
+        coap_server_destroy(&server);
+        coap_mem_all_destroy();
+        return EXIT_FAILURE;
+    }
+#ifdef COAP_SERVER_THREAD_EN
+    ret = coap_server_run_workers(&server, NUM_WORKERS);
+#else
     ret = coap_server_run(&server);
+#endif
     if (ret < 0)
     {
         if (ret != -1)
@@ -35,6 +35,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
 #include <getopt.h>
 #include <netinet/in.h>
 #include <gnutls/gnutls.h>
@@ -53,8 +54,10 @@
 #endif
 #ifdef COAP_IP6
 #define SERVER_HOST                         "[::1]"                             /**< Host address of the server */
+#define SERVER_ALT_HOST                     "[0::1]"                            /**< Another name for the host address of the server */
 #else
 #define SERVER_HOST                         "127.0.0.1"                         /**< Host address of the server */
+#define SERVER_ALT_HOST                     "localhost"                         /**< Another name for the host address of the server */
 #endif
 #define PROXY_PORT                          "12437"                             /**< TCP port number of the proxy */
 #define TRUST_FILE_NAME                     "../../certs/root_server_cert.pem"  /**< TLS trust file name */
@@ -69,8 +72,22 @@
 #define REGULAR_URI_PATH_LEN                7                                   /**< Length of the URI path that causes the server to use regular (i.e. non-blockwise) transfers */
 #define LIB_LEVEL_BLOCKWISE_URI_PATH        "lib-level-blockwise"               /**< URI path that causes the server to use library-level blockwise transfers */
 #define LIB_LEVEL_BLOCKWISE_URI_PATH_LEN    19                                  /**< Length of the URI path that causes the server to use library-level blockwise transfers */
+#define STREAM_BLOCKWISE_URI_PATH           "stream-blockwise"                  /**< URI path that causes the server to use streaming library-level blockwise transfers */
+#define STREAM_BLOCKWISE_URI_PATH_LEN       16                                  /**< Length of the URI path that causes the server to use streaming library-level blockwise transfers */
+#define CACHE_URI_PATH                      "cache"                             /**< URI path of a resource whose responses are cached */
+#define CACHE_URI_PATH_LEN                  5                                   /**< Length of the URI path of a resource whose responses are cached */
+#define VALID_URI_PATH                      "valid"                             /**< URI path of a resource whose cached responses are revalidated */
+#define VALID_URI_PATH_LEN                  5                                   /**< Length of the URI path of a resource whose cached responses are revalidated */
+#define SLOW_URI_PATH                       "slow"                              /**< URI path of a resource that is slow to respond */
+#define SLOW_URI_PATH_LEN                   4                                   /**< Length of the URI path of a resource that is slow to respond */
+#define SLOW_BLOCKWISE_URI_PATH             "slow-blockwise"                    /**< URI path of a resource that is slow to respond and uses library-level blockwise transfers */
+#define SLOW_BLOCKWISE_URI_PATH_LEN         14                                  /**< Length of the URI path of a resource that is slow to respond and uses library-level blockwise transfers */
+#define STREAM_BLOCKWISE_BODY_LEN           10000                               /**< Length of the body used in streaming library-level blockwise transfers */
 #define SOCKET_TIMEOUT                      120                                 /**< Timeout for TLS/IPv6 socket operations */
-#define RESP_BUF_LEN                        1024                                /**< Size of the buffer used to store responses */
+#define RESP_BUF_LEN                        16384                               /**< Size of the buffer used to store responses */
+#define MAX_CONCURRENT                      4                                   /**< Maximum number of requests sent at the same time */
+#define STALE_DELAY                         2                                   /**< Number of seconds after which the responses cached from the resource whose cached responses are revalidated are stale */
+#define IDLE_DELAY                          4                                   /**< Number of seconds after which the proxy has closed idle CoAP clients */
 
 /**
  *  @brief HTTP client test message data structure
@@ -83,6 +100,7 @@ typedef struct
     const char **name;                                                          /**< Array of header names expected in the HTTP response */
     const char **value;                                                         /**< Array of header values expected in the HTTP response */
     const char *body;                                                           /**< String containing the expected body in the HTTP response */
+    unsigned delay;                                                             /**< Number of seconds to wait before sending the HTTP request */
 }
 test_http_client_msg_t;
 
@@ -94,6 +112,7 @@ typedef struct
     const char *desc;                                                           /**< Test description */
     test_http_client_msg_t *msg;                                                /**< Array of test message structures */
     size_t num_msg;                                                             /**< Length of the array of test message structures */
+    size_t num_concurrent;                                                      /**< Number of messages at the start of the array that are sent at the same time on separate connections */
 }
 test_http_client_data_t;
 
@@ -287,8 +306,8 @@ test_http_client_data_t test7_data =
 #define TEST8_NUM_HEADERS  1
 
 const char *test8_start[HTTP_MSG_NUM_START] = {"HTTP/1.1", "200", "OK"};
-const char *test8_name[TEST8_NUM_HEADERS] = {"Content-Length"};
-const char *test8_value[TEST8_NUM_HEADERS] = {"72"};
+const char *test8_name[TEST8_NUM_HEADERS] = {"Transfer-Encoding"};
+const char *test8_value[TEST8_NUM_HEADERS] = {"chunked"};
 
 test_http_client_msg_t test8_msg[TEST8_NUM_MSGS] =
 {
@@ -313,8 +332,8 @@ test_http_client_data_t test8_data =
 #define TEST9_NUM_HEADERS  1
 
 const char *test9_start[HTTP_MSG_NUM_START] = {"HTTP/1.1", "200", "OK"};
-const char *test9_name[TEST9_NUM_HEADERS] = {"Content-Length"};
-const char *test9_value[TEST9_NUM_HEADERS] = {"72"};
+const char *test9_name[TEST9_NUM_HEADERS] = {"Transfer-Encoding"};
+const char *test9_value[TEST9_NUM_HEADERS] = {"chunked"};
 
 test_http_client_msg_t test9_msg[TEST9_NUM_MSGS] =
 {
@@ -348,8 +367,8 @@ test_http_client_data_t test9_data =
 #define TEST10_NUM_HEADERS  1
 
 const char *test10_start[HTTP_MSG_NUM_START] = {"HTTP/1.1", "200", "OK"};
-const char *test10_name[TEST10_NUM_HEADERS] = {"Content-Length"};
-const char *test10_value[TEST10_NUM_HEADERS] = {"72"};
+const char *test10_name[TEST10_NUM_HEADERS] = {"Transfer-Encoding"};
+const char *test10_value[TEST10_NUM_HEADERS] = {"chunked"};
 
 test_http_client_msg_t test10_msg[TEST10_NUM_MSGS] =
 {
@@ -379,6 +398,470 @@ test_http_client_data_t test10_data =
     .num_msg = TEST10_NUM_MSGS
 };
 
+/**
+ *  @brief Body used in streaming library-level blockwise transfers
+ *
+ *  The byte at offset i is 'a' + (i % 26). The buffer
+ *  is filled in by test_stream_body_init.
+ */
+static char test_stream_body[STREAM_BLOCKWISE_BODY_LEN + 1] = {0};
+
+#define TEST11_NUM_MSGS     1
+#define TEST11_NUM_HEADERS  1
+
+const char *test11_start[HTTP_MSG_NUM_START] = {"HTTP/1.1", "200", "OK"};
+const char *test11_name[TEST11_NUM_HEADERS] = {"Transfer-Encoding"};
+const char *test11_value[TEST11_NUM_HEADERS] = {"chunked"};
+
+test_http_client_msg_t test11_msg[TEST11_NUM_MSGS] =
+{
+    {
+        .req_str = "GET coaps://"SERVER_HOST":12436/"STREAM_BLOCKWISE_URI_PATH" HTTP/1.1\r\nContent-Length: 0\r\n\r\n",
+        .start = test11_start,
+        .num_headers = TEST11_NUM_HEADERS,
+        .name = test11_name,
+        .value = test11_value,
+        .body = test_stream_body
+    }
+};
+
+test_http_client_data_t test11_data =
+{
+    .desc = "test 11: perform a GET request that invokes a blockwise transfer from the server with a body larger than the proxy body buffer",
+    .msg = test11_msg,
+    .num_msg = TEST11_NUM_MSGS
+};
+
+#define TEST12_NUM_MSGS     3
+#define TEST12_NUM_HEADERS  2
+
+const char *test12_start[HTTP_MSG_NUM_START] = {"HTTP/1.1", "200", "OK"};
+const char *test12_name[TEST12_NUM_HEADERS] = {"Content-Length", "Etag"};
+const char *test12_value[TEST12_NUM_HEADERS] = {"16", "f"};
+
+test_http_client_msg_t test12_msg[TEST12_NUM_MSGS] =
+{
+    {
+        .req_str = "PUT coaps://"SERVER_HOST":12436/"CACHE_URI_PATH" HTTP/1.1\r\nContent-Length: 16\r\n\r\n0123456789abcdef",
+        .start = test12_start,
+        .num_headers = 0,
+        .name = NULL,
+        .value = NULL,
+        .body = NULL
+    },
+    {
+        .req_str = "GET coaps://"SERVER_HOST":12436/"CACHE_URI_PATH" HTTP/1.1\r\n\r\n",
+        .start = test12_start,
+        .num_headers = TEST12_NUM_HEADERS,
+        .name = test12_name,
+        .value = test12_value,
+        .body = "0123456789abcdef"
+    },
+    {
+        /* the server changes the representation after each GET */
+        /* request so an unchanged response comes from the proxy */
+        .req_str = "GET coaps://"SERVER_HOST":12436/"CACHE_URI_PATH" HTTP/1.1\r\n\r\n",
+        .start = test12_start,
+        .num_headers = TEST12_NUM_HEADERS,
+        .name = test12_name,
+        .value = test12_value,
+        .body = "0123456789abcdef"
+    }
+};
+
+test_http_client_data_t test12_data =
+{
+    .desc = "test 12: Send a PUT request followed by two GET requests for a resource whose responses are cached",
+    .msg = test12_msg,
+    .num_msg = TEST12_NUM_MSGS
+};
+
+#define TEST13_NUM_MSGS     4
+#define TEST13_NUM_HEADERS  2
+
+const char *test13_ok_start[HTTP_MSG_NUM_START] = {"HTTP/1.1", "200", "OK"};
+const char *test13_not_found_start[HTTP_MSG_NUM_START] = {"HTTP/1.1", "404", "Not Found"};
+const char *test13_name[TEST13_NUM_HEADERS] = {"Content-Length", "Etag"};
+const char *test13_value[TEST13_NUM_HEADERS] = {"16", "f"};
+
+test_http_client_msg_t test13_msg[TEST13_NUM_MSGS] =
+{
+    {
+        .req_str = "PUT coaps://"SERVER_HOST":12436/"CACHE_URI_PATH" HTTP/1.1\r\nContent-Length: 16\r\n\r\n0123456789abcdef",
+        .start = test13_ok_start,
+        .num_headers = 0,
+        .name = NULL,
+        .value = NULL,
+        .body = NULL
+    },
+    {
+        .req_str = "GET coaps://"SERVER_HOST":12436/"CACHE_URI_PATH" HTTP/1.1\r\n\r\n",
+        .start = test13_ok_start,
+        .num_headers = TEST13_NUM_HEADERS,
+        .name = test13_name,
+        .value = test13_value,
+        .body = "0123456789abcdef"
+    },
+    {
+        .req_str = "DELETE coaps://"SERVER_HOST":12436/"CACHE_URI_PATH" HTTP/1.1\r\nContent-Length: 0\r\n\r\n",
+        .start = test13_ok_start,
+        .num_headers = 0,
+        .name = NULL,
+        .value = NULL,
+        .body = NULL
+    },
+    {
+        /* a response from the cache would still contain the representation */
+        .req_str = "GET coaps://"SERVER_HOST":12436/"CACHE_URI_PATH" HTTP/1.1\r\n\r\n",
+        .start = test13_not_found_start,
+        .num_headers = 0,
+        .name = NULL,
+        .value = NULL,
+        .body = NULL
+    }
+};
+
+test_http_client_data_t test13_data =
+{
+    .desc = "test 13: Send a DELETE request for a resource whose response is cached followed by a GET request",
+    .msg = test13_msg,
+    .num_msg = TEST13_NUM_MSGS
+};
+
+#define TEST14_NUM_MSGS        2
+#define TEST14_NUM_CONCURRENT  2
+#define TEST14_NUM_HEADERS     1
+
+const char *test14_start[HTTP_MSG_NUM_START] = {"HTTP/1.1", "200", "OK"};
+const char *test14_name[TEST14_NUM_HEADERS] = {"Content-Length"};
+const char *test14_value1[TEST14_NUM_HEADERS] = {"1"};
+const char *test14_value2[TEST14_NUM_HEADERS] = {"16"};
+
+test_http_client_msg_t test14_msg[TEST14_NUM_MSGS] =
+{
+    {
+        .req_str = "GET coaps://"SERVER_HOST":12436/"SLOW_URI_PATH" HTTP/1.1\r\n\r\n",
+        .start = test14_start,
+        .num_headers = TEST14_NUM_HEADERS,
+        .name = test14_name,
+        .value = test14_value1,
+        .body = "1"
+    },
+    {
+        /* the proxy allows one client per server so this */
+        /* request waits for the client used by the other */
+        .req_str = "GET coaps://"SERVER_HOST":12436/"REGULAR_URI_PATH" HTTP/1.1\r\n\r\n",
+        .start = test14_start,
+        .num_headers = TEST14_NUM_HEADERS,
+        .name = test14_name,
+        .value = test14_value2,
+        .body = "qwertyuiopasdfgh"
+    }
+};
+
+test_http_client_data_t test14_data =
+{
+    .desc = "test 14: Send two different GET requests to the same server at the same time on separate connections",
+    .msg = test14_msg,
+    .num_msg = TEST14_NUM_MSGS,
+    .num_concurrent = TEST14_NUM_CONCURRENT
+};
+
+#define TEST15_NUM_MSGS     4
+#define TEST15_NUM_HEADERS  1
+
+const char *test15_start[HTTP_MSG_NUM_START] = {"HTTP/1.1", "200", "OK"};
+const char *test15_name[TEST15_NUM_HEADERS] = {"Content-Length"};
+const char *test15_value[TEST15_NUM_HEADERS] = {"16"};
+
+test_http_client_msg_t test15_msg[TEST15_NUM_MSGS] =
+{
+    {
+        .req_str = "GET coaps://"SERVER_HOST":12436/"REGULAR_URI_PATH" HTTP/1.1\r\n\r\n",
+        .start = test15_start,
+        .num_headers = TEST15_NUM_HEADERS,
+        .name = test15_name,
+        .value = test15_value,
+        .body = "qwertyuiopasdfgh"
+    },
+    {
+        .req_str = "GET coaps://"SERVER_ALT_HOST":12436/"REGULAR_URI_PATH" HTTP/1.1\r\n\r\n",
+        .start = test15_start,
+        .num_headers = TEST15_NUM_HEADERS,
+        .name = test15_name,
+        .value = test15_value,
+        .body = "qwertyuiopasdfgh"
+    },
+    {
+        .req_str = "GET coaps://"SERVER_HOST":12436/"REGULAR_URI_PATH" HTTP/1.1\r\n\r\n",
+        .start = test15_start,
+        .num_headers = TEST15_NUM_HEADERS,
+        .name = test15_name,
+        .value = test15_value,
+        .body = "qwertyuiopasdfgh"
+    },
+    {
+        /* the client for this server has been closed */
+        /* as idle by the time this request is sent   */
+        .req_str = "GET coaps://"SERVER_ALT_HOST":12436/"REGULAR_URI_PATH" HTTP/1.1\r\n\r\n",
+        .start = test15_start,
+        .num_headers = TEST15_NUM_HEADERS,
+        .name = test15_name,
+        .value = test15_value,
+        .body = "qwertyuiopasdfgh",
+        .delay = IDLE_DELAY
+    }
+};
+
+test_http_client_data_t test15_data =
+{
+    .desc = "test 15: Send GET requests to the same server under two host names in turn and again after the clients have been idle",
+    .msg = test15_msg,
+    .num_msg = TEST15_NUM_MSGS
+};
+
+#define TEST16_NUM_MSGS        3
+#define TEST16_NUM_CONCURRENT  2
+#define TEST16_NUM_HEADERS     1
+
+const char *test16_start[HTTP_MSG_NUM_START] = {"HTTP/1.1", "200", "OK"};
+const char *test16_name[TEST16_NUM_HEADERS] = {"Content-Length"};
+const char *test16_value[TEST16_NUM_HEADERS] = {"1"};
+
+test_http_client_msg_t test16_msg[TEST16_NUM_MSGS] =
+{
+    {
+        .req_str = "GET coaps://"SERVER_HOST":12436/"SLOW_URI_PATH" HTTP/1.1\r\n\r\n",
+        .start = test16_start,
+        .num_headers = TEST16_NUM_HEADERS,
+        .name = test16_name,
+        .value = test16_value,
+        .body = "1"
+    },
+    {
+        /* the server counts the requests it receives so */
+        /* both responses come from the same exchange    */
+        .req_str = "GET coaps://"SERVER_HOST":12436/"SLOW_URI_PATH" HTTP/1.1\r\n\r\n",
+        .start = test16_start,
+        .num_headers = TEST16_NUM_HEADERS,
+        .name = test16_name,
+        .value = test16_value,
+        .body = "1"
+    },
+    {
+        .req_str = "GET coaps://"SERVER_HOST":12436/"SLOW_URI_PATH" HTTP/1.1\r\n\r\n",
+        .start = test16_start,
+        .num_headers = TEST16_NUM_HEADERS,
+        .name = test16_name,
+        .value = test16_value,
+        .body = "2"
+    }
+};
+
+test_http_client_data_t test16_data =
+{
+    .desc = "test 16: Send two identical GET requests at the same time on separate connections followed by another GET request",
+    .msg = test16_msg,
+    .num_msg = TEST16_NUM_MSGS,
+    .num_concurrent = TEST16_NUM_CONCURRENT
+};
+
+#define TEST17_NUM_MSGS        2
+#define TEST17_NUM_CONCURRENT  2
+#define TEST17_NUM_HEADERS     1
+
+const char *test17_start[HTTP_MSG_NUM_START] = {"HTTP/1.1", "200", "OK"};
+const char *test17_name[TEST17_NUM_HEADERS] = {"Transfer-Encoding"};
+const char *test17_value[TEST17_NUM_HEADERS] = {"chunked"};
+
+test_http_client_msg_t test17_msg[TEST17_NUM_MSGS] =
+{
+    {
+        .req_str = "GET coaps://"SERVER_HOST":12436/"SLOW_BLOCKWISE_URI_PATH" HTTP/1.1\r\n\r\n",
+        .start = test17_start,
+        .num_headers = TEST17_NUM_HEADERS,
+        .name = test17_name,
+        .value = test17_value,
+        .body = "0123456789abcdefghijABCDEFGHIJasdfghjklpqlfktnghrexi49s1zlkdfiecvntfbghq"
+    },
+    {
+        /* a blockwise response cannot be shared so this */
+        /* request is sent again after the first block   */
+        .req_str = "GET coaps://"SERVER_HOST":12436/"SLOW_BLOCKWISE_URI_PATH" HTTP/1.1\r\n\r\n",
+        .start = test17_start,
+        .num_headers = TEST17_NUM_HEADERS,
+        .name = test17_name,
+        .value = test17_value,
+        .body = "0123456789abcdefghijABCDEFGHIJasdfghjklpqlfktnghrexi49s1zlkdfiecvntfbghq"
+    }
+};
+
+test_http_client_data_t test17_data =
+{
+    .desc = "test 17: Send two identical GET requests that invoke blockwise transfers from the server at the same time on separate connections",
+    .msg = test17_msg,
+    .num_msg = TEST17_NUM_MSGS,
+    .num_concurrent = TEST17_NUM_CONCURRENT
+};
+
+#define TEST18_NUM_MSGS     6
+#define TEST18_NUM_HEADERS  2
+
+const char *test18_start[HTTP_MSG_NUM_START] = {"HTTP/1.1", "200", "OK"};
+const char *test18_name[TEST18_NUM_HEADERS] = {"Content-Length", "Etag"};
+const char *test18_value[TEST18_NUM_HEADERS] = {"16", "f"};
+
+test_http_client_msg_t test18_msg[TEST18_NUM_MSGS] =
+{
+    {
+        .req_str = "PUT coaps://"SERVER_HOST":12436/"VALID_URI_PATH" HTTP/1.1\r\nContent-Length: 16\r\n\r\n0123456789abcdef",
+        .start = test18_start,
+        .num_headers = 0,
+        .name = NULL,
+        .value = NULL,
+        .body = NULL
+    },
+    {
+        .req_str = "GET coaps://"SERVER_HOST":12436/"VALID_URI_PATH" HTTP/1.1\r\n\r\n",
+        .start = test18_start,
+        .num_headers = TEST18_NUM_HEADERS,
+        .name = test18_name,
+        .value = test18_value,
+        .body = "0123456789abcdef"
+    },
+    {
+        /* the other host name leaves the cached response in place */
+        /* and the new representation keeps the same ETag         */
+        .req_str = "PUT coaps://"SERVER_ALT_HOST":12436/"VALID_URI_PATH" HTTP/1.1\r\nContent-Length: 16\r\n\r\n9876543210abcdef",
+        .start = test18_start,
+        .num_headers = 0,
+        .name = NULL,
+        .value = NULL,
+        .body = NULL
+    },
+    {
+        /* the server answers the revalidation with 2.03 (Valid) */
+        /* so the stale response is served from the cache         */
+        .req_str = "GET coaps://"SERVER_HOST":12436/"VALID_URI_PATH" HTTP/1.1\r\n\r\n",
+        .start = test18_start,
+        .num_headers = TEST18_NUM_HEADERS,
+        .name = test18_name,
+        .value = test18_value,
+        .body = "0123456789abcdef",
+        .delay = STALE_DELAY
+    },
+    {
+        .req_str = "PUT coaps://"SERVER_ALT_HOST":12436/"VALID_URI_PATH" HTTP/1.1\r\nContent-Length: 16\r\n\r\n0123456789abcdeg",
+        .start = test18_start,
+        .num_headers = 0,
+        .name = NULL,
+        .value = NULL,
+        .body = NULL
+    },
+    {
+        /* the 2.03 (Valid) response kept the cached response */
+        /* fresh for longer than the original response did    */
+        .req_str = "GET coaps://"SERVER_HOST":12436/"VALID_URI_PATH" HTTP/1.1\r\n\r\n",
+        .start = test18_start,
+        .num_headers = TEST18_NUM_HEADERS,
+        .name = test18_name,
+        .value = test18_value,
+        .body = "0123456789abcdef",
+        .delay = STALE_DELAY
+    }
+};
+
+test_http_client_data_t test18_data =
+{
+    .desc = "test 18: Send GET requests for a resource whose cached response becomes stale and is revalidated",
+    .msg = test18_msg,
+    .num_msg = TEST18_NUM_MSGS
+};
+
+#define TEST19_NUM_MSGS     6
+#define TEST19_NUM_HEADERS  2
+
+const char *test19_ok_start[HTTP_MSG_NUM_START] = {"HTTP/1.1", "200", "OK"};
+const char *test19_not_found_start[HTTP_MSG_NUM_START] = {"HTTP/1.1", "404", "Not Found"};
+const char *test19_name[TEST19_NUM_HEADERS] = {"Content-Length", "Etag"};
+const char *test19_value[TEST19_NUM_HEADERS] = {"16", "f"};
+
+test_http_client_msg_t test19_msg[TEST19_NUM_MSGS] =
+{
+    {
+        .req_str = "PUT coaps://"SERVER_HOST":12436/"VALID_URI_PATH" HTTP/1.1\r\nContent-Length: 16\r\n\r\n0123456789abcdef",
+        .start = test19_ok_start,
+        .num_headers = 0,
+        .name = NULL,
+        .value = NULL,
+        .body = NULL
+    },
+    {
+        .req_str = "GET coaps://"SERVER_HOST":12436/"VALID_URI_PATH" HTTP/1.1\r\n\r\n",
+        .start = test19_ok_start,
+        .num_headers = TEST19_NUM_HEADERS,
+        .name = test19_name,
+        .value = test19_value,
+        .body = "0123456789abcdef"
+    },
+    {
+        /* the other host name leaves the cached response in place */
+        .req_str = "DELETE coaps://"SERVER_ALT_HOST":12436/"VALID_URI_PATH" HTTP/1.1\r\nContent-Length: 0\r\n\r\n",
+        .start = test19_ok_start,
+        .num_headers = 0,
+        .name = NULL,
+        .value = NULL,
+        .body = NULL
+    },
+    {
+        .req_str = "GET coaps://"SERVER_HOST":12436/"VALID_URI_PATH" HTTP/1.1\r\n\r\n",
+        .start = test19_not_found_start,
+        .num_headers = 0,
+        .name = NULL,
+        .value = NULL,
+        .body = NULL,
+        .delay = STALE_DELAY
+    },
+    {
+        .req_str = "PUT coaps://"SERVER_ALT_HOST":12436/"VALID_URI_PATH" HTTP/1.1\r\nContent-Length: 16\r\n\r\n9876543210abcdef",
+        .start = test19_ok_start,
+        .num_headers = 0,
+        .name = NULL,
+        .value = NULL,
+        .body = NULL
+    },
+    {
+        /* a cached response left in place would be revalidated */
+        /* with the same ETag and served instead of this one    */
+        .req_str = "GET coaps://"SERVER_HOST":12436/"VALID_URI_PATH" HTTP/1.1\r\n\r\n",
+        .start = test19_ok_start,
+        .num_headers = TEST19_NUM_HEADERS,
+        .name = test19_name,
+        .value = test19_value,
+        .body = "9876543210abcdef"
+    }
+};
+
+test_http_client_data_t test19_data =
+{
+    .desc = "test 19: Send GET requests for a resource whose cached response becomes stale after the resource has been deleted",
+    .msg = test19_msg,
+    .num_msg = TEST19_NUM_MSGS
+};
+
+/**
+ *  @brief Fill in the body used in streaming library-level blockwise transfers
+ */
+static void test_stream_body_init(void)
+{
+    size_t i = 0;
+
+    for (i = 0; i < STREAM_BLOCKWISE_BODY_LEN; i++)
+    {
+        test_stream_body[i] = 'a' + (i % 26);
+    }
+}
+
 /**
  *  @brief TLS client context used by all tests
  */
@@ -531,6 +1014,61 @@ static test_result_t send_reset(void)
     return 0;
 }
 
+/**
+ *  @brief Receive a response from the proxy and compare it with expected values
+ *
+ *  @param[in,out] s Pointer to a TLS socket structure
+ *  @param[in] test_msg Pointer to a HTTP client test message structure
+ *
+ *  @returns Test result
+ */
+static test_result_t test_recv_resp(tls_sock_t *s, test_http_client_msg_t *test_msg)
+{
+    test_result_t result = PASS;
+    http_msg_t resp_msg = {{0}};
+    size_t resp_len = 0;
+    char resp_buf[RESP_BUF_LEN] = {0};
+    int ret = 0;
+
+    /* a chunked response may arrive in several reads */
+    while (1)
+    {
+        ret = tls_sock_read(s, resp_buf + resp_len, sizeof(resp_buf) - 1 - resp_len);
+        if (ret <= 0)
+        {
+            return FAIL;
+        }
+        resp_len += ret;
+        http_msg_create(&resp_msg);
+        ret = http_msg_parse(&resp_msg, resp_buf, resp_len);
+        if (ret != -EAGAIN)
+        {
+            break;
+        }
+        http_msg_destroy(&resp_msg);
+    }
+    coap_log_info("Received:\n%s", resp_buf);
+    if (ret <= 0)
+    {
+        http_msg_destroy(&resp_msg);
+        return FAIL;
+    }
+    if (check_start(test_msg, &resp_msg) != PASS)
+    {
+        result = FAIL;
+    }
+    if (check_headers(test_msg, &resp_msg) != PASS)
+    {
+        result = FAIL;
+    }
+    if (check_body(test_msg, &resp_msg) != PASS)
+    {
+        result = FAIL;
+    }
+    http_msg_destroy(&resp_msg);
+    return result;
+}
+
 /**
  *  @brief Test an exchange with the proxy
  *
@@ -542,10 +1080,8 @@ static test_result_t test_exchange_func(test_data_t data)
 {
     test_http_client_data_t *test_data = (test_http_client_data_t *)data;
     test_result_t result = PASS;
-    http_msg_t resp_msg = {{0}};
     tls_sock_t s = {0};
     unsigned i = 0;
-    char resp_buf[RESP_BUF_LEN] = {0};
     int ret = 0;
 
     printf("%s\n", test_data->desc);
@@ -559,6 +1095,10 @@ static test_result_t test_exchange_func(test_data_t data)
     }
     for (i = 0; i < test_data->num_msg; i++)
     {
+        if (test_data->msg[i].delay > 0)
+        {
+            sleep(test_data->msg[i].delay);
+        }
         ret = tls_sock_write_full(&s, test_data->msg[i].req_str, strlen(test_data->msg[i].req_str));
         if (ret <= 0)
         {
@@ -566,36 +1106,85 @@ static test_result_t test_exchange_func(test_data_t data)
             return FAIL;
         }
         coap_log_info("Sent:\n%s", test_data->msg[i].req_str);
-        ret = tls_sock_read(&s, resp_buf, sizeof(resp_buf));
-        if (ret <= 0)
+        if (test_recv_resp(&s, &test_data->msg[i]) != PASS)
         {
-            tls_sock_close(&s);
-            return FAIL;
+            result = FAIL;
         }
-        coap_log_info("Received:\n%s", resp_buf);
-        http_msg_create(&resp_msg);
-        ret = http_msg_parse(&resp_msg, resp_buf, strlen(resp_buf));
+    }
+    tls_sock_close(&s);
+    return result;
+}
+
+/**
+ *  @brief Test exchanges with the proxy that are in progress at the same time
+ *
+ *  The first num_concurrent messages are sent on separate
+ *  connections before any response is read. The remaining
+ *  messages are then exchanged in turn on the first
+ *  connection.
+ *
+ *  @param[in] data Pointer to a HTTP client test data structure
+ *
+ *  @returns Test result
+ */
+static test_result_t test_concurrent_func(test_data_t data)
+{
+    test_http_client_data_t *test_data = (test_http_client_data_t *)data;
+    test_result_t result = PASS;
+    tls_sock_t s[MAX_CONCURRENT] = {{0}};
+    unsigned num_open = 0;
+    unsigned i = 0;
+    int ret = 0;
+
+    printf("%s\n", test_data->desc);
+
+    send_reset();
+
+    for (i = 0; i < test_data->num_concurrent; i++)
+    {
+        ret = tls_sock_open(&s[i], &client, PROXY_HOST, PROXY_PORT, SERVER_COMMON_NAME, SOCKET_TIMEOUT);
+        if (ret != SOCK_OK)
+        {
+            result = FAIL;
+            break;
+        }
+        num_open++;
+    }
+    for (i = 0; (i < num_open) && (result == PASS); i++)
+    {
+        ret = tls_sock_write_full(&s[i], test_data->msg[i].req_str, strlen(test_data->msg[i].req_str));
         if (ret <= 0)
         {
-            http_msg_destroy(&resp_msg);
-            tls_sock_close(&s);
-            return FAIL;
+            result = FAIL;
+            break;
         }
-        if (check_start(&test_data->msg[i], &resp_msg) != PASS)
+        coap_log_info("Sent:\n%s", test_data->msg[i].req_str);
+    }
+    for (i = 0; (i < num_open) && (result == PASS); i++)
+    {
+        if (test_recv_resp(&s[i], &test_data->msg[i]) != PASS)
         {
             result = FAIL;
         }
-        if (check_headers(&test_data->msg[i], &resp_msg) != PASS)
+    }
+    for (i = test_data->num_concurrent; (i < test_data->num_msg) && (result == PASS); i++)
+    {
+        ret = tls_sock_write_full(&s[0], test_data->msg[i].req_str, strlen(test_data->msg[i].req_str));
+        if (ret <= 0)
         {
             result = FAIL;
+            break;
         }
-        if (check_body(&test_data->msg[i], &resp_msg) != PASS)
+        coap_log_info("Sent:\n%s", test_data->msg[i].req_str);
+        if (test_recv_resp(&s[0], &test_data->msg[i]) != PASS)
         {
             result = FAIL;
         }
-        http_msg_destroy(&resp_msg);
     }
-    tls_sock_close(&s);
+    for (i = 0; i < num_open; i++)
+    {
+        tls_sock_close(&s[i]);
+    }
     return result;
 }
 
@@ -638,7 +1227,16 @@ int main(int argc, char **argv)
                       {test_exchange_func, &test7_data},
                       {test_exchange_func, &test8_data},
                       {test_exchange_func, &test9_data},
-                      {test_exchange_func, &test10_data}};
+                      {test_exchange_func, &test10_data},
+                      {test_exchange_func, &test11_data},
+                      {test_exchange_func, &test12_data},
+                      {test_exchange_func, &test13_data},
+                      {test_concurrent_func, &test14_data},
+                      {test_exchange_func, &test15_data},
+                      {test_concurrent_func, &test16_data},
+                      {test_concurrent_func, &test17_data},
+                      {test_exchange_func, &test18_data},
+                      {test_exchange_func, &test19_data}};
 
     opterr = 0;
     while ((c = getopt(argc, argv, opts)) != -1)
@@ -668,6 +1266,7 @@ int main(int argc, char **argv)
     }
 
     coap_log_set_level(log_level);
+    test_stream_body_init();
 
     gnutls_ver = gnutls_check_version(NULL);
     if (gnutls_ver == NULL)
@@ -733,8 +1332,44 @@ int main(int argc, char **argv)
         num_tests = 1;
         num_pass = test_run(&tests[9], num_tests);
         break;
+    case 11:
+        num_tests = 1;
+        num_pass = test_run(&tests[10], num_tests);
+        break;
+    case 12:
+        num_tests = 1;
+        num_pass = test_run(&tests[11], num_tests);
+        break;
+    case 13:
+        num_tests = 1;
+        num_pass = test_run(&tests[12], num_tests);
+        break;
+    case 14:
+        num_tests = 1;
+        num_pass = test_run(&tests[13], num_tests);
+        break;
+    case 15:
+        num_tests = 1;
+        num_pass = test_run(&tests[14], num_tests);
+        break;
+    case 16:
+        num_tests = 1;
+        num_pass = test_run(&tests[15], num_tests);
+        break;
+    case 17:
+        num_tests = 1;
+        num_pass = test_run(&tests[16], num_tests);
+        break;
+    case 18:
+        num_tests = 1;
+        num_pass = test_run(&tests[17], num_tests);
+        break;
+    case 19:
+        num_tests = 1;
+        num_pass = test_run(&tests[18], num_tests);
+        break;
     default:
-        num_tests = 10;
+        num_tests = 19;
         num_pass = test_run(tests, num_tests);
     }
 
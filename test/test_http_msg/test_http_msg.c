@@ -1075,6 +1075,93 @@ test_http_msg_data_t test37_data =
     .exp_str_len = 1
 };
 
+#define TEST38_NUM_HEADERS  3
+
+const char *test38_start[] = {"S1", "S2", "S3 S4"};
+const char *test38_name[TEST38_NUM_HEADERS] = {"Transfer-Encoding", "name1", "name2"};
+const char *test38_value[TEST38_NUM_HEADERS] = {"chunked", "value1 continued", "value2"};
+
+test_http_msg_data_t test38_data =
+{
+    .desc = "test 38 : parse message with chunked transfer encoding, folded header and trailers one byte at a time, check message fields",
+    .str = "S1 S2 S3 S4\r\nTransfer-Encoding: chunked\r\nname1: value1\r\n continued\r\n\r\n6; param=value\r\nchunk1\r\na\r\nchunk2\r\n\r\n\r\n0\r\nname2: value2\r\n\r\n",
+    .str_len = 129,
+    .parse_buf_len = 256,
+    .generate_buf_len = 0,
+    .num_headers = TEST38_NUM_HEADERS,
+    .set_start = NULL,
+    .set_name = NULL,
+    .set_value = NULL,
+    .set_body = NULL,
+    .exp_set_start_ret = 0,
+    .exp_set_header_ret = 0,
+    .exp_set_body_ret = 0,
+    .exp_parse_ret = 129,
+    .exp_generate_ret = 0,
+    .exp_start = test38_start,
+    .exp_name = test38_name,
+    .exp_value = test38_value,
+    .exp_body = "chunk1chunk2\r\n\r\n",
+    .exp_str = NULL,
+    .exp_str_len = 0
+};
+
+#define TEST39_NUM_HEADERS  2
+
+const char *test39_start[] = {"S1", "S2", "S3"};
+const char *test39_name[TEST39_NUM_HEADERS] = {"Content-Length", "name"};
+const char *test39_value[TEST39_NUM_HEADERS] = {"10", "value"};
+
+test_http_msg_data_t test39_data =
+{
+    .desc = "test 39 : parse message with content-length one byte at a time, check message fields",
+    .str = "S1 S2 S3\r\nContent-Length: 10\r\nname:  value \r\n\r\nbody\r\nbody",
+    .str_len = 57,
+    .parse_buf_len = 256,
+    .generate_buf_len = 0,
+    .num_headers = TEST39_NUM_HEADERS,
+    .set_start = NULL,
+    .set_name = NULL,
+    .set_value = NULL,
+    .set_body = NULL,
+    .exp_set_start_ret = 0,
+    .exp_set_header_ret = 0,
+    .exp_set_body_ret = 0,
+    .exp_parse_ret = 57,
+    .exp_generate_ret = 0,
+    .exp_start = test39_start,
+    .exp_name = test39_name,
+    .exp_value = test39_value,
+    .exp_body = "body\r\nbody",
+    .exp_str = NULL,
+    .exp_str_len = 0
+};
+
+test_http_msg_data_t test40_data =
+{
+    .desc = "test 40 : parse message with chunked transfer encoding and invalid chunk data one byte at a time",
+    .str = "S1 S2 S3\r\nTransfer-Encoding: chunked\r\n\r\n6\r\nchunk1X\r\n0\r\n\r\n",
+    .str_len = 57,
+    .parse_buf_len = 256,
+    .generate_buf_len = 0,
+    .num_headers = 0,
+    .set_start = NULL,
+    .set_name = NULL,
+    .set_value = NULL,
+    .set_body = NULL,
+    .exp_set_start_ret = 0,
+    .exp_set_header_ret = 0,
+    .exp_set_body_ret = 0,
+    .exp_parse_ret = -EBADMSG,
+    .exp_generate_ret = 0,
+    .exp_start = NULL,
+    .exp_name = NULL,
+    .exp_value = NULL,
+    .exp_body = NULL,
+    .exp_str = NULL,
+    .exp_str_len = 0
+};
+
 /**
  *  @brief Check the start fields in a HTTP message
  *
@@ -1290,6 +1377,73 @@ test_result_t test_parse_check_func(test_data_t data)
     return result;
 }
 
+/**
+ *  @brief Parse a HTTP message one byte at a time and check the message fields
+ *
+ *  @param[in] data Pointer to a HTTP message test data structure
+ *
+ *  @returns Test result
+ */
+test_result_t test_parse_next_check_func(test_data_t data)
+{
+    test_http_msg_data_t *test_data = (test_http_msg_data_t *)data;
+    http_msg_parser_t parser = {0};
+    test_result_t result = PASS;
+    ssize_t num = 0;
+    size_t i = 0;
+    http_msg_t msg = {{0}};
+    char parse_buf[test_data->parse_buf_len];
+
+    printf("%s\n", test_data->desc);
+
+    snprintf(parse_buf, sizeof(parse_buf), "%s", test_data->str);
+
+    http_msg_parser_create(&parser);
+    http_msg_create(&msg);
+
+    /* parse message as it arrives */
+    for (i = 1; i <= test_data->str_len; i++)
+    {
+        num = http_msg_parse_next(&parser, &msg, parse_buf, i);
+        if (num != -EAGAIN)
+        {
+            break;
+        }
+    }
+    if (num != test_data->exp_parse_ret)
+    {
+        http_msg_destroy(&msg);
+        return FAIL;
+    }
+    if (num < 0)
+    {
+        http_msg_destroy(&msg);
+        return result;
+    }
+
+    /* the message must not be complete before its last byte */
+    if (i != test_data->str_len)
+    {
+        result = FAIL;
+    }
+
+    /* check start line */
+    test_check_start(&result, &msg, test_data->exp_start[0], test_data->exp_start[1], test_data->exp_start[2]);
+
+    /* check headers */
+    for (i = 0; i < test_data->num_headers; i++)
+    {
+        test_check_header(&result, &msg, test_data->exp_name[i], test_data->exp_value[i]);
+    }
+
+    /* check body */
+    test_check_body(&result, &msg, test_data->exp_body);
+
+    http_msg_destroy(&msg);
+
+    return result;
+}
+
 /**
  *  @brief Parse a HTTP message
  *
@@ -1700,7 +1854,10 @@ int main()
                       {test_gen_trailer_func, &test34_data},
                       {test_gen_trailer_func, &test35_data},
                       {test_gen_blank_line_func, &test36_data},
-                      {test_gen_blank_line_func, &test37_data}};
+                      {test_gen_blank_line_func, &test37_data},
+                      {test_parse_next_check_func, &test38_data},
+                      {test_parse_next_check_func, &test39_data},
+                      {test_parse_next_check_func, &test40_data}};
     unsigned num_tests = DIM(tests);
     unsigned num_pass = 0;
 